@@ -51,6 +51,7 @@
 #include <xmhf.h>
 
 #include <lockdown.h>
+#include <hashaccel.h>
 
 #if defined(__LDN_HYPERSWITCHING__)
 u32 acpi_control_portnum=0;
@@ -61,6 +62,57 @@ u32 LDN_ENV_PHYSICALMEMORYLIMIT=0; //max physical memory address permissible
  
 u32 currentenvironment = LDN_ENV_UNTRUSTED_SIGNATURE; //default to untrusted env.
 
+#if defined(__LDN_SSLPA__)
+struct __machine_networkdevices {
+  u32 bus;
+  u32 device;
+  u32 function;
+} machine_networkdevices[] = {
+  LDN_MACHINE_NETWORKDEVICES
+};
+
+//PCI config filter for network devices: they look absent to the
+//guest; reads of the vendor/device id return all ones and of any
+//other register zero
+static u32 sslpa_filter(VCPU *vcpu, u32 bus, u32 device, u32 function,
+	u32 index, u32 len, u32 access_type, u32 *value){
+	(void)len;
+
+	if(access_type == PCI_ACCESS_READ){
+		printf("\nCPU(0x%02x): N/W device accessed, denying... (%02x:%02x.%x, offset=0x%03x)", 
+		  vcpu->id, bus, device, function, index);
+
+		if(index < 4)
+			*value=0xFFFFFFFFUL;  //no device present
+		else
+			*value=0; //null value for all other configuration registers
+
+		return PCI_FILTER_EMULATED;
+	}
+
+	printf("\nCPU(0x%02x): N/W device forced write? HALT! (%02x:%02x.%x, offset=0x%03x)", 
+	  vcpu->id, bus, device, function, index);
+	HALT();
+	return PCI_FILTER_EMULATED;	//we never get here
+}
+
+//mask off the network devices of the machine; accesses to the config
+//space of any other device go through without a VM exit
+static void sslpa_setup(VCPU *vcpu){
+	u32 i;
+
+	for(i=0; i < (sizeof(machine_networkdevices)/sizeof(struct __machine_networkdevices)); i++){
+		if(!xmhf_baseplatform_arch_x86vmx_pcifilter_register(vcpu, machine_networkdevices[i].bus,
+			machine_networkdevices[i].device, machine_networkdevices[i].function, sslpa_filter)){
+			printf("\nCPU(0x%02x): could not mask off network device %02x:%02x.%x, halting!",
+				vcpu->id, machine_networkdevices[i].bus, machine_networkdevices[i].device,
+				machine_networkdevices[i].function);
+			HALT();
+		}
+	}
+}
+#endif
+
 //----------------------------------------------------------------------
 //hyperapp main                            
 //----------------------------------------------------------------------
@@ -81,6 +133,10 @@ u32 xmhf_app_main(VCPU *vcpu, APP_PARAM_BLOCK *apb){
 	}
 
 	printf("\nCPU(0x%02x): BSP. Lockdown initiaizing...", vcpu->id);
+
+	//page hashing can use SHA-NI/SSE from here on
+	printf("\nCPU(0x%02x): Lockdown; hashaccel features=0x%08x",
+		vcpu->id, hashaccel_init(HASHACCEL_F_KERNEL));
 	
 	//setup guest environment physical memory size
 	LDN_ENV_PHYSICALMEMORYLIMIT = (apb->runtimephysmembase - PAGE_SIZE_2M); 
@@ -101,17 +157,17 @@ u32 xmhf_app_main(VCPU *vcpu, APP_PARAM_BLOCK *apb){
 
 #if defined(__LDN_HYPERPARTITIONING__)
 	//set IDE port intercepts for hyper-partitioning
-
-	xmhf_partition_legacyIO_setprot(vcpu, ATA_COMMAND(ATA_BUS_PRIMARY), 1, PART_LEGACYIO_NOACCESS); //8-bit port
-	xmhf_partition_legacyIO_setprot(vcpu, ATA_SECTOR_COUNT(ATA_BUS_PRIMARY), 1, PART_LEGACYIO_NOACCESS); //8-bit port
-	xmhf_partition_legacyIO_setprot(vcpu, ATA_LBALOW(ATA_BUS_PRIMARY), 1, PART_LEGACYIO_NOACCESS); //8-bit port
-	xmhf_partition_legacyIO_setprot(vcpu, ATA_LBAMID(ATA_BUS_PRIMARY), 1, PART_LEGACYIO_NOACCESS); //8-bit port
-	xmhf_partition_legacyIO_setprot(vcpu, ATA_LBAHIGH(ATA_BUS_PRIMARY), 1, PART_LEGACYIO_NOACCESS); //8-bit port
+	hp_initialize(vcpu);
 
 	printf("\nCPU(0x%02x): Lockdown; Setup hyperpartitioning on \
 	ATA/SATA device at 0x%08x", vcpu->id, ATA_BUS_PRIMARY);
 #endif
 
+#if defined(__LDN_HYPERPARTITIONING_AHCI__)
+	//intercept command issue on the AHCI HBA for hyper-partitioning
+	hp_ahci_initialize(vcpu);
+#endif
+
 	//grab the ldn parameter block from verifier, this tells us the
 	//destination environment characteristics
 	//TODO: verifier integration, for now we just take it from the apb
@@ -146,8 +202,10 @@ u32 xmhf_app_main(VCPU *vcpu, APP_PARAM_BLOCK *apb){
 		#endif
 
 		#if defined(__LDN_SSLPA__)
-		//mask off all network interfaces by interposing on PCI bus accesses
-		xmhf_iopm_set_write(vcpu, PCI_CONFIG_DATA_PORT, 2); //16-bit port
+		//mask off all network interfaces by filtering their PCI config
+		//space accesses
+		if(vcpu->isbsp)
+			sslpa_setup(vcpu);
 		#endif
 	}else{	//we are going to run the untrusted environment
 		HALT_ON_ERRORCOND( currentenvironment == LDN_ENV_UNTRUSTED_SIGNATURE);
@@ -223,30 +281,6 @@ u32 xmhf_app_handleintercept_hwpgtblviolation(VCPU *vcpu,
 }
 
 
-#if defined(__LDN_SSLPA__)
-struct __machine_networkdevices {
-  u32 bus;
-  u32 device;
-  u32 function;
-} machine_networkdevices[] = {
-  LDN_MACHINE_NETWORKDEVICES
-};
-
-//returns 1 if device specified by the bus:device:function triad
-//is of networking class
-u32 sslpa_isnetworkdevice(u32 bus, u32 device, u32 function){
- u32 i;
- for(i=0; i < (sizeof(machine_networkdevices)/sizeof(struct __machine_networkdevices)); i++){
-  if(machine_networkdevices[i].bus == bus &&
-    machine_networkdevices[i].device == device &&
-    machine_networkdevices[i].function == function)
-    return 1;
- }
-  
- return 0;
-}
-
-#endif
 
 //----------------------------------------------------------------------
 //hyperapp I/O port intercept handler
@@ -297,43 +331,6 @@ u32 xmhf_app_handleintercept_portaccess(VCPU *vcpu, struct regs *r,
 		return retval;
 	}
 	#endif
-
-	#if defined(__LDN_SSLPA__)
-	if(portnum == PCI_CONFIG_DATA_PORT){
-		//printf("\nCPU(0x%02x): PCI DATA acc, size=%u, type=%u", 
-		//  vcpu->id, access_size, access_type);  
-		pci_config_reg_addr_t pci_addr;
-		pci_addr.bytes = inl((u32)PCI_CONFIG_ADDR_PORT);
-
-		if(sslpa_isnetworkdevice(pci_addr.fields.bus, pci_addr.fields.device, 
-			pci_addr.fields.function)) {
-			if(access_type == IO_TYPE_IN){
-				u32 retval;
-				printf("\nCPU(0x%02x): N/W device accessed, denying... (t=%u, s=%u, offset=0x%08x)", 
-				  vcpu->id, access_type, access_size, pci_addr.fields.offset);
-
-				if(pci_addr.fields.offset == 0)
-					retval=0xFFFFFFFFUL;  //no device present
-				else
-					retval=0; //null value for all other configuration registers
-
-				HALT_ON_ERRORCOND( (access_size == IO_SIZE_BYTE) || (access_size == IO_SIZE_WORD) ||
-					(access_size == IO_SIZE_DWORD) );
-				switch(access_size){
-					case IO_SIZE_BYTE: r->eax &= 0xFFFFFF00UL; r->eax |= (u8)retval; break;
-					case IO_SIZE_WORD: r->eax &= 0xFFFF0000UL; r->eax |= (u16)retval; break;
-					case IO_SIZE_DWORD: r->eax = retval; break;
-				}
-
-				return APP_IOINTERCEPT_SKIP;
-			}else{
-				printf("\nCPU(0x%02x): N/W device forced write? HALT! (t=%u, s=%u, offset=0x%08x)", 
-				  vcpu->id, access_type, access_size, pci_addr.fields.offset);
-				HALT();
-			}
-		}
-	}
-	#endif
   
 	return APP_IOINTERCEPT_CHAIN; //chain and do the required I/O    
 }
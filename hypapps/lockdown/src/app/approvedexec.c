@@ -50,6 +50,7 @@
 #include <xmhf.h>
 
 #include <lockdown.h>
+#include <hashaccel.h>
 
 
 u32 ax_debug_flag = 0;
@@ -186,17 +187,32 @@ u32 approvedexec_checkhashes(u32 pagebase_paddr, u32 *index, u32 *fullhash){
 	}
 
 #if 1
-	//now scan the partial hashlist computing checksum for each 
-	for(i=0; i <hashlist_partial_totalelements;i++){
-		sha1_buffer((const u8 *)hashlist_partial[i].pageoffset+pagebase_paddr, hashlist_partial[i].size,
-                sha1sum);
-
-		if (memcmp(hashlist_partial[i].shanum, sha1sum, SHA_DIGEST_LENGTH) == 0){
-     	 *index = i;
-     	 *fullhash=0;     	 
-			 //AX_DEBUG(("\nSUCCESS(Part Hash List) for %s", hashlist_partial[i].name));
-		  return 1;
-    }
+	//now scan the partial hashlist computing checksum for each; a batch
+	//of entries is hashed at a time, so they can share SIMD lanes
+	for(i=0; i <hashlist_partial_totalelements;i+=HASHACCEL_MB_MAX_LANES){
+		const u8 *in[HASHACCEL_MB_MAX_LANES];
+		size_t len[HASHACCEL_MB_MAX_LANES];
+		u8 sha1sums[HASHACCEL_MB_MAX_LANES][SHA_DIGEST_LENGTH];
+		u32 j, n;
+
+		n = hashlist_partial_totalelements - i;
+		if(n > HASHACCEL_MB_MAX_LANES)
+			n = HASHACCEL_MB_MAX_LANES;
+
+		for(j=0; j < n; j++){
+			in[j] = (const u8 *)hashlist_partial[i+j].pageoffset+pagebase_paddr;
+			len[j] = hashlist_partial[i+j].size;
+		}
+		hashaccel_digest_mb(HASHACCEL_SHA1, in, len, n, &sha1sums[0][0]);
+
+		for(j=0; j < n; j++){
+			if (memcmp(hashlist_partial[i+j].shanum, sha1sums[j], SHA_DIGEST_LENGTH) == 0){
+			 *index = i+j;
+			 *fullhash=0;
+			 //AX_DEBUG(("\nSUCCESS(Part Hash List) for %s", hashlist_partial[i+j].name));
+			  return 1;
+			}
+		}
 	}
 #endif
 
@@ -0,0 +1,464 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+//------------------------------------------------------------------------------
+// hyperpart-ahci.c
+// hyper-partitioning for a disk on an AHCI (SATA) host bus adapter
+
+#include <xmhf.h>
+
+#include <lockdown.h>
+
+/*
+	the guest builds commands in its command list and command tables in
+	memory and issues them by setting their slot bits in PxCI, after
+	which the HBA fetches them by DMA. the guest could change a command
+	after we have checked it, so we never let the HBA see the guest's
+	structures:
+
+	- PxCLB of the disk's port always holds our shadow command list,
+	  which lives in hypervisor memory where the guest cannot write it.
+	  the address the guest programs is remembered instead.
+	- on a PxCI write, each newly issued slot's command header and table
+	  are copied from the guest to the shadow list and a shadow table,
+	  and are checked there. the HBA is then issued the copies.
+
+	writes to the ABAR are intercepted by the core (see the MMIO filters
+	in bplt-x86vmx-pcifilter.c), reads are not. a disk command costs one
+	VM exit for the PxCI write (NCQ commands one more for PxSACT), which
+	runs on the issuing CPU with only the port lock held, so that CPUs
+	can issue commands up to the NCQ depth in parallel.
+*/
+
+//largest PRDT we take, so that a command table fits in a page
+#define HP_AHCI_MAXPRDT		((PAGE_SIZE_4K - AHCI_CMDTABLE_PRDT) / sizeof(AHCI_PRD))
+
+//shadow command list of the port, and a shadow command table per slot
+static u8 hp_ahci_cmdlist[PAGE_SIZE_4K] __attribute__(( section(".palign_data") ));
+static u8 hp_ahci_cmdtables[AHCI_MAXSLOTS * PAGE_SIZE_4K] __attribute__(( section(".palign_data") ));
+
+//the HBA
+static PCI_DEVICE *hp_ahci_hba;
+static u32 hp_ahci_abar;
+static u32 hp_ahci_abarsize;
+static u32 hp_ahci_portregs;		//registers of the disk's port
+static u32 hp_ahci_slotsmask;		//command slots the HBA implements
+
+//1 while the guest is sizing the ABAR
+static u32 hp_ahci_abarsizing=0;
+
+//command list base the guest programmed
+static u32 hp_ahci_guestclb;
+static u32 hp_ahci_guestclbu;
+
+//slots issued to the HBA that we have not yet seen complete
+static u32 hp_ahci_issued=0;
+
+//serializes command issue on the port
+static volatile u32 hp_ahci_lock=1;
+
+
+static inline u32 hp_ahci_read(u32 reg){
+	return xmhf_baseplatform_arch_flat_readu32(hp_ahci_portregs + reg);
+}
+
+static inline void hp_ahci_write(u32 reg, u32 value){
+	xmhf_baseplatform_arch_flat_writeu32(hp_ahci_portregs + reg, value);
+}
+
+//1 if [paddr, paddr + size) is guest memory, which is the only memory
+//we let the HBA transfer to and from
+static u32 hp_ahci_isguestmemory(u32 paddrhi, u32 paddr, u32 size){
+	return (paddrhi == 0 && size <= LDN_ENV_PHYSICALMEMORYLIMIT &&
+		paddr <= LDN_ENV_PHYSICALMEMORYLIMIT - size);
+}
+
+//find the slots the HBA has finished with since we issued them, and
+//copy their byte counts back to the guest's command list. called with
+//the port lock held
+static void hp_ahci_complete(void){
+	AHCI_CMDHEADER *shadow = (AHCI_CMDHEADER *)hp_ahci_cmdlist;
+	AHCI_CMDHEADER *guest = NULL;
+	u32 outstanding, done, slot;
+
+	if(!hp_ahci_issued)
+		return;
+
+	//an NCQ command leaves PxCI before it leaves PxSACT, so PxSACT is
+	//read first
+	outstanding = hp_ahci_read(AHCI_PxSACT);
+	outstanding |= hp_ahci_read(AHCI_PxCI);
+	done = hp_ahci_issued & ~outstanding;
+	if(!done)
+		return;
+
+	if(hp_ahci_isguestmemory(hp_ahci_guestclbu, hp_ahci_guestclb, AHCI_CMDLIST_SIZE))
+		guest = (AHCI_CMDHEADER *)gpa2hva(hp_ahci_guestclb);
+
+	for(slot=0; slot < AHCI_MAXSLOTS; slot++){
+		if((done & (1UL << slot)) && guest != NULL)
+			guest[slot].prdbc = shadow[slot].prdbc;
+	}
+
+	hp_ahci_issued &= ~done;
+}
+
+//check the LBA range of a disk command in a command FIS. out of bounds
+//accesses are redirected to the "null" sector as on the ATA ports (see
+//hyperpart-disk.c). commands that can touch sectors we cannot check
+//are turned into NOPs, which the device aborts
+static void hp_ahci_checkcommand(VCPU *vcpu, u32 slot, u8 *cfis){
+	u64 lba;
+	u32 count, lba48;
+	u8 t;
+
+	if(cfis[0] != AHCI_FIS_TYPE_REG_H2D || !(cfis[1] & AHCI_FIS_H2D_C))
+		return;
+
+	switch(cfis[2]){
+		case CMD_READ_SECTORS:
+		case CMD_WRITE_SECTORS:
+		case CMD_READ_MULTIPLE:
+		case CMD_WRITE_MULTIPLE:
+		case CMD_READ_DMA:
+		case CMD_WRITE_DMA:
+		case CMD_READ_VERIFY_SECTORS:
+			lba48 = 0;
+			lba = LBA28_TO_CPU32(cfis[7] & 0x0F, cfis[6], cfis[5], cfis[4]);
+			count = cfis[12] ? cfis[12] : 256;
+			break;
+
+		case CMD_READ_SECTORS_EXT:
+		case CMD_WRITE_SECTORS_EXT:
+		case CMD_READ_MULTIPLE_EXT:
+		case CMD_WRITE_MULTIPLE_EXT:
+		case CMD_WRITE_MULTIPLE_FUA_EXT:
+		case CMD_READ_DMA_EXT:
+		case CMD_WRITE_DMA_EXT:
+		case CMD_WRITE_DMA_FUA_EXT:
+		case CMD_READ_VERIFY_SECTORS_EXT:
+		case CMD_WRITE_UNCORRECTABLE_EXT:
+			lba48 = 1;
+			lba = LBA48_TO_CPU64(0x00, 0x00, cfis[10], cfis[9], cfis[8], cfis[6], cfis[5], cfis[4]);
+			count = (u32)cfis[12] | ((u32)cfis[13] << 8);
+			if(count == 0)
+				count = 65536;
+			break;
+
+		case CMD_READ_FPDMA_QUEUED:
+		case CMD_WRITE_FPDMA_QUEUED:
+			//the sector count of an NCQ command is in the features field
+			lba48 = 1;
+			lba = LBA48_TO_CPU64(0x00, 0x00, cfis[10], cfis[9], cfis[8], cfis[6], cfis[5], cfis[4]);
+			count = (u32)cfis[3] | ((u32)cfis[11] << 8);
+			if(count == 0)
+				count = 65536;
+			break;
+
+		case CMD_DATA_SET_MANAGEMENT:
+		case CMD_SEND_FPDMA_QUEUED:
+		case CMD_SANITIZE_DEVICE:
+		case CMD_SECURITY_ERASE_UNIT:
+			printf("\nCPU(0x%02x): AHCI slot %u: command 0x%02x not allowed",
+				vcpu->id, slot, cfis[2]);
+			cfis[2] = CMD_NOP;
+			cfis[3] = 0x00;
+			return;
+
+		default:
+			return;
+	}
+
+	if(!check_if_LBA_range_outofbounds(lba, count))
+		return;
+
+	printf("\nCPU(0x%02x): AHCI slot %u (OOB): 0x%02x (count=%u, lba=0x%08x%08x)",
+		vcpu->id, slot, cfis[2], count, (u32)(lba >> 32), (u32)lba);
+
+	//convert the access to the "null" sector
+	if(lba48){
+		CPU64_TO_LBA48((u64)LDN_NULL_SECTOR, &cfis[10], &cfis[9], &cfis[8],
+			&cfis[6], &cfis[5], &cfis[4]);
+	}else{
+		CPU32_TO_LBA28((u32)LDN_NULL_SECTOR, &t, &cfis[6], &cfis[5], &cfis[4]);
+		cfis[7] = (cfis[7] & 0xF0) | t;
+	}
+}
+
+//copy the guest's command header and table for a slot to the shadow
+//ones, and check them there. returns 1 if the command may be issued.
+//called with the port lock held
+static u32 hp_ahci_snapshot(VCPU *vcpu, u32 slot){
+	AHCI_CMDHEADER *header = &((AHCI_CMDHEADER *)hp_ahci_cmdlist)[slot];
+	u8 *table = &hp_ahci_cmdtables[slot * PAGE_SIZE_4K];
+	AHCI_PRD *prdt = (AHCI_PRD *)&table[AHCI_CMDTABLE_PRDT];
+	u32 prdtl, size, i;
+
+	if(!hp_ahci_isguestmemory(hp_ahci_guestclbu, hp_ahci_guestclb, AHCI_CMDLIST_SIZE))
+		return 0;
+	memcpy(header, (u8 *)gpa2hva(hp_ahci_guestclb) + (slot * sizeof(AHCI_CMDHEADER)),
+		sizeof(AHCI_CMDHEADER));
+
+	prdtl = AHCI_CMDHEADER_PRDTL(header->flags);
+	size = AHCI_CMDTABLE_PRDT + (prdtl * sizeof(AHCI_PRD));
+	if(prdtl > HP_AHCI_MAXPRDT || !hp_ahci_isguestmemory(header->ctbau, header->ctba, size))
+		return 0;
+	memcpy(table, gpa2hva(header->ctba), size);
+
+	for(i=0; i < prdtl; i++){
+		if(!hp_ahci_isguestmemory(prdt[i].dbau, prdt[i].dba, AHCI_PRD_BYTES(prdt[i].dbc)))
+			return 0;
+	}
+
+	hp_ahci_checkcommand(vcpu, slot, &table[AHCI_CMDTABLE_CFIS]);
+
+	header->prdbc = 0;
+	header->ctba = hva2spa(table);
+	header->ctbau = 0;
+	return 1;
+}
+
+//guest write to the disk's port registers
+static u32 hp_ahci_portwrite(VCPU *vcpu, u32 reg, u32 *value){
+	u32 slots, busy, denied, slot;
+
+	switch(reg){
+		case AHCI_PxCLB:
+			spin_lock(&hp_ahci_lock);
+			hp_ahci_complete();
+			hp_ahci_guestclb = *value;
+			hp_ahci_write(AHCI_PxCLB, hva2spa(hp_ahci_cmdlist));
+			spin_unlock(&hp_ahci_lock);
+			return PCI_FILTER_EMULATED;
+
+		case AHCI_PxCLBU:
+			spin_lock(&hp_ahci_lock);
+			hp_ahci_guestclbu = *value;
+			hp_ahci_write(AHCI_PxCLBU, 0);
+			spin_unlock(&hp_ahci_lock);
+			return PCI_FILTER_EMULATED;
+
+		case AHCI_PxFB:
+			if(!hp_ahci_isguestmemory(hp_ahci_read(AHCI_PxFBU), *value, AHCI_RFIS_MAXSIZE)){
+				printf("\nCPU(0x%02x): AHCI: FIS base 0x%08x not in guest memory, ignored",
+					vcpu->id, *value);
+				return PCI_FILTER_EMULATED;
+			}
+			return PCI_FILTER_PASSTHROUGH;
+
+		case AHCI_PxFBU:
+			if(*value){
+				printf("\nCPU(0x%02x): AHCI: FIS base above 4GB, ignored", vcpu->id);
+				return PCI_FILTER_EMULATED;
+			}
+			return PCI_FILTER_PASSTHROUGH;
+
+		case AHCI_PxCMD:
+			//make sure the HBA is not started on anything but the shadow
+			//command list, e.g., after an HBA reset
+			if(*value & AHCI_PxCMD_ST){
+				spin_lock(&hp_ahci_lock);
+				if(hp_ahci_read(AHCI_PxCLB) != hva2spa(hp_ahci_cmdlist) ||
+					hp_ahci_read(AHCI_PxCLBU) != 0){
+					hp_ahci_write(AHCI_PxCLB, hva2spa(hp_ahci_cmdlist));
+					hp_ahci_write(AHCI_PxCLBU, 0);
+				}
+				spin_unlock(&hp_ahci_lock);
+			}
+			return PCI_FILTER_PASSTHROUGH;
+
+		case AHCI_PxIS:
+			spin_lock(&hp_ahci_lock);
+			hp_ahci_complete();
+			spin_unlock(&hp_ahci_lock);
+			return PCI_FILTER_PASSTHROUGH;
+
+		case AHCI_PxSACT:
+			//retire completed NCQ commands before the guest reuses their tags
+			spin_lock(&hp_ahci_lock);
+			hp_ahci_complete();
+			hp_ahci_write(AHCI_PxSACT, *value);
+			spin_unlock(&hp_ahci_lock);
+			return PCI_FILTER_EMULATED;
+
+		case AHCI_PxCI:
+			spin_lock(&hp_ahci_lock);
+			hp_ahci_complete();
+
+			//slots still in use keep the command they were issued with
+			slots = *value & hp_ahci_slotsmask;
+			busy = slots & hp_ahci_issued;
+			slots &= ~busy;
+
+			denied = 0;
+			for(slot=0; slot < AHCI_MAXSLOTS; slot++){
+				if((slots & (1UL << slot)) && !hp_ahci_snapshot(vcpu, slot))
+					denied |= (1UL << slot);
+			}
+			slots &= ~denied;
+
+			hp_ahci_issued |= slots;
+			if(slots)
+				hp_ahci_write(AHCI_PxCI, slots);
+			spin_unlock(&hp_ahci_lock);
+
+			if(busy | denied)
+				printf("\nCPU(0x%02x): AHCI: slots busy=0x%08x, denied=0x%08x",
+					vcpu->id, busy, denied);
+			return PCI_FILTER_EMULATED;
+
+		default:
+			return PCI_FILTER_PASSTHROUGH;
+	}
+}
+
+//MMIO filter for the page(s) holding the ABAR; registers of other ports
+//and anything else sharing the page are written through
+static u32 hp_ahci_mmiofilter(VCPU *vcpu, u32 paddr, u32 *value){
+	if(paddr < hp_ahci_portregs || paddr >= hp_ahci_portregs + AHCI_PORTREGS_SIZE)
+		return PCI_FILTER_PASSTHROUGH;
+
+	return hp_ahci_portwrite(vcpu, paddr - hp_ahci_portregs, value);
+}
+
+//PCI config filter for the HBA, which keeps the ABAR where it is. the
+//guest may size the BAR and write back its address, nothing else
+static u32 hp_ahci_pcifilter(VCPU *vcpu, u32 bus, u32 device, u32 function,
+	u32 index, u32 len, u32 access_type, u32 *value){
+	u32 bar = PCI_CONF_HDR_IDX_BAR0 + (AHCI_PCI_ABAR * 4);
+	u32 shift = (index - bar) * 8;
+
+	(void)bus;
+	(void)device;
+	(void)function;
+
+	if(index + len <= bar || index >= bar + 4)
+		return PCI_FILTER_PASSTHROUGH;
+
+	if(access_type == PCI_ACCESS_READ){
+		if(!hp_ahci_abarsizing)
+			return PCI_FILTER_PASSTHROUGH;
+		*value = (~(hp_ahci_abarsize - 1) | hp_ahci_hba->bars[AHCI_PCI_ABAR].flags) >> shift;
+		return PCI_FILTER_EMULATED;
+	}
+
+	if(len == 4 && *value == 0xFFFFFFFFUL){
+		hp_ahci_abarsizing = 1;
+	}else if(len == 4 && (*value & PCI_BAR_MEM_ADDR_MASK) == hp_ahci_abar){
+		hp_ahci_abarsizing = 0;
+	}else{
+		printf("\nCPU(0x%02x): AHCI: ABAR write (0x%08x, len=%u) ignored",
+			vcpu->id, *value, len);
+		hp_ahci_abarsizing = 0;
+	}
+
+	return PCI_FILTER_EMULATED;
+}
+
+//set up hyper-partitioning of the disk on port LDN_AHCI_PORT of the
+//(first) AHCI HBA; called from app main on the BSP before the guest
+//runs. the port is switched over to the shadow command list here
+void hp_ahci_initialize(VCPU *vcpu){
+	PCI_DEVICE *devices;
+	PCI_BAR *abar;
+	u32 num_devices, i, cmd, numslots;
+	u64 deadline;
+
+	devices = xmhf_baseplatform_arch_x86_pci_getdevices(&num_devices);
+	for(i=0; i < num_devices; i++){
+		if(devices[i].class_code == AHCI_PCI_CLASS_CODE)
+			break;
+	}
+	if(i == num_devices){
+		printf("\nCPU(0x%02x): Lockdown; no AHCI HBA found, halting!", vcpu->id);
+		HALT();
+	}
+	hp_ahci_hba = &devices[i];
+
+	abar = &hp_ahci_hba->bars[AHCI_PCI_ABAR];
+	if(vcpu->cpu_vendor != CPU_VENDOR_INTEL || abar->size == 0 ||
+		(abar->flags & PCI_BAR_SPACE_IO) || abar->base + abar->size > 0x100000000ULL){
+		printf("\nCPU(0x%02x): Lockdown; cannot intercept AHCI HBA %02x:%02x.%x, halting!",
+			vcpu->id, hp_ahci_hba->bus, hp_ahci_hba->device, hp_ahci_hba->function);
+		HALT();
+	}
+	hp_ahci_abar = (u32)abar->base;
+	hp_ahci_abarsize = (u32)abar->size;
+	hp_ahci_portregs = hp_ahci_abar + AHCI_PORT(LDN_AHCI_PORT);
+
+	numslots = AHCI_CAP_NCS(xmhf_baseplatform_arch_flat_readu32(hp_ahci_abar + AHCI_CAP));
+	hp_ahci_slotsmask = (numslots == AHCI_MAXSLOTS) ? 0xFFFFFFFFUL : ((1UL << numslots) - 1);
+
+	HALT_ON_ERRORCOND( xmhf_baseplatform_arch_flat_readu32(hp_ahci_abar + AHCI_PI) &
+		(1UL << LDN_AHCI_PORT) );
+
+	//the port may only be given a new command list while it is stopped
+	hp_ahci_guestclb = hp_ahci_read(AHCI_PxCLB);
+	hp_ahci_guestclbu = hp_ahci_read(AHCI_PxCLBU);
+	cmd = hp_ahci_read(AHCI_PxCMD);
+	if(cmd & AHCI_PxCMD_ST){
+		hp_ahci_write(AHCI_PxCMD, cmd & ~AHCI_PxCMD_ST);
+		deadline = xmhf_baseplatform_arch_x86_deadline(500000);
+		while(hp_ahci_read(AHCI_PxCMD) & AHCI_PxCMD_CR){
+			HALT_ON_ERRORCOND( !xmhf_baseplatform_arch_x86_deadline_passed(deadline) );
+			xmhf_baseplatform_arch_x86_udelay(10);
+		}
+	}
+	hp_ahci_write(AHCI_PxCLB, hva2spa(hp_ahci_cmdlist));
+	hp_ahci_write(AHCI_PxCLBU, 0);
+	if(cmd & AHCI_PxCMD_ST)
+		hp_ahci_write(AHCI_PxCMD, cmd);
+
+	HALT_ON_ERRORCOND( xmhf_baseplatform_arch_x86vmx_pcifilter_registermmio(vcpu,
+		PAGE_ALIGN_4K(hp_ahci_abar), PAGE_ALIGN_UP4K(hp_ahci_abar + hp_ahci_abarsize) -
+		PAGE_ALIGN_4K(hp_ahci_abar), hp_ahci_mmiofilter) );
+	HALT_ON_ERRORCOND( xmhf_baseplatform_arch_x86vmx_pcifilter_register(vcpu,
+		hp_ahci_hba->bus, hp_ahci_hba->device, hp_ahci_hba->function, hp_ahci_pcifilter) );
+
+	printf("\nCPU(0x%02x): Lockdown; AHCI HBA %02x:%02x.%x, ABAR 0x%08x, port %u, %u slots",
+		vcpu->id, hp_ahci_hba->bus, hp_ahci_hba->device, hp_ahci_hba->function,
+		hp_ahci_abar, LDN_AHCI_PORT, numslots);
+}
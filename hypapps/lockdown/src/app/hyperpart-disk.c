@@ -55,13 +55,16 @@
 #include <lockdown.h>
 
 
-u8 ata_sector_count_buf[2], ata_lbalow_buf[2], ata_lbamid_buf[2];
-u8 ata_lbahigh_buf[2];
+//the ATA registers that make up a command's sector count and LBA, in
+//the order they are written out to the device. the device remembers
+//the last two bytes written to each of them (for LBA48, the first one
+//is the high order byte), which is what the core latches for us
+#define HP_SHADOW_SECTOR_COUNT	0
+#define HP_SHADOW_LBALOW		1
+#define HP_SHADOW_LBAMID		2
+#define HP_SHADOW_LBAHIGH		3
 
-u32 ata_sector_count_index=0;
-u32 ata_lbalow_index=0;
-u32 ata_lbamid_index=0;
-u32 ata_lbahigh_index=0;
+static PART_LEGACYIO_SHADOW hp_ata_shadow;
 
 
 u64 LBA48_TO_CPU64(u8 bits63_56, u8 bits55_48, u8 bits47_40, u8 bits39_32, u8 bits31_24, u8 bits23_16, u8 bits15_8, u8 bits7_0) {
@@ -100,27 +103,44 @@ void CPU32_TO_LBA28(u32 value, u8 *bits27_24,
 
 //this is an array of known sectors that access should be allowed
 //irrespective of the environment we are in. these include the MBR and
-//start sectors of extended partitions if any.
+//start sectors of extended partitions if any. it is sorted by
+//hp_initialize
 u32 hp_allowedsectors[] = {
   LDN_ALLOWED_SECTORS
 };
 
+#define HP_ALLOWEDSECTORS_COUNT	(sizeof(hp_allowedsectors)/sizeof(u32))
+
+//check if a given LBA is one of the allowed sectors
+static u32 hp_isallowedsector(u64 lbaaddr){
+  u32 lo=0, hi=HP_ALLOWEDSECTORS_COUNT, mid;
+
+  while(lo < hi){
+    mid = lo + (hi - lo) / 2;
+    if((u64)hp_allowedsectors[mid] == lbaaddr)
+      return 1;
+    if((u64)hp_allowedsectors[mid] < lbaaddr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return 0;
+}
+
 
 //check if a given LBA is out of bounds of the partition
 //returns 1 if out of bounds, else 0
 extern u32 currentenvironment;
 
 u32 check_if_LBA_outofbounds(u64 lbaaddr){
-	u32 i;
   HALT_ON_ERRORCOND(currentenvironment == LDN_ENV_TRUSTED_SIGNATURE ||
       currentenvironment == LDN_ENV_UNTRUSTED_SIGNATURE);
 
 #if 1 
   //check if the given LBA falls into one of the allowed sectors list
-  for(i=0; i< (sizeof(hp_allowedsectors)/sizeof(u32)); i++){
-    if(hp_allowedsectors[i] == (u32)lbaaddr)
-      return 0; //not out of bounds
-  }
+  if(hp_isallowedsector(lbaaddr))
+    return 0; //not out of bounds
       
   if(currentenvironment == LDN_ENV_TRUSTED_SIGNATURE){
 	 //if we are operating in the TRUSTED environment, restrict all sector
@@ -144,26 +164,51 @@ u32 check_if_LBA_outofbounds(u64 lbaaddr){
   
 #else
 	(void)lbaaddr;
-	(void)i;
 	return 0; //not out of bounds 
 
 #endif  
 }
 
-//return guest EAX value 
-static inline u32 hp_getguesteaxvalue(VCPU *vcpu, struct regs *r){
-		if(vcpu->cpu_vendor == CPU_VENDOR_AMD)
-			return (u32) ((struct _svm_vmcbfields *)vcpu->vmcb_vaddr_ptr)->rax;
-		else
-			return r->eax;
-}
+//check if any sector of a range of count sectors starting at lbaaddr
+//is out of bounds of the partition; returns 1 if so, else 0.
+//the sectors in bounds make up ranges starting at sector 0, at the
+//trusted partition or at an allowed sector, so a range is out of bounds
+//if and only if one of its ends, or a sector next to where one of
+//those starts or ends within it, is
+u32 check_if_LBA_range_outofbounds(u64 lbaaddr, u32 count){
+  u64 last, points[4];
+  u32 i, j;
+
+  if(count == 0)
+    count = 1;
+  last = lbaaddr + count - 1;
+  if(last < lbaaddr)
+    return 1; //wraps around
+
+  if(check_if_LBA_outofbounds(lbaaddr) || check_if_LBA_outofbounds(last))
+    return 1;
+
+  points[0] = (u64)LDN_ENV_TRUSTED_STARTSECTOR - 1;
+  points[1] = (u64)LDN_ENV_TRUSTED_STARTSECTOR;
+  points[2] = (u64)LDN_ENV_TRUSTED_ENDSECTOR;
+  points[3] = (u64)LDN_ENV_TRUSTED_ENDSECTOR + 1;
+  for(i=0; i < 4; i++){
+    if(points[i] > lbaaddr && points[i] < last &&
+      check_if_LBA_outofbounds(points[i]))
+      return 1;
+  }
 
-//set guest EAX value 
-static inline void hp_setguesteaxvalue(VCPU *vcpu, struct regs *r, u32 value){
-		if(vcpu->cpu_vendor == CPU_VENDOR_AMD)
-			((struct _svm_vmcbfields *)vcpu->vmcb_vaddr_ptr)->rax = value;
-		else
-			r->eax=value;
+  for(i=0; i < HP_ALLOWEDSECTORS_COUNT; i++){
+    points[0] = (u64)hp_allowedsectors[i] - 1;
+    points[1] = (u64)hp_allowedsectors[i] + 1;
+    for(j=0; j < 2; j++){
+      if(points[j] > lbaaddr && points[j] < last &&
+        check_if_LBA_outofbounds(points[j]))
+        return 1;
+    }
+  }
+
+  return 0;
 }
 
 
@@ -171,165 +216,126 @@ static inline void hp_setguesteaxvalue(VCPU *vcpu, struct regs *r, u32 value){
 //static bool cmd_packet_identify=false;
 
 
-//returns APP_IOINTERCEPT_SKIP or APP_IOINTERCEPT_CHAIN
-u32 hp(VCPU *vcpu, struct regs *r, u32 portnum, u32 access_type, u32 access_size){
-	u8 command, temp;
+//ATA command validation; called by the core with the other cores
+//quiesced when the guest writes the command port, with the sector
+//count and LBA registers the guest has written since in
+//shadow->values. out of bounds accesses are redirected to the "null"
+//sector by changing the latched LBA, which the core then writes out
+//before the command.
+//returns APP_IOINTERCEPT_CHAIN
+static u32 hp_command(VCPU *vcpu, struct regs *r, PART_LEGACYIO_SHADOW *shadow, u8 command){
+	u8 (*v)[PART_LEGACYIO_SHADOW_DEPTH] = shadow->values;
+	u8 temp;
 	u64 lba48addr;
 	u32 lba28addr;
-	
-	if (access_size != IO_SIZE_BYTE){
-		printf("\nCPU(0x%02x): Non-byte access to IDE port unsupported. HALT!", vcpu->id);
-		HALT();
-	}
+
+	(void)vcpu;
+	(void)r;
 
 	//check for correct disk
 	temp=inb(ATA_DRIVE_SELECT(ATA_BUS_PRIMARY));
 	if(temp & 0x10)	//slave, so simply chain
 		return APP_IOINTERCEPT_CHAIN;
 
-	if(access_type == IO_TYPE_IN)	
-		return APP_IOINTERCEPT_CHAIN;
-
-	switch(portnum){
-		case ATA_SECTOR_COUNT(ATA_BUS_PRIMARY):
-			if(ata_sector_count_index > 1){
-				ata_sector_count_buf[0]=ata_sector_count_buf[1];
-				ata_sector_count_buf[1]=(u8)hp_getguesteaxvalue(vcpu, r);
-			}else{
-				ata_sector_count_buf[ata_sector_count_index]=(u8)hp_getguesteaxvalue(vcpu, r);
-			}
-			ata_sector_count_index++;
-			return(APP_IOINTERCEPT_CHAIN);
+	if(command == CMD_READ_DMA_EXT || command == CMD_WRITE_DMA_EXT){
+		lba48addr = LBA48_TO_CPU64(0x00, 0x00, v[HP_SHADOW_LBAHIGH][0], 
+			v[HP_SHADOW_LBAMID][0], v[HP_SHADOW_LBALOW][0], v[HP_SHADOW_LBAHIGH][1], 
+			v[HP_SHADOW_LBAMID][1], v[HP_SHADOW_LBALOW][1]);
+
+		//[DBG]
+		//printf("\nATA R/W DMA EXT: 0x%02x (count=%02x%02x, lba=%u)", 
+		//command, v[HP_SHADOW_SECTOR_COUNT][0], v[HP_SHADOW_SECTOR_COUNT][1],
+		//	(u32)lba48addr);
+
+		//check if we are out of bounds
+		if(check_if_LBA_outofbounds(lba48addr)){
+			printf("\nATA R/W DMA EXT (OOB): 0x%02x (count=%02x%02x, lba=%02x%02x%02x%02x%02x%02x)", 
+				command, v[HP_SHADOW_SECTOR_COUNT][0], v[HP_SHADOW_SECTOR_COUNT][1],
+				v[HP_SHADOW_LBAHIGH][0], v[HP_SHADOW_LBAMID][0], v[HP_SHADOW_LBALOW][0],
+				v[HP_SHADOW_LBAHIGH][1], v[HP_SHADOW_LBAMID][1], v[HP_SHADOW_LBALOW][1]);
+			//convert the access to the "null" sector	
+			CPU64_TO_LBA48((u64)LDN_NULL_SECTOR, &v[HP_SHADOW_LBAHIGH][0], 
+				&v[HP_SHADOW_LBAMID][0], &v[HP_SHADOW_LBALOW][0], &v[HP_SHADOW_LBAHIGH][1], 
+				&v[HP_SHADOW_LBAMID][1], &v[HP_SHADOW_LBALOW][1]);
+		}
+
+	}else if( command == CMD_READ_DMA || command == CMD_WRITE_DMA){
+		u8 t3;
+		t3 = inb(ATA_DRIVE_SELECT(ATA_BUS_PRIMARY)) & (u8)0x0F;
+
+		lba28addr = LBA28_TO_CPU32(t3, v[HP_SHADOW_LBAHIGH][1],
+			v[HP_SHADOW_LBAMID][1], v[HP_SHADOW_LBALOW][1]);
+
+		//[DBG]
+		//printf("\nATA R/W DMA: 0x%02x (count=%02x, lba=%u", 
+		//command, v[HP_SHADOW_SECTOR_COUNT][1], lba28addr);
 		
-		case ATA_LBALOW(ATA_BUS_PRIMARY):
-			if(ata_lbalow_index > 1){
-				ata_lbalow_buf[0]=ata_lbalow_buf[1];
-				ata_lbalow_buf[1]=(u8)hp_getguesteaxvalue(vcpu, r);
-			}else{
-				ata_lbalow_buf[ata_lbalow_index]=(u8)hp_getguesteaxvalue(vcpu, r);
-			}
-			ata_lbalow_index++;
-			return(APP_IOINTERCEPT_CHAIN);
-			
-		case ATA_LBAMID(ATA_BUS_PRIMARY):
-			if(ata_lbamid_index > 1){
-				ata_lbamid_buf[0]=ata_lbamid_buf[1];
-				ata_lbamid_buf[1]=(u8)hp_getguesteaxvalue(vcpu, r);
-			}else{
-				ata_lbamid_buf[ata_lbamid_index]=(u8)hp_getguesteaxvalue(vcpu, r);
-			}
-			ata_lbamid_index++;
-			return(APP_IOINTERCEPT_CHAIN);
-
-		case ATA_LBAHIGH(ATA_BUS_PRIMARY):
-			if(ata_lbahigh_index > 1){
-				ata_lbahigh_buf[0]=ata_lbahigh_buf[1];
-				ata_lbahigh_buf[1]=(u8)hp_getguesteaxvalue(vcpu, r);
-			}else{
-				ata_lbahigh_buf[ata_lbahigh_index]=(u8)hp_getguesteaxvalue(vcpu, r);
-			}
-			ata_lbahigh_index++;
-			return(APP_IOINTERCEPT_CHAIN);
-	
-		case ATA_COMMAND(ATA_BUS_PRIMARY):
-			command = (u8)hp_getguesteaxvalue(vcpu, r);
-			
-			if(command == CMD_READ_DMA_EXT || command == CMD_WRITE_DMA_EXT){
-				lba48addr = LBA48_TO_CPU64(0x00, 0x00, ata_lbahigh_buf[0], 
-					ata_lbamid_buf[0], ata_lbalow_buf[0], ata_lbahigh_buf[1], 
-					ata_lbamid_buf[1], ata_lbalow_buf[1]);
-
-				//[DBG]
-				//printf("\nATA R/W DMA EXT: 0x%02x (count=%02x%02x, lba=%u)", 
-				//command, ata_sector_count_buf[0], ata_sector_count_buf[1],
-				//	(u32)lba48addr);
-
-				//check if we are out of bounds
-				if(check_if_LBA_outofbounds(lba48addr)){
-					printf("\nATA R/W DMA EXT (OOB): 0x%02x (count=%02x%02x, lba=%02x%02x%02x%02x%02x%02x)", 
-						command, ata_sector_count_buf[0], ata_sector_count_buf[1],
-						ata_lbahigh_buf[0], ata_lbamid_buf[0], ata_lbalow_buf[0],
-						ata_lbahigh_buf[1], ata_lbamid_buf[1], ata_lbalow_buf[1]);
-					//convert the access to the "null" sector	
-					CPU64_TO_LBA48((u64)LDN_NULL_SECTOR, &ata_lbahigh_buf[0], 
-					&ata_lbamid_buf[0], &ata_lbalow_buf[0], &ata_lbahigh_buf[1], 
-					&ata_lbamid_buf[1], &ata_lbalow_buf[1]);
-	
-				//resend the new LBA and sector count addresses
-				outb (ata_sector_count_buf[0], ATA_SECTOR_COUNT(ATA_BUS_PRIMARY));
-				outb (ata_lbalow_buf[0], ATA_LBALOW(ATA_BUS_PRIMARY));
-				outb (ata_lbamid_buf[0], ATA_LBAMID(ATA_BUS_PRIMARY));
-				outb (ata_lbahigh_buf[0], ATA_LBAHIGH(ATA_BUS_PRIMARY));
-				outb (ata_sector_count_buf[1], ATA_SECTOR_COUNT(ATA_BUS_PRIMARY));
-				outb (ata_lbalow_buf[1], ATA_LBALOW(ATA_BUS_PRIMARY));
-				outb (ata_lbamid_buf[1], ATA_LBAMID(ATA_BUS_PRIMARY));
-				outb (ata_lbahigh_buf[1], ATA_LBAHIGH(ATA_BUS_PRIMARY));
-	
-				}				
-				
-				
-				
-				ata_sector_count_index=0;
-				ata_lbalow_index = ata_lbamid_index = ata_lbahigh_index=0;
-				ata_sector_count_buf[0] = ata_sector_count_buf[1] = 0;
-				ata_lbalow_buf[0] = ata_lbalow_buf[1] = 0;
-				ata_lbamid_buf[0] = ata_lbamid_buf[1] = 0;
-				ata_lbahigh_buf[0] = ata_lbahigh_buf[1] = 0;
-				
-			}else if( command == CMD_READ_DMA || command == CMD_WRITE_DMA){
-				u8 t3, t2, t1, t0, count;
-				t3 = inb(ATA_DRIVE_SELECT(ATA_BUS_PRIMARY)) & (u8)0x0F;
-				t2 = inb(ATA_LBAHIGH(ATA_BUS_PRIMARY));
-				t1 = inb(ATA_LBAMID(ATA_BUS_PRIMARY));
-				t0 = inb(ATA_LBALOW(ATA_BUS_PRIMARY));
-				count = inb(ATA_SECTOR_COUNT(ATA_BUS_PRIMARY));
-				
-				lba28addr = LBA28_TO_CPU32(t3, t2, t1, t0);
-
-				//[DBG]
-				//printf("\nATA R/W DMA: 0x%02x (count=%02x, lba=%u", 
-				//command, count, lba28addr);
-				
-				//check if LBA is out of bounds
-				if(check_if_LBA_outofbounds((u64)lba28addr)){
-					printf("\nATA R/W DMA (OOB): 0x%02x (count=%02x, lba=(%02x%02x%02x%02x)", 
-					command, count, t3, t2, t1, t0);
-					//convert the access to a "null" sector
-					CPU32_TO_LBA28((u32)LDN_NULL_SECTOR, &t3, &t2, &t1, &t0);
-
-				//resend the new LBA and sector count addresses
-				temp = inb(ATA_DRIVE_SELECT(ATA_BUS_PRIMARY)) & (u8)0xF0;
-				temp |= t3;
-				outb(temp, ATA_DRIVE_SELECT(ATA_BUS_PRIMARY));
-				outb(count, ATA_SECTOR_COUNT(ATA_BUS_PRIMARY));
-				outb(t2, ATA_LBAHIGH(ATA_BUS_PRIMARY));
-				outb(t1, ATA_LBAMID(ATA_BUS_PRIMARY));
-				outb(t0, ATA_LBALOW(ATA_BUS_PRIMARY));
-
-				}
-			
-				
-				ata_sector_count_index=0;
-				ata_lbalow_index = ata_lbamid_index = ata_lbahigh_index=0;
-				ata_sector_count_buf[0] = ata_sector_count_buf[1] = 0;
-				ata_lbalow_buf[0] = ata_lbalow_buf[1] = 0;
-				ata_lbamid_buf[0] = ata_lbamid_buf[1] = 0;
-				ata_lbahigh_buf[0] = ata_lbahigh_buf[1] = 0;
-				
-			}else {
-				//printf("\nATA command: 0x%02x",	command);
-			}
-			
-			ata_sector_count_index=0;
-			ata_lbalow_index = ata_lbamid_index = ata_lbahigh_index=0;
-			ata_sector_count_buf[0] = ata_sector_count_buf[1] = 0;
-			ata_lbalow_buf[0] = ata_lbalow_buf[1] = 0;
-			ata_lbamid_buf[0] = ata_lbamid_buf[1] = 0;
-			ata_lbahigh_buf[0] = ata_lbahigh_buf[1] = 0;
-			return APP_IOINTERCEPT_CHAIN;
+		//check if LBA is out of bounds
+		if(check_if_LBA_outofbounds((u64)lba28addr)){
+			printf("\nATA R/W DMA (OOB): 0x%02x (count=%02x, lba=(%02x%02x%02x%02x)", 
+				command, v[HP_SHADOW_SECTOR_COUNT][1], t3, v[HP_SHADOW_LBAHIGH][1],
+				v[HP_SHADOW_LBAMID][1], v[HP_SHADOW_LBALOW][1]);
+			//convert the access to a "null" sector
+			CPU32_TO_LBA28((u32)LDN_NULL_SECTOR, &t3, &v[HP_SHADOW_LBAHIGH][1],
+				&v[HP_SHADOW_LBAMID][1], &v[HP_SHADOW_LBALOW][1]);
+
+			//the drive select register is not latched, write the top
+			//LBA bits out here
+			temp = inb(ATA_DRIVE_SELECT(ATA_BUS_PRIMARY)) & (u8)0xF0;
+			temp |= t3;
+			outb(temp, ATA_DRIVE_SELECT(ATA_BUS_PRIMARY));
+		}
+
+	}else {
+		//printf("\nATA command: 0x%02x",	command);
+	}
+
+	//[DBG]
+	//printf("\nATA exits: %u latched, %u commands",
+	//	shadow->latched, shadow->triggered);
+
+	return APP_IOINTERCEPT_CHAIN;
+}
 
+//set up hyper-partitioning on the primary ATA bus; called from app main
+//on the BSP. writes to the sector count and LBA registers are latched by
+//the core, and reads of them and of the status register are done by it,
+//so only the command port write calls into us (see hp_command). a disk
+//command costs one quiescing exit instead of one per register written
+void hp_initialize(VCPU *vcpu){
+	u32 i, j, t;
+
+	//sort the allowed sectors for hp_isallowedsector
+	for(i=1; i < HP_ALLOWEDSECTORS_COUNT; i++){
+		t = hp_allowedsectors[i];
+		for(j=i; j > 0 && hp_allowedsectors[j-1] > t; j--)
+			hp_allowedsectors[j] = hp_allowedsectors[j-1];
+		hp_allowedsectors[j] = t;
 	}
-	
-	return APP_IOINTERCEPT_CHAIN;	
+
+	hp_ata_shadow.trigger = ATA_COMMAND(ATA_BUS_PRIMARY);
+	hp_ata_shadow.numports = 4;
+	hp_ata_shadow.ports[HP_SHADOW_SECTOR_COUNT] = ATA_SECTOR_COUNT(ATA_BUS_PRIMARY);
+	hp_ata_shadow.ports[HP_SHADOW_LBALOW] = ATA_LBALOW(ATA_BUS_PRIMARY);
+	hp_ata_shadow.ports[HP_SHADOW_LBAMID] = ATA_LBAMID(ATA_BUS_PRIMARY);
+	hp_ata_shadow.ports[HP_SHADOW_LBAHIGH] = ATA_LBAHIGH(ATA_BUS_PRIMARY);
+	hp_ata_shadow.handler = hp_command;
+
+	HALT_ON_ERRORCOND( xmhf_partition_legacyIO_setshadow(vcpu, &hp_ata_shadow) );
 }
 
+//other accesses to the intercepted IDE ports, i.e., non-byte accesses,
+//which the core does not handle itself
+//returns APP_IOINTERCEPT_SKIP or APP_IOINTERCEPT_CHAIN
+u32 hp(VCPU *vcpu, struct regs *r, u32 portnum, u32 access_type, u32 access_size){
+	(void)r;
+	(void)portnum;
+	(void)access_type;
+
+	if (access_size != IO_SIZE_BYTE){
+		printf("\nCPU(0x%02x): Non-byte access to IDE port unsupported. HALT!", vcpu->id);
+		HALT();
+	}
+
+	return APP_IOINTERCEPT_CHAIN;	
+}
@@ -52,7 +52,15 @@
 
 #ifndef __ASSEMBLY__
 
+extern u64 LBA48_TO_CPU64(u8 bits63_56, u8 bits55_48, u8 bits47_40, u8 bits39_32, u8 bits31_24, u8 bits23_16, u8 bits15_8, u8 bits7_0);
+extern void CPU64_TO_LBA48(u64 value, u8 *bits47_40, u8 *bits39_32, u8 *bits31_24, u8 *bits23_16, u8 *bits15_8, u8 *bits7_0);
+extern u32 LBA28_TO_CPU32(u8 bits27_24, u8 bits23_16, u8 bits15_8, u8 bits7_0);
+extern void CPU32_TO_LBA28(u32 value, u8 *bits27_24, u8 *bits23_16, u8 *bits15_8, u8 *bits7_0);
+
+extern void hp_initialize(VCPU *vcpu);
 extern u32 hp(VCPU *vcpu, struct regs *r, u32 portnum, u32 access_type, u32 access_size);
+extern u32 check_if_LBA_range_outofbounds(u64 lbaaddr, u32 count);
+extern void hp_ahci_initialize(VCPU *vcpu);
 
 
 #endif //__ASSEMBLY__
@@ -0,0 +1,123 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+//------------------------------------------------------------------------------
+// AHCI (Serial ATA Advanced Host Controller Interface 1.3) definitions
+#ifndef __LOCKDOWN_AHCI_H_
+#define __LOCKDOWN_AHCI_H_
+
+//PCI class code of an AHCI HBA, and the BAR holding its registers (ABAR)
+#define AHCI_PCI_CLASS_CODE		0x010601
+#define AHCI_PCI_ABAR			5
+
+//HBA registers, offsets from the ABAR
+#define AHCI_CAP				0x00
+#define AHCI_GHC				0x04
+#define AHCI_PI					0x0C
+
+#define AHCI_CAP_NCS(x)			((((x) >> 8) & 0x1F) + 1)	//command slots per port
+
+#define AHCI_MAXPORTS			32
+#define AHCI_MAXSLOTS			32
+
+//port registers, offsets from AHCI_PORT(port)
+#define AHCI_PORT(x)			(0x100 + ((x) * 0x80))
+#define AHCI_PORTREGS_SIZE		0x80
+
+#define AHCI_PxCLB				0x00
+#define AHCI_PxCLBU				0x04
+#define AHCI_PxFB				0x08
+#define AHCI_PxFBU				0x0C
+#define AHCI_PxIS				0x10
+#define AHCI_PxCMD				0x18
+#define AHCI_PxSACT				0x34
+#define AHCI_PxCI				0x38
+
+#define AHCI_PxCMD_ST			(1UL << 0)
+#define AHCI_PxCMD_CR			(1UL << 15)
+
+//the received FIS area is 256 bytes, 4KB with FIS-based switching
+#define AHCI_RFIS_MAXSIZE		4096
+
+//command list, 32 command headers of 32 bytes
+#define AHCI_CMDLIST_SIZE		1024
+
+//command table layout; the command FIS is followed by the ATAPI
+//command and the physical region descriptor table (PRDT)
+#define AHCI_CMDTABLE_CFIS		0x00
+#define AHCI_CMDTABLE_ACMD		0x40
+#define AHCI_CMDTABLE_PRDT		0x80
+
+//FIS types
+#define AHCI_FIS_TYPE_REG_H2D	0x27
+#define AHCI_FIS_H2D_C			0x80	//register FIS carries a command
+
+#ifndef __ASSEMBLY__
+
+//command header
+typedef struct {
+	u32 flags;			//bits 4:0 command FIS length in dwords, 31:16 PRDT entries
+	u32 prdbc;			//bytes transferred, written back by the HBA
+	u32 ctba;			//command table base, 128 byte aligned
+	u32 ctbau;
+	u32 reserved[4];
+} __attribute__((packed)) AHCI_CMDHEADER;
+
+#define AHCI_CMDHEADER_PRDTL(x)	((x) >> 16)
+
+//physical region descriptor
+typedef struct {
+	u32 dba;			//data base address
+	u32 dbau;
+	u32 reserved;
+	u32 dbc;			//bits 21:0 byte count - 1, 31 interrupt on completion
+} __attribute__((packed)) AHCI_PRD;
+
+#define AHCI_PRD_BYTES(x)		(((x) & 0x003FFFFFUL) + 1)
+
+#endif //__ASSEMBLY__
+
+#endif /* __LOCKDOWN_AHCI_H_ */
@@ -91,7 +91,7 @@
 #define CMD_WRITE_DMA_EXT		0x35
 
 #define CMD_READ_MULTIPLE		0xC4
-#define CMD_WRITE_MULTIPLE	0xC3
+#define CMD_WRITE_MULTIPLE	0xC5
 #define CMD_READ_SECTORS		0x20
 #define CMD_WRITE_SECTORS		0x30
 
@@ -102,6 +102,19 @@
 
 #define	CMD_IDENTIFY_PACKET_DEVICE	0xA1
 
+#define CMD_NOP							0x00
+#define CMD_DATA_SET_MANAGEMENT			0x06
+#define CMD_READ_VERIFY_SECTORS			0x40
+#define CMD_READ_VERIFY_SECTORS_EXT		0x42
+#define CMD_WRITE_UNCORRECTABLE_EXT		0x45
+#define CMD_WRITE_DMA_FUA_EXT			0x3D
+#define CMD_WRITE_MULTIPLE_FUA_EXT		0xCE
+#define CMD_READ_FPDMA_QUEUED			0x60
+#define CMD_WRITE_FPDMA_QUEUED			0x61
+#define CMD_SEND_FPDMA_QUEUED			0x64
+#define CMD_SANITIZE_DEVICE				0xB4
+#define CMD_SECURITY_ERASE_UNIT			0xF4
+
 /*
 //some defines to construct 32/64 bit numbers for 28bit and 48bit LBA addressing
 #define LBA28BIT_TO_32BITVAL(bits27_24, bits23_16, bits15_8, bits7_0) \
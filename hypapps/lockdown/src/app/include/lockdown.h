@@ -77,6 +77,7 @@
 #define LDN_ENV_TRUSTED_ENDSECTOR  		(222291404)
 #define LDN_NULL_SECTOR  				(620000000)
 #define LDN_IDE_BUS   					0x1F0
+#define LDN_AHCI_PORT					0		//port of the disk on an AHCI HBA
 #define LDN_ALLOWED_SECTORS 			33554495, 96470325, 159396991
 #define LDN_OUTOFBOUNDS_CHECK			(((u64)lbaaddr >= (u64)LDN_ENV_TRUSTED_STARTSECTOR) && ((u64)lbaaddr <= (u64)LDN_ENV_TRUSTED_ENDSECTOR)) || ((u64)lbaaddr < 63ULL) || ((u64)lbaaddr >= 63ULL && (u64)lbaaddr <= 33554494ULL)
 
@@ -105,6 +106,7 @@ typedef struct {
 
 #include <lockdown-acpi.h>
 #include <lockdown-atapi.h>
+#include <lockdown-ahci.h>
 #include <lockdown-exepe.h>
 #include <hyperpart.h>
 #include <approvedexec.h>
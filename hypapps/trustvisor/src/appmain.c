@@ -64,6 +64,9 @@
 #include <tv_log.h>
 #include <tv_emhf.h>
 #include <cmdline.h>
+#include <hashaccel.h>
+#include <aesaccel.h>
+#include <random.h>
 
 const cmdline_option_t gc_trustvisor_available_cmdline_options[] = {
   { "nvpalpcr0", "0000000000000000000000000000000000000000"}, /* Req'd PCR[0] of NvMuxPal */
@@ -130,6 +133,39 @@ void parse_boot_cmdline(const char *cmdline) {
   print_hex("NV uPCR[0] required to be: ", g_nvpalpcr0, sizeof(g_nvpalpcr0));
 }
 
+/* serializes hypercalls that use the hardware TPM, and DRBG reseeds
+   (see get_hw_tpm_entropy) */
+volatile u32 g_tv_hwtpm_lock=1;
+SPINLOCK_STATS g_tv_hwtpm_lock_stats = SPINLOCK_STATS_INITIALIZER("tv_hwtpm");
+
+/* the clock behind TV_HC_TIME_INFO. last_us keeps it monotonic
+   across cpus whose TSCs may be slightly out of step */
+static volatile u32 g_tv_time_lock=1;
+static u64 g_tv_time_epoch_nonce;
+static u64 g_tv_time_tsc_base;
+static u64 g_tv_time_last_us;
+
+static void tv_time_init(void)
+{
+  rand_bytes_or_die((uint8_t*)&g_tv_time_epoch_nonce,
+                    sizeof(g_tv_time_epoch_nonce));
+  g_tv_time_tsc_base = rdtsc64();
+  eu_trace("TSC %u kHz, %s", xmhf_baseplatform_arch_x86_tsc_khz(),
+           xmhf_baseplatform_arch_x86_tsc_invariant() ? "invariant" : "NOT invariant");
+}
+
+/* TSC ticks to microseconds without overflowing for any sane uptime */
+static u64 tv_time_ticks_to_us(u64 ticks, u32 khz)
+{
+  u64 rem_us;
+  u32 rem;
+
+  rem = do_div(ticks, khz);
+  rem_us = (u64)rem * 1000;
+  do_div(rem_us, khz);
+  return ticks * 1000 + rem_us;
+}
+
 /**
  * This is the primary entry-point from the EMHF Core during
  * hypervisor initialization.
@@ -146,7 +182,15 @@ u32 tv_app_main(VCPU *vcpu, APP_PARAM_BLOCK *apb){
     eu_trace("CPU(0x%02x) apb->cmdline: \"%s\"", vcpu->id, apb->cmdline);
     parse_boot_cmdline(apb->cmdline);
 
+    /* measurements, sealing and the DRBG can use SHA-NI, AES-NI and
+       SSE from here on */
+    eu_trace("hashaccel features: %#x", hashaccel_init(HASHACCEL_F_KERNEL));
+    eu_trace("aesaccel features: %#x", aesaccel_init(AESACCEL_F_KERNEL));
+
+    xmhf_baseplatform_spinlock_stats_register(&g_tv_hwtpm_lock_stats);
+
     init_scode(vcpu);
+    tv_time_init();
   }
 
   /* force these to be linked in */
@@ -203,6 +247,78 @@ static u32 do_TV_HC_TEST(VCPU *vcpu, struct regs *r)
   return 0;
 }
 
+static u32 do_TV_HC_LOCK_STATS(VCPU *vcpu, struct regs *r)
+{
+  SPINLOCK_STATS *snap=NULL;
+  struct tv_lock_stats out;
+  u32 out_addr, count_addr;
+  u32 count, n, i;
+  u32 ret=1;
+
+  out_addr = r->ecx;
+  count_addr = r->edx;
+
+  /* count is the capacity of the caller's array on input, and the
+     number of registered locks on output */
+  EU_CHKN( copy_from_current_guest(vcpu, &count, count_addr, sizeof(count)));
+  EU_CHK( count <= TV_LOCK_STATS_MAX,
+          eu_err_e("TV_HC_LOCK_STATS: count %d too large", count));
+
+  EU_CHK( snap = malloc(TV_LOCK_STATS_MAX * sizeof(SPINLOCK_STATS)));
+  n = xmhf_baseplatform_spinlock_stats_read(snap, count);
+
+  for(i=0; i < n && i < count; i++) {
+    memset(&out, 0, sizeof(out));
+    strncpy(out.name, snap[i].name, sizeof(out.name)-1);
+    out.acquisitions = snap[i].acquisitions;
+    out.contended = snap[i].contended;
+    out.spins = snap[i].spins;
+    out.hold_cycles = snap[i].hold_cycles;
+    out.hold_max = snap[i].hold_max;
+    EU_CHKN( copy_to_current_guest(vcpu, out_addr + i*sizeof(out), &out, sizeof(out)));
+  }
+  EU_CHKN( copy_to_current_guest(vcpu, count_addr, &n, sizeof(n)));
+
+  ret=0;
+ out:
+  free(snap);
+  return ret;
+}
+
+static u32 do_TV_HC_TIME_INFO(VCPU *vcpu, struct regs *r)
+{
+  struct tv_time_info info;
+  u32 out_addr;
+  u64 now;
+  u32 ret=1;
+
+  out_addr = r->ecx;
+
+  memset(&info, 0, sizeof(info));
+  info.tsc_khz = xmhf_baseplatform_arch_x86_tsc_khz();
+  EU_CHK( info.tsc_khz != 0,
+          eu_err_e("TV_HC_TIME_INFO: TSC not calibrated"));
+  info.epoch_nonce = g_tv_time_epoch_nonce;
+  info.tsc_base = g_tv_time_tsc_base;
+  if (xmhf_baseplatform_arch_x86_tsc_invariant()) {
+    info.flags |= TV_TIME_TSC_INVARIANT;
+  }
+
+  spin_lock(&g_tv_time_lock);
+  now = tv_time_ticks_to_us(rdtsc64() - g_tv_time_tsc_base, info.tsc_khz);
+  if (now > g_tv_time_last_us) {
+    g_tv_time_last_us = now;
+  }
+  info.now_us = g_tv_time_last_us;
+  spin_unlock(&g_tv_time_lock);
+
+  EU_CHKN( copy_to_current_guest(vcpu, out_addr, &info, sizeof(info)));
+
+  ret=0;
+ out:
+  return ret;
+}
+
 static u32 do_TV_HC_REG(VCPU *vcpu, struct regs *r)
 {
   u32 scode_info, /*scode_sp,*/ scode_pm, scode_en;
@@ -464,6 +580,19 @@ static u32 do_TV_HC_UTPM_GENRAND(VCPU *vcpu, struct regs *r)
   return ret;
 }
 
+static u32 do_TV_HC_UTPM_GENRAND_BULK(VCPU *vcpu, struct regs *r)
+{
+  u32 addr, len;
+  u32 ret=1;
+
+  addr = r->ecx;
+  len = r->edx;
+
+  ret = hc_utpm_rand_bulk(vcpu, addr, len);
+
+  return ret;
+}
+
 static u32 do_TV_HC_TPMNVRAM_GETSIZE(VCPU *vcpu, struct regs *r)
 {
   u32 size_addr;
@@ -505,6 +634,7 @@ u32 tv_app_handlehypercall(VCPU *vcpu, struct regs *r)
 
   u32 status = APP_SUCCESS;
   u32 ret = 0;
+  bool utpm_locked;
 
 //#ifdef __MP_VERSION__
 //  xmhf_smpguest_quiesce(vcpu);
@@ -522,6 +652,14 @@ u32 tv_app_handlehypercall(VCPU *vcpu, struct regs *r)
   }
 
 #define HANDLE(hc) case hc: ret = do_ ## hc (vcpu, r); break
+  /* PALs running on other cpus may use the hardware TPM too */
+#define HANDLE_HWTPM(hc) case hc:               \
+    spin_lock_stat(&g_tv_hwtpm_lock, &g_tv_hwtpm_lock_stats); \
+    ret = do_ ## hc (vcpu, r);                  \
+    spin_unlock_stat(&g_tv_hwtpm_lock, &g_tv_hwtpm_lock_stats); \
+    break
+
+  utpm_locked = scode_lock_running_utpm(vcpu);
 
   switch (cmd) {
     HANDLE( TV_HC_TEST );
@@ -538,9 +676,12 @@ u32 tv_app_handlehypercall(VCPU *vcpu, struct regs *r)
     HANDLE( TV_HC_UTPM_PCRREAD );
     HANDLE( TV_HC_UTPM_PCREXT );
     HANDLE( TV_HC_UTPM_GENRAND );
-    HANDLE( TV_HC_TPMNVRAM_GETSIZE );
-    HANDLE( TV_HC_TPMNVRAM_READALL );
-    HANDLE( TV_HC_TPMNVRAM_WRITEALL );
+    HANDLE( TV_HC_UTPM_GENRAND_BULK );
+    HANDLE( TV_HC_LOCK_STATS );
+    HANDLE( TV_HC_TIME_INFO );
+    HANDLE_HWTPM( TV_HC_TPMNVRAM_GETSIZE );
+    HANDLE_HWTPM( TV_HC_TPMNVRAM_READALL );
+    HANDLE_HWTPM( TV_HC_TPMNVRAM_WRITEALL );
   default:
     {
       eu_err("FATAL ERROR: Invalid vmmcall cmd (%d)", cmd);
@@ -550,6 +691,11 @@ u32 tv_app_handlehypercall(VCPU *vcpu, struct regs *r)
   }
 
 #undef HANDLE
+#undef HANDLE_HWTPM
+
+  if (utpm_locked) {
+    scode_unlock_running_utpm(vcpu);
+  }
 
   if (vcpu->cpu_vendor == CPU_VENDOR_INTEL) {
     r->eax = ret;
@@ -101,7 +101,18 @@ int get_hw_tpm_entropy(uint8_t* buf, unsigned int requested_len /* bytes */) {
   EU_CHK( buf);
 
   actual_len = requested_len;
-  EU_CHKN( rv = tpm_get_random(CRYPTO_INIT_LOCALITY, buf, &actual_len));
+  /* the locality manager only counts holders; commands from other
+     cpus at the same locality must not interleave with ours. callers
+     may hold g_drbg_lock, so g_tv_hwtpm_lock is always taken after
+     it, and its holders mustn't ask for random bytes. */
+  spin_lock_stat(&g_tv_hwtpm_lock, &g_tv_hwtpm_lock_stats);
+  rv = xmhf_tpm_locality_acquire(CRYPTO_INIT_LOCALITY);
+  if (!rv) {
+    rv = tpm_get_random(CRYPTO_INIT_LOCALITY, buf, &actual_len);
+    xmhf_tpm_locality_release(CRYPTO_INIT_LOCALITY);
+  }
+  spin_unlock_stat(&g_tv_hwtpm_lock, &g_tv_hwtpm_lock_stats);
+  EU_CHKN( rv);
 
   /* TODO: Try a few more times before giving up. */
   EU_CHK( actual_len == requested_len,
@@ -136,6 +147,8 @@ static int master_prng_init(void) {
                                         &Nonce, sizeof(Nonce), NULL, 0),
               eu_err_e("FATAL ERROR: nist_ctr_drbg_instantiate FAILED."));
 
+  xmhf_baseplatform_spinlock_stats_register(&g_drbg_lock_stats);
+
   /* set up the libtomcrypt prng wrapper */
   g_ltc_prng_id = register_prng( &tv_sprng_desc);
   EU_CHK( g_ltc_prng_id >= 0);
@@ -286,16 +299,16 @@ static int trustvisor_long_term_secret_init(void) {
 /* TODO: take ciphertext input, e.g., from a multiboot_t */
 int trustvisor_master_crypto_init(void) {
   int rv=1;
-  bool opened_tpm=false;
+  bool held_tpm=false;
 
   /* ensure libtomcrypto's math descriptor is initialized */
   if (!ltc_mp.name) {
     ltc_mp = ltm_desc;
   }
 
-  EU_CHKN( rv = xmhf_tpm_open_locality(CRYPTO_INIT_LOCALITY),
+  EU_CHKN( rv = xmhf_tpm_locality_acquire(CRYPTO_INIT_LOCALITY),
            eu_err_e( "FATAL ERROR: Could not access HW TPM."));
-  opened_tpm=true;
+  held_tpm=true;
 		
   /* PRNG */
   EU_CHKN( rv = master_prng_init(),
@@ -333,8 +346,9 @@ int trustvisor_master_crypto_init(void) {
    * available to the legacy OS. */
   rv=0;
  out:
-  if (opened_tpm) {
-    xmhf_tpm_deactivate_all_localities();
+  if (held_tpm) {
+    xmhf_tpm_locality_release(CRYPTO_INIT_LOCALITY);
+    xmhf_tpm_locality_relinquish();
   }
 		
   return rv;
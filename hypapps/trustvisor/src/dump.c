@@ -104,16 +104,14 @@ nist_dump_ctr_drbg(const NIST_CTR_DRBG* drbg)
 }
 
 void
-nist_dump_aes_ctx(const rijndael_ctx* ctx)
+nist_dump_aes_ctx(const NIST_AES_ENCRYPT_CTX* ctx)
 {
-	printf("  Nr = %d\n  ek:\n", ctx->Nr);
+	printf("  Nr = %d\n  ek:\n", ctx->nr);
 	nist_dump_hex(ctx->ek, sizeof(ctx->ek));
 
 	printf("\n");
 
-	if (!ctx->enc_only) {
-		printf("  dk:\n");
-		nist_dump_hex(ctx->dk, sizeof(ctx->dk));
-		printf("\n");
-	}
+	printf("  dk:\n");
+	nist_dump_hex(ctx->dk, sizeof(ctx->dk));
+	printf("\n");
 }
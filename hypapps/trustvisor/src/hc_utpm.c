@@ -65,6 +65,8 @@
 #include <tv_utpm.h> /* formerly utpm.h */
 #include <hc_utpm.h>
 #include <scode.h> /* copy_from_guest */
+#include <hptw_emhf.h>
+#include <random.h>
 #include <malloc.h> /* malloc */
 
 #include <tv_log.h>
@@ -599,6 +601,46 @@ u32 hc_utpm_rand(VCPU * vcpu, u32 buffer_addr, u32 numbytes_addr)
 	return ret;
 }
 
+/* fills a page-aligned run of whole PAL pages with random bytes in
+ * one hypercall. each page is looked up once, and the DRBG writes
+ * straight into it rather than through a bounce buffer. on failure
+ * the buffer may have been partially filled. */
+u32 hc_utpm_rand_bulk(VCPU * vcpu, u32 buffer_addr, u32 numbytes)
+{
+	hptw_emhf_checked_guest_ctx_t ctx;
+	u32 ret = 1;
+	u32 done;
+	size_t avail;
+	unsigned int chunk;
+	u8 *page;
+
+	/* make sure that this vmmcall can only be executed when a PAL is running */
+	EU_CHK( scode_curr[vcpu->id] != -1,
+		eu_err_e("GenRandomBulk ERROR: no PAL is running!"));
+
+	EU_CHK( numbytes > 0 && numbytes <= MAX_TPM_RAND_BULK_LEN
+		&& buffer_addr % TPM_RAND_BULK_GRANULE == 0
+		&& numbytes % TPM_RAND_BULK_GRANULE == 0,
+		eu_err_e("GenRandomBulk ERROR: bad buffer %x, len %d!",
+			 buffer_addr, numbytes));
+
+	EU_CHKN( hptw_emhf_checked_guest_ctx_init_of_vcpu( &ctx, vcpu));
+
+	for (done = 0; done < numbytes; done += chunk) {
+		EU_CHK( page = hptw_checked_access_va( &ctx.super, HPT_PROTS_W, ctx.cpl,
+						       buffer_addr + done,
+						       TPM_RAND_BULK_GRANULE, &avail));
+		chunk = avail;
+		EU_CHKN( ret = rand_bytes(page, &chunk),
+			 eu_err_e("GenRandomBulk ERROR: rand byte error; numbytes=%d!",
+				  numbytes));
+	}
+
+	ret = 0;
+ out:
+	return ret;
+}
+
 /* Local Variables: */
 /* mode:c           */
 /* indent-tabs-mode:'t */
@@ -47,6 +47,8 @@
 #include <hptw_emhf.h>
 #include <hpt_emhf.h>
 #include <tv_log.h>
+#include <mcache.h>
+#include <scode.h>
 
 static hpt_pa_t hptw_emhf_host_ctx_ptr2pa(void *vctx, void *ptr)
 {
@@ -95,14 +97,34 @@ static hpt_pa_t hptw_emhf_checked_guest_ctx_ptr2pa(void __attribute__((unused))
 static void* hptw_emhf_checked_guest_ctx_pa2ptr(void *vctx, hpt_pa_t gpa, size_t sz, hpt_prot_t access_type, hptw_cpl_t cpl, size_t *avail_sz)
 {
   hptw_emhf_checked_guest_ctx_t *ctx = vctx;
+  void *rv;
   HALT_ON_ERRORCOND(ctx);
 
-  return hptw_checked_access_va(&ctx->hptw_host_ctx.super,
+  /* reg guest memory may be write-protected only to keep a cached
+     measurement valid. writing to it on the guest's behalf drops the
+     measurement, as a write by the guest itself would. */
+  if (access_type & HPT_PROTS_W) {
+    mcache_reg_write(&ctx->hptw_host_ctx.super, gpa);
+  }
+
+  rv = hptw_checked_access_va(&ctx->hptw_host_ctx.super,
+                              access_type,
+                              cpl,
+                              gpa,
+                              sz,
+                              avail_sz);
+
+  /* pages of PAL stacks are mapped on first touch, including touches
+     made by the hypervisor on the PAL's behalf. */
+  if (!rv && scode_exec_claim_npt_page(&ctx->hptw_host_ctx.super, gpa)) {
+    rv = hptw_checked_access_va(&ctx->hptw_host_ctx.super,
                                 access_type,
                                 cpl,
                                 gpa,
                                 sz,
                                 avail_sz);
+  }
+  return rv;
 }
 
 static void* hptw_emhf_checked_guest_ctx_gzp(void *vctx, size_t alignment, size_t sz)
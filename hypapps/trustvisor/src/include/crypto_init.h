@@ -59,6 +59,11 @@ extern uint8_t g_nvpalpcr0[20];
 
 extern NIST_CTR_DRBG g_drbg;
 
+/* serializes runtime use of the hardware TPM: the NV hypercalls, and
+   DRBG reseeds, which may happen on several cpus at once. */
+extern volatile u32 g_tv_hwtpm_lock;
+extern SPINLOCK_STATS g_tv_hwtpm_lock_stats;
+
 int get_hw_tpm_entropy(uint8_t* buf, unsigned int requested_len /* bytes */);
 int trustvisor_master_crypto_init(void);
 
@@ -58,5 +58,6 @@ uint32_t hc_utpm_utpm_id_getpub(VCPU * vcpu, gva_t dst_gva, gva_t dst_sz_gva);
 u32 hc_utpm_pcrread(VCPU * vcpu, u32 gvaddr, u32 num);
 u32 hc_utpm_pcrextend(VCPU * vcpu, u32 idx, u32 meas_gvaddr);
 u32 hc_utpm_rand(VCPU * vcpu, u32 buffer_addr, u32 numbytes_addr);
+u32 hc_utpm_rand_bulk(VCPU * vcpu, u32 buffer_addr, u32 numbytes);
 
 #endif /* _PAL_UTPM_H_ */
@@ -0,0 +1,138 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* mcache.h - cache of PAL section measurements
+ *
+ * A PAL that is registered over and over (e.g., by a service that
+ * loads and unloads it per request) is normally backed by the same
+ * guest-physical frames each time. For sections that the PAL cannot
+ * write, we remember the digest computed at registration along with
+ * the frames it was computed over. When such a section is returned
+ * to the reg guest, its frames stay write-protected in the reg
+ * nested page tables. The first write to any of them, by the guest
+ * or by TrustVisor on the guest's behalf, drops the cached digest
+ * and makes the frames writable again. A later registration over
+ * the same frames can thus reuse the digest without rehashing.
+ *
+ * Not tracked: DMA writes by devices, which TrustVisor also does not
+ * prevent for sections lent to a running PAL.
+ */
+
+#ifndef _MCACHE_H_
+#define _MCACHE_H_
+
+#include <scode.h>
+
+#define MCACHE_ENTRIES 16
+
+/* sections backed by more discontiguous runs of frames than this are
+   not cached */
+#define MCACHE_MAX_RUNS 8
+
+typedef struct {
+  hpt_pa_t gpa; /* guest-physical */
+  u32 pages;
+} mcache_run_t;
+
+typedef struct {
+  u32 section_type;
+  hpt_va_t pal_gva;
+  size_t size;
+
+  size_t num_runs;
+  bool incomplete; /* runs[] does not describe every frame; never cached */
+  mcache_run_t runs[MCACHE_MAX_RUNS];
+} mcache_key_t;
+
+void mcache_init(void);
+
+bool mcache_section_is_cacheable(const tv_pal_section_int_t *section);
+
+void mcache_key_init(mcache_key_t *key, const tv_pal_section_int_t *section);
+void mcache_key_add_page(mcache_key_t *key, hpt_pa_t gpa);
+bool mcache_key_equal(const mcache_key_t *a, const mcache_key_t *b);
+
+/* look up a section about to be lent. on a hit returns a non-zero
+   tag, and the entry is held until mcache_return_section or
+   mcache_drop. returns 0 on a miss. */
+u32 mcache_claim(hptw_ctx_t *reg_npm_ctx, const mcache_key_t *key, TPM_DIGEST *digest);
+
+/* remember the digest of a section that was just lent and
+   measured. returns the tag of the new entry, or 0 if not cached. */
+u32 mcache_insert(hptw_ctx_t *reg_npm_ctx, const mcache_key_t *key, const TPM_DIGEST *digest);
+
+/* forget an entry returned by mcache_claim or mcache_insert */
+void mcache_drop(u32 tag);
+
+/* drop cached digests covering gpa, making their frames writable
+   again, except for those that could be claimed by 'spare' (may be
+   NULL). */
+void mcache_invalidate_page(hptw_ctx_t *reg_npm_ctx, hpt_pa_t gpa,
+                            const tv_pal_section_int_t *spare);
+void mcache_invalidate_all(hptw_ctx_t *reg_npm_ctx);
+
+/* called before the reg guest's page at gpa is written, whether by
+   the guest (on a nested page fault) or by TrustVisor on its
+   behalf. returns true if the page was write-protected by the cache
+   and now is writable. */
+bool mcache_reg_write(hptw_ctx_t *reg_npm_ctx, hpt_pa_t gpa);
+
+/* return a section to the reg guest, keeping its frames
+   write-protected if it has a cache entry. replaces
+   scode_return_section for sections lent by scode_register and
+   scode_share_range. */
+void mcache_return_section(hptw_ctx_t *reg_npm_ctx,
+                           hptw_ctx_t *pal_npm_ctx,
+                           hptw_ctx_t *pal_gpm_ctx,
+                           const tv_pal_section_int_t *section);
+
+#endif /* _MCACHE_H_ */
+
+/* Local Variables: */
+/* mode:c           */
+/* indent-tabs-mode:nil */
+/* c-basic-offset:2 */
+/* End:             */
@@ -0,0 +1,164 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* a pool of 4K pages for page tables and other page-sized
+ * allocations. pages are carved out of slabs taken from the heap as
+ * needed, up to a hard cap, and freed pages are kept on free lists to
+ * be handed out again rather than given back to the heap right away.
+ *
+ * pages are zeroed lazily. freed pages are 'dirty', and are only
+ * cleared when handed out again as zeroed pages, unless
+ * pagepool_scrub gets to them first. call that where the time isn't
+ * on anyone's critical path.
+ *
+ * each CPU keeps a few free pages of its own, so that most
+ * allocations and frees don't take the pool lock. pages are charged
+ * to an owner, which caps the number of pages it may hold and gives
+ * them all back at once. an owner must only be used by one CPU at a
+ * time.
+ *
+ * this has no dependencies on the rest of TrustVisor so that it can
+ * be built into userspace tests as well.
+ */
+
+#ifndef PAGEPOOL_H
+#define PAGEPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PAGEPOOL_PAGE_SIZE 4096
+#define PAGEPOOL_SLAB_PAGES 32
+#define PAGEPOOL_CACHE_PAGES 16
+
+struct pagepool_owner;
+
+typedef struct {
+  void *buf; /* as returned by malloc, or NULL if the slot is unused */
+  void *base; /* first page */
+  struct pagepool_owner *owner[PAGEPOOL_SLAB_PAGES];
+  void *next[PAGEPOOL_SLAB_PAGES]; /* next page of the same owner */
+} pagepool_slab_t;
+
+typedef struct {
+  size_t num_clean;
+  size_t num_dirty;
+  void *clean[PAGEPOOL_CACHE_PAGES];
+  void *dirty[PAGEPOOL_CACHE_PAGES];
+
+  /* statistics */
+  size_t allocs;
+  size_t zeroed; /* pages zeroed when handed out */
+} pagepool_cache_t;
+
+typedef struct pagepool_owner {
+  size_t max; /* hard cap on the pages held */
+  size_t used; /* pages held */
+  size_t peak; /* most pages held at once */
+  size_t fails; /* allocations refused */
+  void *pages; /* pages held, linked through their slabs' next */
+} pagepool_owner_t;
+
+typedef struct {
+  volatile uint32_t lock;
+
+  /* free pages, linked through their first word */
+  void *clean;
+  void *dirty;
+  size_t num_clean;
+  size_t num_dirty;
+
+  pagepool_slab_t *slabs;
+  size_t max_slabs;
+  size_t num_slabs; /* slots used so far, including released ones */
+
+  pagepool_cache_t *caches; /* one per CPU */
+  size_t num_caches;
+
+  /* statistics */
+  size_t scrubbed; /* pages zeroed by pagepool_scrub */
+} pagepool_t;
+
+/* sets up pool to hand out at most max_slabs*PAGEPOOL_SLAB_PAGES
+ * pages, using num_caches CPU caches. no memory is taken from the
+ * heap until pages are asked for.
+ */
+void pagepool_init(pagepool_t *pool,
+                   pagepool_slab_t *slabs, size_t max_slabs,
+                   pagepool_cache_t *caches, size_t num_caches);
+
+void pagepool_owner_init(pagepool_owner_t *owner, size_t max);
+
+/* gets a page for owner, through the cache of cpu, which must be less
+ * than the pool's num_caches. returns NULL if owner already holds its
+ * maximum, or the pool is at its cap or out of heap.
+ */
+void* pagepool_alloc(pagepool_t *pool, pagepool_owner_t *owner,
+                     size_t cpu, bool zeroed);
+
+/* gives back all pages held by owner. pages that may hold secrets
+ * should be cleared, which zeroes them now rather than when they are
+ * next handed out.
+ */
+void pagepool_free_all(pagepool_t *pool, pagepool_owner_t *owner,
+                       size_t cpu, bool clear);
+
+bool pagepool_owns(const pagepool_t *pool, const pagepool_owner_t *owner,
+                   const void *page);
+
+/* zeroes up to max dirty pages on the pool's free lists, so that
+ * later zeroed allocations needn't. returns the number zeroed.
+ */
+size_t pagepool_scrub(pagepool_t *pool, size_t max);
+
+/* gives slabs with all pages on the pool's free lists back to the
+ * heap. pages in CPU caches keep their slabs. returns the number of
+ * pages released.
+ */
+size_t pagepool_trim(pagepool_t *pool);
+
+#endif
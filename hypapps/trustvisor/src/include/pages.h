@@ -48,17 +48,45 @@
 #define PAGES_H
 
 #include <xmhf.h> 
+#include <pagepool.h>
 
+/* a list of pages held by one user, such as a PAL's page tables.
+ * pages come from a pool shared by all lists, capped at num_allocd
+ * pages per list, except for contiguous lists, which reserve a single
+ * buffer of num_allocd pages up front for users that need to map it
+ * as a whole.
+ */
 typedef struct {
-  void *buf;
+  void *buf; /* contiguous lists only */
   void *page_base;
   size_t num_allocd;
   size_t num_used;
+  bool contiguous;
+  bool secret; /* zero pages as they are given back */
+  pagepool_owner_t owner; /* pooled lists only */
 } pagelist_t;
 
+/* sets up the pool that pagelists draw their pages from. call once,
+ * after mem_init.
+ */
+void pagelist_pool_init(void);
+
+/* zeroes some of the pages freed to the pool and gives wholly free
+ * slabs back to the heap. call where the time isn't on anyone's
+ * critical path.
+ */
+void pagelist_pool_idle(void);
+
 void pagelist_init(pagelist_t *pl);
+void pagelist_init_sized(pagelist_t *pl, size_t pages);
+int pagelist_init_contiguous(pagelist_t *pl, size_t pages);
+/* changes the cap of a pooled list. pages held beyond a lowered cap
+   are kept until the list is reset. */
+void pagelist_set_max(pagelist_t *pl, size_t pages);
 void* pagelist_get_page(pagelist_t *pl);
 void* pagelist_get_zeroedpage(pagelist_t *pl);
+void pagelist_reset(pagelist_t *pl);
+bool pagelist_contains(const pagelist_t *pl, const void *page);
 void pagelist_free_all(pagelist_t *pl);
 
 #endif
@@ -60,4 +60,7 @@ extern const struct ltc_prng_descriptor tv_sprng_desc;
 extern prng_state g_ltc_prng;
 extern int g_ltc_prng_id;
 
+/* contention statistics for the lock around the drbg */
+extern SPINLOCK_STATS g_drbg_lock_stats;
+
 #endif /* _RANDOM_H_ */
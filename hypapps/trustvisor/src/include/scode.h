@@ -98,25 +98,66 @@ typedef struct {
   hpt_prot_t pal_prot;
   hpt_prot_t reg_prot;
   u32 section_type;
+  u32 mcache_tag; /* measurement cache entry, or 0. see mcache.h */
 } tv_pal_section_int_t;
 
+/* state of one invocation of a PAL. a PAL may run on several cpus at
+ * once, each invocation in its own execution context. contexts have
+ * their own nested page tables, copied on write from the PAL's,
+ * which stay untouched after registration. memory shared with an
+ * invocation is only mapped in its context. all but the first
+ * context also back the PAL's STACK and PARAM sections with private
+ * pages, so that concurrent invocations neither share a stack nor
+ * clobber each other's parameters. DATA sections are shared by all
+ * invocations, like globals by threads.
+ */
+#define SCODE_EXEC_FREE 0
+#define SCODE_EXEC_SHARED 1   /* has memory shared for the next invocation on vcpu_id */
+#define SCODE_EXEC_RUNNING 2  /* PAL is running on vcpu_id */
+#define SCODE_EXEC_SHARING 3  /* memory is being shared for the next invocation on vcpu_id */
+
+/* pages for a context's copies of nested page tables */
+#define SCODE_EXEC_NPT_PAGES 32
+/* most pages of those a context may have while memory is shared with
+   it, however much the guest asks to share */
+#define SCODE_EXEC_NPT_MAX_PAGES 512
+/* most pages of STACK and PARAM sections a PAL may have and still run
+   concurrently */
+#define SCODE_EXEC_PRIV_MAX_PAGES 64
+
+typedef struct scode_exec_ctx {
+  u32 state;
+  u32 vcpu_id;
+
+  u32 grsp;		/* guest reguar stack */
+  u32 return_v; /* return point virtual address */
+  u32 saved_exception_intercepts;
+
+  pagelist_t *npl;
+  bool npt_valid;
+  hptw_emhf_host_ctx_t hptw_pal_host_ctx;
+  hptw_emhf_checked_guest_ctx_t hptw_pal_checked_guest_ctx;
+
+  pagelist_t *priv; /* backing for STACK and PARAM sections, or NULL */
+  size_t priv_pages;
+
+  tv_pal_section_int_t shared[TV_MAX_SECTIONS];
+  size_t shared_num;
+} scode_exec_ctx_t;
+
 /* scode state struct */
 typedef struct whitelist_entry{
   u64 gcr3; 
   u32 id;
-  u32 grsp;		/* guest reguar stack */
   u32 gssp;		/* guest sensitive code stack */
   u32 gss_size;   /* guest sensitive code stack page number */
   u32 entry_v; /* entry point virtual address */
   u32 entry_p; /* entry point physical address */
-  u32 return_v; /* return point virtual address */
 
   u32 gpmp;     /* guest parameter page address */
   u32 gpm_size; /* guest parameter page number */
   u32 gpm_num;  /* guest parameter number */
 
-  u32 saved_exception_intercepts;
-
   tv_pal_section_int_t sections[TV_MAX_SECTIONS];
   size_t sections_num;
 
@@ -127,10 +168,14 @@ typedef struct whitelist_entry{
 
   pte_t * pte_page;  /* holder for guest page table entry to access scode and GDT */
   u32 pte_size;	/* total size of all PTE pages */
-//#ifdef __MP_VERSION__
-  u32 pal_running_lock; /* PAL running lock */
-  u32 pal_running_vcpu_id; /* the cpu that is running this PAL */
-//#endif
+  /* execution contexts, one per invocation running or about to run */
+  scode_exec_ctx_t *exec;
+  size_t exec_max;
+  /* the struct is packed, but locked instructions on the locks must
+     not straddle a cache line, so they are kept aligned */
+  u32 exec_lock __attribute__ ((aligned (4))); /* protects exec[].state, dying, and the pal's guest page tables */
+  u32 utpm_lock __attribute__ ((aligned (4))); /* serializes uTPM hypercalls of concurrent invocations */
+  bool dying; /* being unregistered. no more contexts are handed out */
 
   /* Micro-TPM related */
   utpm_master_state_t utpm;
@@ -167,20 +212,49 @@ u32 hpt_scode_switch_regular(VCPU * vcpu);
 u32 hpt_scode_npf(VCPU * vcpu, u32 gpaddr, u64 errorcode);
 u32 scode_share(VCPU * vcpu, u32 scode_entry, u32 addr, u32 len);
 u32 scode_share_ranges(VCPU * vcpu, u32 scode_entry, u32 gva_base[], u32 gva_len[], u32 count);
+bool scode_lock_running_utpm(VCPU *vcpu);
+void scode_unlock_running_utpm(VCPU *vcpu);
 
 u32 scode_register(VCPU * vcpu, u32 scode_info, u32 scode_pm, u32 gventry);
 u32 scode_unregister(VCPU * vcpu, u32 gvaddr);
 void init_scode(VCPU * vcpu);
 
+/* called for each page of a section as it is lent or returned, with
+   the page's reg guest-physical address and a pointer through which
+   the hypervisor can read it */
+typedef void (*scode_section_page_fn)(void *arg, hpt_pa_t page_reg_gpa, const void *page);
+
 void scode_lend_section( hptw_ctx_t *reg_npm_ctx,
                          hptw_ctx_t *reg_gpm_ctx,
                          hptw_ctx_t *pal_npm_ctx,
                          hptw_ctx_t *pal_gpm_ctx,
-                         const tv_pal_section_int_t *section);
+                         const tv_pal_section_int_t *section,
+                         scode_section_page_fn visit,
+                         void *visit_arg);
+void scode_reserve_section( hptw_ctx_t *reg_npm_ctx,
+                            hptw_ctx_t *reg_gpm_ctx,
+                            hptw_ctx_t *pal_npm_ctx,
+                            hptw_ctx_t *pal_gpm_ctx,
+                            const tv_pal_section_int_t *section);
 void scode_return_section( hptw_ctx_t *reg_npm_ctx,
                            hptw_ctx_t *pal_npm_ctx,
                            hptw_ctx_t *pal_gpm_ctx,
-                           const tv_pal_section_int_t *section);
+                           const tv_pal_section_int_t *section,
+                           hpt_prot_t reg_prot,
+                           scode_section_page_fn visit,
+                           void *visit_arg);
+
+/* PAL execution contexts */
+extern hptw_emhf_host_ctx_t g_hptw_reg_host_ctx;
+int scode_exec_init(whitelist_entry_t *wle, size_t max);
+void scode_exec_free(whitelist_entry_t *wle);
+scode_exec_ctx_t* scode_exec_acquire(whitelist_entry_t *wle, VCPU *vcpu, u32 state);
+void scode_exec_set_state(whitelist_entry_t *wle, scode_exec_ctx_t *ctx, u32 state);
+scode_exec_ctx_t* scode_exec_current(whitelist_entry_t *wle, VCPU *vcpu);
+void scode_exec_release(whitelist_entry_t *wle, scode_exec_ctx_t *ctx);
+int scode_exec_own_path(scode_exec_ctx_t *ctx, hpt_pa_t gpa);
+int scode_exec_claim_page(whitelist_entry_t *wle, scode_exec_ctx_t *ctx, hpt_pa_t gpa);
+bool scode_exec_claim_npt_page(const hptw_ctx_t *npm_ctx, hpt_pa_t gpa);
 
 int scode_clone_gdt(VCPU *vcpu,
                     gva_t gdtr_base, size_t gdtr_lim,
@@ -67,6 +67,7 @@ enum HCcmd {
   TV_HC_UTPM_UNSEAL	=11,
   TV_HC_UTPM_QUOTE =12,
   TV_HC_UTPM_ID_GETPUB =13,
+  TV_HC_UTPM_GENRAND_BULK =14,
   /* Reserving up through 20 for more UTPM stuff; don't touch! */
 
   /* These are privileged commands; only a special PAL can use them */
@@ -75,9 +76,43 @@ enum HCcmd {
   TV_HC_TPMNVRAM_WRITEALL = 23,
   
   /* misc */
+  TV_HC_LOCK_STATS =24,
+  TV_HC_TIME_INFO =25,
   TV_HC_TEST =255,
 };
 
+/*
+ * spinlock statistics returned by TV_HC_LOCK_STATS. cycles are
+ * hypervisor TSC cycles.
+ */
+#define TV_LOCK_STATS_NAME_LEN 16
+#define TV_LOCK_STATS_MAX 32
+struct tv_lock_stats {
+  char name[TV_LOCK_STATS_NAME_LEN];
+  uint64_t acquisitions; /* times the lock was taken */
+  uint64_t contended;    /* ...of which had to wait */
+  uint64_t spins;        /* pause rounds spent waiting */
+  uint64_t hold_cycles;  /* total time held */
+  uint64_t hold_max;     /* longest single hold */
+};
+
+/*
+ * time parameters returned by TV_HC_TIME_INFO. now_us is the
+ * hypervisor's monotonic clock, in microseconds since tsc_base. when
+ * TV_TIME_TSC_INVARIANT is set, a PAL may compute the same clock
+ * itself from rdtsc, tsc_base and tsc_khz without further hypercalls,
+ * since TrustVisor neither offsets nor traps the guest's TSC.
+ * epoch_nonce is fixed for the life of the hypervisor.
+ */
+#define TV_TIME_TSC_INVARIANT (1u << 0)
+struct tv_time_info {
+  uint64_t epoch_nonce;
+  uint64_t tsc_base;
+  uint32_t tsc_khz;
+  uint32_t flags;
+  uint64_t now_us;
+};
+
 /*
  * structs for pal-registration descriptor
  */
@@ -106,15 +141,21 @@ struct tv_pal_sections {
   struct tv_pal_section sections[TV_MAX_SECTIONS];
 };
 
-/* parameter type */
+/* parameter type. POINTER parameters are copied into the PAL's PARAM
+ * section before it runs and back out afterwards. SHARED parameters
+ * point into memory shared with the invocation by TV_HC_SHARE. the
+ * PAL gets the pointer itself, once all size words of it are found
+ * to lie in one shared range, and nothing is copied.
+ */
 enum tv_pal_param_type {
   TV_PAL_PM_INTEGER =1,
   TV_PAL_PM_POINTER =2,
+  TV_PAL_PM_SHARED =3,
 };
 
 struct tv_pal_param {
-  enum tv_pal_param_type type;  /* 1: integer ;  2:pointer*/
-  uint32_t size;
+  enum tv_pal_param_type type;  /* 1: integer ;  2:pointer ;  3:shared pointer */
+  uint32_t size; /* in words */
 };
 
 #define TV_MAX_PARAMS 10
@@ -59,9 +59,14 @@
 #include <tv_log.h>
 
 tlsf_pool g_pool;
+/* tlsf isn't thread-safe, and PALs run concurrently on several cpus */
+static volatile u32 g_pool_lock=1;
+static SPINLOCK_STATS g_pool_lock_stats = SPINLOCK_STATS_INITIALIZER("tv_pool");
+
 void mem_init(void){
     static uint8_t memory_pool[HEAPMEM_POOLSIZE];
     g_pool = tlsf_create(memory_pool, HEAPMEM_POOLSIZE);
+    xmhf_baseplatform_spinlock_stats_register(&g_pool_lock_stats);
 }
 
 /* size_t heapmem_get_used_size(void) */
@@ -74,7 +79,10 @@ void *malloc(size_t size)
   void *p;
   perf_ctr_timer_start(&g_tv_perf_ctrs[TV_PERF_CTR_SAFEMALLOC], 0/*FIXME*/);
 
-  EU_CHK_W( p = tlsf_malloc(g_pool, size),
+  spin_lock_stat(&g_pool_lock, &g_pool_lock_stats);
+  p = tlsf_malloc(g_pool, size);
+  spin_unlock_stat(&g_pool_lock, &g_pool_lock_stats);
+  EU_CHK_W( p,
             eu_warn_e( "malloc: allocation of size %d failed.", size));
 
  out:
@@ -85,7 +93,9 @@ void *malloc(size_t size)
 void *calloc(size_t nmemb, size_t size)
 {
   void *p;
+  spin_lock_stat(&g_pool_lock, &g_pool_lock_stats);
   p = tlsf_malloc(g_pool, nmemb * size);
+  spin_unlock_stat(&g_pool_lock, &g_pool_lock_stats);
 
   if(NULL != p) {
     memset(p, 0, nmemb * size);
@@ -96,10 +106,16 @@ void *calloc(size_t nmemb, size_t size)
 
 void *realloc(void *ptr, size_t size)
 {
-  return tlsf_realloc(g_pool, ptr, size);
+  void *p;
+  spin_lock_stat(&g_pool_lock, &g_pool_lock_stats);
+  p = tlsf_realloc(g_pool, ptr, size);
+  spin_unlock_stat(&g_pool_lock, &g_pool_lock_stats);
+  return p;
 }
 
 void free(void *ptr)
 {
+  spin_lock_stat(&g_pool_lock, &g_pool_lock_stats);
   tlsf_free(g_pool, ptr);
+  spin_unlock_stat(&g_pool_lock, &g_pool_lock_stats);
 }
@@ -0,0 +1,428 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* mcache.c - cache of PAL section measurements. see mcache.h */
+
+#include <xmhf.h>
+#include <mcache.h>
+#include <tv_log.h>
+
+typedef enum {
+  MCACHE_FREE=0,
+  MCACHE_LENT,    /* section is lent to a registered PAL */
+  MCACHE_TRACKED, /* section was returned. frames are write-protected
+                     in the reg npt */
+} mcache_state_t;
+
+typedef struct {
+  mcache_state_t state;
+  u32 tag;
+  mcache_key_t key;
+  TPM_DIGEST digest;
+} mcache_entry_t;
+
+static mcache_entry_t mcache[MCACHE_ENTRIES];
+static u32 mcache_next_tag;
+static hpt_pa_t mcache_reg_root_pa;
+static volatile u32 mcache_lock=1;
+static SPINLOCK_STATS mcache_lock_stats = SPINLOCK_STATS_INITIALIZER("tv_mcache");
+
+void mcache_init(void)
+{
+  memset(mcache, 0, sizeof(mcache));
+  mcache_next_tag = 1;
+  mcache_reg_root_pa = 0;
+  xmhf_baseplatform_spinlock_stats_register(&mcache_lock_stats);
+}
+
+/* only sections whose contents the PAL cannot change are cached;
+   others typically need to be re-measured anyways. */
+bool mcache_section_is_cacheable(const tv_pal_section_int_t *section)
+{
+  return !(section->pal_prot & HPT_PROTS_W)
+    && !(section->reg_prot & HPT_PROTS_W);
+}
+
+void mcache_key_init(mcache_key_t *key, const tv_pal_section_int_t *section)
+{
+  memset(key, 0, sizeof(*key));
+  key->section_type = section->section_type;
+  key->pal_gva = section->pal_gva;
+  key->size = section->size;
+}
+
+void mcache_key_add_page(mcache_key_t *key, hpt_pa_t gpa)
+{
+  mcache_run_t *last;
+
+  if (key->incomplete) {
+    return;
+  }
+
+  last = key->num_runs ? &key->runs[key->num_runs-1] : NULL;
+  if (last && last->gpa + (hpt_pa_t)last->pages * PAGE_SIZE_4K == gpa) {
+    last->pages++;
+  } else if (key->num_runs < MCACHE_MAX_RUNS) {
+    key->runs[key->num_runs++] = (mcache_run_t) {
+      .gpa = gpa,
+      .pages = 1,
+    };
+  } else {
+    key->incomplete = true;
+  }
+}
+
+static bool mcache_key_same_section(const mcache_key_t *key,
+                                    u32 section_type, hpt_va_t pal_gva, size_t size)
+{
+  return key->section_type == section_type
+    && key->pal_gva == pal_gva
+    && key->size == size;
+}
+
+bool mcache_key_equal(const mcache_key_t *a, const mcache_key_t *b)
+{
+  size_t i;
+
+  if (a->incomplete || b->incomplete
+      || !mcache_key_same_section(a, b->section_type, b->pal_gva, b->size)
+      || a->num_runs != b->num_runs) {
+    return false;
+  }
+  for (i=0; i < a->num_runs; i++) {
+    if (a->runs[i].gpa != b->runs[i].gpa
+        || a->runs[i].pages != b->runs[i].pages) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool mcache_key_contains(const mcache_key_t *key, hpt_pa_t gpa)
+{
+  size_t i;
+
+  gpa &= ~((hpt_pa_t)PAGE_SIZE_4K-1);
+  for (i=0; i < key->num_runs; i++) {
+    if (gpa >= key->runs[i].gpa
+        && gpa < key->runs[i].gpa + (hpt_pa_t)key->runs[i].pages * PAGE_SIZE_4K) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool mcache_keys_overlap(const mcache_key_t *a, const mcache_key_t *b)
+{
+  size_t i, j;
+
+  for (i=0; i < a->num_runs; i++) {
+    hpt_pa_t a_end = a->runs[i].gpa + (hpt_pa_t)a->runs[i].pages * PAGE_SIZE_4K;
+    for (j=0; j < b->num_runs; j++) {
+      hpt_pa_t b_end = b->runs[j].gpa + (hpt_pa_t)b->runs[j].pages * PAGE_SIZE_4K;
+      if (a->runs[i].gpa < b_end && b->runs[j].gpa < a_end) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/* PRE: mcache_lock held */
+static void mcache_evict(hptw_ctx_t *reg_npm_ctx, mcache_entry_t *e)
+{
+  size_t i, pg;
+  bool was_tracked = (e->state == MCACHE_TRACKED);
+
+  eu_trace("evicting entry tag %u state %d", e->tag, (int)e->state);
+  e->state = MCACHE_FREE;
+  if (!was_tracked) {
+    /* frames are lent to a PAL, which will return them writable once
+       it finds the entry gone */
+    return;
+  }
+
+  for (i=0; i < e->key.num_runs; i++) {
+    for (pg=0; pg < e->key.runs[i].pages; pg++) {
+      hptw_set_prot(reg_npm_ctx,
+                    e->key.runs[i].gpa + (hpt_pa_t)pg * PAGE_SIZE_4K,
+                    HPT_PROTS_RWX);
+    }
+  }
+
+  /* any other entry sharing frames with this one has just lost its
+     write protection too */
+  for (i=0; i < MCACHE_ENTRIES; i++) {
+    if (mcache[i].state == MCACHE_TRACKED
+        && mcache_keys_overlap(&mcache[i].key, &e->key)) {
+      mcache_evict(reg_npm_ctx, &mcache[i]);
+    }
+  }
+}
+
+u32 mcache_claim(hptw_ctx_t *reg_npm_ctx, const mcache_key_t *key, TPM_DIGEST *digest)
+{
+  size_t i;
+  u32 tag=0;
+
+  spin_lock_stat(&mcache_lock, &mcache_lock_stats);
+
+  /* first get rid of stale versions of this section; evicting them
+     may also evict a matching entry that shares frames with them */
+  for (i=0; i < MCACHE_ENTRIES; i++) {
+    if (mcache[i].state == MCACHE_TRACKED
+        && mcache_key_same_section(&mcache[i].key,
+                                   key->section_type, key->pal_gva, key->size)
+        && !mcache_key_equal(&mcache[i].key, key)) {
+      mcache_evict(reg_npm_ctx, &mcache[i]);
+    }
+  }
+
+  for (i=0; i < MCACHE_ENTRIES; i++) {
+    if (mcache[i].state == MCACHE_TRACKED
+        && mcache_key_equal(&mcache[i].key, key)) {
+      mcache[i].state = MCACHE_LENT;
+      *digest = mcache[i].digest;
+      tag = mcache[i].tag;
+      break;
+    }
+  }
+
+  spin_unlock_stat(&mcache_lock, &mcache_lock_stats);
+  return tag;
+}
+
+u32 mcache_insert(hptw_ctx_t *reg_npm_ctx, const mcache_key_t *key, const TPM_DIGEST *digest)
+{
+  size_t i;
+  mcache_entry_t *victim=NULL;
+  u32 tag=0;
+
+  if (key->incomplete) {
+    return 0;
+  }
+
+  spin_lock_stat(&mcache_lock, &mcache_lock_stats);
+
+  for (i=0; i < MCACHE_ENTRIES; i++) {
+    if (mcache[i].state != MCACHE_FREE
+        && mcache_key_equal(&mcache[i].key, key)) {
+      /* already held by another registration of the same frames */
+      goto out;
+    }
+  }
+
+  /* prefer a free slot, then the oldest returned section, then the
+     oldest lent one */
+  for (i=0; i < MCACHE_ENTRIES && !victim; i++) {
+    if (mcache[i].state == MCACHE_FREE) {
+      victim = &mcache[i];
+    }
+  }
+  for (i=0; i < MCACHE_ENTRIES; i++) {
+    if (mcache[i].state == MCACHE_TRACKED
+        && (!victim || (victim->state == MCACHE_TRACKED && mcache[i].tag < victim->tag))) {
+      victim = &mcache[i];
+    }
+  }
+  for (i=0; i < MCACHE_ENTRIES; i++) {
+    if (!victim || (victim->state == MCACHE_LENT && mcache[i].tag < victim->tag)) {
+      victim = &mcache[i];
+    }
+  }
+  if (victim->state != MCACHE_FREE) {
+    mcache_evict(reg_npm_ctx, victim);
+  }
+
+  tag = mcache_next_tag++;
+  if (mcache_next_tag == 0) {
+    mcache_next_tag = 1;
+  }
+  *victim = (mcache_entry_t) {
+    .state = MCACHE_LENT,
+    .tag = tag,
+    .key = *key,
+    .digest = *digest,
+  };
+  mcache_reg_root_pa = reg_npm_ctx->root_pa;
+
+ out:
+  spin_unlock_stat(&mcache_lock, &mcache_lock_stats);
+  return tag;
+}
+
+/* PRE: mcache_lock held */
+static mcache_entry_t* mcache_find_lent(u32 tag)
+{
+  size_t i;
+
+  if (tag == 0) {
+    return NULL;
+  }
+  for (i=0; i < MCACHE_ENTRIES; i++) {
+    if (mcache[i].state == MCACHE_LENT && mcache[i].tag == tag) {
+      return &mcache[i];
+    }
+  }
+  return NULL;
+}
+
+void mcache_drop(u32 tag)
+{
+  mcache_entry_t *e;
+
+  spin_lock_stat(&mcache_lock, &mcache_lock_stats);
+  e = mcache_find_lent(tag);
+  if (e) {
+    e->state = MCACHE_FREE;
+  }
+  spin_unlock_stat(&mcache_lock, &mcache_lock_stats);
+}
+
+/* PRE: mcache_lock held */
+static void mcache_invalidate_page_locked(hptw_ctx_t *reg_npm_ctx, hpt_pa_t gpa,
+                                          const tv_pal_section_int_t *spare)
+{
+  size_t i;
+
+  for (i=0; i < MCACHE_ENTRIES; i++) {
+    if (mcache[i].state == MCACHE_FREE
+        || !mcache_key_contains(&mcache[i].key, gpa)) {
+      continue;
+    }
+    if (spare
+        && mcache[i].state == MCACHE_TRACKED
+        && mcache_key_same_section(&mcache[i].key,
+                                   spare->section_type, spare->pal_gva, spare->size)) {
+      continue;
+    }
+    mcache_evict(reg_npm_ctx, &mcache[i]);
+  }
+}
+
+void mcache_invalidate_page(hptw_ctx_t *reg_npm_ctx, hpt_pa_t gpa,
+                            const tv_pal_section_int_t *spare)
+{
+  spin_lock_stat(&mcache_lock, &mcache_lock_stats);
+  mcache_invalidate_page_locked(reg_npm_ctx, gpa, spare);
+  spin_unlock_stat(&mcache_lock, &mcache_lock_stats);
+}
+
+void mcache_invalidate_all(hptw_ctx_t *reg_npm_ctx)
+{
+  size_t i;
+
+  spin_lock_stat(&mcache_lock, &mcache_lock_stats);
+  for (i=0; i < MCACHE_ENTRIES; i++) {
+    if (mcache[i].state != MCACHE_FREE) {
+      mcache_evict(reg_npm_ctx, &mcache[i]);
+    }
+  }
+  spin_unlock_stat(&mcache_lock, &mcache_lock_stats);
+}
+
+bool mcache_reg_write(hptw_ctx_t *reg_npm_ctx, hpt_pa_t gpa)
+{
+  size_t i;
+  bool rv=false;
+
+  /* the reg npt is the only one we write-protect */
+  if (reg_npm_ctx->root_pa != mcache_reg_root_pa) {
+    return false;
+  }
+
+  spin_lock_stat(&mcache_lock, &mcache_lock_stats);
+  for (i=0; i < MCACHE_ENTRIES; i++) {
+    if (mcache[i].state == MCACHE_TRACKED
+        && mcache_key_contains(&mcache[i].key, gpa)) {
+      mcache_evict(reg_npm_ctx, &mcache[i]);
+      rv = true;
+    }
+  }
+  spin_unlock_stat(&mcache_lock, &mcache_lock_stats);
+
+  return rv;
+}
+
+static void mcache_return_page(void *arg, hpt_pa_t gpa, const void *page)
+{
+  (void)page;
+  mcache_invalidate_page_locked((hptw_ctx_t*)arg, gpa, NULL);
+}
+
+void mcache_return_section(hptw_ctx_t *reg_npm_ctx,
+                           hptw_ctx_t *pal_npm_ctx,
+                           hptw_ctx_t *pal_gpm_ctx,
+                           const tv_pal_section_int_t *section)
+{
+  mcache_entry_t *e;
+
+  /* hold the lock while changing the reg npt, so that the frames
+     never are write-protected without a TRACKED entry covering them */
+  spin_lock_stat(&mcache_lock, &mcache_lock_stats);
+
+  e = mcache_find_lent(section->mcache_tag);
+  if (e) {
+    eu_trace("tracking returned section at 0x%08llx, tag %u",
+             section->pal_gva, e->tag);
+    scode_return_section(reg_npm_ctx, pal_npm_ctx, pal_gpm_ctx,
+                         section, HPT_PROTS_RX, NULL, NULL);
+    e->state = MCACHE_TRACKED;
+  } else {
+    /* frames become writable. drop any other entry covering them */
+    scode_return_section(reg_npm_ctx, pal_npm_ctx, pal_gpm_ctx,
+                         section, HPT_PROTS_RWX,
+                         mcache_return_page, reg_npm_ctx);
+  }
+
+  spin_unlock_stat(&mcache_lock, &mcache_lock_stats);
+}
+
+/* Local Variables: */
+/* mode:c           */
+/* indent-tabs-mode:nil */
+/* c-basic-offset:2 */
+/* End:             */
@@ -271,7 +271,10 @@ int trustvisor_nv_get_mss(unsigned int locality, uint32_t idx,
   eu_trace("locality %d, idx 0x%08x, mss@%p, mss_size %d",
            locality, idx, mss, mss_size);
 
-  EU_CHKN( rv = _trustvisor_nv_get_mss(locality, idx, mss, mss_size));
+  EU_CHKN( rv = xmhf_tpm_locality_acquire(locality));
+  rv = _trustvisor_nv_get_mss(locality, idx, mss, mss_size);
+  xmhf_tpm_locality_release(locality);
+  EU_CHKN( rv);
 
   rv = 0;
  out:
@@ -378,6 +381,34 @@ static uint32_t authenticate_nv_mux_pal(VCPU *vcpu) {
   return rv;
 }
 
+/* cycles averaged over n, in microseconds */
+static u64 tpm_us(u64 total, u64 n, u32 khz) {
+  if (!n) {
+    return 0;
+  }
+  do_div(total, (u32)n);
+  total *= 1000;
+  do_div(total, khz);
+  return total;
+}
+
+/* cumulative TPM latencies, for seeing what the NV hypercalls cost */
+static void trace_tpm_stats(void) {
+  XMHF_TPM_STATS stats;
+  u32 khz = xmhf_baseplatform_arch_x86_tsc_khz();
+
+  if (!khz) {
+    return;
+  }
+  xmhf_tpm_stats_read(&stats);
+  eu_trace("TPM: %llu cmds, avg %llu us, max %llu us;"
+           " %llu of %llu acquisitions opened the locality, avg %llu us",
+           stats.cmds, tpm_us(stats.cmd_cycles, stats.cmds, khz),
+           tpm_us(stats.cmd_max, 1, khz),
+           stats.opens, stats.acquisitions,
+           tpm_us(stats.open_cycles, stats.opens, khz));
+}
+
 uint32_t hc_tpmnvram_getsize(VCPU* vcpu, uint32_t size_addr) {
   uint32_t rv = 1;
   uint32_t actual_size;
@@ -387,17 +418,17 @@ uint32_t hc_tpmnvram_getsize(VCPU* vcpu, uint32_t size_addr) {
   /* Make sure the asking PAL is authorized */
   EU_CHKN( rv = authenticate_nv_mux_pal(vcpu));
 
-  /* Open TPM */
-  /* TODO: Make sure this plays nice with guest OS */
-  EU_CHKN( rv = xmhf_tpm_open_locality(TRUSTVISOR_HWTPM_NV_LOCALITY),
+  /* Hold the TPM; it stays open for the next NV hypercall */
+  EU_CHKN( rv = xmhf_tpm_locality_acquire(TRUSTVISOR_HWTPM_NV_LOCALITY),
            eu_err_e("FATAL ERROR: Could not access HW TPM."));
 
   /* Make the actual TPM call */
-  EU_CHKN( rv = tpm_get_nvindex_size(TRUSTVISOR_HWTPM_NV_LOCALITY,
-                                     HW_TPM_ROLLBACK_PROT_INDEX, &actual_size));
+  rv = tpm_get_nvindex_size(TRUSTVISOR_HWTPM_NV_LOCALITY,
+                            HW_TPM_ROLLBACK_PROT_INDEX, &actual_size);
 
-  /* Close TPM */
-  xmhf_tpm_deactivate_all_localities();
+  xmhf_tpm_locality_release(TRUSTVISOR_HWTPM_NV_LOCALITY);
+  EU_CHKN( rv);
+  trace_tpm_stats();
 
   eu_trace("HW_TPM_ROLLBACK_PROT_INDEX 0x%08x size"
           " = %d", HW_TPM_ROLLBACK_PROT_INDEX, actual_size);
@@ -413,17 +444,16 @@ uint32_t hc_tpmnvram_readall(VCPU* vcpu, uint32_t out_addr) {
   uint32_t rv = 1;
   uint32_t data_size = HW_TPM_ROLLBACK_PROT_SIZE;
   uint8_t data[HW_TPM_ROLLBACK_PROT_SIZE];
-  bool opened_tpm = false;
+  bool held_tpm = false;
 
   eu_pulse();
 
   /* Make sure the asking PAL is authorized */
   EU_CHKN( rv = authenticate_nv_mux_pal(vcpu));
 
-  /* Open TPM */
-  /* TODO: Make sure this plays nice with guest OS */
-  EU_CHKN( rv = xmhf_tpm_open_locality(TRUSTVISOR_HWTPM_NV_LOCALITY));
-  opened_tpm = true;
+  /* Hold the TPM; it stays open for the next NV hypercall */
+  EU_CHKN( rv = xmhf_tpm_locality_acquire(TRUSTVISOR_HWTPM_NV_LOCALITY));
+  held_tpm = true;
 
   /* Make the actual TPM call */
   EU_CHKN( rv = tpm_nv_read_value(TRUSTVISOR_HWTPM_NV_LOCALITY,
@@ -441,9 +471,9 @@ uint32_t hc_tpmnvram_readall(VCPU* vcpu, uint32_t out_addr) {
   
   rv = 0;
  out:
-  /* Close TPM */
-  if (opened_tpm) {
-    xmhf_tpm_deactivate_all_localities();
+  if (held_tpm) {
+    xmhf_tpm_locality_release(TRUSTVISOR_HWTPM_NV_LOCALITY);
+    trace_tpm_stats();
   }
 
   return rv;
@@ -452,17 +482,16 @@ uint32_t hc_tpmnvram_readall(VCPU* vcpu, uint32_t out_addr) {
 uint32_t hc_tpmnvram_writeall(VCPU* vcpu, uint32_t in_addr) {
   uint32_t rv = 1;
   uint8_t data[HW_TPM_ROLLBACK_PROT_SIZE];
-  bool opened_tpm = false;
+  bool held_tpm = false;
 		
   eu_pulse();
 
   /* Make sure the asking PAL is authorized */
   EU_CHKN( rv = authenticate_nv_mux_pal(vcpu));
 
-  /* Open TPM */
-  /* TODO: Make sure this plays nice with guest OS */
-  EU_CHKN( rv = xmhf_tpm_open_locality(TRUSTVISOR_HWTPM_NV_LOCALITY));
-  opened_tpm = true;
+  /* Hold the TPM; it stays open for the next NV hypercall */
+  EU_CHKN( rv = xmhf_tpm_locality_acquire(TRUSTVISOR_HWTPM_NV_LOCALITY));
+  held_tpm = true;
 
   /* copy input data to host */
   EU_CHKN( copy_from_current_guest(vcpu, data, in_addr, HW_TPM_ROLLBACK_PROT_SIZE));
@@ -475,9 +504,9 @@ uint32_t hc_tpmnvram_writeall(VCPU* vcpu, uint32_t in_addr) {
 
   rv = 0;
  out:
-  /* Close TPM */
-  if (opened_tpm) {
-    xmhf_tpm_deactivate_all_localities();
+  if (held_tpm) {
+    xmhf_tpm_locality_release(TRUSTVISOR_HWTPM_NV_LOCALITY);
+    trace_tpm_stats();
   }
 		
   return rv;
@@ -0,0 +1,384 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <malloc.h>
+
+#include <arch/x86/_spinlock.h>
+#include <pagepool.h>
+
+#define PAGEPOOL_SLAB_SIZE (PAGEPOOL_SLAB_PAGES*PAGEPOOL_PAGE_SIZE)
+
+static inline void* page_next(void *page)
+{
+  return *(void**)page;
+}
+
+static inline void page_set_next(void *page, void *next)
+{
+  *(void**)page = next;
+}
+
+static inline bool pagepool_slab_has(const pagepool_slab_t *slab, const void *page)
+{
+  return (uintptr_t)page >= (uintptr_t)slab->base
+    && (uintptr_t)page < (uintptr_t)slab->base + PAGEPOOL_SLAB_SIZE;
+}
+
+/* finds the slab holding page. slabs are only released once all their
+ * pages are back on the free lists, so this is safe without the lock
+ * for pages held by the caller.
+ */
+static pagepool_slab_t* pagepool_slab_of(const pagepool_t *pool, const void *page, size_t *idx)
+{
+  size_t i;
+
+  for (i=0; i < pool->num_slabs; i++) {
+    pagepool_slab_t *slab = &pool->slabs[i];
+    if (slab->buf && pagepool_slab_has(slab, page)) {
+      *idx = ((uintptr_t)page - (uintptr_t)slab->base) / PAGEPOOL_PAGE_SIZE;
+      return slab;
+    }
+  }
+  return NULL;
+}
+
+/* the free list functions below are called with the lock held */
+
+static void pagepool_push(void **list, size_t *num, void *page)
+{
+  page_set_next(page, *list);
+  *list = page;
+  (*num)++;
+}
+
+static void* pagepool_pop(void **list, size_t *num)
+{
+  void *page = *list;
+
+  if (page) {
+    *list = page_next(page);
+    page_set_next(page, NULL);
+    (*num)--;
+  }
+  return page;
+}
+
+/* takes a new slab from the heap and puts its pages on the dirty
+ * list. returns false if the pool is at its cap or the heap is
+ * exhausted.
+ */
+static bool pagepool_grow(pagepool_t *pool)
+{
+  pagepool_slab_t *slab = NULL;
+  void *buf;
+  size_t i;
+
+  for (i=0; i < pool->max_slabs; i++) {
+    if (!pool->slabs[i].buf) {
+      slab = &pool->slabs[i];
+      break;
+    }
+  }
+  if (!slab) {
+    return false;
+  }
+
+  /* one extra page to align the slab */
+  buf = malloc(PAGEPOOL_SLAB_SIZE + PAGEPOOL_PAGE_SIZE);
+  if (!buf) {
+    return false;
+  }
+  memset(slab, 0, sizeof(*slab));
+  slab->base = (void*)(((uintptr_t)buf + PAGEPOOL_PAGE_SIZE-1)
+                       & ~(uintptr_t)(PAGEPOOL_PAGE_SIZE-1));
+  /* base must be in place before lockless lookups see the slot in use */
+  __asm__ __volatile__ ("" : : : "memory");
+  slab->buf = buf;
+  if (i >= pool->num_slabs) {
+    pool->num_slabs = i+1;
+  }
+
+  for (i=PAGEPOOL_SLAB_PAGES; i > 0; i--) {
+    pagepool_push(&pool->dirty, &pool->num_dirty,
+                  (uint8_t*)slab->base + (i-1)*PAGEPOOL_PAGE_SIZE);
+  }
+  return true;
+}
+
+/* moves up to half a cache's worth of free pages from the pool into
+ * cache. dirty pages are taken from a new slab if the pool has no
+ * free pages at all, or from the clean list if it has only clean
+ * ones.
+ */
+static void pagepool_refill(pagepool_t *pool, pagepool_cache_t *cache, bool clean)
+{
+  /* a peek without the lock is good enough to skip taking it for
+     nothing. zeroed allocations look here first every time while no
+     pages have been scrubbed. */
+  if (clean && !*(void * volatile *)&pool->clean) {
+    return;
+  }
+
+  ticket_spin_lock(&pool->lock);
+  if (clean) {
+    while (cache->num_clean < PAGEPOOL_CACHE_PAGES/2 && pool->clean) {
+      cache->clean[cache->num_clean++] = pagepool_pop(&pool->clean, &pool->num_clean);
+    }
+  } else {
+    if (!pool->dirty && !pool->clean) {
+      pagepool_grow(pool);
+    }
+    while (cache->num_dirty < PAGEPOOL_CACHE_PAGES/2 && pool->dirty) {
+      cache->dirty[cache->num_dirty++] = pagepool_pop(&pool->dirty, &pool->num_dirty);
+    }
+    while (!cache->num_dirty && cache->num_clean < PAGEPOOL_CACHE_PAGES/2 && pool->clean) {
+      cache->clean[cache->num_clean++] = pagepool_pop(&pool->clean, &pool->num_clean);
+    }
+  }
+  ticket_spin_unlock(&pool->lock);
+}
+
+/* moves half of a full cache's clean or dirty pages back to the pool */
+static void pagepool_flush(pagepool_t *pool, pagepool_cache_t *cache, bool clean)
+{
+  ticket_spin_lock(&pool->lock);
+  if (clean) {
+    while (cache->num_clean > PAGEPOOL_CACHE_PAGES/2) {
+      pagepool_push(&pool->clean, &pool->num_clean, cache->clean[--cache->num_clean]);
+    }
+  } else {
+    while (cache->num_dirty > PAGEPOOL_CACHE_PAGES/2) {
+      pagepool_push(&pool->dirty, &pool->num_dirty, cache->dirty[--cache->num_dirty]);
+    }
+  }
+  ticket_spin_unlock(&pool->lock);
+}
+
+void pagepool_init(pagepool_t *pool,
+                   pagepool_slab_t *slabs, size_t max_slabs,
+                   pagepool_cache_t *caches, size_t num_caches)
+{
+  memset(pool, 0, sizeof(*pool));
+  pool->lock = 1;
+  pool->slabs = slabs;
+  pool->max_slabs = max_slabs;
+  memset(slabs, 0, max_slabs*sizeof(*slabs));
+  pool->caches = caches;
+  pool->num_caches = num_caches;
+  memset(caches, 0, num_caches*sizeof(*caches));
+}
+
+void pagepool_owner_init(pagepool_owner_t *owner, size_t max)
+{
+  memset(owner, 0, sizeof(*owner));
+  owner->max = max;
+}
+
+void* pagepool_alloc(pagepool_t *pool, pagepool_owner_t *owner,
+                     size_t cpu, bool zeroed)
+{
+  pagepool_cache_t *cache = &pool->caches[cpu];
+  pagepool_slab_t *slab;
+  void *page;
+  size_t idx=0;
+
+  if (owner->used >= owner->max) {
+    owner->fails++;
+    return NULL;
+  }
+
+  if (zeroed && !cache->num_clean) {
+    pagepool_refill(pool, cache, true);
+  }
+  if (zeroed && cache->num_clean) {
+    page = cache->clean[--cache->num_clean];
+  } else {
+    if (!cache->num_dirty && !cache->num_clean) {
+      pagepool_refill(pool, cache, false);
+    }
+    if (cache->num_dirty) {
+      page = cache->dirty[--cache->num_dirty];
+      if (zeroed) {
+        memset(page, 0, PAGEPOOL_PAGE_SIZE);
+        cache->zeroed++;
+      }
+    } else if (cache->num_clean) {
+      page = cache->clean[--cache->num_clean];
+    } else {
+      owner->fails++;
+      return NULL;
+    }
+  }
+  cache->allocs++;
+
+  slab = pagepool_slab_of(pool, page, &idx);
+  slab->owner[idx] = owner;
+  slab->next[idx] = owner->pages;
+  owner->pages = page;
+  owner->used++;
+  if (owner->used > owner->peak) {
+    owner->peak = owner->used;
+  }
+  return page;
+}
+
+void pagepool_free_all(pagepool_t *pool, pagepool_owner_t *owner,
+                       size_t cpu, bool clear)
+{
+  pagepool_cache_t *cache = &pool->caches[cpu];
+  void *page = owner->pages;
+
+  while (page) {
+    pagepool_slab_t *slab;
+    size_t idx=0;
+    void *next;
+
+    slab = pagepool_slab_of(pool, page, &idx);
+    next = slab->next[idx];
+    slab->owner[idx] = NULL;
+    slab->next[idx] = NULL;
+
+    if (clear) {
+      memset(page, 0, PAGEPOOL_PAGE_SIZE);
+      if (cache->num_clean == PAGEPOOL_CACHE_PAGES) {
+        pagepool_flush(pool, cache, true);
+      }
+      cache->clean[cache->num_clean++] = page;
+    } else {
+      if (cache->num_dirty == PAGEPOOL_CACHE_PAGES) {
+        pagepool_flush(pool, cache, false);
+      }
+      cache->dirty[cache->num_dirty++] = page;
+    }
+    page = next;
+  }
+  owner->pages = NULL;
+  owner->used = 0;
+}
+
+bool pagepool_owns(const pagepool_t *pool, const pagepool_owner_t *owner,
+                   const void *page)
+{
+  pagepool_slab_t *slab;
+  size_t idx=0;
+
+  slab = pagepool_slab_of(pool, page, &idx);
+  return slab && slab->owner[idx] == owner;
+}
+
+size_t pagepool_scrub(pagepool_t *pool, size_t max)
+{
+  size_t n;
+
+  for (n=0; n < max; n++) {
+    void *page;
+
+    ticket_spin_lock(&pool->lock);
+    page = pagepool_pop(&pool->dirty, &pool->num_dirty);
+    ticket_spin_unlock(&pool->lock);
+    if (!page) {
+      break;
+    }
+
+    /* off the lists while zeroed, which also keeps its slab */
+    memset(page, 0, PAGEPOOL_PAGE_SIZE);
+
+    ticket_spin_lock(&pool->lock);
+    pagepool_push(&pool->clean, &pool->num_clean, page);
+    pool->scrubbed++;
+    ticket_spin_unlock(&pool->lock);
+  }
+  return n;
+}
+
+/* counts or removes the pages of slab on list */
+static size_t pagepool_list_slab(void **list, const pagepool_slab_t *slab, bool unlink)
+{
+  void **link = list;
+  size_t n=0;
+
+  while (*link) {
+    if (pagepool_slab_has(slab, *link)) {
+      n++;
+      if (unlink) {
+        *link = page_next(*link);
+        continue;
+      }
+    }
+    link = (void**)*link;
+  }
+  return n;
+}
+
+size_t pagepool_trim(pagepool_t *pool)
+{
+  size_t released=0;
+  size_t i;
+
+  ticket_spin_lock(&pool->lock);
+  for (i=0; i < pool->num_slabs; i++) {
+    pagepool_slab_t *slab = &pool->slabs[i];
+    void *buf = slab->buf;
+
+    if (!buf
+        || pagepool_list_slab(&pool->clean, slab, false)
+        + pagepool_list_slab(&pool->dirty, slab, false) < PAGEPOOL_SLAB_PAGES) {
+      continue;
+    }
+    pool->num_clean -= pagepool_list_slab(&pool->clean, slab, true);
+    pool->num_dirty -= pagepool_list_slab(&pool->dirty, slab, true);
+    slab->buf = NULL;
+    __asm__ __volatile__ ("" : : : "memory");
+    free(buf);
+    released += PAGEPOOL_SLAB_PAGES;
+  }
+  ticket_spin_unlock(&pool->lock);
+  return released;
+}
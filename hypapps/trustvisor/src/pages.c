@@ -51,45 +51,146 @@
 
 #include <tv_log.h>
 
+/* page tables may take up to half the heap */
+#define PAGELIST_POOL_SLABS (HEAPMEM_POOLSIZE/2/PAGE_SIZE_4K/PAGEPOOL_SLAB_PAGES)
+/* dirty pages zeroed per call to pagelist_pool_idle */
+#define PAGELIST_POOL_SCRUB_PAGES 64
+
+static pagepool_t g_pagelist_pool;
+static pagepool_slab_t g_pagelist_pool_slabs[PAGELIST_POOL_SLABS];
+static pagepool_cache_t g_pagelist_pool_caches[MAX_VCPU_ENTRIES];
+
+static size_t pagelist_cpu(void)
+{
+  return xmhf_baseplatform_arch_x86_getcurrentvcpu()->idx;
+}
+
+void pagelist_pool_init(void)
+{
+  pagepool_init(&g_pagelist_pool,
+                g_pagelist_pool_slabs, PAGELIST_POOL_SLABS,
+                g_pagelist_pool_caches, MAX_VCPU_ENTRIES);
+}
+
+void pagelist_pool_idle(void)
+{
+  size_t scrubbed, released;
+
+  scrubbed = pagepool_scrub(&g_pagelist_pool, PAGELIST_POOL_SCRUB_PAGES);
+  released = pagepool_trim(&g_pagelist_pool);
+  eu_trace("scrubbed %u pages, released %u pages, %u clean and %u dirty pages free",
+           (u32)scrubbed, (u32)released,
+           (u32)g_pagelist_pool.num_clean, (u32)g_pagelist_pool.num_dirty);
+}
+
 void pagelist_init(pagelist_t *pl)
 {
-  const int pages = 128;
-  pl->buf = malloc(pages*PAGE_SIZE_4K);
-  EU_VERIFY(pl->buf != NULL);
+  pagelist_init_sized(pl, 128);
+}
+
+void pagelist_init_sized(pagelist_t *pl, size_t pages)
+{
+  memset(pl, 0, sizeof(*pl));
+  pl->num_allocd = pages;
+  pagepool_owner_init(&pl->owner, pages);
+}
+
+void pagelist_set_max(pagelist_t *pl, size_t pages)
+{
+  HALT_ON_ERRORCOND(!pl->contiguous);
+  pl->num_allocd = pages;
+  pl->owner.max = pages;
+}
+
+int pagelist_init_contiguous(pagelist_t *pl, size_t pages)
+{
+  int rv=1;
+
+  memset(pl, 0, sizeof(*pl));
+  pl->contiguous = true;
+  EU_CHK( pl->buf = malloc(pages*PAGE_SIZE_4K));
 
   pl->page_base = (void*)PAGE_ALIGN_UP4K((uintptr_t)pl->buf);
   pl->num_allocd =
     (pl->page_base == pl->buf)
     ? pages
     : pages-1;
- 
-  pl->num_used = 0;
+
+  rv=0;
+ out:
+  return rv;
 }
 
-void* pagelist_get_page(pagelist_t *pl)
+static void* pagelist_get(pagelist_t *pl, bool zeroed)
 {
-  void *page;
+  void *page=NULL;
   eu_trace("num_used:%d num_alocd:%d", pl->num_used, pl->num_allocd);
 
-  /* we'll handle allocating more on-demand later */
-  EU_VERIFY(pl->num_used < pl->num_allocd);
-
-  page = pl->page_base + (pl->num_used*PAGE_SIZE_4K);
-  pl->num_used++;
+  if (pl->contiguous) {
+    EU_CHK( pl->num_used < pl->num_allocd,
+            eu_err_e("pagelist of %u pages is full", (u32)pl->num_allocd));
+    page = pl->page_base + (pl->num_used*PAGE_SIZE_4K);
+    pl->num_used++;
+    if (zeroed) {
+      memset(page, 0, PAGE_SIZE_4K);
+    }
+  } else {
+    EU_CHK( page = pagepool_alloc(&g_pagelist_pool, &pl->owner, pagelist_cpu(), zeroed),
+            eu_err_e("no page for pagelist holding %u of %u pages",
+                     (u32)pl->owner.used, (u32)pl->owner.max));
+    pl->num_used = pl->owner.used;
+  }
 
+ out:
   return page;
 }
 
+/* returns NULL once the list is at its cap, or the pool is exhausted */
+void* pagelist_get_page(pagelist_t *pl)
+{
+  return pagelist_get(pl, false);
+}
+
 void* pagelist_get_zeroedpage(pagelist_t *pl)
 {
-  void *page = pagelist_get_page(pl);
-  memset(page, 0, PAGE_SIZE_4K);
-  return page;
+  return pagelist_get(pl, true);
+}
+
+/* give back all pages handed out so far, making them available again */
+void pagelist_reset(pagelist_t *pl)
+{
+  if (pl->contiguous) {
+    if (pl->secret) {
+      memset(pl->page_base, 0, pl->num_used*PAGE_SIZE_4K);
+    }
+  } else {
+    pagepool_free_all(&g_pagelist_pool, &pl->owner, pagelist_cpu(), pl->secret);
+  }
+  pl->num_used = 0;
+}
+
+bool pagelist_contains(const pagelist_t *pl, const void *page)
+{
+  if (!pl->contiguous) {
+    return pagepool_owns(&g_pagelist_pool, &pl->owner, page);
+  }
+  return page >= pl->page_base
+    && page < pl->page_base + pl->num_used*PAGE_SIZE_4K;
 }
 
 void pagelist_free_all(pagelist_t *pl)
 {
-  free(pl->buf);
-  pl->buf=NULL;
+  if (pl->contiguous) {
+    if (pl->secret) {
+      memset(pl->page_base, 0, pl->num_used*PAGE_SIZE_4K);
+    }
+    free(pl->buf);
+    pl->buf=NULL;
+  } else {
+    eu_trace("pagelist peak %u of %u pages, %u refused",
+             (u32)pl->owner.peak, (u32)pl->owner.max, (u32)pl->owner.fails);
+    pagepool_free_all(&g_pagelist_pool, &pl->owner, pagelist_cpu(), pl->secret);
+  }
   pl->num_allocd=0;
+  pl->num_used=0;
 }
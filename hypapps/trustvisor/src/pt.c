@@ -195,185 +195,291 @@ int scode_clone_gdt(VCPU *vcpu,
   return err;
 }
 
+/* lending, reserving and returning a section walk the reg and pal
+   page tables with one cursor each (see hptw_leaf_t), so that each
+   page map is walked to once per section rather than once per page.
+
+   the reg guest may map a section with large pages; each page of the
+   section is then simply at an offset from the large page's
+   guest-physical address. reg's nested mappings of a section are
+   split down to 4K pages, since its access to them is revoked and
+   restored a page at a time here, by mcache, and by
+   scode_exec_claim_page. the pal's own tables are only ever given 4K
+   entries. */
+
+/* whether the walk that found leaf entry pmeo grants prot to user
+   mode */
+static bool pt_leaf_allows(const hptw_leaf_t *leaf,
+                           const hpt_pmeo_t *pmeo,
+                           hpt_prot_t prot)
+{
+  return ((leaf->prots & hpt_pmeo_getprot(pmeo) & prot) == prot)
+    && leaf->user
+    && hpt_pmeo_getuser(pmeo);
+}
+
+/* reg's nested entry for the 4K page at gpa, splitting any large
+   page that maps it */
+static void pt_get_reg_npmeo(hpt_pmeo_t *pmeo,
+                             hptw_leaf_t *leaf,
+                             hptw_ctx_t *reg_npm_ctx,
+                             hpt_pa_t gpa)
+{
+  CHK_RV(hptw_leaf_get_pmeo(pmeo, leaf, reg_npm_ctx, gpa));
+  while (pmeo->lvl > 1
+         && hpt_pmeo_is_present(pmeo)
+         && hpt_pmeo_is_page(pmeo)) {
+    eu_trace("splitting reg nested page at gpa %llx, level %d", gpa, pmeo->lvl);
+    CHK_RV(hptw_split_page(reg_npm_ctx, leaf, gpa));
+    hpt_pm_get_pmeo_by_va(pmeo, &leaf->pmo, gpa);
+  }
+  CHK(pmeo->lvl == 1);
+}
+
+/* the 4K entry mapping the first page of the page mapped by pmeo,
+   with the same attributes */
+static void pt_pmeo_to_4k(hpt_pmeo_t *pmeo)
+{
+  while (pmeo->lvl > 1) {
+    hpt_pmeo_split_page(pmeo, pmeo);
+  }
+}
+
+/* looks up the reg guest's mapping of the 4K page at reg_gva, checks
+   that it grants prot to the guest process, and returns its
+   guest-physical address. pal_gpmeo is set to the 4K entry giving the
+   pal the same mapping. */
+static hpt_pa_t pt_get_reg_gpa(hptw_leaf_t *leaf,
+                               hptw_ctx_t *reg_gpm_ctx,
+                               hpt_va_t reg_gva,
+                               hpt_prot_t prot,
+                               hpt_pmeo_t *pal_gpmeo)
+{
+  hpt_pmeo_t reg_gpmeo;
+  hpt_pa_t gpa;
+
+  reg_gva &= ~(hpt_va_t)(PAGE_SIZE_4K-1);
+
+  CHK_RV(hptw_leaf_get_pmeo(&reg_gpmeo, leaf, reg_gpm_ctx, reg_gva));
+  eu_trace("got pme %016llx, level %d, type %d",
+           reg_gpmeo.pme, reg_gpmeo.lvl, reg_gpmeo.t);
+
+  /* check that this guest process is allowed to access this guest-physical mem */
+  CHK(pt_leaf_allows(leaf, &reg_gpmeo, prot));
+  gpa = hpt_pmeo_va_to_pa(&reg_gpmeo, reg_gva);
+
+  *pal_gpmeo = reg_gpmeo; /* XXX SECURITY should build from scratch */
+  pt_pmeo_to_4k(pal_gpmeo);
+  hpt_pmeo_set_address(pal_gpmeo, gpa);
+  hpt_pmeo_setprot(pal_gpmeo, HPT_PROTS_RWX);
+
+  return gpa;
+}
+
 /* lend a section of memory from a user-space process (on the
-   commodity OS) to a pal */
+   commodity OS) to a pal.
+   if visit is non-NULL, it is called on each page once the reg VM
+   can no longer write to it, so that the caller can measure the
+   section without walking it a second time.
+*/
 void scode_lend_section( hptw_ctx_t *reg_npm_ctx,
                          hptw_ctx_t *reg_gpm_ctx,
                          hptw_ctx_t *pal_npm_ctx,
                          hptw_ctx_t *pal_gpm_ctx,
-                         const tv_pal_section_int_t *section)
+                         const tv_pal_section_int_t *section,
+                         scode_section_page_fn visit,
+                         void *visit_arg)
 {
+  hptw_leaf_t reg_gleaf, reg_nleaf, pal_gleaf, pal_nleaf;
   size_t offset;
-  int hpt_err;
 
   eu_trace("Mapping from %016llx to %016llx, size %u, pal_prot %u",
            section->reg_gva, section->pal_gva, section->size, (u32)section->pal_prot);
   
-  /* XXX don't hard-code page size here. */
   /* XXX fail gracefully */
   HALT_ON_ERRORCOND((section->size % PAGE_SIZE_4K) == 0); 
 
+  hptw_leaf_init(&reg_gleaf);
+  hptw_leaf_init(&reg_nleaf);
+  hptw_leaf_init(&pal_gleaf);
+  hptw_leaf_init(&pal_nleaf);
+
   for (offset=0; offset < section->size; offset += PAGE_SIZE_4K) {
-    hpt_va_t page_reg_gva = section->reg_gva + offset;
     hpt_va_t page_pal_gva = section->pal_gva + offset;
 
     /* XXX we don't use hpt_va_t or hpt_pa_t for gpa's because these
        get used as both */
-    u64 page_reg_gpa, page_pal_gpa; /* guest-physical-addresses */
-
-    hpt_pmeo_t page_reg_gpmeo; /* reg's guest page-map-entry and lvl */
-    hpt_pmeo_t page_pal_gpmeo; /* pal's guest page-map-entry and lvl */
+    u64 page_gpa; /* the same guest-physical-address in reg and pal */
 
     hpt_pmeo_t page_reg_npmeo; /* reg's nested page-map-entry and lvl */
+    hpt_pmeo_t page_pal_gpmeo; /* pal's guest page-map-entry and lvl */
     hpt_pmeo_t page_pal_npmeo; /* pal's nested page-map-entry and lvl */
+    hpt_pmeo_t existing_pmeo;
 
     /* lock? quiesce? */
 
-    hptw_get_pmeo(&page_reg_gpmeo,
-                      reg_gpm_ctx,
-                      1,
-                      page_reg_gva);
-    eu_trace("got pme %016llx, level %d, type %d",
-             page_reg_gpmeo.pme, page_reg_gpmeo.lvl, page_reg_gpmeo.t);
-    HALT_ON_ERRORCOND(page_reg_gpmeo.lvl==1); /* we don't handle large pages */
-    page_reg_gpa = hpt_pmeo_get_address(&page_reg_gpmeo);
-
-    hptw_get_pmeo(&page_reg_npmeo,
-                      reg_npm_ctx,
-                      1,
-                      page_reg_gpa);
-    HALT_ON_ERRORCOND(page_reg_npmeo.lvl==1); /* we don't handle large pages */
-
-    /* no reason to go with a different mapping */
-    page_pal_gpa = page_reg_gpa;
+    page_gpa = pt_get_reg_gpa(&reg_gleaf, reg_gpm_ctx,
+                              section->reg_gva + offset,
+                              section->pal_prot,
+                              &page_pal_gpmeo);
 
     /* check that this VM is allowed to access this system-physical mem */
-    {
-      hpt_prot_t effective_prots;
-      bool user_accessible=false;
-      effective_prots = hptw_get_effective_prots(reg_npm_ctx,
-                                                      page_reg_gpa,
-                                                      &user_accessible);
-      CHK((effective_prots & section->reg_prot) == section->reg_prot);
-      CHK(user_accessible);
-    }
-
-    /* check that this guest process is allowed to access this guest-physical mem */
-    {
-      hpt_prot_t effective_prots;
-      bool user_accessible=false;
-      effective_prots = hptw_get_effective_prots(reg_gpm_ctx,
-                                                      page_reg_gva,
-                                                      &user_accessible);
-      eu_trace("got reg gpt prots:0x%x, user:%d",
-               (u32)effective_prots, (int)user_accessible);
-      CHK((effective_prots & section->pal_prot) == section->pal_prot);
-      CHK(user_accessible);
-    }
+    pt_get_reg_npmeo(&page_reg_npmeo, &reg_nleaf, reg_npm_ctx, page_gpa);
+    CHK(pt_leaf_allows(&reg_nleaf, &page_reg_npmeo, section->reg_prot));
 
     /* check that the requested virtual address isn't already mapped
        into PAL's address space */
-    {
-      hpt_pmeo_t existing_pmeo;
-      hptw_get_pmeo(&existing_pmeo,
-                        pal_gpm_ctx,
-                        1,
-                        page_pal_gva);
-      CHK(!hpt_pmeo_is_present(&existing_pmeo));
-    }
+    CHK_RV(hptw_leaf_get_pmeo_alloc(&existing_pmeo, &pal_gleaf,
+                                    pal_gpm_ctx, page_pal_gva));
+    CHK(!hpt_pmeo_is_present(&existing_pmeo));
 
     /* revoke access from 'reg' VM */
     hpt_pmeo_setprot(&page_reg_npmeo, section->reg_prot);
-    hpt_err = hptw_insert_pmeo(reg_npm_ctx,
-                                   &page_reg_npmeo,
-                                   page_reg_gpa);
-    CHK_RV(hpt_err);
+    hpt_pmo_set_pme_by_va(&reg_nleaf.pmo, &page_reg_npmeo, page_gpa);
+
+    if (visit) {
+      visit(visit_arg, page_gpa,
+            spa2hva(hpt_pmeo_get_address(&page_reg_npmeo)));
+    }
 
     /* for simplicity, we don't bother removing from guest page
        tables. removing from nested page tables is sufficient */
 
     /* add access to pal guest page tables */
-    page_pal_gpmeo = page_reg_gpmeo; /* XXX SECURITY should build from scratch */
-    hpt_pmeo_set_address(&page_pal_gpmeo, page_pal_gpa);
-    hpt_pmeo_setprot    (&page_pal_gpmeo, HPT_PROTS_RWX);
-    hpt_err = hptw_insert_pmeo_alloc(pal_gpm_ctx,
-                                         &page_pal_gpmeo,
-                                         page_pal_gva);
-    CHK_RV(hpt_err);
+    hpt_pmo_set_pme_by_va(&pal_gleaf.pmo, &page_pal_gpmeo, page_pal_gva);
 
     /* add access to pal nested page tables */
+    CHK_RV(hptw_leaf_get_pmeo_alloc(&existing_pmeo, &pal_nleaf,
+                                    pal_npm_ctx, page_gpa));
     page_pal_npmeo = page_reg_npmeo;
     hpt_pmeo_setprot(&page_pal_npmeo, section->pal_prot);
-    hpt_err = hptw_insert_pmeo_alloc(pal_npm_ctx,
-                                         &page_pal_npmeo,
-                                         page_pal_gpa);
-    CHK_RV(hpt_err);
+    hpt_pmo_set_pme_by_va(&pal_nleaf.pmo, &page_pal_npmeo, page_gpa);
 
     /* unlock? unquiesce? */
   }
 }
 
+/* map a section into the pal's guest page tables, and reserve its
+   frames in the pal's nested page tables without granting any access
+   to them yet. the reg VM keeps its access until the pal first
+   touches each page (see scode_exec_claim_page).
+*/
+void scode_reserve_section( hptw_ctx_t *reg_npm_ctx,
+                            hptw_ctx_t *reg_gpm_ctx,
+                            hptw_ctx_t *pal_npm_ctx,
+                            hptw_ctx_t *pal_gpm_ctx,
+                            const tv_pal_section_int_t *section)
+{
+  hptw_leaf_t reg_gleaf, reg_nleaf, pal_gleaf, pal_nleaf;
+  size_t offset;
+
+  eu_trace("Reserving from %016llx to %016llx, size %u",
+           section->reg_gva, section->pal_gva, section->size);
+
+  HALT_ON_ERRORCOND((section->size % PAGE_SIZE_4K) == 0);
+
+  hptw_leaf_init(&reg_gleaf);
+  hptw_leaf_init(&reg_nleaf);
+  hptw_leaf_init(&pal_gleaf);
+  hptw_leaf_init(&pal_nleaf);
+
+  for (offset=0; offset < section->size; offset += PAGE_SIZE_4K) {
+    hpt_va_t page_pal_gva = section->pal_gva + offset;
+    u64 page_gpa;
+    hpt_pmeo_t page_reg_npmeo, page_pal_gpmeo, page_pal_npmeo;
+    hpt_pmeo_t existing_pmeo;
+
+    page_gpa = pt_get_reg_gpa(&reg_gleaf, reg_gpm_ctx,
+                              section->reg_gva + offset,
+                              section->pal_prot,
+                              &page_pal_gpmeo);
+
+    /* the frame must be available for the pal to claim later */
+    pt_get_reg_npmeo(&page_reg_npmeo, &reg_nleaf, reg_npm_ctx, page_gpa);
+    CHK(pt_leaf_allows(&reg_nleaf, &page_reg_npmeo, section->pal_prot));
+
+    CHK_RV(hptw_leaf_get_pmeo_alloc(&existing_pmeo, &pal_gleaf,
+                                    pal_gpm_ctx, page_pal_gva));
+    CHK(!hpt_pmeo_is_present(&existing_pmeo));
+    hpt_pmo_set_pme_by_va(&pal_gleaf.pmo, &page_pal_gpmeo, page_pal_gva);
+
+    /* not present, but remembers the frame */
+    CHK_RV(hptw_leaf_get_pmeo_alloc(&existing_pmeo, &pal_nleaf,
+                                    pal_npm_ctx, page_gpa));
+    page_pal_npmeo = page_reg_npmeo;
+    hpt_pmeo_setprot(&page_pal_npmeo, HPT_PROTS_NONE);
+    hpt_pmo_set_pme_by_va(&pal_nleaf.pmo, &page_pal_npmeo, page_gpa);
+  }
+}
+
 /* lend a section of memory from a user-space process (on the
    commodity OS) to a pal.
    PRE: assumes section was already successfully lent using scode_lend_section
    PRE: assumes no concurrent access to page tables (e.g., quiesce other cpus)
+   reg_prot is the access given back to the reg VM, normally
+   HPT_PROTS_RWX. if visit is non-NULL it is called on each page
+   after the reg VM's access is restored.
 */
 void scode_return_section(hptw_ctx_t *reg_npm_ctx,
                           hptw_ctx_t *pal_npm_ctx,
                           hptw_ctx_t *pal_gpm_ctx,
-                          const tv_pal_section_int_t *section)
+                          const tv_pal_section_int_t *section,
+                          hpt_prot_t reg_prot,
+                          scode_section_page_fn visit,
+                          void *visit_arg)
 {
+  hptw_leaf_t reg_nleaf, pal_gleaf, pal_nleaf;
   size_t offset;
 
+  hptw_leaf_init(&reg_nleaf);
+  hptw_leaf_init(&pal_gleaf);
+  hptw_leaf_init(&pal_nleaf);
+
   for (offset=0; offset < section->size; offset += PAGE_SIZE_4K) {
     hpt_va_t page_pal_gva = section->pal_gva + offset;
 
     /* XXX we don't use hpt_va_t or hpt_pa_t for gpa's because these
        get used as both */
-    u64 page_reg_gpa, page_pal_gpa; /* guest-physical-addresses */
+    u64 page_gpa; /* lend_section always uses the same gpas between reg and pal */
     hpt_pmeo_t page_pal_gpmeo; /* pal's guest page-map-entry and lvl */
+    hpt_pmeo_t page_pal_npmeo; /* pal's nested page-map-entry and lvl */
+    hpt_pmeo_t page_reg_npmeo; /* reg's nested page-map-entry and lvl */
 
-    hptw_get_pmeo(&page_pal_gpmeo,
-                      pal_gpm_ctx,
-                      1,
-                      page_pal_gva);
-    HALT_ON_ERRORCOND(page_pal_gpmeo.lvl==1); /* we don't handle large pages */
-    page_pal_gpa = hpt_pmeo_get_address(&page_pal_gpmeo);
-
-    /* lend_section always uses the same gpas between reg and pal */
-    page_reg_gpa = page_pal_gpa;
+    CHK_RV(hptw_leaf_get_pmeo(&page_pal_gpmeo, &pal_gleaf,
+                              pal_gpm_ctx, page_pal_gva));
+    CHK(hpt_pmeo_is_page(&page_pal_gpmeo));
+    page_gpa = hpt_pmeo_va_to_pa(&page_pal_gpmeo,
+                                 page_pal_gva & ~(hpt_va_t)(PAGE_SIZE_4K-1));
 
     /* check that this pal VM is allowed to access this system-physical mem.
        we only check that it's readable; trustvisor-wide we maintain the invariant
        that a page is readable in a PAL's npt iff it is not readable in the guest npt
        or other PALs' npts.
     */
-    {
-      hpt_prot_t effective_prots;
-      bool user_accessible=false;
-      effective_prots = hptw_get_effective_prots(pal_npm_ctx,
-                                                      page_pal_gpa,
-                                                      &user_accessible);
-      CHK(effective_prots & HPT_PROTS_R);
-    }
+    CHK_RV(hptw_leaf_get_pmeo(&page_pal_npmeo, &pal_nleaf,
+                              pal_npm_ctx, page_gpa));
+    CHK(pal_nleaf.prots & hpt_pmeo_getprot(&page_pal_npmeo) & HPT_PROTS_R);
+    CHK(page_pal_npmeo.lvl == 1);
 
     /* revoke access from 'pal' VM */
-    hptw_set_prot(pal_npm_ctx,
-                       page_pal_gpa,
-                       HPT_PROTS_NONE);
+    hpt_pmeo_setprot(&page_pal_npmeo, HPT_PROTS_NONE);
+    hpt_pmo_set_pme_by_va(&pal_nleaf.pmo, &page_pal_npmeo, page_gpa);
 
     /* scode_lend_section leaves reg guest page tables intact, so no
        need to restore anything in them here. */
 
     /* revoke access from pal guest page tables */
-    hptw_set_prot(pal_gpm_ctx,
-                       page_pal_gva,
-                       HPT_PROTS_NONE);
+    hpt_pmeo_setprot(&page_pal_gpmeo, HPT_PROTS_NONE);
+    hpt_pmo_set_pme_by_va(&pal_gleaf.pmo, &page_pal_gpmeo, page_pal_gva);
 
     /* add access to reg nested page tables */
-    hptw_set_prot(reg_npm_ctx,
-                       page_reg_gpa,
-                       HPT_PROTS_RWX);
+    pt_get_reg_npmeo(&page_reg_npmeo, &reg_nleaf, reg_npm_ctx, page_gpa);
+    hpt_pmeo_setprot(&page_reg_npmeo, reg_prot);
+    hpt_pmo_set_pme_by_va(&reg_nleaf.pmo, &page_reg_npmeo, page_gpa);
+
+    if (visit) {
+      visit(visit_arg, page_gpa, gpa2hva(page_gpa));
+    }
   }
 }
 
@@ -61,6 +61,10 @@
 prng_state g_ltc_prng;
 int g_ltc_prng_id;
 
+/* protects g_drbg. PALs may ask for random bytes on several cpus at once */
+static volatile u32 g_drbg_lock=1;
+SPINLOCK_STATS g_drbg_lock_stats = SPINLOCK_STATS_INITIALIZER("tv_drbg");
+
 /**
  * Reseed the CTR_DRBG if needed.  This function is structured to do
  * nothing if a reseed is not required, to simplify the logic in the
@@ -99,8 +103,10 @@ uint8_t rand_byte_or_die(void) {
 
     EU_VERIFY( g_master_prng_init_completed);
 
+    spin_lock_stat(&g_drbg_lock, &g_drbg_lock_stats);
     EU_VERIFYN( reseed_ctr_drbg_using_tpm_entropy_if_needed());
     EU_VERIFYN( nist_ctr_drbg_generate( &g_drbg, &byte, sizeof(byte), NULL, 0));
+    spin_unlock_stat(&g_drbg_lock, &g_drbg_lock_stats);
 
     return byte;
 }
@@ -114,9 +120,11 @@ void rand_bytes_or_die(uint8_t *out, unsigned int len) {
     EU_VERIFY( out);
     EU_VERIFY( len >= 1);
     
+    spin_lock_stat(&g_drbg_lock, &g_drbg_lock_stats);
     EU_VERIFYN( reseed_ctr_drbg_using_tpm_entropy_if_needed());
 
     EU_VERIFYN( nist_ctr_drbg_generate(&g_drbg, out, len, NULL, 0));
+    spin_unlock_stat(&g_drbg_lock, &g_drbg_lock_stats);
 }    
 
 /**
@@ -137,6 +145,7 @@ int rand_bytes(uint8_t *out, unsigned int *len) {
     /* at the present time this will either give all requested bytes
      * or fail completely.  no support for partial returns, though
      * that may one day be desirable. */
+    spin_lock_stat(&g_drbg_lock, &g_drbg_lock_stats);
     EU_VERIFYN( reseed_ctr_drbg_using_tpm_entropy_if_needed());
 
     EU_CHKN( rv = nist_ctr_drbg_generate(&g_drbg, out, *len, NULL, 0));
@@ -145,5 +154,6 @@ int rand_bytes(uint8_t *out, unsigned int *len) {
 
     rv=0;
  out:
+    spin_unlock_stat(&g_drbg_lock, &g_drbg_lock_stats);
     return rv;
 }
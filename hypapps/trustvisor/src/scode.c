@@ -61,12 +61,17 @@
 
 #include <tv_log.h>
 #include <hptw_emhf.h>
+#include <mcache.h>
 
 /* #define EU_DOWNCAST(vctx, t) assert(((t)vctx)->magic == t ## _MAGIC), (t)vctx */
 
 hpt_pmo_t g_reg_npmo_root;
 hptw_emhf_host_ctx_t g_hptw_reg_host_ctx;
 
+/* page maps for splitting large pages in the reg nested page tables
+   when lending sections (see scode_lend_section). they stay split. */
+static pagelist_t g_reg_npm_pl;
+
 /* this is the return address we push onto the stack when entering the
    pal. We return to the reg world on a nested page fault on
    instruction fetch of this address */
@@ -74,18 +79,20 @@ hptw_emhf_host_ctx_t g_hptw_reg_host_ctx;
 
 /* whitelist of all approved sensitive code regions */
 /* whitelist_max and *whitelist is set up by BSP, no need to apply lock
- * whitelist_size will only be updated in scode_register() and scode_unreg(), no need to apply lock
+ * whitelist_size and the claiming and freeing of entries are protected
+ * by whitelist_lock
  *
  * scode_whitelist entry is created in scode_register(), and cleaned up in scode_unregister()
- * no need to apply lock on it during those time
+ * once marked dying, after which no cpu may start using it
  *
- * scode_whitelist entry can also be edited during PAL running(during context switch),
- * However, one PAL can only be run on the CPU where the registration is done,
- * which means there is no possibility that multiple CPU will run a same PAL simultaneously,
- * thus no need to apply lock to whitelist entry.
+ * a PAL may run on several CPUs at once. the whitelist entry itself is
+ * not modified while the PAL is registered; per-invocation state lives
+ * in the entry's execution contexts (see scode_exec_ctx_t), whose
+ * states and the PAL's guest page tables are protected by exec_lock.
  * */
 whitelist_entry_t *whitelist=NULL;
 size_t whitelist_size=0, whitelist_max=0;
+static volatile u32 whitelist_lock=1;
 
 perf_ctr_t g_tv_perf_ctrs[TV_PERF_CTRS_COUNT];
 char *g_tv_perf_ctr_strings[] = {
@@ -176,8 +183,6 @@ static inline u32 test_page_scode_bitmap_2M(u32 pfn)
   return scode_pfn_bitmap_2M[index];
 }
 
-void scode_release_all_shared_pages(VCPU *vcpu, whitelist_entry_t* entry);
-
 /* search scode in whitelist */
 int scode_in_list(u64 gcr3, u32 gvaddr)
 {
@@ -214,19 +219,14 @@ static whitelist_entry_t* find_scode_by_entry(u64 gcr3, u32 gv_entry)
   return NULL;
 }
 
-int scode_measure_section(utpm_master_state_t *utpm,
-                          whitelist_entry_t *wle,
-                          const tv_pal_section_int_t *section)
+static int scode_measure_section_header(hash_state *ctx,
+                                        const tv_pal_section_int_t *section)
 {
-  hash_state ctx;
-  TPM_DIGEST sha1sum;
   int rv=1;
 
-  EU_CHKN( sha1_init( &ctx));
-
   /* always measure the section type, which determines permissions and
      how the section is used. */
-  EU_CHKN( sha1_process( &ctx, (const uint8_t*)&section->section_type, sizeof(section->section_type)));
+  EU_CHKN( sha1_process( ctx, (const uint8_t*)&section->section_type, sizeof(section->section_type)));
 
   /* measure the address where the section is mapped. this prevents,
      for example, that a section is mapped with a different alignment
@@ -240,69 +240,213 @@ int scode_measure_section(utpm_master_state_t *utpm,
   */
   if (section->section_type != TV_PAL_SECTION_STACK
       && section->section_type != TV_PAL_SECTION_PARAM) {
-    EU_CHKN( sha1_process( &ctx, (const uint8_t*)&section->pal_gva, sizeof(section->pal_gva)));
+    EU_CHKN( sha1_process( ctx, (const uint8_t*)&section->pal_gva, sizeof(section->pal_gva)));
   }
 
   /* measure section size. not clear that this is strictly necessary,
      since giving a pal more memory shouldn't hurt anything, and less
      memory should result in no worse than the pal crashing, but seems
      like good hygiene. */
-  EU_CHKN( sha1_process( &ctx, (const uint8_t*)&section->size, sizeof(section->size)));
+  EU_CHKN( sha1_process( ctx, (const uint8_t*)&section->size, sizeof(section->size)));
 
-  /* measure contents. we could consider making this optional for,
-     e.g., PARAM and STACK sections, but seems like good hygiene to
-     always do it. client ought to ensure that those sections are
-     consistent (e.g., 0'd). an alternative to consider is to enforce
-     that the hypervisor either measures or zeroes each section.*/
-  {
-    size_t measured=0;
-
-    while(measured < section->size) {
-      size_t to_measure;
-      uint8_t *ptr=NULL;
-      
-      /* we just constructed these page tables, so in principle the
-       * additional checks here should be unnecessary. leaving them in
-       * to avoid potential future TOCTTOU vulnerabilities.
-       */
-      EU_VERIFY( ptr = hptw_checked_access_va( &wle->hptw_pal_checked_guest_ctx.super,
-                                               HPT_PROTS_R,
-                                               HPTW_CPL3,
-                                               section->pal_gva + measured,
-                                               section->size - measured,
-                                               &to_measure));
-
-      EU_CHKN( sha1_process( &ctx, ptr, to_measure));
-      measured += to_measure;
+  rv=0;
+ out:
+  return rv;
+}
+
+/* state for measuring a section while it is being lent */
+typedef struct {
+  hash_state ctx;
+  bool hashing;
+  int err;
+  mcache_key_t lent_key; /* frames the section was actually lent from */
+} scode_section_meas_t;
+
+/* measure contents. we could consider making this optional for,
+   e.g., PARAM and STACK sections, but seems like good hygiene to
+   always do it. client ought to ensure that those sections are
+   consistent (e.g., 0'd). an alternative to consider is to enforce
+   that the hypervisor either measures or zeroes each section.*/
+static void scode_measure_section_page(void *arg, hpt_pa_t page_reg_gpa, const void *page)
+{
+  scode_section_meas_t *meas = arg;
+
+  mcache_key_add_page(&meas->lent_key, page_reg_gpa);
+  if (meas->hashing && !meas->err) {
+    meas->err = sha1_process(&meas->ctx, page, PAGE_SIZE_4K);
+  }
+}
+
+/* find the frames backing a section in the reg guest, and drop any
+   cached measurements that lending them would invalidate. this has
+   to happen before the section is lent, since dropping a
+   measurement makes its frames writable by the reg guest again. */
+static void scode_section_frames(hptw_ctx_t *reg_npm_ctx,
+                                 hptw_ctx_t *reg_gpm_ctx,
+                                 const tv_pal_section_int_t *section,
+                                 mcache_key_t *key)
+{
+  bool cacheable = mcache_section_is_cacheable(section);
+  hptw_leaf_t gleaf, nleaf;
+  size_t offset;
+
+  mcache_key_init(key, section);
+  hptw_leaf_init(&gleaf);
+  hptw_leaf_init(&nleaf);
+
+  for (offset=0; offset < section->size; offset += PAGE_SIZE_4K) {
+    hpt_va_t gva = (section->reg_gva + offset) & ~(hpt_va_t)(PAGE_SIZE_4K-1);
+    hpt_pmeo_t pmeo;
+    hpt_pa_t gpa;
+
+    if (hptw_leaf_get_pmeo(&pmeo, &gleaf, reg_gpm_ctx, gva)
+        || !hpt_pmeo_is_present(&pmeo)) {
+      /* scode_lend_section will reject it */
+      key->incomplete = true;
+      continue;
     }
+    gpa = hpt_pmeo_va_to_pa(&pmeo, gva);
+
+    /* frames not readable by the reg guest are lent to another pal,
+       which may be able to write them. */
+    if (hptw_leaf_get_pmeo(&pmeo, &nleaf, reg_npm_ctx, gpa)
+        || !(nleaf.prots & hpt_pmeo_getprot(&pmeo) & HPT_PROTS_R)) {
+      key->incomplete = true;
+    }
+
+    mcache_key_add_page(key, gpa);
+    mcache_invalidate_page(reg_npm_ctx, gpa, cacheable ? section : NULL);
   }
+}
 
-  EU_CHKN( sha1_done( &ctx, sha1sum.value));
+/* lend a section to the pal being registered, and extend pcr 0 of
+ * its uTPM with the hash of the section's metadata and contents.
+ * the contents are hashed as each page is lent, rather than in a
+ * second pass over the section. code sections that were measured
+ * before, from the same frames, and not written to since, are not
+ * hashed at all (see mcache.h).
+ */
+static int scode_lend_and_measure_section(whitelist_entry_t *wle,
+                                          tv_pal_section_int_t *section,
+                                          hptw_ctx_t *reg_gpm_ctx)
+{
+  hptw_ctx_t *reg_npm_ctx = &g_hptw_reg_host_ctx.super;
+  mcache_key_t key;
+  scode_section_meas_t meas;
+  TPM_DIGEST sha1sum;
+  int rv=1;
+
+  scode_section_frames(reg_npm_ctx, reg_gpm_ctx, section, &key);
+
+  section->mcache_tag = 0;
+  if (mcache_section_is_cacheable(section)) {
+    section->mcache_tag = mcache_claim(reg_npm_ctx, &key, &sha1sum);
+  }
+
+  mcache_key_init(&meas.lent_key, section);
+  meas.hashing = !section->mcache_tag;
+  meas.err = 0;
+  if (meas.hashing) {
+    EU_CHKN( sha1_init( &meas.ctx));
+    EU_CHKN( scode_measure_section_header( &meas.ctx, section));
+  } else {
+    eu_trace("using cached measurement for section at 0x%08llx", section->pal_gva);
+  }
+
+  scode_lend_section( reg_npm_ctx,
+                      reg_gpm_ctx,
+                      &wle->hptw_pal_host_ctx.super,
+                      &wle->hptw_pal_checked_guest_ctx.super,
+                      section,
+                      scode_measure_section_page, &meas);
+
+  /* the cached measurement, if any, is only good for the frames we
+     looked up. */
+  EU_CHK( key.incomplete || mcache_key_equal( &key, &meas.lent_key),
+          eu_err_e("reg guest page tables changed while lending section"));
+
+  if (meas.hashing) {
+    EU_CHKN( meas.err);
+    EU_CHKN( sha1_done( &meas.ctx, sha1sum.value));
+    if (mcache_section_is_cacheable(section)) {
+      section->mcache_tag = mcache_insert(reg_npm_ctx, &key, &sha1sum);
+    }
+  }
 
   /* extend pcr 0 */
-  utpm_extend(&sha1sum, utpm, 0);
+  utpm_extend(&sha1sum, &wle->utpm, 0);
 
   rv=0;
  out:
   return rv;
 }
 
-int scode_measure_sections(utpm_master_state_t *utpm,
-                           whitelist_entry_t *wle)
+/* reserve a STACK section for the pal being registered, to be mapped
+ * on first touch (see scode_exec_claim_page), and extend pcr 0 of its
+ * uTPM with the hash of the section's metadata. the contents aren't
+ * measured, since the pal will only ever see zeroed pages.
+ */
+static int scode_reserve_and_measure_section(whitelist_entry_t *wle,
+                                             tv_pal_section_int_t *section,
+                                             hptw_ctx_t *reg_gpm_ctx)
 {
-  size_t i;
-  int err=0;
+  hash_state ctx;
+  TPM_DIGEST sha1sum;
+  int rv=1;
 
-  for(i=0; i < wle->sections_num; i++) {
-    err = scode_measure_section(utpm, wle, &wle->sections[i]);
-    if (err) {
-      return err;
-    }
-  }
+  section->mcache_tag = 0;
 
-  return 0;
+  EU_CHKN( sha1_init( &ctx));
+  EU_CHKN( scode_measure_section_header( &ctx, section));
+  EU_CHKN( sha1_done( &ctx, sha1sum.value));
+
+  scode_reserve_section( &g_hptw_reg_host_ctx.super,
+                         reg_gpm_ctx,
+                         &wle->hptw_pal_host_ctx.super,
+                         &wle->hptw_pal_checked_guest_ctx.super,
+                         section);
+
+  /* extend pcr 0 */
+  utpm_extend(&sha1sum, &wle->utpm, 0);
+
+  rv=0;
+ out:
+  return rv;
 }
 
+/* give the pages of a STACK section back to the reg guest. pages the
+ * pal never touched were never taken from it.
+ */
+static void scode_return_reserved_section(whitelist_entry_t *wle,
+                                          const tv_pal_section_int_t *section)
+{
+  hptw_ctx_t *pal_npm_ctx = &wle->hptw_pal_host_ctx.super;
+  hptw_ctx_t *pal_gpm_ctx = &wle->hptw_pal_checked_guest_ctx.super;
+  size_t offset;
+
+  for (offset=0; offset < section->size; offset += PAGE_SIZE_4K) {
+    tv_pal_section_int_t page = *section;
+    hpt_pmeo_t pmeo;
+    hpt_pa_t gpa;
+
+    page.reg_gva += offset;
+    page.pal_gva += offset;
+    page.size = PAGE_SIZE_4K;
+
+    hptw_get_pmeo(&pmeo, pal_gpm_ctx, 1, page.pal_gva);
+    HALT_ON_ERRORCOND(pmeo.lvl == 1);
+    gpa = hpt_pmeo_get_address(&pmeo);
+
+    hptw_get_pmeo(&pmeo, pal_npm_ctx, 1, gpa);
+    if (hpt_pmeo_is_present(&pmeo)) {
+      memset(spa2hva(hpt_pmeo_get_address(&pmeo)), 0, PAGE_SIZE_4K);
+      mcache_return_section( &g_hptw_reg_host_ctx.super,
+                             pal_npm_ctx, pal_gpm_ctx, &page);
+    } else {
+      hptw_set_prot(pal_gpm_ctx, page.pal_gva, HPT_PROTS_NONE);
+    }
+  }
+}
 
 /* initialize all the scode related variables and buffers */
 void init_scode(VCPU * vcpu)
@@ -322,6 +466,7 @@ void init_scode(VCPU * vcpu)
 
   /* initialize heap memory */
   mem_init();
+  pagelist_pool_init();
 
   whitelist = malloc(WHITELIST_LIMIT);
   eu_trace("alloc %dKB mem for scode_list at %x!", (WHITELIST_LIMIT/1024), (unsigned int)whitelist);
@@ -348,6 +493,8 @@ void init_scode(VCPU * vcpu)
   scode_curr = malloc((max+1) * sizeof(*scode_curr));
   memset(scode_curr, 0xFF, ((max+1) * sizeof(*scode_curr)));
 
+  mcache_init();
+
   /* init PRNG and long-term crypto keys */
   EU_VERIFYN(trustvisor_master_crypto_init());
   eu_trace("trustvisor_master_crypto_init successful.");
@@ -493,6 +640,8 @@ u32 scode_register(VCPU *vcpu, u32 scode_info, u32 scode_pm, u32 gventry)
     if (!did_change_root_mappings) {
       hpt_emhf_get_root_pmo(vcpu, &g_reg_npmo_root);
       hptw_emhf_host_ctx_init_of_vcpu( &g_hptw_reg_host_ctx, vcpu);
+      pagelist_init( &g_reg_npm_pl);
+      g_hptw_reg_host_ctx.pl = &g_reg_npm_pl;
 #ifdef __MP_VERSION__
       {
         size_t i;
@@ -525,7 +674,6 @@ u32 scode_register(VCPU *vcpu, u32 scode_info, u32 scode_pm, u32 gventry)
    */
   whitelist_new.id = 0;
   whitelist_new.gcr3 = gcr3;
-  whitelist_new.grsp = (u32)-1;
 
   /* store scode entry point */
   whitelist_new.entry_v = gventry;
@@ -543,8 +691,10 @@ u32 scode_register(VCPU *vcpu, u32 scode_info, u32 scode_pm, u32 gventry)
   EU_CHK( whitelist_new.npl = malloc(sizeof(pagelist_t)));
   pagelist_init(whitelist_new.npl);
 
+  /* contiguous, so that it can be mapped into the pal's npt at once
+     below */
   EU_CHK( whitelist_new.gpl = malloc(sizeof(pagelist_t)));
-  pagelist_init(whitelist_new.gpl);
+  EU_CHKN( pagelist_init_contiguous(whitelist_new.gpl, 128));
 
   whitelist_new.reg_gpt_root_pa = hpt_emhf_get_guest_root_pm_pa( vcpu);
   whitelist_new.reg_gpt_type = hpt_emhf_get_guest_hpt_type( vcpu);
@@ -558,6 +708,7 @@ u32 scode_register(VCPU *vcpu, u32 scode_info, u32 scode_pm, u32 gventry)
     .lvl = hpt_root_lvl( whitelist_new.reg_gpt_type),
     .pm = pagelist_get_zeroedpage( whitelist_new.gpl),
   };
+  EU_CHK( pal_npmo_root.pm && pal_gpmo_root.pm);
 
   EU_CHKN( hptw_emhf_host_ctx_init( &whitelist_new.hptw_pal_host_ctx,
                                     hva2spa( pal_npmo_root.pm),
@@ -574,26 +725,31 @@ u32 scode_register(VCPU *vcpu, u32 scode_info, u32 scode_pm, u32 gventry)
   /* add all gpl pages to pal's nested page tables, ensuring that
      the guest page tables allocated from it will be accessible to the
      pal */
-  /* XXX breaks pagelist abstraction. will break if pagelist ever dynamically
-     allocates more buffers. consider doing this on-demand inside pal's gzp fn instead. */
+  /* XXX breaks pagelist abstraction. consider doing this on-demand
+     inside pal's gzp fn instead, so that gpl can come from the page
+     pool too. */
   eu_trace("adding gpl to pal's npt:");
-  for (i=0; i < whitelist_new.gpl->num_allocd; i++) {
-    hpt_pmeo_t pmeo = {
-      .pme = 0,
-      .t = pal_npmo_root.t,
-      .lvl = 1,
-    };
-    void *page = whitelist_new.gpl->page_base + i*PAGE_SIZE_4K;
-    hpt_pmeo_setprot(&pmeo, HPT_PROTS_RWX);
-    hpt_pmeo_setuser(&pmeo, true);
-    hpt_pmeo_set_address(&pmeo, hva2spa(page));
-    EU_CHKN( hptw_insert_pmeo_alloc( &whitelist_new.hptw_pal_host_ctx.super,
-                                     &pmeo,
-                                     hva2gpa(page)));
+  {
+    size_t gpl_size = whitelist_new.gpl->num_allocd * PAGE_SIZE_4K;
+    size_t pms;
+
+    EU_CHKN( hptw_map_range_pms( &whitelist_new.hptw_pal_host_ctx.super,
+                                 hva2gpa(whitelist_new.gpl->page_base),
+                                 hva2spa(whitelist_new.gpl->page_base),
+                                 gpl_size, HPT_LVL_PD2, &pms));
+    EU_CHK( pms <= whitelist_new.npl->num_allocd - whitelist_new.npl->num_used);
+    EU_CHKN( hptw_map_range( &whitelist_new.hptw_pal_host_ctx.super,
+                             hva2gpa(whitelist_new.gpl->page_base),
+                             hva2spa(whitelist_new.gpl->page_base),
+                             gpl_size, HPT_PROTS_RWX, true, HPT_LVL_PD2));
   }
 
+  /* initialize Micro-TPM instance */
+  utpm_init_instance(&whitelist_new.utpm);
+
   eu_trace("adding sections to pal's npts and gpts:");
-  /* map each requested section into the pal */
+  /* map each requested section into the pal, extending uTPM PCR[0]
+     with the hash of each section's metadata and contents */
   whitelist_new.sections_num = whitelist_new.scode_info.num_sections;
   for (i=0; i<whitelist_new.scode_info.num_sections; i++) {
     whitelist_new.sections[i] = (tv_pal_section_int_t) {
@@ -604,11 +760,15 @@ u32 scode_register(VCPU *vcpu, u32 scode_info, u32 scode_pm, u32 gventry)
       .reg_prot = reg_prot_of_type(whitelist_new.scode_info.sections[i].type),
       .section_type = whitelist_new.scode_info.sections[i].type,
     };
-    scode_lend_section( &g_hptw_reg_host_ctx.super,
-                        &reg_guest_walk_ctx.super,
-                        &whitelist_new.hptw_pal_host_ctx.super,
-                        &whitelist_new.hptw_pal_checked_guest_ctx.super,
-                        &whitelist_new.sections[i]);
+    if (whitelist_new.sections[i].section_type == TV_PAL_SECTION_STACK) {
+      EU_CHKN( scode_reserve_and_measure_section( &whitelist_new,
+                                                  &whitelist_new.sections[i],
+                                                  &reg_guest_walk_ctx.super));
+    } else {
+      EU_CHKN( scode_lend_and_measure_section( &whitelist_new,
+                                               &whitelist_new.sections[i],
+                                               &reg_guest_walk_ctx.super));
+    }
   }
 
   /* clone gdt */
@@ -650,24 +810,23 @@ u32 scode_register(VCPU *vcpu, u32 scode_info, u32 scode_pm, u32 gventry)
   /* flush TLB for page table modifications to take effect */
   xmhf_memprot_flushmappings(vcpu);
 
-  /* initialize Micro-TPM instance */
-  utpm_init_instance(&whitelist_new.utpm);
+  /* one execution context per cpu, built on first use */
+  EU_CHKN( scode_exec_init(&whitelist_new, g_midtable_numentries));
 
-  /* extent uTPM PCR[0] with with hash of each section metadata and contents */
-  EU_CHKN( scode_measure_sections(&whitelist_new.utpm, &whitelist_new));
-
-#ifdef __MP_VERSION__
-  /* initialize PAL running lock */
-  whitelist_new.pal_running_lock=1;
-  whitelist_new.pal_running_vcpu_id=-1;
-#endif
+  eu_perf("registered pal: %u npt pages, %u gpt pages, %u execution contexts",
+          (u32)whitelist_new.npl->num_used,
+          (u32)whitelist_new.gpl->num_used,
+          (u32)whitelist_new.exec_max);
 
   /* add new entry into whitelist */
-  /* CRITICAL SECTION in MP scenario: need to quiesce other CPUs or at least acquire spinlock */
-  for (i = 0; whitelist[i].gcr3!=0 && i < whitelist_max; i ++);
+  spin_lock(&whitelist_lock);
+  for (i = 0; i < whitelist_max && whitelist[i].gcr3!=0; i ++);
+  if (i < whitelist_max) {
+    whitelist_size ++;
+    memcpy(whitelist + i, &whitelist_new, sizeof(whitelist_entry_t));
+  }
+  spin_unlock(&whitelist_lock);
   EU_CHK( i < whitelist_max);
-  whitelist_size ++;
-  memcpy(whitelist + i, &whitelist_new, sizeof(whitelist_entry_t));
 
   /* 
    * reset performance counters
@@ -690,6 +849,7 @@ u32 scode_unregister(VCPU * vcpu, u32 gvaddr)
 {
   size_t i, j;
   u32 rv=1;
+  bool was_dying=false, busy=false;
 
   u64 gcr3;
 
@@ -701,13 +861,45 @@ u32 scode_unregister(VCPU * vcpu, u32 gvaddr)
 
   eu_trace("CPU(%02x): remove from whitelist gcr3 %#llx, gvaddr %#x", vcpu->id, gcr3, gvaddr);
 
+  /* fail if the PAL is running, or memory is being shared with it,
+     somewhere, or another cpu is already unregistering it. otherwise
+     mark it dying, so that no other cpu starts using it while it is
+     torn down below. the lookup holds whitelist_lock, so that the slot
+     isn't claimed again meanwhile. */
+  spin_lock(&whitelist_lock);
   for (i = 0; i < whitelist_max; i ++) {
     /* find scode with correct cr3 and entry point */
     if ((whitelist[i].gcr3 == gcr3) && (whitelist[i].entry_v == gvaddr))
       break;
   }
-
+  if (i < whitelist_max) {
+    spin_lock(&whitelist[i].exec_lock);
+    was_dying = whitelist[i].dying;
+    for(j = 0; j < whitelist[i].exec_max; j++) {
+      if (whitelist[i].exec[j].state == SCODE_EXEC_RUNNING
+          || whitelist[i].exec[j].state == SCODE_EXEC_SHARING) {
+        break;
+      }
+    }
+    busy = (j < whitelist[i].exec_max);
+    if (!was_dying && !busy) {
+      whitelist[i].dying = true;
+    }
+    spin_unlock(&whitelist[i].exec_lock);
+  }
+  spin_unlock(&whitelist_lock);
   EU_CHK( i < whitelist_max);
+  EU_CHK( !was_dying,
+          eu_err_e("PAL is already being unregistered"));
+  EU_CHK( !busy,
+          eu_err_e("can't unregister a running PAL"));
+
+  /* return memory shared for invocations that never happened */
+  for(j = 0; j < whitelist[i].exec_max; j++) {
+    if (whitelist[i].exec[j].state == SCODE_EXEC_SHARED) {
+      scode_exec_release(&whitelist[i], &whitelist[i].exec[j]);
+    }
+  }
 
   /* dump perf counters */
   eu_perf("performance counters:");
@@ -725,6 +917,11 @@ u32 scode_unregister(VCPU * vcpu, u32 gvaddr)
 
   /* restore permissions for remapped sections */
   for(j = 0; j < whitelist[i].sections_num; j++) {
+    if (whitelist[i].sections[j].section_type == TV_PAL_SECTION_STACK) {
+      scode_return_reserved_section(&whitelist[i], &whitelist[i].sections[j]);
+      continue;
+    }
+
     /* zero the contents of any sections that are writable by the PAL, and not readable by the reg guest */
     if ((whitelist[i].sections[j].pal_prot & HPT_PROTS_W)
         && !(whitelist[i].sections[j].reg_prot & HPT_PROTS_R)) {
@@ -739,25 +936,32 @@ u32 scode_unregister(VCPU * vcpu, u32 gvaddr)
       HALT_ON_ERRORCOND(!err);
     }
 
-    scode_return_section( &g_hptw_reg_host_ctx.super,
-                          &whitelist[i].hptw_pal_host_ctx.super,
-                          &whitelist[i].hptw_pal_checked_guest_ctx.super,
-                          &whitelist[i].sections[j]);
+    mcache_return_section( &g_hptw_reg_host_ctx.super,
+                           &whitelist[i].hptw_pal_host_ctx.super,
+                           &whitelist[i].hptw_pal_checked_guest_ctx.super,
+                           &whitelist[i].sections[j]);
   }
   /* flush TLB for page table modifications to take effect */
   xmhf_memprot_flushmappings(vcpu);
 
-  /* delete entry from scode whitelist */
-  /* CRITICAL SECTION in MP scenario: need to quiesce other CPUs or at least acquire spinlock */
-  whitelist_size --;
-  whitelist[i].gcr3 = 0;
-
   pagelist_free_all(whitelist[i].npl);
   free(whitelist[i].npl);
 
   pagelist_free_all(whitelist[i].gpl);
   free(whitelist[i].gpl);
 
+  scode_exec_free(&whitelist[i]);
+
+  /* delete entry from scode whitelist. only now may the slot be
+     claimed by a new registration */
+  spin_lock(&whitelist_lock);
+  whitelist_size --;
+  whitelist[i].gcr3 = 0;
+  spin_unlock(&whitelist_lock);
+
+  /* tidy up the page pool while we're off the register path */
+  pagelist_pool_idle();
+
   rv=0;
  out:
   return rv;
@@ -775,7 +979,28 @@ int test_page_in_list(pte_t * page_list, pte_t page, u32 count)
   return 0;
 }
 
-u32 scode_marshall(VCPU * vcpu)
+/* finds the range shared with ctx that holds all of the words at
+ * reg_gva, and sets *pal_gva to where the pal sees them.
+ */
+static int scode_shared_param_addr(scode_exec_ctx_t *ctx,
+                                   u32 reg_gva, u32 words, u32 *pal_gva)
+{
+  hpt_va_t len = (hpt_va_t)words * 4;
+  size_t i;
+
+  for (i=0; i < ctx->shared_num; i++) {
+    const tv_pal_section_int_t *section = &ctx->shared[i];
+    if (reg_gva >= section->reg_gva
+        && reg_gva - section->reg_gva < section->size
+        && len <= section->size - (reg_gva - section->reg_gva)) {
+      *pal_gva = (u32)(section->pal_gva + (reg_gva - section->reg_gva));
+      return 0;
+    }
+  }
+  return 1;
+}
+
+u32 scode_marshall(VCPU * vcpu, scode_exec_ctx_t *ctx)
 {
   u32 pm_addr, pm_addr_base, pm_value, pm_tmp;  /*parameter stack base address*/
   u32 pm_type, pm_size, pm_size_sum; /*save pm information*/
@@ -798,11 +1023,11 @@ u32 scode_marshall(VCPU * vcpu)
   eu_trace("parameter page base address is %#x", pm_addr_base);
 
   /* address for parameters in guest stack */
-  grsp = (u32)whitelist[curr].grsp + 4; /*the stack pointer of parameters in guest stack*/
+  grsp = (u32)ctx->grsp + 4; /*the stack pointer of parameters in guest stack*/
 
   /* save params number */
   pm_addr = pm_addr_base;
-  EU_CHKN( hptw_checked_copy_to_va( &whitelist[curr].hptw_pal_checked_guest_ctx.super,
+  EU_CHKN( hptw_checked_copy_to_va( &ctx->hptw_pal_checked_guest_ctx.super,
                                     HPTW_CPL3,
                                     pm_addr,
                                     &whitelist[curr].gpm_num,
@@ -828,15 +1053,15 @@ u32 scode_marshall(VCPU * vcpu)
       EU_CHK( pm_size_sum <= (whitelist[curr].gpm_size*PAGE_SIZE_4K));
 
       /* save input params in input params memory for sensitive code */
-      EU_CHKN( hptw_checked_copy_to_va(&whitelist[curr].hptw_pal_checked_guest_ctx.super,
+      EU_CHKN( hptw_checked_copy_to_va(&ctx->hptw_pal_checked_guest_ctx.super,
                                        HPTW_CPL3,
                                        pm_addr,
                                        &pm_type, sizeof(pm_type)));
-      EU_CHKN( hptw_checked_copy_to_va(&whitelist[curr].hptw_pal_checked_guest_ctx.super,
+      EU_CHKN( hptw_checked_copy_to_va(&ctx->hptw_pal_checked_guest_ctx.super,
                                        HPTW_CPL3,
                                        pm_addr+sizeof(pm_type),
                                        &pm_size, sizeof(pm_size)));
-      EU_CHKN( hptw_checked_copy_to_va(&whitelist[curr].hptw_pal_checked_guest_ctx.super,
+      EU_CHKN( hptw_checked_copy_to_va(&ctx->hptw_pal_checked_guest_ctx.super,
                                        HPTW_CPL3,
                                        pm_addr+sizeof(pm_type)+sizeof(pm_size),
                                        &pm_value, sizeof(pm_value)));
@@ -860,7 +1085,7 @@ u32 scode_marshall(VCPU * vcpu)
 
             eu_trace("PM %d is a pointer (size %d, value %#x)", pm_i, pm_size, pm_value);
 
-            EU_CHKN( hptw_checked_copy_va_to_va(&whitelist[curr].hptw_pal_checked_guest_ctx.super,
+            EU_CHKN( hptw_checked_copy_va_to_va(&ctx->hptw_pal_checked_guest_ctx.super,
                                                 HPTW_CPL3,
                                                 pm_addr,
                                                 &vcpu_guest_walk_ctx.super,
@@ -873,6 +1098,16 @@ u32 scode_marshall(VCPU * vcpu)
             pm_addr += 4*pm_size;
             break;
           }
+        case TV_PAL_PM_SHARED: /* pointer into shared memory */
+          {
+            /* scode_share_ranges already took the pages away from
+               the reg guest and mapped them for this invocation
+               only, so the pal can use them in place */
+            eu_trace("PM %d is a shared pointer (size %d, value %#x)", pm_i, pm_size, pm_value);
+            EU_CHKN( scode_shared_param_addr(ctx, pm_value, pm_size, &pm_tmp),
+                     eu_err_e("PM %d at %#x isn't in memory shared with the PAL", pm_i, pm_value));
+            break;
+          }
         default: /* other */
           eu_err("Fail: unknown parameter %d type %d ", pm_i, pm_type);
           err=7;
@@ -880,7 +1115,7 @@ u32 scode_marshall(VCPU * vcpu)
         }
       new_rsp = VCPU_grsp(vcpu)-4;
       VCPU_grsp_set(vcpu, new_rsp);
-      EU_CHKN( hptw_checked_copy_to_va( &whitelist[curr].hptw_pal_checked_guest_ctx.super,
+      EU_CHKN( hptw_checked_copy_to_va( &ctx->hptw_pal_checked_guest_ctx.super,
                                         HPTW_CPL3,
                                         new_rsp,
                                         &pm_tmp,
@@ -899,6 +1134,7 @@ u32 scode_marshall(VCPU * vcpu)
 u32 hpt_scode_switch_scode(VCPU * vcpu)
 {
   int curr=scode_curr[vcpu->id];
+  scode_exec_ctx_t *ctx=NULL;
   int err=1;
   bool swapped_grsp=false;
   bool pushed_return=false;
@@ -908,29 +1144,29 @@ u32 hpt_scode_switch_scode(VCPU * vcpu)
 
   eu_trace("*** to scode ***");
 
-  spin_lock(&(whitelist[curr].pal_running_lock));
-  whitelist[curr].pal_running_vcpu_id=vcpu->id;
-  eu_trace("got pal_running lock!");
+  EU_CHK( ctx = scode_exec_acquire(&whitelist[curr], vcpu, SCODE_EXEC_RUNNING),
+          eu_err_e("no free execution context for PAL"));
+  eu_trace("got execution context %d", (int)(ctx - whitelist[curr].exec));
 
   EU_CHKN( copy_from_current_guest(vcpu,
-                                   &whitelist[curr].return_v,
+                                   &ctx->return_v,
                                    VCPU_grsp(vcpu),
                                    sizeof(void*)));
-  eu_trace("scode return vaddr is %#x", whitelist[curr].return_v);
+  eu_trace("scode return vaddr is %#x", ctx->return_v);
 
   /* save the guest stack pointer and set new stack pointer to scode stack */
   eu_trace("saved guest regular stack %#x, switch to sensitive code stack %#x",
            (u32)VCPU_grsp(vcpu), whitelist[curr].gssp);
-  whitelist[curr].grsp = (u32)VCPU_grsp(vcpu);
+  ctx->grsp = (u32)VCPU_grsp(vcpu);
   VCPU_grsp_set(vcpu, whitelist[curr].gssp);
   swapped_grsp=true;
 
   /* input parameter marshalling */
-  EU_CHKN( scode_marshall(vcpu));
+  EU_CHKN( scode_marshall(vcpu, ctx));
 
   /* write the sentinel return address to scode stack */
   sentinel_return = RETURN_FROM_PAL_ADDRESS;
-  EU_CHKN( hptw_checked_copy_to_va( &whitelist[curr].hptw_pal_checked_guest_ctx.super,
+  EU_CHKN( hptw_checked_copy_to_va( &ctx->hptw_pal_checked_guest_ctx.super,
                                     HPTW_CPL3,
                                     VCPU_grsp(vcpu)-4,
                                     &sentinel_return,
@@ -944,7 +1180,7 @@ u32 hpt_scode_switch_scode(VCPU * vcpu)
      below in case of error) */
 
   eu_trace("change NPT permission to run PAL!");
-  hpt_emhf_set_root_pm_pa( vcpu, whitelist[curr].hptw_pal_host_ctx.super.root_pa);
+  hpt_emhf_set_root_pm_pa( vcpu, ctx->hptw_pal_host_ctx.super.root_pa);
   VCPU_gcr3_set(vcpu, whitelist[curr].pal_gcr3);
   xmhf_memprot_flushmappings(vcpu); /* XXX */
 
@@ -965,11 +1201,11 @@ u32 hpt_scode_switch_scode(VCPU * vcpu)
    *   since the PAL doesn't have any exception handlers installed).
    */
   if (vcpu->cpu_vendor == CPU_VENDOR_AMD) {
-    whitelist[curr].saved_exception_intercepts =
+    ctx->saved_exception_intercepts =
       ((struct _svm_vmcbfields *)(vcpu->vmcb_vaddr_ptr))->exception_intercepts_bitmask;
     ((struct _svm_vmcbfields *)(vcpu->vmcb_vaddr_ptr))->exception_intercepts_bitmask = 0xffffffff;
   } else if (vcpu->cpu_vendor == CPU_VENDOR_INTEL) {
-    whitelist[curr].saved_exception_intercepts =  vcpu->vmcs.control_exception_bitmap;
+    ctx->saved_exception_intercepts =  vcpu->vmcs.control_exception_bitmap;
     vcpu->vmcs.control_exception_bitmap = 0xffffffff;
   }
 
@@ -977,21 +1213,23 @@ u32 hpt_scode_switch_scode(VCPU * vcpu)
  out:
   if(err) {
     if (swapped_grsp) {
-      VCPU_grsp_set(vcpu, whitelist[curr].grsp);
-      whitelist[curr].grsp = (u32)-1;
+      VCPU_grsp_set(vcpu, ctx->grsp);
+      ctx->grsp = (u32)-1;
     }
     if (pushed_return) {
       VCPU_grsp_set(vcpu, VCPU_grsp(vcpu)+4);
     }
 
-    whitelist[curr].pal_running_vcpu_id=-1;
-    spin_unlock(&(whitelist[curr].pal_running_lock));
-    eu_trace("released pal_running lock!");
+    if (ctx) {
+      scode_exec_release(&whitelist[curr], ctx);
+      xmhf_memprot_flushmappings(vcpu);
+      eu_trace("released execution context");
+    }
   }
   return err;
 }
 
-u32 scode_unmarshall(VCPU * vcpu)
+u32 scode_unmarshall(VCPU * vcpu, scode_exec_ctx_t *ctx)
 {
   u32 pm_addr_base, pm_addr;
   size_t i;
@@ -1019,7 +1257,7 @@ u32 scode_unmarshall(VCPU * vcpu)
 
   /* get params number */
   pm_addr = pm_addr_base;
-  EU_CHKN( hptw_checked_copy_from_va( &whitelist[curr].hptw_pal_checked_guest_ctx.super,
+  EU_CHKN( hptw_checked_copy_from_va( &ctx->hptw_pal_checked_guest_ctx.super,
                                       HPTW_CPL3,
                                       &pm_num,
                                       pm_addr,
@@ -1032,7 +1270,7 @@ u32 scode_unmarshall(VCPU * vcpu)
   for (i = 0; i < pm_num; i++) /*the last parameter should be pushed in stack first*/
     {
       /* get param information*/
-      EU_CHKN( hptw_checked_copy_from_va( &whitelist[curr].hptw_pal_checked_guest_ctx.super,
+      EU_CHKN( hptw_checked_copy_from_va( &ctx->hptw_pal_checked_guest_ctx.super,
                                           HPTW_CPL3,
                                           &pm_type,
                                           pm_addr,
@@ -1048,15 +1286,23 @@ u32 scode_unmarshall(VCPU * vcpu)
             eu_trace("skip an integer parameter!"); 
             break;
           }
+        case TV_PAL_PM_SHARED: /* pointer into shared memory */
+          {
+            /* written in place. returned along with the rest of the
+               shared memory by scode_exec_release */
+            pm_addr += 8;
+            eu_trace("skip a shared pointer parameter!");
+            break;
+          }
         case TV_PAL_PM_POINTER: /* pointer */
           {
-            EU_CHKN( hptw_checked_copy_from_va( &whitelist[curr].hptw_pal_checked_guest_ctx.super,
+            EU_CHKN( hptw_checked_copy_from_va( &ctx->hptw_pal_checked_guest_ctx.super,
                                                 HPTW_CPL3,
                                                 &pm_size,
                                                 pm_addr,
                                                 sizeof(pm_size)));
             /* get pointer adddress in regular code */
-            EU_CHKN( hptw_checked_copy_from_va( &whitelist[curr].hptw_pal_checked_guest_ctx.super,
+            EU_CHKN( hptw_checked_copy_from_va( &ctx->hptw_pal_checked_guest_ctx.super,
                                                 HPTW_CPL3,
                                                 &pm_value,
                                                 pm_addr+4,
@@ -1068,7 +1314,7 @@ u32 scode_unmarshall(VCPU * vcpu)
             EU_CHKN( hptw_checked_copy_va_to_va( &reg_guest_walk_ctx.super,
                                                  HPTW_CPL3,
                                                  pm_value,
-                                                 &whitelist[curr].hptw_pal_checked_guest_ctx.super,
+                                                 &ctx->hptw_pal_checked_guest_ctx.super,
                                                  HPTW_CPL3,
                                                  pm_addr,
                                                  pm_size*4));
@@ -1093,6 +1339,7 @@ u32 scode_unmarshall(VCPU * vcpu)
 u32 hpt_scode_switch_regular(VCPU * vcpu)
 {
   int curr=scode_curr[vcpu->id];
+  scode_exec_ctx_t *ctx;
   u32 rv=1;
 
   perf_ctr_timer_start(&g_tv_perf_ctrs[TV_PERF_CTR_SWITCH_REGULAR], vcpu->idx);
@@ -1101,8 +1348,11 @@ u32 hpt_scode_switch_regular(VCPU * vcpu)
   eu_trace("***** switch to regular code  ******");
   eu_trace("************************************");
 
+  ctx = scode_exec_current(&whitelist[curr], vcpu);
+  HALT_ON_ERRORCOND(ctx);
+
   /* marshalling parameters back to regular code */
-  EU_CHKN( scode_unmarshall(vcpu));
+  EU_CHKN( scode_unmarshall(vcpu, ctx));
 
   /* whether or not marshalling succeeded, we switch back to reg world.
    * nothing below can fail.
@@ -1113,25 +1363,16 @@ u32 hpt_scode_switch_regular(VCPU * vcpu)
   /* restore exception intercept vector */
   if (vcpu->cpu_vendor == CPU_VENDOR_AMD) {
     ((struct _svm_vmcbfields *)(vcpu->vmcb_vaddr_ptr))->exception_intercepts_bitmask
-      = whitelist[curr].saved_exception_intercepts;
+      = ctx->saved_exception_intercepts;
   } else if (vcpu->cpu_vendor == CPU_VENDOR_INTEL) {
     vcpu->vmcs.control_exception_bitmap
-      = whitelist[curr].saved_exception_intercepts;
+      = ctx->saved_exception_intercepts;
   }
 
-  /* release shared pages */
-  scode_release_all_shared_pages(vcpu, &whitelist[curr]);
-
-  /* clear the NPT permission setting in switching into scode */
-  eu_trace("change NPT permission to exit PAL!"); 
-  hpt_emhf_set_root_pm(vcpu, g_reg_npmo_root.pm);
-  VCPU_gcr3_set(vcpu, whitelist[curr].gcr3);
-  xmhf_memprot_flushmappings(vcpu); /* XXX */
-
   /* switch back to regular stack */
-  eu_trace("switch from scode stack %#x back to regular stack %#x", (u32)VCPU_grsp(vcpu), (u32)whitelist[curr].grsp);
-  VCPU_grsp_set(vcpu, whitelist[curr].grsp + 4);
-  whitelist[curr].grsp = (u32)-1;
+  eu_trace("switch from scode stack %#x back to regular stack %#x", (u32)VCPU_grsp(vcpu), (u32)ctx->grsp);
+  VCPU_grsp_set(vcpu, ctx->grsp + 4);
+  ctx->grsp = (u32)-1;
 
   /* enable interrupts */
   VCPU_grflags_set(vcpu, VCPU_grflags(vcpu) | EFLAGS_IF);
@@ -1139,11 +1380,18 @@ u32 hpt_scode_switch_regular(VCPU * vcpu)
   eu_trace("stack pointer before exiting scode is %#x",(u32)VCPU_grsp(vcpu));
 
   /* return to actual return address */
-  VCPU_grip_set(vcpu, whitelist[curr].return_v);
+  VCPU_grip_set(vcpu, ctx->return_v);
+
+  /* release shared pages and the execution context. ctx may be
+     reused by another cpu as soon as it is released. */
+  scode_exec_release(&whitelist[curr], ctx);
+  eu_trace("released execution context");
 
-  whitelist[curr].pal_running_vcpu_id=-1;
-  spin_unlock(&(whitelist[curr].pal_running_lock));
-  eu_trace("released pal_running lock!");
+  /* clear the NPT permission setting in switching into scode */
+  eu_trace("change NPT permission to exit PAL!"); 
+  hpt_emhf_set_root_pm(vcpu, g_reg_npmo_root.pm);
+  VCPU_gcr3_set(vcpu, whitelist[curr].gcr3);
+  xmhf_memprot_flushmappings(vcpu); /* XXX */
 
   perf_ctr_timer_record(&g_tv_perf_ctrs[TV_PERF_CTR_SWITCH_REGULAR], vcpu->idx);
 
@@ -1160,6 +1408,42 @@ static bool hpt_error_wasInsnFetch(VCPU *vcpu, u64 errorcode)
   }	
   return (errorcode & VMCB_NPT_ERRORCODE_ID);
 }
+
+static bool hpt_error_wasWrite(VCPU *vcpu, u64 errorcode)
+{
+  if (vcpu->cpu_vendor == CPU_VENDOR_INTEL) {
+    return (errorcode & EPT_ERRORCODE_WRITE);
+  } else if (vcpu->cpu_vendor != CPU_VENDOR_AMD) {
+    HALT_ON_ERRORCOND(0);
+  }	
+  return (errorcode & VMCB_NPT_ERRORCODE_RW);
+}
+
+/* regular code wrote to a page that is write-protected in its
+ * nested page tables. expected for frames whose measurement is
+ * cached (see mcache.h), and for pages that another cpu has just
+ * made writable again while this cpu still had the old mapping in
+ * its TLB.
+ */
+static u32 scode_reg_write_fault(VCPU *vcpu, u32 gpaddr)
+{
+  u32 err=1;
+
+  if (!mcache_reg_write(&g_hptw_reg_host_ctx.super, gpaddr)) {
+    bool user_accessible=false;
+    EU_CHK( hptw_get_effective_prots(&g_hptw_reg_host_ctx.super,
+                                     gpaddr,
+                                     &user_accessible) & HPT_PROTS_W,
+            eu_err_e("incorrect regular code EPT configuration!"));
+  }
+
+  /* other cpus pick up the change on their next fault on the page */
+  xmhf_memprot_flushmappings(vcpu);
+
+  err=0;
+ out:
+  return err;
+}
 #endif //__LDN_TV_INTEGRATION__
 
 /*  EPT violation handler */
@@ -1182,7 +1466,9 @@ u32 hpt_scode_npf(VCPU * vcpu, u32 gpaddr, u64 errorcode)
   eu_trace("CPU(%02x): nested page fault!(rip %#x, gcr3 %#llx, gpaddr %#x, errorcode %llx)",
           vcpu->id, rip, gcr3, gpaddr, errorcode);
 
-  EU_CHK( hpt_error_wasInsnFetch(vcpu, errorcode));
+  EU_CHK( hpt_error_wasInsnFetch(vcpu, errorcode)
+          || ((*curr == -1) && hpt_error_wasWrite(vcpu, errorcode))
+          || (*curr >= 0));
 #endif //__LDN_TV_INTEGRATION__
 
   index = scode_in_list(gcr3, rip);
@@ -1197,6 +1483,14 @@ u32 hpt_scode_npf(VCPU * vcpu, u32 gpaddr, u64 errorcode)
     /* valid entry point, switch from regular code to sensitive code */
     EU_CHKN( hpt_scode_switch_scode(vcpu));
 
+  } else if ((*curr >= 0) && (index < 0) && (RETURN_FROM_PAL_ADDRESS != rip)) {
+    /* sensitive code touching a page of its stack for the first time */
+    scode_exec_ctx_t *ctx = scode_exec_current(&whitelist[*curr], vcpu);
+
+    HALT_ON_ERRORCOND(ctx);
+    EU_CHKN( scode_exec_claim_page(&whitelist[*curr], ctx, gpaddr),
+             eu_err_e("SECURITY: invalid access to %#x from scode!", gpaddr));
+    xmhf_memprot_flushmappings(vcpu);
   } else if ((*curr >=0) && (index < 0)) {
     /* sensitive code to regular code */
 
@@ -1216,11 +1510,18 @@ u32 hpt_scode_npf(VCPU * vcpu, u32 gpaddr, u64 errorcode)
       eu_err("SECURITY: invalid access to scode mem region from other scodes!"); 
     goto out;	
   } else {
+    /* regular code to regular code. only writes to write-protected
+       memory are expected here */
 #if !defined(__LDN_TV_INTEGRATION__)  
-    /* regular code to regular code */
-    eu_err("incorrect regular code EPT configuration!"); 
+    EU_CHK( hpt_error_wasWrite(vcpu, errorcode),
+            eu_err_e("incorrect regular code EPT configuration!"));
+    EU_CHKN( scode_reg_write_fault(vcpu, gpaddr));
+#else
+    if (!mcache_reg_write(&g_hptw_reg_host_ctx.super, gpaddr)) {
+      goto out;
+    }
+    xmhf_memprot_flushmappings(vcpu);
 #endif //__LDN_TV_INTEGRATION__
-    goto out;
   }
 
   /* no errors, pseodu page fault canceled by nested paging */
@@ -1247,37 +1548,60 @@ u32 hpt_scode_npf(VCPU * vcpu, u32 gpaddr, u64 errorcode)
   return err;
 }
 
-/* caller is responsible for flushing TLB */
-void scode_release_all_shared_pages(VCPU *vcpu, whitelist_entry_t* wle)
+/* hypercalls made by concurrent invocations of a PAL all act on its
+ * uTPM. serialize them. returns false, without locking anything, if
+ * vcpu isn't running a PAL.
+ */
+bool scode_lock_running_utpm(VCPU *vcpu)
 {
-  int i;
+  int curr=scode_curr[vcpu->id];
 
-  (void)vcpu;
+  if (curr < 0) {
+    return false;
+  }
+  spin_lock(&whitelist[curr].utpm_lock);
+  return true;
+}
 
-  /* restore permissions for remapped sections */
-  /* assumes that SHARED sections are contiguous and on the end of the sections array */
-  for(i = wle->sections_num-1;
-      i >= 0 && wle->sections[i].section_type == TV_PAL_SECTION_SHARED;
-      i--) {
-    eu_trace("returning shared section num %d at 0x%08llx", i, wle->sections[i].pal_gva);
-    scode_return_section( &g_hptw_reg_host_ctx.super,
-                          &wle->hptw_pal_host_ctx.super,
-                          &wle->hptw_pal_checked_guest_ctx.super,
-                          &wle->sections[i]);
-    wle->sections_num--;
+void scode_unlock_running_utpm(VCPU *vcpu)
+{
+  int curr=scode_curr[vcpu->id];
+
+  HALT_ON_ERRORCOND(curr >= 0);
+  spin_unlock(&whitelist[curr].utpm_lock);
+}
+
+/* the nested page maps below the root that a range of len bytes, in
+   contiguous frames, can touch: at each level those covering it, plus
+   one where it straddles a boundary, as hptw_map_range counts them */
+static size_t scode_range_npt_pages(hpt_type_t t, size_t len)
+{
+  size_t pages=0;
+  int lvl;
+
+  for (lvl = 1; lvl < hpt_root_lvl(t); lvl++) {
+    int bits = hpt_va_idx_hi[t][lvl]+1; /* spanned by one map at lvl */
+    pages += (size_t)((((u64)len + (1ull << bits) - 1) >> bits) + 1);
   }
+  return pages;
 }
 
 /* note- caller is responsible for flushing page tables afterwards */
-u32 scode_share_range(VCPU * vcpu, whitelist_entry_t *wle, u32 gva_base, u32 gva_len)
+u32 scode_share_range(VCPU * vcpu, whitelist_entry_t *wle, scode_exec_ctx_t *ctx,
+                      u32 gva_base, u32 gva_len)
 {
   u32 err=1;
+  bool locked=false;
+  size_t npt_pages;
+  tv_pal_section_int_t *section;
   hptw_emhf_checked_guest_ctx_t vcpu_guest_walk_ctx;
   EU_CHKN( hptw_emhf_checked_guest_ctx_init_of_vcpu( &vcpu_guest_walk_ctx, vcpu));
 
-  EU_CHK( wle->sections_num < TV_MAX_SECTIONS);
+  EU_CHK( ctx->shared_num < TV_MAX_SECTIONS);
+  EU_CHK( (gva_len % PAGE_SIZE_4K) == 0);
 
-  wle->sections[wle->sections_num] = (tv_pal_section_int_t) {
+  section = &ctx->shared[ctx->shared_num];
+  *section = (tv_pal_section_int_t) {
     .reg_gva = gva_base,
     .pal_gva = gva_base,
     .size = gva_len,
@@ -1286,38 +1610,116 @@ u32 scode_share_range(VCPU * vcpu, whitelist_entry_t *wle, u32 gva_base, u32 gva
     .section_type = TV_PAL_SECTION_SHARED,
   };
 
+  {
+    mcache_key_t key;
+    /* for the side effect of dropping cached measurements of the
+       shared frames */
+    scode_section_frames( &g_hptw_reg_host_ctx.super,
+                          &vcpu_guest_walk_ctx.super,
+                          section,
+                          &key);
+  }
+
+  /* the pal's guest page tables are common to all its invocations */
+  spin_lock(&wle->exec_lock);
+  locked=true;
+
+  /* the range's pages need copies of the nested page maps on their
+     paths. the cap goes back down when the memory is returned. */
+  npt_pages = scode_range_npt_pages(ctx->hptw_pal_host_ctx.super.t, gva_len);
+  EU_CHK( npt_pages <= SCODE_EXEC_NPT_MAX_PAGES - ctx->npl->num_allocd,
+          eu_err_e("sharing %u bytes would take the PAL's nested page tables past %u pages",
+                   gva_len, SCODE_EXEC_NPT_MAX_PAGES));
+  pagelist_set_max(ctx->npl, ctx->npl->num_allocd + npt_pages);
+
+  {
+    /* large ranges are checked with one cursor per page table
+       rather than a walk per page */
+    hptw_leaf_t pal_gleaf, reg_gleaf;
+    size_t offset;
+
+    hptw_leaf_init(&pal_gleaf);
+    hptw_leaf_init(&reg_gleaf);
+    for (offset=0; offset < gva_len; offset += PAGE_SIZE_4K) {
+      hpt_pmeo_t pmeo;
+
+      /* the range mustn't overlap the pal's sections, or memory
+         shared with another invocation */
+      EU_CHKN( hptw_leaf_get_pmeo( &pmeo, &pal_gleaf,
+                                   &wle->hptw_pal_checked_guest_ctx.super,
+                                   gva_base + offset));
+      EU_CHK( !hpt_pmeo_is_present(&pmeo),
+              eu_err_e("range at %#x already mapped in PAL", gva_base + offset));
+
+      /* lending modifies the context's nested page tables.
+         scode_lend_section checks the reg mapping itself. */
+      EU_CHKN( hptw_leaf_get_pmeo( &pmeo, &reg_gleaf,
+                                   &vcpu_guest_walk_ctx.super,
+                                   gva_base + offset));
+      EU_CHK( hpt_pmeo_is_present(&pmeo));
+
+      /* frames scattered in guest-physical memory can need more
+         maps than the range's size suggests. make room for this
+         page's path, up to the hard cap */
+      npt_pages = ctx->npl->num_used
+        + hpt_root_lvl(ctx->hptw_pal_host_ctx.super.t) - 1;
+      if (npt_pages > ctx->npl->num_allocd) {
+        EU_CHK( npt_pages <= SCODE_EXEC_NPT_MAX_PAGES,
+                eu_err_e("sharing %u bytes would take the PAL's nested page tables past %u pages",
+                         gva_len, SCODE_EXEC_NPT_MAX_PAGES));
+        pagelist_set_max(ctx->npl, npt_pages);
+      }
+      EU_CHKN( scode_exec_own_path( ctx,
+                                    hpt_pmeo_va_to_pa( &pmeo,
+                                                       gva_base + offset)));
+    }
+  }
+
   scode_lend_section( &g_hptw_reg_host_ctx.super,
                       &vcpu_guest_walk_ctx.super,
-                      &wle->hptw_pal_host_ctx.super,
-                      &wle->hptw_pal_checked_guest_ctx.super,
-                      &wle->sections[wle->sections_num]);
+                      &ctx->hptw_pal_host_ctx.super,
+                      &ctx->hptw_pal_checked_guest_ctx.super,
+                      section,
+                      NULL, NULL);
 
-  wle->sections_num++;
+  ctx->shared_num++;
 
   err=0;
  out:
+  if (locked) {
+    spin_unlock(&wle->exec_lock);
+  }
   return err;
 }
 
+/* memory shared here is mapped only for the next invocation of the
+   PAL on this cpu */
 u32 scode_share_ranges(VCPU * vcpu, u32 scode_entry, u32 gva_base[], u32 gva_len[], u32 count)
 {
   size_t i;
   whitelist_entry_t* entry;
+  scode_exec_ctx_t *ctx=NULL;
   u32 err=1;
 
   EU_CHK( entry = find_scode_by_entry(VCPU_gcr3(vcpu), scode_entry));
+  EU_CHK( ctx = scode_exec_acquire(entry, vcpu, SCODE_EXEC_SHARING),
+          eu_err_e("no free execution context for PAL"));
 
   for(i=0; i<count; i++) {
-    EU_CHKN( scode_share_range(vcpu, entry, gva_base[i], gva_len[i]));
+    EU_CHKN( scode_share_range(vcpu, entry, ctx, gva_base[i], gva_len[i]));
   }
 
   /* flush TLB for page table modifications to take effect */
   xmhf_memprot_flushmappings(vcpu);
+
+  /* only now may the PAL be unregistered, or invoked */
+  scode_exec_set_state(entry, ctx, SCODE_EXEC_SHARED);
   
   err=0;
 out:
-  if (err && entry) {
-    scode_release_all_shared_pages(vcpu, entry);
+  if (err && ctx) {
+    scode_exec_release(entry, ctx);
+    xmhf_memprot_flushmappings(vcpu);
   }
   return err;
 }
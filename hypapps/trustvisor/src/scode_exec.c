@@ -0,0 +1,454 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* scode_exec.c - execution contexts for concurrent PAL invocations.
+ * see scode_exec_ctx_t in scode.h
+ */
+
+#include <xmhf.h>
+
+#include <scode.h>
+#include <malloc.h>
+#include <pages.h>
+#include <mcache.h>
+#include <tv_log.h>
+
+extern whitelist_entry_t *whitelist;
+extern size_t whitelist_max;
+
+/* make sure every page map on the path to gpa in ctx's nested page
+ * tables belongs to ctx, copying maps still shared with the PAL's
+ * nested page tables. must be called before modifying the entry for
+ * gpa. maps that don't exist yet are allocated from ctx->npl by
+ * hptw_insert_pmeo_alloc, so they're owned already.
+ */
+int scode_exec_own_path(scode_exec_ctx_t *ctx, hpt_pa_t gpa)
+{
+  hptw_ctx_t *npm_ctx = &ctx->hptw_pal_host_ctx.super;
+  hpt_pmo_t pmo = {
+    .t = npm_ctx->t,
+    .lvl = hpt_root_lvl(npm_ctx->t),
+    .pm = spa2hva(npm_ctx->root_pa),
+  };
+  int rv=1;
+
+  while (pmo.lvl > 1) {
+    hpt_pmeo_t pmeo;
+    void *pm;
+
+    hpt_pm_get_pmeo_by_va(&pmeo, &pmo, gpa);
+    if (!hpt_pmeo_is_present(&pmeo) || hpt_pmeo_is_page(&pmeo)) {
+      break;
+    }
+    pm = spa2hva(hpt_pmeo_get_address(&pmeo));
+    if (!pagelist_contains(ctx->npl, pm)) {
+      void *copy;
+      EU_CHK( copy = pagelist_get_page(ctx->npl),
+              eu_err_e("out of nested page table pages for PAL context"));
+      memcpy(copy, pm, hpt_pm_size(pmo.t, pmo.lvl-1));
+      hpt_pmeo_set_address(&pmeo, hva2spa(copy));
+      hpt_pmo_set_pme_by_va(&pmo, &pmeo, gpa);
+      pm = copy;
+    }
+    pmo.lvl--;
+    pmo.pm = pm;
+  }
+
+  rv=0;
+ out:
+  return rv;
+}
+
+/* back the pages of section with private frames in ctx */
+static int scode_exec_remap_section(whitelist_entry_t *wle,
+                                    scode_exec_ctx_t *ctx,
+                                    const tv_pal_section_int_t *section)
+{
+  hptw_ctx_t *npm_ctx = &ctx->hptw_pal_host_ctx.super;
+  size_t offset;
+  int rv=1;
+
+  for (offset=0; offset < section->size; offset += PAGE_SIZE_4K) {
+    hpt_pa_t gpa;
+    hpt_pmeo_t pmeo;
+    void *page;
+
+    gpa = hptw_va_to_pa(&wle->hptw_pal_checked_guest_ctx.super,
+                        section->pal_gva + offset);
+    EU_CHKN( scode_exec_own_path(ctx, gpa));
+
+    /* STACK pages may only be reserved in the pal's tables (see
+       scode_exec_claim_page). either way the frame is replaced. */
+    hptw_get_pmeo(&pmeo, npm_ctx, 1, gpa);
+    EU_CHK( pmeo.lvl == 1);
+
+    EU_CHK( page = pagelist_get_zeroedpage(ctx->priv));
+    hpt_pmeo_set_address(&pmeo, hva2spa(page));
+    hpt_pmeo_setprot(&pmeo, section->pal_prot);
+    EU_CHKN( hptw_insert_pmeo(npm_ctx, &pmeo, gpa));
+  }
+
+  rv=0;
+ out:
+  return rv;
+}
+
+/* (re)build ctx's nested page tables from the PAL's */
+static int scode_exec_build(whitelist_entry_t *wle, scode_exec_ctx_t *ctx)
+{
+  hptw_ctx_t *pal_npm_ctx = &wle->hptw_pal_host_ctx.super;
+  void *root;
+  size_t i;
+  int rv=1;
+
+  /* page lists are only allocated for contexts that get used */
+  if (!ctx->npl) {
+    EU_CHK( ctx->npl = malloc(sizeof(pagelist_t)));
+    pagelist_init_sized(ctx->npl, SCODE_EXEC_NPT_PAGES);
+  }
+  if (ctx->priv_pages && !ctx->priv) {
+    EU_CHK( ctx->priv = malloc(sizeof(pagelist_t)));
+    pagelist_init_sized(ctx->priv, ctx->priv_pages);
+    /* private stack and parameter pages hold PAL secrets */
+    ctx->priv->secret = true;
+  }
+
+  pagelist_reset(ctx->npl);
+  EU_CHK( root = pagelist_get_page(ctx->npl));
+  memcpy(root,
+         spa2hva(pal_npm_ctx->root_pa),
+         hpt_pm_size(pal_npm_ctx->t, hpt_root_lvl(pal_npm_ctx->t)));
+
+  EU_CHKN( hptw_emhf_host_ctx_init( &ctx->hptw_pal_host_ctx,
+                                    hva2spa(root),
+                                    pal_npm_ctx->t,
+                                    ctx->npl));
+  EU_CHKN( hptw_emhf_checked_guest_ctx_init( &ctx->hptw_pal_checked_guest_ctx,
+                                             wle->hptw_pal_checked_guest_ctx.super.root_pa,
+                                             wle->hptw_pal_checked_guest_ctx.super.t,
+                                             HPTW_CPL3,
+                                             &ctx->hptw_pal_host_ctx,
+                                             wle->gpl));
+
+  if (ctx->priv) {
+    pagelist_reset(ctx->priv);
+    for (i=0; i < wle->scode_info.num_sections; i++) {
+      if (wle->sections[i].section_type == TV_PAL_SECTION_STACK
+          || wle->sections[i].section_type == TV_PAL_SECTION_PARAM) {
+        EU_CHKN( scode_exec_remap_section(wle, ctx, &wle->sections[i]));
+      }
+    }
+  }
+
+  ctx->npt_valid = true;
+
+  rv=0;
+ out:
+  return rv;
+}
+
+/* set up to max execution contexts for a newly registered PAL. all
+ * but the first get private pages for the STACK and PARAM sections.
+ * PALs with STACK and PARAM sections too big to copy get only one
+ * context, so their invocations are serialized. nothing is allocated
+ * for a context until it is first used.
+ */
+int scode_exec_init(whitelist_entry_t *wle, size_t max)
+{
+  size_t priv_pages=0;
+  size_t i;
+  int rv=1;
+
+  COMPILE_TIME_ASSERT(offsetof(whitelist_entry_t, exec_lock) % 4 == 0);
+  COMPILE_TIME_ASSERT(offsetof(whitelist_entry_t, utpm_lock) % 4 == 0);
+
+  for (i=0; i < wle->scode_info.num_sections; i++) {
+    if (wle->sections[i].section_type == TV_PAL_SECTION_STACK
+        || wle->sections[i].section_type == TV_PAL_SECTION_PARAM) {
+      priv_pages += wle->sections[i].size / PAGE_SIZE_4K;
+    }
+  }
+
+  EU_CHK( max > 0);
+  if (priv_pages > SCODE_EXEC_PRIV_MAX_PAGES) {
+    eu_trace("%u pages of STACK and PARAM; PAL won't run concurrently",
+             (u32)priv_pages);
+    max = 1;
+  }
+  EU_CHK( wle->exec = malloc(max * sizeof(scode_exec_ctx_t)));
+  memset(wle->exec, 0, max * sizeof(scode_exec_ctx_t));
+  wle->exec_max = max;
+  wle->exec_lock = 1;
+  wle->utpm_lock = 1;
+  wle->dying = false;
+
+  for (i=0; i < max; i++) {
+    scode_exec_ctx_t *ctx = &wle->exec[i];
+
+    ctx->state = SCODE_EXEC_FREE;
+    ctx->vcpu_id = (u32)-1;
+    ctx->grsp = (u32)-1;
+    ctx->priv_pages = (i > 0) ? priv_pages : 0;
+  }
+
+  rv=0;
+ out:
+  return rv;
+}
+
+void scode_exec_free(whitelist_entry_t *wle)
+{
+  size_t i;
+
+  if (!wle->exec) {
+    return;
+  }
+
+  for (i=0; i < wle->exec_max; i++) {
+    scode_exec_ctx_t *ctx = &wle->exec[i];
+
+    if (ctx->priv) {
+      pagelist_free_all(ctx->priv);
+      free(ctx->priv);
+    }
+    if (ctx->npl) {
+      pagelist_free_all(ctx->npl);
+      free(ctx->npl);
+    }
+  }
+  free(wle->exec);
+  wle->exec = NULL;
+  wle->exec_max = 0;
+}
+
+/* get the execution context for vcpu's next (state SHARING) or current
+ * (state RUNNING) invocation of the PAL. a context already holding
+ * memory shared by vcpu is reused; otherwise a free one is taken,
+ * preferring the first, which has no private pages to set up.
+ * returns NULL if all contexts are busy, or the PAL is being
+ * unregistered.
+ */
+scode_exec_ctx_t* scode_exec_acquire(whitelist_entry_t *wle, VCPU *vcpu, u32 state)
+{
+  scode_exec_ctx_t *ctx=NULL;
+  size_t i;
+
+  spin_lock(&wle->exec_lock);
+
+  if (wle->dying) {
+    spin_unlock(&wle->exec_lock);
+    return NULL;
+  }
+
+  for (i=0; i < wle->exec_max; i++) {
+    if (wle->exec[i].state == SCODE_EXEC_SHARED
+        && wle->exec[i].vcpu_id == vcpu->id) {
+      ctx = &wle->exec[i];
+      break;
+    }
+  }
+  for (i=0; !ctx && i < wle->exec_max; i++) {
+    if (wle->exec[i].state == SCODE_EXEC_FREE) {
+      ctx = &wle->exec[i];
+    }
+  }
+
+  if (ctx) {
+    if (!ctx->npt_valid && scode_exec_build(wle, ctx)) {
+      ctx = NULL;
+    } else {
+      ctx->state = state;
+      ctx->vcpu_id = vcpu->id;
+    }
+  }
+
+  spin_unlock(&wle->exec_lock);
+  return ctx;
+}
+
+void scode_exec_set_state(whitelist_entry_t *wle, scode_exec_ctx_t *ctx, u32 state)
+{
+  spin_lock(&wle->exec_lock);
+  ctx->state = state;
+  spin_unlock(&wle->exec_lock);
+}
+
+/* STACK sections are only reserved at registration (see
+ * scode_reserve_section), so that PALs don't pay for stack they never
+ * use. the first touch of a page by the PAL, or by the hypervisor on
+ * its behalf, takes the frame from the reg guest, zeroes it, and maps
+ * it in the PAL's nested page tables. the contents of STACK sections
+ * are not measured; the PAL always starts out with zeroed pages
+ * instead.
+ *
+ * returns 0 if gpa is now mapped in ctx. caller is responsible for
+ * flushing TLB. like scode_lend_section, we don't shoot down other
+ * cpus' mappings of the frame.
+ */
+int scode_exec_claim_page(whitelist_entry_t *wle, scode_exec_ctx_t *ctx, hpt_pa_t gpa)
+{
+  hptw_ctx_t *reg_npm_ctx = &g_hptw_reg_host_ctx.super;
+  hptw_ctx_t *pal_npm_ctx = &wle->hptw_pal_host_ctx.super;
+  hpt_prot_t pal_prot = pal_prot_of_type(TV_PAL_SECTION_STACK);
+  hpt_pmeo_t pal_npmeo;
+  int rv=1;
+
+  gpa &= ~(hpt_pa_t)(PAGE_SIZE_4K-1);
+
+  spin_lock(&wle->exec_lock);
+
+  /* already mapped, so the fault was for something else */
+  hptw_get_pmeo(&pal_npmeo, &ctx->hptw_pal_host_ctx.super, 1, gpa);
+  EU_CHK( !hpt_pmeo_is_present(&pal_npmeo));
+
+  hptw_get_pmeo(&pal_npmeo, pal_npm_ctx, 1, gpa);
+  if (!hpt_pmeo_is_present(&pal_npmeo)) {
+    hpt_pmeo_t reg_npmeo;
+    hpt_pa_t spa = hpt_pmeo_get_address(&pal_npmeo);
+    bool user_accessible=false;
+
+    /* reserved entries are the only non-present ones with a frame */
+    EU_CHK( pal_npmeo.lvl == 1 && spa != 0);
+
+    /* the frame may have been lent elsewhere since. dropping a cached
+       measurement first makes it writable by the reg guest again. */
+    mcache_invalidate_page(reg_npm_ctx, gpa, NULL);
+    hptw_get_pmeo(&reg_npmeo, reg_npm_ctx, 1, gpa);
+    EU_CHK( reg_npmeo.lvl == 1 && hpt_pmeo_get_address(&reg_npmeo) == spa);
+    EU_CHK( (hptw_get_effective_prots(reg_npm_ctx, gpa, &user_accessible) & pal_prot) == pal_prot,
+            eu_err_e("reserved PAL page at %#llx is in use", gpa));
+
+    hptw_set_prot(reg_npm_ctx, gpa, HPT_PROTS_NONE);
+    memset(spa2hva(spa), 0, PAGE_SIZE_4K);
+
+    hpt_pmeo_setprot(&pal_npmeo, pal_prot);
+    EU_CHKN( hptw_insert_pmeo(pal_npm_ctx, &pal_npmeo, gpa));
+  }
+
+  /* in case ctx has its own copy of the map */
+  hptw_set_prot(&ctx->hptw_pal_host_ctx.super, gpa, pal_prot);
+
+  rv=0;
+ out:
+  spin_unlock(&wle->exec_lock);
+  return rv;
+}
+
+/* claim a reserved page for the context whose nested page tables are
+ * npm_ctx. for the hypervisor's own accesses to PAL memory, which
+ * don't go through hpt_scode_npf. returns true if gpa is now mapped.
+ */
+bool scode_exec_claim_npt_page(const hptw_ctx_t *npm_ctx, hpt_pa_t gpa)
+{
+  size_t i, j;
+
+  for (i=0; i < whitelist_max; i++) {
+    if (!whitelist[i].gcr3 || !whitelist[i].exec) {
+      continue;
+    }
+    for (j=0; j < whitelist[i].exec_max; j++) {
+      scode_exec_ctx_t *ctx = &whitelist[i].exec[j];
+      if (ctx->npt_valid
+          && ctx->hptw_pal_host_ctx.super.root_pa == npm_ctx->root_pa) {
+        return !scode_exec_claim_page(&whitelist[i], ctx, gpa);
+      }
+    }
+  }
+  return false;
+}
+
+/* the context of the invocation running on vcpu, or NULL */
+scode_exec_ctx_t* scode_exec_current(whitelist_entry_t *wle, VCPU *vcpu)
+{
+  size_t i;
+
+  /* only vcpu moves a context into or out of RUNNING on vcpu, so
+     no need for the lock */
+  for (i=0; i < wle->exec_max; i++) {
+    if (wle->exec[i].state == SCODE_EXEC_RUNNING
+        && wle->exec[i].vcpu_id == vcpu->id) {
+      return &wle->exec[i];
+    }
+  }
+  return NULL;
+}
+
+/* return all memory shared with ctx and make it available to other
+ * invocations. caller is responsible for flushing TLB.
+ */
+void scode_exec_release(whitelist_entry_t *wle, scode_exec_ctx_t *ctx)
+{
+  spin_lock(&wle->exec_lock);
+
+  while (ctx->shared_num > 0) {
+    ctx->shared_num--;
+    eu_trace("returning shared section at 0x%08llx",
+             ctx->shared[ctx->shared_num].pal_gva);
+    mcache_return_section( &g_hptw_reg_host_ctx.super,
+                           &ctx->hptw_pal_host_ctx.super,
+                           &ctx->hptw_pal_checked_guest_ctx.super,
+                           &ctx->shared[ctx->shared_num]);
+  }
+
+  /* copied maps are reused by later invocations. start over from the
+     PAL's tables once too many have accumulated, rather than run
+     out, and drop the extra room scode_share_range made. */
+  if (ctx->npl->num_used > SCODE_EXEC_NPT_PAGES/2) {
+    ctx->npt_valid = false;
+  }
+  pagelist_set_max(ctx->npl, SCODE_EXEC_NPT_PAGES);
+
+  ctx->state = SCODE_EXEC_FREE;
+  ctx->vcpu_id = (u32)-1;
+
+  spin_unlock(&wle->exec_lock);
+}
+
+/* Local Variables: */
+/* mode:c           */
+/* indent-tabs-mode:nil */
+/* c-basic-offset:2 */
+/* End:             */
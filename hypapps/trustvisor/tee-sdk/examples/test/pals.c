@@ -316,6 +316,41 @@ void pals(uint32_t uiCommand, tzi_encode_buffer_t *psInBuf, tzi_encode_buffer_t
           break;
     }
     break;
+
+  case PAL_RAND_BENCH:
+    {
+      uint32_t method, len, count;
+
+      if((*puiRv = TZIDecodeBufF(psInBuf, "%"TZI_DU32 "%"TZI_DU32 "%"TZI_DU32,
+                                 &method, &len, &count)))
+        break;
+
+      *puiRv = pal_rand_bench(method, len, count);
+    }
+    break;
+
+  case PAL_PARAM_BENCH:
+    {
+      uint32_t method, len;
+      uint8_t *in, *out;
+
+      if((*puiRv = TZIDecodeBufF(psInBuf, "%"TZI_DU32, &method)))
+        break;
+
+      if (method == PAL_PARAM_BENCH_COPY) {
+        if((*puiRv = TZIDecodeBufF(psInBuf, "%"TZI_DARRSPC, &in, &len)))
+          break;
+        if((*puiRv = TZIEncodeBufF(psOutBuf, "%"TZI_EARRSPC, &out, len)))
+          break;
+      } else {
+        in = out = TZIDecodeMemoryReference(psInBuf, &len);
+        if((*puiRv = TZIDecodeGetError(psInBuf)))
+          break;
+      }
+
+      *puiRv = pal_param_bench(in, out, len);
+    }
+    break;
   }
   return;
 }
@@ -420,6 +455,59 @@ tz_return_t pal_rand(IN size_t len,
   }
 }
 
+static uint8_t rand_bench_buf[PAL_RAND_BENCH_MAX]
+  __attribute__ ((aligned (4096)));
+
+/* gets count lots of len random bytes, the way method says. the
+ * bytes aren't returned; the caller times the whole invocation. */
+__attribute__ ((section (".scode")))
+tz_return_t pal_rand_bench(IN uint32_t method,
+                           IN uint32_t len,
+                           IN uint32_t count)
+{
+  uint32_t i;
+  int rv=0;
+
+  if (len > PAL_RAND_BENCH_MAX) {
+    return TZ_ERROR_GENERIC;
+  }
+
+  for (i = 0; i < count && !rv; i++) {
+    switch (method) {
+    case PAL_RAND_BENCH_BLOCK:
+      rv = svc_utpm_rand_block(rand_bench_buf, len);
+      break;
+    case PAL_RAND_BENCH_BULK:
+      rv = svc_utpm_rand_bulk(rand_bench_buf, len);
+      break;
+    case PAL_RAND_BENCH_POOL:
+      rv = svc_rand_pool(rand_bench_buf, len);
+      break;
+    default:
+      rv = 1;
+    }
+  }
+
+  return rv ? TZ_ERROR_GENERIC : TZ_SUCCESS;
+}
+
+/* inverts len bytes of in into out, which may be the same buffer.
+ * every byte is read and written so that the caller can time moving
+ * the buffer in and out of the pal. */
+__attribute__ ((section (".scode")))
+tz_return_t pal_param_bench(IN uint8_t *in,
+                            OUT uint8_t *out,
+                            IN uint32_t len)
+{
+  uint32_t i;
+
+  for (i = 0; i < len; i++) {
+    out[i] = ~in[i];
+  }
+
+  return TZ_SUCCESS;
+}
+
 static uint64_t t0;
 static uint64_t t0_nonce;
 static bool t0_initd=false;
@@ -64,8 +64,29 @@ typedef enum {
   PAL_TIME_INIT,
   PAL_TIME_ELAPSED,
   PAL_NV_ROLLBACK,
+  PAL_RAND_BENCH,
+  PAL_PARAM_BENCH,
 } PAL_CMD;
 
+/* ways for PAL_RAND_BENCH to get its random bytes */
+typedef enum {
+  PAL_RAND_BENCH_BLOCK, /* svc_utpm_rand_block */
+  PAL_RAND_BENCH_BULK,  /* svc_utpm_rand_bulk; whole pages only */
+  PAL_RAND_BENCH_POOL,  /* svc_rand_pool */
+} PAL_RAND_BENCH_METHOD;
+
+#define PAL_RAND_BENCH_MAX (16*4096)
+
+/* ways for PAL_PARAM_BENCH to get its buffer */
+typedef enum {
+  PAL_PARAM_BENCH_COPY,   /* array in the marshal buffers, copied in and out */
+  PAL_PARAM_BENCH_SHARED, /* memory reference, used in place */
+} PAL_PARAM_BENCH_METHOD;
+
+/* most bytes PAL_PARAM_BENCH_COPY takes per call, so that an array
+   fits in one marshal buffer */
+#define PAL_PARAM_BENCH_CHUNK 2048
+
 void pals(uint32_t uiCommand, tzi_encode_buffer_t *psInBuf, tzi_encode_buffer_t *psOutBuf, tz_return_t *puiRv);
 void pal_withoutparam();
 uint32_t pal_param(uint32_t input);
@@ -82,6 +103,12 @@ tz_return_t pal_pcr_read(IN uint32_t idx,
                         OUT uint8_t *val);
 tz_return_t pal_rand(IN size_t len,
                      OUT uint8_t *bytes);
+tz_return_t pal_rand_bench(IN uint32_t method,
+                           IN uint32_t len,
+                           IN uint32_t count);
+tz_return_t pal_param_bench(IN uint8_t *in,
+                            OUT uint8_t *out,
+                            IN uint32_t len);
 tz_return_t pal_time_init();
 tz_return_t pal_time_elapsed(OUT uint64_t *us);
 tz_return_t pal_nv_rollback(IN uint8_t *newval,
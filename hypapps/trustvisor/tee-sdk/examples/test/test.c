@@ -44,6 +44,9 @@
  * @XMHF_LICENSE_HEADER_END@
  */
 
+#ifdef TEST_MTBENCH
+#define _GNU_SOURCE /* for sched_setaffinity */
+#endif
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -52,6 +55,12 @@
 #include  <errno.h>
 #include  <string.h>
 #include <inttypes.h>
+#include <time.h>
+#ifdef TEST_MTBENCH
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
 
 #include <openssl/err.h>
 #include <openssl/evp.h>
@@ -1176,6 +1185,473 @@ tz_return_t test_nv_rollback(tz_session_t *tzPalSession) {
 
 }
 
+#ifdef TEST_REGBENCH
+static uint64_t regbench_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* registers and unregisters a pal with a code section of the given
+ * size, reporting the average time per registration. the first
+ * registration measures the code section from scratch; later ones
+ * can reuse the cached measurement, unless the section is written to
+ * in between (dirty).
+ */
+static int regbench_size(size_t code_sz, bool dirty)
+{
+  const int iters = 16;
+  struct tv_pal_sections scode_info;
+  struct tv_pal_params params = { .num_params = 0 };
+  uint8_t *code = NULL, *scratch = NULL;
+  uint64_t t0, t_cold = 0, t_warm = 0;
+  int i, rv = 1;
+
+  if (posix_memalign((void**)&code, PAGE_SIZE, code_sz)
+      || posix_memalign((void**)&scratch, PAGE_SIZE, 2*PAGE_SIZE)) {
+    goto out;
+  }
+  memset(code, 0xc3, code_sz); /* ret */
+  memset(scratch, 0, 2*PAGE_SIZE);
+
+  scode_info.num_sections = 0;
+  tv_pal_sections_add(&scode_info, TV_PAL_SECTION_CODE, code, code_sz);
+  tv_pal_sections_add(&scode_info, TV_PAL_SECTION_STACK, scratch, PAGE_SIZE);
+  tv_pal_sections_add(&scode_info, TV_PAL_SECTION_PARAM, scratch+PAGE_SIZE, PAGE_SIZE);
+  tv_lock_pal_sections(&scode_info);
+
+  for (i = 0; i <= iters; i++) {
+    if (dirty) {
+      code[(i * PAGE_SIZE) % code_sz] = 0xc3;
+    }
+    t0 = regbench_now_ns();
+    if (tv_pal_register(&scode_info, &params, code)) {
+      printf("Failure at %s:%d\n", __FILE__, __LINE__);
+      goto out;
+    }
+    if (i == 0) {
+      t_cold = regbench_now_ns() - t0;
+    } else {
+      t_warm += regbench_now_ns() - t0;
+    }
+    if (tv_pal_unregister(code)) {
+      printf("Failure at %s:%d\n", __FILE__, __LINE__);
+      goto out;
+    }
+  }
+
+  printf("  %8zu KB%s: first %8"PRIu64" us, later avg %8"PRIu64" us\n",
+         code_sz / 1024, dirty ? " (dirty)" : "        ",
+         t_cold / 1000, t_warm / iters / 1000);
+  rv = 0;
+
+ out:
+  free(code);
+  free(scratch);
+  return rv;
+}
+
+/* registers and unregisters a pal with a small code section and a
+ * stack section of the given size. stack pages are only backed once
+ * touched, so this should be roughly independent of the stack size.
+ */
+static int regbench_stack(size_t stack_sz)
+{
+  const int iters = 16;
+  struct tv_pal_sections scode_info;
+  struct tv_pal_params params = { .num_params = 0 };
+  uint8_t *code = NULL, *stack = NULL;
+  uint64_t t0, t = 0;
+  int i, rv = 1;
+
+  if (posix_memalign((void**)&code, PAGE_SIZE, 2*PAGE_SIZE)
+      || posix_memalign((void**)&stack, PAGE_SIZE, stack_sz)) {
+    goto out;
+  }
+  memset(code, 0xc3, 2*PAGE_SIZE); /* ret */
+  memset(stack, 0, stack_sz);
+
+  scode_info.num_sections = 0;
+  tv_pal_sections_add(&scode_info, TV_PAL_SECTION_CODE, code, PAGE_SIZE);
+  tv_pal_sections_add(&scode_info, TV_PAL_SECTION_PARAM, code+PAGE_SIZE, PAGE_SIZE);
+  tv_pal_sections_add(&scode_info, TV_PAL_SECTION_STACK, stack, stack_sz);
+  tv_lock_pal_sections(&scode_info);
+
+  for (i = 0; i < iters; i++) {
+    t0 = regbench_now_ns();
+    if (tv_pal_register(&scode_info, &params, code)) {
+      printf("Failure at %s:%d\n", __FILE__, __LINE__);
+      goto out;
+    }
+    t += regbench_now_ns() - t0;
+    if (tv_pal_unregister(code)) {
+      printf("Failure at %s:%d\n", __FILE__, __LINE__);
+      goto out;
+    }
+  }
+
+  printf("  %8zu KB stack: avg %8"PRIu64" us\n",
+         stack_sz / 1024, t / iters / 1000);
+  rv = 0;
+
+ out:
+  free(code);
+  free(stack);
+  return rv;
+}
+
+int test_regbench(void)
+{
+  size_t sz;
+  int rv = 0;
+
+  printf("\nREGBENCH\n");
+  if (USERSPACE_ONLY) {
+    printf("  skipped (userspace only)\n");
+    return 0;
+  }
+
+  for (sz = 16*1024; sz <= 4*1024*1024; sz *= 4) {
+    rv = regbench_size(sz, false) || rv;
+    rv = regbench_size(sz, true) || rv;
+  }
+  for (sz = 64*1024; sz <= 16*1024*1024; sz *= 4) {
+    rv = regbench_stack(sz) || rv;
+  }
+
+  if (rv) { printf("...FAILED rv %d\n", rv); }
+  return rv;
+}
+#endif
+
+#ifdef TEST_MTBENCH
+#define MTBENCH_MAX_THREADS 16
+#define MTBENCH_ITERS 1000
+
+typedef struct {
+  tz_session_t *tzPalSession;
+  int cpu;
+  int rv;
+} mtbench_arg_t;
+
+static uint64_t mtbench_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* invokes PAL_PARAM repeatedly from one cpu, checking that results
+ * aren't mixed up with those of invocations on other cpus.
+ */
+static void* mtbench_thread(void *varg)
+{
+  mtbench_arg_t *arg = varg;
+  cpu_set_t set;
+  uint32_t i, base;
+
+  CPU_ZERO(&set);
+  CPU_SET(arg->cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set)) {
+    printf("Failure at %s:%d\n", __FILE__, __LINE__);
+    arg->rv = 1;
+    return NULL;
+  }
+
+  base = (uint32_t)arg->cpu << 24;
+  for (i = 0; i < MTBENCH_ITERS; i++) {
+    tz_operation_t tzOp;
+    tz_return_t tzRet, serviceReturn;
+    uint32_t output;
+
+    tzRet = TZOperationPrepareInvoke(arg->tzPalSession,
+                                     PAL_PARAM,
+                                     NULL,
+                                     &tzOp);
+    assert(tzRet == TZ_SUCCESS);
+    TZEncodeUint32(&tzOp, base + i);
+
+    tzRet = TZOperationPerform(&tzOp, &serviceReturn);
+    output = TZDecodeUint32(&tzOp);
+    if (tzRet != TZ_SUCCESS
+        || TZDecodeGetError(&tzOp) != TZ_SUCCESS
+        || output != base + i + 1) {
+      printf("error: cpu %d, tzRet %d, serviceReturn %d, output %#x, expected %#x\n",
+             arg->cpu, tzRet, serviceReturn, output, base + i + 1);
+      arg->rv = 1;
+    }
+    TZOperationRelease(&tzOp);
+    if (arg->rv) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+/* runs the same pal from 1..n threads at once, one per cpu,
+ * reporting total invocations per second.
+ */
+int test_mtbench(tz_session_t *tzPalSession)
+{
+  pthread_t threads[MTBENCH_MAX_THREADS];
+  mtbench_arg_t args[MTBENCH_MAX_THREADS];
+  long ncpus;
+  int n, i, rv = 0;
+
+  printf("\nMTBENCH\n");
+
+  ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpus < 1) {
+    ncpus = 1;
+  } else if (ncpus > MTBENCH_MAX_THREADS) {
+    ncpus = MTBENCH_MAX_THREADS;
+  }
+
+  for (n = 1; n <= ncpus && !rv; n++) {
+    uint64_t t0, t;
+
+    t0 = mtbench_now_ns();
+    for (i = 0; i < n; i++) {
+      args[i] = (mtbench_arg_t) {
+        .tzPalSession = tzPalSession,
+        .cpu = i,
+        .rv = 0,
+      };
+      if (pthread_create(&threads[i], NULL, mtbench_thread, &args[i])) {
+        printf("Failure at %s:%d\n", __FILE__, __LINE__);
+        return 1;
+      }
+    }
+    for (i = 0; i < n; i++) {
+      pthread_join(threads[i], NULL);
+      rv = args[i].rv || rv;
+    }
+    t = mtbench_now_ns() - t0;
+
+    printf("  %2d threads: %8"PRIu64" invocations/s\n",
+           n, (uint64_t)n * MTBENCH_ITERS * 1000000000ull / (t ? t : 1));
+  }
+
+  if (rv) { printf("...FAILED rv %d\n", rv); }
+  return rv;
+}
+#endif
+
+#ifdef TEST_RANDBENCH
+#define RANDBENCH_BYTES (4*1024*1024)
+
+static uint64_t randbench_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* has the pal get RANDBENCH_BYTES random bytes, len at a time, and
+ * returns the rate in bytes/s, or 0 on failure */
+static uint64_t randbench_run(tz_session_t *tzPalSession,
+                              uint32_t method, uint32_t len)
+{
+  tz_return_t tzRet, serviceReturn;
+  tz_operation_t tzOp;
+  uint64_t t0, t;
+
+  tzRet = TZOperationPrepareInvoke(tzPalSession,
+                                   PAL_RAND_BENCH,
+                                   NULL,
+                                   &tzOp);
+  assert(tzRet == TZ_SUCCESS);
+  assert(!(TZIEncodeF(&tzOp, "%"TZI_EU32 "%"TZI_EU32 "%"TZI_EU32,
+                      method, len, RANDBENCH_BYTES / len)));
+
+  t0 = randbench_now_ns();
+  tzRet = TZOperationPerform(&tzOp, &serviceReturn);
+  t = randbench_now_ns() - t0;
+  TZOperationRelease(&tzOp);
+
+  if (tzRet != TZ_SUCCESS) {
+    printf("Failure at %s:%d\n", __FILE__, __LINE__);
+    printf("tzRet 0x%08x\n", tzRet);
+    return 0;
+  }
+  return (uint64_t)RANDBENCH_BYTES * 1000000000ull / (t ? t : 1);
+}
+
+/* random bytes/s obtained inside the pal, for several request sizes,
+ * one request per call into the TEE, one call per page run, and
+ * through the pal-side pool. run with the null backend to compare
+ * against userspace. */
+int test_randbench(tz_session_t *tzPalSession)
+{
+  const uint32_t lens[] = { 16, 256, 4096, PAL_RAND_BENCH_MAX };
+  unsigned int i;
+  int rv = 0;
+
+  printf("\nRANDBENCH\n");
+  printf("  %8s %12s %12s %12s bytes/s\n", "len", "block", "bulk", "pool");
+
+  for (i = 0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+    uint64_t block, bulk=0, pool;
+
+    block = randbench_run(tzPalSession, PAL_RAND_BENCH_BLOCK, lens[i]);
+    if (lens[i] % TPM_RAND_BULK_GRANULE == 0) {
+      bulk = randbench_run(tzPalSession, PAL_RAND_BENCH_BULK, lens[i]);
+      rv = !bulk || rv;
+    }
+    pool = randbench_run(tzPalSession, PAL_RAND_BENCH_POOL, lens[i]);
+    rv = !block || !pool || rv;
+
+    printf("  %8"PRIu32" %12"PRIu64" %12"PRIu64" %12"PRIu64"\n",
+           lens[i], block, bulk, pool);
+  }
+
+  if (rv) { printf("...FAILED rv %d\n", rv); }
+  return rv;
+}
+#endif
+
+#ifdef TEST_PARAMBENCH
+#define PARAMBENCH_MAX (16*1024*1024)
+
+static uint64_t parambench_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* has the pal invert len bytes of buf, passed through the marshal
+ * buffers a chunk per call, and copied back into buf. returns the
+ * rate in bytes/s, or 0 on failure */
+static uint64_t parambench_copy(tz_session_t *tzPalSession,
+                                uint8_t *buf, uint32_t len)
+{
+  tz_return_t tzRet, serviceReturn;
+  tz_operation_t tzOp;
+  uint64_t t0, t;
+  uint32_t off;
+
+  t0 = parambench_now_ns();
+  for (off = 0; off < len; off += PAL_PARAM_BENCH_CHUNK) {
+    uint32_t n = len - off < PAL_PARAM_BENCH_CHUNK ? len - off : PAL_PARAM_BENCH_CHUNK;
+    uint8_t *out;
+    uint32_t outLen;
+
+    tzRet = TZOperationPrepareInvoke(tzPalSession,
+                                     PAL_PARAM_BENCH,
+                                     NULL,
+                                     &tzOp);
+    assert(tzRet == TZ_SUCCESS);
+    assert(!(TZIEncodeF(&tzOp, "%"TZI_EU32 "%"TZI_EARR,
+                        PAL_PARAM_BENCH_COPY, buf + off, n)));
+
+    tzRet = TZOperationPerform(&tzOp, &serviceReturn);
+    if (tzRet == TZ_SUCCESS) {
+      tzRet = TZIDecodeF(&tzOp, "%"TZI_DARRSPC, &out, &outLen);
+    }
+    if (tzRet == TZ_SUCCESS && outLen == n) {
+      memcpy(buf + off, out, n);
+    }
+    TZOperationRelease(&tzOp);
+
+    if (tzRet != TZ_SUCCESS || outLen != n) {
+      printf("Failure at %s:%d\n", __FILE__, __LINE__);
+      printf("tzRet 0x%08x\n", tzRet);
+      return 0;
+    }
+  }
+  t = parambench_now_ns() - t0;
+
+  return (uint64_t)len * 1000000000ull / (t ? t : 1);
+}
+
+/* has the pal invert the first len bytes of mem in place, in one
+ * call. returns the rate in bytes/s, or 0 on failure */
+static uint64_t parambench_shared(tz_session_t *tzPalSession,
+                                  tz_shared_memory_t *mem, uint32_t len)
+{
+  tz_return_t tzRet, serviceReturn;
+  tz_operation_t tzOp;
+  uint64_t t0, t;
+
+  tzRet = TZOperationPrepareInvoke(tzPalSession,
+                                   PAL_PARAM_BENCH,
+                                   NULL,
+                                   &tzOp);
+  assert(tzRet == TZ_SUCCESS);
+  assert(!(TZIEncodeF(&tzOp, "%"TZI_EU32, PAL_PARAM_BENCH_SHARED)));
+  TZEncodeMemoryReference(&tzOp, mem, 0, len, TZ_MEM_SERVICE_RW);
+
+  t0 = parambench_now_ns();
+  tzRet = TZOperationPerform(&tzOp, &serviceReturn);
+  t = parambench_now_ns() - t0;
+  TZOperationRelease(&tzOp);
+
+  if (tzRet != TZ_SUCCESS) {
+    printf("Failure at %s:%d\n", __FILE__, __LINE__);
+    printf("tzRet 0x%08x\n", tzRet);
+    return 0;
+  }
+  return (uint64_t)len * 1000000000ull / (t ? t : 1);
+}
+
+/* bytes/s a pal reads and writes of a buffer parameter, for several
+ * sizes, copied through the marshal buffers, and lent in place as
+ * shared memory. each byte is inverted once each way, so the buffer
+ * should end up as it started. */
+int test_parambench(tz_session_t *tzPalSession)
+{
+  const uint32_t lens[] = { 4096, 64*1024, 1024*1024, 4*1024*1024, PARAMBENCH_MAX };
+  tz_shared_memory_t mem = {
+    .uiLength = PARAMBENCH_MAX,
+    .uiFlags = TZ_MEM_SERVICE_RW,
+  };
+  uint8_t *buf;
+  unsigned int i;
+  uint32_t j;
+  int rv = 0;
+
+  printf("\nPARAMBENCH\n");
+
+  if (TZSharedMemoryAllocate(tzPalSession, &mem) != TZ_SUCCESS) {
+    printf("...FAILED to allocate shared memory\n");
+    return 1;
+  }
+  buf = mem.pBlock;
+  for (j = 0; j < PARAMBENCH_MAX; j++) {
+    buf[j] = (uint8_t)j;
+  }
+
+  printf("  %9s %12s %12s bytes/s\n", "len", "copy", "shared");
+
+  for (i = 0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+    uint64_t copy, shared;
+
+    copy = parambench_copy(tzPalSession, buf, lens[i]);
+    shared = parambench_shared(tzPalSession, &mem, lens[i]);
+    rv = !copy || !shared || rv;
+
+    for (j = 0; j < lens[i]; j++) {
+      if (buf[j] != (uint8_t)j) {
+        printf("...byte %"PRIu32" is 0x%02x after %"PRIu32"-byte round trip\n",
+               j, buf[j], lens[i]);
+        rv = 1;
+        break;
+      }
+    }
+
+    printf("  %9"PRIu32" %12"PRIu64" %12"PRIu64"\n",
+           lens[i], copy, shared);
+  }
+
+  TZSharedMemoryRelease(&mem);
+
+  if (rv) { printf("...FAILED rv %d\n", rv); }
+  return rv;
+}
+#endif
+
 tz_return_t init_tz_sess(tze_dev_svc_sess_t* tz_sess)
 {
   tz_return_t rv;
@@ -1269,6 +1745,22 @@ int main(void)
 #ifdef TEST_NV_ROLLBACK
   rv = test_nv_rollback(&tz_sess.tzSession) || rv;
 #endif
+
+#ifdef TEST_REGBENCH
+  rv = test_regbench() || rv;
+#endif
+
+#ifdef TEST_MTBENCH
+  rv = test_mtbench(&tz_sess.tzSession) || rv;
+#endif
+
+#ifdef TEST_RANDBENCH
+  rv = test_randbench(&tz_sess.tzSession) || rv;
+#endif
+
+#ifdef TEST_PARAMBENCH
+  rv = test_parambench(&tz_sess.tzSession) || rv;
+#endif
   
   if (rv) {
     printf("FAIL with rv=%d\n", rv);
@@ -44,46 +44,322 @@
  * @XMHF_LICENSE_HEADER_END@
  */
 
+/* the null backend runs services in the calling process, without a
+ * hypervisor. uTPM operations are performed by TrustVisor's own uTPM
+ * and CTR_DRBG, built for userspace, so that seal, quote and rand
+ * cost about what they do under TrustVisor, and PAL workloads can be
+ * profiled and benchmarked on an ordinary Linux box.
+ *
+ * configured through the environment:
+ *
+ * TZ_NULL_NVRAM: file standing in for the hardware TPM's NV
+ * indices. it holds the master sealing secret the sealing keys are
+ * derived from, so that data sealed in one run can be unsealed in
+ * the next, followed by the rollback-protection region behind
+ * svc_tpmnvram_*. created on first use. defaults to
+ * "tz-null-nvram.bin" in the working directory.
+ *
+ * TZ_NULL_HYPERCALL_US: microseconds every service call busy-waits
+ * before doing its work, standing in for the cost of the hypercall
+ * and the PAL's world switch. defaults to 0.
+ *
+ * as under TrustVisor, the quote signing key is generated afresh
+ * each run. there is one uTPM instance per process.
+ */
+
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <svcapi.h>
 
+#include <tomcrypt.h>
+#include <tommath.h>
+#include <nist_ctr_drbg.h>
+
+#ifndef LTC_PKCS_1_V1_5
+#define LTC_PKCS_1_V1_5 LTC_LTC_PKCS_1_V1_5
+#endif
+
+/* sizes of the NV indices TrustVisor uses, from its nv.h */
+#define NULL_NV_MSS_SIZE 20
+#define NULL_NV_ROLLBACK_SIZE 32
+
+#define NULL_NV_DEFAULT_FILE "tz-null-nvram.bin"
+
+/* provided to the uTPM, in place of TrustVisor's random.c */
+int null_rand_bytes(uint8_t *out, unsigned int *len);
+uint8_t null_rand_byte_or_die(void);
+
+static bool g_null_initd=false;
+static volatile int g_null_lock=0;
+static uint64_t g_hypercall_ns;
+static const char *g_nv_file;
+static uint8_t g_nv[NULL_NV_MSS_SIZE + NULL_NV_ROLLBACK_SIZE];
+static NIST_CTR_DRBG g_drbg;
+static utpm_master_state_t g_utpm;
+
+/* PALs may call services from several threads at once */
+static void null_lock(void)
+{
+  while (__sync_lock_test_and_set(&g_null_lock, 1)) {
+    while (g_null_lock) {
+      __asm__ __volatile__ ("pause");
+    }
+  }
+}
+
+static void null_unlock(void)
+{
+  __sync_lock_release(&g_null_lock);
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int urandom(void *out, size_t len)
+{
+  FILE *f;
+  size_t got;
+
+  if (!(f = fopen("/dev/urandom", "rb"))) {
+    return -1;
+  }
+  got = fread(out, 1, len, f);
+  fclose(f);
+  return got == len ? 0 : -1;
+}
+
+static int nv_store(void)
+{
+  FILE *f;
+  size_t put;
+
+  if (!(f = fopen(g_nv_file, "wb"))) {
+    perror(g_nv_file);
+    return -1;
+  }
+  put = fwrite(g_nv, 1, sizeof(g_nv), f);
+  if (fclose(f) || put != sizeof(g_nv)) {
+    perror(g_nv_file);
+    return -1;
+  }
+  return 0;
+}
+
+/* reads the NV stand-in, creating it with a fresh master sealing
+ * secret and a zeroed rollback region if it doesn't exist yet */
+static int nv_load(void)
+{
+  FILE *f;
+  size_t got;
+
+  if (!(f = fopen(g_nv_file, "rb"))) {
+    memset(g_nv, 0, sizeof(g_nv));
+    if (urandom(g_nv, NULL_NV_MSS_SIZE)) {
+      return -1;
+    }
+    return nv_store();
+  }
+  got = fread(g_nv, 1, sizeof(g_nv), f);
+  fclose(f);
+  if (got != sizeof(g_nv)) {
+    fprintf(stderr, "%s: expected %u bytes of NV, found %u\n",
+            g_nv_file, (unsigned)sizeof(g_nv), (unsigned)got);
+    return -1;
+  }
+  return 0;
+}
+
+/* mirrors master_prng_init() and trustvisor_long_term_secret_init()
+ * in TrustVisor's crypto_init.c */
+static int null_crypto_init(void)
+{
+  uint8_t entropy[NIST_BLOCK_SEEDLEN_BYTES];
+  uint64_t nonce = now_ns();
+  const uint8_t sealingaes[10] = {0x73, 0x65, 0x61, 0x6c, 0x69, 0x6e,
+                                  0x67, 0x61, 0x65, 0x73};
+  const uint8_t sealinghmac[11] = {0x73, 0x65, 0x61, 0x6c, 0x69, 0x6e,
+                                   0x67, 0x68, 0x6d, 0x61, 0x63};
+  uint8_t aeskey[NULL_NV_MSS_SIZE];
+  unsigned long aeskey_len = sizeof(aeskey);
+  uint8_t hmackey[NULL_NV_MSS_SIZE];
+  unsigned long hmackey_len = sizeof(hmackey);
+  rsa_key rsakey;
+  int hash_id, prng_id;
+  int rv=-1;
+
+  if (nist_ctr_initialize()
+      || urandom(entropy, sizeof(entropy))
+      || nist_ctr_drbg_instantiate(&g_drbg, entropy, sizeof(entropy),
+                                   &nonce, sizeof(nonce), NULL, 0)) {
+    fprintf(stderr, "tz null: CTR_DRBG init failed\n");
+    goto out;
+  }
+
+  if (nv_load()) {
+    goto out;
+  }
+
+  if (!ltc_mp.name) {
+    ltc_mp = ltm_desc;
+  }
+  hash_id = register_hash(&sha1_desc);
+  prng_id = register_prng(&sprng_desc);
+  if (hash_id < 0 || prng_id < 0
+      || hmac_memory(hash_id, g_nv, NULL_NV_MSS_SIZE,
+                     sealingaes, sizeof(sealingaes),
+                     aeskey, &aeskey_len)
+      || hmac_memory(hash_id, g_nv, NULL_NV_MSS_SIZE,
+                     sealinghmac, sizeof(sealinghmac),
+                     hmackey, &hmackey_len)
+      || rsa_make_key(NULL, prng_id, TPM_RSA_KEY_LEN, 65537, &rsakey)) {
+    fprintf(stderr, "tz null: key derivation failed\n");
+    goto out;
+  }
+
+  if (utpm_init_master_entropy(aeskey, hmackey, &rsakey)) {
+    goto out;
+  }
+  utpm_init_instance(&g_utpm);
+
+  rv=0;
+ out:
+  memset(entropy, 0, sizeof(entropy));
+  memset(aeskey, 0, sizeof(aeskey));
+  memset(hmackey, 0, sizeof(hmackey));
+  return rv;
+}
+
+/* entry to every service: initializes on first use, then spends the
+ * configured hypercall latency. returns with the backend locked. */
+static int null_enter(void)
+{
+  uint64_t t0 = now_ns();
+  const char *s;
+
+  null_lock();
+  if (!g_null_initd) {
+    s = getenv("TZ_NULL_HYPERCALL_US");
+    g_hypercall_ns = s ? strtoull(s, NULL, 0) * 1000 : 0;
+    s = getenv("TZ_NULL_NVRAM");
+    g_nv_file = s ? s : NULL_NV_DEFAULT_FILE;
+
+    if (null_crypto_init()) {
+      null_unlock();
+      return -1;
+    }
+    g_null_initd = true;
+    t0 = now_ns();
+  }
+
+  while (now_ns() - t0 < g_hypercall_ns) {
+    __asm__ __volatile__ ("pause");
+  }
+  return 0;
+}
+
+static void null_exit(void)
+{
+  null_unlock();
+}
+
+/* from TrustVisor's random.c. called with the backend locked */
+int null_rand_bytes(uint8_t *out, unsigned int *len)
+{
+  uint8_t entropy[NIST_BLOCK_SEEDLEN_BYTES];
+
+  if (!out || !len || *len < 1) {
+    return 1;
+  }
 
-/* from emhf's processor.h */
-static inline uint64_t rdtsc64(void)
+  if (g_drbg.reseed_counter >= NIST_CTR_DRBG_RESEED_INTERVAL) {
+    if (urandom(entropy, sizeof(entropy))
+        || nist_ctr_drbg_reseed(&g_drbg, entropy, sizeof(entropy), NULL, 0)) {
+      return 1;
+    }
+  }
+
+  return nist_ctr_drbg_generate(&g_drbg, out, *len, NULL, 0) ? 1 : 0;
+}
+
+uint8_t null_rand_byte_or_die(void)
 {
-  uint64_t rv;
+  uint8_t byte;
+  unsigned int len = sizeof(byte);
+
+  if (null_rand_bytes(&byte, &len)) {
+    abort();
+  }
+  return byte;
+}
 
-  __asm__ __volatile__ ("rdtsc" : "=A" (rv));
-  return (rv);
+/* CLOCK_MONOTONIC restarts at boot, so the epoch is the kernel's
+ * boot. its boot_id is the nonce, so that time stays comparable
+ * across processes, as it is across PALs under TrustVisor. without
+ * it the epoch is this process.
+ */
+static int null_epoch_nonce(uint64_t *nonce)
+{
+  char id[64];
+  FILE *f;
+  uint64_t n=0;
+  int digits=0;
+  char *p;
+
+  if ((f = fopen("/proc/sys/kernel/random/boot_id", "r"))) {
+    if (fgets(id, sizeof(id), f)) {
+      for (p=id; *p && digits < 16; p++) {
+        if (*p >= '0' && *p <= '9') {
+          n = (n << 4) | (*p - '0');
+        } else if (*p >= 'a' && *p <= 'f') {
+          n = (n << 4) | (*p - 'a' + 10);
+        } else {
+          continue;
+        }
+        digits++;
+      }
+    }
+    fclose(f);
+  }
+  if (digits == 16) {
+    *nonce = n;
+    return 0;
+  }
+  return urandom(nonce, sizeof(*nonce));
 }
 
+/* clock_gettime is served from the vDSO, without a system call, the
+ * counterpart of the TSC fast path of the TrustVisor backend.
+ */
 int svc_time_elapsed_us(uint64_t *epoch_nonce, /* out */
                         uint64_t *us) /* out */
 {
   static uint64_t our_epoch_nonce;
-  static uint32_t cycles_per_us;
-  static bool initd=false;
+  static volatile bool initd=false;
   int rv=0;
 
-  /* FIXME: check for constant_tsc. otherwise rdtsc is unreliable */
-
-  /* initialize epoch nonce */
   if(!initd) {
-    rv = svc_utpm_rand_block(&our_epoch_nonce, sizeof(our_epoch_nonce));
+    null_lock();
+    if (!initd) {
+      rv = null_epoch_nonce(&our_epoch_nonce);
+      initd = !rv;
+    }
+    null_unlock();
     if (rv) {
       return rv;
     }
-
-    cycles_per_us = 2000; /* FIXME - get real cpu frequency */
-
-    initd=true;
   }
 
   *epoch_nonce = our_epoch_nonce;
-  /* FIXME : technically ought to serialize with, e.g. cpuid */
-  *us = rdtsc64() / cycles_per_us;
+  *us = now_ns() / 1000;
 
   return 0;
 }
@@ -94,9 +370,23 @@ int svc_utpm_seal(TPM_PCR_INFO *pcrInfo,
                   void *out,
                   size_t *out_len)
 {
-  memcpy(out, pcrInfo, sizeof(*pcrInfo));
-  memcpy(out+sizeof(*pcrInfo), in, in_len);
-  *out_len = in_len+sizeof(*pcrInfo);
+  uint32_t outlen = 0;
+  int rv;
+
+  /* the limits hc_utpm.c places on the hypercall */
+  if (in_len > MAX_SEALDATA_LEN - SEALDATA_HEADER_LEN - 16) {
+    return -1;
+  }
+  if (null_enter()) {
+    return -1;
+  }
+  rv = utpm_seal(&g_utpm, pcrInfo, in, in_len, out, &outlen);
+  null_exit();
+
+  if (rv || outlen > MAX_SEALDATA_LEN) {
+    return -1;
+  }
+  *out_len = outlen;
   return 0;
 }
 
@@ -106,15 +396,23 @@ int svc_utpm_unseal(void *in,
                     size_t *out_len,
                     void *digestAtCreation)
 {
-  TPM_PCR_INFO *info_at_creation = (TPM_PCR_INFO*)in;
-
-  memcpy(digestAtCreation,
-         &info_at_creation->digestAtCreation,
-         sizeof(TPM_COMPOSITE_HASH));
+  uint32_t outlen = 0;
+  int rv;
 
-  *out_len = in_len-sizeof(TPM_PCR_INFO);
-  memcpy(out, in+sizeof(TPM_PCR_INFO), *out_len);
+  if (in_len > MAX_SEALDATA_LEN) {
+    return -1;
+  }
+  if (null_enter()) {
+    return -1;
+  }
+  rv = utpm_unseal(&g_utpm, in, in_len, out, &outlen,
+                   (TPM_COMPOSITE_HASH*)digestAtCreation);
+  null_exit();
 
+  if (rv) {
+    return -1;
+  }
+  *out_len = outlen;
   return 0;
 }
 
@@ -125,59 +423,161 @@ int svc_utpm_quote(TPM_NONCE *nonce, /* in */
                    uint8_t *pcrComposite,
                    size_t *pcrCompositeLen)
 {
-  *sigLen=0;
+  uint32_t siglen = *sigLen;
+  uint32_t pcrcomplen = *pcrCompositeLen;
+  int rv;
+
+  if (siglen > 5*TPM_QUOTE_SIZE) {
+    return -1;
+  }
+  if (null_enter()) {
+    return -1;
+  }
+  rv = utpm_quote(nonce, tpmsel, sig, &siglen, pcrComposite, &pcrcomplen,
+                  &g_utpm);
+  null_exit();
+
+  if (rv) {
+    return -1;
+  }
+  *sigLen = siglen;
+  *pcrCompositeLen = pcrcomplen;
   return 0;
 }
 
 int svc_utpm_pcr_extend(uint32_t idx,
                         uint8_t *meas)
 {
-  return 0;
+  TPM_DIGEST digest;
+  int rv;
+
+  if (idx >= TPM_PCR_NUM) {
+    return -1;
+  }
+  memcpy(digest.value, meas, TPM_HASH_SIZE);
+  if (null_enter()) {
+    return -1;
+  }
+  rv = utpm_extend(&digest, &g_utpm, idx);
+  null_exit();
+
+  return rv ? -1 : 0;
 }
 
 int svc_utpm_pcr_read(uint32_t idx,
                       uint8_t* val)
 {
-  memset(val, 0, 20);
+  TPM_DIGEST digest;
+  int rv;
+
+  if (idx >= TPM_PCR_NUM) {
+    return -1;
+  }
+  if (null_enter()) {
+    return -1;
+  }
+  rv = utpm_pcrread(&digest, &g_utpm, idx);
+  null_exit();
+
+  if (rv) {
+    return -1;
+  }
+  memcpy(val, digest.value, TPM_HASH_SIZE);
   return 0;
 }
 
 int svc_utpm_id_getpub(uint8_t *N,
 											 size_t *out_len)
 {
+  uint32_t len = *out_len;
+  int rv;
+
+  if (null_enter()) {
+    return -1;
+  }
+  rv = utpm_id_getpub(N, &len);
+  null_exit();
+
+  if (rv) {
+    return -1;
+  }
+  *out_len = len;
   return 0;
 }
 
 int svc_utpm_rand(void *out, /* out */
                   size_t *out_len) /* in,out */
 {
-  memset(out, 0, *out_len);
+  uint32_t len = *out_len;
+  int rv;
+
+  if (len > MAX_TPM_RAND_DATA_LEN) {
+    return -1;
+  }
+  if (null_enter()) {
+    return -1;
+  }
+  rv = utpm_rand(out, &len);
+  null_exit();
+
+  if (rv) {
+    return -1;
+  }
+  *out_len = len;
   return 0;
 }
 
+/* as in the tv backend: one call per MAX_TPM_RAND_DATA_LEN, since
+ * that is what a PAL pays under TrustVisor */
 int svc_utpm_rand_block(void *out, /* out */
                         size_t out_len) /* in */
 {
-  memset(out, 0, out_len);
+  size_t got;
+  int rv;
+
+  while (out_len > 0) {
+    got = out_len < MAX_TPM_RAND_DATA_LEN ? out_len : MAX_TPM_RAND_DATA_LEN;
+    rv = svc_utpm_rand(out, &got);
+    if (rv) {
+      return rv;
+    }
+    out = (uint8_t*)out + got;
+    out_len -= got;
+  }
   return 0;
 }
 
-/**
- * Semantics for "fake" NVRAM: Persist what is written for the life of
- * a service invocation, but do not actually persist to disk.
- *
- * TODO: Wire it up to the logic currently residing in
- * ~hyp/trustvisor/trunk/code/app/hc_utpm.c
- */
+/* with the limits hc_utpm_rand_bulk() places on it. one page at a
+ * time, as TrustVisor fills them */
+int svc_utpm_rand_bulk(void *out, /* out */
+                       size_t out_len) /* in */
+{
+  unsigned int len;
+  size_t done;
+  int rv=0;
 
-#define FAKE_NVRAM_SIZE 32
-uint8_t g_fake_nvram[FAKE_NVRAM_SIZE];
+  if (out_len == 0 || out_len > MAX_TPM_RAND_BULK_LEN
+      || (uintptr_t)out % TPM_RAND_BULK_GRANULE
+      || out_len % TPM_RAND_BULK_GRANULE) {
+    return -1;
+  }
+  if (null_enter()) {
+    return -1;
+  }
+  for (done = 0; done < out_len && !rv; done += len) {
+    len = TPM_RAND_BULK_GRANULE;
+    rv = null_rand_bytes((uint8_t*)out + done, &len);
+  }
+  null_exit();
+
+  return rv ? -1 : 0;
+}
 
 int svc_tpmnvram_getsize(size_t *size) { /* out */
   if(NULL == size) {
       return -1;
   }
-  *size = FAKE_NVRAM_SIZE;
+  *size = NULL_NV_ROLLBACK_SIZE;
 
   return 0;
 }
@@ -186,20 +586,31 @@ int svc_tpmnvram_readall(uint8_t *out) { /* out */
   if(NULL == out) {
       return -1;
   }
-
-  memcpy(out, g_fake_nvram, FAKE_NVRAM_SIZE);
+  if (null_enter()) {
+    return -1;
+  }
+  memcpy(out, g_nv + NULL_NV_MSS_SIZE, NULL_NV_ROLLBACK_SIZE);
+  null_exit();
 
   return 0;
 }
 
+/* written through to the NV file, as TrustVisor writes through to
+ * the hardware TPM */
 int svc_tpmnvram_writeall(uint8_t *in) { /* in */
+  int rv;
+
   if(NULL == in) {
       return -1;
   }
+  if (null_enter()) {
+    return -1;
+  }
+  memcpy(g_nv + NULL_NV_MSS_SIZE, in, NULL_NV_ROLLBACK_SIZE);
+  rv = nv_store();
+  null_exit();
 
-  memcpy(g_fake_nvram, in, FAKE_NVRAM_SIZE);
-  
-  return 0;                  
+  return rv;
 }
 
 /* Local Variables: */
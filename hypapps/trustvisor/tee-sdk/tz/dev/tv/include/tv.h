@@ -140,6 +140,16 @@ int tv_pal_share(const void *entry, void **start, size_t *len, size_t count);
  */
 int tv_test(void);
 
+/* Read TrustVisor's spinlock statistics.
+ *
+ * On input *count is the number of entries in stats (at most
+ * TV_LOCK_STATS_MAX); on output it is the number of locks TrustVisor
+ * tracks, which may be larger than the number of entries filled in.
+ *
+ * Returns 0 on success, nonzero on failure.
+ */
+int tv_lock_stats(struct tv_lock_stats *stats, uint32_t *count);
+
 /** 
  * Convenience function to load the linked PAL using the TZ
  * interfaces, and initialize the tzDevice, tzPalSession, and tzSvcId.
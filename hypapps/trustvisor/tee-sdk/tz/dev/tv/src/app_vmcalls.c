@@ -254,3 +254,11 @@ int tv_test(void)
   return vmcall(TV_HC_TEST,
                 0, 0, 0, 0);
 }
+
+int tv_lock_stats(struct tv_lock_stats *stats, uint32_t *count)
+{
+  return vmcall(TV_HC_LOCK_STATS,
+                (uint32_t)stats,
+                (uint32_t)count,
+                0, 0);
+}
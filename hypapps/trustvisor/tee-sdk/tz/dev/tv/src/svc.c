@@ -47,41 +47,62 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <svcapi.h>
+#include <trustvisor/trustvisor.h>
+#include "vmcalls.h"
 
-/* from emhf's processor.h */
-static inline uint64_t rdtsc64(void)
+/* rdtsc can otherwise execute ahead of the instructions before it */
+static inline uint64_t rdtsc64_ordered(void)
 {
   uint64_t rv;
 
-  __asm__ __volatile__ ("rdtsc" : "=A" (rv));
+  __asm__ __volatile__ ("lfence\n\trdtsc" : "=A" (rv) : : "memory");
   return (rv);
 }
 
+/* the time parameters are fetched from TrustVisor once, and kept in
+ * the PAL's own memory, where the guest cannot change them. with an
+ * invariant TSC, time is then read without leaving the PAL.
+ */
 int svc_time_elapsed_us(uint64_t *epoch_nonce, /* out */
                         uint64_t *us) /* out */
 {
-  static uint64_t our_epoch_nonce;
-  static uint32_t cycles_per_us;
+  static struct tv_time_info info;
+  static uint64_t last_us;
   static bool initd=false;
+  struct tv_time_info now;
+  uint64_t ticks, t;
   int rv=0;
 
-  /* FIXME: check for constant_tsc. otherwise rdtsc is unreliable */
-
-  /* initialize epoch nonce */
   if(!initd) {
-    rv = svc_utpm_rand_block(&our_epoch_nonce, sizeof(our_epoch_nonce));
+    rv = vmcall(TV_HC_TIME_INFO, (uint32_t)&info, 0, 0, 0);
     if (rv) {
       return rv;
     }
+    last_us = info.now_us;
+    initd=true;
+  }
 
-    cycles_per_us = 2000; /* FIXME - get real cpu frequency */
+  if (info.flags & TV_TIME_TSC_INVARIANT) {
+    ticks = rdtsc64_ordered() - info.tsc_base;
+    t = (ticks / info.tsc_khz) * 1000
+      + ((ticks % info.tsc_khz) * 1000) / info.tsc_khz;
+  } else {
+    rv = vmcall(TV_HC_TIME_INFO, (uint32_t)&now, 0, 0, 0);
+    if (rv) {
+      return rv;
+    }
+    t = now.now_us;
+  }
 
-    initd=true;
+  /* never step backwards, e.g. after migrating to a cpu whose TSC
+     is slightly behind */
+  if (t < last_us) {
+    t = last_us;
   }
+  last_us = t;
 
-  *epoch_nonce = our_epoch_nonce;
-  /* FIXME : technically ought to serialize with, e.g. cpuid */
-  *us = rdtsc64() / cycles_per_us;
+  *epoch_nonce = info.epoch_nonce;
+  *us = t;
 
   return 0;
 }
@@ -142,6 +142,16 @@ int svc_utpm_rand(void *out, /* out */
                 0);
 }
 
+int svc_utpm_rand_bulk(void *out, /* out */
+                       size_t out_len) /* in */
+{
+  return vmcall(TV_HC_UTPM_GENRAND_BULK,
+                (uint32_t)out,
+                (uint32_t)out_len,
+                0,
+                0);
+}
+
 int svc_tpmnvram_getsize(size_t *size) { /* out */
   return vmcall(TV_HC_TPMNVRAM_GETSIZE, /* eax */
                 (uint32_t)size, /* ecx */
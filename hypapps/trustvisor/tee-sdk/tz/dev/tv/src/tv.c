@@ -48,6 +48,7 @@
  * Author - Jim Newsome (jnewsome@no-fuss.com)
  */
 
+#define _GNU_SOURCE /* for sched_getcpu and sched_setaffinity */
 #include <stdbool.h>
 
 #include <tv.h>
@@ -60,6 +61,15 @@
 #include <stdio.h>
 
 #include <tz_platform.h>
+#include <config.h>
+
+#if HAVE_SCHED_GETCPU && HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+
+#if HAVE_WINDOWS_H
+#include <windows.h>
+#endif
 
 typedef struct tzi_session_ext_t {
   pal_fn_t pFn;
@@ -77,7 +87,10 @@ typedef struct tzi_device_ext_t {
   bool userspace_only;
 } tzi_device_ext_t;
 
-/* temporary hard-coded size of marshal buffer */
+/* temporary hard-coded size of marshal buffer. the buffers are lent
+   to the PAL for each invocation, so bulk data is better passed by
+   TZEncodeMemoryReference, which is lent the same way, than by
+   growing these. */
 #define MARSHAL_BUF_SIZE (1*PAGE_SIZE_4K)
 
 tz_return_t
@@ -91,8 +104,6 @@ TVOperationPrepareOpen(INOUT tz_device_t* psDevice,
                        OUT tzi_operation_open_ext_t** ppsOperationExt)
 {
 
-  /* XXX later we'll point to a page to be re-mapped instead of
-     copied */
   *puiBufSize = MARSHAL_BUF_SIZE;
   *ppsBufData = tz_aligned_malloc( *puiBufSize, PAGE_SIZE_4K);
   *ppsSessionExt = malloc(sizeof(tzi_session_ext_t));
@@ -178,6 +189,61 @@ static int unshare_referenced_mem(void **addrs, size_t *lens, size_t count)
   return rv;
 }
 
+/* memory shared with a PAL is only mapped for its next invocation on
+   the same cpu, so that several threads can run the PAL at once. the
+   calling thread mustn't migrate between sharing and invoking. */
+#if HAVE_SCHED_GETCPU && HAVE_SCHED_SETAFFINITY
+typedef cpu_set_t cpu_pin_t;
+
+static int pin_to_current_cpu(cpu_pin_t *saved)
+{
+  cpu_set_t set;
+  int cpu;
+
+  if (sched_getaffinity(0, sizeof(*saved), saved)) {
+    return -1;
+  }
+  if ((cpu = sched_getcpu()) < 0) {
+    return -1;
+  }
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set);
+}
+
+static void unpin(cpu_pin_t *saved)
+{
+  sched_setaffinity(0, sizeof(*saved), saved);
+}
+#elif HAVE_WINDOWS_H
+typedef DWORD_PTR cpu_pin_t;
+
+static int pin_to_current_cpu(cpu_pin_t *saved)
+{
+  *saved = SetThreadAffinityMask(GetCurrentThread(),
+                                 (DWORD_PTR)1 << GetCurrentProcessorNumber());
+  return *saved ? 0 : -1;
+}
+
+static void unpin(cpu_pin_t *saved)
+{
+  SetThreadAffinityMask(GetCurrentThread(), *saved);
+}
+#else
+typedef int cpu_pin_t;
+
+static int pin_to_current_cpu(cpu_pin_t *saved)
+{
+  (void)saved;
+  return 0;
+}
+
+static void unpin(cpu_pin_t *saved)
+{
+  (void)saved;
+}
+#endif
+
 tz_return_t
 TVOperationPerform(INOUT tz_operation_t* psOperation,
                    OUT tz_return_t* puiServiceReturn)
@@ -196,6 +262,7 @@ TVOperationPerform(INOUT tz_operation_t* psOperation,
       void **shared_addrs=NULL;
       size_t *shared_lens=NULL;
       size_t shared_count=0;
+      cpu_pin_t pin;
 
       psOutBuf = tz_aligned_malloc( MARSHAL_BUF_SIZE, PAGE_SIZE_4K);
       if(psOutBuf == NULL) {
@@ -205,6 +272,10 @@ TVOperationPerform(INOUT tz_operation_t* psOperation,
 
       TZIEncodeToDecode(psInBuf);
 
+      if (pin_to_current_cpu(&pin)) {
+        tz_aligned_free(psOutBuf);
+        return TZ_ERROR_GENERIC;
+      }
       if (share_referenced_mem(fn,
                                psOperation->sImp.psRefdSubranges,
                                psOutBuf,
@@ -213,9 +284,12 @@ TVOperationPerform(INOUT tz_operation_t* psOperation,
                                &shared_addrs,
                                &shared_lens,
                                &shared_count)) {
+        unpin(&pin);
+        tz_aligned_free(psOutBuf);
         return TZ_ERROR_GENERIC;
       }
       fn(uiCommand, psInBuf, psOutBuf, puiServiceReturn);
+      unpin(&pin);
       unshare_referenced_mem(shared_addrs, shared_lens, shared_count);
 
       TZIEncodeToDecode(psOutBuf);
@@ -247,8 +321,6 @@ TVOperationPrepareInvoke(INOUT tz_session_t* psSession,
                          OUT uint32_t *puiBufSize,
                          OUT tzi_operation_invoke_ext_t** ppsOperationExt)
 {
- /* XXX later we'll point to a page to be re-mapped instead of
-    copied */
   *puiBufSize = MARSHAL_BUF_SIZE;
   *ppsBufData = tz_aligned_malloc( *puiBufSize, PAGE_SIZE_4K);
   *ppsOperationExt = malloc(sizeof(tzi_operation_invoke_ext_t));
@@ -348,13 +420,15 @@ TVManagerDownloadService(INOUT tz_session_t* psSession,
         {.type = TV_PAL_PM_INTEGER,
          .size = sizeof(uint32_t)/sizeof(int)},
 
-        /* psInBuf. (pass a pointer to a shared region) */
-        {.type = TV_PAL_PM_INTEGER,
-         .size = sizeof(uint32_t)/sizeof(int)},
+        /* psInBuf. the marshal buffers are shared with each
+           invocation (see share_referenced_mem) rather than
+           copied. */
+        {.type = TV_PAL_PM_SHARED,
+         .size = MARSHAL_BUF_SIZE/sizeof(int)},
 
         /* psOutBuf */
-        {.type = TV_PAL_PM_INTEGER,
-         .size = sizeof(uint32_t)/sizeof(int)},
+        {.type = TV_PAL_PM_SHARED,
+         .size = MARSHAL_BUF_SIZE/sizeof(int)},
 
         /* puiRv */
         {.type = TV_PAL_PM_POINTER,
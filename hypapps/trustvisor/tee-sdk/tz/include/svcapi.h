@@ -166,6 +166,32 @@ int svc_utpm_rand(void *out, /* out */
 int svc_utpm_rand_block(void *out, /* out */
                         size_t out_len); /* in */
 
+/* Request out_len secure-random bytes in a single call into the TEE,
+ * from the same source as svc_utpm_rand_block. out and out_len must
+ * be multiples of TPM_RAND_BULK_GRANULE, and out_len at most
+ * MAX_TPM_RAND_BULK_LEN. The buffer may be partially filled on
+ * failure.
+ *
+ * out     : random bytes
+ * out_len : the number of requested bytes
+ */
+int svc_utpm_rand_bulk(void *out, /* out */
+                       size_t out_len); /* in */
+
+/* Get out_len secure-random bytes from a pool in the service's own
+ * memory, which is refilled with svc_utpm_rand_bulk
+ * SVC_RAND_POOL_SIZE bytes at a time. Much cheaper than
+ * svc_utpm_rand_block for the many small requests of, e.g., key
+ * generation. Bytes are wiped from the pool as they are handed out.
+ * Not thread-safe.
+ *
+ * out     : random bytes
+ * out_len : the number of requested bytes
+ */
+#define SVC_RAND_POOL_SIZE (4*TPM_RAND_BULK_GRANULE)
+int svc_rand_pool(void *out, /* out */
+                  size_t out_len); /* in */
+
 /* Get the size of the TrustVisor-internal Hardware TPM NVRAM space
  * dedicated to providing rollback resistance for a privileged NV
  * Multiplexor PAL (NvMuxPal).
@@ -0,0 +1,103 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* a PAL-side pool of random bytes, refilled from the TEE in bulk so
+ * that small requests don't each cost a call into the TEE */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <svcapi.h>
+
+/* [g_pool_next, SVC_RAND_POOL_SIZE) of g_pool is unused */
+static uint8_t g_pool[SVC_RAND_POOL_SIZE]
+  __attribute__ ((aligned (TPM_RAND_BULK_GRANULE)));
+static size_t g_pool_next = SVC_RAND_POOL_SIZE;
+
+int svc_rand_pool(void *out, /* out */
+                  size_t out_len) /* in */
+{
+  uint8_t *p = out;
+  size_t n;
+  int rv;
+
+  while (out_len > 0) {
+    /* whole aligned pages are filled directly, bypassing the pool */
+    if ((uintptr_t)p % TPM_RAND_BULK_GRANULE == 0
+        && out_len >= TPM_RAND_BULK_GRANULE) {
+      n = out_len - out_len % TPM_RAND_BULK_GRANULE;
+      if (n > MAX_TPM_RAND_BULK_LEN) {
+        n = MAX_TPM_RAND_BULK_LEN;
+      }
+      if ((rv = svc_utpm_rand_bulk(p, n))) {
+        return rv;
+      }
+    } else {
+      if (g_pool_next == SVC_RAND_POOL_SIZE) {
+        if ((rv = svc_utpm_rand_bulk(g_pool, SVC_RAND_POOL_SIZE))) {
+          return rv;
+        }
+        g_pool_next = 0;
+      }
+      n = SVC_RAND_POOL_SIZE - g_pool_next;
+      if (n > out_len) {
+        n = out_len;
+      }
+      memcpy(p, &g_pool[g_pool_next], n);
+      memset(&g_pool[g_pool_next], 0, n);
+      g_pool_next += n;
+    }
+    p += n;
+    out_len -= n;
+  }
+  return 0;
+}
+
+/* Local Variables: */
+/* mode:c           */
+/* indent-tabs-mode:'t */
+/* tab-width:2      */
+/* End:             */
@@ -0,0 +1,107 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* stands in for xmhf.h when building xmhf-core's TPM driver
+ * (xmhf-tpm/arch/x86) and locality manager (xmhf-tpm/tpm-interface.c)
+ * on the host, on top of tissim instead of the TPM's registers.
+ */
+
+#ifndef __XMHF_H_
+#define __XMHF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* libtpm's headers need u8 and u32 before any are included, so they
+   may come from the command line */
+#ifndef u8
+typedef uint8_t u8;
+#endif
+typedef uint16_t u16;
+#ifndef u32
+typedef uint32_t u32;
+#endif
+typedef uint64_t u64;
+
+#include <tpm.h>
+#include <arch/x86/_spinlock.h>
+#include <xmhf-tpm.h>
+
+#include "../tissim.h"
+
+#define PAGE_SIZE_4K (1 << 12)
+
+#define readb(addr) tissim_readb(addr)
+#define writeb(addr, val) tissim_writeb(addr, val)
+#define readl(addr) tissim_readl(addr)
+#define writel(addr, val) tissim_writel(addr, val)
+
+#define CPU_VENDOR_INTEL 0xAB
+#define CPU_VENDOR_AMD 0xCD
+#define get_cpu_vendor_or_die() CPU_VENDOR_AMD
+
+#define spin_lock(lock) ((void)ticket_spin_lock(lock))
+#define spin_unlock(lock) ticket_spin_unlock(lock)
+#define rdtsc64() tissim_now()
+#define xmhf_baseplatform_arch_x86_deadline(usecs) \
+  (tissim_now() + (u64)(usecs) * TISSIM_MHZ)
+/* the simulated TSC only moves when something charges it, so each look
+   at it costs a pause's worth, or a spin on it would never end */
+#define xmhf_baseplatform_arch_x86_deadline_passed(deadline) \
+  (tissim_delay(TISSIM_PAUSE_CYCLES), tissim_now() >= (deadline))
+
+#define HALT_ON_ERRORCOND(c) do {                               \
+    if (!(c)) {                                                 \
+      printf("%s:%d: HALT_ON_ERRORCOND(%s)\n", __FILE__, __LINE__, #c); \
+      abort();                                                  \
+    }                                                           \
+  } while (0)
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <aesaccel.h>
+
+#define B AESACCEL_BLOCK_LENGTH
+
+/* FIPS 197 appendix C */
+typedef struct {
+  int bits;
+  const char *key;
+  const char *pt;
+  const char *ct;
+} aes_vector_t;
+
+static const aes_vector_t vectors[] = {
+  { 128,
+    "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f",
+    "\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xaa\xbb\xcc\xdd\xee\xff",
+    "\x69\xc4\xe0\xd8\x6a\x7b\x04\x30\xd8\xcd\xb7\x80\x70\xb4\xc5\x5a" },
+  { 192,
+    "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+    "\x10\x11\x12\x13\x14\x15\x16\x17",
+    "\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xaa\xbb\xcc\xdd\xee\xff",
+    "\xdd\xa9\x7c\xa4\x86\x4c\xdf\xe0\x6e\xaf\x70\xa0\xec\x0d\x71\x91" },
+  { 256,
+    "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+    "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f",
+    "\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xaa\xbb\xcc\xdd\xee\xff",
+    "\x8e\xa2\xb7\xca\x51\x67\x45\xbf\xea\xfc\x49\x90\x4b\x49\x60\x89" },
+};
+#define NUM_VECTORS (sizeof(vectors)/sizeof(vectors[0]))
+
+/* NIST SP 800-38A appendix F */
+static const uint8_t sp800_38a_pt[4*B] =
+  "\x6b\xc1\xbe\xe2\x2e\x40\x9f\x96\xe9\x3d\x7e\x11\x73\x93\x17\x2a"
+  "\xae\x2d\x8a\x57\x1e\x03\xac\x9c\x9e\xb7\x6f\xac\x45\xaf\x8e\x51"
+  "\x30\xc8\x1c\x46\xa3\x5c\xe4\x11\xe5\xfb\xc1\x19\x1a\x0a\x52\xef"
+  "\xf6\x9f\x24\x45\xdf\x4f\x9b\x17\xad\x2b\x41\x7b\xe6\x6c\x37\x10";
+static const uint8_t sp800_38a_key128[B] =
+  "\x2b\x7e\x15\x16\x28\xae\xd2\xa6\xab\xf7\x15\x88\x09\xcf\x4f\x3c";
+static const uint8_t sp800_38a_key256[2*B] =
+  "\x60\x3d\xeb\x10\x15\xca\x71\xbe\x2b\x73\xae\xf0\x85\x7d\x77\x81"
+  "\x1f\x35\x2c\x07\x3b\x61\x08\xd7\x2d\x98\x10\xa3\x09\x14\xdf\xf4";
+/* F.1.5 ECB-AES256.Encrypt */
+static const uint8_t ecb256_ct[4*B] =
+  "\xf3\xee\xd1\xbd\xb5\xd2\xa0\x3c\x06\x4b\x5a\x7e\x3d\xb1\x81\xf8"
+  "\x59\x1c\xcb\x10\xd4\x10\xed\x26\xdc\x5b\xa7\x4a\x31\x36\x28\x70"
+  "\xb6\xed\x21\xb9\x9c\xa6\xf4\xf9\xf1\x53\xe7\xb1\xbe\xaf\xed\x1d"
+  "\x23\x30\x4b\x7a\x39\xf9\xf3\xff\x06\x7d\x8d\x8f\x9e\x24\xec\xc7";
+/* F.2.1 CBC-AES128.Encrypt */
+static const uint8_t cbc128_iv[B] =
+  "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f";
+static const uint8_t cbc128_ct[4*B] =
+  "\x76\x49\xab\xac\x81\x19\xb2\x46\xce\xe9\x8e\x9b\x12\xe9\x19\x7d"
+  "\x50\x86\xcb\x9b\x50\x72\x19\xee\x95\xdb\x11\x3a\x91\x76\x78\xb2"
+  "\x73\xbe\xd6\xb8\xe3\xc1\x74\x3b\x71\x16\xe6\x9e\x22\x22\x95\x16"
+  "\x3f\xf1\xca\xa1\x68\x1f\xac\x09\x12\x0e\xca\x30\x75\x86\xe1\xa7";
+/* F.5.1 CTR-AES128.Encrypt. the first counter block is f0..ff, so
+   aesaccel_ctr_generate, which increments first, starts from f0..fe */
+static const uint8_t ctr128_ctr[B] =
+  "\xf0\xf1\xf2\xf3\xf4\xf5\xf6\xf7\xf8\xf9\xfa\xfb\xfc\xfd\xfe\xfe";
+static const uint8_t ctr128_ct[4*B] =
+  "\x87\x4d\x61\x91\xb6\x20\xe3\x26\x1b\xef\x68\x64\x99\x0d\xb6\xce"
+  "\x98\x06\xf6\x6b\x79\x70\xfd\xff\x86\x17\x18\x7b\xb9\xff\xfd\xff"
+  "\x5a\xe4\xdf\x3e\xdb\xd5\xd3\x5e\x5b\x4f\x09\x02\x0d\xb0\x3e\xab"
+  "\x1e\x03\x1d\xda\x2f\xbe\x03\xd1\x79\x21\x70\xa0\xf3\x00\x9c\xee";
+
+static uint32_t detected;
+static uint8_t data[64*1024];
+
+/* every subset of the detected features, constant-time C first */
+#define FOR_EACH_FEATURES(f)                            \
+  for (f = 0; f <= detected; f++)                       \
+    if ((f & detected) == f && aesaccel_set_features(f) == f)
+
+void setUp(void)
+{
+  size_t i;
+
+  detected = aesaccel_init(0);
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (uint8_t)(i * 131 + (i >> 9));
+  }
+}
+
+void tearDown(void)
+{
+}
+
+void test_known_answers(void)
+{
+  aesaccel_key_t key;
+  uint8_t out[B];
+  uint32_t f;
+  size_t i;
+
+  FOR_EACH_FEATURES(f) {
+    for (i = 0; i < NUM_VECTORS; i++) {
+      TEST_ASSERT_EQUAL_INT(0, aesaccel_setkey(&key, (const uint8_t*)vectors[i].key, vectors[i].bits));
+      aesaccel_encrypt(&key, (const uint8_t*)vectors[i].pt, out, 1);
+      TEST_ASSERT_EQUAL_MEMORY(vectors[i].ct, out, B);
+      aesaccel_decrypt(&key, out, out, 1);
+      TEST_ASSERT_EQUAL_MEMORY(vectors[i].pt, out, B);
+    }
+  }
+  TEST_ASSERT_TRUE(aesaccel_setkey(&key, (const uint8_t*)vectors[0].key, 64) != 0);
+}
+
+void test_modes(void)
+{
+  aesaccel_key_t key;
+  uint8_t out[4*B], iv[B];
+  uint32_t f;
+
+  FOR_EACH_FEATURES(f) {
+    aesaccel_setkey(&key, sp800_38a_key256, 256);
+    aesaccel_encrypt(&key, sp800_38a_pt, out, 4);
+    TEST_ASSERT_EQUAL_MEMORY(ecb256_ct, out, sizeof(out));
+    aesaccel_decrypt(&key, out, out, 4);
+    TEST_ASSERT_EQUAL_MEMORY(sp800_38a_pt, out, sizeof(out));
+
+    /* CBC in two pieces, to check the iv is carried over */
+    aesaccel_setkey(&key, sp800_38a_key128, 128);
+    memcpy(iv, cbc128_iv, B);
+    aesaccel_cbc_encrypt(&key, iv, sp800_38a_pt, out, 1);
+    aesaccel_cbc_encrypt(&key, iv, sp800_38a_pt + B, out + B, 3);
+    TEST_ASSERT_EQUAL_MEMORY(cbc128_ct, out, sizeof(out));
+    TEST_ASSERT_EQUAL_MEMORY(cbc128_ct + 3*B, iv, B);
+    memcpy(iv, cbc128_iv, B);
+    aesaccel_cbc_decrypt(&key, iv, out, out, 3);
+    aesaccel_cbc_decrypt(&key, iv, out + 3*B, out + 3*B, 1);
+    TEST_ASSERT_EQUAL_MEMORY(sp800_38a_pt, out, sizeof(out));
+
+    {
+      uint8_t ctr[B];
+      size_t i;
+
+      memcpy(ctr, ctr128_ctr, B);
+      aesaccel_ctr_generate(&key, ctr, out, 4);
+      for (i = 0; i < sizeof(out); i++) {
+        out[i] ^= sp800_38a_pt[i];
+      }
+      TEST_ASSERT_EQUAL_MEMORY(ctr128_ct, out, sizeof(out));
+      /* the counter carried, and ends at the last one used */
+      TEST_ASSERT_EQUAL_HEX8(0xff, ctr[14]);
+      TEST_ASSERT_EQUAL_HEX8(0x02, ctr[15]);
+    }
+  }
+}
+
+/* the implementations agree on odd lengths, in-place buffers and every
+   key size */
+void test_consistency(void)
+{
+  static uint8_t ref[5][17*B], out[17*B];
+  static const int bits[] = { 128, 192, 256 };
+  aesaccel_key_t key;
+  uint8_t iv[B];
+  uint32_t f;
+  size_t k, n;
+
+  for (k = 0; k < 3; k++) {
+    aesaccel_setkey(&key, data + 7*k, bits[k]);
+    for (n = 1; n <= 17; n += 2) {
+      aesaccel_set_features(0);
+      aesaccel_encrypt(&key, data + 3, ref[0], n);
+      aesaccel_decrypt(&key, data + 3, ref[1], n);
+      memcpy(iv, data + 1000, B);
+      aesaccel_cbc_encrypt(&key, iv, data + 3, ref[2], n);
+      memcpy(iv, data + 1000, B);
+      aesaccel_cbc_decrypt(&key, iv, data + 3, ref[3], n);
+      memcpy(iv, data + 2000, B);
+      aesaccel_ctr_generate(&key, iv, ref[4], n);
+
+      FOR_EACH_FEATURES(f) {
+        memcpy(out, data + 3, n*B);
+        aesaccel_encrypt(&key, out, out, n);
+        TEST_ASSERT_EQUAL_MEMORY(ref[0], out, n*B);
+        memcpy(out, data + 3, n*B);
+        aesaccel_decrypt(&key, out, out, n);
+        TEST_ASSERT_EQUAL_MEMORY(ref[1], out, n*B);
+        memcpy(out, data + 3, n*B);
+        memcpy(iv, data + 1000, B);
+        aesaccel_cbc_encrypt(&key, iv, out, out, n);
+        TEST_ASSERT_EQUAL_MEMORY(ref[2], out, n*B);
+        memcpy(out, data + 3, n*B);
+        memcpy(iv, data + 1000, B);
+        aesaccel_cbc_decrypt(&key, iv, out, out, n);
+        TEST_ASSERT_EQUAL_MEMORY(ref[3], out, n*B);
+        memcpy(iv, data + 2000, B);
+        aesaccel_ctr_generate(&key, iv, out, n);
+        TEST_ASSERT_EQUAL_MEMORY(ref[4], out, n*B);
+      }
+    }
+  }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* not a test as such: throughput of each implementation with an
+   AES-256 key (as used by the DRBG) in each mode, 64K at a time. */
+void test_benchmark(void)
+{
+  static uint8_t out[sizeof(data)];
+  const size_t nblocks = sizeof(data) / B;
+  aesaccel_key_t key;
+  uint8_t iv[B] = { 0 };
+  uint32_t f;
+
+  aesaccel_setkey(&key, data, 256);
+  printf("\naesaccel AES-256 throughput, MB/s (aesni=%x)\n",
+         AESACCEL_FEAT_AESNI);
+  FOR_EACH_FEATURES(f) {
+    /* the C code is much slower; keep its runs short */
+    int iters = f ? 512 : 8;
+    double mb = iters * sizeof(data) / (1024.0 * 1024.0);
+    double t0, t1, t2, t3, t4;
+    int it;
+
+    t0 = now();
+    for (it = 0; it < iters; it++) {
+      aesaccel_encrypt(&key, data, out, nblocks);
+    }
+    t1 = now();
+    for (it = 0; it < iters; it++) {
+      aesaccel_cbc_encrypt(&key, iv, data, out, nblocks);
+    }
+    t2 = now();
+    for (it = 0; it < iters; it++) {
+      aesaccel_cbc_decrypt(&key, iv, data, out, nblocks);
+    }
+    t3 = now();
+    for (it = 0; it < iters; it++) {
+      aesaccel_ctr_generate(&key, iv, out, nblocks);
+    }
+    t4 = now();
+
+    printf("  features %x: ecb %7.1f, cbc enc %7.1f, cbc dec %7.1f, ctr %7.1f\n",
+           f, mb / (t1 - t0), mb / (t2 - t1), mb / (t3 - t2), mb / (t4 - t3));
+  }
+}
@@ -54,11 +54,15 @@
 #include <stddef.h>
 #include <string.h>
 #include <nist_ctr_drbg.h>
+#include <aesaccel.h>
 
 
 /* standard unity constructions */
 void setUp(void)
 {
+  /* run the known answer tests on the fastest AES the cpu has;
+     test_aesaccel checks it against the portable code */
+  aesaccel_init(0);
 }
 
 void tearDown(void)
@@ -0,0 +1,260 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <hashaccel.h>
+
+/* FIPS 180-2 appendix A/B examples, and the long messages from the
+   NIST SHS validation suite */
+typedef struct {
+  const char *msg;
+  size_t repeat;
+  const char *sha1;
+  const char *sha256;
+} shs_vector_t;
+
+static const shs_vector_t vectors[] = {
+  { "", 1,
+    "\xda\x39\xa3\xee\x5e\x6b\x4b\x0d\x32\x55\xbf\xef\x95\x60\x18\x90\xaf\xd8\x07\x09",
+    "\xe3\xb0\xc4\x42\x98\xfc\x1c\x14\x9a\xfb\xf4\xc8\x99\x6f\xb9\x24"
+    "\x27\xae\x41\xe4\x64\x9b\x93\x4c\xa4\x95\x99\x1b\x78\x52\xb8\x55" },
+  { "abc", 1,
+    "\xa9\x99\x3e\x36\x47\x06\x81\x6a\xba\x3e\x25\x71\x78\x50\xc2\x6c\x9c\xd0\xd8\x9d",
+    "\xba\x78\x16\xbf\x8f\x01\xcf\xea\x41\x41\x40\xde\x5d\xae\x22\x23"
+    "\xb0\x03\x61\xa3\x96\x17\x7a\x9c\xb4\x10\xff\x61\xf2\x00\x15\xad" },
+  { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+    "\x84\x98\x3e\x44\x1c\x3b\xd2\x6e\xba\xae\x4a\xa1\xf9\x51\x29\xe5\xe5\x46\x70\xf1",
+    "\x24\x8d\x6a\x61\xd2\x06\x38\xb8\xe5\xc0\x26\x93\x0c\x3e\x60\x39"
+    "\xa3\x3c\xe4\x59\x64\xff\x21\x67\xf6\xec\xed\xd4\x19\xdb\x06\xc1" },
+  { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+    "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 1,
+    "\xa4\x9b\x24\x46\xa0\x2c\x64\x5b\xf4\x19\xf9\x95\xb6\x70\x91\x25\x3a\x04\xa2\x59",
+    "\xcf\x5b\x16\xa7\x78\xaf\x83\x80\x03\x6c\xe5\x9e\x7b\x04\x92\x37"
+    "\x0b\x24\x9b\x11\xe8\xf0\x7a\x51\xaf\xac\x45\x03\x7a\xfe\xe9\xd1" },
+  { "a", 1000000,
+    "\x34\xaa\x97\x3c\xd4\xc4\xda\xa4\xf6\x1e\xeb\x2b\xdb\xad\x27\x31\x65\x34\x01\x6f",
+    "\xcd\xc7\x6e\x5c\x99\x14\xfb\x92\x81\xa1\xc7\xe2\x84\xd7\x3e\x67"
+    "\xf1\x80\x9a\x48\xa4\x97\x20\x0e\x04\x6d\x39\xcc\xc7\x11\x2c\xd0" },
+};
+#define NUM_VECTORS (sizeof(vectors)/sizeof(vectors[0]))
+
+static const hashaccel_alg_t algs[] = { HASHACCEL_SHA1, HASHACCEL_SHA256 };
+
+static uint32_t detected;
+static uint8_t data[64*4096];
+
+static const uint8_t* expected(const shs_vector_t *v, hashaccel_alg_t alg)
+{
+  return (const uint8_t*)((alg == HASHACCEL_SHA1) ? v->sha1 : v->sha256);
+}
+
+/* every subset of the detected features, portable C first */
+#define FOR_EACH_FEATURES(f)                            \
+  for (f = 0; f <= detected; f++)                       \
+    if ((f & detected) == f && hashaccel_set_features(f) == f)
+
+void setUp(void)
+{
+  size_t i;
+
+  detected = hashaccel_init(0);
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (uint8_t)(i * 131 + (i >> 9));
+  }
+}
+
+void tearDown(void)
+{
+}
+
+void test_vectors(void)
+{
+  uint32_t f;
+  size_t i, a, r;
+
+  FOR_EACH_FEATURES(f) {
+    for (a = 0; a < 2; a++) {
+      for (i = 0; i < NUM_VECTORS; i++) {
+        hashaccel_ctx_t ctx;
+        uint8_t md[HASHACCEL_MAX_DIGEST_LENGTH];
+        size_t dlen = hashaccel_digest_length(algs[a]);
+
+        hashaccel_begin(&ctx, algs[a]);
+        for (r = 0; r < vectors[i].repeat; r++) {
+          hashaccel_update(&ctx, (const uint8_t*)vectors[i].msg, strlen(vectors[i].msg));
+        }
+        hashaccel_finish(&ctx, md);
+        TEST_ASSERT_EQUAL_MEMORY(expected(&vectors[i], algs[a]), md, dlen);
+
+        if (vectors[i].repeat == 1) {
+          hashaccel_digest(algs[a], (const uint8_t*)vectors[i].msg, strlen(vectors[i].msg), md);
+          TEST_ASSERT_EQUAL_MEMORY(expected(&vectors[i], algs[a]), md, dlen);
+        }
+      }
+    }
+  }
+}
+
+/* split updates and unaligned buffers give the same digests */
+void test_update_split(void)
+{
+  uint32_t f;
+  size_t a, len, split;
+
+  for (a = 0; a < 2; a++) {
+    for (len = 0; len < 300; len += 7) {
+      uint8_t ref[HASHACCEL_MAX_DIGEST_LENGTH];
+      size_t dlen = hashaccel_digest_length(algs[a]);
+
+      hashaccel_set_features(0);
+      hashaccel_digest(algs[a], data + 1, len, ref);
+
+      FOR_EACH_FEATURES(f) {
+        for (split = 0; split <= len; split += 13) {
+          hashaccel_ctx_t ctx;
+          uint8_t md[HASHACCEL_MAX_DIGEST_LENGTH];
+
+          hashaccel_begin(&ctx, algs[a]);
+          hashaccel_update(&ctx, data + 1, split);
+          hashaccel_update(&ctx, data + 1 + split, len - split);
+          hashaccel_finish(&ctx, md);
+          TEST_ASSERT_EQUAL_MEMORY(ref, md, dlen);
+        }
+      }
+    }
+  }
+}
+
+/* multi-buffer digests match single-buffer ones, including for
+   buffers of different lengths and more buffers than lanes */
+void test_multi_buffer(void)
+{
+  enum { N = 19 };
+  const uint8_t *in[N];
+  size_t len[N];
+  uint8_t ref[N * HASHACCEL_MAX_DIGEST_LENGTH];
+  uint8_t md[N * HASHACCEL_MAX_DIGEST_LENGTH];
+  uint32_t f;
+  size_t a, i, n;
+
+  for (i = 0; i < N; i++) {
+    in[i] = data + i * 4099;
+    len[i] = (i % 3 == 0) ? 4096 : (i * 61) % 700;
+  }
+
+  for (a = 0; a < 2; a++) {
+    size_t dlen = hashaccel_digest_length(algs[a]);
+
+    hashaccel_set_features(0);
+    for (i = 0; i < N; i++) {
+      hashaccel_digest(algs[a], in[i], len[i], ref + i * dlen);
+    }
+
+    FOR_EACH_FEATURES(f) {
+      for (n = 1; n <= N; n += 3) {
+        memset(md, 0, sizeof(md));
+        hashaccel_digest_mb(algs[a], in, len, n, md);
+        TEST_ASSERT_EQUAL_MEMORY(ref, md, n * dlen);
+      }
+    }
+  }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* not a test as such: throughput of each implementation, hashing 4K
+   pages one at a time and 64 at a time. */
+void test_benchmark(void)
+{
+  const int iters = 32;
+  const uint8_t *in[64];
+  size_t len[64];
+  uint8_t md[64 * HASHACCEL_MAX_DIGEST_LENGTH];
+  double mb = iters * sizeof(data) / (1024.0 * 1024.0);
+  uint32_t f;
+  size_t a, i;
+  int it;
+
+  for (i = 0; i < 64; i++) {
+    in[i] = data + i * 4096;
+    len[i] = 4096;
+  }
+
+  printf("\nhashaccel throughput, MB/s (ssse3=%x avx2=%x shani=%x)\n",
+         HASHACCEL_FEAT_SSSE3, HASHACCEL_FEAT_AVX2, HASHACCEL_FEAT_SHANI);
+  FOR_EACH_FEATURES(f) {
+    for (a = 0; a < 2; a++) {
+      double t0, t1, t2;
+
+      t0 = now();
+      for (it = 0; it < iters; it++) {
+        for (i = 0; i < 64; i++) {
+          hashaccel_digest(algs[a], in[i], len[i], md);
+        }
+      }
+      t1 = now();
+      for (it = 0; it < iters; it++) {
+        hashaccel_digest_mb(algs[a], in, len, 64, md);
+      }
+      t2 = now();
+
+      printf("  features %x %-6s: single %7.1f, multi-buffer %7.1f\n",
+             f, (algs[a] == HASHACCEL_SHA1) ? "sha1" : "sha256",
+             mb / (t1 - t0), mb / (t2 - t1));
+    }
+  }
+}
@@ -0,0 +1,261 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <hpt.h>
+#include <hptw.h>
+
+/* synthetic page tables of each type, for checking the per-type
+   walks in hptw against a walk through the generic primitives, and
+   timing the two. "physical" addresses of page maps are offsets into
+   one arena, as in test_lend.c. */
+
+#define PAGE_SIZE_4K (1u << 12)
+#define ARENA_SIZE (8u << 20)
+
+#define VA_BASE 0x20000000ull
+#define PA_BASE 0x40000000ull
+#define TABLE_SIZE (64u << 20)
+#define WALKS (1u << 20)
+
+static const hpt_type_t types[] = {
+  HPT_TYPE_NORM, HPT_TYPE_PAE, HPT_TYPE_LONG, HPT_TYPE_EPT
+};
+static const char *type_names[] = { "norm", "pae", "long", "ept" };
+
+static uint8_t *arena;
+static size_t arena_used;
+
+static void* arena_gzp(void *self, size_t alignment, size_t sz)
+{
+  void *rv;
+  (void)self;
+  (void)alignment;
+  (void)sz;
+  TEST_ASSERT_TRUE(arena_used + HPT_PM_SIZE <= ARENA_SIZE);
+  rv = arena + arena_used;
+  arena_used += HPT_PM_SIZE;
+  memset(rv, 0, HPT_PM_SIZE);
+  return rv;
+}
+
+static hpt_pa_t arena_ptr2pa(void *self, void *ptr)
+{
+  (void)self;
+  return (uint8_t *)ptr - arena;
+}
+
+static void* arena_pa2ptr(void *self, hpt_pa_t pa, size_t sz,
+                          hpt_prot_t access_type, hptw_cpl_t cpl,
+                          size_t *avail_sz)
+{
+  (void)self;
+  (void)access_type;
+  (void)cpl;
+  *avail_sz = sz;
+  return arena + pa;
+}
+
+/* a table of type t mapping TABLE_SIZE from VA_BASE with 4K pages,
+   every 8th of them read-only and every 16th not user-accessible */
+static void ctx_init(hptw_ctx_t *ctx, hpt_type_t t)
+{
+  size_t off;
+
+  arena_used = 0;
+  *ctx = (hptw_ctx_t) {
+    .gzp = arena_gzp,
+    .pa2ptr = arena_pa2ptr,
+    .ptr2pa = arena_ptr2pa,
+    .t = t,
+  };
+  ctx->root_pa = arena_ptr2pa(ctx, arena_gzp(ctx, HPT_PM_SIZE, HPT_PM_SIZE));
+
+  for (off = 0; off < TABLE_SIZE; off += PAGE_SIZE_4K) {
+    hpt_pmeo_t pmeo = { .pme = 0, .t = t, .lvl = 1 };
+    size_t page = off / PAGE_SIZE_4K;
+
+    hpt_pmeo_set_address(&pmeo, PA_BASE + off);
+    hpt_pmeo_setprot(&pmeo, (page % 8 == 7) ? HPT_PROTS_RX : HPT_PROTS_RWX);
+    hpt_pmeo_setuser(&pmeo, t == HPT_TYPE_EPT || page % 16 != 15);
+    TEST_ASSERT_EQUAL_INT(0, hptw_insert_pmeo_alloc(ctx, &pmeo, VA_BASE + off));
+  }
+}
+
+/* the walk hptw did before it was specialized by type: from the
+   root, one hptw_next_lvl and one generic entry lookup per level */
+static hpt_prot_t generic_walk(hptw_ctx_t *ctx, hpt_va_t va,
+                               hpt_pa_t *pa, bool *user)
+{
+  hpt_prot_t prots = HPT_PROTS_RWX;
+  hpt_pmo_t pmo;
+  hpt_pmeo_t pmeo;
+  size_t avail;
+
+  pmo = (hpt_pmo_t) {
+    .t = ctx->t,
+    .lvl = hpt_root_lvl(ctx->t),
+  };
+  pmo.pm = ctx->pa2ptr(ctx, ctx->root_pa, hpt_pm_size(pmo.t, pmo.lvl),
+                       HPT_PROTS_RW, HPTW_CPL0, &avail);
+  *user = true;
+  do {
+    hpt_pm_get_pmeo_by_va(&pmeo, &pmo, va);
+    prots &= hpt_pmeo_getprot(&pmeo);
+    *user = *user && hpt_pmeo_getuser(&pmeo);
+  } while (hptw_next_lvl(ctx, &pmo, va));
+
+  *pa = hpt_pmeo_is_present(&pmeo) ? hpt_pmeo_va_to_pa(&pmeo, va) : 0;
+  return prots;
+}
+
+/* addresses spread over the table and a little beyond it, so that
+   some walks end on a missing entry */
+static hpt_va_t walk_va(size_t i)
+{
+  return VA_BASE + ((i * 2654435761u) % (TABLE_SIZE + TABLE_SIZE / 8));
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void setUp(void)
+{
+  if (!arena) {
+    arena = aligned_alloc(HPT_PM_SIZE, ARENA_SIZE);
+    TEST_ASSERT_TRUE(arena != NULL);
+  }
+}
+
+void tearDown(void)
+{
+}
+
+/* the per-type walks find the same translations and protections as
+   the generic one */
+void test_walk_matches_generic(void)
+{
+  size_t i, j;
+
+  for (j = 0; j < sizeof(types)/sizeof(types[0]); j++) {
+    hptw_ctx_t ctx;
+
+    ctx_init(&ctx, types[j]);
+    for (i = 0; i < 4096; i++) {
+      hpt_va_t va = walk_va(i);
+      hpt_pa_t pa;
+      hpt_prot_t prots;
+      bool user, gen_user;
+      size_t avail;
+      void *ptr;
+
+      prots = generic_walk(&ctx, va, &pa, &gen_user);
+      TEST_ASSERT_TRUE(hptw_get_effective_prots(&ctx, va, &user) == prots);
+      TEST_ASSERT_TRUE(user == gen_user);
+
+      if ((prots & HPT_PROTS_RW) == HPT_PROTS_RW && user) {
+        ptr = hptw_checked_access_va(&ctx, HPT_PROTS_RW, HPTW_CPL3, va, 8, &avail);
+        TEST_ASSERT_TRUE(ptr == arena + pa);
+        TEST_ASSERT_TRUE(hptw_va_to_pa(&ctx, va) == pa);
+      } else if (i < 64) {
+        /* refusals are logged, so only check a few */
+        ptr = hptw_checked_access_va(&ctx, HPT_PROTS_RW, HPTW_CPL3, va, 8, &avail);
+        TEST_ASSERT_TRUE(ptr == NULL);
+      }
+    }
+  }
+}
+
+/* not a test as such: ns per walk for each table type, through the
+   generic primitives and through the per-type walks */
+void test_benchmark(void)
+{
+  size_t i, j;
+
+  printf("\nwalk time, ns/walk: generic walk, hptw_get_effective_prots, hptw_va_to_pa\n");
+  for (j = 0; j < sizeof(types)/sizeof(types[0]); j++) {
+    hptw_ctx_t ctx;
+    volatile hpt_pa_t sink = 0;
+    double t[3], t0;
+
+    ctx_init(&ctx, types[j]);
+
+    t0 = now();
+    for (i = 0; i < WALKS; i++) {
+      hpt_pa_t pa;
+      bool user;
+      sink += generic_walk(&ctx, walk_va(i), &pa, &user) + pa;
+    }
+    t[0] = (now() - t0) * 1e9 / WALKS;
+
+    t0 = now();
+    for (i = 0; i < WALKS; i++) {
+      bool user;
+      sink += hptw_get_effective_prots(&ctx, walk_va(i), &user);
+    }
+    t[1] = (now() - t0) * 1e9 / WALKS;
+
+    /* only addresses in the table; va_to_pa wants a page */
+    t0 = now();
+    for (i = 0; i < WALKS; i++) {
+      sink += hptw_va_to_pa(&ctx, VA_BASE + walk_va(i) % TABLE_SIZE);
+    }
+    t[2] = (now() - t0) * 1e9 / WALKS;
+
+    printf("  %-4s: %8.1f %8.1f %8.1f\n", type_names[j], t[0], t[1], t[2]);
+  }
+}
@@ -0,0 +1,471 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <hpt.h>
+#include <hptw.h>
+
+/* synthetic page tables for exercising the range walks that
+   scode_lend_section and scode_return_section do (see pt.c), and for
+   comparing them with the per-page walks they replaced. "physical"
+   addresses of page maps are offsets into one arena, so that 32-bit
+   NORM entries can hold them. lent frames are never touched, so
+   guest-physical and system-physical addresses needn't be backed. */
+
+#define PAGE_SIZE_4K (1u << 12)
+#define ARENA_SIZE (32u << 20)
+
+#define GVA_BASE 0x20000000ull
+#define GPA_BASE 0x40000000ull
+#define SPA_BASE 0x80000000ull
+#define TABLE_SIZE (64u << 20)  /* mapped around each section */
+
+static uint8_t *arena;
+static size_t arena_used;
+
+static void* arena_gzp(void *self, size_t alignment, size_t sz)
+{
+  void *rv;
+  (void)self;
+  (void)alignment;
+  (void)sz;
+  TEST_ASSERT_TRUE(arena_used + HPT_PM_SIZE <= ARENA_SIZE);
+  rv = arena + arena_used;
+  arena_used += HPT_PM_SIZE;
+  memset(rv, 0, HPT_PM_SIZE);
+  return rv;
+}
+
+static hpt_pa_t arena_ptr2pa(void *self, void *ptr)
+{
+  (void)self;
+  return (uint8_t *)ptr - arena;
+}
+
+static void* arena_pa2ptr(void *self, hpt_pa_t pa, size_t sz,
+                          hpt_prot_t access_type, hptw_cpl_t cpl,
+                          size_t *avail_sz)
+{
+  (void)self;
+  (void)access_type;
+  (void)cpl;
+  *avail_sz = sz;
+  return arena + pa;
+}
+
+static void ctx_init(hptw_ctx_t *ctx, hpt_type_t t)
+{
+  *ctx = (hptw_ctx_t) {
+    .gzp = arena_gzp,
+    .pa2ptr = arena_pa2ptr,
+    .ptr2pa = arena_ptr2pa,
+    .t = t,
+  };
+  ctx->root_pa = arena_ptr2pa(ctx, arena_gzp(ctx, HPT_PM_SIZE, HPT_PM_SIZE));
+}
+
+static int ps_bit(hpt_type_t t)
+{
+  switch (t) {
+  case HPT_TYPE_NORM: return HPT_NORM_PS_L2_MP_BIT;
+  case HPT_TYPE_PAE: return HPT_PAE_PS_L2_MP_BIT;
+  case HPT_TYPE_LONG: return HPT_LONG_PS_L32_MP_BIT;
+  default: return HPT_EPT_PS_L32_MP_BIT;
+  }
+}
+
+/* maps [va, va+size) to [pa, pa+size), user-accessible with all
+   access, using pages of level lvl */
+static void map_range(hptw_ctx_t *ctx, hpt_va_t va, hpt_pa_t pa,
+                      size_t size, int lvl)
+{
+  hpt_pmeo_t pmeo = { .pme = 0, .t = ctx->t, .lvl = lvl };
+  size_t page_sz, off;
+
+  if (lvl > 1) {
+    pmeo.pme = BR64_SET_BIT(0, ps_bit(ctx->t), 1);
+  }
+  page_sz = hpt_pmeo_page_size(&pmeo);
+  for (off = 0; off < size; off += page_sz) {
+    hpt_pmeo_set_address(&pmeo, pa + off);
+    hpt_pmeo_setprot(&pmeo, HPT_PROTS_RWX);
+    hpt_pmeo_setuser(&pmeo, true);
+    TEST_ASSERT_EQUAL_INT(0, hptw_insert_pmeo_alloc(ctx, &pmeo, va + off));
+  }
+}
+
+typedef struct {
+  hptw_ctx_t reg_gpm, reg_npm, pal_gpm, pal_npm;
+} tables_t;
+
+/* a reg guest of type t mapping TABLE_SIZE from GVA_BASE, nested
+   tables mapping it, and empty pal tables. large selects large pages
+   in both the guest and nested tables. */
+static void tables_init(tables_t *tb, hpt_type_t t, bool large)
+{
+  arena_used = 0;
+  ctx_init(&tb->reg_gpm, t);
+  ctx_init(&tb->reg_npm, HPT_TYPE_EPT);
+  ctx_init(&tb->pal_gpm, t);
+  ctx_init(&tb->pal_npm, HPT_TYPE_EPT);
+
+  /* 4M NORM guest pages still line up with 2M nested pages */
+  map_range(&tb->reg_gpm, GVA_BASE, GPA_BASE, TABLE_SIZE, large ? 2 : 1);
+  map_range(&tb->reg_npm, GPA_BASE, SPA_BASE, TABLE_SIZE, large ? 2 : 1);
+}
+
+/* how scode_lend_section walked the tables before hptw_leaf_t: each
+   page from the root, several times over. only works on 4K pages. */
+static void lend_per_page(tables_t *tb, hpt_va_t reg_gva, hpt_va_t pal_gva,
+                          size_t size, hpt_prot_t reg_prot, hpt_prot_t pal_prot)
+{
+  size_t offset;
+
+  for (offset = 0; offset < size; offset += PAGE_SIZE_4K) {
+    hpt_pmeo_t reg_gpmeo, reg_npmeo, pal_gpmeo, pal_npmeo, existing;
+    hpt_pa_t gpa;
+    hpt_prot_t prots;
+    bool user = false;
+
+    hptw_get_pmeo(&reg_gpmeo, &tb->reg_gpm, 1, reg_gva + offset);
+    TEST_ASSERT_EQUAL_INT(1, reg_gpmeo.lvl);
+    gpa = hpt_pmeo_get_address(&reg_gpmeo);
+
+    hptw_get_pmeo(&reg_npmeo, &tb->reg_npm, 1, gpa);
+    TEST_ASSERT_EQUAL_INT(1, reg_npmeo.lvl);
+
+    prots = hptw_get_effective_prots(&tb->reg_npm, gpa, &user);
+    TEST_ASSERT_TRUE((prots & reg_prot) == reg_prot && user);
+    prots = hptw_get_effective_prots(&tb->reg_gpm, reg_gva + offset, &user);
+    TEST_ASSERT_TRUE((prots & pal_prot) == pal_prot && user);
+
+    hptw_get_pmeo(&existing, &tb->pal_gpm, 1, pal_gva + offset);
+    TEST_ASSERT_TRUE(!hpt_pmeo_is_present(&existing));
+
+    hpt_pmeo_setprot(&reg_npmeo, reg_prot);
+    TEST_ASSERT_EQUAL_INT(0, hptw_insert_pmeo(&tb->reg_npm, &reg_npmeo, gpa));
+
+    pal_gpmeo = reg_gpmeo;
+    hpt_pmeo_setprot(&pal_gpmeo, HPT_PROTS_RWX);
+    TEST_ASSERT_EQUAL_INT(0, hptw_insert_pmeo_alloc(&tb->pal_gpm, &pal_gpmeo,
+                                                    pal_gva + offset));
+
+    pal_npmeo = reg_npmeo;
+    hpt_pmeo_setprot(&pal_npmeo, pal_prot);
+    TEST_ASSERT_EQUAL_INT(0, hptw_insert_pmeo_alloc(&tb->pal_npm, &pal_npmeo, gpa));
+  }
+}
+
+static bool leaf_allows(const hptw_leaf_t *leaf, const hpt_pmeo_t *pmeo,
+                        hpt_prot_t prot)
+{
+  return ((leaf->prots & hpt_pmeo_getprot(pmeo) & prot) == prot)
+    && leaf->user && hpt_pmeo_getuser(pmeo);
+}
+
+static void get_reg_npmeo(hpt_pmeo_t *pmeo, hptw_leaf_t *leaf,
+                          hptw_ctx_t *reg_npm, hpt_pa_t gpa)
+{
+  TEST_ASSERT_EQUAL_INT(0, hptw_leaf_get_pmeo(pmeo, leaf, reg_npm, gpa));
+  while (pmeo->lvl > 1 && hpt_pmeo_is_present(pmeo) && hpt_pmeo_is_page(pmeo)) {
+    TEST_ASSERT_EQUAL_INT(0, hptw_split_page(reg_npm, leaf, gpa));
+    hpt_pm_get_pmeo_by_va(pmeo, &leaf->pmo, gpa);
+  }
+  TEST_ASSERT_EQUAL_INT(1, pmeo->lvl);
+}
+
+/* the walks scode_lend_section does now */
+static void lend_range(tables_t *tb, hpt_va_t reg_gva, hpt_va_t pal_gva,
+                       size_t size, hpt_prot_t reg_prot, hpt_prot_t pal_prot)
+{
+  hptw_leaf_t reg_gleaf, reg_nleaf, pal_gleaf, pal_nleaf;
+  size_t offset;
+
+  hptw_leaf_init(&reg_gleaf);
+  hptw_leaf_init(&reg_nleaf);
+  hptw_leaf_init(&pal_gleaf);
+  hptw_leaf_init(&pal_nleaf);
+
+  for (offset = 0; offset < size; offset += PAGE_SIZE_4K) {
+    hpt_pmeo_t reg_gpmeo, reg_npmeo, pal_gpmeo, pal_npmeo, existing;
+    hpt_pa_t gpa;
+
+    TEST_ASSERT_EQUAL_INT(0, hptw_leaf_get_pmeo(&reg_gpmeo, &reg_gleaf,
+                                                &tb->reg_gpm, reg_gva + offset));
+    TEST_ASSERT_TRUE(leaf_allows(&reg_gleaf, &reg_gpmeo, pal_prot));
+    gpa = hpt_pmeo_va_to_pa(&reg_gpmeo, reg_gva + offset);
+    pal_gpmeo = reg_gpmeo;
+    while (pal_gpmeo.lvl > 1) {
+      hpt_pmeo_split_page(&pal_gpmeo, &pal_gpmeo);
+    }
+    hpt_pmeo_set_address(&pal_gpmeo, gpa);
+    hpt_pmeo_setprot(&pal_gpmeo, HPT_PROTS_RWX);
+
+    get_reg_npmeo(&reg_npmeo, &reg_nleaf, &tb->reg_npm, gpa);
+    TEST_ASSERT_TRUE(leaf_allows(&reg_nleaf, &reg_npmeo, reg_prot));
+
+    TEST_ASSERT_EQUAL_INT(0, hptw_leaf_get_pmeo_alloc(&existing, &pal_gleaf,
+                                                      &tb->pal_gpm, pal_gva + offset));
+    TEST_ASSERT_TRUE(!hpt_pmeo_is_present(&existing));
+
+    hpt_pmeo_setprot(&reg_npmeo, reg_prot);
+    hpt_pmo_set_pme_by_va(&reg_nleaf.pmo, &reg_npmeo, gpa);
+
+    hpt_pmo_set_pme_by_va(&pal_gleaf.pmo, &pal_gpmeo, pal_gva + offset);
+
+    TEST_ASSERT_EQUAL_INT(0, hptw_leaf_get_pmeo_alloc(&existing, &pal_nleaf,
+                                                      &tb->pal_npm, gpa));
+    pal_npmeo = reg_npmeo;
+    hpt_pmeo_setprot(&pal_npmeo, pal_prot);
+    hpt_pmo_set_pme_by_va(&pal_nleaf.pmo, &pal_npmeo, gpa);
+  }
+}
+
+/* the walks scode_return_section does now */
+static void return_range(tables_t *tb, hpt_va_t pal_gva, size_t size,
+                         hpt_prot_t reg_prot)
+{
+  hptw_leaf_t reg_nleaf, pal_gleaf, pal_nleaf;
+  size_t offset;
+
+  hptw_leaf_init(&reg_nleaf);
+  hptw_leaf_init(&pal_gleaf);
+  hptw_leaf_init(&pal_nleaf);
+
+  for (offset = 0; offset < size; offset += PAGE_SIZE_4K) {
+    hpt_pmeo_t pal_gpmeo, pal_npmeo, reg_npmeo;
+    hpt_pa_t gpa;
+
+    TEST_ASSERT_EQUAL_INT(0, hptw_leaf_get_pmeo(&pal_gpmeo, &pal_gleaf,
+                                                &tb->pal_gpm, pal_gva + offset));
+    TEST_ASSERT_TRUE(hpt_pmeo_is_page(&pal_gpmeo));
+    gpa = hpt_pmeo_va_to_pa(&pal_gpmeo, pal_gva + offset);
+
+    TEST_ASSERT_EQUAL_INT(0, hptw_leaf_get_pmeo(&pal_npmeo, &pal_nleaf,
+                                                &tb->pal_npm, gpa));
+    TEST_ASSERT_TRUE(pal_nleaf.prots & hpt_pmeo_getprot(&pal_npmeo) & HPT_PROTS_R);
+    hpt_pmeo_setprot(&pal_npmeo, HPT_PROTS_NONE);
+    hpt_pmo_set_pme_by_va(&pal_nleaf.pmo, &pal_npmeo, gpa);
+
+    hpt_pmeo_setprot(&pal_gpmeo, HPT_PROTS_NONE);
+    hpt_pmo_set_pme_by_va(&pal_gleaf.pmo, &pal_gpmeo, pal_gva + offset);
+
+    get_reg_npmeo(&reg_npmeo, &reg_nleaf, &tb->reg_npm, gpa);
+    hpt_pmeo_setprot(&reg_npmeo, reg_prot);
+    hpt_pmo_set_pme_by_va(&reg_nleaf.pmo, &reg_npmeo, gpa);
+  }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void setUp(void)
+{
+  if (!arena) {
+    arena = aligned_alloc(HPT_PM_SIZE, ARENA_SIZE);
+    TEST_ASSERT_TRUE(arena != NULL);
+  }
+}
+
+void tearDown(void)
+{
+}
+
+/* splitting a large page keeps every translation, protection, and
+   memory type */
+void test_split_page(void)
+{
+  static const struct { hpt_type_t t; int lvl; int pat_bit; } cases[] = {
+    { HPT_TYPE_NORM, 2, HPT_NORM_PAT_L2_P_BIT },
+    { HPT_TYPE_PAE,  2, HPT_PAE_PAT_L2_P_BIT },
+    { HPT_TYPE_LONG, 2, HPT_LONG_PAT_L32_P_BIT },
+    { HPT_TYPE_LONG, 3, HPT_LONG_PAT_L32_P_BIT },
+    { HPT_TYPE_EPT,  2, -1 },
+    { HPT_TYPE_EPT,  3, -1 },
+  };
+  size_t i;
+
+  for (i = 0; i < sizeof(cases)/sizeof(cases[0]); i++) {
+    hptw_ctx_t ctx;
+    hptw_leaf_t leaf;
+    hpt_pmeo_t page = { .t = cases[i].t, .lvl = cases[i].lvl };
+    hpt_pmeo_t pmeo;
+    hpt_va_t va = 0;
+    hpt_pa_t pa = 0x40000000ull;
+    size_t page_sz, off;
+
+    arena_used = 0;
+    ctx_init(&ctx, cases[i].t);
+
+    page.pme = BR64_SET_BIT(0, ps_bit(page.t), 1);
+    if (cases[i].pat_bit >= 0) {
+      page.pme = BR64_SET_BIT(page.pme, cases[i].pat_bit, 1);
+    } else {
+      page.pme |= (hpt_pme_t)HPT_PMT_WT << 3; /* EPT memory type */
+    }
+    hpt_pmeo_set_address(&page, pa);
+    TEST_ASSERT_TRUE(hpt_pmeo_get_address(&page) == pa);
+    hpt_pmeo_setprot(&page, HPT_PROTS_RX);
+    hpt_pmeo_setuser(&page, true);
+    page_sz = hpt_pmeo_page_size(&page);
+    TEST_ASSERT_EQUAL_INT(0, hptw_insert_pmeo_alloc(&ctx, &page, va));
+
+    hptw_leaf_init(&leaf);
+    TEST_ASSERT_EQUAL_INT(0, hptw_leaf_get_pmeo(&pmeo, &leaf, &ctx, va));
+    TEST_ASSERT_EQUAL_INT(cases[i].lvl, pmeo.lvl);
+    TEST_ASSERT_EQUAL_INT(0, hptw_split_page(&ctx, &leaf, va + page_sz / 2));
+    TEST_ASSERT_EQUAL_INT(cases[i].lvl - 1, leaf.pmo.lvl);
+
+    for (off = 0; off < page_sz; off += page_sz / 8 + PAGE_SIZE_4K) {
+      bool user = false;
+      hptw_get_pmeo(&pmeo, &ctx, 1, va + off);
+      TEST_ASSERT_EQUAL_INT(cases[i].lvl - 1, pmeo.lvl);
+      TEST_ASSERT_TRUE(hptw_va_to_pa(&ctx, va + off) == pa + off);
+      TEST_ASSERT_TRUE(hptw_get_effective_prots(&ctx, va + off, &user) == HPT_PROTS_RX);
+      TEST_ASSERT_TRUE(user);
+      if (pmeo.lvl > 1 || cases[i].pat_bit < 0) {
+        TEST_ASSERT_TRUE(BR64_GET_BIT(pmeo.pme, ps_bit(pmeo.t)) == (pmeo.lvl > 1));
+      }
+      if (cases[i].pat_bit < 0) {
+        TEST_ASSERT_TRUE(((pmeo.pme >> 3) & 7) == HPT_PMT_WT);
+      } else if (pmeo.lvl == 1) {
+        /* 4K entries keep PAT where large pages keep PS */
+        TEST_ASSERT_TRUE(BR64_GET_BIT(pmeo.pme, ps_bit(pmeo.t)));
+      } else {
+        TEST_ASSERT_TRUE(BR64_GET_BIT(pmeo.pme, cases[i].pat_bit));
+      }
+    }
+  }
+}
+
+/* lend a section that starts and ends part way through large guest
+   and nested pages, then return it */
+void test_lend_large_pages(void)
+{
+  static const hpt_type_t types[] = { HPT_TYPE_NORM, HPT_TYPE_PAE, HPT_TYPE_LONG };
+  size_t i;
+
+  for (i = 0; i < sizeof(types)/sizeof(types[0]); i++) {
+    tables_t tb;
+    hpt_va_t reg_gva = GVA_BASE + (1u << 20) + 5*PAGE_SIZE_4K;
+    hpt_va_t pal_gva = 0x10000000ull + 5*PAGE_SIZE_4K;
+    size_t size = (9u << 20) + 3*PAGE_SIZE_4K;
+    hpt_va_t off;
+
+    tables_init(&tb, types[i], true);
+    lend_range(&tb, reg_gva, pal_gva, size, HPT_PROTS_NONE, HPT_PROTS_RW);
+
+    for (off = 0; off < size + (2u << 20); off += PAGE_SIZE_4K) {
+      hpt_pa_t gpa = GPA_BASE + (reg_gva - GVA_BASE) - (1u << 20) + off;
+      bool lent = off >= (1u << 20) && off < (1u << 20) + size;
+      bool user;
+
+      TEST_ASSERT_TRUE(hptw_get_effective_prots(&tb.reg_npm, gpa, &user)
+                       == (lent ? HPT_PROTS_NONE : HPT_PROTS_RWX));
+      if (lent) {
+        hpt_va_t va = pal_gva + off - (1u << 20);
+        TEST_ASSERT_TRUE(hptw_va_to_pa(&tb.pal_gpm, va) == gpa);
+        TEST_ASSERT_TRUE(hptw_va_to_pa(&tb.pal_npm, gpa) == SPA_BASE + gpa - GPA_BASE);
+        TEST_ASSERT_TRUE(hptw_get_effective_prots(&tb.pal_npm, gpa, &user) == HPT_PROTS_RW);
+      }
+    }
+
+    return_range(&tb, pal_gva, size, HPT_PROTS_RWX);
+    for (off = 0; off < size; off += PAGE_SIZE_4K) {
+      hpt_pa_t gpa = GPA_BASE + (reg_gva - GVA_BASE) + off;
+      bool user;
+      TEST_ASSERT_TRUE(hptw_get_effective_prots(&tb.reg_npm, gpa, &user) == HPT_PROTS_RWX);
+      TEST_ASSERT_TRUE(hptw_get_effective_prots(&tb.pal_npm, gpa, &user) == HPT_PROTS_NONE);
+      TEST_ASSERT_TRUE(hptw_get_effective_prots(&tb.pal_gpm, pal_gva + off, &user) == HPT_PROTS_NONE);
+    }
+  }
+}
+
+/* not a test as such: time to lend sections of a few sizes, walking
+   per page as before, and by range on 4K and on large pages */
+void test_benchmark(void)
+{
+  static const size_t sizes[] = { 2u << 20, 8u << 20, 32u << 20 };
+  static const hpt_type_t types[] = { HPT_TYPE_PAE, HPT_TYPE_LONG };
+  size_t i, j;
+
+  printf("\nlend time, ns/page: per-page walks, range walks on 4K, range walks on large pages\n");
+  for (j = 0; j < sizeof(types)/sizeof(types[0]); j++) {
+    for (i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+      size_t pages = sizes[i] / PAGE_SIZE_4K;
+      double t[3];
+      int k;
+
+      for (k = 0; k < 3; k++) {
+        tables_t tb;
+        double t0;
+
+        tables_init(&tb, types[j], k == 2);
+        t0 = now();
+        if (k == 0) {
+          lend_per_page(&tb, GVA_BASE, GVA_BASE, sizes[i], HPT_PROTS_NONE, HPT_PROTS_RW);
+        } else {
+          lend_range(&tb, GVA_BASE, GVA_BASE, sizes[i], HPT_PROTS_NONE, HPT_PROTS_RW);
+        }
+        t[k] = (now() - t0) * 1e9 / pages;
+      }
+      printf("  %-4s %3zu MB: %8.1f %8.1f %8.1f\n",
+             types[j] == HPT_TYPE_PAE ? "pae" : "long",
+             sizes[i] >> 20, t[0], t[1], t[2]);
+    }
+  }
+}
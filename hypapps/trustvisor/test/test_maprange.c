@@ -0,0 +1,274 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <hpt.h>
+#include <hptw.h>
+
+/* synthetic page tables of each type, for checking hptw_map_range,
+   hptw_protect_range and hptw_unmap_range against page-at-a-time
+   lookups, and timing range maps against one hptw_insert_pmeo_alloc
+   per page. "physical" addresses of page maps are offsets into one
+   arena, as in test_lend.c; mapped frames are never touched. */
+
+#define PAGE_SIZE_4K (1u << 12)
+#define PAGE_SIZE_2M (1u << 21)
+#define ARENA_SIZE (8u << 20)
+
+#define VA_BASE 0x40000000ull
+#define PA_BASE 0x80000000ull
+
+static const hpt_type_t types[] = {
+  HPT_TYPE_NORM, HPT_TYPE_PAE, HPT_TYPE_LONG, HPT_TYPE_EPT
+};
+static const char *type_names[] = { "norm", "pae", "long", "ept" };
+
+static uint8_t *arena;
+static size_t arena_used;
+
+static void* arena_gzp(void *self, size_t alignment, size_t sz)
+{
+  void *rv;
+  (void)self;
+  (void)alignment;
+  (void)sz;
+  TEST_ASSERT_TRUE(arena_used + HPT_PM_SIZE <= ARENA_SIZE);
+  rv = arena + arena_used;
+  arena_used += HPT_PM_SIZE;
+  memset(rv, 0, HPT_PM_SIZE);
+  return rv;
+}
+
+static hpt_pa_t arena_ptr2pa(void *self, void *ptr)
+{
+  (void)self;
+  return (uint8_t *)ptr - arena;
+}
+
+static void* arena_pa2ptr(void *self, hpt_pa_t pa, size_t sz,
+                          hpt_prot_t access_type, hptw_cpl_t cpl,
+                          size_t *avail_sz)
+{
+  (void)self;
+  (void)access_type;
+  (void)cpl;
+  *avail_sz = sz;
+  return arena + pa;
+}
+
+static void ctx_init(hptw_ctx_t *ctx, hpt_type_t t)
+{
+  arena_used = 0;
+  *ctx = (hptw_ctx_t) {
+    .gzp = arena_gzp,
+    .pa2ptr = arena_pa2ptr,
+    .ptr2pa = arena_ptr2pa,
+    .t = t,
+  };
+  ctx->root_pa = arena_ptr2pa(ctx, arena_gzp(ctx, HPT_PM_SIZE, HPT_PM_SIZE));
+}
+
+/* the way tables were built before hptw_map_range */
+static void map_per_page(hptw_ctx_t *ctx, hpt_va_t va, hpt_pa_t pa,
+                         size_t size, hpt_prot_t prot)
+{
+  size_t off;
+
+  for (off = 0; off < size; off += PAGE_SIZE_4K) {
+    hpt_pmeo_t pmeo = { .pme = 0, .t = ctx->t, .lvl = 1 };
+    hpt_pmeo_setprot(&pmeo, prot);
+    hpt_pmeo_setuser(&pmeo, true);
+    hpt_pmeo_set_address(&pmeo, pa + off);
+    TEST_ASSERT_EQUAL_INT(0, hptw_insert_pmeo_alloc(ctx, &pmeo, va + off));
+  }
+}
+
+/* every 4K page of [va, va+size) maps to pa onwards with prot, or
+   isn't mapped if prot is HPT_PROTS_NONE */
+static void check_range(hptw_ctx_t *ctx, hpt_va_t va, hpt_pa_t pa,
+                        size_t size, hpt_prot_t prot)
+{
+  size_t off;
+
+  for (off = 0; off < size; off += PAGE_SIZE_4K) {
+    hpt_pmeo_t pmeo;
+    bool user = false;
+
+    if (prot == HPT_PROTS_NONE) {
+      /* not-present entries can still show W or X */
+      TEST_ASSERT_TRUE(!(hptw_get_effective_prots(ctx, va + off, &user)
+                         & HPT_PROT_READ_MASK));
+    } else {
+      TEST_ASSERT_TRUE(hptw_get_effective_prots(ctx, va + off, &user) == prot);
+      TEST_ASSERT_TRUE(user);
+      hptw_get_pmeo(&pmeo, ctx, 1, va + off);
+      TEST_ASSERT_TRUE(hpt_pmeo_is_page(&pmeo));
+      TEST_ASSERT_TRUE(hpt_pmeo_va_to_pa(&pmeo, va + off) == pa + off);
+    }
+  }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void setUp(void)
+{
+  if (!arena) {
+    arena = aligned_alloc(HPT_PM_SIZE, ARENA_SIZE);
+    TEST_ASSERT_TRUE(arena != NULL);
+  }
+}
+
+void tearDown(void)
+{
+}
+
+/* a range starting and ending part way through large pages gets 4K
+   pages at the ends and large pages between, allocating as many page
+   maps as it said it would. protecting and unmapping parts of it
+   splits the large pages they cut through. */
+void test_map_range(void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof(types)/sizeof(types[0]); i++) {
+    hpt_va_t va = VA_BASE + PAGE_SIZE_2M - 3*PAGE_SIZE_4K;
+    hpt_pa_t pa = PA_BASE + PAGE_SIZE_2M - 3*PAGE_SIZE_4K;
+    size_t size = 5*PAGE_SIZE_2M + 5*PAGE_SIZE_4K;
+    hpt_va_t cut = va + 2*PAGE_SIZE_2M + 7*PAGE_SIZE_4K;
+    hptw_ctx_t ctx;
+    hpt_pmeo_t pmeo;
+    size_t pms, used;
+
+    ctx_init(&ctx, types[i]);
+
+    TEST_ASSERT_EQUAL_INT(0, hptw_map_range_pms(&ctx, va, pa, size, HPT_LVL_PD2, &pms));
+    used = arena_used;
+    TEST_ASSERT_EQUAL_INT(0, hptw_map_range(&ctx, va, pa, size, HPT_PROTS_RWX,
+                                            true, HPT_LVL_PD2));
+    TEST_ASSERT_EQUAL_INT(pms, (arena_used - used) / HPT_PM_SIZE);
+    check_range(&ctx, va, pa, size, HPT_PROTS_RWX);
+    check_range(&ctx, va - PAGE_SIZE_4K, 0, PAGE_SIZE_4K, HPT_PROTS_NONE);
+    check_range(&ctx, va + size, 0, PAGE_SIZE_4K, HPT_PROTS_NONE);
+
+    /* large pages in the middle: 2M, or 4M for NORM */
+    hptw_get_pmeo(&pmeo, &ctx, 1, VA_BASE + 2*PAGE_SIZE_2M);
+    TEST_ASSERT_EQUAL_INT(2, pmeo.lvl);
+
+    /* mapping it again changes nothing and needs no page maps */
+    TEST_ASSERT_EQUAL_INT(0, hptw_map_range_pms(&ctx, va, pa, size, HPT_LVL_PD2, &pms));
+    TEST_ASSERT_EQUAL_INT(0, pms);
+
+    TEST_ASSERT_EQUAL_INT(0, hptw_protect_range(&ctx, va + PAGE_SIZE_4K,
+                                                cut - va - PAGE_SIZE_4K,
+                                                HPT_PROTS_RX));
+    check_range(&ctx, va, pa, PAGE_SIZE_4K, HPT_PROTS_RWX);
+    check_range(&ctx, va + PAGE_SIZE_4K, pa + PAGE_SIZE_4K,
+                cut - va - PAGE_SIZE_4K, HPT_PROTS_RX);
+    check_range(&ctx, cut, pa + (cut - va), va + size - cut, HPT_PROTS_RWX);
+
+    TEST_ASSERT_EQUAL_INT(0, hptw_unmap_range(&ctx, cut - PAGE_SIZE_2M, PAGE_SIZE_2M));
+    check_range(&ctx, va + PAGE_SIZE_4K, pa + PAGE_SIZE_4K,
+                cut - PAGE_SIZE_2M - va - PAGE_SIZE_4K, HPT_PROTS_RX);
+    check_range(&ctx, cut - PAGE_SIZE_2M, 0, PAGE_SIZE_2M, HPT_PROTS_NONE);
+    check_range(&ctx, cut, pa + (cut - va), va + size - cut, HPT_PROTS_RWX);
+
+    /* and the page maps left behind get used again */
+    TEST_ASSERT_EQUAL_INT(0, hptw_map_range_pms(&ctx, va, pa, size, HPT_LVL_PD2, &pms));
+    TEST_ASSERT_EQUAL_INT(0, pms);
+    TEST_ASSERT_EQUAL_INT(0, hptw_map_range(&ctx, va, pa, size, HPT_PROTS_RX,
+                                            true, HPT_LVL_PD2));
+    check_range(&ctx, va, pa, size, HPT_PROTS_RX);
+  }
+}
+
+/* not a test as such: time to map ranges of a few sizes one page at
+   a time, and with hptw_map_range on 4K and on large pages */
+void test_benchmark(void)
+{
+  static const size_t sizes[] = { 1u << 20, 16u << 20, 256u << 20, 1u << 30 };
+  size_t i, j;
+
+  printf("\nmap time, us: per page, map_range 4K, map_range large pages (page maps allocated)\n");
+  for (j = 0; j < sizeof(types)/sizeof(types[0]); j++) {
+    for (i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+      hpt_prot_t prot = types[j] == HPT_TYPE_NORM ? HPT_PROTS_RWX : HPT_PROTS_RW;
+      double t[3];
+      size_t pms[3];
+      int k;
+
+      for (k = 0; k < 3; k++) {
+        hptw_ctx_t ctx;
+        double t0;
+
+        ctx_init(&ctx, types[j]);
+        t0 = now();
+        if (k == 0) {
+          map_per_page(&ctx, VA_BASE, PA_BASE, sizes[i], prot);
+        } else {
+          TEST_ASSERT_EQUAL_INT(0, hptw_map_range(&ctx, VA_BASE, PA_BASE, sizes[i], prot,
+                                                  true, k == 1 ? 1 : HPT_LVL_PD2));
+        }
+        t[k] = (now() - t0) * 1e6;
+        pms[k] = arena_used / HPT_PM_SIZE - 1;
+      }
+      TEST_ASSERT_EQUAL_INT(pms[0], pms[1]);
+      printf("  %-4s %4zu MB: %10.1f %10.1f %10.1f (%zu, %zu)\n",
+             type_names[j], sizes[i] >> 20, t[0], t[1], t[2], pms[1], pms[2]);
+    }
+  }
+}
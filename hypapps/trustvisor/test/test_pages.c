@@ -46,33 +46,311 @@
 
 #include "unity.h"
 
-#define __PRINT_H_ /* avoid indirectly including our print.h, which conflicts with libc stdio.h */
-#include <xmhf.h>
-#include <puttymem.h>
-#include <pages.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 
-/* run time parameter block. we'll mock this up as needed */
-/* RPB __rpb; */
-/* RPB *rpb = &__rpb; */
+/* the page pool has no dependencies on the rest of TrustVisor, so the
+   very same code runs here on top of libc malloc */
+#include <pagepool.h>
 
-/* /\* global CPU structs *\/ */
-/* VCPU g_vcpubuffers[0]; */
+#define MAX_SLABS 16
+#define MAX_PAGES (MAX_SLABS*PAGEPOOL_SLAB_PAGES)
+#define NUM_CPUS 4
 
-static pagelist_t pl;
+static pagepool_t pool;
+static pagepool_slab_t slabs[MAX_SLABS];
+static pagepool_cache_t caches[NUM_CPUS];
+
+static bool is_zero(const void *buf, size_t len)
+{
+  const uint8_t *p = buf;
+  size_t i;
+
+  for (i=0; i < len; i++) {
+    if (p[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool page_is_zero(const void *page)
+{
+  return is_zero(page, PAGEPOOL_PAGE_SIZE);
+}
+
+static size_t live_slabs(void)
+{
+  size_t i, n=0;
+
+  for (i=0; i < pool.num_slabs; i++) {
+    n += slabs[i].buf != NULL;
+  }
+  return n;
+}
 
 void setUp(void)
 {
-  mem_init();
-  pagelist_init(&pl);
+  pagepool_init(&pool, slabs, MAX_SLABS, caches, NUM_CPUS);
 }
 
 void tearDown(void)
 {
-  pagelist_free_all(&pl);
+  size_t i;
+
+  for (i=0; i < pool.num_slabs; i++) {
+    free(slabs[i].buf);
+  }
+}
+
+void test_zeroed_pages(void)
+{
+  pagepool_owner_t owner;
+  void *pages[64];
+  size_t i;
+
+  pagepool_owner_init(&owner, 64);
+  for (i=0; i < 64; i++) {
+    TEST_ASSERT_NOT_NULL(pages[i] = pagepool_alloc(&pool, &owner, 0, true));
+    TEST_ASSERT_EQUAL(0, (uintptr_t)pages[i] % PAGEPOOL_PAGE_SIZE);
+    TEST_ASSERT_TRUE(page_is_zero(pages[i]));
+    memset(pages[i], 0xa5, PAGEPOOL_PAGE_SIZE);
+  }
+
+  /* dirty pages come back zeroed all the same */
+  pagepool_free_all(&pool, &owner, 0, false);
+  TEST_ASSERT_EQUAL(0, owner.used);
+  TEST_ASSERT_EQUAL(64, owner.peak);
+  for (i=0; i < 64; i++) {
+    TEST_ASSERT_NOT_NULL(pages[i] = pagepool_alloc(&pool, &owner, 0, true));
+    TEST_ASSERT_TRUE(page_is_zero(pages[i]));
+  }
+
+  /* recycled, not taken from new slabs */
+  TEST_ASSERT_EQUAL(2, live_slabs());
+  pagepool_free_all(&pool, &owner, 0, false);
+}
+
+void test_caps(void)
+{
+  pagepool_owner_t a, b;
+  size_t i;
+
+  /* an owner can't hold more than its cap */
+  pagepool_owner_init(&a, 3);
+  for (i=0; i < 3; i++) {
+    TEST_ASSERT_NOT_NULL(pagepool_alloc(&pool, &a, 0, false));
+  }
+  TEST_ASSERT_NULL(pagepool_alloc(&pool, &a, 0, false));
+  TEST_ASSERT_EQUAL(1, a.fails);
+  pagepool_free_all(&pool, &a, 0, false);
+
+  /* nor can the pool hand out more than its cap, from any cpu */
+  pagepool_owner_init(&b, 2*MAX_PAGES);
+  for (i=0; i < MAX_PAGES; i++) {
+    TEST_ASSERT_NOT_NULL(pagepool_alloc(&pool, &b, i % NUM_CPUS, false));
+  }
+  TEST_ASSERT_NULL(pagepool_alloc(&pool, &b, 0, false));
+  TEST_ASSERT_NULL(pagepool_alloc(&pool, &b, 1, true));
+  TEST_ASSERT_EQUAL(MAX_PAGES, b.used);
+  TEST_ASSERT_EQUAL(MAX_SLABS, live_slabs());
+
+  /* and everything is available again once given back */
+  pagepool_free_all(&pool, &b, 0, false);
+  for (i=0; i < MAX_PAGES - NUM_CPUS*PAGEPOOL_CACHE_PAGES; i++) {
+    TEST_ASSERT_NOT_NULL(pagepool_alloc(&pool, &b, 1, true));
+  }
+  pagepool_free_all(&pool, &b, 1, false);
+}
+
+void test_owns(void)
+{
+  pagepool_owner_t a, b;
+  void *pa, *pb;
+  int local;
+
+  pagepool_owner_init(&a, 8);
+  pagepool_owner_init(&b, 8);
+  pa = pagepool_alloc(&pool, &a, 0, true);
+  pb = pagepool_alloc(&pool, &b, 1, true);
+
+  TEST_ASSERT_TRUE(pagepool_owns(&pool, &a, pa));
+  TEST_ASSERT_FALSE(pagepool_owns(&pool, &a, pb));
+  TEST_ASSERT_TRUE(pagepool_owns(&pool, &b, pb));
+  TEST_ASSERT_FALSE(pagepool_owns(&pool, &b, &local));
+
+  pagepool_free_all(&pool, &a, 0, false);
+  TEST_ASSERT_FALSE(pagepool_owns(&pool, &a, pa));
+  TEST_ASSERT_TRUE(pagepool_owns(&pool, &b, pb));
+  pagepool_free_all(&pool, &b, 1, false);
+}
+
+void test_clear_scrub_trim(void)
+{
+  pagepool_owner_t owner;
+  void *pages[3*PAGEPOOL_SLAB_PAGES];
+  size_t n = sizeof(pages)/sizeof(pages[0]);
+  size_t i;
+
+  /* cleared pages are zeroed as they are given back */
+  pagepool_owner_init(&owner, n);
+  for (i=0; i < n; i++) {
+    pages[i] = pagepool_alloc(&pool, &owner, 0, false);
+    memset(pages[i], 0x5a, PAGEPOOL_PAGE_SIZE);
+  }
+  pagepool_free_all(&pool, &owner, 0, true);
+  for (i=0; i < n; i++) {
+    /* free pages on the pool's lists hold a link in their first word */
+    TEST_ASSERT_TRUE(is_zero((uint8_t*)pages[i] + sizeof(void*),
+                             PAGEPOOL_PAGE_SIZE - sizeof(void*)));
+  }
+  for (i=0; i < n; i++) {
+    TEST_ASSERT_NOT_NULL(pages[i] = pagepool_alloc(&pool, &owner, 0, true));
+    memset(pages[i], 0x5a, PAGEPOOL_PAGE_SIZE);
+  }
+  TEST_ASSERT_EQUAL(0, caches[0].zeroed);
+
+  /* scrubbed pages needn't be zeroed when handed out */
+  pagepool_free_all(&pool, &owner, 0, false);
+  TEST_ASSERT_TRUE(pool.num_dirty > 0);
+  TEST_ASSERT_EQUAL(pool.num_dirty, pagepool_scrub(&pool, (size_t)-1));
+  TEST_ASSERT_EQUAL(0, pool.num_dirty);
+  n = pool.num_clean;
+  for (i=0; i < n; i++) {
+    TEST_ASSERT_NOT_NULL(pages[i] = pagepool_alloc(&pool, &owner, 2, true));
+    TEST_ASSERT_TRUE(page_is_zero(pages[i]));
+  }
+  TEST_ASSERT_EQUAL(0, caches[2].zeroed);
+  pagepool_free_all(&pool, &owner, 2, false);
+
+  /* slabs whose pages are all on the free lists go back to the heap */
+  TEST_ASSERT_EQUAL(3, live_slabs());
+  TEST_ASSERT_TRUE(pagepool_trim(&pool) > 0);
+  TEST_ASSERT_TRUE(live_slabs() < 3);
+  TEST_ASSERT_EQUAL(0, pagepool_trim(&pool));
+  n = sizeof(pages)/sizeof(pages[0]);
+  for (i=0; i < n; i++) {
+    TEST_ASSERT_NOT_NULL(pages[i] = pagepool_alloc(&pool, &owner, 0, true));
+    TEST_ASSERT_TRUE(page_is_zero(pages[i]));
+  }
+  pagepool_free_all(&pool, &owner, 0, false);
 }
 
-void test_foo(void)
+#define THREAD_PAGES 24
+#define THREAD_ROUNDS 2000
+
+static void* churn_thread(void *arg)
 {
-  void *p = pagelist_getpage(&pl);
-  TEST_ASSERT(PAGE_ALIGNED_4K((uintptr_t)p));
+  size_t cpu = (uintptr_t)arg;
+  pagepool_owner_t owner;
+  void *pages[THREAD_PAGES];
+  size_t i, j, bad=0;
+
+  pagepool_owner_init(&owner, THREAD_PAGES);
+  for (i=0; i < THREAD_ROUNDS; i++) {
+    size_t n = 1 + (i*7 + cpu) % THREAD_PAGES;
+    for (j=0; j < n; j++) {
+      pages[j] = pagepool_alloc(&pool, &owner, cpu, j & 1);
+      if (!pages[j]) {
+        return (void*)1;
+      }
+      memset(pages[j], (int)cpu+1, PAGEPOOL_PAGE_SIZE);
+    }
+    /* no other thread was handed the same pages meanwhile */
+    for (j=0; j < n; j++) {
+      bad += ((uint8_t*)pages[j])[PAGEPOOL_PAGE_SIZE-1] != cpu+1;
+    }
+    pagepool_free_all(&pool, &owner, cpu, (i % 5) == 0);
+    if (cpu == 0 && (i % 64) == 0) {
+      pagepool_scrub(&pool, 16);
+    }
+  }
+  return (void*)bad;
+}
+
+void test_concurrent_churn(void)
+{
+  pthread_t threads[NUM_CPUS];
+  size_t i;
+
+  for (i=0; i < NUM_CPUS; i++) {
+    TEST_ASSERT_EQUAL(0, pthread_create(&threads[i], NULL, churn_thread, (void*)i));
+  }
+  for (i=0; i < NUM_CPUS; i++) {
+    void *bad;
+    pthread_join(threads[i], &bad);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)bad);
+  }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the bump allocator the pool replaced: one buffer per list, a memset
+   per page handed out, and everything freed at once */
+static double churn_bump(size_t pages, size_t rounds)
+{
+  double t0 = now();
+  size_t i, j;
+
+  for (i=0; i < rounds; i++) {
+    uint8_t *buf = malloc((pages+1)*PAGEPOOL_PAGE_SIZE);
+    uint8_t *base = (uint8_t*)(((uintptr_t)buf + PAGEPOOL_PAGE_SIZE-1)
+                               & ~(uintptr_t)(PAGEPOOL_PAGE_SIZE-1));
+    for (j=0; j < pages; j++) {
+      uint8_t *page = base + j*PAGEPOOL_PAGE_SIZE;
+      memset(page, 0, PAGEPOOL_PAGE_SIZE);
+      page[j % PAGEPOOL_PAGE_SIZE] = 1;
+    }
+    free(buf);
+  }
+  return (now() - t0) / (rounds*pages) * 1e9;
+}
+
+static double churn_pool(size_t pages, size_t rounds, bool scrub)
+{
+  pagepool_owner_t owner;
+  double t0, t=0;
+  size_t i, j;
+
+  pagepool_owner_init(&owner, pages);
+  for (i=0; i < rounds; i++) {
+    t0 = now();
+    for (j=0; j < pages; j++) {
+      uint8_t *page = pagepool_alloc(&pool, &owner, 0, true);
+      page[j % PAGEPOOL_PAGE_SIZE] = 1;
+    }
+    pagepool_free_all(&pool, &owner, 0, false);
+    t += now() - t0;
+    /* zeroing between rounds stands in for an idle hypervisor */
+    if (scrub) {
+      pagepool_scrub(&pool, pages);
+    }
+  }
+  return t / (rounds*pages) * 1e9;
+}
+
+void test_benchmark(void)
+{
+  static const size_t sizes[] = { 8, 64, 256 };
+  size_t i;
+
+  printf("\nchurn, ns per zeroed page: bump allocator, pool, pool scrubbed while idle\n");
+  for (i=0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+    size_t rounds = (1 << 16) / sizes[i];
+    double t[3];
+
+    t[0] = churn_bump(sizes[i], rounds);
+    t[1] = churn_pool(sizes[i], rounds, false);
+    t[2] = churn_pool(sizes[i], rounds, true);
+    printf("  %3zu pages: %8.1f %8.1f %8.1f\n", sizes[i], t[0], t[1], t[2]);
+  }
 }
@@ -0,0 +1,249 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* the hypervisor's lock code is self-contained inline asm, so the very
+   same primitives run here under pthreads */
+#include <arch/x86/_spinlock.h>
+
+#define MAX_THREADS 16
+#define RUN_SECONDS 0.25
+
+/* the spin_lock that the ticket lock replaced: test-and-test-and-set
+   with lock btr, no pause. kept here as the baseline for comparison. */
+static inline uint32_t ttas_spin_lock(volatile uint32_t *lock)
+{
+  uint8_t got;
+  uint32_t spins = 0;
+
+  for (;;) {
+    while (!(*lock & 1)) {
+      spins++;
+    }
+    __asm__ __volatile__ ("lock; btrl $0, %0; setc %1"
+                          : "+m" (*lock), "=q" (got) : : "memory", "cc");
+    if (got) {
+      return spins;
+    }
+  }
+}
+
+static inline void ttas_spin_unlock(volatile uint32_t *lock)
+{
+  __asm__ __volatile__ ("btsl $0, %0" : "+m" (*lock) : : "memory", "cc");
+}
+
+typedef struct {
+  uint32_t (*lock)(volatile uint32_t *);
+  void (*unlock)(volatile uint32_t *);
+  volatile uint32_t word;
+  volatile int stop;
+  /* protected by word */
+  uint64_t counter;
+  uint64_t holder_overlap;
+  volatile int holders;
+} stress_t;
+
+typedef struct {
+  stress_t *s;
+  uint64_t acquisitions;
+  uint64_t spins;
+} worker_t;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker(void *arg)
+{
+  worker_t *w = arg;
+  stress_t *s = w->s;
+  int i;
+
+  while (!s->stop) {
+    w->spins += s->lock(&s->word);
+    if (s->holders++ != 0) {
+      s->holder_overlap++;
+    }
+    /* a short critical section with a read-modify-write that would
+       lose updates without mutual exclusion */
+    for (i = 0; i < 8; i++) {
+      s->counter++;
+    }
+    s->holders--;
+    s->unlock(&s->word);
+    w->acquisitions++;
+  }
+  return NULL;
+}
+
+/* runs nthreads workers against one lock for RUN_SECONDS; returns the
+   acquisition rate and fills in the per-thread min/max */
+static double stress(stress_t *s, int nthreads, uint64_t *min, uint64_t *max,
+                     uint64_t *spins)
+{
+  pthread_t th[MAX_THREADS];
+  worker_t w[MAX_THREADS];
+  uint64_t total = 0;
+  double t0, t1;
+  int i;
+
+  s->word = 1;
+  s->stop = 0;
+  s->counter = 0;
+  s->holder_overlap = 0;
+  s->holders = 0;
+  memset(w, 0, sizeof(w));
+
+  t0 = now();
+  for (i = 0; i < nthreads; i++) {
+    w[i].s = s;
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&th[i], NULL, worker, &w[i]));
+  }
+  usleep(RUN_SECONDS * 1e6);
+  s->stop = 1;
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(th[i], NULL);
+  }
+  t1 = now();
+
+  *min = UINT64_MAX;
+  *max = 0;
+  *spins = 0;
+  for (i = 0; i < nthreads; i++) {
+    total += w[i].acquisitions;
+    *spins += w[i].spins;
+    if (w[i].acquisitions < *min) *min = w[i].acquisitions;
+    if (w[i].acquisitions > *max) *max = w[i].acquisitions;
+  }
+
+  TEST_ASSERT_EQUAL_INT(0, (int)s->holder_overlap);
+  TEST_ASSERT_TRUE(s->counter == total * 8);
+  return total / (t1 - t0);
+}
+
+static int ncpus(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (n < 1) n = 1;
+  if (n > MAX_THREADS) n = MAX_THREADS;
+  return n;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/* the lock word encoding, including wrap-around of both halves */
+void test_encoding(void)
+{
+  volatile uint32_t lock = 1;
+  int i;
+
+  TEST_ASSERT_EQUAL_INT(0, ticket_spin_lock(&lock));
+  TEST_ASSERT_TRUE(lock == 0x00010001);
+  ticket_spin_unlock(&lock);
+  TEST_ASSERT_TRUE(lock == 0x00010002);
+
+  /* now serving 0xfffe, next ticket 0xfffe */
+  lock = 0xfffeffff;
+  for (i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_INT(0, ticket_spin_lock(&lock));
+    ticket_spin_unlock(&lock);
+  }
+  TEST_ASSERT_TRUE(lock == 0x00020003);
+}
+
+void test_mutual_exclusion(void)
+{
+  stress_t s = { .lock = ticket_spin_lock, .unlock = ticket_spin_unlock };
+  uint64_t min, max, spins;
+
+  /* at least two threads, even if they have to share a cpu */
+  stress(&s, ncpus() < 2 ? 2 : ncpus(), &min, &max, &spins);
+  /* FIFO handoff: nobody starves */
+  TEST_ASSERT_TRUE(min > 0);
+}
+
+/* not a test as such: acquisitions/s and per-thread spread for the
+   ticket lock and the old test-and-test-and-set lock. one thread per
+   cpu at most: hypervisor cpus are never preempted while they hold or
+   wait for a lock, and a ticket lock convoys badly when they are. */
+void test_benchmark(void)
+{
+  stress_t ticket = { .lock = ticket_spin_lock, .unlock = ticket_spin_unlock };
+  stress_t ttas = { .lock = ttas_spin_lock, .unlock = ttas_spin_unlock };
+  uint64_t min, max, spins;
+  double rate;
+  int n;
+
+  printf("\nspinlock stress, %.2fs per run: Macq/s, per-thread min/max, spins/acq\n",
+         RUN_SECONDS);
+  for (n = 1; n <= ncpus(); n *= 2) {
+    rate = stress(&ticket, n, &min, &max, &spins);
+    printf("  %2d threads: ticket %7.2f %5.3f %8.1f", n, rate / 1e6,
+           (double)min / max, (double)spins / (rate * RUN_SECONDS));
+    rate = stress(&ttas, n, &min, &max, &spins);
+    printf("   ttas %7.2f %5.3f %8.1f\n", rate / 1e6,
+           (double)min / max, (double)spins / (rate * RUN_SECONDS));
+  }
+}
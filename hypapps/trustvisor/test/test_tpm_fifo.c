@@ -0,0 +1,237 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* xmhf-core's TPM driver itself, on top of tissim instead of a TPM */
+#include <xmhf.h>
+
+#define LOC 2
+
+static uint8_t out[4096];
+
+static uint32_t cmd(uint32_t locality, uint32_t *out_size)
+{
+  uint8_t in[14] = { 0x00, 0xc1, 0, 0, 0, 14, 0, 0, 0, 0x46, 0, 0, 0, 20 };
+
+  memset(out, 0xcc, sizeof(out));
+  return tpm_write_cmd_fifo(locality, in, sizeof(in), out, out_size);
+}
+
+static void check_cmd(uint32_t rsp_size)
+{
+  uint32_t out_size = sizeof(out), i;
+
+  tissim_set_rsp_size(rsp_size);
+  TEST_ASSERT_EQUAL_HEX32(TPM_SUCCESS, cmd(LOC, &out_size));
+  TEST_ASSERT_EQUAL_INT(rsp_size, out_size);
+  TEST_ASSERT_EQUAL_INT(0xc4, out[1]);
+  TEST_ASSERT_EQUAL_INT(rsp_size, (out[4] << 8) | out[5]);
+  for (i = 10; i < rsp_size; i++) {
+    TEST_ASSERT_EQUAL_INT(0, out[i]);
+  }
+  TEST_ASSERT_EQUAL_INT(0xcc, out[rsp_size]);
+}
+
+static void use(tissim_intf_t intf)
+{
+  tissim_init(intf);
+  TEST_ASSERT_TRUE(xmhf_tpm_arch_prepare_tpm());
+  memset(&tissim_stats, 0, sizeof(tissim_stats));
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+  /* nothing out of turn, and the locality given back */
+  TEST_ASSERT_EQUAL_INT(0, tissim_stats.bad_accesses);
+  TEST_ASSERT_EQUAL_INT(-1, tissim_active());
+}
+
+void test_tis12(void)
+{
+  use(TISSIM_TIS12);
+  check_cmd(30);
+  /* more than a burst each way */
+  check_cmd(200);
+  TEST_ASSERT_EQUAL_INT(2, tissim_stats.cmds);
+}
+
+void test_tis13(void)
+{
+  use(TISSIM_TIS13);
+  check_cmd(30);
+  check_cmd(200);
+  /* sizes that aren't a multiple of 4 */
+  check_cmd(31);
+  check_cmd(33);
+}
+
+void test_crb(void)
+{
+  use(TISSIM_CRB);
+  check_cmd(30);
+  check_cmd(200);
+  check_cmd(31);
+}
+
+void test_wide_accesses(void)
+{
+  uint32_t narrow, wide;
+
+  use(TISSIM_TIS12);
+  check_cmd(512);
+  narrow = tissim_stats.accesses;
+
+  use(TISSIM_TIS13);
+  check_cmd(512);
+  wide = tissim_stats.accesses;
+
+  TEST_ASSERT_TRUE(4*wide < narrow);
+}
+
+void test_response_too_large(void)
+{
+  tissim_intf_t intf;
+  uint32_t out_size;
+
+  for (intf = TISSIM_TIS12; intf <= TISSIM_CRB; intf++) {
+    use(intf);
+    tissim_set_rsp_size(200);
+    out_size = 100;
+    TEST_ASSERT_EQUAL_HEX32(TPM_SUCCESS, cmd(LOC, &out_size));
+    TEST_ASSERT_EQUAL_INT(100, out_size);
+    TEST_ASSERT_EQUAL_INT(0xcc, out[100]);
+
+    /* room for no more than the header */
+    out_size = 10;
+    TEST_ASSERT_EQUAL_HEX32(TPM_SUCCESS, cmd(LOC, &out_size));
+    TEST_ASSERT_EQUAL_INT(10, out_size);
+    TEST_ASSERT_EQUAL_INT(0xcc, out[10]);
+
+    /* and the TPM is ready for the next one */
+    check_cmd(30);
+  }
+}
+
+void test_backoff(void)
+{
+  tissim_intf_t intf;
+
+  /* status polls back off while the TPM executes a command, rather
+     than keep the bus busy for all of it: 9 polls to get up to the
+     longest delay, and then one per delay */
+  for (intf = TISSIM_TIS12; intf <= TISSIM_CRB; intf++) {
+    use(intf);
+    check_cmd(30);
+    TEST_ASSERT_TRUE(tissim_stats.busy_polls > 0);
+    TEST_ASSERT_TRUE(tissim_stats.busy_polls
+                     <= 9 + TISSIM_CMD_CYCLES / TISSIM_MHZ / TPM_POLL_MAX_DELAY);
+  }
+}
+
+void test_locality_taken(void)
+{
+  tissim_intf_t intf;
+  uint32_t out_size = sizeof(out);
+
+  for (intf = TISSIM_TIS12; intf <= TISSIM_CRB; intf++) {
+    use(intf);
+    /* the guest has locality 0 */
+    if (intf == TISSIM_CRB) {
+      tissim_writel(TPM_LOCALITY_BASE_N(0) | TPM_CRB_REG_LOC_CTRL,
+                    TPM_CRB_LOC_CTRL_REQUEST);
+    } else {
+      tissim_writeb(TPM_LOCALITY_BASE_N(0) | TPM_REG_ACCESS, 0x02);
+    }
+    TEST_ASSERT_EQUAL_INT(0, tissim_active());
+    TEST_ASSERT_EQUAL_HEX32(TPM_FAIL, cmd(LOC, &out_size));
+    TEST_ASSERT_EQUAL_INT(1, tissim_stats.waits);
+    TEST_ASSERT_EQUAL_INT(0, tissim_stats.cmds);
+
+    /* once it's done, the request goes through */
+    if (intf == TISSIM_CRB) {
+      tissim_writel(TPM_LOCALITY_BASE_N(0) | TPM_CRB_REG_LOC_CTRL,
+                    TPM_CRB_LOC_CTRL_RELINQUISH);
+    } else {
+      tissim_writeb(TPM_LOCALITY_BASE_N(0) | TPM_REG_ACCESS, 0x20);
+    }
+    check_cmd(30);
+  }
+}
+
+void test_benchmark(void)
+{
+  static const char *names[] = { "TIS 1.2", "TIS 1.3", "CRB" };
+  uint32_t sizes[] = { 30, 512 }, n = 20, i, j;
+  tissim_intf_t intf;
+  uint64_t start;
+
+  printf("\n");
+  for (intf = TISSIM_TIS12; intf <= TISSIM_CRB; intf++) {
+    for (j = 0; j < sizeof(sizes)/sizeof(sizes[0]); j++) {
+      use(intf);
+      start = tissim_now();
+      for (i = 0; i < n; i++) {
+        check_cmd(sizes[j]);
+      }
+      printf("%s, %u-byte response: %.0fus per command,"
+             " of which %.0fus transfer; %.1f register accesses, %.1f status polls\n",
+             names[intf], sizes[j],
+             (double)(tissim_now() - start) / n / TISSIM_MHZ,
+             (double)(tissim_now() - start - n*TISSIM_CMD_CYCLES) / n / TISSIM_MHZ,
+             (double)tissim_stats.accesses / n,
+             (double)tissim_stats.busy_polls / n);
+    }
+  }
+}
@@ -0,0 +1,319 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+/* xmhf-core's locality manager and TPM driver themselves, on top of
+   tissim instead of a TPM */
+#include <xmhf.h>
+
+#define LOC 2
+
+static XMHF_TPM_STATS before;
+
+static void stats_delta(XMHF_TPM_STATS *d)
+{
+  xmhf_tpm_stats_read(d);
+  d->acquisitions -= before.acquisitions;
+  d->opens -= before.opens;
+  d->holds -= before.holds;
+  d->cmds -= before.cmds;
+  d->relinquishes -= before.relinquishes;
+}
+
+/* a batch of commands, as an NV hypercall makes */
+static void batch(int cmds)
+{
+  int i;
+
+  TEST_ASSERT_EQUAL_INT(0, xmhf_tpm_locality_acquire(LOC));
+  for (i=0; i < cmds; i++) {
+    TEST_ASSERT_TRUE(tissim_cmd(LOC));
+  }
+  xmhf_tpm_locality_release(LOC);
+}
+
+void setUp(void)
+{
+  /* the manager's state lives on from test to test, as it does from
+     hypercall to hypercall; start each test with nothing open, and
+     LOC already found ready */
+  tissim_init(TISSIM_TIS12);
+  TEST_ASSERT_EQUAL_INT(0, xmhf_tpm_locality_acquire(LOC));
+  xmhf_tpm_locality_release(LOC);
+  xmhf_tpm_locality_relinquish();
+  tissim_init(TISSIM_TIS12);
+  xmhf_tpm_stats_read(&before);
+}
+
+void tearDown(void)
+{
+}
+
+void test_ready_checked_once(void)
+{
+  XMHF_TPM_STATS d;
+
+  /* no other test uses locality 1 */
+  TEST_ASSERT_EQUAL_INT(0, xmhf_tpm_locality_acquire(1));
+  xmhf_tpm_locality_release(1);
+  TEST_ASSERT_EQUAL_INT(1, tissim_stats.ready_checks);
+
+  xmhf_tpm_locality_relinquish();
+  TEST_ASSERT_EQUAL_INT(0, xmhf_tpm_locality_acquire(1));
+  xmhf_tpm_locality_release(1);
+  xmhf_tpm_locality_relinquish();
+  TEST_ASSERT_EQUAL_INT(1, tissim_stats.ready_checks);
+  stats_delta(&d);
+  TEST_ASSERT_EQUAL_INT(2, d.opens);
+}
+
+void test_locality_kept_open(void)
+{
+  XMHF_TPM_STATS d;
+  int i;
+
+  for (i=0; i < 10; i++) {
+    batch(3);
+  }
+  TEST_ASSERT_EQUAL_INT(0, tissim_stats.ready_checks);
+  TEST_ASSERT_EQUAL_INT(30, tissim_stats.cmds);
+
+  stats_delta(&d);
+  TEST_ASSERT_EQUAL_INT(10, d.acquisitions);
+  TEST_ASSERT_EQUAL_INT(1, d.opens);
+  TEST_ASSERT_EQUAL_INT(10, d.holds);
+  TEST_ASSERT_EQUAL_INT(30, d.cmds);
+  TEST_ASSERT_TRUE(d.cmd_max >= TISSIM_CMD_CYCLES);
+}
+
+void test_nesting(void)
+{
+  XMHF_TPM_STATS d;
+
+  TEST_ASSERT_EQUAL_INT(0, xmhf_tpm_locality_acquire(LOC));
+  TEST_ASSERT_EQUAL_INT(0, xmhf_tpm_locality_acquire(LOC));
+  xmhf_tpm_locality_release(LOC);
+
+  /* still held, so neither relinquished nor given up for another */
+  xmhf_tpm_locality_relinquish();
+  TEST_ASSERT_EQUAL_INT(LOC, tissim_active());
+  TEST_ASSERT_EQUAL_INT(1, xmhf_tpm_locality_acquire(1));
+  TEST_ASSERT_TRUE(tissim_cmd(LOC));
+
+  xmhf_tpm_locality_release(LOC);
+  xmhf_tpm_locality_relinquish();
+  stats_delta(&d);
+  TEST_ASSERT_EQUAL_INT(1, d.opens);
+  TEST_ASSERT_EQUAL_INT(1, d.relinquishes);
+}
+
+void test_bad_locality(void)
+{
+  TEST_ASSERT_EQUAL_INT(1, xmhf_tpm_locality_acquire(0));
+  TEST_ASSERT_EQUAL_INT(1, xmhf_tpm_locality_acquire(3));
+  TEST_ASSERT_EQUAL_INT(0, tissim_stats.accesses);
+}
+
+void test_relinquish(void)
+{
+  XMHF_TPM_STATS d;
+
+  batch(1);
+  xmhf_tpm_locality_relinquish();
+  xmhf_tpm_locality_relinquish();
+  batch(1);
+  TEST_ASSERT_EQUAL_INT(0, tissim_stats.ready_checks);
+
+  stats_delta(&d);
+  TEST_ASSERT_EQUAL_INT(1, d.relinquishes);
+  TEST_ASSERT_EQUAL_INT(2, d.opens);
+}
+
+void test_guest_not_blocked(void)
+{
+  int i;
+
+  /* the TIS driver gives up the locality after every command, so
+     keeping it open in the manager leaves the TPM to the guest */
+  for (i=0; i < 5; i++) {
+    batch(2);
+    TEST_ASSERT_TRUE(tissim_cmd(0));
+  }
+  TEST_ASSERT_EQUAL_INT(0, tissim_stats.waits);
+  TEST_ASSERT_EQUAL_INT(-1, tissim_active());
+}
+
+void test_open_failure(void)
+{
+  XMHF_TPM_STATS d;
+
+  tissim_fail_grant(true);
+  TEST_ASSERT_EQUAL_INT(1, xmhf_tpm_locality_acquire(LOC));
+  tissim_fail_grant(false);
+
+  /* the failure isn't remembered as an open locality */
+  batch(1);
+  stats_delta(&d);
+  TEST_ASSERT_EQUAL_INT(1, d.acquisitions);
+  TEST_ASSERT_EQUAL_INT(1, d.opens);
+}
+
+#define THREADS 4
+#define ITERS 200
+
+static volatile int stop_reader;
+
+/* callers serialize their commands, but not acquire and release */
+static pthread_mutex_t cmd_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *batch_thread(void *arg)
+{
+  int i;
+
+  (void)arg;
+  for (i=0; i < ITERS; i++) {
+    if (xmhf_tpm_locality_acquire(LOC)) {
+      return (void*)1;
+    }
+    pthread_mutex_lock(&cmd_lock);
+    tissim_cmd(LOC);
+    pthread_mutex_unlock(&cmd_lock);
+    xmhf_tpm_locality_release(LOC);
+    if (i % 10 == 0) {
+      xmhf_tpm_locality_relinquish();
+    }
+  }
+  return NULL;
+}
+
+static void *reader_thread(void *arg)
+{
+  XMHF_TPM_STATS s;
+  uintptr_t torn = 0;
+
+  (void)arg;
+  while (!stop_reader) {
+    xmhf_tpm_stats_read(&s);
+    if (s.cmd_cycles < s.cmds * TISSIM_CMD_CYCLES
+        || s.holds > s.acquisitions) {
+      torn++;
+    }
+  }
+  return (void*)torn;
+}
+
+void test_threads(void)
+{
+  pthread_t t[THREADS], r;
+  XMHF_TPM_STATS d;
+  void *rv;
+  int i;
+
+  stop_reader = 0;
+  pthread_create(&r, NULL, reader_thread, NULL);
+  for (i=0; i < THREADS; i++) {
+    pthread_create(&t[i], NULL, batch_thread, NULL);
+  }
+  for (i=0; i < THREADS; i++) {
+    pthread_join(t[i], &rv);
+    TEST_ASSERT_NULL(rv);
+  }
+  stop_reader = 1;
+  pthread_join(r, &rv);
+  TEST_ASSERT_NULL(rv);
+
+  stats_delta(&d);
+  TEST_ASSERT_EQUAL_INT(THREADS*ITERS, d.acquisitions);
+  TEST_ASSERT_EQUAL_INT(THREADS*ITERS, d.cmds);
+  TEST_ASSERT_TRUE(d.holds <= d.acquisitions);
+  TEST_ASSERT_TRUE(d.opens <= d.relinquishes + 1);
+
+  /* everything was released */
+  xmhf_tpm_locality_relinquish();
+  TEST_ASSERT_EQUAL_INT(0, xmhf_tpm_locality_acquire(1));
+  xmhf_tpm_locality_release(1);
+}
+
+void test_benchmark(void)
+{
+  uint32_t n = 10, cmds = 2, i, j;
+  uint64_t start, old_cycles, new_cycles;
+  uint32_t old_regs, new_regs;
+
+  /* what an NV hypercall did before: open the locality, check the TPM
+     is ready, and deactivate it afterwards */
+  start = tissim_now();
+  for (i=0; i < n; i++) {
+    TEST_ASSERT_EQUAL_INT(0, xmhf_tpm_open_locality(LOC));
+    for (j=0; j < cmds; j++) {
+      TEST_ASSERT_TRUE(tissim_cmd(LOC));
+    }
+    xmhf_tpm_deactivate_all_localities();
+  }
+  old_cycles = tissim_now() - start;
+  old_regs = tissim_stats.accesses;
+
+  tissim_init(TISSIM_TIS12);
+  start = tissim_now();
+  for (i=0; i < n; i++) {
+    batch(cmds);
+  }
+  new_cycles = tissim_now() - start;
+  new_regs = tissim_stats.accesses;
+
+  printf("\nNV batch of %u TPM commands: %.0fus and %.1f register accesses"
+         " opening the locality every time, %.0fus and %.1f kept open\n",
+         cmds,
+         (double)old_cycles / n / TISSIM_MHZ, (double)old_regs / n,
+         (double)new_cycles / n / TISSIM_MHZ, (double)new_regs / n);
+  TEST_ASSERT_TRUE(2*new_cycles < old_cycles);
+}
@@ -0,0 +1,225 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* libtpm itself, talking to tpmsim instead of a TIS */
+#include <tpm.h>
+#include "tpmsim.h"
+
+#define LOC 2
+
+static uint8_t secret[] = "the quick brown fox jumps over the lazy dog";
+static uint8_t blob[512];
+static uint32_t blob_size;
+
+static void do_seal(void)
+{
+  uint32_t rv;
+
+  blob_size = sizeof(blob);
+  rv = tpm_seal(LOC, TPM_LOC_TWO | TPM_LOC_THREE, 0, NULL, 0, NULL, NULL,
+                sizeof(secret), secret, &blob_size, blob);
+  TEST_ASSERT_EQUAL_HEX32(TPM_SUCCESS, rv);
+}
+
+static uint32_t do_unseal(uint32_t locality, uint8_t *out, uint32_t *out_size)
+{
+  *out_size = sizeof(secret);
+  memset(out, 0xcc, sizeof(secret));
+  return tpm_unseal(locality, blob_size, blob, out_size, out);
+}
+
+static void check_unseal(uint32_t locality)
+{
+  uint8_t out[sizeof(secret)];
+  uint32_t out_size;
+
+  TEST_ASSERT_EQUAL_HEX32(TPM_SUCCESS, do_unseal(locality, out, &out_size));
+  TEST_ASSERT_EQUAL_INT(sizeof(secret), out_size);
+  TEST_ASSERT_EQUAL_MEMORY(secret, out, sizeof(secret));
+}
+
+void setUp(void)
+{
+  tpm_forget_sessions();
+  tpmsim_init();
+  do_seal();
+}
+
+void tearDown(void)
+{
+}
+
+void test_seal_unseal(void)
+{
+  /* seal needs its own OSAP session, and leaves nothing open */
+  TEST_ASSERT_EQUAL_INT(1, tpmsim_stats.osap);
+  TEST_ASSERT_EQUAL_INT(0, tpmsim_stats.open_sessions);
+  check_unseal(LOC);
+}
+
+void test_sessions_reused(void)
+{
+  int i;
+
+  check_unseal(LOC);
+  TEST_ASSERT_EQUAL_INT(2, tpmsim_stats.oiap);
+  TEST_ASSERT_EQUAL_INT(2, tpmsim_stats.open_sessions);
+
+  /* nonces roll on, so every unseal after the first is one command */
+  tpmsim_stats.cmds = 0;
+  for (i=0; i < 10; i++) {
+    check_unseal(LOC);
+  }
+  TEST_ASSERT_EQUAL_INT(10, tpmsim_stats.cmds);
+  TEST_ASSERT_EQUAL_INT(2, tpmsim_stats.oiap);
+}
+
+void test_locality_change(void)
+{
+  check_unseal(LOC);
+
+  /* sessions opened at one locality are flushed, not reused, at another */
+  check_unseal(LOC+1);
+  TEST_ASSERT_EQUAL_INT(2, tpmsim_stats.flush);
+  TEST_ASSERT_EQUAL_INT(4, tpmsim_stats.oiap);
+  TEST_ASSERT_EQUAL_INT(2, tpmsim_stats.open_sessions);
+  TEST_ASSERT_EQUAL_INT(LOC+1, tpmsim_last_locality());
+
+  tpm_flush_sessions(LOC+1);
+  TEST_ASSERT_EQUAL_INT(0, tpmsim_stats.open_sessions);
+}
+
+void test_error_invalidates(void)
+{
+  uint8_t out[sizeof(secret)];
+  uint32_t out_size;
+
+  check_unseal(LOC);
+
+  /* the TPM ends sessions on failure, so they mustn't be used again,
+     and authorization failures aren't retried */
+  tpmsim_fail_next(TPM_AUTHFAIL);
+  TEST_ASSERT_EQUAL_HEX32(TPM_AUTHFAIL, do_unseal(LOC, out, &out_size));
+  TEST_ASSERT_EQUAL_INT(2, tpmsim_stats.unseal);
+  TEST_ASSERT_EQUAL_INT(0, tpmsim_stats.open_sessions);
+
+  check_unseal(LOC);
+  TEST_ASSERT_EQUAL_INT(4, tpmsim_stats.oiap);
+}
+
+void test_stale_sessions(void)
+{
+  check_unseal(LOC);
+
+  /* sessions flushed behind our back cost one retry with new ones */
+  tpmsim_drop_sessions();
+  tpmsim_stats.unseal = 0;
+  check_unseal(LOC);
+  TEST_ASSERT_EQUAL_INT(2, tpmsim_stats.unseal);
+  TEST_ASSERT_EQUAL_INT(4, tpmsim_stats.oiap);
+}
+
+void test_bad_res_auth(void)
+{
+  uint8_t out[sizeof(secret)];
+  uint32_t out_size;
+  uint32_t i;
+
+  check_unseal(LOC);
+
+  /* a response that doesn't authenticate yields nothing */
+  tpmsim_corrupt_next();
+  TEST_ASSERT_EQUAL_HEX32(TPM_FAIL, do_unseal(LOC, out, &out_size));
+  for (i=0; i < out_size; i++) {
+    TEST_ASSERT_EQUAL_HEX8(0, out[i]);
+  }
+  TEST_ASSERT_EQUAL_INT(0, tpmsim_stats.open_sessions);
+
+  check_unseal(LOC);
+}
+
+void test_seal_bad_res_auth(void)
+{
+  uint32_t rv;
+
+  tpmsim_corrupt_next();
+  blob_size = sizeof(blob);
+  rv = tpm_seal(LOC, TPM_LOC_TWO, 0, NULL, 0, NULL, NULL,
+                sizeof(secret), secret, &blob_size, blob);
+  TEST_ASSERT_EQUAL_HEX32(TPM_FAIL, rv);
+}
+
+void test_benchmark(void)
+{
+  uint32_t n = 100, i, cached, uncached;
+
+  /* what each unseal costed before sessions were kept: two OIAPs and
+     the unseal itself. flushing after every unseal stands in for it,
+     plus the flushes. */
+  tpmsim_stats.cmds = 0;
+  for (i=0; i < n; i++) {
+    check_unseal(LOC);
+    tpm_flush_sessions(LOC);
+  }
+  uncached = tpmsim_stats.cmds - 2*n;
+
+  tpmsim_stats.cmds = 0;
+  for (i=0; i < n; i++) {
+    check_unseal(LOC);
+  }
+  cached = tpmsim_stats.cmds;
+
+  printf("\nTPM commands per unseal: %.2f without session caching, %.2f with\n",
+         (double)uncached / n, (double)cached / n);
+  TEST_ASSERT_EQUAL_INT(3*n, uncached);
+  TEST_ASSERT_EQUAL_INT(n+2, cached);
+}
@@ -0,0 +1,480 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* tissim.c - a TPM at the register level */
+
+#include <pthread.h>
+#include <string.h>
+
+#include <xmhf.h>
+
+tissim_stats_t tissim_stats;
+
+#define NR_LOCALITIES   5
+#define BUF_SIZE        0xf80
+
+enum { IDLE, READY, RECEPTION, EXECUTION, COMPLETION };
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t now;
+static tissim_intf_t intf;
+static int active;              /* active locality, -1 if none */
+static uint32_t pending;        /* localities requesting use */
+static bool fail_grant;
+static uint32_t rsp_size_other;
+
+static int state;
+static uint64_t done_at;        /* when the executing command finishes */
+static uint32_t burst_max, credit;
+static uint64_t refill_at;      /* when credit is available again */
+
+static uint8_t cmd[BUF_SIZE], rsp[BUF_SIZE];
+static uint32_t cmd_len, rsp_len, rsp_off;
+
+void tissim_init(tissim_intf_t i)
+{
+  pthread_mutex_lock(&sim_lock);
+  memset(&tissim_stats, 0, sizeof(tissim_stats));
+  intf = i;
+  active = -1;
+  pending = 0;
+  fail_grant = false;
+  rsp_size_other = 30;
+  state = IDLE;
+  burst_max = (intf == TISSIM_TIS12) ? 16 : 64;
+  credit = burst_max;
+  refill_at = 0;
+  cmd_len = rsp_len = rsp_off = 0;
+  pthread_mutex_unlock(&sim_lock);
+}
+
+uint64_t tissim_now(void)
+{
+  return __sync_add_and_fetch(&now, 0);
+}
+
+void tissim_delay(uint64_t cycles)
+{
+  __sync_add_and_fetch(&now, cycles);
+}
+
+int tissim_active(void)
+{
+  return active;
+}
+
+void tissim_fail_grant(bool fail)
+{
+  fail_grant = fail;
+}
+
+void tissim_set_rsp_size(uint32_t size)
+{
+  rsp_size_other = size;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+/* the TPM itself: GetCapability for the flags and timeouts, which the
+ * driver checks, and a response of rsp_size_other bytes to anything
+ * else.
+ */
+static void execute(void)
+{
+  uint32_t ordinal = get32(&cmd[6]), data_size = rsp_size_other - 10;
+
+  memset(rsp, 0, sizeof(rsp));
+  if (ordinal == TPM_ORD_GET_CAPABILITY && cmd_len >= 22) {
+    uint32_t cap = get32(&cmd[10]), sub_cap = get32(&cmd[18]);
+
+    if (cap == TPM_CAP_FLAG) {
+      /* the flags' tag, then all false: enabled and activated */
+      data_size = 4 + 7;
+      put32(&rsp[10], 7);
+      rsp[14] = 0;
+      rsp[15] = (sub_cap == TPM_CAP_FLAG_PERMANENT) ? 0x1f : 0x20;
+      if (sub_cap == TPM_CAP_FLAG_PERMANENT) {
+        tissim_stats.ready_checks++;
+      }
+    } else {
+      /* the TIS timeouts, in us */
+      data_size = 4 + 16;
+      put32(&rsp[10], 16);
+      put32(&rsp[14], 750000);
+      put32(&rsp[18], 2000000);
+      put32(&rsp[22], 750000);
+      put32(&rsp[26], 750000);
+    }
+  }
+  rsp[0] = 0x00;
+  rsp[1] = 0xc4;
+  rsp_len = 10 + data_size;
+  put32(&rsp[2], rsp_len);
+  put32(&rsp[6], 0);
+  rsp_off = 0;
+
+  tissim_stats.cmds++;
+  done_at = tissim_now() + TISSIM_CMD_CYCLES;
+  state = EXECUTION;
+}
+
+static bool executing(void)
+{
+  if (state == EXECUTION) {
+    if (tissim_now() < done_at) {
+      return true;
+    }
+    state = COMPLETION;
+    credit = burst_max;
+  }
+  return false;
+}
+
+static void request(uint32_t locality)
+{
+  if (fail_grant) {
+    return;
+  }
+  if (active < 0) {
+    active = locality;
+  } else if (active != (int)locality) {
+    if (!(pending & (1 << locality))) {
+      tissim_stats.waits++;
+    }
+    pending |= 1 << locality;
+  }
+}
+
+static void relinquish(uint32_t locality)
+{
+  int i;
+
+  pending &= ~(1 << locality);
+  if (active != (int)locality) {
+    return;
+  }
+  /* the highest pending locality gets the TPM */
+  active = -1;
+  for (i = NR_LOCALITIES - 1; i >= 0; i--) {
+    if (pending & (1 << i)) {
+      pending &= ~(1 << i);
+      active = i;
+      break;
+    }
+  }
+}
+
+/* a FIFO data byte moved; bursts take a while to refill */
+static void burst(void)
+{
+  if (credit > 0 && --credit == 0) {
+    credit = burst_max;
+    refill_at = tissim_now() + TISSIM_REFILL_CYCLES;
+  }
+}
+
+static uint32_t burst_count(void)
+{
+  return tissim_now() < refill_at ? 0 : credit;
+}
+
+static uint8_t fifo_read(uint32_t locality, uint32_t reg)
+{
+  uint32_t sts;
+
+  switch (reg) {
+  case TPM_REG_ACCESS:
+    return 0x80                                   /* valid */
+      | (active == (int)locality ? 0x20 : 0)
+      | ((pending & ~(1 << locality)) ? 0x04 : 0)
+      | ((pending & (1 << locality)) ? 0x02 : 0);
+  case TPM_REG_STS: case TPM_REG_STS + 1: case TPM_REG_STS + 2:
+    if (active != (int)locality) {
+      return 0xff;
+    }
+    sts = 0x80;                                   /* valid */
+    if (!executing()) {
+      if (state == READY) {
+        sts |= 0x40;
+      }
+      if (state == RECEPTION
+          && (cmd_len < 6 || cmd_len < get32(&cmd[2]))) {
+        sts |= 0x08;
+      }
+      if (state == COMPLETION && rsp_off < rsp_len) {
+        sts |= 0x10;
+      }
+      if (state == READY || state == RECEPTION
+          || (state == COMPLETION && rsp_off < rsp_len)) {
+        sts |= burst_count() << 8;
+      }
+    }
+    return sts >> (8 * (reg - TPM_REG_STS));
+  case TPM_REG_DATA_FIFO:
+    if (active != (int)locality || state != COMPLETION || rsp_off >= rsp_len) {
+      tissim_stats.bad_accesses++;
+      return 0xff;
+    }
+    burst();
+    return rsp[rsp_off++];
+  case TPM_REG_INTF_CAPABILITY + 1:
+    return intf == TISSIM_TIS13 ? 0x06 : 0;       /* 64-byte transfers */
+  case TPM_REG_INTF_CAPABILITY + 3:
+    return intf == TISSIM_TIS13 ? 0x20 : 0;       /* TIS 1.3 */
+  case TPM_REG_INTERFACE_ID:
+    return intf == TISSIM_TIS13 ? 0x0f : 0xff;
+  default:
+    return intf == TISSIM_TIS13 ? 0 : 0xff;
+  }
+}
+
+static void fifo_write(uint32_t locality, uint32_t reg, uint8_t val)
+{
+  switch (reg) {
+  case TPM_REG_ACCESS:
+    if (val & 0x02) {
+      request(locality);
+    }
+    if (val & 0x20) {
+      relinquish(locality);
+    }
+    return;
+  case TPM_REG_STS:
+    if (active != (int)locality || executing()) {
+      return;
+    }
+    if (val & 0x40) {
+      /* command ready, aborting whatever was going on */
+      state = READY;
+      cmd_len = 0;
+      credit = burst_max;
+    }
+    if ((val & 0x20) && state == RECEPTION
+        && cmd_len >= 10 && cmd_len == get32(&cmd[2])) {
+      execute();
+    }
+    return;
+  case TPM_REG_DATA_FIFO:
+    if (active != (int)locality || (state != READY && state != RECEPTION)
+        || cmd_len >= sizeof(cmd) || burst_count() == 0) {
+      tissim_stats.bad_accesses++;
+      return;
+    }
+    state = RECEPTION;
+    cmd[cmd_len++] = val;
+    burst();
+    return;
+  }
+}
+
+static uint32_t crb_read(uint32_t locality, uint32_t reg)
+{
+  switch (reg) {
+  case TPM_CRB_REG_LOC_STATE:
+    return TPM_CRB_LOC_STATE_VALID
+      | (active >= 0 ? TPM_CRB_LOC_STATE_ASSIGNED | (active << 2) : 0);
+  case TPM_CRB_REG_CTRL_REQ:
+    return 0;
+  case TPM_CRB_REG_CTRL_STS:
+    return state == IDLE ? TPM_CRB_CTRL_STS_IDLE : 0;
+  case TPM_CRB_REG_CTRL_START:
+    return executing() ? 1 : 0;
+  case TPM_CRB_REG_CMD_SIZE:
+  case TPM_CRB_REG_RSP_SIZE:
+    return BUF_SIZE;
+  case TPM_CRB_REG_CMD_LADDR:
+  case TPM_CRB_REG_RSP_ADDR:
+    return TPM_LOCALITY_BASE_N(locality) | TPM_CRB_DATA_BUFFER;
+  case TPM_REG_INTERFACE_ID:
+    return TPM_INTERFACE_TYPE_CRB;
+  default:
+    return 0;
+  }
+}
+
+static void crb_write(uint32_t locality, uint32_t reg, uint32_t val)
+{
+  switch (reg) {
+  case TPM_CRB_REG_LOC_CTRL:
+    if (val & TPM_CRB_LOC_CTRL_REQUEST) {
+      request(locality);
+    }
+    if (val & TPM_CRB_LOC_CTRL_RELINQUISH) {
+      relinquish(locality);
+    }
+    return;
+  case TPM_CRB_REG_CTRL_REQ:
+    if (active != (int)locality || executing()) {
+      return;
+    }
+    if (val & TPM_CRB_CTRL_REQ_CMD_READY) {
+      state = READY;
+    }
+    if (val & TPM_CRB_CTRL_REQ_GO_IDLE) {
+      state = IDLE;
+    }
+    return;
+  case TPM_CRB_REG_CTRL_START:
+    if (active == (int)locality && state != IDLE && !executing()
+        && (val & 1)) {
+      cmd_len = get32(&cmd[2]);
+      if (cmd_len > sizeof(cmd)) {
+        cmd_len = sizeof(cmd);
+      }
+      execute();
+      /* the response goes to the same buffer */
+      memcpy(cmd, rsp, sizeof(cmd));
+    }
+    return;
+  }
+}
+
+/* an access of size bytes at addr */
+static uint32_t access(uint32_t addr, uint32_t size, bool write, uint32_t val)
+{
+  uint32_t locality = (addr - TPM_LOCALITY_BASE) >> 12;
+  uint32_t reg = addr & 0xfff, ret = 0, i;
+
+  pthread_mutex_lock(&sim_lock);
+  tissim_delay(TISSIM_ACCESS_CYCLES + size * TISSIM_BYTE_CYCLES);
+  tissim_stats.accesses++;
+  if (!write && (reg == TPM_REG_STS
+                 || (intf == TISSIM_CRB && reg == TPM_CRB_REG_CTRL_START))
+      && executing()) {
+    tissim_stats.busy_polls++;
+  }
+
+  if (intf == TISSIM_CRB) {
+    if (reg >= TPM_CRB_DATA_BUFFER) {
+      /* the buffer takes any access, at any locality */
+      for (i = 0; i < size; i++) {
+        if (write) {
+          cmd[reg - TPM_CRB_DATA_BUFFER + i] = val >> (8 * i);
+        } else {
+          ret |= (uint32_t)cmd[reg - TPM_CRB_DATA_BUFFER + i] << (8 * i);
+        }
+      }
+    } else if (size != 4 || (reg & 3)) {
+      tissim_stats.bad_accesses++;
+    } else if (write) {
+      crb_write(locality, reg, val);
+    } else {
+      ret = crb_read(locality, reg);
+    }
+  } else {
+    if (size == 4 && intf == TISSIM_TIS12 && reg == TPM_REG_DATA_FIFO) {
+      tissim_stats.bad_accesses++;
+    }
+    /* the FIFO takes the bytes of a wider access one after another */
+    for (i = 0; i < size; i++) {
+      uint32_t r = (reg == TPM_REG_DATA_FIFO) ? reg : reg + i;
+
+      if (write) {
+        fifo_write(locality, r, val >> (8 * i));
+      } else {
+        ret |= (uint32_t)fifo_read(locality, r) << (8 * i);
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&sim_lock);
+  return ret;
+}
+
+uint8_t tissim_readb(uint32_t addr)
+{
+  return access(addr, 1, false, 0);
+}
+
+void tissim_writeb(uint32_t addr, uint8_t val)
+{
+  access(addr, 1, true, val);
+}
+
+uint32_t tissim_readl(uint32_t addr)
+{
+  return access(addr, 4, false, 0);
+}
+
+void tissim_writel(uint32_t addr, uint32_t val)
+{
+  access(addr, 4, true, val);
+}
+
+bool tissim_cmd(uint32_t locality)
+{
+  uint8_t in[14] = { 0x00, 0xc1, 0, 0, 0, 14, 0, 0, 0, 0x46, 0, 0, 0, 20 };
+  uint8_t out[BUF_SIZE];
+  uint32_t out_size = sizeof(out);
+
+  return tpm_write_cmd_fifo(locality, in, sizeof(in), out, &out_size)
+    == TPM_SUCCESS;
+}
+
+/* TXT isn't simulated, so the driver takes the AMD path */
+int xmhf_tpm_arch_x86vmx_open_locality(int locality)
+{
+  (void)locality;
+  return 1;
+}
+
+void print_hex(const char *prefix, const void *prtptr, size_t size)
+{
+  (void)prefix;
+  (void)prtptr;
+  (void)size;
+}
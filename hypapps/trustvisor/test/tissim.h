@@ -0,0 +1,113 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* tissim.h - a TPM at the register level, for testing xmhf-core's TPM
+ * driver (xmhf-tpm/arch/x86/tpm-x86.c) and locality manager on the
+ * host. it has the locality arbitration, status and data FIFO
+ * registers of a TIS 1.2 or 1.3 FIFO interface, or the registers and
+ * buffer of a PTP CRB interface, and answers enough of TPM 1.2 for
+ * the driver to find it ready. every register access costs simulated
+ * time, according to its width, and commands take a while to execute.
+ */
+
+#ifndef TISSIM_H
+#define TISSIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* simulated TSC cycles, at TISSIM_MHZ */
+#define TISSIM_MHZ              2000
+#define TISSIM_ACCESS_CYCLES    1000ULL      /* a bus cycle */
+#define TISSIM_BYTE_CYCLES      250ULL       /* and for each byte moved */
+#define TISSIM_REFILL_CYCLES    20000ULL     /* a FIFO burst */
+#define TISSIM_CMD_CYCLES       2000000ULL   /* the TPM executing a command */
+#define TISSIM_PAUSE_CYCLES     100ULL       /* a spin-wait iteration */
+
+typedef enum {
+  TISSIM_TIS12,         /* TIS 1.2 FIFO: single bytes, small bursts */
+  TISSIM_TIS13,         /* TIS 1.3 FIFO: 4-byte accesses, large bursts */
+  TISSIM_CRB,           /* PTP CRB */
+} tissim_intf_t;
+
+typedef struct {
+  uint32_t accesses;    /* register accesses */
+  uint32_t busy_polls;  /* status reads while a command was executing */
+  uint32_t cmds;
+  uint32_t ready_checks;        /* permanent flags read */
+  uint32_t waits;       /* locality requests that had to wait */
+  uint32_t bad_accesses;        /* accesses the interface doesn't allow */
+} tissim_stats_t;
+
+extern tissim_stats_t tissim_stats;
+
+void tissim_init(tissim_intf_t intf);
+
+/* the simulated TSC, and waiting on it */
+uint64_t tissim_now(void);
+void tissim_delay(uint64_t cycles);
+
+/* the active locality, or -1 */
+int tissim_active(void);
+
+/* stops locality requests from being granted, until called with false */
+void tissim_fail_grant(bool fail);
+
+/* the size of the response to commands other than GetCapability */
+void tissim_set_rsp_size(uint32_t size);
+
+/* the TPM's registers, from TPM_LOCALITY_BASE */
+uint8_t tissim_readb(uint32_t addr);
+void tissim_writeb(uint32_t addr, uint8_t val);
+uint32_t tissim_readl(uint32_t addr);
+void tissim_writel(uint32_t addr, uint32_t val);
+
+/* sends a command through the driver at locality; true if it went
+ * through with TPM_SUCCESS.
+ */
+bool tissim_cmd(uint32_t locality);
+
+#endif
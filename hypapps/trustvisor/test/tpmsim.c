@@ -0,0 +1,573 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* tpmsim.c - a TPM 1.2 for testing libtpm's authorization sessions */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <tpm.h>
+#include <tomcrypt.h>
+
+#include "tpmsim.h"
+
+#define NONCE_SIZE 20
+#define AUTH_SIZE 20
+#define MAX_SESSIONS 3          /* as few as some real TPMs have */
+
+#define TPM_TAG_RSP_COMMAND       0x00C4
+#define TPM_TAG_RSP_AUTH1_COMMAND 0x00C5
+#define TPM_TAG_RSP_AUTH2_COMMAND 0x00C6
+
+/* what follows the parameters of an authorized command */
+#define AUTH_IN_SIZE (4 + NONCE_SIZE + 1 + AUTH_SIZE)
+
+typedef struct {
+  bool used;
+  uint32_t handle;
+  bool osap;
+  uint8_t shared_secret[AUTH_SIZE];
+  uint8_t nonce_even[NONCE_SIZE];
+} session_t;
+
+/* what an authorized command carries for one session */
+typedef struct {
+  session_t *s;
+  const uint8_t *nonce_odd;
+  uint8_t cont;
+  const uint8_t *auth;
+} auth_in_t;
+
+tpmsim_stats_t tpmsim_stats;
+
+static session_t sessions[MAX_SESSIONS];
+static uint32_t next_handle;
+static uint32_t nonce_count;
+static uint32_t fail_next;
+static bool corrupt_next;
+static uint32_t last_locality;
+static const uint8_t srk_auth[AUTH_SIZE];
+
+static uint32_t get32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+    ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v >> 8; p[1] = v;
+}
+
+static int sha1_idx(void)
+{
+  int idx = find_hash("sha1");
+  if (idx < 0) {
+    idx = register_hash(&sha1_desc);
+  }
+  return idx;
+}
+
+static void sha1(const uint8_t *a, size_t a_len,
+                 const uint8_t *b, size_t b_len, uint8_t *out)
+{
+  hash_state md;
+
+  sha1_init(&md);
+  sha1_process(&md, a, a_len);
+  sha1_process(&md, b, b_len);
+  sha1_done(&md, out);
+}
+
+/* hmac(key, digest || nonce_even || nonce_odd || cont) */
+static void auth_hmac(const uint8_t *key, const uint8_t *digest,
+                      const uint8_t *nonce_even, const uint8_t *nonce_odd,
+                      uint8_t cont, uint8_t *out)
+{
+  uint8_t buf[20 + 2*NONCE_SIZE + 1];
+  unsigned long out_len = AUTH_SIZE;
+
+  memcpy(buf, digest, 20);
+  memcpy(buf + 20, nonce_even, NONCE_SIZE);
+  memcpy(buf + 20 + NONCE_SIZE, nonce_odd, NONCE_SIZE);
+  buf[20 + 2*NONCE_SIZE] = cont;
+  hmac_memory(sha1_idx(), key, AUTH_SIZE, buf, sizeof(buf), out, &out_len);
+}
+
+static void new_nonce(uint8_t *nonce)
+{
+  uint8_t buf[4];
+
+  put32(buf, ++nonce_count);
+  sha1(buf, sizeof(buf), (const uint8_t *)"tpmsim", 6, nonce);
+}
+
+static session_t *find_session(uint32_t handle)
+{
+  int i;
+
+  for (i=0; i < MAX_SESSIONS; i++) {
+    if (sessions[i].used && sessions[i].handle == handle) {
+      return &sessions[i];
+    }
+  }
+  return NULL;
+}
+
+static session_t *new_session(void)
+{
+  int i;
+
+  for (i=0; i < MAX_SESSIONS; i++) {
+    if (!sessions[i].used) {
+      memset(&sessions[i], 0, sizeof(sessions[i]));
+      sessions[i].used = true;
+      sessions[i].handle = ++next_handle;
+      new_nonce(sessions[i].nonce_even);
+      tpmsim_stats.open_sessions++;
+      return &sessions[i];
+    }
+  }
+  return NULL;
+}
+
+static void end_session(session_t *s)
+{
+  if (s && s->used) {
+    s->used = false;
+    tpmsim_stats.open_sessions--;
+  }
+}
+
+void tpmsim_init(void)
+{
+  memset(sessions, 0, sizeof(sessions));
+  memset(&tpmsim_stats, 0, sizeof(tpmsim_stats));
+  next_handle = 0x02000000;
+  fail_next = TPM_SUCCESS;
+  corrupt_next = false;
+}
+
+void tpmsim_drop_sessions(void)
+{
+  int i;
+
+  for (i=0; i < MAX_SESSIONS; i++) {
+    end_session(&sessions[i]);
+  }
+}
+
+void tpmsim_fail_next(uint32_t rc)
+{
+  fail_next = rc;
+}
+
+void tpmsim_corrupt_next(void)
+{
+  corrupt_next = true;
+}
+
+uint32_t tpmsim_last_locality(void)
+{
+  return last_locality;
+}
+
+/* parses the authorization of session n of n_auth, which come last */
+static void get_auth_in(const uint8_t *in, uint32_t in_size,
+                        int n, int n_auth, auth_in_t *a)
+{
+  const uint8_t *p = in + in_size - (n_auth - n) * AUTH_IN_SIZE;
+
+  a->s = find_session(get32(p));
+  a->nonce_odd = p + 4;
+  a->cont = p[4 + NONCE_SIZE];
+  a->auth = p + 4 + NONCE_SIZE + 1;
+}
+
+static bool check_auth_in(const auth_in_t *a, const uint8_t *key,
+                          const uint8_t *digest)
+{
+  uint8_t auth[AUTH_SIZE];
+
+  auth_hmac(key, digest, a->s->nonce_even, a->nonce_odd, a->cont, auth);
+  return memcmp(auth, a->auth, AUTH_SIZE) == 0;
+}
+
+/* appends the authorization of a response to out, rolling the nonce */
+static uint32_t put_auth_out(uint8_t *out, const auth_in_t *a,
+                             const uint8_t *key, const uint8_t *digest)
+{
+  new_nonce(a->s->nonce_even);
+  memcpy(out, a->s->nonce_even, NONCE_SIZE);
+  out[NONCE_SIZE] = a->cont;
+  auth_hmac(key, digest, a->s->nonce_even, a->nonce_odd, a->cont,
+            out + NONCE_SIZE + 1);
+  if (corrupt_next) {
+    out[NONCE_SIZE + 1] ^= 1;
+  }
+  if (!a->cont) {
+    end_session(a->s);
+  }
+  return NONCE_SIZE + 1 + AUTH_SIZE;
+}
+
+/* sha1(ordinal || params), the digest authorized commands sign */
+static void in_digest(uint32_t ord, const uint8_t *params, uint32_t size,
+                      uint8_t *digest)
+{
+  uint8_t buf[4];
+
+  put32(buf, ord);
+  sha1(buf, sizeof(buf), params, size, digest);
+}
+
+/* sha1(TPM_SUCCESS || ordinal || params), what responses sign */
+static void out_digest(uint32_t ord, const uint8_t *params, uint32_t size,
+                       uint8_t *digest)
+{
+  uint8_t buf[8];
+
+  put32(buf, TPM_SUCCESS);
+  put32(buf + 4, ord);
+  sha1(buf, sizeof(buf), params, size, digest);
+}
+
+static uint32_t oiap(uint8_t *out, uint32_t *out_size)
+{
+  session_t *s = new_session();
+
+  tpmsim_stats.oiap++;
+  if (!s) {
+    return TPM_NOSPACE;
+  }
+  put32(out, s->handle);
+  memcpy(out + 4, s->nonce_even, NONCE_SIZE);
+  *out_size = 4 + NONCE_SIZE;
+  return TPM_SUCCESS;
+}
+
+static uint32_t osap(const uint8_t *in, uint32_t in_size,
+                     uint8_t *out, uint32_t *out_size)
+{
+  uint8_t nonces[2*NONCE_SIZE];
+  unsigned long len = AUTH_SIZE;
+  session_t *s;
+
+  tpmsim_stats.osap++;
+  if (in_size != 2 + 4 + NONCE_SIZE ||
+      get16(in) != TPM_ET_SRK || get32(in + 2) != TPM_KH_SRK) {
+    return TPM_BAD_PARAMETER;
+  }
+  if (!(s = new_session())) {
+    return TPM_NOSPACE;
+  }
+  s->osap = true;
+
+  /* shared secret = hmac(srk_auth, nonce_even_osap || nonce_odd_osap) */
+  new_nonce(nonces);
+  memcpy(nonces + NONCE_SIZE, in + 6, NONCE_SIZE);
+  hmac_memory(sha1_idx(), srk_auth, AUTH_SIZE, nonces, sizeof(nonces),
+              s->shared_secret, &len);
+
+  put32(out, s->handle);
+  memcpy(out + 4, s->nonce_even, NONCE_SIZE);
+  memcpy(out + 4 + NONCE_SIZE, nonces, NONCE_SIZE);
+  *out_size = 4 + 2*NONCE_SIZE;
+  return TPM_SUCCESS;
+}
+
+/* the sealed blob: TPM_STORED_DATA12 whose encData is just the blob's
+   authdata followed by the data */
+static uint32_t seal(const uint8_t *in, uint32_t in_size,
+                     uint8_t *out, uint32_t *out_size)
+{
+  const uint8_t *params = in + 4;
+  uint32_t params_size, pcr_info_size, data_size, off;
+  uint8_t digest[20], pad[20], blob_auth[AUTH_SIZE];
+  auth_in_t a;
+  int i;
+
+  if (in_size < 4 + AUTH_SIZE + 4 + 4 + AUTH_IN_SIZE) {
+    return TPM_BAD_PARAMETER;
+  }
+  get_auth_in(in, in_size, 0, 1, &a);
+  if (!a.s || !a.s->osap) {
+    return TPM_INVALID_AUTHHANDLE;
+  }
+  params_size = in_size - 4 - AUTH_IN_SIZE;
+  pcr_info_size = get32(params + AUTH_SIZE);
+  if (AUTH_SIZE + 4 + pcr_info_size + 4 > params_size) {
+    return TPM_BAD_PARAMETER;
+  }
+  data_size = get32(params + AUTH_SIZE + 4 + pcr_info_size);
+  if (AUTH_SIZE + 4 + pcr_info_size + 4 + data_size != params_size) {
+    return TPM_BAD_PARAMETER;
+  }
+
+  in_digest(TPM_ORD_SEAL, params, params_size, digest);
+  if (!check_auth_in(&a, a.s->shared_secret, digest)) {
+    return TPM_AUTHFAIL;
+  }
+
+  /* blob_auth = enc_auth xor sha1(shared_secret || nonce_even) */
+  sha1(a.s->shared_secret, AUTH_SIZE, a.s->nonce_even, NONCE_SIZE, pad);
+  for (i=0; i < AUTH_SIZE; i++) {
+    blob_auth[i] = params[i] ^ pad[i];
+  }
+
+  off = 0;
+  put16(out + off, TPM_TAG_STORED_DATA12); off += 2;
+  put16(out + off, 0); off += 2;
+  put32(out + off, pcr_info_size); off += 4;
+  memcpy(out + off, params + AUTH_SIZE + 4, pcr_info_size);
+  off += pcr_info_size;
+  put32(out + off, AUTH_SIZE + data_size); off += 4;
+  memcpy(out + off, blob_auth, AUTH_SIZE); off += AUTH_SIZE;
+  memcpy(out + off, params + AUTH_SIZE + 4 + pcr_info_size + 4, data_size);
+  off += data_size;
+
+  out_digest(TPM_ORD_SEAL, out, off, digest);
+  off += put_auth_out(out + off, &a, a.s->shared_secret, digest);
+  *out_size = off;
+  return TPM_SUCCESS;
+}
+
+static uint32_t unseal(const uint8_t *in, uint32_t in_size,
+                       uint8_t *out, uint32_t *out_size,
+                       auth_in_t *a, auth_in_t *a_d)
+{
+  const uint8_t *params = in + 4;
+  const uint8_t *enc;
+  uint32_t params_size, pcr_info_size, enc_size, off;
+  uint8_t digest[20];
+
+  if (in_size < 4 + 8 + 4 + 2*AUTH_IN_SIZE) {
+    return TPM_BAD_PARAMETER;
+  }
+  get_auth_in(in, in_size, 0, 2, a);
+  get_auth_in(in, in_size, 1, 2, a_d);
+  if (!a->s || !a_d->s || a->s == a_d->s || a->s->osap || a_d->s->osap) {
+    return TPM_INVALID_AUTHHANDLE;
+  }
+
+  params_size = in_size - 4 - 2*AUTH_IN_SIZE;
+  if (get16(params) != TPM_TAG_STORED_DATA12) {
+    return TPM_BAD_PARAMETER;
+  }
+  pcr_info_size = get32(params + 4);
+  if (8 + pcr_info_size + 4 > params_size) {
+    return TPM_BAD_PARAMETER;
+  }
+  enc_size = get32(params + 8 + pcr_info_size);
+  enc = params + 8 + pcr_info_size + 4;
+  if (8 + pcr_info_size + 4 + enc_size != params_size ||
+      enc_size < AUTH_SIZE) {
+    return TPM_BAD_PARAMETER;
+  }
+
+  in_digest(TPM_ORD_UNSEAL, params, params_size, digest);
+  if (!check_auth_in(a, srk_auth, digest)) {
+    return TPM_AUTHFAIL;
+  }
+  if (!check_auth_in(a_d, enc, digest)) {
+    return TPM_AUTH2FAIL;
+  }
+
+  off = 0;
+  put32(out, enc_size - AUTH_SIZE); off += 4;
+  memcpy(out + off, enc + AUTH_SIZE, enc_size - AUTH_SIZE);
+  off += enc_size - AUTH_SIZE;
+
+  out_digest(TPM_ORD_UNSEAL, out, off, digest);
+  off += put_auth_out(out + off, a, srk_auth, digest);
+  off += put_auth_out(out + off, a_d, enc, digest);
+  *out_size = off;
+  return TPM_SUCCESS;
+}
+
+static uint32_t flush_specific(const uint8_t *in, uint32_t in_size)
+{
+  session_t *s;
+
+  tpmsim_stats.flush++;
+  if (in_size != 8 || get32(in + 4) != TPM_RT_AUTH) {
+    return TPM_BAD_PARAMETER;
+  }
+  if (!(s = find_session(get32(in)))) {
+    return TPM_INVALID_AUTHHANDLE;
+  }
+  end_session(s);
+  return TPM_SUCCESS;
+}
+
+static uint32_t get_random(const uint8_t *in, uint32_t in_size,
+                           uint8_t *out, uint32_t *out_size)
+{
+  uint32_t n, i;
+
+  tpmsim_stats.get_random++;
+  if (in_size != 4) {
+    return TPM_BAD_PARAMETER;
+  }
+  n = get32(in);
+  if (n > TPM_RSP_SIZE_MAX - RSP_HEAD_SIZE - 4) {
+    n = TPM_RSP_SIZE_MAX - RSP_HEAD_SIZE - 4;
+  }
+  put32(out, n);
+  for (i=0; i < n; i++) {
+    out[4 + i] = (uint8_t)(i * 37 + nonce_count++);
+  }
+  *out_size = 4 + n;
+  return TPM_SUCCESS;
+}
+
+/* libtpm's other dependency. libxmhfutil's own doesn't build against
+   libc. */
+void print_hex(const char *prefix, const void *prtptr, size_t size)
+{
+  const uint8_t *p = prtptr;
+  size_t i;
+
+  for (i=0; i < size; i++) {
+    if (i % 16 == 0 && prefix) {
+      printf("%s", prefix);
+    }
+    printf("%02x%s", p[i], (i % 16 == 15 || i+1 == size) ? "\n" : " ");
+  }
+}
+
+uint32_t tpm_write_cmd_fifo(uint32_t locality, uint8_t *in,
+                            uint32_t in_size, uint8_t *out,
+                            uint32_t *out_size)
+{
+  static uint8_t rsp[TPM_RSP_SIZE_MAX];
+  uint32_t ord, ret, body_size = 0, rsp_size;
+  auth_in_t a[2];
+  int n_auth = 0;
+
+  if (in_size < CMD_HEAD_SIZE || get32(in + CMD_SIZE_OFFSET) != in_size) {
+    return TPM_BAD_PARAMETER;
+  }
+  last_locality = locality;
+  tpmsim_stats.cmds++;
+  ord = get32(in + CMD_ORD_OFFSET);
+  in += CMD_HEAD_SIZE;
+  in_size -= CMD_HEAD_SIZE;
+
+  switch (ord) {
+  case TPM_ORD_OIAP:
+    ret = oiap(rsp + RSP_HEAD_SIZE, &body_size);
+    break;
+  case TPM_ORD_OSAP:
+    ret = osap(in, in_size, rsp + RSP_HEAD_SIZE, &body_size);
+    break;
+  case TPM_ORD_SEAL:
+    tpmsim_stats.seal++;
+    n_auth = 1;
+    ret = fail_next ? fail_next
+      : seal(in, in_size, rsp + RSP_HEAD_SIZE, &body_size);
+    if (ret != TPM_SUCCESS) {
+      get_auth_in(in, in_size, 0, 1, &a[0]);
+    }
+    break;
+  case TPM_ORD_UNSEAL:
+    tpmsim_stats.unseal++;
+    n_auth = 2;
+    ret = fail_next ? fail_next
+      : unseal(in, in_size, rsp + RSP_HEAD_SIZE, &body_size, &a[0], &a[1]);
+    if (ret != TPM_SUCCESS) {
+      get_auth_in(in, in_size, 0, 2, &a[0]);
+      get_auth_in(in, in_size, 1, 2, &a[1]);
+    }
+    break;
+  case TPM_ORD_FLUSH_SPECIFIC:
+    ret = flush_specific(in, in_size);
+    break;
+  case TPM_ORD_GET_RANDOM:
+    ret = get_random(in, in_size, rsp + RSP_HEAD_SIZE, &body_size);
+    break;
+  default:
+    ret = TPM_BAD_ORDINAL;
+    break;
+  }
+
+  if (n_auth) {
+    fail_next = TPM_SUCCESS;
+    corrupt_next = false;
+  }
+
+  /* a failed command terminates its sessions, and returns nothing */
+  if (ret != TPM_SUCCESS) {
+    int i;
+    for (i=0; i < n_auth; i++) {
+      end_session(a[i].s);
+    }
+    body_size = 0;
+  }
+
+  rsp_size = RSP_HEAD_SIZE + body_size;
+  put16(rsp, n_auth == 2 ? TPM_TAG_RSP_AUTH2_COMMAND
+        : n_auth == 1 ? TPM_TAG_RSP_AUTH1_COMMAND : TPM_TAG_RSP_COMMAND);
+  put32(rsp + RSP_SIZE_OFFSET, rsp_size);
+  put32(rsp + RSP_RST_OFFSET, ret);
+
+  if (rsp_size > *out_size) {
+    rsp_size = *out_size;
+  }
+  memcpy(out, rsp, rsp_size);
+  *out_size = rsp_size;
+  return ret;
+}
@@ -0,0 +1,89 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* tpmsim.h - a TPM 1.2 standing in for the real one behind libtpm's
+ * tpm_write_cmd_fifo, for testing authorization sessions on the
+ * host. it implements just enough of the commands libtpm uses for
+ * sealing: OIAP, OSAP, Seal, Unseal, FlushSpecific and GetRandom.
+ * authorization is checked as a TPM would, rolling nonces included,
+ * but sealed blobs aren't encrypted.
+ */
+
+#ifndef TPMSIM_H
+#define TPMSIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+  uint32_t cmds;
+  uint32_t oiap;
+  uint32_t osap;
+  uint32_t seal;
+  uint32_t unseal;
+  uint32_t flush;
+  uint32_t get_random;
+  uint32_t open_sessions;
+} tpmsim_stats_t;
+
+extern tpmsim_stats_t tpmsim_stats;
+
+/* powers up a TPM with no sessions open and an all-zero SRK authdata */
+void tpmsim_init(void);
+
+/* drops all sessions, as if someone else had flushed them */
+void tpmsim_drop_sessions(void);
+
+/* makes the next authorized command fail with rc */
+void tpmsim_fail_next(uint32_t rc);
+
+/* makes the TPM send a bad resAuth in the next authorized response */
+void tpmsim_corrupt_next(void);
+
+/* the locality of the last command */
+uint32_t tpmsim_last_locality(void);
+
+#endif
@@ -124,6 +124,7 @@ extern uint32_t tpm_write_cmd_fifo(uint32_t locality, uint8_t *in,
 #define TPM_BASE                0x00000000
 #define TPM_NON_FATAL           0x00000800
 #define TPM_SUCCESS             TPM_BASE
+#define TPM_AUTHFAIL            (TPM_BASE + 1)
 #define TPM_BADINDEX            (TPM_BASE + 2)
 #define TPM_BAD_PARAMETER       (TPM_BASE + 3)
 #define TPM_DEACTIVATED         (TPM_BASE + 6)
@@ -131,6 +132,8 @@ extern uint32_t tpm_write_cmd_fifo(uint32_t locality, uint8_t *in,
 #define TPM_FAIL                (TPM_BASE + 9)
 #define TPM_BAD_ORDINAL         (TPM_BASE + 10)
 #define TPM_NOSPACE             (TPM_BASE + 17)
+#define TPM_AUTH2FAIL           (TPM_BASE + 29)
+#define TPM_INVALID_AUTHHANDLE  (TPM_BASE + 34)
 #define TPM_NOTRESETABLE        (TPM_BASE + 50)
 #define TPM_NOTLOCAL            (TPM_BASE + 51)
 #define TPM_BAD_LOCALITY        (TPM_BASE + 61)
@@ -292,6 +295,22 @@ extern uint32_t tpm_unseal(
                   uint32_t sealed_data_size, const uint8_t *sealed_data,
                   uint32_t *secret_size, uint8_t *secret);
 
+/*
+ * tpm_unseal authorizes with two OIAP sessions that are kept open
+ * afterwards (continueAuthSession), with the TPM's last nonces, and
+ * reused by later calls, which saves starting sessions for every
+ * command. sessions are only reused at the locality that opened them,
+ * and are forgotten once the TPM reports an error for a command using
+ * them, as the TPM terminates them then. tpm_seal needs an OSAP
+ * session of its own every time, which the TPM terminates after use.
+ *
+ * tpm_flush_sessions closes the cached sessions, e.g. before handing
+ * the TPM to someone else, and tpm_forget_sessions drops them without
+ * talking to the TPM, e.g. after it was reset.
+ */
+extern void tpm_flush_sessions(uint32_t locality);
+extern void tpm_forget_sessions(void);
+
 /*
  * tpm_cmp_creation_pcrs compare the current values of specified PCRs with
  * the values of the creation PCRs in the sealed data
@@ -368,6 +387,7 @@ static inline void _reverse_copy(uint8_t *out, const uint8_t *in, uint32_t count
 #define TPM_ORD_OIAP                0x0000000A
 #define TPM_ORD_SAVE_STATE          0x00000098
 #define TPM_ORD_GET_RANDOM          0x00000046
+#define TPM_ORD_FLUSH_SPECIFIC      0x000000BA
 
 #define TPM_TAG_PCR_INFO_LONG       0x0006
 #define TPM_TAG_STORED_DATA12       0x0016
@@ -430,6 +450,8 @@ typedef struct __attribute__ ((packed)) {
 #define TPM_ET_SRK              0x0004
 #define TPM_KH_SRK              0x40000000
 
+#define TPM_RT_AUTH             0x00000002
+
 typedef uint32_t tpm_key_handle_t;
 
 typedef tpm_digest_t tpm_composite_hash_t;
@@ -180,13 +180,14 @@ uint32_t _tpm_submit_cmd(uint32_t locality, uint16_t tag, uint32_t cmd,
     return ret;
 }
 
-/* from emhf's processor.h */
+/* from emhf's processor.h, but with the halves taken separately: "=A"
+   means only rax on x86_64, where the tests run */
 static inline uint64_t rdtsc64(void)
 {
-  uint64_t rv;
+  uint32_t lo, hi;
 
-  __asm__ __volatile__ ("rdtsc" : "=A" (rv));
-  return (rv);
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t)hi << 32) | lo;
 }
 
 /*static inline*/
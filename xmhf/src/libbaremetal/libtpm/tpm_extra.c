@@ -330,6 +330,173 @@ static uint32_t tpm_osap(uint32_t locality, tpm_entity_type_t ent_type,
     return ret;
 }
 
+/*
+ * nonces for our side of authorization sessions. each is the SHA1 of
+ * a seed from the TPM's RNG and a counter, which is fresh for every
+ * command without asking the TPM for random bytes every time.
+ */
+static tpm_nonce_t g_nonce_seed;
+static uint32_t g_nonce_count;
+static bool g_nonce_seeded = false;
+
+static void tpm_next_nonce_odd(uint32_t locality, tpm_nonce_t *nonce)
+{
+    uint8_t buf[sizeof(g_nonce_seed) + sizeof(g_nonce_count)];
+    uint32_t offset;
+
+    if ( !g_nonce_seeded ) {
+        uint32_t size = sizeof(g_nonce_seed);
+        if ( tpm_get_random(locality, g_nonce_seed.nonce, &size)
+             == TPM_SUCCESS && size == sizeof(g_nonce_seed) )
+            g_nonce_seeded = true;
+    }
+
+    g_nonce_count++;
+    offset = 0;
+    UNLOAD_BLOB_TYPE(buf, offset, &g_nonce_seed);
+    UNLOAD_INTEGER(buf, offset, g_nonce_count);
+    sha1_buffer(buf, offset, nonce->nonce);
+}
+
+/* authdata = hmac(secret, param_digest || nonce_even || nonce_odd || cont) */
+static void tpm_auth_hmac(const tpm_authdata_t *secret,
+                          const tpm_digest_t *digest,
+                          const tpm_nonce_t *nonce_even,
+                          const tpm_nonce_t *nonce_odd,
+                          uint8_t cont_session, tpm_authdata_t *auth)
+{
+    uint8_t buf[sizeof(*digest) + 2*sizeof(*nonce_even) + sizeof(cont_session)];
+    uint32_t offset = 0;
+
+    UNLOAD_BLOB_TYPE(buf, offset, digest);
+    UNLOAD_BLOB_TYPE(buf, offset, nonce_even);
+    UNLOAD_BLOB_TYPE(buf, offset, nonce_odd);
+    UNLOAD_INTEGER(buf, offset, cont_session);
+    HMAC_SHA1((uint8_t *)secret, sizeof(*secret), buf, offset,
+              (uint8_t *)auth);
+}
+
+/*
+ * checks the authdata of a response, whose output parameters are the
+ * out_size bytes at out:
+ * res_auth = hmac(secret, sha1(ret || ordinal || out) || nonce_even ||
+ *                 nonce_odd || cont)
+ */
+static bool tpm_check_res_auth(const tpm_authdata_t *secret,
+                               uint32_t ordinal, const uint8_t *out,
+                               uint32_t out_size,
+                               const tpm_nonce_t *nonce_even,
+                               const tpm_nonce_t *nonce_odd,
+                               uint8_t cont_session,
+                               const tpm_authdata_t *res_auth)
+{
+    uint8_t buf[2*sizeof(uint32_t)];
+    uint32_t offset = 0, ret = TPM_SUCCESS;
+    hash_state md;
+    tpm_digest_t digest;
+    tpm_authdata_t auth;
+
+    /* hashed in pieces, the output may be most of the response */
+    UNLOAD_INTEGER(buf, offset, ret);
+    UNLOAD_INTEGER(buf, offset, ordinal);
+    sha1_init(&md);
+    sha1_process(&md, buf, offset);
+    sha1_process(&md, out, out_size);
+    sha1_done(&md, (uint8_t *)&digest);
+
+    tpm_auth_hmac(secret, &digest, nonce_even, nonce_odd, cont_session, &auth);
+    return memcmp(&auth, res_auth, sizeof(auth)) == 0;
+}
+
+/* an OIAP session kept open across commands */
+typedef struct {
+    bool                valid;
+    uint32_t            locality;
+    tpm_authhandle_t    hauth;
+    tpm_nonce_t         nonce_even;     /* from the TPM's last response */
+} tpm_session_t;
+
+/* unseal needs two at a time */
+#define TPM_NR_SESSIONS 2
+static tpm_session_t g_sessions[TPM_NR_SESSIONS];
+
+static void tpm_flush_session(uint32_t locality, tpm_session_t *s)
+{
+    uint32_t ret, offset, out_size = 0;
+    uint32_t rt = TPM_RT_AUTH;
+
+    if ( !s->valid )
+        return;
+    s->valid = false;
+
+    offset = 0;
+    UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, s->hauth);
+    UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, rt);
+    ret = tpm_submit_cmd(locality, TPM_ORD_FLUSH_SPECIFIC, offset, &out_size);
+
+    /* the TPM may have dropped it already, e.g. if someone else
+       flushed all sessions */
+    if ( ret != TPM_SUCCESS && ret != TPM_INVALID_AUTHHANDLE )
+        printf("TPM: flush session %08X, return value = %08X\n",
+               s->hauth, ret);
+}
+
+void tpm_flush_sessions(uint32_t locality)
+{
+    uint32_t i;
+
+    for ( i = 0; i < TPM_NR_SESSIONS; i++ )
+        tpm_flush_session(locality, &g_sessions[i]);
+}
+
+void tpm_forget_sessions(void)
+{
+    uint32_t i;
+
+    for ( i = 0; i < TPM_NR_SESSIONS; i++ )
+        g_sessions[i].valid = false;
+}
+
+/*
+ * makes sure s is open at locality, starting a new session if needed.
+ * *reused tells whether s was open already.
+ */
+static uint32_t tpm_get_session(uint32_t locality, tpm_session_t *s,
+                                bool *reused)
+{
+    uint32_t ret;
+
+    if ( s->valid && s->locality != locality )
+        tpm_flush_session(locality, s);
+
+    *reused = s->valid;
+    if ( s->valid )
+        return TPM_SUCCESS;
+
+    ret = tpm_oiap(locality, &s->hauth, &s->nonce_even);
+    if ( ret != TPM_SUCCESS )
+        return ret;
+    s->valid = true;
+    s->locality = locality;
+    return ret;
+}
+
+/*
+ * after a command authorized with s: the TPM keeps the session open
+ * only if the command succeeded and asked to continue it, and rolls
+ * its nonce.
+ */
+static void tpm_put_session(tpm_session_t *s, uint32_t ret,
+                            uint8_t cont_session,
+                            const tpm_nonce_t *nonce_even)
+{
+    if ( ret != TPM_SUCCESS || !cont_session ) {
+        s->valid = false;
+        return;
+    }
+    s->nonce_even = *nonce_even;
+}
+
 static uint32_t _tpm_seal(uint32_t locality, tpm_key_handle_t hkey,
                   const tpm_encauth_t *enc_auth, uint32_t pcr_info_size,
                   const tpm_pcr_info_long_t *pcr_info, uint32_t in_data_size,
@@ -498,9 +665,12 @@ static uint32_t _tpm_wrap_seal(uint32_t locality,
     uint32_t ordinal = TPM_ORD_SEAL;
     tpm_digest_t digest;
 
-    /* skip generate nonce for odd_osap, just use the random value in stack */
+    tpm_next_nonce_odd(locality, &odd_osap);
+    tpm_next_nonce_odd(locality, &nonce_odd);
 
-    /* establish a osap session */
+    /* establish a osap session. it can't be cached: seal uses it to
+       encrypt the new blob's authdata, and the TPM terminates it
+       afterwards */
     ret = tpm_osap(locality, TPM_ET_SRK, TPM_KH_SRK, &odd_osap, &hauth,
                    &nonce_even, &even_osap);
     if ( ret != TPM_SUCCESS )
@@ -524,8 +694,6 @@ static uint32_t _tpm_wrap_seal(uint32_t locality,
     memcpy(&enc_auth, &blob_authdata, sizeof(blob_authdata));
     XOR_BLOB_TYPE(&enc_auth, &digest);
 
-    /* skip generate nonce for nonce_odd, just use the random value in stack */
-
     /* calculate authdata */
     /* in_param_digest = sha1(1S ~ 6S) */
     offset = 0;
@@ -538,14 +706,8 @@ static uint32_t _tpm_wrap_seal(uint32_t locality,
     sha1_buffer(WRAPPER_IN_BUF, offset, (uint8_t *)&digest);
 
     /* authdata = hmac(key, in_param_digest || auth_params) */
-    offset = 0;
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &digest);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_even);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_odd);
-    UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, cont_session);
-    HMAC_SHA1((uint8_t *)&shared_secret, sizeof(shared_secret),
-              WRAPPER_IN_BUF, offset,
-              (uint8_t *)&pub_auth);
+    tpm_auth_hmac((const tpm_authdata_t *)&shared_secret, &digest,
+                  &nonce_even, &nonce_odd, cont_session, &pub_auth);
 
     /* call the simple seal function */
     ret = _tpm_seal(locality, hkey, (const tpm_encauth_t *)&enc_auth,
@@ -554,8 +716,17 @@ static uint32_t _tpm_wrap_seal(uint32_t locality,
                     (const tpm_authdata_t *)&pub_auth,
                     sealed_data_size, sealed_data,
                     &nonce_even, &res_auth);
+    if ( ret != TPM_SUCCESS )
+        return ret;
 
-    /* skip check for res_auth */
+    /* the blob is the first output parameter, still in the response */
+    if ( !tpm_check_res_auth((const tpm_authdata_t *)&shared_secret,
+                             ordinal, WRAPPER_OUT_BUF, *sealed_data_size,
+                             &nonce_even, &nonce_odd, cont_session,
+                             (const tpm_authdata_t *)&res_auth) ) {
+        printf("TPM: seal response authorization mismatch\n");
+        return TPM_FAIL;
+    }
 
     return ret;
 }
@@ -564,78 +735,85 @@ static uint32_t _tpm_wrap_unseal(uint32_t locality, const uint8_t *in_data,
                                  uint32_t *secret_size, uint8_t *secret)
 {
     uint32_t ret;
-    tpm_nonce_t odd_osap, even_osap;
     tpm_nonce_t nonce_even, nonce_odd, nonce_even_d, nonce_odd_d;
-    tpm_authhandle_t hauth, hauth_d;
-    tpm_authdata_t shared_secret;
     tpm_authdata_t pub_auth, res_auth, pub_auth_d, res_auth_d;
-    uint8_t cont_session = false, cont_session_d = false;
+    uint8_t cont_session, cont_session_d;
     tpm_key_handle_t hkey = TPM_KH_SRK;
+    tpm_session_t *s = &g_sessions[0], *s_d = &g_sessions[1];
+    bool reused, reused_d;
     uint32_t offset;
     uint32_t ordinal = TPM_ORD_UNSEAL;
+    uint32_t secret_max = *secret_size;
     tpm_digest_t digest;
 
-    /* skip generate nonce for odd_osap, just use the random value in stack */
-
-    /* establish a osap session */
-    ret = tpm_osap(locality, TPM_ET_SRK, TPM_KH_SRK, &odd_osap, &hauth,
-                   &nonce_even, &even_osap);
-    if ( ret != TPM_SUCCESS )
+    /* both the key and the blob are authorized with cached OIAP
+       sessions, which saves two commands once they're open */
+    for ( ;; ) {
+        ret = tpm_get_session(locality, s, &reused);
+        if ( ret != TPM_SUCCESS )
             return ret;
-
-    /* calculate the shared secret
-       shared-secret = HMAC(auth, even_osap || odd_osap) */
-    offset = 0;
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &even_osap);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &odd_osap);
-    HMAC_SHA1((uint8_t *)&srk_authdata, sizeof(srk_authdata),
-              WRAPPER_IN_BUF, offset,
-              (uint8_t *)&shared_secret);
-
-    /* establish a oiap session */
-    ret = tpm_oiap(locality, &hauth_d, &nonce_even_d);
-    if ( ret != TPM_SUCCESS )
+        ret = tpm_get_session(locality, s_d, &reused_d);
+        if ( ret != TPM_SUCCESS )
             return ret;
 
-    /* skip generate nonce_odd & nonce_odd_d, just use the random values */
-
-    /* calculate authdata */
-    /* in_param_digest = sha1(1S ~ 6S) */
-    offset = 0;
-    UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, ordinal);
-    UNLOAD_STORED_DATA12(WRAPPER_IN_BUF, offset, in_data);
-    sha1_buffer(WRAPPER_IN_BUF, offset, (uint8_t *)&digest);
+        tpm_next_nonce_odd(locality, &nonce_odd);
+        tpm_next_nonce_odd(locality, &nonce_odd_d);
+        cont_session = cont_session_d = true;
 
-    /* authdata1 = hmac(key, in_param_digest || auth_params1) */
-    offset = 0;
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &digest);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_even);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_odd);
-    UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, cont_session);
-    HMAC_SHA1((uint8_t *)&shared_secret, sizeof(shared_secret),
-              WRAPPER_IN_BUF, offset,
-              (uint8_t *)&pub_auth);
+        /* calculate authdata */
+        /* in_param_digest = sha1(1S ~ 6S) */
+        offset = 0;
+        UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, ordinal);
+        UNLOAD_STORED_DATA12(WRAPPER_IN_BUF, offset, in_data);
+        sha1_buffer(WRAPPER_IN_BUF, offset, (uint8_t *)&digest);
+
+        /* authdata1 = hmac(key, in_param_digest || auth_params1) */
+        tpm_auth_hmac(&srk_authdata, &digest, &s->nonce_even, &nonce_odd,
+                      cont_session, &pub_auth);
+
+        /* authdata2 = hmac(key, in_param_digest || auth_params2) */
+        tpm_auth_hmac(&blob_authdata, &digest, &s_d->nonce_even, &nonce_odd_d,
+                      cont_session_d, &pub_auth_d);
+
+        /* call the simple unseal function */
+        *secret_size = secret_max;
+        ret = _tpm_unseal(locality, hkey, in_data,
+                          s->hauth, &nonce_odd, &cont_session,
+                          (const tpm_authdata_t *)&pub_auth,
+                          s_d->hauth, &nonce_odd_d, &cont_session_d,
+                          (const tpm_authdata_t *)&pub_auth_d,
+                          secret_size, secret,
+                          &nonce_even, &res_auth, &nonce_even_d, &res_auth_d);
+
+        /* cached sessions may have been flushed behind our back, in
+           which case it's worth one more try with new ones */
+        if ( ret == TPM_INVALID_AUTHHANDLE && (reused || reused_d) ) {
+            tpm_forget_sessions();
+            continue;
+        }
+        break;
+    }
 
-    /* authdata2 = hmac(key, in_param_digest || auth_params2) */
-    offset = 0;
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &digest);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_even_d);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_odd_d);
-    UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, cont_session_d);
-    HMAC_SHA1((uint8_t *)&blob_authdata, sizeof(blob_authdata),
-              WRAPPER_IN_BUF, offset,
-              (uint8_t *)&pub_auth_d);
+    if ( ret == TPM_SUCCESS ) {
+        /* the secret, with its size, is the only output parameter */
+        offset = sizeof(*secret_size) + *secret_size;
+        if ( !tpm_check_res_auth(&srk_authdata, ordinal,
+                                 WRAPPER_OUT_BUF, offset,
+                                 &nonce_even, &nonce_odd, cont_session,
+                                 (const tpm_authdata_t *)&res_auth) ||
+             !tpm_check_res_auth(&blob_authdata, ordinal,
+                                 WRAPPER_OUT_BUF, offset,
+                                 &nonce_even_d, &nonce_odd_d, cont_session_d,
+                                 (const tpm_authdata_t *)&res_auth_d) ) {
+            printf("TPM: unseal response authorization mismatch\n");
+            memset(secret, 0, *secret_size);
+            tpm_flush_sessions(locality);
+            return TPM_FAIL;
+        }
+    }
 
-    /* call the simple seal function */
-    ret = _tpm_unseal(locality, hkey, in_data,
-                      hauth, &nonce_odd, &cont_session,
-                      (const tpm_authdata_t *)&pub_auth,
-                      hauth_d, &nonce_odd_d, &cont_session_d,
-                      (const tpm_authdata_t *)&pub_auth_d,
-                      secret_size, secret,
-                      &nonce_even, &res_auth, &nonce_even_d, &res_auth_d);
-
-    /* skip check for res_auth */
+    tpm_put_session(s, ret, cont_session, &nonce_even);
+    tpm_put_session(s_d, ret, cont_session_d, &nonce_even_d);
 
     return ret;
 }
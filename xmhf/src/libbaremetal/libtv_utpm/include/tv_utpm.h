@@ -79,6 +79,9 @@
 
 #define  MAX_TPM_EXTEND_DATA_LEN 4096
 #define  MAX_TPM_RAND_DATA_LEN 4096
+/* bulk random requests fill whole, page-aligned pages */
+#define  TPM_RAND_BULK_GRANULE 4096
+#define  MAX_TPM_RAND_BULK_LEN (64*TPM_RAND_BULK_GRANULE)
 
 #define TPM_QUOTE_SIZE ( 8 + MAX_PCR_SEL_SIZE + MAX_PCR_DATA_SIZE + TPM_NONCE_SIZE + TPM_RSA_KEY_LEN )
 
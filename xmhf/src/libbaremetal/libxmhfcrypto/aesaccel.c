@@ -0,0 +1,686 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* aesaccel: run-time selection of AES implementations, and the
+ * constant-time C one. see aesaccel.h.
+ *
+ * The C code keeps two blocks at a time in eight 32-bit words, one
+ * per column, with row r in byte r. SubBytes transposes the 32 state
+ * bytes into eight bit planes and evaluates the Boyar-Peralta S-box
+ * circuit on all of them at once; the other steps are byte
+ * permutations and shifts. Nothing branches on, or indexes memory
+ * with, key or data.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "aesaccel_internal.h"
+#include "simd_internal.h"
+
+/*
+ * constant-time C implementation
+ */
+
+/* swap bit groups between two words; with the masks below this is a
+   3-dimensional transpose, and its own inverse */
+#define AESACCEL_SWAPN(cl, ch, s, x, y)                                 \
+  do {                                                                  \
+    uint32_t a_ = (x), b_ = (y);                                        \
+    (x) = (a_ & (uint32_t)(cl)) | ((b_ & (uint32_t)(cl)) << (s));       \
+    (y) = ((a_ & (uint32_t)(ch)) >> (s)) | (b_ & (uint32_t)(ch));       \
+  } while (0)
+
+/* move bit k of every byte of q[0..7] into q[k] */
+static void aesaccel_ortho(uint32_t *q)
+{
+  AESACCEL_SWAPN(0x55555555, 0xaaaaaaaa, 1, q[0], q[1]);
+  AESACCEL_SWAPN(0x55555555, 0xaaaaaaaa, 1, q[2], q[3]);
+  AESACCEL_SWAPN(0x55555555, 0xaaaaaaaa, 1, q[4], q[5]);
+  AESACCEL_SWAPN(0x55555555, 0xaaaaaaaa, 1, q[6], q[7]);
+
+  AESACCEL_SWAPN(0x33333333, 0xcccccccc, 2, q[0], q[2]);
+  AESACCEL_SWAPN(0x33333333, 0xcccccccc, 2, q[1], q[3]);
+  AESACCEL_SWAPN(0x33333333, 0xcccccccc, 2, q[4], q[6]);
+  AESACCEL_SWAPN(0x33333333, 0xcccccccc, 2, q[5], q[7]);
+
+  AESACCEL_SWAPN(0x0f0f0f0f, 0xf0f0f0f0, 4, q[0], q[4]);
+  AESACCEL_SWAPN(0x0f0f0f0f, 0xf0f0f0f0, 4, q[1], q[5]);
+  AESACCEL_SWAPN(0x0f0f0f0f, 0xf0f0f0f0, 4, q[2], q[6]);
+  AESACCEL_SWAPN(0x0f0f0f0f, 0xf0f0f0f0, 4, q[3], q[7]);
+}
+
+/* the AES S-box on 32 bytes in bit planes (q[k] holds bit k of each
+   byte), with the circuit from Boyar and Peralta, "A small depth-16
+   circuit for the AES S-box" */
+static void aesaccel_sbox_planes(uint32_t *q)
+{
+  uint32_t x0, x1, x2, x3, x4, x5, x6, x7;
+  uint32_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+  uint32_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+  uint32_t y20, y21;
+  uint32_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+  uint32_t z10, z11, z12, z13, z14, z15, z16, z17;
+  uint32_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+  uint32_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+  uint32_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+  uint32_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+  uint32_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+  uint32_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+  uint32_t t60, t61, t62, t63, t64, t65, t66, t67;
+  uint32_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+  x0 = q[7]; x1 = q[6]; x2 = q[5]; x3 = q[4];
+  x4 = q[3]; x5 = q[2]; x6 = q[1]; x7 = q[0];
+
+  /* top linear transformation */
+  y14 = x3 ^ x5;
+  y13 = x0 ^ x6;
+  y9 = x0 ^ x3;
+  y8 = x0 ^ x5;
+  t0 = x1 ^ x2;
+  y1 = t0 ^ x7;
+  y4 = y1 ^ x3;
+  y12 = y13 ^ y14;
+  y2 = y1 ^ x0;
+  y5 = y1 ^ x6;
+  y3 = y5 ^ y8;
+  t1 = x4 ^ y12;
+  y15 = t1 ^ x5;
+  y20 = t1 ^ x1;
+  y6 = y15 ^ x7;
+  y10 = y15 ^ t0;
+  y11 = y20 ^ y9;
+  y7 = x7 ^ y11;
+  y17 = y10 ^ y11;
+  y19 = y10 ^ y8;
+  y16 = t0 ^ y11;
+  y21 = y13 ^ y16;
+  y18 = x0 ^ y16;
+
+  /* non-linear section */
+  t2 = y12 & y15;
+  t3 = y3 & y6;
+  t4 = t3 ^ t2;
+  t5 = y4 & x7;
+  t6 = t5 ^ t2;
+  t7 = y13 & y16;
+  t8 = y5 & y1;
+  t9 = t8 ^ t7;
+  t10 = y2 & y7;
+  t11 = t10 ^ t7;
+  t12 = y9 & y11;
+  t13 = y14 & y17;
+  t14 = t13 ^ t12;
+  t15 = y8 & y10;
+  t16 = t15 ^ t12;
+  t17 = t4 ^ t14;
+  t18 = t6 ^ t16;
+  t19 = t9 ^ t14;
+  t20 = t11 ^ t16;
+  t21 = t17 ^ y20;
+  t22 = t18 ^ y19;
+  t23 = t19 ^ y21;
+  t24 = t20 ^ y18;
+
+  t25 = t21 ^ t22;
+  t26 = t21 & t23;
+  t27 = t24 ^ t26;
+  t28 = t25 & t27;
+  t29 = t28 ^ t22;
+  t30 = t23 ^ t24;
+  t31 = t22 ^ t26;
+  t32 = t31 & t30;
+  t33 = t32 ^ t24;
+  t34 = t23 ^ t33;
+  t35 = t27 ^ t33;
+  t36 = t24 & t35;
+  t37 = t36 ^ t34;
+  t38 = t27 ^ t36;
+  t39 = t29 & t38;
+  t40 = t25 ^ t39;
+
+  t41 = t40 ^ t37;
+  t42 = t29 ^ t33;
+  t43 = t29 ^ t40;
+  t44 = t33 ^ t37;
+  t45 = t42 ^ t41;
+  z0 = t44 & y15;
+  z1 = t37 & y6;
+  z2 = t33 & x7;
+  z3 = t43 & y16;
+  z4 = t40 & y1;
+  z5 = t29 & y7;
+  z6 = t42 & y11;
+  z7 = t45 & y17;
+  z8 = t41 & y10;
+  z9 = t44 & y12;
+  z10 = t37 & y3;
+  z11 = t33 & y4;
+  z12 = t43 & y13;
+  z13 = t40 & y5;
+  z14 = t29 & y2;
+  z15 = t42 & y9;
+  z16 = t45 & y14;
+  z17 = t41 & y8;
+
+  /* bottom linear transformation */
+  t46 = z15 ^ z16;
+  t47 = z10 ^ z11;
+  t48 = z5 ^ z13;
+  t49 = z9 ^ z10;
+  t50 = z2 ^ z12;
+  t51 = z2 ^ z5;
+  t52 = z7 ^ z8;
+  t53 = z0 ^ z3;
+  t54 = z6 ^ z7;
+  t55 = z16 ^ z17;
+  t56 = z12 ^ t48;
+  t57 = t50 ^ t53;
+  t58 = z4 ^ t46;
+  t59 = z3 ^ t54;
+  t60 = t46 ^ t57;
+  t61 = z14 ^ t57;
+  t62 = t52 ^ t58;
+  t63 = t49 ^ t58;
+  t64 = z4 ^ t59;
+  t65 = t61 ^ t62;
+  t66 = z1 ^ t63;
+  s0 = t59 ^ t63;
+  s6 = t56 ^ ~t62;
+  s7 = t48 ^ ~t60;
+  t67 = t64 ^ t65;
+  s3 = t53 ^ t66;
+  s4 = t51 ^ t66;
+  s5 = t47 ^ t65;
+  s1 = t64 ^ ~s3;
+  s2 = t55 ^ ~t67;
+
+  q[7] = s0; q[6] = s1; q[5] = s2; q[4] = s3;
+  q[3] = s4; q[2] = s5; q[1] = s6; q[0] = s7;
+}
+
+static void aesaccel_sub_bytes(uint32_t *w)
+{
+  aesaccel_ortho(w);
+  aesaccel_sbox_planes(w);
+  aesaccel_ortho(w);
+}
+
+/* rotate each byte of x left by n */
+#define AESACCEL_ROTB(x, n)                                             \
+  ((((x) << (n)) & (0x01010101U * ((0xffU << (n)) & 0xffU)))            \
+   | (((x) >> (8 - (n))) & (0x01010101U * (0xffU >> (8 - (n))))))
+
+/* the inverse of the S-box's affine transformation, on each byte */
+static uint32_t aesaccel_inv_affine(uint32_t x)
+{
+  return AESACCEL_ROTB(x, 1) ^ AESACCEL_ROTB(x, 3) ^ AESACCEL_ROTB(x, 6)
+    ^ 0x05050505U;
+}
+
+/* S(x) is A(x^-1), so the inverse S-box is A^-1(S(A^-1(x))) */
+static void aesaccel_inv_sub_bytes(uint32_t *w)
+{
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    w[i] = aesaccel_inv_affine(w[i]);
+  }
+  aesaccel_sub_bytes(w);
+  for (i = 0; i < 8; i++) {
+    w[i] = aesaccel_inv_affine(w[i]);
+  }
+}
+
+/* row r of column c comes from column c + r (ShiftRows), or c - r
+   (InvShiftRows) */
+static void aesaccel_shift_rows(uint32_t *w, int dir)
+{
+  uint32_t c[4];
+  int b, i;
+
+  for (b = 0; b < 8; b += 4) {
+    for (i = 0; i < 4; i++) {
+      c[i] = w[b + i];
+    }
+    for (i = 0; i < 4; i++) {
+      w[b + i] = (c[i] & 0x000000ffU)
+        | (c[(i + dir) & 3] & 0x0000ff00U)
+        | (c[(i + 2*dir) & 3] & 0x00ff0000U)
+        | (c[(i + 3*dir) & 3] & 0xff000000U);
+    }
+  }
+}
+
+#define AESACCEL_ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/* multiply each byte by x in GF(2^8) */
+static uint32_t aesaccel_xtime(uint32_t x)
+{
+  return ((x & 0x7f7f7f7fU) << 1) ^ (((x >> 7) & 0x01010101U) * 0x1b);
+}
+
+static uint32_t aesaccel_mix_column(uint32_t x)
+{
+  uint32_t r1 = AESACCEL_ROR32(x, 8);
+
+  return aesaccel_xtime(x ^ r1) ^ r1
+    ^ AESACCEL_ROR32(x, 16) ^ AESACCEL_ROR32(x, 24);
+}
+
+/* InvMixColumns is MixColumns after multiplying by 4x^2 + 5 */
+static uint32_t aesaccel_inv_mix_column(uint32_t x)
+{
+  x ^= aesaccel_xtime(aesaccel_xtime(x ^ AESACCEL_ROR32(x, 16)));
+  return aesaccel_mix_column(x);
+}
+
+static void aesaccel_add_round_key(uint32_t *w, const uint32_t *rk)
+{
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    w[i] ^= rk[i & 3];
+  }
+}
+
+static void aesaccel_encrypt2_c(const aesaccel_key_t *key, uint32_t *w)
+{
+  int r, i;
+
+  aesaccel_add_round_key(w, key->ek);
+  for (r = 1; r < key->nr; r++) {
+    aesaccel_sub_bytes(w);
+    aesaccel_shift_rows(w, 1);
+    for (i = 0; i < 8; i++) {
+      w[i] = aesaccel_mix_column(w[i]);
+    }
+    aesaccel_add_round_key(w, key->ek + 4*r);
+  }
+  aesaccel_sub_bytes(w);
+  aesaccel_shift_rows(w, 1);
+  aesaccel_add_round_key(w, key->ek + 4*key->nr);
+}
+
+static void aesaccel_decrypt2_c(const aesaccel_key_t *key, uint32_t *w)
+{
+  int r, i;
+
+  aesaccel_add_round_key(w, key->ek + 4*key->nr);
+  for (r = key->nr - 1; r > 0; r--) {
+    aesaccel_shift_rows(w, -1);
+    aesaccel_inv_sub_bytes(w);
+    aesaccel_add_round_key(w, key->ek + 4*r);
+    for (i = 0; i < 8; i++) {
+      w[i] = aesaccel_inv_mix_column(w[i]);
+    }
+  }
+  aesaccel_shift_rows(w, -1);
+  aesaccel_inv_sub_bytes(w);
+  aesaccel_add_round_key(w, key->ek);
+}
+
+static uint32_t aesaccel_load32l(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8)
+    | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void aesaccel_store32l(uint8_t *p, uint32_t x)
+{
+  p[0] = (uint8_t)x;
+  p[1] = (uint8_t)(x >> 8);
+  p[2] = (uint8_t)(x >> 16);
+  p[3] = (uint8_t)(x >> 24);
+}
+
+/* nblocks (1 or 2) blocks between bytes and the two-block state. an
+   absent second block is zeros. */
+static void aesaccel_load_c(uint32_t *w, const uint8_t *in, size_t nblocks)
+{
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    w[i] = ((size_t)i < 4*nblocks) ? aesaccel_load32l(in + 4*i) : 0;
+  }
+}
+
+static void aesaccel_store_c(uint8_t *out, const uint32_t *w, size_t nblocks)
+{
+  size_t i;
+
+  for (i = 0; i < 4*nblocks; i++) {
+    aesaccel_store32l(out + 4*i, w[i]);
+  }
+}
+
+static void aesaccel_ecb_c(const aesaccel_key_t *key, bool decrypt,
+                           const uint8_t *in, uint8_t *out, size_t nblocks)
+{
+  uint32_t w[8];
+  size_t n;
+
+  while (nblocks > 0) {
+    n = (nblocks >= 2) ? 2 : 1;
+    aesaccel_load_c(w, in, n);
+    if (decrypt) {
+      aesaccel_decrypt2_c(key, w);
+    } else {
+      aesaccel_encrypt2_c(key, w);
+    }
+    aesaccel_store_c(out, w, n);
+    in += n * AESACCEL_BLOCK_LENGTH;
+    out += n * AESACCEL_BLOCK_LENGTH;
+    nblocks -= n;
+  }
+}
+
+static void aesaccel_cbc_encrypt_c(const aesaccel_key_t *key, uint8_t *iv,
+                                   const uint8_t *in, uint8_t *out,
+                                   size_t nblocks)
+{
+  uint32_t w[8];
+  int i;
+
+  aesaccel_load_c(w, iv, 1);
+  while (nblocks--) {
+    for (i = 0; i < 4; i++) {
+      w[i] ^= aesaccel_load32l(in + 4*i);
+    }
+    aesaccel_encrypt2_c(key, w);
+    aesaccel_store_c(out, w, 1);
+    in += AESACCEL_BLOCK_LENGTH;
+    out += AESACCEL_BLOCK_LENGTH;
+  }
+  aesaccel_store_c(iv, w, 1);
+}
+
+static void aesaccel_cbc_decrypt_c(const aesaccel_key_t *key, uint8_t *iv,
+                                   const uint8_t *in, uint8_t *out,
+                                   size_t nblocks)
+{
+  uint32_t w[8], prev[8], c[8];
+  size_t n;
+  int i;
+
+  aesaccel_load_c(prev, iv, 1);
+  while (nblocks > 0) {
+    n = (nblocks >= 2) ? 2 : 1;
+    aesaccel_load_c(c, in, n);
+    memcpy(w, c, sizeof(w));
+    aesaccel_decrypt2_c(key, w);
+    for (i = 0; i < 4; i++) {
+      w[i] ^= prev[i];
+      w[i + 4] ^= c[i];
+      prev[i] = c[4*(n - 1) + i];
+    }
+    aesaccel_store_c(out, w, n);
+    in += n * AESACCEL_BLOCK_LENGTH;
+    out += n * AESACCEL_BLOCK_LENGTH;
+    nblocks -= n;
+  }
+  aesaccel_store_c(iv, prev, 1);
+}
+
+static void aesaccel_ctr_generate_c(const aesaccel_key_t *key, uint8_t *ctr,
+                                    uint8_t *out, size_t nblocks)
+{
+  uint8_t blocks[2*AESACCEL_BLOCK_LENGTH];
+  uint32_t w[8];
+  size_t n, i;
+
+  while (nblocks > 0) {
+    n = (nblocks >= 2) ? 2 : 1;
+    for (i = 0; i < n; i++) {
+      aesaccel_ctr_increment(ctr);
+      memcpy(blocks + i*AESACCEL_BLOCK_LENGTH, ctr, AESACCEL_BLOCK_LENGTH);
+    }
+    aesaccel_load_c(w, blocks, n);
+    aesaccel_encrypt2_c(key, w);
+    aesaccel_store_c(out, w, n);
+    out += n * AESACCEL_BLOCK_LENGTH;
+    nblocks -= n;
+  }
+}
+
+/*
+ * key schedule. done in C whatever the cpu, so that keys stay valid
+ * if the features in use change.
+ */
+
+static uint32_t aesaccel_sub_word(uint32_t x)
+{
+  uint32_t w[8] = { 0 };
+
+  w[0] = x;
+  aesaccel_sub_bytes(w);
+  return w[0];
+}
+
+int aesaccel_setkey(aesaccel_key_t *key, const uint8_t *k, int bits)
+{
+  int nk, nwords, i;
+  uint32_t t, rcon = 1;
+
+  if (bits != 128 && bits != 192 && bits != 256) {
+    return 1;
+  }
+  nk = bits / 32;
+  key->nr = nk + 6;
+  nwords = 4 * (key->nr + 1);
+
+  for (i = 0; i < nk; i++) {
+    key->ek[i] = aesaccel_load32l(k + 4*i);
+  }
+  for (i = nk; i < nwords; i++) {
+    t = key->ek[i - 1];
+    if (i % nk == 0) {
+      t = aesaccel_sub_word(AESACCEL_ROR32(t, 8)) ^ rcon;
+      rcon = aesaccel_xtime(rcon) & 0xff;
+    } else if (nk > 6 && i % nk == 4) {
+      t = aesaccel_sub_word(t);
+    }
+    key->ek[i] = key->ek[i - nk] ^ t;
+  }
+
+  /* equivalent inverse cipher: round keys in reverse order, with
+     InvMixColumns applied to all but the first and last */
+  for (i = 0; i < 4; i++) {
+    key->dk[i] = key->ek[4*key->nr + i];
+    key->dk[4*key->nr + i] = key->ek[i];
+  }
+  for (i = 4; i < 4*key->nr; i++) {
+    key->dk[i] = aesaccel_inv_mix_column(key->ek[4*key->nr - (i & ~3) + (i & 3)]);
+  }
+
+  return 0;
+}
+
+/*
+ * cpu feature detection and dispatch
+ */
+
+static uint32_t g_aesaccel_flags = 0;
+static uint32_t g_aesaccel_detected = 0;
+static uint32_t g_aesaccel_features = 0;
+
+#ifdef AESACCEL_X86
+static uint32_t aesaccel_detect(void)
+{
+  uint32_t eax, ebx, ecx, edx, max_leaf;
+
+  simd_cpuid(0, 0, &max_leaf, &ebx, &ecx, &edx);
+  if (max_leaf < 1) {
+    return 0;
+  }
+  simd_cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+  /* aes-ni, plus fxsr and sse2 */
+  if ((ecx & (1UL << 25)) && (edx & (1UL << 24)) && (edx & (1UL << 26))) {
+    return AESACCEL_FEAT_AESNI;
+  }
+  return 0;
+}
+
+/* returns true if AES-NI can be used, with the FPU state saved if
+   need be */
+static bool aesaccel_aesni_begin(simd_fpu_t *fpu)
+{
+  return (g_aesaccel_features & AESACCEL_FEAT_AESNI)
+    && simd_fpu_begin(fpu, g_aesaccel_flags & AESACCEL_F_KERNEL);
+}
+
+static void aesaccel_aesni_end(simd_fpu_t *fpu)
+{
+  simd_fpu_end(fpu, g_aesaccel_flags & AESACCEL_F_KERNEL);
+}
+#else /* !AESACCEL_X86 */
+static uint32_t aesaccel_detect(void)
+{
+  return 0;
+}
+#endif /* AESACCEL_X86 */
+
+uint32_t aesaccel_init(uint32_t flags)
+{
+  g_aesaccel_flags = flags;
+  g_aesaccel_detected = aesaccel_detect();
+  g_aesaccel_features = g_aesaccel_detected;
+  return g_aesaccel_features;
+}
+
+uint32_t aesaccel_features(void)
+{
+  return g_aesaccel_features;
+}
+
+uint32_t aesaccel_set_features(uint32_t features)
+{
+  g_aesaccel_features = features & g_aesaccel_detected;
+  return g_aesaccel_features;
+}
+
+void aesaccel_encrypt(const aesaccel_key_t *key, const uint8_t *in,
+                      uint8_t *out, size_t nblocks)
+{
+#ifdef AESACCEL_X86
+  simd_fpu_t fpu;
+
+  if (nblocks > 0 && aesaccel_aesni_begin(&fpu)) {
+    aesaccel_encrypt_aesni(key, in, out, nblocks);
+    aesaccel_aesni_end(&fpu);
+    return;
+  }
+#endif
+  aesaccel_ecb_c(key, false, in, out, nblocks);
+}
+
+void aesaccel_decrypt(const aesaccel_key_t *key, const uint8_t *in,
+                      uint8_t *out, size_t nblocks)
+{
+#ifdef AESACCEL_X86
+  simd_fpu_t fpu;
+
+  if (nblocks > 0 && aesaccel_aesni_begin(&fpu)) {
+    aesaccel_decrypt_aesni(key, in, out, nblocks);
+    aesaccel_aesni_end(&fpu);
+    return;
+  }
+#endif
+  aesaccel_ecb_c(key, true, in, out, nblocks);
+}
+
+void aesaccel_cbc_encrypt(const aesaccel_key_t *key, uint8_t *iv,
+                          const uint8_t *in, uint8_t *out, size_t nblocks)
+{
+#ifdef AESACCEL_X86
+  simd_fpu_t fpu;
+
+  if (nblocks > 0 && aesaccel_aesni_begin(&fpu)) {
+    aesaccel_cbc_encrypt_aesni(key, iv, in, out, nblocks);
+    aesaccel_aesni_end(&fpu);
+    return;
+  }
+#endif
+  if (nblocks > 0) {
+    aesaccel_cbc_encrypt_c(key, iv, in, out, nblocks);
+  }
+}
+
+void aesaccel_cbc_decrypt(const aesaccel_key_t *key, uint8_t *iv,
+                          const uint8_t *in, uint8_t *out, size_t nblocks)
+{
+#ifdef AESACCEL_X86
+  simd_fpu_t fpu;
+
+  if (nblocks > 0 && aesaccel_aesni_begin(&fpu)) {
+    aesaccel_cbc_decrypt_aesni(key, iv, in, out, nblocks);
+    aesaccel_aesni_end(&fpu);
+    return;
+  }
+#endif
+  if (nblocks > 0) {
+    aesaccel_cbc_decrypt_c(key, iv, in, out, nblocks);
+  }
+}
+
+void aesaccel_ctr_generate(const aesaccel_key_t *key, uint8_t *ctr,
+                           uint8_t *out, size_t nblocks)
+{
+#ifdef AESACCEL_X86
+  simd_fpu_t fpu;
+
+  if (nblocks > 0 && aesaccel_aesni_begin(&fpu)) {
+    aesaccel_ctr_generate_aesni(key, ctr, out, nblocks);
+    aesaccel_aesni_end(&fpu);
+    return;
+  }
+#endif
+  aesaccel_ctr_generate_c(key, ctr, out, nblocks);
+}
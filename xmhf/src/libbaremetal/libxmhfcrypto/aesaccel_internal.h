@@ -0,0 +1,83 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* implementations behind aesaccel.h */
+
+#ifndef AESACCEL_INTERNAL_H
+#define AESACCEL_INTERNAL_H
+
+#include <aesaccel.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define AESACCEL_X86
+#endif
+
+/* add one to a 128-bit big-endian counter */
+static inline void aesaccel_ctr_increment(uint8_t *ctr)
+{
+  int i;
+
+  for (i = AESACCEL_BLOCK_LENGTH - 1; i >= 0; i--) {
+    if (++ctr[i] != 0) {
+      break;
+    }
+  }
+}
+
+#ifdef AESACCEL_X86
+void aesaccel_encrypt_aesni(const aesaccel_key_t *key, const uint8_t *in,
+                            uint8_t *out, size_t nblocks);
+void aesaccel_decrypt_aesni(const aesaccel_key_t *key, const uint8_t *in,
+                            uint8_t *out, size_t nblocks);
+void aesaccel_cbc_encrypt_aesni(const aesaccel_key_t *key, uint8_t *iv,
+                                const uint8_t *in, uint8_t *out, size_t nblocks);
+void aesaccel_cbc_decrypt_aesni(const aesaccel_key_t *key, uint8_t *iv,
+                                const uint8_t *in, uint8_t *out, size_t nblocks);
+void aesaccel_ctr_generate_aesni(const aesaccel_key_t *key, uint8_t *ctr,
+                                 uint8_t *out, size_t nblocks);
+#endif
+
+#endif /* AESACCEL_INTERNAL_H */
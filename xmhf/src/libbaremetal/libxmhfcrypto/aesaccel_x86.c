@@ -0,0 +1,296 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* aesaccel: AES-NI implementations for x86.
+ *
+ * as with hashaccel_x86.c, these are built with per-function target
+ * attributes and GCC builtins, and must only be called once
+ * aesaccel.c has checked for the cpu feature and taken care of the
+ * FPU state. the modes without a dependency between blocks keep
+ * several blocks in flight, to cover the latency of aesenc/aesdec.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "aesaccel_internal.h"
+
+#ifdef AESACCEL_X86
+
+typedef long long v2di_t __attribute__((vector_size(16)));
+typedef long long v2di_u_t __attribute__((vector_size(16), aligned(1), may_alias));
+
+#define LOADU(p) (*(const v2di_u_t *)(p))
+#define STOREU(p, v) (*(v2di_u_t *)(p) = (v))
+
+/* blocks kept in flight by the modes without a dependency between
+   blocks. the x4 functions below are written out with locals, so that
+   the blocks stay in registers. */
+#define AESACCEL_PIPELINE 4
+
+/* one block through the cipher, with the round keys rk */
+__attribute__((target("aes,sse2"), always_inline))
+static inline void aesaccel_encrypt_x1(const uint32_t *rk, int nr, v2di_t *b)
+{
+  v2di_t b0 = *b ^ LOADU(rk);
+  int r;
+
+  for (r = 1; r < nr; r++) {
+    b0 = __builtin_ia32_aesenc128(b0, LOADU(rk + 4*r));
+  }
+  *b = __builtin_ia32_aesenclast128(b0, LOADU(rk + 4*nr));
+}
+
+__attribute__((target("aes,sse2"), always_inline))
+static inline void aesaccel_encrypt_x4(const uint32_t *rk, int nr, v2di_t *b)
+{
+  v2di_t k = LOADU(rk);
+  v2di_t b0 = b[0] ^ k, b1 = b[1] ^ k, b2 = b[2] ^ k, b3 = b[3] ^ k;
+  int r;
+
+  for (r = 1; r < nr; r++) {
+    k = LOADU(rk + 4*r);
+    b0 = __builtin_ia32_aesenc128(b0, k);
+    b1 = __builtin_ia32_aesenc128(b1, k);
+    b2 = __builtin_ia32_aesenc128(b2, k);
+    b3 = __builtin_ia32_aesenc128(b3, k);
+  }
+  k = LOADU(rk + 4*nr);
+  b[0] = __builtin_ia32_aesenclast128(b0, k);
+  b[1] = __builtin_ia32_aesenclast128(b1, k);
+  b[2] = __builtin_ia32_aesenclast128(b2, k);
+  b[3] = __builtin_ia32_aesenclast128(b3, k);
+}
+
+/* and through the equivalent inverse cipher, with the round keys dk */
+__attribute__((target("aes,sse2"), always_inline))
+static inline void aesaccel_decrypt_x1(const uint32_t *rk, int nr, v2di_t *b)
+{
+  v2di_t b0 = *b ^ LOADU(rk);
+  int r;
+
+  for (r = 1; r < nr; r++) {
+    b0 = __builtin_ia32_aesdec128(b0, LOADU(rk + 4*r));
+  }
+  *b = __builtin_ia32_aesdeclast128(b0, LOADU(rk + 4*nr));
+}
+
+__attribute__((target("aes,sse2"), always_inline))
+static inline void aesaccel_decrypt_x4(const uint32_t *rk, int nr, v2di_t *b)
+{
+  v2di_t k = LOADU(rk);
+  v2di_t b0 = b[0] ^ k, b1 = b[1] ^ k, b2 = b[2] ^ k, b3 = b[3] ^ k;
+  int r;
+
+  for (r = 1; r < nr; r++) {
+    k = LOADU(rk + 4*r);
+    b0 = __builtin_ia32_aesdec128(b0, k);
+    b1 = __builtin_ia32_aesdec128(b1, k);
+    b2 = __builtin_ia32_aesdec128(b2, k);
+    b3 = __builtin_ia32_aesdec128(b3, k);
+  }
+  k = LOADU(rk + 4*nr);
+  b[0] = __builtin_ia32_aesdeclast128(b0, k);
+  b[1] = __builtin_ia32_aesdeclast128(b1, k);
+  b[2] = __builtin_ia32_aesdeclast128(b2, k);
+  b[3] = __builtin_ia32_aesdeclast128(b3, k);
+}
+
+/* full groups of AESACCEL_PIPELINE blocks, then any remainder one
+   block at a time */
+
+__attribute__((target("aes,sse2")))
+void aesaccel_encrypt_aesni(const aesaccel_key_t *key, const uint8_t *in,
+                            uint8_t *out, size_t nblocks)
+{
+  v2di_t b[AESACCEL_PIPELINE];
+  int i;
+
+  for (; nblocks >= AESACCEL_PIPELINE; nblocks -= AESACCEL_PIPELINE) {
+    for (i = 0; i < AESACCEL_PIPELINE; i++) {
+      b[i] = LOADU(in + i*AESACCEL_BLOCK_LENGTH);
+    }
+    aesaccel_encrypt_x4(key->ek, key->nr, b);
+    for (i = 0; i < AESACCEL_PIPELINE; i++) {
+      STOREU(out + i*AESACCEL_BLOCK_LENGTH, b[i]);
+    }
+    in += AESACCEL_PIPELINE * AESACCEL_BLOCK_LENGTH;
+    out += AESACCEL_PIPELINE * AESACCEL_BLOCK_LENGTH;
+  }
+  for (; nblocks > 0; nblocks--) {
+    b[0] = LOADU(in);
+    aesaccel_encrypt_x1(key->ek, key->nr, b);
+    STOREU(out, b[0]);
+    in += AESACCEL_BLOCK_LENGTH;
+    out += AESACCEL_BLOCK_LENGTH;
+  }
+}
+
+__attribute__((target("aes,sse2")))
+void aesaccel_decrypt_aesni(const aesaccel_key_t *key, const uint8_t *in,
+                            uint8_t *out, size_t nblocks)
+{
+  v2di_t b[AESACCEL_PIPELINE];
+  int i;
+
+  for (; nblocks >= AESACCEL_PIPELINE; nblocks -= AESACCEL_PIPELINE) {
+    for (i = 0; i < AESACCEL_PIPELINE; i++) {
+      b[i] = LOADU(in + i*AESACCEL_BLOCK_LENGTH);
+    }
+    aesaccel_decrypt_x4(key->dk, key->nr, b);
+    for (i = 0; i < AESACCEL_PIPELINE; i++) {
+      STOREU(out + i*AESACCEL_BLOCK_LENGTH, b[i]);
+    }
+    in += AESACCEL_PIPELINE * AESACCEL_BLOCK_LENGTH;
+    out += AESACCEL_PIPELINE * AESACCEL_BLOCK_LENGTH;
+  }
+  for (; nblocks > 0; nblocks--) {
+    b[0] = LOADU(in);
+    aesaccel_decrypt_x1(key->dk, key->nr, b);
+    STOREU(out, b[0]);
+    in += AESACCEL_BLOCK_LENGTH;
+    out += AESACCEL_BLOCK_LENGTH;
+  }
+}
+
+/* each block depends on the previous one, so there's nothing to
+   pipeline */
+__attribute__((target("aes,sse2")))
+void aesaccel_cbc_encrypt_aesni(const aesaccel_key_t *key, uint8_t *iv,
+                                const uint8_t *in, uint8_t *out, size_t nblocks)
+{
+  v2di_t b;
+
+  b = LOADU(iv);
+  for (; nblocks > 0; nblocks--) {
+    b ^= LOADU(in);
+    aesaccel_encrypt_x1(key->ek, key->nr, &b);
+    STOREU(out, b);
+    in += AESACCEL_BLOCK_LENGTH;
+    out += AESACCEL_BLOCK_LENGTH;
+  }
+  STOREU(iv, b);
+}
+
+__attribute__((target("aes,sse2")))
+void aesaccel_cbc_decrypt_aesni(const aesaccel_key_t *key, uint8_t *iv,
+                                const uint8_t *in, uint8_t *out, size_t nblocks)
+{
+  v2di_t b[AESACCEL_PIPELINE], c[AESACCEL_PIPELINE], prev;
+  int i;
+
+  prev = LOADU(iv);
+  for (; nblocks >= AESACCEL_PIPELINE; nblocks -= AESACCEL_PIPELINE) {
+    /* read all the ciphertext first, in case in == out */
+    for (i = 0; i < AESACCEL_PIPELINE; i++) {
+      c[i] = LOADU(in + i*AESACCEL_BLOCK_LENGTH);
+      b[i] = c[i];
+    }
+    aesaccel_decrypt_x4(key->dk, key->nr, b);
+    for (i = 0; i < AESACCEL_PIPELINE; i++) {
+      STOREU(out + i*AESACCEL_BLOCK_LENGTH, b[i] ^ prev);
+      prev = c[i];
+    }
+    in += AESACCEL_PIPELINE * AESACCEL_BLOCK_LENGTH;
+    out += AESACCEL_PIPELINE * AESACCEL_BLOCK_LENGTH;
+  }
+  for (; nblocks > 0; nblocks--) {
+    c[0] = LOADU(in);
+    b[0] = c[0];
+    aesaccel_decrypt_x1(key->dk, key->nr, b);
+    STOREU(out, b[0] ^ prev);
+    prev = c[0];
+    in += AESACCEL_BLOCK_LENGTH;
+    out += AESACCEL_BLOCK_LENGTH;
+  }
+  STOREU(iv, prev);
+}
+
+/* the counter is kept as two native 64-bit halves, rather than
+   incremented byte by byte in memory and reloaded */
+__attribute__((target("aes,sse2"), always_inline))
+static inline v2di_t aesaccel_ctr_next(uint64_t *hi, uint64_t *lo)
+{
+  if (++*lo == 0) {
+    ++*hi;
+  }
+  return (v2di_t){ (long long)__builtin_bswap64(*hi),
+                   (long long)__builtin_bswap64(*lo) };
+}
+
+__attribute__((target("aes,sse2")))
+void aesaccel_ctr_generate_aesni(const aesaccel_key_t *key, uint8_t *ctr,
+                                 uint8_t *out, size_t nblocks)
+{
+  v2di_t b[AESACCEL_PIPELINE];
+  uint64_t hi, lo;
+  int i;
+
+  hi = __builtin_bswap64(*(const uint64_t *)ctr);
+  lo = __builtin_bswap64(*(const uint64_t *)(ctr + 8));
+
+  for (; nblocks >= AESACCEL_PIPELINE; nblocks -= AESACCEL_PIPELINE) {
+    for (i = 0; i < AESACCEL_PIPELINE; i++) {
+      b[i] = aesaccel_ctr_next(&hi, &lo);
+    }
+    aesaccel_encrypt_x4(key->ek, key->nr, b);
+    for (i = 0; i < AESACCEL_PIPELINE; i++) {
+      STOREU(out + i*AESACCEL_BLOCK_LENGTH, b[i]);
+    }
+    out += AESACCEL_PIPELINE * AESACCEL_BLOCK_LENGTH;
+  }
+  for (; nblocks > 0; nblocks--) {
+    b[0] = aesaccel_ctr_next(&hi, &lo);
+    aesaccel_encrypt_x1(key->ek, key->nr, b);
+    STOREU(out, b[0]);
+    out += AESACCEL_BLOCK_LENGTH;
+  }
+
+  *(uint64_t *)ctr = __builtin_bswap64(hi);
+  *(uint64_t *)(ctr + 8) = __builtin_bswap64(lo);
+}
+
+#endif /* AESACCEL_X86 */
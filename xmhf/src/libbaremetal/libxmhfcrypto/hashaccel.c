@@ -0,0 +1,542 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* hashaccel: run-time selection of SHA-1/SHA-256 implementations,
+ * and the portable C ones. see hashaccel.h.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hashaccel_internal.h"
+#include "simd_internal.h"
+
+const uint32_t hashaccel_k256[64] __attribute__((aligned(16))) = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t hashaccel_sha1_iv[5] = {
+  0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+};
+
+static const uint32_t hashaccel_sha256_iv[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+void hashaccel_sha1_blocks_c(uint32_t *state, const uint8_t *in, size_t nblocks)
+{
+  uint32_t w[16], a, b, c, d, e, f, k, t;
+  int i;
+
+  while (nblocks--) {
+    for (i = 0; i < 16; i++) {
+      w[i] = HASHACCEL_LOAD32H(in + 4*i);
+    }
+    a = state[0]; b = state[1]; c = state[2]; d = state[3]; e = state[4];
+
+    for (i = 0; i < 80; i++) {
+      if (i >= 16) {
+        t = w[(i-3) & 15] ^ w[(i-8) & 15] ^ w[(i-14) & 15] ^ w[i & 15];
+        w[i & 15] = ROL32(t, 1);
+      }
+      if (i < 20) {
+        f = d ^ (b & (c ^ d));
+        k = 0x5a827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      } else if (i < 60) {
+        f = (b & c) | (d & (b | c));
+        k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+      t = ROL32(a, 5) + f + e + k + w[i & 15];
+      e = d; d = c; c = ROL32(b, 30); b = a; a = t;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+    in += HASHACCEL_BLOCK_LENGTH;
+  }
+}
+
+void hashaccel_sha256_blocks_c(uint32_t *state, const uint8_t *in, size_t nblocks)
+{
+  uint32_t w[16], s[8], t1, t2;
+  int i;
+
+  while (nblocks--) {
+    for (i = 0; i < 16; i++) {
+      w[i] = HASHACCEL_LOAD32H(in + 4*i);
+    }
+    for (i = 0; i < 8; i++) {
+      s[i] = state[i];
+    }
+
+    for (i = 0; i < 64; i++) {
+      if (i >= 16) {
+        uint32_t w2 = w[(i-2) & 15], w15 = w[(i-15) & 15];
+        w[i & 15] += (ROR32(w2, 17) ^ ROR32(w2, 19) ^ (w2 >> 10))
+          + w[(i-7) & 15]
+          + (ROR32(w15, 7) ^ ROR32(w15, 18) ^ (w15 >> 3));
+      }
+      t1 = s[7] + (ROR32(s[4], 6) ^ ROR32(s[4], 11) ^ ROR32(s[4], 25))
+        + (s[6] ^ (s[4] & (s[5] ^ s[6]))) + hashaccel_k256[i] + w[i & 15];
+      t2 = (ROR32(s[0], 2) ^ ROR32(s[0], 13) ^ ROR32(s[0], 22))
+        + ((s[0] & s[1]) | (s[2] & (s[0] | s[1])));
+      s[7] = s[6]; s[6] = s[5]; s[5] = s[4]; s[4] = s[3] + t1;
+      s[3] = s[2]; s[2] = s[1]; s[1] = s[0]; s[0] = t1 + t2;
+    }
+
+    for (i = 0; i < 8; i++) {
+      state[i] += s[i];
+    }
+    in += HASHACCEL_BLOCK_LENGTH;
+  }
+}
+
+/*
+ * cpu feature detection and FPU state handling
+ */
+
+/* SIMD code is only worth saving the FPU state for in the hypervisor
+   if there are at least this many blocks to hash */
+#define HASHACCEL_KERNEL_MIN_BLOCKS 2
+
+static uint32_t g_hashaccel_flags = 0;
+static uint32_t g_hashaccel_detected = 0;
+static uint32_t g_hashaccel_features = 0;
+
+#ifdef HASHACCEL_X86
+static uint32_t hashaccel_detect(uint32_t flags)
+{
+  uint32_t eax, ebx, ecx, edx, max_leaf;
+  uint32_t ecx1, ebx7 = 0;
+  uint32_t features = 0;
+
+  simd_cpuid(0, 0, &max_leaf, &ebx, &ecx, &edx);
+  if (max_leaf < 1) {
+    return 0;
+  }
+  simd_cpuid(1, 0, &eax, &ebx, &ecx1, &edx);
+  if (max_leaf >= 7) {
+    simd_cpuid(7, 0, &eax, &ebx7, &ecx, &edx);
+  }
+
+  /* fxsr and sse2 are needed for anything */
+  if (!(edx & (1UL << 24)) || !(edx & (1UL << 26))) {
+    return 0;
+  }
+
+  if (ecx1 & (1UL << 9)) {
+    features |= HASHACCEL_FEAT_SSSE3;
+  }
+  /* the SHA-NI code also uses SSE4.1 */
+  if ((ebx7 & (1UL << 29)) && (ecx1 & (1UL << 19)) && (ecx1 & (1UL << 9))) {
+    features |= HASHACCEL_FEAT_SHANI;
+  }
+  /* AVX2, if the OS saves YMM state. never in the hypervisor, since
+     fxsave doesn't preserve the upper halves of the guest's YMM
+     registers. */
+  if (!(flags & HASHACCEL_F_KERNEL)
+      && (ebx7 & (1UL << 5))
+      && (ecx1 & (1UL << 27)) && (ecx1 & (1UL << 28))) {
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__ __volatile__ (".byte 0x0f,0x01,0xd0" /* xgetbv */
+                          : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+    (void)xcr0_hi;
+    if ((xcr0_lo & 0x6) == 0x6) {
+      features |= HASHACCEL_FEAT_AVX2;
+    }
+  }
+
+  return features;
+}
+#else /* !HASHACCEL_X86 */
+static uint32_t hashaccel_detect(uint32_t flags)
+{
+  (void)flags;
+  return 0;
+}
+#endif /* HASHACCEL_X86 */
+
+static bool hashaccel_fpu_begin(simd_fpu_t *fpu)
+{
+  return simd_fpu_begin(fpu, g_hashaccel_flags & HASHACCEL_F_KERNEL);
+}
+
+static void hashaccel_fpu_end(simd_fpu_t *fpu)
+{
+  simd_fpu_end(fpu, g_hashaccel_flags & HASHACCEL_F_KERNEL);
+}
+
+uint32_t hashaccel_init(uint32_t flags)
+{
+  g_hashaccel_flags = flags;
+  g_hashaccel_detected = hashaccel_detect(flags);
+  g_hashaccel_features = g_hashaccel_detected;
+  return g_hashaccel_features;
+}
+
+uint32_t hashaccel_features(void)
+{
+  return g_hashaccel_features;
+}
+
+uint32_t hashaccel_set_features(uint32_t features)
+{
+  g_hashaccel_features = features & g_hashaccel_detected;
+  return g_hashaccel_features;
+}
+
+size_t hashaccel_digest_length(hashaccel_alg_t alg)
+{
+  return (alg == HASHACCEL_SHA1)
+    ? HASHACCEL_SHA1_DIGEST_LENGTH
+    : HASHACCEL_SHA256_DIGEST_LENGTH;
+}
+
+/*
+ * single buffer
+ */
+
+void hashaccel_compress(hashaccel_alg_t alg, uint32_t *state,
+                        const uint8_t *in, size_t nblocks)
+{
+  if (nblocks == 0) {
+    return;
+  }
+
+#ifdef HASHACCEL_X86
+  if ((g_hashaccel_features & HASHACCEL_FEAT_SHANI)
+      && (!(g_hashaccel_flags & HASHACCEL_F_KERNEL)
+          || nblocks >= HASHACCEL_KERNEL_MIN_BLOCKS)) {
+    simd_fpu_t fpu;
+
+    if (hashaccel_fpu_begin(&fpu)) {
+      if (alg == HASHACCEL_SHA1) {
+        hashaccel_sha1_blocks_shani(state, in, nblocks);
+      } else {
+        hashaccel_sha256_blocks_shani(state, in, nblocks);
+      }
+      hashaccel_fpu_end(&fpu);
+      return;
+    }
+  }
+#endif
+
+  if (alg == HASHACCEL_SHA1) {
+    hashaccel_sha1_blocks_c(state, in, nblocks);
+  } else {
+    hashaccel_sha256_blocks_c(state, in, nblocks);
+  }
+}
+
+void hashaccel_begin(hashaccel_ctx_t *ctx, hashaccel_alg_t alg)
+{
+  ctx->alg = alg;
+  if (alg == HASHACCEL_SHA1) {
+    memcpy(ctx->state, hashaccel_sha1_iv, sizeof(hashaccel_sha1_iv));
+  } else {
+    memcpy(ctx->state, hashaccel_sha256_iv, sizeof(hashaccel_sha256_iv));
+  }
+  ctx->length = 0;
+  ctx->curlen = 0;
+}
+
+void hashaccel_update(hashaccel_ctx_t *ctx, const uint8_t *in, size_t len)
+{
+  size_t n;
+
+  if (ctx->curlen > 0) {
+    n = HASHACCEL_BLOCK_LENGTH - ctx->curlen;
+    n = (len < n) ? len : n;
+    memcpy(ctx->buf + ctx->curlen, in, n);
+    ctx->curlen += n;
+    in += n;
+    len -= n;
+    if (ctx->curlen < HASHACCEL_BLOCK_LENGTH) {
+      return;
+    }
+    hashaccel_compress(ctx->alg, ctx->state, ctx->buf, 1);
+    ctx->length += HASHACCEL_BLOCK_LENGTH;
+    ctx->curlen = 0;
+  }
+
+  /* whole blocks in one go, so SIMD setup is paid once */
+  n = len / HASHACCEL_BLOCK_LENGTH;
+  hashaccel_compress(ctx->alg, ctx->state, in, n);
+  ctx->length += n * HASHACCEL_BLOCK_LENGTH;
+  in += n * HASHACCEL_BLOCK_LENGTH;
+  len -= n * HASHACCEL_BLOCK_LENGTH;
+
+  memcpy(ctx->buf, in, len);
+  ctx->curlen = len;
+}
+
+/* the final one or two blocks for a message of length bytes, ending
+   with the tail bytes in tail. returns the number of blocks. */
+static size_t hashaccel_pad(uint8_t pad[2*HASHACCEL_BLOCK_LENGTH],
+                            const uint8_t *tail, size_t tail_len,
+                            uint64_t length)
+{
+  size_t nblocks = (tail_len + 9 > HASHACCEL_BLOCK_LENGTH) ? 2 : 1;
+  uint64_t bits = length * 8;
+  uint8_t *end = pad + nblocks * HASHACCEL_BLOCK_LENGTH;
+  int i;
+
+  memcpy(pad, tail, tail_len);
+  pad[tail_len] = 0x80;
+  memset(pad + tail_len + 1, 0, nblocks * HASHACCEL_BLOCK_LENGTH - tail_len - 1);
+  for (i = 1; i <= 8; i++) {
+    end[-i] = (uint8_t)bits;
+    bits >>= 8;
+  }
+  return nblocks;
+}
+
+static void hashaccel_store_digest(hashaccel_alg_t alg, const uint32_t *state,
+                                   size_t stride, uint8_t *md)
+{
+  size_t i, words = hashaccel_digest_length(alg) / 4;
+
+  for (i = 0; i < words; i++) {
+    uint32_t v = state[i * stride];
+    md[4*i + 0] = (uint8_t)(v >> 24);
+    md[4*i + 1] = (uint8_t)(v >> 16);
+    md[4*i + 2] = (uint8_t)(v >> 8);
+    md[4*i + 3] = (uint8_t)v;
+  }
+}
+
+void hashaccel_finish(hashaccel_ctx_t *ctx, uint8_t *md)
+{
+  uint8_t pad[2*HASHACCEL_BLOCK_LENGTH];
+  size_t nblocks;
+
+  nblocks = hashaccel_pad(pad, ctx->buf, ctx->curlen, ctx->length + ctx->curlen);
+  hashaccel_compress(ctx->alg, ctx->state, pad, nblocks);
+  hashaccel_store_digest(ctx->alg, ctx->state, 1, md);
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void hashaccel_digest(hashaccel_alg_t alg, const uint8_t *in, size_t len,
+                      uint8_t *md)
+{
+  hashaccel_ctx_t ctx;
+
+  hashaccel_begin(&ctx, alg);
+  hashaccel_update(&ctx, in, len);
+  hashaccel_finish(&ctx, md);
+}
+
+/*
+ * multiple buffers
+ */
+
+#ifdef HASHACCEL_X86
+typedef struct {
+  bool active;
+  size_t job;
+  size_t data_blocks; /* left to hash from the buffer */
+  size_t pad_blocks;  /* left to hash from pad */
+  uint8_t pad[2*HASHACCEL_BLOCK_LENGTH];
+} hashaccel_lane_t;
+
+static void hashaccel_lane_start(hashaccel_alg_t alg, hashaccel_lane_t *lane,
+                                 uint32_t *state, size_t lanes, size_t l,
+                                 const uint8_t **ptr, size_t job,
+                                 const uint8_t *in, size_t len)
+{
+  const uint32_t *iv = (alg == HASHACCEL_SHA1) ? hashaccel_sha1_iv : hashaccel_sha256_iv;
+  size_t i, words = (alg == HASHACCEL_SHA1) ? 5 : 8;
+
+  for (i = 0; i < words; i++) {
+    state[i*lanes + l] = iv[i];
+  }
+  lane->active = true;
+  lane->job = job;
+  lane->data_blocks = len / HASHACCEL_BLOCK_LENGTH;
+  lane->pad_blocks = hashaccel_pad(lane->pad,
+                                   in + lane->data_blocks * HASHACCEL_BLOCK_LENGTH,
+                                   len % HASHACCEL_BLOCK_LENGTH,
+                                   len);
+  ptr[l] = lane->data_blocks ? in : lane->pad;
+}
+
+/* keeps every lane busy with a buffer until all are hashed. each
+   step runs all lanes up to the nearest end of a buffer (or of its
+   padding). */
+static void hashaccel_digest_lanes(hashaccel_alg_t alg, hashaccel_lanes_fn_t fn,
+                                   size_t lanes,
+                                   const uint8_t *const *in, const size_t *len,
+                                   size_t n, uint8_t *md)
+{
+  uint32_t state[8 * HASHACCEL_MB_MAX_LANES] __attribute__((aligned(32)));
+  const uint8_t *ptr[HASHACCEL_MB_MAX_LANES];
+  hashaccel_lane_t lane[HASHACCEL_MB_MAX_LANES];
+  size_t dlen = hashaccel_digest_length(alg);
+  size_t l, next = 0, active = 0;
+
+  for (l = 0; l < lanes; l++) {
+    lane[l].active = false;
+    if (next < n) {
+      hashaccel_lane_start(alg, &lane[l], state, lanes, l, ptr,
+                           next, in[next], len[next]);
+      next++;
+      active++;
+    }
+  }
+
+  while (active > 0) {
+    size_t k = (size_t)-1;
+    const uint8_t *busy = NULL;
+
+    for (l = 0; l < lanes; l++) {
+      if (lane[l].active) {
+        size_t left = lane[l].data_blocks ? lane[l].data_blocks : lane[l].pad_blocks;
+        k = (left < k) ? left : k;
+        busy = ptr[l];
+      }
+    }
+    /* idle lanes hash whatever a busy one does, and are ignored */
+    for (l = 0; l < lanes; l++) {
+      if (!lane[l].active) {
+        ptr[l] = busy;
+      }
+    }
+
+    fn(state, ptr, k);
+
+    for (l = 0; l < lanes; l++) {
+      if (!lane[l].active) {
+        continue;
+      }
+      if (lane[l].data_blocks) {
+        lane[l].data_blocks -= k;
+        if (!lane[l].data_blocks) {
+          ptr[l] = lane[l].pad;
+        }
+        continue;
+      }
+      lane[l].pad_blocks -= k;
+      if (lane[l].pad_blocks) {
+        continue;
+      }
+
+      hashaccel_store_digest(alg, &state[l], lanes, md + lane[l].job * dlen);
+      lane[l].active = false;
+      active--;
+      if (next < n) {
+        hashaccel_lane_start(alg, &lane[l], state, lanes, l, ptr,
+                             next, in[next], len[next]);
+        next++;
+        active++;
+      }
+    }
+  }
+}
+#endif /* HASHACCEL_X86 */
+
+void hashaccel_digest_mb(hashaccel_alg_t alg,
+                         const uint8_t *const *in, const size_t *len,
+                         size_t n, uint8_t *md)
+{
+  size_t i, dlen = hashaccel_digest_length(alg);
+
+#ifdef HASHACCEL_X86
+  /* SHA-NI on one buffer at a time beats even eight AVX2 lanes, so
+     lanes are only for cpus without it. */
+  hashaccel_lanes_fn_t fn = NULL;
+  size_t lanes = 0;
+
+  if (g_hashaccel_features & HASHACCEL_FEAT_SHANI) {
+    /* one at a time */
+  } else if (g_hashaccel_features & HASHACCEL_FEAT_AVX2) {
+    fn = (alg == HASHACCEL_SHA1) ? hashaccel_sha1_lanes_x8 : hashaccel_sha256_lanes_x8;
+    lanes = 8;
+  } else if (g_hashaccel_features & HASHACCEL_FEAT_SSSE3) {
+    fn = (alg == HASHACCEL_SHA1) ? hashaccel_sha1_lanes_x4 : hashaccel_sha256_lanes_x4;
+    lanes = 4;
+  }
+
+  if (fn && n > 1) {
+    simd_fpu_t fpu;
+
+    if (hashaccel_fpu_begin(&fpu)) {
+      hashaccel_digest_lanes(alg, fn, lanes, in, len, n, md);
+      hashaccel_fpu_end(&fpu);
+      return;
+    }
+  }
+#endif
+
+  for (i = 0; i < n; i++) {
+    hashaccel_digest(alg, in[i], len[i], md + i*dlen);
+  }
+}
@@ -0,0 +1,87 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* implementations behind hashaccel.h */
+
+#ifndef HASHACCEL_INTERNAL_H
+#define HASHACCEL_INTERNAL_H
+
+#include <hashaccel.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define HASHACCEL_X86
+#endif
+
+#define HASHACCEL_LOAD32H(p)                                            \
+  (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16)                  \
+   | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+extern const uint32_t hashaccel_k256[64];
+
+/* single buffer: nblocks consecutive blocks from in */
+typedef void (*hashaccel_blocks_fn_t)(uint32_t *state, const uint8_t *in,
+                                      size_t nblocks);
+
+void hashaccel_sha1_blocks_c(uint32_t *state, const uint8_t *in, size_t nblocks);
+void hashaccel_sha256_blocks_c(uint32_t *state, const uint8_t *in, size_t nblocks);
+
+/* several buffers: word w of lane l's state is state[w*lanes + l],
+   and each lane hashes nblocks consecutive blocks from in[l], which
+   is advanced past them. */
+typedef void (*hashaccel_lanes_fn_t)(uint32_t *state, const uint8_t **in,
+                                     size_t nblocks);
+
+#ifdef HASHACCEL_X86
+void hashaccel_sha1_blocks_shani(uint32_t *state, const uint8_t *in, size_t nblocks);
+void hashaccel_sha256_blocks_shani(uint32_t *state, const uint8_t *in, size_t nblocks);
+
+void hashaccel_sha1_lanes_x4(uint32_t *state, const uint8_t **in, size_t nblocks);
+void hashaccel_sha256_lanes_x4(uint32_t *state, const uint8_t **in, size_t nblocks);
+void hashaccel_sha1_lanes_x8(uint32_t *state, const uint8_t **in, size_t nblocks);
+void hashaccel_sha256_lanes_x8(uint32_t *state, const uint8_t **in, size_t nblocks);
+#endif
+
+#endif /* HASHACCEL_INTERNAL_H */
@@ -0,0 +1,167 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* multi-buffer SHA-1 and SHA-256, one buffer per 32-bit vector
+ * lane. included by hashaccel_x86.c once per vector width, with
+ * LANES, LANES_TARGET and LANES_NAME defined.
+ */
+
+typedef uint32_t LANES_NAME(lanes_vec_t) __attribute__((vector_size(4*LANES)));
+
+/* the same word of each lane's block */
+#define LANES_LOAD(dst, in, off)                                \
+  do {                                                          \
+    union { LANES_NAME(lanes_vec_t) v; uint32_t u[LANES]; } w_; \
+    int l_;                                                     \
+    for (l_ = 0; l_ < LANES; l_++) {                            \
+      w_.u[l_] = HASHACCEL_LOAD32H((in)[l_] + (off));           \
+    }                                                           \
+    (dst) = w_.v;                                               \
+  } while (0)
+
+#define LANES_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define LANES_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+__attribute__((target(LANES_TARGET)))
+void LANES_NAME(hashaccel_sha1_lanes)(uint32_t *state, const uint8_t **in, size_t nblocks)
+{
+  LANES_NAME(lanes_vec_t) s[5], w[16], a, b, c, d, e, f, t;
+  uint32_t k;
+  int i, l;
+
+  for (i = 0; i < 5; i++) {
+    s[i] = *(LANES_NAME(lanes_vec_t) *)&state[i*LANES];
+  }
+
+  while (nblocks--) {
+    for (i = 0; i < 16; i++) {
+      LANES_LOAD(w[i], in, 4*i);
+    }
+    for (l = 0; l < LANES; l++) {
+      in[l] += HASHACCEL_BLOCK_LENGTH;
+    }
+    a = s[0]; b = s[1]; c = s[2]; d = s[3]; e = s[4];
+
+    for (i = 0; i < 80; i++) {
+      if (i >= 16) {
+        t = w[(i-3) & 15] ^ w[(i-8) & 15] ^ w[(i-14) & 15] ^ w[i & 15];
+        w[i & 15] = LANES_ROL(t, 1);
+      }
+      if (i < 20) {
+        f = d ^ (b & (c ^ d));
+        k = 0x5a827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      } else if (i < 60) {
+        f = (b & c) | (d & (b | c));
+        k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+      t = LANES_ROL(a, 5) + f + e + k + w[i & 15];
+      e = d; d = c; c = LANES_ROL(b, 30); b = a; a = t;
+    }
+
+    s[0] += a; s[1] += b; s[2] += c; s[3] += d; s[4] += e;
+  }
+
+  for (i = 0; i < 5; i++) {
+    *(LANES_NAME(lanes_vec_t) *)&state[i*LANES] = s[i];
+  }
+}
+
+__attribute__((target(LANES_TARGET)))
+void LANES_NAME(hashaccel_sha256_lanes)(uint32_t *state, const uint8_t **in, size_t nblocks)
+{
+  LANES_NAME(lanes_vec_t) s[8], v[8], w[16], t1, t2, w2, w15;
+  int i, l;
+
+  for (i = 0; i < 8; i++) {
+    s[i] = *(LANES_NAME(lanes_vec_t) *)&state[i*LANES];
+  }
+
+  while (nblocks--) {
+    for (i = 0; i < 16; i++) {
+      LANES_LOAD(w[i], in, 4*i);
+    }
+    for (l = 0; l < LANES; l++) {
+      in[l] += HASHACCEL_BLOCK_LENGTH;
+    }
+    for (i = 0; i < 8; i++) {
+      v[i] = s[i];
+    }
+
+    for (i = 0; i < 64; i++) {
+      if (i >= 16) {
+        w2 = w[(i-2) & 15];
+        w15 = w[(i-15) & 15];
+        w[i & 15] += (LANES_ROR(w2, 17) ^ LANES_ROR(w2, 19) ^ (w2 >> 10))
+          + w[(i-7) & 15]
+          + (LANES_ROR(w15, 7) ^ LANES_ROR(w15, 18) ^ (w15 >> 3));
+      }
+      t1 = v[7] + (LANES_ROR(v[4], 6) ^ LANES_ROR(v[4], 11) ^ LANES_ROR(v[4], 25))
+        + (v[6] ^ (v[4] & (v[5] ^ v[6]))) + hashaccel_k256[i] + w[i & 15];
+      t2 = (LANES_ROR(v[0], 2) ^ LANES_ROR(v[0], 13) ^ LANES_ROR(v[0], 22))
+        + ((v[0] & v[1]) | (v[2] & (v[0] | v[1])));
+      v[7] = v[6]; v[6] = v[5]; v[5] = v[4]; v[4] = v[3] + t1;
+      v[3] = v[2]; v[2] = v[1]; v[1] = v[0]; v[0] = t1 + t2;
+    }
+
+    for (i = 0; i < 8; i++) {
+      s[i] += v[i];
+    }
+  }
+
+  for (i = 0; i < 8; i++) {
+    *(LANES_NAME(lanes_vec_t) *)&state[i*LANES] = s[i];
+  }
+}
+
+#undef LANES_LOAD
+#undef LANES_ROL
+#undef LANES_ROR
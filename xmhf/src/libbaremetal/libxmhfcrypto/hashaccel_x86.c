@@ -0,0 +1,245 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* hashaccel: SIMD implementations of SHA-1 and SHA-256 for x86.
+ *
+ * these are built with per-function target attributes, since the
+ * rest of the tree is built without SSE. they must only be called
+ * once hashaccel.c has checked that the cpu has the features and
+ * that the FPU state is taken care of.
+ *
+ * vector operations use GCC builtins rather than <immintrin.h>,
+ * which isn't available with -nostdinc.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hashaccel_internal.h"
+
+#ifdef HASHACCEL_X86
+
+typedef int v4si_t __attribute__((vector_size(16)));
+typedef int v4si_u_t __attribute__((vector_size(16), aligned(1), may_alias));
+typedef short v8hi_t __attribute__((vector_size(16)));
+typedef char v16qi_t __attribute__((vector_size(16)));
+typedef long long v2di_t __attribute__((vector_size(16)));
+
+#define LOADU(p) (*(const v4si_u_t *)(p))
+#define STOREU(p, v) (*(v4si_u_t *)(p) = (v))
+#define PSHUFB(a, m) ((v4si_t)__builtin_ia32_pshufb128((v16qi_t)(a), (v16qi_t)(m)))
+#define PSHUFD(a, imm) ((v4si_t)__builtin_ia32_pshufd((a), (imm)))
+#define PALIGNR(a, b, n) ((v4si_t)__builtin_ia32_palignr128((v2di_t)(a), (v2di_t)(b), (n)*8))
+#define PBLENDW(a, b, imm) ((v4si_t)__builtin_ia32_pblendw128((v8hi_t)(a), (v8hi_t)(b), (imm)))
+
+/*
+ * SHA-1 with SHA-NI. each group of four rounds uses four message
+ * words; groups 4..19 compute theirs from the previous four groups'
+ * with sha1msg1, xor and sha1msg2, spread over the three groups
+ * before they're needed.
+ */
+
+#define SHA1_GROUP(i, E, Enext)                                         \
+  do {                                                                  \
+    if ((i) == 0) {                                                     \
+      E += M[0];                                                        \
+    } else {                                                            \
+      E = __builtin_ia32_sha1nexte(E, M[(i) % 4]);                      \
+    }                                                                   \
+    Enext = abcd;                                                       \
+    if ((i) >= 3 && (i) <= 18) {                                        \
+      M[((i)+1) % 4] = __builtin_ia32_sha1msg2(M[((i)+1) % 4], M[(i) % 4]); \
+    }                                                                   \
+    abcd = __builtin_ia32_sha1rnds4(abcd, E, (i) / 5);                  \
+    if ((i) >= 1 && (i) <= 16) {                                        \
+      M[((i)+3) % 4] = __builtin_ia32_sha1msg1(M[((i)+3) % 4], M[(i) % 4]); \
+    }                                                                   \
+    if ((i) >= 2 && (i) <= 17) {                                        \
+      M[((i)+2) % 4] ^= M[(i) % 4];                                     \
+    }                                                                   \
+  } while (0)
+
+__attribute__((target("sha,sse4.1")))
+void hashaccel_sha1_blocks_shani(uint32_t *state, const uint8_t *in, size_t nblocks)
+{
+  const v4si_t mask = (v4si_t)(v16qi_t){ 15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0 };
+  v4si_t abcd, abcd_save, e0, e0_save, e1, M[4];
+
+  abcd = PSHUFD(LOADU(state), 0x1b);
+  e0 = (v4si_t){ 0, 0, 0, (int)state[4] };
+
+  while (nblocks--) {
+    abcd_save = abcd;
+    e0_save = e0;
+
+    M[0] = PSHUFB(LOADU(in + 0), mask);
+    M[1] = PSHUFB(LOADU(in + 16), mask);
+    M[2] = PSHUFB(LOADU(in + 32), mask);
+    M[3] = PSHUFB(LOADU(in + 48), mask);
+
+    SHA1_GROUP(0, e0, e1);
+    SHA1_GROUP(1, e1, e0);
+    SHA1_GROUP(2, e0, e1);
+    SHA1_GROUP(3, e1, e0);
+    SHA1_GROUP(4, e0, e1);
+    SHA1_GROUP(5, e1, e0);
+    SHA1_GROUP(6, e0, e1);
+    SHA1_GROUP(7, e1, e0);
+    SHA1_GROUP(8, e0, e1);
+    SHA1_GROUP(9, e1, e0);
+    SHA1_GROUP(10, e0, e1);
+    SHA1_GROUP(11, e1, e0);
+    SHA1_GROUP(12, e0, e1);
+    SHA1_GROUP(13, e1, e0);
+    SHA1_GROUP(14, e0, e1);
+    SHA1_GROUP(15, e1, e0);
+    SHA1_GROUP(16, e0, e1);
+    SHA1_GROUP(17, e1, e0);
+    SHA1_GROUP(18, e0, e1);
+    SHA1_GROUP(19, e1, e0);
+
+    e0 = __builtin_ia32_sha1nexte(e0, e0_save);
+    abcd += abcd_save;
+    in += HASHACCEL_BLOCK_LENGTH;
+  }
+
+  STOREU(state, PSHUFD(abcd, 0x1b));
+  state[4] = (uint32_t)e0[3];
+}
+
+/*
+ * SHA-256 with SHA-NI. the state is kept as ABEF and CDGH, which is
+ * what sha256rnds2 wants. message words are scheduled like for SHA-1
+ * above.
+ */
+
+#define SHA256_GROUP(i)                                                 \
+  do {                                                                  \
+    v4si_t msg = M[(i) % 4] + *(const v4si_t *)&hashaccel_k256[4*(i)];  \
+    cdgh = __builtin_ia32_sha256rnds2(cdgh, abef, msg);                 \
+    if ((i) >= 3 && (i) <= 14) {                                        \
+      M[((i)+1) % 4] += PALIGNR(M[(i) % 4], M[((i)+3) % 4], 4);         \
+      M[((i)+1) % 4] = __builtin_ia32_sha256msg2(M[((i)+1) % 4], M[(i) % 4]); \
+    }                                                                   \
+    msg = PSHUFD(msg, 0x0e);                                            \
+    abef = __builtin_ia32_sha256rnds2(abef, cdgh, msg);                 \
+    if ((i) >= 1 && (i) <= 12) {                                        \
+      M[((i)+3) % 4] = __builtin_ia32_sha256msg1(M[((i)+3) % 4], M[(i) % 4]); \
+    }                                                                   \
+  } while (0)
+
+__attribute__((target("sha,sse4.1")))
+void hashaccel_sha256_blocks_shani(uint32_t *state, const uint8_t *in, size_t nblocks)
+{
+  const v4si_t mask = (v4si_t)(v16qi_t){ 3, 2, 1, 0, 7, 6, 5, 4,
+                                         11, 10, 9, 8, 15, 14, 13, 12 };
+  v4si_t abef, cdgh, abef_save, cdgh_save, tmp, M[4];
+
+  tmp = PSHUFD(LOADU(state), 0xb1);        /* CDAB */
+  cdgh = PSHUFD(LOADU(state + 4), 0x1b);   /* EFGH */
+  abef = PALIGNR(tmp, cdgh, 8);            /* ABEF */
+  cdgh = PBLENDW(cdgh, tmp, 0xf0);         /* CDGH */
+
+  while (nblocks--) {
+    abef_save = abef;
+    cdgh_save = cdgh;
+
+    M[0] = PSHUFB(LOADU(in + 0), mask);
+    M[1] = PSHUFB(LOADU(in + 16), mask);
+    M[2] = PSHUFB(LOADU(in + 32), mask);
+    M[3] = PSHUFB(LOADU(in + 48), mask);
+
+    SHA256_GROUP(0);
+    SHA256_GROUP(1);
+    SHA256_GROUP(2);
+    SHA256_GROUP(3);
+    SHA256_GROUP(4);
+    SHA256_GROUP(5);
+    SHA256_GROUP(6);
+    SHA256_GROUP(7);
+    SHA256_GROUP(8);
+    SHA256_GROUP(9);
+    SHA256_GROUP(10);
+    SHA256_GROUP(11);
+    SHA256_GROUP(12);
+    SHA256_GROUP(13);
+    SHA256_GROUP(14);
+    SHA256_GROUP(15);
+
+    abef += abef_save;
+    cdgh += cdgh_save;
+    in += HASHACCEL_BLOCK_LENGTH;
+  }
+
+  tmp = PSHUFD(abef, 0x1b);                /* FEBA */
+  cdgh = PSHUFD(cdgh, 0xb1);               /* DCHG */
+  STOREU(state, PBLENDW(tmp, cdgh, 0xf0)); /* DCBA */
+  STOREU(state + 4, PALIGNR(cdgh, tmp, 8)); /* HGFE */
+}
+
+/*
+ * multi-buffer: one buffer per 32-bit vector lane, 4 with SSSE3 and
+ * 8 with AVX2. hashaccel_lanes.h has the code, once per width.
+ */
+
+#define LANES 4
+#define LANES_TARGET "ssse3"
+#define LANES_NAME(name) name##_x4
+#include "hashaccel_lanes.h"
+#undef LANES
+#undef LANES_TARGET
+#undef LANES_NAME
+
+#define LANES 8
+#define LANES_TARGET "avx2"
+#define LANES_NAME(name) name##_x8
+#include "hashaccel_lanes.h"
+#undef LANES
+#undef LANES_TARGET
+#undef LANES_NAME
+
+#endif /* HASHACCEL_X86 */
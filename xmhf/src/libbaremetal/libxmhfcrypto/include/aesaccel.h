@@ -0,0 +1,122 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/*
+ * aesaccel: AES with the best implementation the cpu supports,
+ * chosen at run time.
+ *
+ * - AES-NI, with several blocks in flight for the modes that allow
+ *   it (ECB, CBC decryption, counter generation)
+ * - a constant-time C implementation otherwise. It uses no
+ *   secret-dependent table lookups or branches (the S-box is
+ *   computed with a bitsliced circuit), so unlike the usual
+ *   table-driven code it doesn't leak key bits through the cache to
+ *   other software sharing the core.
+ *
+ * As with hashaccel, everything uses the C code until aesaccel_init()
+ * is called, and with AESACCEL_F_KERNEL the guest's x87/SSE state is
+ * saved with fxsave and restored around any use of the XMM registers.
+ *
+ * The key schedule has the same layout as libtomcrypt's struct
+ * rijndael_key, so ltc's aes cipher descriptor can hand its scheduled
+ * keys straight to these functions.
+ */
+
+#ifndef __AESACCEL_H__
+#define __AESACCEL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AESACCEL_BLOCK_LENGTH 16
+#define AESACCEL_MAX_ROUNDS 14
+
+/* flags for aesaccel_init */
+#define AESACCEL_F_KERNEL 0x1 /* running in the hypervisor */
+
+/* cpu features aesaccel can use */
+#define AESACCEL_FEAT_AESNI 0x1
+
+typedef struct {
+  /* round keys, as bytes in the order they're xored into the state */
+  uint32_t ek[4*(AESACCEL_MAX_ROUNDS + 1)];
+  /* round keys for the equivalent inverse cipher */
+  uint32_t dk[4*(AESACCEL_MAX_ROUNDS + 1)];
+  int nr;
+} aesaccel_key_t;
+
+/* detect cpu features and start using them. returns the features in
+   use. */
+uint32_t aesaccel_init(uint32_t flags);
+
+/* features in use, and restricting them to a subset of those
+   detected (for testing and benchmarking). */
+uint32_t aesaccel_features(void);
+uint32_t aesaccel_set_features(uint32_t features);
+
+/* schedule a 128, 192 or 256-bit key. returns 0 on success. */
+int aesaccel_setkey(aesaccel_key_t *key, const uint8_t *k, int bits);
+
+/* ECB on nblocks 16-byte blocks. in and out may be the same. */
+void aesaccel_encrypt(const aesaccel_key_t *key, const uint8_t *in,
+                      uint8_t *out, size_t nblocks);
+void aesaccel_decrypt(const aesaccel_key_t *key, const uint8_t *in,
+                      uint8_t *out, size_t nblocks);
+
+/* CBC on nblocks 16-byte blocks. iv is updated to the last ciphertext
+   block, so that a message can be processed in pieces. */
+void aesaccel_cbc_encrypt(const aesaccel_key_t *key, uint8_t *iv,
+                          const uint8_t *in, uint8_t *out, size_t nblocks);
+void aesaccel_cbc_decrypt(const aesaccel_key_t *key, uint8_t *iv,
+                          const uint8_t *in, uint8_t *out, size_t nblocks);
+
+/* counter mode output blocks, as generated by CTR_DRBG (NIST SP
+   800-90 10.2.1.5): for each block, increment the big-endian counter
+   ctr, then store its encryption in out. */
+void aesaccel_ctr_generate(const aesaccel_key_t *key, uint8_t *ctr,
+                           uint8_t *out, size_t nblocks);
+
+#endif /* __AESACCEL_H__ */
@@ -0,0 +1,130 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/*
+ * hashaccel: SHA-1 and SHA-256 with the fastest implementation the
+ * cpu supports, chosen at run time.
+ *
+ * - SHA-NI, for single buffers
+ * - SSSE3 (4 lanes) or AVX2 (8 lanes), for hashing several
+ *   independent buffers at once (e.g., many 4K pages)
+ * - portable C otherwise
+ *
+ * Until hashaccel_init() is called, everything uses the portable C
+ * code, so early boot code (bootloader, SL) that can't use SSE is
+ * safe by default.
+ *
+ * In the hypervisor (HASHACCEL_F_KERNEL), the guest's x87/SSE state
+ * is live in the registers while we run, so it is saved with fxsave
+ * and restored around any use of SSE. CR4.OSFXSR must be set, and
+ * AVX2 is not used, since fxsave doesn't cover the upper halves of
+ * the YMM registers.
+ */
+
+#ifndef __HASHACCEL_H__
+#define __HASHACCEL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HASHACCEL_BLOCK_LENGTH 64
+#define HASHACCEL_SHA1_DIGEST_LENGTH 20
+#define HASHACCEL_SHA256_DIGEST_LENGTH 32
+#define HASHACCEL_MAX_DIGEST_LENGTH HASHACCEL_SHA256_DIGEST_LENGTH
+
+/* most buffers hashed in parallel by hashaccel_digest_mb */
+#define HASHACCEL_MB_MAX_LANES 8
+
+typedef enum {
+  HASHACCEL_SHA1,
+  HASHACCEL_SHA256,
+} hashaccel_alg_t;
+
+/* flags for hashaccel_init */
+#define HASHACCEL_F_KERNEL 0x1 /* running in the hypervisor */
+
+/* cpu features hashaccel can use */
+#define HASHACCEL_FEAT_SSSE3 0x1
+#define HASHACCEL_FEAT_AVX2  0x2
+#define HASHACCEL_FEAT_SHANI 0x4
+
+typedef struct {
+  hashaccel_alg_t alg;
+  uint32_t state[8];
+  uint64_t length; /* bytes compressed so far */
+  uint8_t buf[HASHACCEL_BLOCK_LENGTH];
+  size_t curlen;
+} hashaccel_ctx_t;
+
+/* detect cpu features and start using them. returns the features in
+   use. */
+uint32_t hashaccel_init(uint32_t flags);
+
+/* features in use, and restricting them to a subset of those
+   detected (for testing and benchmarking). */
+uint32_t hashaccel_features(void);
+uint32_t hashaccel_set_features(uint32_t features);
+
+size_t hashaccel_digest_length(hashaccel_alg_t alg);
+
+/* run nblocks 64-byte blocks through the compression function */
+void hashaccel_compress(hashaccel_alg_t alg, uint32_t *state,
+                        const uint8_t *in, size_t nblocks);
+
+void hashaccel_begin(hashaccel_ctx_t *ctx, hashaccel_alg_t alg);
+void hashaccel_update(hashaccel_ctx_t *ctx, const uint8_t *in, size_t len);
+void hashaccel_finish(hashaccel_ctx_t *ctx, uint8_t *md);
+
+void hashaccel_digest(hashaccel_alg_t alg, const uint8_t *in, size_t len,
+                      uint8_t *md);
+
+/* digests of n independent buffers, which may have different
+   lengths. the digest of in[i] is stored at md + i*digest length. */
+void hashaccel_digest_mb(hashaccel_alg_t alg,
+                         const uint8_t *const *in, const size_t *len,
+                         size_t n, uint8_t *md);
+
+#endif /* __HASHACCEL_H__ */
@@ -44,21 +44,14 @@
  * @XMHF_LICENSE_HEADER_END@
  */
 
-#include <tomcrypt.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <sha1.h> 
-
-#include <euchk.h>
+#include <hashaccel.h>
 
 int sha1_buffer(const unsigned char *buffer, size_t len,
                 unsigned char md[SHA_DIGEST_LENGTH])
 {
-  int rv=0;
-  hash_state hs;
-  
-  EU_CHKN( rv = sha1_init( &hs));
-  EU_CHKN( rv = sha1_process( &hs, buffer, len));
-  EU_CHKN( rv = sha1_done( &hs, md));
-
- out:
-  return rv;
+  hashaccel_digest(HASHACCEL_SHA1, buffer, len, md);
+  return 0;
 }
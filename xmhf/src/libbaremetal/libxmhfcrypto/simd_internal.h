@@ -0,0 +1,121 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* cpu feature detection and FPU state handling shared by the SIMD
+   crypto implementations (hashaccel, aesaccel). */
+
+#ifndef SIMD_INTERNAL_H
+#define SIMD_INTERNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define SIMD_X86
+#endif
+
+#define SIMD_CR0_EM     (1UL << 2)
+#define SIMD_CR0_TS     (1UL << 3)
+#define SIMD_CR4_OSFXSR (1UL << 9)
+
+/* fxsave area, plus room to align it */
+typedef struct {
+  uint8_t area[512 + 16];
+} simd_fpu_t;
+
+#ifdef SIMD_X86
+static inline void simd_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax,
+                              uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+  __asm__ __volatile__ ("cpuid"
+                        : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+                        : "a" (leaf), "c" (subleaf));
+}
+
+/* in the hypervisor (kernel), save the guest's x87/SSE state before
+   touching the XMM registers. returns false if SSE can't be used
+   right now, in which case the caller should use its C code. */
+static inline bool simd_fpu_begin(simd_fpu_t *fpu, bool kernel)
+{
+  if (kernel) {
+    unsigned long cr0, cr4;
+    uint8_t *area = (uint8_t *)(((uintptr_t)fpu->area + 15) & ~(uintptr_t)15);
+
+    __asm__ __volatile__ ("mov %%cr0, %0" : "=r" (cr0));
+    __asm__ __volatile__ ("mov %%cr4, %0" : "=r" (cr4));
+    if ((cr0 & (SIMD_CR0_EM | SIMD_CR0_TS))
+        || !(cr4 & SIMD_CR4_OSFXSR)) {
+      return false;
+    }
+    __asm__ __volatile__ ("fxsave %0" : "=m" (*(uint8_t (*)[512])area));
+  }
+  return true;
+}
+
+static inline void simd_fpu_end(simd_fpu_t *fpu, bool kernel)
+{
+  if (kernel) {
+    uint8_t *area = (uint8_t *)(((uintptr_t)fpu->area + 15) & ~(uintptr_t)15);
+
+    __asm__ __volatile__ ("fxrstor %0" : : "m" (*(uint8_t (*)[512])area));
+  }
+}
+#else /* !SIMD_X86 */
+static inline bool simd_fpu_begin(simd_fpu_t *fpu, bool kernel)
+{
+  (void)fpu;
+  (void)kernel;
+  return false;
+}
+
+static inline void simd_fpu_end(simd_fpu_t *fpu, bool kernel)
+{
+  (void)fpu;
+  (void)kernel;
+}
+#endif /* SIMD_X86 */
+
+#endif /* SIMD_INTERNAL_H */
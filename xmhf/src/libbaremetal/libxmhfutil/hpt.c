@@ -189,106 +189,22 @@ int hpt_root_lvl(hpt_type_t t)
 
 hpt_pme_t hpt_pme_setuser(hpt_type_t t, int lvl, hpt_pme_t entry, bool user_accessible)
 {
-  if (t == HPT_TYPE_NORM) {
-    return BR64_SET_BIT(entry, HPT_NORM_US_L21_MP_BIT, user_accessible);
-  } else if (t == HPT_TYPE_PAE) {
-    if (lvl == 3) {
-      assert(user_accessible);
-      return entry;
-    } else {
-      return BR64_SET_BIT(entry, HPT_PAE_US_L21_MP_BIT, user_accessible);
-    }
-  } else if (t == HPT_TYPE_LONG) {
-    return BR64_SET_BIT(entry, HPT_LONG_US_L4321_MP_BIT, user_accessible);
-  } else if (t == HPT_TYPE_EPT) {
-    assert(user_accessible);
-    return entry;
-  }
-  assert(0); return 0; /* unreachable; appeases compiler */
+  return hpt_pme_setuser_inl(t, lvl, entry, user_accessible);
 }
 
 bool hpt_pme_getuser(hpt_type_t t, int lvl, hpt_pme_t entry)
 {
-  if (t == HPT_TYPE_NORM) {
-    return BR64_GET_BIT(entry, HPT_NORM_US_L21_MP_BIT);
-  } else if (t == HPT_TYPE_PAE) {
-    if (lvl == 3) {
-      return true;
-    } else {
-      return BR64_GET_BIT(entry, HPT_PAE_US_L21_MP_BIT);
-    }
-  } else if (t == HPT_TYPE_LONG) {
-    return BR64_GET_BIT(entry, HPT_LONG_US_L4321_MP_BIT);
-  } else if (t == HPT_TYPE_EPT) {
-    return true;
-  }
-  assert(0); return false; /* unreachable; appeases compiler */
+  return hpt_pme_getuser_inl(t, lvl, entry);
 }
 
 hpt_pme_t hpt_pme_setprot(hpt_type_t t, int lvl, hpt_pme_t entry, hpt_prot_t perms)
 {
-  hpt_pme_t rv=entry;
-  assert(hpt_lvl_is_valid(t, lvl));
-  assert(hpt_prot_is_valid(t, lvl, perms));
-
-  if (t == HPT_TYPE_NORM) {
-    rv = BR64_SET_BIT(rv, HPT_NORM_P_L21_MP_BIT, perms & HPT_PROT_READ_MASK);
-    rv = BR64_SET_BIT(rv, HPT_NORM_RW_L21_MP_BIT, perms & HPT_PROT_WRITE_MASK);
-  } else if (t == HPT_TYPE_PAE) {
-    rv = BR64_SET_BIT(rv, HPT_PAE_P_L321_MP_BIT, perms & HPT_PROT_READ_MASK);
-    if (lvl == 2 || lvl == 1) {
-      rv = BR64_SET_BIT(rv, HPT_PAE_RW_L21_MP_BIT, perms & HPT_PROT_WRITE_MASK);
-      rv = BR64_SET_BIT(rv, HPT_PAE_NX_L21_MP_BIT, !(perms & HPT_PROT_EXEC_MASK));
-    }
-  } else if (t == HPT_TYPE_LONG) {
-    rv = BR64_SET_BIT(rv, HPT_LONG_P_L4321_MP_BIT, perms & HPT_PROT_READ_MASK);
-    rv = BR64_SET_BIT(rv, HPT_LONG_RW_L4321_MP_BIT, perms & HPT_PROT_WRITE_MASK);
-    rv = BR64_SET_BIT(rv, HPT_LONG_NX_L4321_MP_BIT, !(perms & HPT_PROT_EXEC_MASK));
-  } else if (t == HPT_TYPE_EPT) {
-    rv = BR64_SET_BR(rv, HPT_EPT_PROT_L4321_MP, perms);
-  } else {
-    assert(0);
-  }
-
-  return rv;
+  return hpt_pme_setprot_inl(t, lvl, entry, perms);
 }
 
 hpt_prot_t hpt_pme_getprot(hpt_type_t t, int lvl, hpt_pme_t entry)
 {
-  hpt_prot_t rv=HPT_PROTS_NONE;
-  bool r,w,x;
-  assert(hpt_lvl_is_valid(t, lvl));
-
-  if (t == HPT_TYPE_NORM) {
-    r= entry & MASKBIT64(HPT_NORM_P_L21_MP_BIT);
-    w= entry & MASKBIT64(HPT_NORM_RW_L21_MP_BIT);
-    x= r;
-  } else if (t == HPT_TYPE_PAE) {
-    r= entry & MASKBIT64(HPT_PAE_P_L321_MP_BIT);
-    if (lvl == 2 || lvl == 1) {
-      w= entry & MASKBIT64(HPT_PAE_RW_L21_MP_BIT);
-      x= !(entry & MASKBIT64(HPT_PAE_NX_L21_MP_BIT));;
-    } else {
-      w=r;
-      x=r;
-    }
-  } else if (t == HPT_TYPE_LONG) {
-    r=entry & MASKBIT64(HPT_LONG_P_L4321_MP_BIT);
-    w=entry & MASKBIT64(HPT_LONG_RW_L4321_MP_BIT);
-    x=!(entry & MASKBIT64(HPT_LONG_NX_L4321_MP_BIT));
-  } else if (t == HPT_TYPE_EPT) {
-    r=entry & MASKBIT64(HPT_EPT_R_L4321_MP_BIT);
-    w=entry & MASKBIT64(HPT_EPT_W_L4321_MP_BIT);
-    x=entry & MASKBIT64(HPT_EPT_X_L4321_MP_BIT);
-  } else {
-    assert(0);
-  }
-  rv = HPT_PROTS_NONE;
-  rv = rv | (r ? HPT_PROT_READ_MASK : 0);
-  rv = rv | (w ? HPT_PROT_WRITE_MASK : 0);
-  rv = rv | (x ? HPT_PROT_EXEC_MASK : 0);
-
-  return rv;
+  return hpt_pme_getprot_inl(t, lvl, entry);
 }
 
 hpt_pme_t hpt_pme_setunused(hpt_type_t t, int lvl, hpt_pme_t entry, int hi, int lo, hpt_pme_t val)
@@ -339,172 +255,55 @@ hpt_pme_t hpt_pme_getunused(hpt_type_t t, int lvl, hpt_pme_t entry, int hi, int
 
 bool hpt_pme_is_present(hpt_type_t t, int lvl, hpt_pme_t entry)
 {
-  /* a valid entry is present iff read access is enabled. */
-  return hpt_pme_getprot(t, lvl, entry) & HPT_PROT_READ_MASK;
+  return hpt_pme_is_present_inl(t, lvl, entry);
 }
 
 bool hpt_pme_is_page(hpt_type_t t, int lvl, hpt_pme_t entry)
 {
-  if (t== HPT_TYPE_NORM) {
-    assert(lvl<=2);
-    return lvl == 1 || (lvl==2 && BR64_GET_BIT(entry, HPT_NORM_PS_L2_MP_BIT));
-  } else if (t == HPT_TYPE_PAE) {
-    assert(lvl<=3);
-    return lvl == 1 || (lvl==2 && BR64_GET_BIT(entry, HPT_PAE_PS_L2_MP_BIT));
-  } else if (t == HPT_TYPE_LONG) {
-    assert(lvl<=3);
-    return lvl == 1 || ((lvl==2 || lvl==3) && BR64_GET_BIT(entry, HPT_LONG_PS_L32_MP_BIT));
-  } else if (t == HPT_TYPE_EPT) {
-    assert(lvl<=4);
-    return lvl == 1 || ((lvl==2 || lvl==3) && BR64_GET_BIT(entry, HPT_EPT_PS_L32_MP_BIT));
-  } else {
-    assert(0);
-    return false;
-  }
+  return hpt_pme_is_page_inl(t, lvl, entry);
 }
 
 hpt_pa_t hpt_pme_get_address(hpt_type_t t, int lvl, hpt_pme_t entry)
 {
-  if (t == HPT_TYPE_NORM) {
-    assert(lvl<=2);
-    if(lvl==2) {
-      if (hpt_pme_is_page(t,lvl,entry)) {
-        /* 4 MB page */
-        hpt_pa_t rv = 0;
-        rv = BR64_COPY_BITS_HL(rv, entry,
-                               39, 32,
-                               32-HPT_NORM_ADDR3932_L2_P_LO);
-        rv = BR64_COPY_BITS_HL(rv, entry,
-                               31, 22,
-                               22-HPT_NORM_ADDR3122_L2_P_LO);
-        return rv;
-      } else {
-        return BR64_COPY_BITS_HL(0, entry,
-                                 HPT_NORM_ADDR_L2_M_HI,
-                                 HPT_NORM_ADDR_L2_M_LO, 0);
-      }
-    } else {
-      return BR64_COPY_BITS_HL(0, entry,
-                               HPT_NORM_ADDR_L1_P_HI,
-                               HPT_NORM_ADDR_L1_P_LO, 0);
-    }
-  } else if (t == HPT_TYPE_PAE) {
-    assert(lvl<=3);
-    if (hpt_pme_is_page(t, lvl, entry)) {
-      if (lvl == 1) {
-        return BR64_COPY_BITS_HL(0, entry,
-                                 HPT_PAE_ADDR_L1_P_HI,
-                                 HPT_PAE_ADDR_L1_P_LO, 0);
-      } else {
-        assert(lvl==2);
-        return BR64_COPY_BITS_HL(0, entry,
-                                 HPT_PAE_ADDR_L2_P_HI,
-                                 HPT_PAE_ADDR_L2_P_LO, 0);
-      }
-    } else {
-      return BR64_COPY_BITS_HL(0, entry,
-                               HPT_PAE_ADDR_L321_M_HI,
-                               HPT_PAE_ADDR_L321_M_LO, 0);
-    }
-  } else if (t == HPT_TYPE_LONG) {
-    assert(lvl<=4);
-    if (hpt_pme_is_page(t, lvl, entry)) {
-      if(lvl==1) {
-        return BR64_COPY_BITS_HL(0, entry,
-                                 HPT_LONG_ADDR_L1_P_HI,
-                                 HPT_LONG_ADDR_L1_P_LO, 0);
-      } else {
-        return BR64_COPY_BITS_HL(0, entry,
-                                 HPT_LONG_ADDR_L32_P_HI,
-                                 HPT_LONG_ADDR_L32_P_LO, 0);
-      }
-    } else {
-      return BR64_COPY_BITS_HL(0, entry,
-                               HPT_LONG_ADDR_L4321_M_HI,
-                               HPT_LONG_ADDR_L4321_M_LO, 0);
-    }
-  } else if (t == HPT_TYPE_EPT) {
-    assert(lvl<=4);
-    return BR64_COPY_BITS_HL(0, entry,
-                             HPT_EPT_ADDR_L4321_MP_HI,
-                             HPT_EPT_ADDR_L4321_MP_LO, 0);
-  } else {
-    assert(0);
-    return 0;
-  }
+  return hpt_pme_get_address_inl(t, lvl, entry);
 }
 
 hpt_pme_t hpt_pme_set_address(hpt_type_t t, int lvl, hpt_pme_t entry, hpt_pa_t addr)
 {
-  if (t == HPT_TYPE_NORM) {
-    assert(lvl<=2);
-    if(lvl==2) {
-      if (hpt_pme_is_page(t,lvl,entry)) {
-        hpt_pme_t rv = entry;
-        /* 4 MB page */
-        rv = BR64_COPY_BITS_HL(entry, addr,
-                               HPT_NORM_ADDR3932_L2_P_HI,
-                               HPT_NORM_ADDR3932_L2_P_LO,
-                               HPT_NORM_ADDR3932_L2_P_LO-32);
-        rv = BR64_COPY_BITS_HL(entry, addr,
-                               HPT_NORM_ADDR3122_L2_P_HI,
-                               HPT_NORM_ADDR3122_L2_P_LO,
-                               HPT_NORM_ADDR3122_L2_P_LO-22);
-        return rv;
-      } else {
-        return BR64_COPY_BITS_HL(entry, addr,
-                                 HPT_NORM_ADDR_L2_M_HI,
-                                 HPT_NORM_ADDR_L2_M_LO, 0);
-      }
-    } else {
-      return BR64_COPY_BITS_HL(entry, addr,
-                               HPT_NORM_ADDR_L1_P_HI,
-                               HPT_NORM_ADDR_L1_P_LO, 0);
-    }
-  } else if (t == HPT_TYPE_PAE) {
-    assert(lvl<=3);
-    if (hpt_pme_is_page(t, lvl, entry)) {
-      if (lvl == 1) {
-        return BR64_COPY_BITS_HL(entry, addr,
-                                 HPT_PAE_ADDR_L1_P_HI,
-                                 HPT_PAE_ADDR_L1_P_LO, 0);
-      } else {
-        assert(lvl==2);
-        return BR64_COPY_BITS_HL(entry, addr,
-                                 HPT_PAE_ADDR_L2_P_HI,
-                                 HPT_PAE_ADDR_L2_P_LO, 0);
-      }
-    } else {
-      return BR64_COPY_BITS_HL(entry, addr,
-                               HPT_PAE_ADDR_L321_M_HI,
-                               HPT_PAE_ADDR_L321_M_LO, 0);
-    }
-  } else if (t == HPT_TYPE_LONG) {
-    assert(lvl<=4);
-    if (hpt_pme_is_page(t, lvl, entry)) {
-      if(lvl==1) {
-        return BR64_COPY_BITS_HL(entry, addr,
-                                 HPT_LONG_ADDR_L1_P_HI,
-                                 HPT_LONG_ADDR_L1_P_LO, 0);
-      } else {
-        return BR64_COPY_BITS_HL(entry, addr,
-                                 HPT_LONG_ADDR_L32_P_HI,
-                                 HPT_LONG_ADDR_L32_P_LO, 0);
-      }
+  return hpt_pme_set_address_inl(t, lvl, entry, addr);
+}
+
+/* entry for the first of the pages one level down that together map
+ * the same memory as the large page 'entry', with the same
+ * protections and memory type. 2M and 4M pages keep their PAT bit
+ * in the address field of 4K entries, in the bit that 4K entries
+ * use for PAT, so it has to move.
+ */
+hpt_pme_t hpt_pme_split_page(hpt_type_t t, int lvl, hpt_pme_t entry)
+{
+  hpt_pa_t addr = hpt_pme_get_address(t, lvl, entry);
+  hpt_pme_t rv = entry;
+
+  assert(lvl > 1 && hpt_pme_is_page(t, lvl, entry));
+
+  if (lvl == 2) {
+    if (t == HPT_TYPE_NORM) {
+      bool pat = BR64_GET_BIT(entry, HPT_NORM_PAT_L2_P_BIT);
+      rv = BR64_SET_BIT(rv, HPT_NORM_PAT_L1_P_BIT, pat);
+    } else if (t == HPT_TYPE_PAE) {
+      bool pat = BR64_GET_BIT(entry, HPT_PAE_PAT_L2_P_BIT);
+      rv = BR64_SET_BIT(rv, HPT_PAE_PAT_L1_P_BIT, pat);
+    } else if (t == HPT_TYPE_LONG) {
+      bool pat = BR64_GET_BIT(entry, HPT_LONG_PAT_L32_P_BIT);
+      rv = BR64_SET_BIT(rv, HPT_LONG_PAT_L1_P_BIT, pat);
+    } else if (t == HPT_TYPE_EPT) {
+      rv = BR64_SET_BIT(rv, HPT_EPT_PS_L32_MP_BIT, 0);
     } else {
-      return BR64_COPY_BITS_HL(entry, addr,
-                               HPT_LONG_ADDR_L4321_M_HI,
-                               HPT_LONG_ADDR_L4321_M_LO, 0);
+      assert(0);
     }
-  } else if (t == HPT_TYPE_EPT) {
-    assert(lvl<=4);
-    return BR64_COPY_BITS_HL(entry, addr,
-                             HPT_EPT_ADDR_L4321_MP_HI,
-                             HPT_EPT_ADDR_L4321_MP_LO, 0);
-  } else {
-    assert(0);
-    return 0;
   }
+
+  return hpt_pme_set_address(t, lvl-1, rv, addr);
 }
 
 /* "internal". use hpt_pme_set_pmt instead */
@@ -703,48 +502,25 @@ hpt_pmt_t hpt_pme_set_pmt(hpt_type_t t, int lvl, hpt_pme_t pme, hpt_pmt_t pmt)
 
 unsigned int hpt_get_pm_idx(hpt_type_t t, int lvl, hpt_va_t va)
 {
-  unsigned int lo;
-  unsigned int hi;
-  assert(hpt_type_is_valid(t));
-  assert(hpt_lvl_is_valid(t, lvl));
-
-  hi = hpt_va_idx_hi[t][lvl];
-  lo = hpt_va_idx_hi[t][lvl-1]+1;
-
-  return BR64_GET_HL(va, hi, lo);
+  return hpt_get_pm_idx_inl(t, lvl, va);
 }
 
 hpt_pme_t hpt_pm_get_pme_by_idx(hpt_type_t t, int lvl, hpt_pm_t pm, int idx)
 {
-  HPT_UNUSED_ARGUMENT(lvl);
-  if(t == HPT_TYPE_EPT || t == HPT_TYPE_PAE || t == HPT_TYPE_LONG) {
-    return ((u64*)pm)[idx];
-  } else if (t == HPT_TYPE_NORM) {
-    return ((u32*)pm)[idx];
-  } else {
-    assert(0);
-    return 0;
-  }
+  return hpt_pm_get_pme_by_idx_inl(t, lvl, pm, idx);
 }
 
 void hpt_pm_set_pme_by_idx(hpt_type_t t, int lvl, hpt_pm_t pm, int idx, hpt_pme_t pme)
 {
-  HPT_UNUSED_ARGUMENT(lvl);
-  if(t == HPT_TYPE_EPT || t == HPT_TYPE_PAE || t == HPT_TYPE_LONG) {
-    ((u64*)pm)[idx] = pme;
-  } else if (t == HPT_TYPE_NORM) {
-    ((u32*)pm)[idx] = pme;
-  } else {
-    assert(0);
-  }
+  hpt_pm_set_pme_by_idx_inl(t, lvl, pm, idx, pme);
 }
 
 hpt_pme_t hpt_pm_get_pme_by_va(hpt_type_t t, int lvl, hpt_pm_t pm, hpt_va_t va)
 {
-  return hpt_pm_get_pme_by_idx(t, lvl, pm, hpt_get_pm_idx(t, lvl, va));
+  return hpt_pm_get_pme_by_va_inl(t, lvl, pm, va);
 }
 
 void hpt_pm_set_pme_by_va(hpt_type_t t, int lvl, hpt_pm_t pm, hpt_va_t va, hpt_pme_t pme)
 {
-  hpt_pm_set_pme_by_idx(t, lvl, pm, hpt_get_pm_idx(t, lvl, va), pme);
+  hpt_pm_set_pme_by_va_inl(t, lvl, pm, va, pme);
 }
@@ -212,7 +212,7 @@ bool hpt_pme_is_page(hpt_type_t t, int lvl, hpt_pme_t entry)
     assert(lvl<=3);
     return lvl == 1 || (lvl==2 && BR64_GET_BIT(entry, HPT_PAE_PS_L2_MP_BIT));
   } else if (t == HPT_TYPE_LONG) {
-    assert(lvl<=3);
+    assert(lvl<=4);
     return lvl == 1 || ((lvl==2 || lvl==3) && BR64_GET_BIT(entry, HPT_LONG_PS_L32_MP_BIT));
   } else if (t == HPT_TYPE_EPT) {
     assert(lvl<=4);
@@ -232,10 +232,12 @@ hpt_pa_t hpt_pme_get_address(hpt_type_t t, int lvl, hpt_pme_t entry)
         /* 4 MB page */
         hpt_pa_t rv = 0;
         rv = BR64_COPY_BITS_HL(rv, entry,
-                               39, 32,
+                               HPT_NORM_ADDR3932_L2_P_HI,
+                               HPT_NORM_ADDR3932_L2_P_LO,
                                32-HPT_NORM_ADDR3932_L2_P_LO);
         rv = BR64_COPY_BITS_HL(rv, entry,
-                               31, 22,
+                               HPT_NORM_ADDR3122_L2_P_HI,
+                               HPT_NORM_ADDR3122_L2_P_LO,
                                22-HPT_NORM_ADDR3122_L2_P_LO);
         return rv;
       } else {
@@ -302,13 +304,11 @@ hpt_pme_t hpt_pme_set_address(hpt_type_t t, int lvl, hpt_pme_t entry, hpt_pa_t a
       if (hpt_pme_is_page(t,lvl,entry)) {
         hpt_pme_t rv = entry;
         /* 4 MB page */
-        rv = BR64_COPY_BITS_HL(entry, addr,
-                               HPT_NORM_ADDR3932_L2_P_HI,
-                               HPT_NORM_ADDR3932_L2_P_LO,
+        rv = BR64_COPY_BITS_HL(rv, addr,
+                               39, 32,
                                HPT_NORM_ADDR3932_L2_P_LO-32);
-        rv = BR64_COPY_BITS_HL(entry, addr,
-                               HPT_NORM_ADDR3122_L2_P_HI,
-                               HPT_NORM_ADDR3122_L2_P_LO,
+        rv = BR64_COPY_BITS_HL(rv, addr,
+                               31, 22,
                                HPT_NORM_ADDR3122_L2_P_LO-22);
         return rv;
       } else {
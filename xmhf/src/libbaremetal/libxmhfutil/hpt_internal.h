@@ -64,6 +64,8 @@ hpt_pa_t hpt_pme_get_address(hpt_type_t t, int lvl, hpt_pme_t entry);
 
 hpt_pme_t hpt_pme_set_address(hpt_type_t t, int lvl, hpt_pme_t entry, hpt_pa_t addr);
 
+hpt_pme_t hpt_pme_split_page(hpt_type_t t, int lvl, hpt_pme_t entry);
+
 /* Assumes PAT register has default values */
 hpt_pmt_t hpt_pme_get_pmt(hpt_type_t t, int lvl, hpt_pme_t pme);
 
@@ -78,4 +80,383 @@ void hpt_pm_set_pme_by_idx(hpt_type_t t, int lvl, hpt_pm_t pm, int idx, hpt_pme_
 hpt_pme_t hpt_pm_get_pme_by_va(hpt_type_t t, int lvl, hpt_pm_t pm, hpt_va_t va);
 void hpt_pm_set_pme_by_va(hpt_type_t t, int lvl, hpt_pm_t pm, hpt_va_t va, hpt_pme_t pme);
 
+/* the bodies of the primitives above that page walks use, for
+ * inlining. each one branches on the table type, so where t is a
+ * compile-time constant, as in the per-type walkers that hptw.c
+ * instantiates from hptw_walk.h, the branches fold away and what is
+ * left is that type's bit positions and entry width. hpto.c inlines
+ * them too, and hpt.c wraps them for everything else.
+ */
+#define HPT_INLINE static inline __attribute__((always_inline))
+
+HPT_INLINE int hpt_type_max_lvl_inl(hpt_type_t t)
+{
+  return (t == HPT_TYPE_NORM) ? 2 : (t == HPT_TYPE_PAE) ? 3 : 4;
+}
+
+/* as hpt_pm_sizes[t][lvl] */
+HPT_INLINE size_t hpt_pm_size_inl(hpt_type_t t, int lvl)
+{
+  return (t == HPT_TYPE_PAE && lvl == 3) ? 4*sizeof(hpt_pme_t) : HPT_PM_SIZE;
+}
+
+/* as hpt_va_idx_hi[t][lvl] */
+HPT_INLINE int hpt_va_idx_hi_inl(hpt_type_t t, int lvl)
+{
+  return
+    (t == HPT_TYPE_NORM) ? 11 + 10*lvl
+    : (t == HPT_TYPE_PAE && lvl == 3) ? 31
+    : 11 + 9*lvl;
+}
+
+HPT_INLINE hpt_pme_t hpt_pme_setuser_inl(hpt_type_t t, int lvl, hpt_pme_t entry, bool user_accessible)
+{
+  if (t == HPT_TYPE_NORM) {
+    return BR64_SET_BIT(entry, HPT_NORM_US_L21_MP_BIT, user_accessible);
+  } else if (t == HPT_TYPE_PAE) {
+    if (lvl == 3) {
+      assert(user_accessible);
+      return entry;
+    } else {
+      return BR64_SET_BIT(entry, HPT_PAE_US_L21_MP_BIT, user_accessible);
+    }
+  } else if (t == HPT_TYPE_LONG) {
+    return BR64_SET_BIT(entry, HPT_LONG_US_L4321_MP_BIT, user_accessible);
+  } else if (t == HPT_TYPE_EPT) {
+    assert(user_accessible);
+    return entry;
+  }
+  assert(0); return 0; /* unreachable; appeases compiler */
+}
+
+HPT_INLINE bool hpt_pme_getuser_inl(hpt_type_t t, int lvl, hpt_pme_t entry)
+{
+  if (t == HPT_TYPE_NORM) {
+    return BR64_GET_BIT(entry, HPT_NORM_US_L21_MP_BIT);
+  } else if (t == HPT_TYPE_PAE) {
+    if (lvl == 3) {
+      return true;
+    } else {
+      return BR64_GET_BIT(entry, HPT_PAE_US_L21_MP_BIT);
+    }
+  } else if (t == HPT_TYPE_LONG) {
+    return BR64_GET_BIT(entry, HPT_LONG_US_L4321_MP_BIT);
+  } else if (t == HPT_TYPE_EPT) {
+    return true;
+  }
+  assert(0); return false; /* unreachable; appeases compiler */
+}
+
+HPT_INLINE hpt_pme_t hpt_pme_setprot_inl(hpt_type_t t, int lvl, hpt_pme_t entry, hpt_prot_t perms)
+{
+  hpt_pme_t rv=entry;
+  assert(lvl <= hpt_type_max_lvl_inl(t));
+  assert(hpt_prot_is_valid(t, lvl, perms));
+
+  if (t == HPT_TYPE_NORM) {
+    rv = BR64_SET_BIT(rv, HPT_NORM_P_L21_MP_BIT, perms & HPT_PROT_READ_MASK);
+    rv = BR64_SET_BIT(rv, HPT_NORM_RW_L21_MP_BIT, perms & HPT_PROT_WRITE_MASK);
+  } else if (t == HPT_TYPE_PAE) {
+    rv = BR64_SET_BIT(rv, HPT_PAE_P_L321_MP_BIT, perms & HPT_PROT_READ_MASK);
+    if (lvl == 2 || lvl == 1) {
+      rv = BR64_SET_BIT(rv, HPT_PAE_RW_L21_MP_BIT, perms & HPT_PROT_WRITE_MASK);
+      rv = BR64_SET_BIT(rv, HPT_PAE_NX_L21_MP_BIT, !(perms & HPT_PROT_EXEC_MASK));
+    }
+  } else if (t == HPT_TYPE_LONG) {
+    rv = BR64_SET_BIT(rv, HPT_LONG_P_L4321_MP_BIT, perms & HPT_PROT_READ_MASK);
+    rv = BR64_SET_BIT(rv, HPT_LONG_RW_L4321_MP_BIT, perms & HPT_PROT_WRITE_MASK);
+    rv = BR64_SET_BIT(rv, HPT_LONG_NX_L4321_MP_BIT, !(perms & HPT_PROT_EXEC_MASK));
+  } else if (t == HPT_TYPE_EPT) {
+    rv = BR64_SET_BR(rv, HPT_EPT_PROT_L4321_MP, perms);
+  } else {
+    assert(0);
+  }
+
+  return rv;
+}
+
+HPT_INLINE hpt_prot_t hpt_pme_getprot_inl(hpt_type_t t, int lvl, hpt_pme_t entry)
+{
+  hpt_prot_t rv=HPT_PROTS_NONE;
+  bool r=false,w=false,x=false;
+  assert(lvl <= hpt_type_max_lvl_inl(t));
+
+  if (t == HPT_TYPE_NORM) {
+    r= entry & MASKBIT64(HPT_NORM_P_L21_MP_BIT);
+    w= entry & MASKBIT64(HPT_NORM_RW_L21_MP_BIT);
+    x= r;
+  } else if (t == HPT_TYPE_PAE) {
+    r= entry & MASKBIT64(HPT_PAE_P_L321_MP_BIT);
+    if (lvl == 2 || lvl == 1) {
+      w= entry & MASKBIT64(HPT_PAE_RW_L21_MP_BIT);
+      x= !(entry & MASKBIT64(HPT_PAE_NX_L21_MP_BIT));
+    } else {
+      w=r;
+      x=r;
+    }
+  } else if (t == HPT_TYPE_LONG) {
+    r=entry & MASKBIT64(HPT_LONG_P_L4321_MP_BIT);
+    w=entry & MASKBIT64(HPT_LONG_RW_L4321_MP_BIT);
+    x=!(entry & MASKBIT64(HPT_LONG_NX_L4321_MP_BIT));
+  } else if (t == HPT_TYPE_EPT) {
+    r=entry & MASKBIT64(HPT_EPT_R_L4321_MP_BIT);
+    w=entry & MASKBIT64(HPT_EPT_W_L4321_MP_BIT);
+    x=entry & MASKBIT64(HPT_EPT_X_L4321_MP_BIT);
+  } else {
+    assert(0);
+  }
+  rv = HPT_PROTS_NONE;
+  rv = rv | (r ? HPT_PROT_READ_MASK : 0);
+  rv = rv | (w ? HPT_PROT_WRITE_MASK : 0);
+  rv = rv | (x ? HPT_PROT_EXEC_MASK : 0);
+
+  return rv;
+}
+
+HPT_INLINE bool hpt_pme_is_present_inl(hpt_type_t t, int lvl, hpt_pme_t entry)
+{
+  /* a valid entry is present iff read access is enabled. */
+  return hpt_pme_getprot_inl(t, lvl, entry) & HPT_PROT_READ_MASK;
+}
+
+HPT_INLINE bool hpt_pme_is_page_inl(hpt_type_t t, int lvl, hpt_pme_t entry)
+{
+  if (t== HPT_TYPE_NORM) {
+    assert(lvl<=2);
+    return lvl == 1 || (lvl==2 && BR64_GET_BIT(entry, HPT_NORM_PS_L2_MP_BIT));
+  } else if (t == HPT_TYPE_PAE) {
+    assert(lvl<=3);
+    return lvl == 1 || (lvl==2 && BR64_GET_BIT(entry, HPT_PAE_PS_L2_MP_BIT));
+  } else if (t == HPT_TYPE_LONG) {
+    assert(lvl<=4);
+    return lvl == 1 || ((lvl==2 || lvl==3) && BR64_GET_BIT(entry, HPT_LONG_PS_L32_MP_BIT));
+  } else if (t == HPT_TYPE_EPT) {
+    assert(lvl<=4);
+    return lvl == 1 || ((lvl==2 || lvl==3) && BR64_GET_BIT(entry, HPT_EPT_PS_L32_MP_BIT));
+  } else {
+    assert(0);
+    return false;
+  }
+}
+
+/* whether entries of level lvl can map pages. 1G pages (LONG and
+ * EPT level 3) also need processor support, which is the caller's to
+ * check. */
+HPT_INLINE bool hpt_lvl_has_pages_inl(hpt_type_t t, int lvl)
+{
+  return lvl == 1
+    || lvl == 2
+    || (lvl == 3 && (t == HPT_TYPE_LONG || t == HPT_TYPE_EPT));
+}
+
+/* marks entry, of a level above 1, as a page rather than a pointer
+ * to the next level's page map. set this before the address, which
+ * is laid out differently in large pages for some types. */
+HPT_INLINE hpt_pme_t hpt_pme_setpage_inl(hpt_type_t t, int lvl, hpt_pme_t entry, bool page)
+{
+  assert(lvl > 1 && hpt_lvl_has_pages_inl(t, lvl));
+  if (t == HPT_TYPE_NORM) {
+    return BR64_SET_BIT(entry, HPT_NORM_PS_L2_MP_BIT, page);
+  } else if (t == HPT_TYPE_PAE) {
+    return BR64_SET_BIT(entry, HPT_PAE_PS_L2_MP_BIT, page);
+  } else if (t == HPT_TYPE_LONG) {
+    return BR64_SET_BIT(entry, HPT_LONG_PS_L32_MP_BIT, page);
+  } else if (t == HPT_TYPE_EPT) {
+    return BR64_SET_BIT(entry, HPT_EPT_PS_L32_MP_BIT, page);
+  }
+  assert(0); return 0; /* unreachable; appeases compiler */
+}
+
+HPT_INLINE hpt_pa_t hpt_pme_get_address_inl(hpt_type_t t, int lvl, hpt_pme_t entry)
+{
+  if (t == HPT_TYPE_NORM) {
+    assert(lvl<=2);
+    if(lvl==2) {
+      if (hpt_pme_is_page_inl(t,lvl,entry)) {
+        /* 4 MB page */
+        hpt_pa_t rv = 0;
+        rv = BR64_COPY_BITS_HL(rv, entry,
+                               HPT_NORM_ADDR3932_L2_P_HI,
+                               HPT_NORM_ADDR3932_L2_P_LO,
+                               32-HPT_NORM_ADDR3932_L2_P_LO);
+        rv = BR64_COPY_BITS_HL(rv, entry,
+                               HPT_NORM_ADDR3122_L2_P_HI,
+                               HPT_NORM_ADDR3122_L2_P_LO,
+                               22-HPT_NORM_ADDR3122_L2_P_LO);
+        return rv;
+      } else {
+        return BR64_COPY_BITS_HL(0, entry,
+                                 HPT_NORM_ADDR_L2_M_HI,
+                                 HPT_NORM_ADDR_L2_M_LO, 0);
+      }
+    } else {
+      return BR64_COPY_BITS_HL(0, entry,
+                               HPT_NORM_ADDR_L1_P_HI,
+                               HPT_NORM_ADDR_L1_P_LO, 0);
+    }
+  } else if (t == HPT_TYPE_PAE) {
+    assert(lvl<=3);
+    if (hpt_pme_is_page_inl(t, lvl, entry)) {
+      if (lvl == 1) {
+        return BR64_COPY_BITS_HL(0, entry,
+                                 HPT_PAE_ADDR_L1_P_HI,
+                                 HPT_PAE_ADDR_L1_P_LO, 0);
+      } else {
+        assert(lvl==2);
+        return BR64_COPY_BITS_HL(0, entry,
+                                 HPT_PAE_ADDR_L2_P_HI,
+                                 HPT_PAE_ADDR_L2_P_LO, 0);
+      }
+    } else {
+      return BR64_COPY_BITS_HL(0, entry,
+                               HPT_PAE_ADDR_L321_M_HI,
+                               HPT_PAE_ADDR_L321_M_LO, 0);
+    }
+  } else if (t == HPT_TYPE_LONG) {
+    assert(lvl<=4);
+    if (hpt_pme_is_page_inl(t, lvl, entry)) {
+      if(lvl==1) {
+        return BR64_COPY_BITS_HL(0, entry,
+                                 HPT_LONG_ADDR_L1_P_HI,
+                                 HPT_LONG_ADDR_L1_P_LO, 0);
+      } else {
+        return BR64_COPY_BITS_HL(0, entry,
+                                 HPT_LONG_ADDR_L32_P_HI,
+                                 HPT_LONG_ADDR_L32_P_LO, 0);
+      }
+    } else {
+      return BR64_COPY_BITS_HL(0, entry,
+                               HPT_LONG_ADDR_L4321_M_HI,
+                               HPT_LONG_ADDR_L4321_M_LO, 0);
+    }
+  } else if (t == HPT_TYPE_EPT) {
+    assert(lvl<=4);
+    return BR64_COPY_BITS_HL(0, entry,
+                             HPT_EPT_ADDR_L4321_MP_HI,
+                             HPT_EPT_ADDR_L4321_MP_LO, 0);
+  } else {
+    assert(0);
+    return 0;
+  }
+}
+
+HPT_INLINE hpt_pme_t hpt_pme_set_address_inl(hpt_type_t t, int lvl, hpt_pme_t entry, hpt_pa_t addr)
+{
+  if (t == HPT_TYPE_NORM) {
+    assert(lvl<=2);
+    if(lvl==2) {
+      if (hpt_pme_is_page_inl(t,lvl,entry)) {
+        hpt_pme_t rv = entry;
+        /* 4 MB page */
+        rv = BR64_COPY_BITS_HL(rv, addr,
+                               39, 32,
+                               HPT_NORM_ADDR3932_L2_P_LO-32);
+        rv = BR64_COPY_BITS_HL(rv, addr,
+                               31, 22,
+                               HPT_NORM_ADDR3122_L2_P_LO-22);
+        return rv;
+      } else {
+        return BR64_COPY_BITS_HL(entry, addr,
+                                 HPT_NORM_ADDR_L2_M_HI,
+                                 HPT_NORM_ADDR_L2_M_LO, 0);
+      }
+    } else {
+      return BR64_COPY_BITS_HL(entry, addr,
+                               HPT_NORM_ADDR_L1_P_HI,
+                               HPT_NORM_ADDR_L1_P_LO, 0);
+    }
+  } else if (t == HPT_TYPE_PAE) {
+    assert(lvl<=3);
+    if (hpt_pme_is_page_inl(t, lvl, entry)) {
+      if (lvl == 1) {
+        return BR64_COPY_BITS_HL(entry, addr,
+                                 HPT_PAE_ADDR_L1_P_HI,
+                                 HPT_PAE_ADDR_L1_P_LO, 0);
+      } else {
+        assert(lvl==2);
+        return BR64_COPY_BITS_HL(entry, addr,
+                                 HPT_PAE_ADDR_L2_P_HI,
+                                 HPT_PAE_ADDR_L2_P_LO, 0);
+      }
+    } else {
+      return BR64_COPY_BITS_HL(entry, addr,
+                               HPT_PAE_ADDR_L321_M_HI,
+                               HPT_PAE_ADDR_L321_M_LO, 0);
+    }
+  } else if (t == HPT_TYPE_LONG) {
+    assert(lvl<=4);
+    if (hpt_pme_is_page_inl(t, lvl, entry)) {
+      if(lvl==1) {
+        return BR64_COPY_BITS_HL(entry, addr,
+                                 HPT_LONG_ADDR_L1_P_HI,
+                                 HPT_LONG_ADDR_L1_P_LO, 0);
+      } else {
+        return BR64_COPY_BITS_HL(entry, addr,
+                                 HPT_LONG_ADDR_L32_P_HI,
+                                 HPT_LONG_ADDR_L32_P_LO, 0);
+      }
+    } else {
+      return BR64_COPY_BITS_HL(entry, addr,
+                               HPT_LONG_ADDR_L4321_M_HI,
+                               HPT_LONG_ADDR_L4321_M_LO, 0);
+    }
+  } else if (t == HPT_TYPE_EPT) {
+    assert(lvl<=4);
+    return BR64_COPY_BITS_HL(entry, addr,
+                             HPT_EPT_ADDR_L4321_MP_HI,
+                             HPT_EPT_ADDR_L4321_MP_LO, 0);
+  } else {
+    assert(0);
+    return 0;
+  }
+}
+
+HPT_INLINE unsigned int hpt_get_pm_idx_inl(hpt_type_t t, int lvl, hpt_va_t va)
+{
+  unsigned int lo;
+  unsigned int hi;
+  assert(t < HPT_TYPE_NUM);
+  assert(lvl <= hpt_type_max_lvl_inl(t));
+
+  hi = hpt_va_idx_hi_inl(t, lvl);
+  lo = hpt_va_idx_hi_inl(t, lvl-1)+1;
+
+  return BR64_GET_HL(va, hi, lo);
+}
+
+HPT_INLINE hpt_pme_t hpt_pm_get_pme_by_idx_inl(hpt_type_t t, int lvl, hpt_pm_t pm, int idx)
+{
+  HPT_UNUSED_ARGUMENT(lvl);
+  if(t == HPT_TYPE_EPT || t == HPT_TYPE_PAE || t == HPT_TYPE_LONG) {
+    return ((u64*)pm)[idx];
+  } else if (t == HPT_TYPE_NORM) {
+    return ((u32*)pm)[idx];
+  } else {
+    assert(0);
+    return 0;
+  }
+}
+
+HPT_INLINE void hpt_pm_set_pme_by_idx_inl(hpt_type_t t, int lvl, hpt_pm_t pm, int idx, hpt_pme_t pme)
+{
+  HPT_UNUSED_ARGUMENT(lvl);
+  if(t == HPT_TYPE_EPT || t == HPT_TYPE_PAE || t == HPT_TYPE_LONG) {
+    ((u64*)pm)[idx] = pme;
+  } else if (t == HPT_TYPE_NORM) {
+    ((u32*)pm)[idx] = pme;
+  } else {
+    assert(0);
+  }
+}
+
+HPT_INLINE hpt_pme_t hpt_pm_get_pme_by_va_inl(hpt_type_t t, int lvl, hpt_pm_t pm, hpt_va_t va)
+{
+  return hpt_pm_get_pme_by_idx_inl(t, lvl, pm, hpt_get_pm_idx_inl(t, lvl, va));
+}
+
+HPT_INLINE void hpt_pm_set_pme_by_va_inl(hpt_type_t t, int lvl, hpt_pm_t pm, hpt_va_t va, hpt_pme_t pme)
+{
+  hpt_pm_set_pme_by_idx_inl(t, lvl, pm, hpt_get_pm_idx_inl(t, lvl, va), pme);
+}
+
 #endif
@@ -49,53 +49,53 @@
 
 hpt_pa_t hpt_pmeo_get_address(const hpt_pmeo_t *pmeo)
 {
-  return hpt_pme_get_address(pmeo->t, pmeo->lvl, pmeo->pme);
+  return hpt_pme_get_address_inl(pmeo->t, pmeo->lvl, pmeo->pme);
 }
 void hpt_pmeo_set_address(hpt_pmeo_t *pmeo, hpt_pa_t addr)
 {
-  pmeo->pme = hpt_pme_set_address(pmeo->t, pmeo->lvl, pmeo->pme, addr);
+  pmeo->pme = hpt_pme_set_address_inl(pmeo->t, pmeo->lvl, pmeo->pme, addr);
 }
 
 bool hpt_pmeo_is_present(const hpt_pmeo_t *pmeo)
 {
-  return hpt_pme_is_present(pmeo->t, pmeo->lvl, pmeo->pme);
+  return hpt_pme_is_present_inl(pmeo->t, pmeo->lvl, pmeo->pme);
 }
 
 bool hpt_pmeo_is_page(const hpt_pmeo_t *pmeo)
 {
-  return hpt_pme_is_page(pmeo->t, pmeo->lvl, pmeo->pme);
+  return hpt_pme_is_page_inl(pmeo->t, pmeo->lvl, pmeo->pme);
 }
 
 void hpt_pmeo_setprot(hpt_pmeo_t *pmeo, hpt_prot_t perms)
 {
-  pmeo->pme = hpt_pme_setprot(pmeo->t, pmeo->lvl, pmeo->pme, perms);
+  pmeo->pme = hpt_pme_setprot_inl(pmeo->t, pmeo->lvl, pmeo->pme, perms);
 }
 
 hpt_prot_t hpt_pmeo_getprot(const hpt_pmeo_t *pmeo)
 {
-  return hpt_pme_getprot(pmeo->t, pmeo->lvl, pmeo->pme);
+  return hpt_pme_getprot_inl(pmeo->t, pmeo->lvl, pmeo->pme);
 }
 
 bool hpt_pmeo_getuser(const hpt_pmeo_t *pmeo)
 {
-  return hpt_pme_getuser(pmeo->t, pmeo->lvl, pmeo->pme);
+  return hpt_pme_getuser_inl(pmeo->t, pmeo->lvl, pmeo->pme);
 }
 
 void hpt_pmeo_setuser(hpt_pmeo_t *pmeo, bool user)
 {
-  pmeo->pme = hpt_pme_setuser(pmeo->t, pmeo->lvl, pmeo->pme, user);
+  pmeo->pme = hpt_pme_setuser_inl(pmeo->t, pmeo->lvl, pmeo->pme, user);
 }
 
 void hpt_pm_get_pmeo_by_va(hpt_pmeo_t *pmeo, const hpt_pmo_t *pmo, hpt_va_t va)
 {
   pmeo->t = pmo->t;
   pmeo->lvl = pmo->lvl;
-  pmeo->pme = hpt_pm_get_pme_by_va(pmo->t, pmo->lvl, pmo->pm, va);
+  pmeo->pme = hpt_pm_get_pme_by_va_inl(pmo->t, pmo->lvl, pmo->pm, va);
 }
 
 void hpt_pmo_set_pme_by_va(hpt_pmo_t *pmo, const hpt_pmeo_t *pmeo, hpt_va_t va)
 {
-  hpt_pm_set_pme_by_va(pmo->t, pmo->lvl, pmo->pm, va, pmeo->pme);
+  hpt_pm_set_pme_by_va_inl(pmo->t, pmo->lvl, pmo->pm, va, pmeo->pme);
 }
 
 hpt_pa_t hpt_pmeo_va_to_pa(hpt_pmeo_t* pmeo, hpt_va_t va)
@@ -104,7 +104,7 @@ hpt_pa_t hpt_pmeo_va_to_pa(hpt_pmeo_t* pmeo, hpt_va_t va)
   hpt_pa_t offset;
   int offset_hi;
 
-  assert(hpt_pme_is_page(pmeo->t, pmeo->lvl, pmeo->pme));
+  assert(hpt_pme_is_page_inl(pmeo->t, pmeo->lvl, pmeo->pme));
   base = hpt_pmeo_get_address(pmeo);
 
   offset_hi = hpt_va_idx_hi[pmeo->t][pmeo->lvl-1];
@@ -135,3 +135,15 @@ size_t hpt_remaining_on_page(const hpt_pmeo_t *pmeo, hpt_va_t va)
   offset_on_page = va & MASKRANGE64(page_size_log_2-1, 0);
   return page_size - offset_on_page;
 }
+
+/* sets sub to the entry for the first of the pages one level below
+   large page 'page' that map the same memory. sub may be page. */
+void hpt_pmeo_split_page(hpt_pmeo_t *sub, const hpt_pmeo_t *page)
+{
+  hpt_pmeo_t rv = {
+    .pme = hpt_pme_split_page(page->t, page->lvl, page->pme),
+    .t = page->t,
+    .lvl = page->lvl-1,
+  };
+  *sub = rv;
+}
@@ -49,6 +49,83 @@
 #include <string.h> /* for memset */
 
 #include "hpt_log.h"
+#include "hpt_internal.h"
+
+/* one copy of the page walk, and of the loops over level 1 entries,
+ * per table type. the hptw entry points below switch on the type once
+ * per walk or run of entries, rather than every primitive switching on
+ * it once per entry.
+ */
+#define HPTW_WALK_T HPT_TYPE_NORM
+#define HPTW_WALK(name) name##_norm
+#include "hptw_walk.h"
+
+#define HPTW_WALK_T HPT_TYPE_PAE
+#define HPTW_WALK(name) name##_pae
+#include "hptw_walk.h"
+
+#define HPTW_WALK_T HPT_TYPE_LONG
+#define HPTW_WALK(name) name##_long
+#include "hptw_walk.h"
+
+#define HPTW_WALK_T HPT_TYPE_EPT
+#define HPTW_WALK(name) name##_ept
+#include "hptw_walk.h"
+
+static bool hptw_walk(hptw_ctx_t *ctx,
+                      hpt_pmo_t *pmo,
+                      hpt_pmeo_t *pmeo,
+                      int end_lvl,
+                      hpt_va_t va,
+                      hpt_prot_t *prots,
+                      bool *user)
+{
+  switch (pmo->t) {
+  case HPT_TYPE_NORM:
+    return hptw_walk_norm(ctx, pmo, pmeo, end_lvl, va, prots, user);
+  case HPT_TYPE_PAE:
+    return hptw_walk_pae(ctx, pmo, pmeo, end_lvl, va, prots, user);
+  case HPT_TYPE_LONG:
+    return hptw_walk_long(ctx, pmo, pmeo, end_lvl, va, prots, user);
+  case HPT_TYPE_EPT:
+    return hptw_walk_ept(ctx, pmo, pmeo, end_lvl, va, prots, user);
+  default:
+    assert(0);
+    return false;
+  }
+}
+
+static void hptw_fill(hpt_type_t t,
+                      hpt_pm_t pm,
+                      unsigned int first,
+                      unsigned int last,
+                      hpt_pme_t pme,
+                      hpt_pa_t pa)
+{
+  switch (t) {
+  case HPT_TYPE_NORM: hptw_fill_norm(pm, first, last, pme, pa); break;
+  case HPT_TYPE_PAE:  hptw_fill_pae(pm, first, last, pme, pa); break;
+  case HPT_TYPE_LONG: hptw_fill_long(pm, first, last, pme, pa); break;
+  case HPT_TYPE_EPT:  hptw_fill_ept(pm, first, last, pme, pa); break;
+  default: assert(0);
+  }
+}
+
+static void hptw_protect(hpt_type_t t,
+                         hpt_pm_t pm,
+                         unsigned int first,
+                         unsigned int last,
+                         hpt_prot_t prot,
+                         bool unmap)
+{
+  switch (t) {
+  case HPT_TYPE_NORM: hptw_protect_norm(pm, first, last, prot, unmap); break;
+  case HPT_TYPE_PAE:  hptw_protect_pae(pm, first, last, prot, unmap); break;
+  case HPT_TYPE_LONG: hptw_protect_long(pm, first, last, prot, unmap); break;
+  case HPT_TYPE_EPT:  hptw_protect_ept(pm, first, last, prot, unmap); break;
+  default: assert(0);
+  }
+}
 
 static int hptw_get_root( hptw_ctx_t *ctx, hpt_pmo_t *pmo)
 {
@@ -96,6 +173,44 @@ int hptw_insert_pmeo(hptw_ctx_t *ctx,
   return err;
 }
 
+/* points the entry for va in pmo at new_pmo, one level down, starting
+ * from entry pmeo. the entry grants all access, leaving it to the
+ * entries in new_pmo to restrict it.
+ */
+static void hptw_link_next_lvl(hptw_ctx_t *ctx,
+                               hpt_pmo_t *pmo,
+                               hpt_pmeo_t *pmeo,
+                               hpt_va_t va,
+                               const hpt_pmo_t *new_pmo)
+{
+  hpt_pmeo_set_address(pmeo, ctx->ptr2pa(ctx, new_pmo->pm));
+  hpt_pmeo_setprot(    pmeo, HPT_PROTS_RWX);
+  hpt_pmeo_setuser(    pmeo, true);
+
+  hpt_pmo_set_pme_by_va(pmo, pmeo, va);
+}
+
+static int hptw_alloc_pm(hptw_ctx_t *ctx,
+                         const hpt_pmo_t *pmo,
+                         hpt_pmo_t *new_pmo)
+{
+  hpt_pm_t pm;
+  int err = 1;
+
+  EU_CHK( pm = ctx->gzp(ctx,
+                        HPT_PM_SIZE, /*FIXME*/
+                        hpt_pm_size(pmo->t, pmo->lvl-1)));
+  *new_pmo = (hpt_pmo_t) {
+    .pm = pm,
+    .lvl = pmo->lvl-1,
+    .t = pmo->t,
+  };
+
+  err = 0;
+ out:
+  return err;
+}
+
 int hptw_get_pmo_alloc(hpt_pmo_t *pmo,
                        hptw_ctx_t *ctx,
                        int end_lvl,
@@ -111,22 +226,9 @@ int hptw_get_pmo_alloc(hpt_pmo_t *pmo,
     EU_CHK( !hpt_pmeo_is_page(&pmeo));
 
     if (!hpt_pmeo_is_present(&pmeo)) {
-      hpt_pm_t pm;
       hpt_pmo_t new_pmo;
-
-      EU_CHK( pm = ctx->gzp(ctx,
-                            HPT_PM_SIZE, /*FIXME*/
-                            hpt_pm_size(pmo->t, pmo->lvl-1)));
-      new_pmo = (hpt_pmo_t) {
-        .pm = pm,
-        .lvl = pmo->lvl-1,
-        .t = pmo->t,
-      };
-      hpt_pmeo_set_address(&pmeo, ctx->ptr2pa(ctx, new_pmo.pm));
-      hpt_pmeo_setprot(    &pmeo, HPT_PROTS_RWX);
-      hpt_pmeo_setuser(    &pmeo, true);
-
-      hpt_pmo_set_pme_by_va(pmo, &pmeo, va);
+      EU_CHKN( hptw_alloc_pm(ctx, pmo, &new_pmo));
+      hptw_link_next_lvl(ctx, pmo, &pmeo, va, &new_pmo);
     }
     {
       bool walked_next_lvl;
@@ -163,10 +265,10 @@ void hptw_get_pmo( hpt_pmo_t *pmo,
                    int end_lvl,
                    hpt_va_t va)
 {
+  hpt_pmeo_t pmeo;
   int err=1;
   EU_CHKN( hptw_get_root( ctx, pmo));
-  while (pmo->lvl > end_lvl
-         && hptw_next_lvl(ctx, pmo, va));
+  hptw_walk(ctx, pmo, &pmeo, end_lvl, va, NULL, NULL);
   err=0;
  out:
   EU_VERIFYN( err); /* XXX */
@@ -178,8 +280,12 @@ void hptw_get_pmeo(hpt_pmeo_t *pmeo,
                    hpt_va_t va)
 {
   hpt_pmo_t end_pmo;
-  hptw_get_pmo(&end_pmo, ctx, end_lvl, va);
-  hpt_pm_get_pmeo_by_va(pmeo, &end_pmo, va);
+  int err=1;
+  EU_CHKN( hptw_get_root( ctx, &end_pmo));
+  EU_CHK( hptw_walk(ctx, &end_pmo, pmeo, end_lvl, va, NULL, NULL));
+  err=0;
+ out:
+  EU_VERIFYN( err); /* XXX */
 }
 
 bool hptw_next_lvl(hptw_ctx_t *ctx, hpt_pmo_t *pmo, hpt_va_t va)
@@ -233,19 +339,15 @@ hpt_prot_t hptw_get_effective_prots(hptw_ctx_t *ctx,
   hpt_prot_t prots_rv = HPT_PROTS_RWX;
   bool user_accessible_rv = true;
   hpt_pmo_t pmo;
+  hpt_pmeo_t pmeo;
   int err = 1;
 
   EU_CHKN( hptw_get_root( ctx, &pmo));
 
-  do {
-    hpt_pmeo_t pmeo;
-    hpt_pm_get_pmeo_by_va(&pmeo, &pmo, va);
-    prots_rv &= hpt_pmeo_getprot(&pmeo);
-    user_accessible_rv = user_accessible_rv && hpt_pmeo_getuser(&pmeo);
-  } while (hptw_next_lvl(ctx, &pmo, va));
-
   /* XXX should more clearly indicate an error */
-  EU_CHK( pmo.t != HPT_TYPE_INVALID);
+  EU_CHK( hptw_walk(ctx, &pmo, &pmeo, 1, va, &prots_rv, &user_accessible_rv));
+  prots_rv &= hpt_pmeo_getprot(&pmeo);
+  user_accessible_rv = user_accessible_rv && hpt_pmeo_getuser(&pmeo);
 
   if(user_accessible != NULL) {
     *user_accessible = user_accessible_rv;
@@ -275,6 +377,392 @@ void hptw_set_prot(hptw_ctx_t *ctx,
   hpt_pmo_set_pme_by_va (&pmo, &pmeo, va);
 }
 
+void hptw_leaf_init(hptw_leaf_t *leaf)
+{
+  *leaf = (hptw_leaf_t) {
+    .pmo = { .pm = NULL, .t = HPT_TYPE_INVALID, .lvl = 0 },
+    .prots = HPT_PROTS_NONE,
+    .user = false,
+    .va_lo = 1,
+    .va_hi = 0,
+  };
+}
+
+static void hptw_leaf_set_range(hptw_leaf_t *leaf, hpt_va_t va)
+{
+  hpt_va_t mask = MASKRANGE64(hpt_va_idx_hi[leaf->pmo.t][leaf->pmo.lvl], 0);
+  leaf->va_lo = va & ~mask;
+  leaf->va_hi = va | mask;
+}
+
+/* walks to the page map holding the leaf entry for va. with alloc,
+ * missing page maps are allocated down to level 1, as in
+ * hptw_get_pmo_alloc.
+ */
+static int hptw_get_leaf(hptw_leaf_t *leaf,
+                         hptw_ctx_t *ctx,
+                         hpt_va_t va,
+                         bool alloc)
+{
+  int err = 1;
+
+  hptw_leaf_init(leaf);
+  EU_CHKN( hptw_get_root( ctx, &leaf->pmo));
+  leaf->prots = HPT_PROTS_RWX;
+  leaf->user = true;
+
+  if (!alloc) {
+    hpt_pmeo_t pmeo;
+    EU_CHK( hptw_walk(ctx, &leaf->pmo, &pmeo, 1, va, &leaf->prots, &leaf->user));
+  }
+
+  while (alloc && leaf->pmo.lvl > 1) {
+    hpt_pmeo_t pmeo;
+    hpt_pm_get_pmeo_by_va(&pmeo, &leaf->pmo, va);
+
+    EU_CHK( !hpt_pmeo_is_page(&pmeo));
+    if (!hpt_pmeo_is_present(&pmeo)) {
+      hpt_pmo_t new_pmo;
+      EU_CHKN( hptw_alloc_pm(ctx, &leaf->pmo, &new_pmo));
+      hptw_link_next_lvl(ctx, &leaf->pmo, &pmeo, va, &new_pmo);
+    }
+
+    leaf->prots &= hpt_pmeo_getprot(&pmeo);
+    leaf->user = leaf->user && hpt_pmeo_getuser(&pmeo);
+    EU_CHK( hptw_next_lvl(ctx, &leaf->pmo, va));
+  }
+  hptw_leaf_set_range(leaf, va);
+
+  err = 0;
+ out:
+  if (err) {
+    hptw_leaf_init(leaf);
+  }
+  return err;
+}
+
+int hptw_leaf_get_pmeo(hpt_pmeo_t *pmeo,
+                       hptw_leaf_t *leaf,
+                       hptw_ctx_t *ctx,
+                       hpt_va_t va)
+{
+  int err = 1;
+
+  if (!(leaf->va_lo <= va && va <= leaf->va_hi)) {
+    EU_CHKN( hptw_get_leaf( leaf, ctx, va, false));
+  }
+  hpt_pm_get_pmeo_by_va(pmeo, &leaf->pmo, va);
+
+  err = 0;
+ out:
+  return err;
+}
+
+int hptw_leaf_get_pmeo_alloc(hpt_pmeo_t *pmeo,
+                             hptw_leaf_t *leaf,
+                             hptw_ctx_t *ctx,
+                             hpt_va_t va)
+{
+  int err = 1;
+
+  if (!(leaf->va_lo <= va && va <= leaf->va_hi && leaf->pmo.lvl == 1)) {
+    EU_CHKN( hptw_get_leaf( leaf, ctx, va, true));
+  }
+  hpt_pm_get_pmeo_by_va(pmeo, &leaf->pmo, va);
+
+  err = 0;
+ out:
+  return err;
+}
+
+/* replaces the large page mapping va in pmo with a new page map of
+ * pages one level down, as hptw_split_page does, and points new_pmo
+ * at it.
+ */
+static int hptw_split_pme(hptw_ctx_t *ctx,
+                          hpt_pmo_t *pmo,
+                          hpt_va_t va,
+                          hpt_pmo_t *new_pmo)
+{
+  hpt_pmeo_t page, sub, dir;
+  hpt_va_t va_base;
+  size_t sub_sz, i, n;
+  int err = 1;
+
+  hpt_pm_get_pmeo_by_va(&page, pmo, va);
+  EU_CHK( pmo->lvl > 1
+          && hpt_pmeo_is_present(&page)
+          && hpt_pmeo_is_page(&page));
+
+  hpt_pmeo_split_page(&sub, &page);
+  sub_sz = hpt_pmeo_page_size(&sub);
+  n = hpt_pmeo_page_size(&page) / sub_sz;
+  va_base = va & ~MASKRANGE64(hpt_pmeo_page_size_log_2(&page)-1, 0);
+
+  EU_CHKN( hptw_alloc_pm(ctx, pmo, new_pmo));
+  for (i=0; i < n; i++) {
+    hpt_pmeo_set_address(&sub, hpt_pmeo_get_address(&page) + i*sub_sz);
+    hpt_pmo_set_pme_by_va(new_pmo, &sub, va_base + i*sub_sz);
+  }
+
+  /* only link the new map in once it's filled, since the page
+     tables may be live */
+  dir = (hpt_pmeo_t) { .pme = 0, .t = page.t, .lvl = page.lvl };
+  hptw_link_next_lvl(ctx, pmo, &dir, va, new_pmo);
+
+  err = 0;
+ out:
+  return err;
+}
+
+int hptw_split_page(hptw_ctx_t *ctx,
+                    hptw_leaf_t *leaf,
+                    hpt_va_t va)
+{
+  hpt_pmo_t new_pmo;
+  int err = 1;
+
+  EU_CHKN( hptw_split_pme(ctx, &leaf->pmo, va, &new_pmo));
+
+  leaf->pmo = new_pmo;
+  hptw_leaf_set_range(leaf, va);
+
+  err = 0;
+ out:
+  return err;
+}
+
+/* size of the memory mapped through one entry of a level lvl page map */
+static hpt_va_t hptw_entry_size(hpt_type_t t, int lvl)
+{
+  return 1ull << (hpt_va_idx_hi[t][lvl-1]+1);
+}
+
+/* maps [va, va_last], which lies within page map pmo, to pa onwards,
+ * as hptw_map_range does. with count_only nothing is changed, and
+ * *pms counts the page maps that would be allocated. pmo->pm is then
+ * NULL for a page map that doesn't exist yet.
+ */
+static int hptw_map_range_pm(hptw_ctx_t *ctx,
+                             hpt_pmo_t *pmo,
+                             hpt_va_t va,
+                             hpt_va_t va_last,
+                             hpt_pa_t pa,
+                             hpt_prot_t prot,
+                             bool user,
+                             int max_lvl,
+                             bool count_only,
+                             size_t *pms)
+{
+  hpt_va_t entry_sz = hptw_entry_size(pmo->t, pmo->lvl);
+  int err = 1;
+
+  if (pmo->lvl == 1) {
+    hpt_pmeo_t pmeo = { .pme = 0, .t = pmo->t, .lvl = 1 };
+    if (!count_only) {
+      hpt_pmeo_setprot(&pmeo, prot);
+      hpt_pmeo_setuser(&pmeo, user);
+      hptw_fill(pmo->t, pmo->pm,
+                hpt_get_pm_idx(pmo->t, 1, va),
+                hpt_get_pm_idx(pmo->t, 1, va_last),
+                pmeo.pme, pa);
+    }
+    return 0;
+  }
+
+  for (;;) {
+    hpt_va_t entry_last = MIN(va | (entry_sz-1), va_last);
+    hpt_pmeo_t pmeo = { .pme = 0, .t = pmo->t, .lvl = pmo->lvl };
+
+    if (pmo->pm) {
+      hpt_pm_get_pmeo_by_va(&pmeo, pmo, va);
+    }
+
+    if (pmo->lvl <= max_lvl
+        && hpt_lvl_has_pages_inl(pmo->t, pmo->lvl)
+        && (va & (entry_sz-1)) == 0
+        && entry_last - va == entry_sz-1
+        && (pa & (entry_sz-1)) == 0
+        && !(hpt_pmeo_is_present(&pmeo) && !hpt_pmeo_is_page(&pmeo))) {
+      /* a large page. page maps already in its place are kept, and
+         filled below instead */
+      if (!count_only) {
+        pmeo.pme = hpt_pme_setpage_inl(pmo->t, pmo->lvl, 0, true);
+        hpt_pmeo_set_address(&pmeo, pa);
+        hpt_pmeo_setprot(&pmeo, prot);
+        hpt_pmeo_setuser(&pmeo, user);
+        hpt_pmo_set_pme_by_va(pmo, &pmeo, va);
+      }
+    } else {
+      hpt_pmo_t next = *pmo;
+
+      if (hpt_pmeo_is_present(&pmeo) && !hpt_pmeo_is_page(&pmeo)) {
+        EU_CHK( hptw_next_lvl(ctx, &next, va));
+      } else if (count_only) {
+        (*pms)++;
+        next.pm = NULL;
+        next.lvl--;
+      } else if (hpt_pmeo_is_present(&pmeo)) {
+        EU_CHKN( hptw_split_pme(ctx, pmo, va, &next));
+      } else {
+        hpt_pmo_t new_pmo;
+        EU_CHKN( hptw_alloc_pm(ctx, pmo, &new_pmo));
+        pmeo.pme = 0;
+        hptw_link_next_lvl(ctx, pmo, &pmeo, va, &new_pmo);
+        next = new_pmo;
+      }
+      EU_CHKN( hptw_map_range_pm(ctx, &next, va, entry_last, pa,
+                                 prot, user, max_lvl, count_only, pms));
+    }
+
+    if (entry_last == va_last) {
+      break;
+    }
+    pa += entry_last - va + 1;
+    va = entry_last + 1;
+  }
+
+  err = 0;
+ out:
+  return err;
+}
+
+int hptw_map_range(hptw_ctx_t *ctx,
+                   hpt_va_t va,
+                   hpt_pa_t pa,
+                   size_t size,
+                   hpt_prot_t prot,
+                   bool user,
+                   int max_lvl)
+{
+  hpt_pmo_t root;
+  int err = 1;
+
+  EU_CHK( size > 0);
+  EU_CHKN( hptw_get_root( ctx, &root));
+  EU_CHKN( hptw_map_range_pm( ctx, &root, va, va + size - 1, pa,
+                              prot, user, max_lvl, false, NULL));
+
+  err = 0;
+ out:
+  return err;
+}
+
+int hptw_map_range_pms(hptw_ctx_t *ctx,
+                       hpt_va_t va,
+                       hpt_pa_t pa,
+                       size_t size,
+                       int max_lvl,
+                       size_t *pms)
+{
+  hpt_pmo_t root;
+  int err = 1;
+
+  *pms = 0;
+  EU_CHK( size > 0);
+  EU_CHKN( hptw_get_root( ctx, &root));
+  EU_CHKN( hptw_map_range_pm( ctx, &root, va, va + size - 1, pa,
+                              HPT_PROTS_NONE, true, max_lvl, true, pms));
+
+  err = 0;
+ out:
+  return err;
+}
+
+/* sets the protections of the pages in [va, va_last], which lies
+ * within page map pmo, or unmaps them, as hptw_protect_range and
+ * hptw_unmap_range do.
+ */
+static int hptw_protect_range_pm(hptw_ctx_t *ctx,
+                                 hpt_pmo_t *pmo,
+                                 hpt_va_t va,
+                                 hpt_va_t va_last,
+                                 hpt_prot_t prot,
+                                 bool unmap)
+{
+  hpt_va_t entry_sz = hptw_entry_size(pmo->t, pmo->lvl);
+  int err = 1;
+
+  if (pmo->lvl == 1) {
+    hptw_protect(pmo->t, pmo->pm,
+                 hpt_get_pm_idx(pmo->t, 1, va),
+                 hpt_get_pm_idx(pmo->t, 1, va_last),
+                 prot, unmap);
+    return 0;
+  }
+
+  for (;;) {
+    hpt_va_t entry_last = MIN(va | (entry_sz-1), va_last);
+    hpt_pmeo_t pmeo;
+
+    hpt_pm_get_pmeo_by_va(&pmeo, pmo, va);
+
+    if (!hpt_pmeo_is_present(&pmeo)) {
+      /* nothing mapped */
+    } else if (hpt_pmeo_is_page(&pmeo)
+               && (va & (entry_sz-1)) == 0
+               && entry_last - va == entry_sz-1) {
+      if (unmap) {
+        pmeo.pme = 0;
+      } else {
+        hpt_pmeo_setprot(&pmeo, prot);
+      }
+      hpt_pmo_set_pme_by_va(pmo, &pmeo, va);
+    } else {
+      hpt_pmo_t next = *pmo;
+      if (hpt_pmeo_is_page(&pmeo)) {
+        EU_CHKN( hptw_split_pme(ctx, pmo, va, &next));
+      } else {
+        EU_CHK( hptw_next_lvl(ctx, &next, va));
+      }
+      EU_CHKN( hptw_protect_range_pm(ctx, &next, va, entry_last, prot, unmap));
+    }
+
+    if (entry_last == va_last) {
+      break;
+    }
+    va = entry_last + 1;
+  }
+
+  err = 0;
+ out:
+  return err;
+}
+
+int hptw_protect_range(hptw_ctx_t *ctx,
+                       hpt_va_t va,
+                       size_t size,
+                       hpt_prot_t prot)
+{
+  hpt_pmo_t root;
+  int err = 1;
+
+  EU_CHK( size > 0);
+  EU_CHKN( hptw_get_root( ctx, &root));
+  EU_CHKN( hptw_protect_range_pm( ctx, &root, va, va + size - 1, prot, false));
+
+  err = 0;
+ out:
+  return err;
+}
+
+int hptw_unmap_range(hptw_ctx_t *ctx,
+                     hpt_va_t va,
+                     size_t size)
+{
+  hpt_pmo_t root;
+  int err = 1;
+
+  EU_CHK( size > 0);
+  EU_CHKN( hptw_get_root( ctx, &root));
+  EU_CHKN( hptw_protect_range_pm( ctx, &root, va, va + size - 1,
+                                  HPT_PROTS_NONE, true));
+
+  err = 0;
+ out:
+  return err;
+}
+
 hpt_pa_t hptw_va_to_pa(hptw_ctx_t *ctx,
                        hpt_va_t va)
 {
@@ -310,6 +798,8 @@ void* hptw_checked_access_va(hptw_ctx_t *ctx,
   hpt_pmeo_t pmeo;
   hpt_pa_t pa;
   hpt_pmo_t pmo;
+  hpt_prot_t prots = HPT_PROTS_RWX;
+  bool user = true;
   void *rv=NULL;
   *avail_sz=0;
 
@@ -318,24 +808,21 @@ void* hptw_checked_access_va(hptw_ctx_t *ctx,
   eu_trace("va:0x%llx access_type %lld cpl:%d",
            va, access_type, cpl);
 
-  do {
-    eu_trace("pmo t:%d pm:%p lvl:%d",
-             pmo.t, pmo.pm, pmo.lvl);
-    hpt_pm_get_pmeo_by_va( &pmeo, &pmo, va);
-    EU_CHK(((access_type & hpt_pmeo_getprot(&pmeo)) == access_type)
-           && (cpl == HPTW_CPL0 || hpt_pmeo_getuser(&pmeo)),
-           eu_err_e("req-priv:%lld req-cpl:%d priv:%lld user-accessible:%d",
-                    access_type, cpl, hpt_pmeo_getprot(&pmeo), hpt_pmeo_getuser(&pmeo)));
-  } while (hptw_next_lvl(ctx, &pmo, va));
-
-  EU_CHK( pmo.t != HPT_TYPE_INVALID);
+  EU_CHK( hptw_walk(ctx, &pmo, &pmeo, 1, va, &prots, &user));
+  eu_trace("pmo t:%d pm:%p lvl:%d",
+           pmo.t, pmo.pm, pmo.lvl);
+  prots &= hpt_pmeo_getprot(&pmeo);
+  user = user && hpt_pmeo_getuser(&pmeo);
+  EU_CHK(((access_type & prots) == access_type)
+         && (cpl == HPTW_CPL0 || user),
+         eu_err_e("req-priv:%lld req-cpl:%d priv:%lld user-accessible:%d",
+                  access_type, cpl, prots, user));
 
   EU_CHK( hpt_pmeo_is_present(&pmeo));
 
-  /* exiting loop means hptw_next_lvl failed, which means either the
-   * current pmeo is a page, or the current pmeo is not present.
-   * however, we should have already returned if not present, so pmeo
-   * must be a page */
+  /* the walk stops at level 1, at a page, or at an entry that isn't
+   * present. we should have already returned if not present, so
+   * pmeo must be a page */
   EU_VERIFY(hpt_pmeo_is_page(&pmeo));
 
   pa = hpt_pmeo_va_to_pa(&pmeo, va);
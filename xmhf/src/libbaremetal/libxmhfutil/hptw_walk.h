@@ -0,0 +1,157 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/* hptw_walk.h - page walk, and the loops over runs of level 1
+ * entries, specialized to one page table type
+ *
+ * no include guard: hptw.c includes this once per type, with
+ * HPTW_WALK_T defined to the type and HPTW_WALK(name) to that type's
+ * name for name. the type being a constant, the hpt_*_inl primitives
+ * fold down to its bit positions and entry width, and these loops
+ * have no type dispatch left in them.
+ */
+
+/* walks down from pmo, which must be of type HPTW_WALK_T, towards
+ * va. stops at level end_lvl, or at the first page or entry that
+ * isn't present. pmo is left at the page map reached, and pmeo at its
+ * entry for va. *prots and *user, where not NULL, are narrowed by the
+ * entries walked through, not including pmeo. as with hptw_next_lvl,
+ * returns false and sets pmo to type HPT_TYPE_INVALID if the pa2ptr
+ * callback fails.
+ */
+static bool HPTW_WALK(hptw_walk)(hptw_ctx_t *ctx,
+                                 hpt_pmo_t *pmo,
+                                 hpt_pmeo_t *pmeo,
+                                 int end_lvl,
+                                 hpt_va_t va,
+                                 hpt_prot_t *prots,
+                                 bool *user)
+{
+  const hpt_type_t t = HPTW_WALK_T;
+  hpt_pm_t pm = pmo->pm;
+  int lvl = pmo->lvl;
+  hpt_pme_t pme;
+
+  assert(pmo->t == t);
+
+  for (;;) {
+    size_t avail;
+    size_t pm_sz;
+
+    pme = hpt_pm_get_pme_by_va_inl(t, lvl, pm, va);
+    if (lvl <= end_lvl
+        || !hpt_pme_is_present_inl(t, lvl, pme)
+        || hpt_pme_is_page_inl(t, lvl, pme)) {
+      break;
+    }
+    if (prots) {
+      *prots &= hpt_pme_getprot_inl(t, lvl, pme);
+    }
+    if (user) {
+      *user = *user && hpt_pme_getuser_inl(t, lvl, pme);
+    }
+
+    pm_sz = hpt_pm_size_inl(t, lvl-1);
+    pm = ctx->pa2ptr(ctx, hpt_pme_get_address_inl(t, lvl, pme),
+                     pm_sz, HPT_PROTS_R, HPTW_CPL0, &avail);
+    if (!pm) {
+      /* see hptw_next_lvl */
+      pmo->pm = NULL;
+      pmo->t = HPT_TYPE_INVALID;
+      pmo->lvl = 0;
+      return false;
+    }
+    assert(avail == pm_sz); /* see hptw_next_lvl */
+    lvl--;
+  }
+
+  *pmo = (hpt_pmo_t) { .pm = pm, .t = t, .lvl = lvl };
+  *pmeo = (hpt_pmeo_t) { .pme = pme, .t = t, .lvl = lvl };
+  return true;
+}
+
+/* sets entries first to last of level 1 page map pm to consecutive
+ * 4K pages from pa, otherwise as pme.
+ */
+static void HPTW_WALK(hptw_fill)(hpt_pm_t pm,
+                                 unsigned int first,
+                                 unsigned int last,
+                                 hpt_pme_t pme,
+                                 hpt_pa_t pa)
+{
+  const hpt_type_t t = HPTW_WALK_T;
+  const hpt_pa_t page_sz = 1ull << (hpt_va_idx_hi_inl(t, 0)+1);
+  unsigned int i;
+
+  for (i = first; i <= last; i++, pa += page_sz) {
+    hpt_pm_set_pme_by_idx_inl(t, 1, pm, i,
+                              hpt_pme_set_address_inl(t, 1, pme, pa));
+  }
+}
+
+/* sets the protections of the present entries first to last of level
+ * 1 page map pm to prot, or clears them with unmap.
+ */
+static void HPTW_WALK(hptw_protect)(hpt_pm_t pm,
+                                    unsigned int first,
+                                    unsigned int last,
+                                    hpt_prot_t prot,
+                                    bool unmap)
+{
+  const hpt_type_t t = HPTW_WALK_T;
+  unsigned int i;
+
+  for (i = first; i <= last; i++) {
+    hpt_pme_t pme = hpt_pm_get_pme_by_idx_inl(t, 1, pm, i);
+    if (hpt_pme_is_present_inl(t, 1, pme)) {
+      hpt_pm_set_pme_by_idx_inl(t, 1, pm, i,
+                                unmap ? 0 : hpt_pme_setprot_inl(t, 1, pme, prot));
+    }
+  }
+}
+
+#undef HPTW_WALK_T
+#undef HPTW_WALK
@@ -180,5 +180,6 @@ hpt_pa_t hpt_pmeo_va_to_pa(hpt_pmeo_t* pmeo, hpt_va_t va);
 size_t hpt_pmeo_page_size_log_2(const hpt_pmeo_t *pmeo);
 size_t hpt_pmeo_page_size(const hpt_pmeo_t *pmeo);
 size_t hpt_remaining_on_page(const hpt_pmeo_t *pmeo, hpt_va_t va);
+void hpt_pmeo_split_page(hpt_pmeo_t *sub, const hpt_pmeo_t *page);
 
 #endif
@@ -106,6 +106,94 @@ void hptw_set_prot( hptw_ctx_t *ctx,
                     hpt_va_t va,
                     hpt_prot_t prot);
 
+/* a cursor for looking up the leaf entries of a range of addresses
+ * one after another. it remembers the page map holding the last
+ * leaf, and the protections granted by the levels above it, so that
+ * the tables are only walked again once the range leaves that map,
+ * rather than once per page. [va_lo, va_hi] is the range of
+ * addresses translated through pmo. the page maps above pmo mustn't
+ * be changed other than through the cursor while it is in use.
+ */
+typedef struct {
+  hpt_pmo_t pmo;
+  hpt_prot_t prots;
+  bool user;
+  hpt_va_t va_lo;
+  hpt_va_t va_hi;
+} hptw_leaf_t;
+
+void hptw_leaf_init( hptw_leaf_t *leaf);
+
+/* gets the leaf entry for va, which may be a large page, or not
+ * present at any level.
+ */
+int hptw_leaf_get_pmeo( hpt_pmeo_t *pmeo,
+                        hptw_leaf_t *leaf,
+                        hptw_ctx_t *ctx,
+                        hpt_va_t va);
+
+/* gets the level 1 entry for va, allocating page maps on the way as
+ * hptw_get_pmo_alloc does. fails on large pages.
+ */
+int hptw_leaf_get_pmeo_alloc( hpt_pmeo_t *pmeo,
+                              hptw_leaf_t *leaf,
+                              hptw_ctx_t *ctx,
+                              hpt_va_t va);
+
+/* replaces the large page mapping va in leaf's page map with a new
+ * page map of pages one level down, mapping the same memory with the
+ * same attributes, and moves leaf down to it. the caller is
+ * responsible for flushing the TLB.
+ */
+int hptw_split_page( hptw_ctx_t *ctx,
+                     hptw_leaf_t *leaf,
+                     hpt_va_t va);
+
+/* maps [va, va+size) to [pa, pa+size) with protections prot, walking
+ * each page map once and filling runs of level 1 entries together.
+ * pages of up to level max_lvl are used wherever va and pa are
+ * aligned for them and the range covers them whole, except where a
+ * page map is already in place. 1G pages need processor support, so
+ * pass HPT_LVL_PD2 unless that's been checked. missing page maps are
+ * allocated with ctx->gzp, and large pages in the way are split.
+ * existing mappings in the range are replaced. va, pa and size must
+ * be 4K aligned. the caller is responsible for flushing the TLB.
+ */
+int hptw_map_range( hptw_ctx_t *ctx,
+                    hpt_va_t va,
+                    hpt_pa_t pa,
+                    size_t size,
+                    hpt_prot_t prot,
+                    bool user,
+                    int max_lvl);
+
+/* sets *pms to the number of page maps hptw_map_range would allocate
+ * given the same range, so that callers can make sure of them first.
+ */
+int hptw_map_range_pms( hptw_ctx_t *ctx,
+                        hpt_va_t va,
+                        hpt_pa_t pa,
+                        size_t size,
+                        int max_lvl,
+                        size_t *pms);
+
+/* sets the protections of the pages mapped in [va, va+size) to prot.
+ * entries that aren't present are left alone. large pages only partly
+ * in the range are split first, which allocates at most two page maps
+ * per level.
+ */
+int hptw_protect_range( hptw_ctx_t *ctx,
+                        hpt_va_t va,
+                        size_t size,
+                        hpt_prot_t prot);
+
+/* unmaps [va, va+size), splitting large pages as hptw_protect_range
+ * does. page maps are kept even if left empty, for later mappings.
+ */
+int hptw_unmap_range( hptw_ctx_t *ctx,
+                      hpt_va_t va,
+                      size_t size);
+
 hpt_pa_t hptw_va_to_pa( hptw_ctx_t *ctx,
                         hpt_va_t va);
 
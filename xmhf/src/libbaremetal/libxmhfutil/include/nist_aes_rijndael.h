@@ -62,14 +62,15 @@
 
 /*
  * Interface adapter for Rijndael implmentation (for use by NIST SP 800-90 CTR_DRBG)
+ *
+ * The block cipher is aesaccel (AES-NI, or constant-time C), rather
+ * than the table-driven rijndael.c.
  */
 
 #ifndef NIST_AES_RIJNDAEL_H
 #define NIST_AES_RIJNDAEL_H
 
-#ifndef __RIJNDAEL_H
-#include "rijndael.h"
-#endif
+#include <aesaccel.h>
 
 #define NIST_AES_MAXKEYBITS		256
 #define NIST_AES_MAXKEYBYTES	(NIST_AES_MAXKEYBITS / 8)
@@ -79,25 +80,28 @@
 #define NIST_AES_BLOCKSIZEBYTES	(NIST_AES_BLOCKSIZEBITS / 8)
 #define NIST_AES_BLOCKSIZEINTS	(NIST_AES_BLOCKSIZEBYTES / sizeof(int))
 
-typedef struct {
-	int Nr;			/* key-length-dependent number of rounds */
-	unsigned int ek[4*(AES_MAXROUNDS + 1)];	/* encrypt key schedule */
-} NIST_AES_ENCRYPT_CTX;
+typedef aesaccel_key_t NIST_AES_ENCRYPT_CTX;
 
 static __inline void
 NIST_AES_ECB_Encrypt(const NIST_AES_ENCRYPT_CTX* ctx, const void* src, void* dst)
 {
-	rijndaelEncrypt(ctx->ek, ctx->Nr, (const unsigned char *)src, (unsigned char *)dst);
+	aesaccel_encrypt(ctx, (const uint8_t *)src, (uint8_t *)dst, 1);
+}
+
+/*
+ * Increment the big-endian counter ctr and encrypt it, nblocks times,
+ * with the blocks pipelined where the hardware allows.
+ */
+static __inline void
+NIST_AES_CTR_Generate(const NIST_AES_ENCRYPT_CTX* ctx, void* ctr, void* dst, int nblocks)
+{
+	aesaccel_ctr_generate(ctx, (uint8_t *)ctr, (uint8_t *)dst, nblocks);
 }
 
 static __inline int
 NIST_AES_Schedule_Encryption(NIST_AES_ENCRYPT_CTX* ctx, const void* key, int bits)
 {
-	ctx->Nr = rijndaelKeySetupEnc(ctx->ek, (const unsigned char *)key, bits);
-	if (!ctx->Nr)
-		return 1;
-
-	return 0;
+	return aesaccel_setkey(ctx, (const uint8_t *)key, bits);
 }
 
 #endif /* NIST_AES_RIJNDAEL_H */
@@ -79,6 +79,7 @@
 typedef NIST_AES_ENCRYPT_CTX NIST_Key;
 
 #define Block_Encrypt(ctx, src, dst) NIST_AES_ECB_Encrypt(ctx, src, dst)
+#define Block_Encrypt_CTR(ctx, ctr, dst, n) NIST_AES_CTR_Generate(ctx, ctr, dst, n)
 #define Block_Schedule_Encryption(ctx, key) NIST_AES_Schedule_Encryption(ctx, key, NIST_BLOCK_KEYLEN)
 
 /*
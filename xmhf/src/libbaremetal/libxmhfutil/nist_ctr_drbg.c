@@ -405,18 +405,12 @@ nist_ctr_drbg_update(NIST_CTR_DRBG* drbg, const unsigned int* provided_data)
 {
 	unsigned int i;
 	unsigned int temp[NIST_BLOCK_SEEDLEN_INTS];
-	unsigned int* output_block;
 
 	/* 2. while (len(temp) < seedlen) do */
-	for (output_block = temp; output_block < &temp[NIST_BLOCK_SEEDLEN_INTS];
-		output_block += NIST_BLOCK_OUTLEN_INTS) {
-
-		/* 2.1 V = (V + 1) mod 2^outlen */
-		nist_increment_block(&drbg->V[0]);
-
-		/* 2.2 output_block = Block_Encrypt(K, V) */
-		Block_Encrypt(&drbg->ctx, drbg->V, output_block);
-	}
+	/* 2.1 V = (V + 1) mod 2^outlen */
+	/* 2.2 output_block = Block_Encrypt(K, V) */
+	Block_Encrypt_CTR(&drbg->ctx, &drbg->V[0], temp,
+		NIST_BLOCK_SEEDLEN_INTS / NIST_BLOCK_OUTLEN_INTS);
 
 	/* 3 temp is already of size seedlen (NIST_BLOCK_SEEDLEN_INTS) */
 
@@ -557,7 +551,7 @@ nist_ctr_drbg_generate(NIST_CTR_DRBG* drbg,
 	void* output_string, int output_string_length,
 	const void* additional_input, int additional_input_length)
 {
-	int i, len, err;
+	int len, err;
 	int blocks = output_string_length / NIST_BLOCK_OUTLEN_BYTES;
 	unsigned char* p;
 	unsigned int* temp;
@@ -587,17 +581,14 @@ nist_ctr_drbg_generate(NIST_CTR_DRBG* drbg,
 		nist_ctr_drbg_update(drbg, additional_input_buffer);
 	}
 
-	if (blocks && check_int_alignment(output_string)) {
+	if (blocks) {
 		/* [3] temp = Null */
-		temp = (unsigned int *)output_string;
-		for (i = 0; i < blocks; ++i) {
-			nist_ctr_drbg_generate_block(drbg, temp);
-
-			temp += NIST_BLOCK_OUTLEN_INTS;
-			output_string_length -= NIST_BLOCK_OUTLEN_BYTES;
-		}
+		/* [4.1]-[4.2] for all the whole blocks at once, so the
+		   cipher can work on several counter values in parallel */
+		Block_Encrypt_CTR(&drbg->ctx, &drbg->V[0], output_string, blocks);
 
-		output_string = (unsigned char *)temp;
+		output_string = (unsigned char *)output_string + blocks * NIST_BLOCK_OUTLEN_BYTES;
+		output_string_length -= blocks * NIST_BLOCK_OUTLEN_BYTES;
 	}
 	
 	/* [3] temp = Null */
@@ -53,6 +53,7 @@
 #define ACPI_RSDP_SIGNATURE  (0x2052545020445352ULL) //"RSD PTR " 
 #define ACPI_FADT_SIGNATURE  (0x50434146)  //"FACP"
 #define ACPI_MADT_SIGNATURE	 (0x43495041)			//"APIC"
+#define ACPI_MCFG_SIGNATURE	 (0x4746434D)			//"MCFG"
 
 #define ACPI_GAS_ASID_SYSMEMORY		0x0
 #define ACPI_GAS_ASID_SYSIO				0x1
@@ -144,6 +145,33 @@ typedef struct {
 	u32 flags;
 } __attribute__ ((packed)) ACPI_MADT_APIC;
 
+//ACPI MCFG structure (PCI Express memory mapped configuration space)
+//followed by (length - sizeof(ACPI_MCFG)) / sizeof(ACPI_MCFG_ALLOCATION)
+//allocation structures
+typedef struct {
+  u32 signature;
+  u32 length;
+  u8 revision;
+  u8 checksum;
+  u8 oemid[6];
+  u64 oemtableid;
+	u32 oemrevision;
+	u32 creatorid;
+	u32 creatorrevision;
+	u64 rsvd0;
+} __attribute__ ((packed)) ACPI_MCFG;
+
+//ACPI MCFG configuration space base address allocation structure
+//baseaddress is the ECAM address of bus 0 of the segment, even when
+//startbus is not 0
+typedef struct {
+	u64 baseaddress;
+	u16 segment;
+	u8 startbus;
+	u8 endbus;
+	u32 rsvd0;
+} __attribute__ ((packed)) ACPI_MCFG_ALLOCATION;
+
 //FADT structure
 typedef struct{
   u32 signature;
@@ -54,6 +54,15 @@
 #define LAPIC_ICR_HIGH  (0x310)
 #define LAPIC_ID        (0x20)
 
+//LAPIC timer registers; the timer counts down at the bus or core
+//crystal clock, divided by LAPIC_TIMER_DIV
+#define LAPIC_LVT_TIMER     (0x320)
+#define LAPIC_TIMER_INIT    (0x380)
+#define LAPIC_TIMER_CUR     (0x390)
+#define LAPIC_TIMER_DIV     (0x3E0)
+#define LAPIC_LVT_MASKED    (1UL << 16)
+#define LAPIC_TIMER_DIV_1   (0xB)
+
 //LAPIC emulation defines
 #define LAPIC_OP_RSVD   (3)
 #define LAPIC_OP_READ   (2)
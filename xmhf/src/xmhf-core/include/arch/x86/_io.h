@@ -128,8 +128,6 @@
 
 #endif //__XMHF_VERIFICATION__
 
-void udelay(u32 usecs);
-
 #endif /* __ASSEMBLY__ */
 
 #endif /* __IO_H_ */
@@ -63,6 +63,10 @@
 #define MSR_AMD64_PATCH_CLEAR 0xc0010021 //AMD-specific microcode patch clear
 
 #define MSR_APIC_BASE 0x0000001B
+#define MSR_APIC_BASE_X2APIC (1UL << 10) //x2APIC mode enable
+
+//x2APIC registers, at MSR 0x800 + (xAPIC register offset >> 4)
+#define MSR_X2APIC_ICR 0x00000830
 
 // EFER bits 
 #define EFER_SCE 0  /* SYSCALL/SYSRET */
@@ -176,6 +180,7 @@
  */
 #define APICBASE_BSP                                  0x00000100
 #define MSR_IA32_APICBASE_ENABLE                      (1<<11)
+#define MSR_IA32_APICBASE_X2APIC                      (1<<10)
 
 #define MSR_IA32_SMM_MONITOR_CTL_VALID                1
 #define MSR_IA32_SMM_MONITOR_CTL_MSEG_BASE(x)         (x>>12)
@@ -63,8 +63,30 @@
 #define PCI_CONF_HDR_IDX_REVISION_ID						0x08
 #define PCI_CONF_HDR_IDX_CLASS_CODE							0x09
 #define	PCI_CONF_HDR_IDX_HEADER_TYPE						0x0E
+#define PCI_CONF_HDR_IDX_BAR0										0x10
 #define PCI_CONF_HDR_IDX_CAPABILITIES_POINTER		0x34
 
+//PCI "header type" register
+#define PCI_HEADER_TYPE_MASK							0x7f
+#define PCI_HEADER_TYPE_MULTIFUNCTION			0x80
+#define PCI_HEADER_TYPE_NORMAL						0x0			/* 6 BARs */
+#define PCI_HEADER_TYPE_BRIDGE						0x1			/* 2 BARs */
+#define PCI_HEADER_TYPE_CARDBUS						0x2
+
+//PCI base address registers (BARs)
+#define PCI_BAR_SPACE_IO									0x1			/* I/O space, else memory */
+#define PCI_BAR_MEM_TYPE_64								0x4			/* 64-bit, uses next BAR too */
+#define PCI_BAR_MEM_PREFETCH							0x8			/* prefetchable */
+#define PCI_BAR_IO_ADDR_MASK							(~0x3UL)
+#define PCI_BAR_MEM_ADDR_MASK							(~0xfUL)
+#define PCI_MAX_BARS											6
+
+//PCI base class codes
+#define PCI_CLASS_STORAGE									0x01
+#define PCI_CLASS_NETWORK									0x02
+#define PCI_CLASS_DISPLAY									0x03
+#define PCI_CLASS_BRIDGE									0x06
+
 //PCI "command" register
 #define PCI_COMMAND_IO          	0x1     /* Enable response in I/O space */
 #define PCI_COMMAND_MEMORY      	0x2     /* Enable response in Memory space */
@@ -83,6 +105,16 @@
 #define PCI_DEVICE_MAX			32
 #define	PCI_FUNCTION_MAX		8	
 
+//size of config space of a PCI function; type-1 accesses reach the
+//first 256 bytes, ECAM accesses all of it
+#define PCI_CONFIG_SPACE_SIZE		256
+#define PCIE_CONFIG_SPACE_SIZE	4096
+
+//maximum number of PCI functions and populated buses recorded in the
+//boot-time device inventory
+#define PCI_MAX_DEVICES					256
+#define PCI_MAX_INVENTORY_BUSES	32
+
 //AMD PCI configuration space constants
 #define	PCI_VENDOR_ID_AMD										0x1022	//Vendor ID for AMD
 
@@ -106,6 +138,32 @@
         (0x80000000 | ((index & 0xF00) << 16) | (bus << 16) \
         | (PCI_DEVICE_FN(device, function) << 8) | (index & 0xFC))
 
+//macro to encode a bus, device, function and index into an offset
+//into a PCI Express ECAM (memory mapped config space) window
+#define PCIE_ECAM_OFFSET(bus, device, function, index) \
+        (((bus) << 20) | (PCI_DEVICE_FN(device, function) << 12) | (index))
+
+//a base address register, decoded during boot-time enumeration
+typedef struct {
+  u64 base;     //address the BAR decodes
+  u64 size;     //0 if the BAR is not implemented
+  u32 flags;    //PCI_BAR_SPACE_IO, PCI_BAR_MEM_TYPE_64, PCI_BAR_MEM_PREFETCH
+} PCI_BAR;
+
+//a PCI function in the boot-time device inventory
+typedef struct {
+  u8 bus;
+  u8 device;
+  u8 function;
+  u8 header_type;
+  u16 vendor_id;
+  u16 device_id;
+  u32 class_code;   //base class:sub-class:programming i/f in bits 23:0
+  u8 revision_id;
+  PCI_BAR bars[PCI_MAX_BARS]; //a 64-bit BAR takes up two slots, the
+                              //second of which is left empty
+} PCI_DEVICE;
+
 
 
 #endif /* __ASSEMBLY__ */
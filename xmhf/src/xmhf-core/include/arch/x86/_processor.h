@@ -377,7 +377,10 @@ static inline void xsetbv(u32 xcr_reg, u64 value){
 	}
 
 
+	//ticket spinlocks, see _spinlock.h. spin_lock_spins is spin_lock
+	//that also returns how many pause rounds it waited
 	void spin_lock(volatile u32 *);
+	u32 spin_lock_spins(volatile u32 *);
 	void spin_unlock(volatile u32 *);
 
 #else //__XMHF_VERIFICATION__
@@ -391,6 +394,11 @@ static inline void xsetbv(u32 xcr_reg, u64 value){
 			(void)lock;
 	}
 
+	inline u32 spin_lock_spins(volatile u32 *lock){
+			(void)lock;
+			return 0;
+	}
+
 	inline void spin_unlock(volatile u32 *lock){
 			(void)lock;
 	}
@@ -0,0 +1,107 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+//spinlock.h - fair (ticket) spinlock primitives
+//
+//a lock is a single u32 so existing "u32 lock = 1" initializers keep
+//working. the low 16 bits hold (now serving + 1) and the high 16 bits the
+//next ticket to hand out; 1 is therefore "unlocked, nobody waiting" and 0
+//is "held". a CPU takes a ticket with lock xadd and waits until it is being
+//served, pausing for as many rounds as there are holders ahead of it, so
+//waiters are granted the lock in FIFO order and mostly read a shared line
+//instead of hammering it with locked operations. only the holder writes the
+//low half, so release is a plain 16-bit increment.
+//
+//this header has no dependencies on the rest of XMHF so that it can be
+//built into userspace tests as well.
+#ifndef __SPINLOCK_H
+#define __SPINLOCK_H
+
+#ifndef __ASSEMBLY__
+
+#define SPINLOCK_TICKET_INC	0x00010000U
+
+static inline void cpu_relax(void){
+	__asm__ __volatile__ ("pause" : : : "memory");
+}
+
+//acquire lock, returns the number of pause rounds spent waiting for it
+static inline uint32_t ticket_spin_lock(volatile uint32_t *lock){
+	uint32_t v = SPINLOCK_TICKET_INC;
+	uint32_t spins = 0;
+	uint16_t ticket, ahead;
+
+	__asm__ __volatile__ ("lock; xaddl %0, %1"
+		: "+r" (v), "+m" (*lock)
+		:
+		: "memory", "cc");
+	ticket = (uint16_t)(v >> 16);
+
+	for(;;){
+		ahead = (uint16_t)(ticket - (uint16_t)((v & 0xffff) - 1));
+		if(ahead == 0)
+			break;
+		//proportional backoff: one round per holder ahead of us
+		spins += ahead;
+		while(ahead--)
+			cpu_relax();
+		v = *lock;
+	}
+
+	__asm__ __volatile__ ("" : : : "memory");
+	return spins;
+}
+
+static inline void ticket_spin_unlock(volatile uint32_t *lock){
+	__asm__ __volatile__ ("incw %0"
+		: "+m" (*(volatile uint16_t *)lock)
+		:
+		: "memory", "cc");
+}
+
+#endif //__ASSEMBLY__
+
+#endif //__SPINLOCK_H
@@ -67,6 +67,23 @@
 #define INTR_TYPE_SW_INTERRUPT         	 (4UL << 8) // software interrupt
 #define INTR_TYPE_SW_EXCEPTION           (6UL << 8) // software exception (INTO, INT3)
 
+//NMI unblocking due to IRET, in VM-exit interruption information and
+//EPT violation exit qualification
+#define INTR_INFO_NMI_UNBLOCKED_BY_IRET  (1UL << 12)
+
+//guest interruptibility state
+#define GUEST_INTR_STATE_STI             (1UL << 0) // blocking by STI
+#define GUEST_INTR_STATE_MOV_SS          (1UL << 1) // blocking by MOV SS
+#define GUEST_INTR_STATE_NMI             (1UL << 3) // (virtual-)NMI blocking
+
+//VM-execution controls used for NMI delivery
+#define VMX_PINBASED_NMI_EXITING         (1UL << 3)
+#define VMX_PINBASED_VIRTUAL_NMIS        (1UL << 5)
+#define VMX_PROCBASED_NMI_WINDOW_EXITING (1UL << 22)
+
+//VM-entry control, saved as the guest's EFER.LMA on VM exits
+#define VMX_ENTRY_IA32E_MODE_GUEST       (1UL << 9)
+
 //
 #define VMX_EVENT_CANCEL  (0)
 #define VMX_EVENT_INJECT  (1)
@@ -146,6 +163,7 @@
 #define VMX_VMEXIT_CPUID	0x0a
 #define VMX_VMEXIT_INIT   0x3
 #define VMX_VMEXIT_EPT_VIOLATION  0x30
+#define VMX_VMEXIT_NMI_WINDOW	0x8
 #define VMX_VMEXIT_TASKSWITCH	0x9
 #define	VMX_VMEXIT_WBINVD		54
 #define VMX_VMEXIT_XSETBV		55
@@ -56,6 +56,7 @@
 #include "_cmdline.h"		//GRUB command line handling functions
 #include "_error.h"      	//error handling and assertions
 #include "_processor.h"  	//CPU
+#include "_spinlock.h"  	//spinlocks
 #include "_msr.h"        	//model specific registers
 #include "_paging.h"     	//MMU
 #include "_io.h"         	//legacy I/O
@@ -190,6 +191,7 @@ typedef struct _vcpu {
 	u32 cpu_vendor;					//Intel or AMD
 	u32 isbsp;							//1 if this core is BSP else 0
   u32 quiesced;				//1 if this core is currently quiesced
+  u32 quiesce_request;		//set by the quiescing core before it sends this core an NMI
 	
   //SVM specific fields
   u32 hsave_vaddr_ptr;    //VM_HSAVE area of the CPU
@@ -226,6 +228,13 @@ typedef struct _vcpu {
   u32 vmx_guest_currentstate;		//current operating mode of guest
   u32 vmx_guest_nextstate;		  //next operating mode of guest
 	u32 vmx_guest_unrestricted;		//this is 1 if the CPU VMX implementation supports unrestricted guest execution
+	u32 vmx_guest_vnmi;				//this is 1 if virtual NMIs and NMI-window exiting are in use
+	volatile u32 vmx_guest_nmi_pending;	//number of NMIs for the guest not yet injected
+
+  //LAPIC interception state during SMP guest boot
+  u32 vmx_lapic_reg;				//the LAPIC register being accessed during emulation
+  u32 vmx_lapic_op;				//the LAPIC operation being performed during emulation
+  u32 vmx_lapic_guest_eflags_tfifmask;	//guest TF and IF bit values during LAPIC emulation
   struct _vmx_vmcsfields vmcs;   //the VMCS fields
 
 } __attribute__((packed)) VCPU;
@@ -260,6 +269,12 @@ u32 xmhf_baseplatform_arch_flat_readu32(u32 addr);
 //read 64-bits from absolute physical address
 u64 xmhf_baseplatform_arch_flat_readu64(u32 addr);
 
+//write 8-bits to absolute physical address
+void xmhf_baseplatform_arch_flat_writeu8(u32 addr, u8 val);
+
+//write 16-bits to absolute physical address
+void xmhf_baseplatform_arch_flat_writeu16(u32 addr, u16 val);
+
 //write 32-bits to absolute physical address
 void xmhf_baseplatform_arch_flat_writeu32(u32 addr, u32 val);
 
@@ -276,6 +291,9 @@ void xmhf_baseplatform_arch_reboot(VCPU *vcpu);
 //returns true if CPU has support for XSAVE/XRSTOR
 bool xmhf_baseplatform_arch_x86_cpuhasxsavefeature(void);
 
+//returns true if CPU has support for FXSAVE/FXRSTOR
+bool xmhf_baseplatform_arch_x86_cpuhasfxsrfeature(void);
+
 #endif //__ASSEMBLY__
 
 //----------------------------------------------------------------------
@@ -317,6 +335,9 @@ extern u32 _ap_cr4_value;
 //return 1 if the calling CPU is the BSP
 u32 xmhf_baseplatform_arch_x86_isbsp(void);
 
+//return the VCPU of the calling CPU
+VCPU *xmhf_baseplatform_arch_x86_getcurrentvcpu(void);
+
 //wake up APs using the LAPIC by sending the INIT-SIPI-SIPI IPI sequence
 void xmhf_baseplatform_arch_x86_wakeupAPs(void);
 
@@ -326,6 +347,9 @@ void xmhf_baseplatform_arch_x86_reboot(void);
 //get the physical address of the root system description pointer (rsdp)
 u32 xmhf_baseplatform_arch_x86_acpi_getRSDP(ACPI_RSDP *rsdp);
 
+//find an ACPI table by its signature in the RSDT
+u32 xmhf_baseplatform_arch_x86_acpi_gettable(u32 signature);
+
 //PCI subsystem initialization
 void xmhf_baseplatform_arch_x86_pci_initialize(void);
 
@@ -339,9 +363,53 @@ void xmhf_baseplatform_arch_x86_pci_type1_write(u32 bus, u32 device, u32 functio
 void xmhf_baseplatform_arch_x86_pci_type1_read(u32 bus, u32 device, u32 function, u32 index, u32 len,
 			u32 *value);
 
-//microsecond delay
+//discover PCI Express ECAM from the ACPI MCFG table and build the
+//boot-time PCI device inventory (runtime only)
+void xmhf_baseplatform_arch_x86_pci_enumerate(void);
+
+//reads PCI config space for a given bus, device, function and index,
+//through ECAM where available and type-1 otherwise
+void xmhf_baseplatform_arch_x86_pci_read(u32 bus, u32 device, u32 function, u32 index, u32 len,
+			u32 *value);
+
+//writes PCI config space for a given bus, device, function and index,
+//through ECAM where available and type-1 otherwise
+void xmhf_baseplatform_arch_x86_pci_write(u32 bus, u32 device, u32 function, u32 index, u32 len,
+	u32 value);
+
+//physical address of the ECAM config space page of a given bus, device
+//and function, or 0 if it is not reachable through ECAM
+u32 xmhf_baseplatform_arch_x86_pci_ecam_getaddress(u32 bus, u32 device, u32 function);
+
+//the inventory entry of a given bus, device and function, or NULL if
+//no such function was found at boot
+PCI_DEVICE *xmhf_baseplatform_arch_x86_pci_getdevice(u32 bus, u32 device, u32 function);
+
+//the boot-time PCI device inventory, in bus/device/function order
+PCI_DEVICE *xmhf_baseplatform_arch_x86_pci_getdevices(u32 *num_devices);
+
+//microsecond delay on the shared 8254 PIT; BSP only, before the guest
+//starts
+void xmhf_baseplatform_arch_x86_pit_udelay(u32 usecs);
+
+//calibrate the TSC and LAPIC timer against CPUID or the PIT; runtime
+//BSP at boot, before the guest starts. the loaders calibrate on first
+//use of the functions below
+void xmhf_baseplatform_arch_x86_tsc_calibrate(void);
+
+//TSC frequency in kHz, as calibrated at boot; 0 if unknown
+u32 xmhf_baseplatform_arch_x86_tsc_khz(void);
+
+//true if the TSC ticks at a constant rate in all power states
+bool xmhf_baseplatform_arch_x86_tsc_invariant(void);
+
+//per-CPU microsecond delay; safe on any number of cores at once
 void xmhf_baseplatform_arch_x86_udelay(u32 usecs);
 
+//timeouts: the TSC value usecs from now, and whether it has passed
+u64 xmhf_baseplatform_arch_x86_deadline(u32 usecs);
+bool xmhf_baseplatform_arch_x86_deadline_passed(u64 deadline);
+
 
 static inline u64 VCPU_gdtr_base(VCPU *vcpu)
 {
@@ -510,6 +578,38 @@ extern u8 g_vmx_msr_area_guest_buffers[] __attribute__(( section(".palign_data")
 //VMX MSR bitmap buffers
 extern u8 g_vmx_msrbitmap_buffers[] __attribute__(( section(".palign_data") ));
 
+//VMX PCI config filter shadow pages
+extern u8 g_vmx_pcifilter_shadow_buffers[] __attribute__(( section(".palign_data") ));
+
+//PCI config filters
+#define PCI_FILTER_MAX			16		//maximum number of filtered functions
+
+#define PCI_ACCESS_READ			0x1
+#define PCI_ACCESS_WRITE		0x2
+
+#define PCI_FILTER_EMULATED		0xB0	//the filter has handled the access
+#define PCI_FILTER_PASSTHROUGH	0xB1	//do the access on the real function
+
+//a filter is called for every guest access to the config space of the
+//function it was registered for, with index the offset of the access
+//and len 1, 2 or 4. for reads it sets *value and returns
+//PCI_FILTER_EMULATED, or returns PCI_FILTER_PASSTHROUGH to read the
+//function. for writes *value is what the guest wrote. filters run on
+//the CPU that made the access, and may run on several CPUs at once
+typedef u32 (*PCI_FILTER_HANDLER)(VCPU *vcpu, u32 bus, u32 device, u32 function,
+	u32 index, u32 len, u32 access_type, u32 *value);
+
+//MMIO filters
+#define PCI_MMIO_FILTER_MAX		4		//maximum number of filtered MMIO ranges
+
+//an MMIO filter is called for every guest write to the range it was
+//registered for, with paddr the dword written and *value that dword as
+//the guest left it; bytes the guest did not write hold what the device
+//returned for them. it returns PCI_FILTER_EMULATED if it has dealt with
+//the write, or PCI_FILTER_PASSTHROUGH to write *value to the device.
+//guest reads of the range go to the device without a VM exit
+typedef u32 (*PCI_MMIO_FILTER_HANDLER)(VCPU *vcpu, u32 paddr, u32 *value);
+
 
 //initialize CPU state
 void xmhf_baseplatform_arch_x86vmx_cpuinitialize(void);
@@ -532,6 +632,37 @@ void xmhf_baseplatform_arch_x86vmx_dumpVMCS(VCPU *vcpu);
 //VMX specific platform reboot
 void xmhf_baseplatform_arch_x86vmx_reboot(VCPU *vcpu);
 
+//filter guest accesses to the config space of a PCI function; called
+//from app main on the BSP. returns 1 on success, 0 if filtering is not
+//supported or there are too many filters
+u32 xmhf_baseplatform_arch_x86vmx_pcifilter_register(VCPU *vcpu, u32 bus, u32 device,
+	u32 function, PCI_FILTER_HANDLER handler);
+
+//filter guest writes to a page aligned range of device MMIO below 4GB,
+//such as a BAR; called from app main on the BSP. the device must not
+//mind being read. returns 1 on success, 0 if filtering is not supported
+//or there are too many filters
+u32 xmhf_baseplatform_arch_x86vmx_pcifilter_registermmio(VCPU *vcpu, u32 paddr, u32 size,
+	PCI_MMIO_FILTER_HANDLER handler);
+
+//start intercepting accesses to filtered functions on all cores;
+//called on the BSP once all cores have been through app main
+void xmhf_baseplatform_arch_x86vmx_pcifilter_activate(VCPU *vcpu);
+
+//handle an EPT violation on a filtered function's ECAM page or a
+//filtered MMIO range; returns 1 if it was one, 0 otherwise
+u32 xmhf_baseplatform_arch_x86vmx_pcifilter_eptviolation(VCPU *vcpu, u32 gpa, u32 errorcode);
+
+//finish an access to a filtered function's ECAM page or MMIO range
+//after it has been single-stepped; returns 1 if the #DB was due to one, 0 otherwise
+u32 xmhf_baseplatform_arch_x86vmx_pcifilter_dbexception(VCPU *vcpu, struct regs *r);
+
+//handle a PCI config data port access; returns APP_IOINTERCEPT_SKIP if
+//it was to a filtered function and has been emulated, else
+//APP_IOINTERCEPT_CHAIN
+u32 xmhf_baseplatform_arch_x86vmx_pcifilter_portaccess(VCPU *vcpu, struct regs *r,
+	u32 portnum, u32 access_type, u32 access_size);
+
 //----------------------------------------------------------------------
 //x86svm SUBARCH. INTERFACES
 //----------------------------------------------------------------------
@@ -87,7 +87,7 @@ void xmhf_smpguest_arch_x86_eventhandler_dbexception(VCPU *vcpu,
 	struct regs *r);
 
 //handle LAPIC access #NPF (nested page fault) event
-void xmhf_smpguest_arch_x86_eventhandler_hwpgtblviolation(VCPU *vcpu, u32 gpa, u32 errorcode);
+void xmhf_smpguest_arch_x86_eventhandler_hwpgtblviolation(VCPU *vcpu, struct regs *r, u32 gpa, u32 errorcode);
 
 //quiescing handler for #NMI (non-maskable interrupt) exception event
 void xmhf_smpguest_arch_x86_eventhandler_nmiexception(VCPU *vcpu, struct regs *r);
@@ -101,7 +101,9 @@ void xmhf_smpguest_arch_x86vmx_initialize(VCPU *vcpu);
 void xmhf_smpguest_arch_x86vmx_eventhandler_dbexception(VCPU *vcpu, 
 	struct regs *r);
 void xmhf_smpguest_arch_x86vmx_eventhandler_nmiexception(VCPU *vcpu, struct regs *r);
-u32 xmhf_smpguest_arch_x86vmx_eventhandler_hwpgtblviolation(VCPU *vcpu, u32 paddr, u32 errorcode);
+void xmhf_smpguest_arch_x86vmx_injectnmi(VCPU *vcpu);
+u32 xmhf_smpguest_arch_x86vmx_eventhandler_hwpgtblviolation(VCPU *vcpu, struct regs *r, u32 paddr, u32 errorcode);
+u32 xmhf_smpguest_arch_x86vmx_eventhandler_x2apicicrwrite(VCPU *vcpu, struct regs *r);
 void xmhf_smpguest_arch_x86vmx_quiesce(VCPU *vcpu);
 void xmhf_smpguest_arch_x86vmx_endquiesce(VCPU *vcpu);
 
@@ -137,6 +139,9 @@ extern u32 g_vmx_quiesce __attribute__(( section(".data") ));
 
 //SMP lock to access the above variable
 extern u32 g_vmx_lock_quiesce __attribute__(( section(".data") )); 
+
+//statistics for the above lock
+extern SPINLOCK_STATS g_vmx_lock_quiesce_stats __attribute__(( section(".data") ));
     
 //resume signal, becomes 1 to signal resume after quiescing
 extern u32 g_vmx_quiesce_resume_signal __attribute__(( section(".data") ));  
@@ -153,7 +158,7 @@ void xmhf_smpguest_arch_x86svm_initialize(VCPU *vcpu);
 void xmhf_smpguest_arch_x86svm_eventhandler_dbexception(VCPU *vcpu, 
 	struct regs *r);
 void xmhf_smpguest_arch_x86svm_eventhandler_nmiexception(VCPU *vcpu, struct regs *r);
-u32 xmhf_smpguest_arch_x86svm_eventhandler_hwpgtblviolation(VCPU *vcpu, u32 paddr, u32 errorcode);
+u32 xmhf_smpguest_arch_x86svm_eventhandler_hwpgtblviolation(VCPU *vcpu, struct regs *r, u32 paddr, u32 errorcode);
 void xmhf_smpguest_arch_x86svm_quiesce(VCPU *vcpu);
 void xmhf_smpguest_arch_x86svm_endquiesce(VCPU *vcpu);
 
@@ -185,6 +190,9 @@ extern u32 g_svm_quiesce __attribute__(( section(".data") ));
 
 //SMP lock to access the above variable
 extern u32 g_svm_lock_quiesce __attribute__(( section(".data") )); 
+
+//statistics for the above lock
+extern SPINLOCK_STATS g_svm_lock_quiesce_stats __attribute__(( section(".data") ));
     
 //resume signal, becomes 1 to signal resume after quiescing
 extern u32 g_svm_quiesce_resume_signal __attribute__(( section(".data") ));  
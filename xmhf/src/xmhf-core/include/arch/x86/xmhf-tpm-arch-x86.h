@@ -136,12 +136,49 @@ typedef union {
     };
 } tpm_reg_sts_t;
 
-/* TPM_DATA_FIFO_x */
+/* TPM_DATA_FIFO_x; TIS 1.3 FIFOs take up to 4-byte accesses */
 #define TPM_REG_DATA_FIFO        0x24
 typedef union {
         uint8_t _raw[1];                      /* 1-byte reg */
 } tpm_reg_data_fifo_t;
 
+/* TPM_INTF_CAPABILITY_x */
+#define TPM_REG_INTF_CAPABILITY  0x14
+#define TPM_INTF_CAP_TRANSFER_SIZE(c)   (((c) >> 9) & 3)  /* 0=single bytes */
+#define TPM_INTF_CAP_VERSION(c)         (((c) >> 28) & 7)
+#define TPM_INTF_VERSION_TIS13   2   /* TIS 1.3 */
+#define TPM_INTF_VERSION_PTP     3   /* TIS 1.3 for TPM 2.0 */
+
+/* TPM_INTERFACE_ID_x, PTP only */
+#define TPM_REG_INTERFACE_ID     0x30
+#define TPM_INTERFACE_ID_TYPE(i)        ((i) & 0xf)
+#define TPM_INTERFACE_TYPE_CRB   0x1
+
+/*
+ * PTP command response buffer (CRB) interface registers, which take
+ * 4-byte accesses only
+ */
+#define TPM_CRB_REG_LOC_STATE    0x00
+#define TPM_CRB_LOC_STATE_ASSIGNED      (1 << 1)
+#define TPM_CRB_LOC_STATE_ACTIVE(s)     (((s) >> 2) & 7)
+#define TPM_CRB_LOC_STATE_VALID         (1 << 7)
+#define TPM_CRB_REG_LOC_CTRL     0x08
+#define TPM_CRB_LOC_CTRL_REQUEST        (1 << 0)
+#define TPM_CRB_LOC_CTRL_RELINQUISH     (1 << 1)
+#define TPM_CRB_REG_CTRL_REQ     0x40
+#define TPM_CRB_CTRL_REQ_CMD_READY      (1 << 0)
+#define TPM_CRB_CTRL_REQ_GO_IDLE        (1 << 1)
+#define TPM_CRB_REG_CTRL_STS     0x44
+#define TPM_CRB_CTRL_STS_ERROR          (1 << 0)
+#define TPM_CRB_CTRL_STS_IDLE           (1 << 1)
+#define TPM_CRB_REG_CTRL_START   0x4c
+#define TPM_CRB_REG_CMD_SIZE     0x58
+#define TPM_CRB_REG_CMD_LADDR    0x5c
+#define TPM_CRB_REG_CMD_HADDR    0x60
+#define TPM_CRB_REG_RSP_SIZE     0x64
+#define TPM_CRB_REG_RSP_ADDR     0x68
+#define TPM_CRB_DATA_BUFFER      0x80
+
 /*
  * assumes that all reg types follow above format:
  *   - packed
@@ -182,6 +219,22 @@ typedef union {
 	    return (u8)ret;        
 	}
 
+	static inline void writel(u32 addr, u32 val) {
+	    __asm__ __volatile__("movl %%eax, %%fs:(%%ebx)\r\n"
+				 :
+				 : "b"(addr), "a"(val)
+				 );
+	}
+
+	static inline u32 readl(u32 addr) {
+	    u32 ret;
+	    __asm__ __volatile("movl %%fs:(%%ebx), %%eax\r\n"
+			       : "=a"(ret)
+			       : "b"(addr)
+			       );
+	    return ret;
+	}
+
 #else //__XMHF_VERIFICATION__
 
 	static inline void writeb(u32 addr, u8 val) {
@@ -192,10 +245,17 @@ typedef union {
 	 return 0;
 	}
 
+	static inline void writel(u32 addr, u32 val) {
+
+	}
+
+	static inline u32 readl(u32 addr) {
+	 return 0;
+	}
+
 #endif //__XMHF_VERIFICATION__
 
-//TPM timeouts
-#define TIMEOUT_UNIT    (0x100000 / 330) /* ~1ms, 1 tpm r/w need > 330ns */
+//TPM timeouts, in ms
 #define TIMEOUT_A       750  /* 750ms */
 #define TIMEOUT_B       2000 /* 2s */
 #define TIMEOUT_C       750  /* 750ms */
@@ -209,16 +269,21 @@ typedef struct __attribute__ ((packed)) {
 } tpm_timeout_t;
 
 
+//the same in us, for xmhf_baseplatform_arch_x86_deadline
 #define TPM_ACTIVE_LOCALITY_TIME_OUT    \
-          (TIMEOUT_UNIT * g_timeout.timeout_a)  /* according to spec */
+          (1000 * g_timeout.timeout_a)  /* according to spec */
 #define TPM_CMD_READY_TIME_OUT          \
-          (TIMEOUT_UNIT * g_timeout.timeout_b)  /* according to spec */
+          (1000 * g_timeout.timeout_b)  /* according to spec */
 #define TPM_CMD_WRITE_TIME_OUT          \
-          (TIMEOUT_UNIT * g_timeout.timeout_d)  /* let it long enough */
+          (1000 * g_timeout.timeout_d)  /* let it long enough */
 #define TPM_DATA_AVAIL_TIME_OUT         \
-          (TIMEOUT_UNIT * g_timeout.timeout_c)  /* let it long enough */
+          (1000 * g_timeout.timeout_c)  /* let it long enough */
 #define TPM_RSP_READ_TIME_OUT           \
-          (TIMEOUT_UNIT * g_timeout.timeout_d)  /* let it long enough */
+          (1000 * g_timeout.timeout_d)  /* let it long enough */
+
+//polls of a TPM register that isn't ready yet back off exponentially
+//up to this many us, rather than spin
+#define TPM_POLL_MAX_DELAY              128
 
 
 //----------------------------------------------------------------------
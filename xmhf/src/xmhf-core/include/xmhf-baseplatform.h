@@ -90,6 +90,26 @@ typedef struct _pcpu {
 
 #define SIZE_STRUCT_PCPU  (sizeof(struct _pcpu))
 
+//---spinlock statistics
+//kept for a lock by taking it with spin_lock_stat/spin_unlock_stat instead
+//of spin_lock/spin_unlock. the counters are only written by the lock
+//holder; seq is odd while they are being updated so that
+//xmhf_baseplatform_spinlock_stats_read can take a consistent snapshot
+//without acquiring the lock itself
+typedef struct _spinlock_stats {
+  const char *name;
+  volatile u32 seq;
+  u64 acquisitions;       //times the lock was taken
+  u64 contended;          //...of which had to wait for another holder
+  u64 spins;              //pause rounds spent waiting
+  u64 hold_cycles;        //total TSC cycles the lock was held
+  u64 hold_max;           //longest single hold, in TSC cycles
+  u64 hold_start;
+  struct _spinlock_stats *next;
+} SPINLOCK_STATS;
+
+#define SPINLOCK_STATS_INITIALIZER(lockname)  { (lockname), 0, 0, 0, 0, 0, 0, 0, NULL }
+
 //----------------------------------------------------------------------
 //exported DATA 
 //----------------------------------------------------------------------
@@ -146,6 +166,51 @@ void xmhf_baseplatform_initialize(void);
 //reboot platform
 void xmhf_baseplatform_reboot(VCPU *vcpu);
 
+//add a lock's statistics to the list reported by
+//xmhf_baseplatform_spinlock_stats_read; call once per SPINLOCK_STATS
+void xmhf_baseplatform_spinlock_stats_register(SPINLOCK_STATS *stats);
+
+//copy a consistent snapshot of up to max registered lock statistics into
+//out (name and counters only), returns the number of registered locks
+u32 xmhf_baseplatform_spinlock_stats_read(SPINLOCK_STATS *out, u32 max);
+
+#ifndef __XMHF_VERIFICATION__
+
+	static inline void spin_lock_stat(volatile u32 *lock, SPINLOCK_STATS *stats){
+		u32 spins = spin_lock_spins(lock);
+
+		stats->seq++;
+		__asm__ __volatile__ ("" : : : "memory");
+		stats->acquisitions++;
+		if(spins){
+			stats->contended++;
+			stats->spins += spins;
+		}
+		__asm__ __volatile__ ("" : : : "memory");
+		stats->seq++;
+		stats->hold_start = rdtsc64();
+	}
+
+	static inline void spin_unlock_stat(volatile u32 *lock, SPINLOCK_STATS *stats){
+		u64 held = rdtsc64() - stats->hold_start;
+
+		stats->seq++;
+		__asm__ __volatile__ ("" : : : "memory");
+		stats->hold_cycles += held;
+		if(held > stats->hold_max)
+			stats->hold_max = held;
+		__asm__ __volatile__ ("" : : : "memory");
+		stats->seq++;
+		spin_unlock(lock);
+	}
+
+#else //__XMHF_VERIFICATION__
+
+	#define spin_lock_stat(lock, stats)	spin_lock(lock)
+	#define spin_unlock_stat(lock, stats)	spin_unlock(lock)
+
+#endif //__XMHF_VERIFICATION__
+
 #ifndef __XMHF_VERIFICATION__
 
 	//hypervisor runtime virtual address to secure loader address
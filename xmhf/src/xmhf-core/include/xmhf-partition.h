@@ -60,9 +60,41 @@
 #define PART_LEGACYIO_PORTSIZE_WORD		(2)		//16-bit port
 #define PART_LEGACYIO_PORTSIZE_DWORD	(4)		//32-bit port
 
+//partition legacy I/O shadow port groups
+#define PART_LEGACYIO_SHADOW_MAXGROUPS	(2)		//groups that can be set up
+#define PART_LEGACYIO_SHADOW_MAXPORTS	(8)		//shadow ports per group
+#define PART_LEGACYIO_SHADOW_DEPTH		(2)		//writes remembered per port
+
 
 #ifndef __ASSEMBLY__
 
+//a group of 8-bit device registers whose writes are latched ("shadow"
+//ports), and the port that makes the device act on them (the trigger,
+//e.g., an ATA command port). guest writes to the shadow ports are
+//latched and passed on to the device by the core, without quiescing
+//the other cores or calling the hypapp; so are byte reads of any port
+//of the group. a guest write to the trigger port is handed to the
+//group's handler, with the other cores quiesced, together with the
+//latched values.
+//values[i] holds the last PART_LEGACYIO_SHADOW_DEPTH bytes written to
+//ports[i], the most recent one last. the handler may change them, and
+//returns APP_IOINTERCEPT_CHAIN to have the core write them out (oldest
+//first, for all ports, then the most recent ones) followed by the
+//trigger write, or APP_IOINTERCEPT_SKIP to drop the trigger write.
+//the values are always written out before the trigger, so the device
+//acts on what the handler saw even if another core was in the middle
+//of a shadow port write when it was quiesced
+typedef struct _part_legacyio_shadow {
+	u32 trigger;
+	u32 numports;
+	u32 ports[PART_LEGACYIO_SHADOW_MAXPORTS];
+	u8 values[PART_LEGACYIO_SHADOW_MAXPORTS][PART_LEGACYIO_SHADOW_DEPTH];
+	u32 (*handler)(VCPU *vcpu, struct regs *r,
+		struct _part_legacyio_shadow *shadow, u8 value);
+	u32 latched;		//shadow port writes latched so far
+	u32 triggered;		//trigger port writes handed to the handler so far
+} PART_LEGACYIO_SHADOW;
+
 //----------------------------------------------------------------------
 //exported DATA 
 //----------------------------------------------------------------------
@@ -84,6 +116,30 @@ void xmhf_partition_start(VCPU *vcpu);
 //set legacy I/O protection for the partition
 void xmhf_partition_legacyIO_setprot(VCPU *vcpu, u32 port, u32 size, u32 prottype);
 
+//set up a shadow port group (see PART_LEGACYIO_SHADOW) and intercept
+//its ports. the hypapp owns shadow, which must stay around. called
+//from app main on the BSP. returns 1 on success, 0 if there are too
+//many groups or ports
+u32 xmhf_partition_legacyIO_setshadow(VCPU *vcpu, PART_LEGACYIO_SHADOW *shadow);
+
+//the shadow port group an intercepted byte access to portnum belongs
+//to, or NULL if there is none
+PART_LEGACYIO_SHADOW *xmhf_partition_legacyIO_getshadow(u32 portnum,
+	u32 access_type, u32 access_size);
+
+//handle a guest access to a port of a group other than a trigger
+//write: a write to a shadow port is latched and passed on to the
+//device, and APP_IOINTERCEPT_SKIP returned; for a read,
+//APP_IOINTERCEPT_CHAIN is returned for the caller to do it
+u32 xmhf_partition_legacyIO_shadowaccess(PART_LEGACYIO_SHADOW *shadow,
+	u32 portnum, u32 access_type, u8 value);
+
+//hand a guest write to the trigger port of a group to its handler;
+//called with the other cores quiesced. returns APP_IOINTERCEPT_CHAIN
+//if the trigger write is to be done, else APP_IOINTERCEPT_SKIP
+u32 xmhf_partition_legacyIO_shadowtrigger(VCPU *vcpu, struct regs *r,
+	PART_LEGACYIO_SHADOW *shadow, u8 value);
+
 
 //----------------------------------------------------------------------
 //ARCH. BACKENDS
@@ -100,6 +156,15 @@ void xmhf_partition_arch_start(VCPU *vcpu);
 //set legacy I/O protection for the partition
 void xmhf_partition_arch_legacyIO_setprot(VCPU *vcpu, u32 port, u32 size, u32 prottype);
 
+//legacy I/O shadow port groups
+u32 xmhf_partition_arch_legacyIO_setshadow(VCPU *vcpu, PART_LEGACYIO_SHADOW *shadow);
+PART_LEGACYIO_SHADOW *xmhf_partition_arch_legacyIO_getshadow(u32 portnum,
+	u32 access_type, u32 access_size);
+u32 xmhf_partition_arch_legacyIO_shadowaccess(PART_LEGACYIO_SHADOW *shadow,
+	u32 portnum, u32 access_type, u8 value);
+u32 xmhf_partition_arch_legacyIO_shadowtrigger(VCPU *vcpu, struct regs *r,
+	PART_LEGACYIO_SHADOW *shadow, u8 value);
+
 
 //----------------------------------------------------------------------
 //x86 ARCH. INTERFACES
@@ -123,6 +188,9 @@ u32 __vmx_start_hvm(void);
 //set legacy I/O protection for the partition
 void xmhf_partition_arch_x86vmx_legacyIO_setprot(VCPU *vcpu, u32 port, u32 size, u32 prottype);
 
+//set whether guest writes to the given MSR cause an intercept
+void xmhf_partition_arch_x86vmx_msrwrite_setprot(VCPU *vcpu, u32 msr, u32 intercept);
+
 
 //----------------------------------------------------------------------
 //x86svm SUBARCH. INTERFACES
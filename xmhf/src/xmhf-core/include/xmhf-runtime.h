@@ -79,6 +79,9 @@ extern u32 g_appmain_success_counter __attribute__(( section(".data") ));
 //SMP lock for the above variable
 extern u32 g_lock_appmain_success_counter __attribute__(( section(".data") ));
 
+//statistics for the debug output line lock (xmhfcbackend)
+extern SPINLOCK_STATS g_emhfc_putchar_linelock_stats;
+
 //----------------------------------------------------------------------
 //exported FUNCTIONS 
 //----------------------------------------------------------------------
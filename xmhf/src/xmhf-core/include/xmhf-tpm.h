@@ -58,6 +58,25 @@
 #ifndef __ASSEMBLY__
 
 
+//---TPM latency statistics, in TSC cycles
+//seq is odd while they are being updated, as for SPINLOCK_STATS, so
+//that xmhf_tpm_stats_read can take a consistent snapshot without
+//waiting for writers
+typedef struct {
+  volatile u32 seq;
+  u64 acquisitions;       //xmhf_tpm_locality_acquire calls
+  u64 opens;              //...of which had to open the locality
+  u64 open_cycles;        //total time spent opening localities
+  u64 open_max;
+  u64 holds;              //batches, from first acquire to last release
+  u64 hold_cycles;
+  u64 hold_max;
+  u64 cmds;               //commands sent to the TPM
+  u64 cmd_cycles;
+  u64 cmd_max;
+  u64 relinquishes;       //times an idle locality was closed
+} XMHF_TPM_STATS;
+
 //----------------------------------------------------------------------
 //exported DATA 
 //----------------------------------------------------------------------
@@ -79,6 +98,26 @@ void xmhf_tpm_deactivate_all_localities(void);
 //prepare TPM for use
 bool xmhf_tpm_prepare_tpm(void);
 
+//hold locality 1 or 2 for a batch of TPM commands, opening it if it
+//isn't open already. holds nest, but all holders must use the same
+//locality; asking for another one while it is held fails. returns 0
+//on success. callers still serialize the commands themselves.
+int xmhf_tpm_locality_acquire(int locality);
+
+//end a hold taken with xmhf_tpm_locality_acquire. the locality stays
+//open for the next batch until xmhf_tpm_locality_relinquish
+void xmhf_tpm_locality_release(int locality);
+
+//close the open locality if no one holds it, e.g. before handing the
+//TPM to the guest
+void xmhf_tpm_locality_relinquish(void);
+
+//record the latency of one TPM command
+void xmhf_tpm_stats_cmd(u64 cycles);
+
+//copy a consistent snapshot of the TPM statistics into out
+void xmhf_tpm_stats_read(XMHF_TPM_STATS *out);
+
 
 
 #endif	//__ASSEMBLY__
@@ -93,6 +93,9 @@ u8 * xmhf_xcphandler_arch_get_idt_start(void);
 //EMHF exception handler hub
 void xmhf_xcphandler_arch_hub(u32 vector, struct regs *r);
 
+//NMI handler, entered from the NMI stub
+void xmhf_xcphandler_arch_nmi(void);
+
 
 
 
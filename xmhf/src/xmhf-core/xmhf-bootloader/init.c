@@ -121,44 +121,11 @@ void dealwithMP(void){
 }
 
 
-//---microsecond delay----------------------------------------------------------
-void udelay(u32 usecs){
-    u8 val;
-    u32 latchregval;  
-
-    //enable 8254 ch-2 counter
-    val = inb(0x61);
-    val &= 0x0d; //turn PC speaker off
-    val |= 0x01; //turn on ch-2
-    outb(val, 0x61);
-  
-    //program ch-2 as one-shot
-    outb(0xB0, 0x43);
-  
-    //compute appropriate latch register value depending on usecs
-    latchregval = (1193182 * usecs) / 1000000;
-
-    //write latch register to ch-2
-    val = (u8)latchregval;
-    outb(val, 0x42);
-    val = (u8)((u32)latchregval >> (u32)8);
-    outb(val , 0x42);
-  
-    //wait for countdown
-    while(!(inb(0x61) & 0x20));
-  
-    //disable ch-2 counter
-    val = inb(0x61);
-    val &= 0x0c;
-    outb(val, 0x61);
-}
-
-
 //---INIT IPI routine-----------------------------------------------------------
 void send_init_ipi_to_all_APs(void) {
     u32 eax, edx;
     volatile u32 *icr;
-    u32 timeout = 0x01000000;
+    u64 deadline;
   
     //read LAPIC base address from MSR
     rdmsr(MSR_APIC_BASE, &eax, &edx);
@@ -170,15 +137,12 @@ void send_init_ipi_to_all_APs(void) {
     //send INIT
     printf("\nSending INIT IPI to all APs...");
     *icr = 0x000c4500UL;
-    udelay(10000);
+    xmhf_baseplatform_arch_x86_udelay(10000);
     //wait for command completion
-    {
-        u32 val;
-        do{
-            val = *icr;
-        }while(--timeout > 0 && (val & 0x1000) );
-    }
-    if(timeout == 0) {
+    deadline = xmhf_baseplatform_arch_x86_deadline(100000);
+    while( (*icr & 0x1000) && !xmhf_baseplatform_arch_x86_deadline_passed(deadline) )
+        cpu_relax();
+    if(*icr & 0x1000) {
         printf("\nERROR: send_init_ipi_to_all_APs() TIMEOUT!\n");
     }
     printf("\nDone.\n");
@@ -763,7 +727,7 @@ void wakeupAPs(void){
     //send INIT
     printf("\nSending INIT IPI to all APs...");
     *icr = 0x000c4500UL;
-    udelay(10000);
+    xmhf_baseplatform_arch_x86_udelay(10000);
     //wait for command completion
     {
         u32 val;
@@ -779,7 +743,7 @@ void wakeupAPs(void){
         for(i=0; i < 2; i++){
             printf("\nSending SIPI-%u...", i);
             *icr = 0x000c4610UL;
-            udelay(200);
+            xmhf_baseplatform_arch_x86_udelay(200);
             //wait for command completion
             {
                 u32 val;
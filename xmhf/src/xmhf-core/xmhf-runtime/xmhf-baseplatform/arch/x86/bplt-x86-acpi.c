@@ -117,4 +117,32 @@ u32 xmhf_baseplatform_arch_x86_acpi_getRSDP(ACPI_RSDP *rsdp){
   //no RSDP, system is not ACPI compliant!
   return 0;  
 }
+
+//------------------------------------------------------------------------------
+//find an ACPI table by its signature in the RSDT
+//return 0 if the table is not found else the absolute physical memory
+//address of the table
+u32 xmhf_baseplatform_arch_x86_acpi_gettable(u32 signature){
+  ACPI_RSDP rsdp;
+  ACPI_RSDT rsdt;
+  u32 num_rsdtentries;
+  u32 i, tableaddr;
+
+  if(!xmhf_baseplatform_arch_x86_acpi_getRSDP(&rsdp))
+    return 0;
+
+  xmhf_baseplatform_arch_flat_copy((u8 *)&rsdt, (u8 *)rsdp.rsdtaddress, sizeof(ACPI_RSDT));
+  if(rsdt.length < sizeof(ACPI_RSDT))
+    return 0;
+
+  //the RSDT header is followed by a list of 32-bit table addresses
+  num_rsdtentries = (rsdt.length - sizeof(ACPI_RSDT)) / sizeof(u32);
+  for(i=0; i < num_rsdtentries; i++){
+    tableaddr = xmhf_baseplatform_arch_flat_readu32(rsdp.rsdtaddress + sizeof(ACPI_RSDT) + (i * sizeof(u32)));
+    if(tableaddr && xmhf_baseplatform_arch_flat_readu32(tableaddr) == signature)
+      return tableaddr;
+  }
+
+  return 0;
+}
 //------------------------------------------------------------------------------
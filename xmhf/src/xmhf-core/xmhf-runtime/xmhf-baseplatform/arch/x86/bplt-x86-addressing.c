@@ -89,6 +89,22 @@ u64 xmhf_baseplatform_arch_flat_readu64(u32 addr){
     return  ((u64)highpart << 32) | (u64)lowpart;        
 }
 
+//write 8-bits to absolute physical address
+void xmhf_baseplatform_arch_flat_writeu8(u32 addr, u8 val) {
+    __asm__ __volatile__("movb %%al, %%fs:(%%ebx)\r\n"
+                         :
+                         : "b"(addr), "a"(val)
+                         );
+}
+
+//write 16-bits to absolute physical address
+void xmhf_baseplatform_arch_flat_writeu16(u32 addr, u16 val) {
+    __asm__ __volatile__("movw %%ax, %%fs:(%%ebx)\r\n"
+                         :
+                         : "b"(addr), "a"(val)
+                         );
+}
+
 //write 32-bits to absolute physical address
 void xmhf_baseplatform_arch_flat_writeu32(u32 addr, u32 val) {
     __asm__ __volatile__("movl %%eax, %%fs:(%%ebx)\r\n"
@@ -68,3 +68,18 @@ bool xmhf_baseplatform_arch_x86_cpuhasxsavefeature(void){
 	
 }
 
+//returns true if CPU has support for FXSAVE/FXRSTOR
+bool xmhf_baseplatform_arch_x86_cpuhasfxsrfeature(void){
+	u32 eax, ebx, ecx, edx;
+	
+	//bit 24 of EDX is 1 in CPUID function 0x00000001 if
+	//FXSAVE/FXRSTOR feature is available
+	
+	cpuid(0x00000001, &eax, &ebx, &ecx, &edx);
+	
+	if((edx & (1UL << 24)))
+		return true;
+	else
+		return false;
+	
+}
@@ -147,37 +147,13 @@
   specified is greater than the secondary bus number and less than or equal 
 	to the subordinate bus number	
 	
+	PCI Express systems also map config space into memory (ECAM), see
+	pcie.c, which the runtime prefers over type-1 accesses where the
+	firmware describes it.
+
 	geronimo...
 */
 
-//==============================================================================
-//static (local) functions
-//==============================================================================
-
-/*//enumerates the PCI bus on the system
-static void _pci_enumeratebus(void){
-	u32 b, d, f;
-
-	//bus numbers range from 0-255, device from 0-31 and function from 0-7	
-	for(b=0; b < PCI_BUS_MAX; b++){
-		for(d=0; d < PCI_DEVICE_MAX; d++){
-			for(f=0; f < PCI_FUNCTION_MAX; f++){		
-				u32 vendor_id, device_id;
-				//read device and vendor ids, if no device then both will be 0xFFFF
-				xmhf_baseplatform_arch_x86_pci_type1_read(b, d, f, PCI_CONF_HDR_IDX_VENDOR_ID, sizeof(u16), &vendor_id);
-				xmhf_baseplatform_arch_x86_pci_type1_read(b, d, f, PCI_CONF_HDR_IDX_DEVICE_ID, sizeof(u16), &device_id);
-				if(vendor_id == 0xFFFF && device_id == 0xFFFF)
-					break;
-				
-				printf("\n	%02x:%02x.%1x -> vendor_id=%04x, device_id=%04x", b, d, f, vendor_id, device_id);						
-			}
-		}
-	}
-
-  	
-}*/
-
-
 //does a PCI type-1 read of PCI config space for a given bus, device, 
 //function and index
 //len = 1(byte), 2(word) and 4(dword)
@@ -265,11 +241,9 @@ void xmhf_baseplatform_arch_x86_pci_initialize(void){
   //restore previous value at PCI_CONFIG_ADDR_PORT
   outl(tmp, PCI_CONFIG_ADDR_PORT);
 
-	//say we are good to go and enumerate the PCI bus 
+	//say we are good to go; the runtime enumerates the PCI bus later
+	//(see xmhf_baseplatform_arch_x86_pci_enumerate in pcie.c)
 	printf("\n%s: PCI type-1 access supported.", __FUNCTION__);
-	printf("\n%s: PCI bus enumeration follows:", __FUNCTION__);
-	//_pci_enumeratebus();
-	printf("\n%s: Done with PCI bus enumeration.", __FUNCTION__);
 
 	return;
 }
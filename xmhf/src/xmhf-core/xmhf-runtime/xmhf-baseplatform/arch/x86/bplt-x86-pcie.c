@@ -0,0 +1,392 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+//	pcie.c - PCI Express enhanced configuration access mechanism (ECAM)
+//	and boot-time PCI device inventory
+
+#include <xmhf.h> 
+
+/*
+	ECAM (a.k.a. MMCONFIG) maps the 4KB config space of every function
+	of a bus range into physical memory, 1MB per bus, at a base address
+	given by the ACPI MCFG table:
+
+	address = base + (bus << 20) + (device << 15) + (function << 12) + index
+
+	unlike type-1 accesses (see pci.c), an ECAM access is a single
+	memory access that needs no shared address port, so it does not
+	race the guest's own use of PCI_CONFIG_ADDR_PORT, and it reaches the
+	whole 4KB of PCIe config space. we use ECAM for the buses MCFG
+	covers in segment 0 and fall back to type-1 accesses elsewhere.
+
+	the runtime addresses physical memory below 4GB through the flat
+	selector, so ECAM windows above 4GB are left alone.
+
+	at boot we walk every bus once and record each function's ids, class
+	and BARs. hypapps can then look a function up by bus/device/function
+	in constant time instead of touching config space.
+*/
+
+//ECAM address of each bus (the address of device 0 function 0 on it),
+//0 if the bus is not reachable through ECAM
+static u32 g_pci_ecam_busbase[PCI_BUS_MAX];
+
+//the device inventory
+static PCI_DEVICE g_pci_devices[PCI_MAX_DEVICES];
+static u32 g_pci_num_devices=0;
+
+//inventory lookup: g_pci_busindex[bus] is 0 if no functions were found
+//on bus, else 1 + the row of g_pci_devfnindex for the bus, where
+//g_pci_devfnindex[row][devfn] is 0 if there is no such function, else
+//1 + its index in g_pci_devices
+static u16 g_pci_busindex[PCI_BUS_MAX];
+static u16 g_pci_devfnindex[PCI_MAX_INVENTORY_BUSES][PCI_DEVICE_MAX * PCI_FUNCTION_MAX];
+static u32 g_pci_num_inventorybuses=0;
+
+
+//==============================================================================
+//static (local) functions
+//==============================================================================
+
+//does an ECAM read of a byte, word or dword of config space
+static u32 _pci_ecam_read(u32 addr, u32 len){
+	//config space reads have no side effects, so read the aligned
+	//dword and pick out the bytes asked for
+	u32 value = xmhf_baseplatform_arch_flat_readu32(addr & ~0x3UL);
+
+	value >>= (addr & 0x3) * 8;
+	switch (len) {
+		case 1:	return value & 0xFF;
+		case 2:	return value & 0xFFFF;
+		default: return value;
+	}
+}
+
+//does an ECAM write of a byte, word or dword of config space
+static void _pci_ecam_write(u32 addr, u32 len, u32 value){
+	//writes must be of the exact size, a read-modify-write of the dword
+	//could clear write-1-to-clear status bits next to the target
+	switch (len) {
+		case 1:	xmhf_baseplatform_arch_flat_writeu8(addr, (u8)value); break;
+		case 2:	xmhf_baseplatform_arch_flat_writeu16(addr, (u16)value); break;
+		case 4:	xmhf_baseplatform_arch_flat_writeu32(addr, value); break;
+	}
+}
+
+//find the ECAM windows of segment 0 in the ACPI MCFG table
+static void _pci_ecam_initialize(void){
+	ACPI_MCFG mcfg;
+	ACPI_MCFG_ALLOCATION alloc;
+	u32 mcfgaddr, num_allocs, i, bus;
+	u32 type1_id, ecam_id;
+
+	memset(g_pci_ecam_busbase, 0, sizeof(g_pci_ecam_busbase));
+
+	mcfgaddr = xmhf_baseplatform_arch_x86_acpi_gettable(ACPI_MCFG_SIGNATURE);
+	if(!mcfgaddr){
+		printf("\n%s: no ACPI MCFG table, using PCI type-1 access only.", __FUNCTION__);
+		return;
+	}
+
+	xmhf_baseplatform_arch_flat_copy((u8 *)&mcfg, (u8 *)mcfgaddr, sizeof(ACPI_MCFG));
+	if(mcfg.length < sizeof(ACPI_MCFG)){
+		printf("\n%s: malformed ACPI MCFG table, using PCI type-1 access only.", __FUNCTION__);
+		return;
+	}
+
+	num_allocs = (mcfg.length - sizeof(ACPI_MCFG)) / sizeof(ACPI_MCFG_ALLOCATION);
+	for(i=0; i < num_allocs; i++){
+		xmhf_baseplatform_arch_flat_copy((u8 *)&alloc,
+			(u8 *)(mcfgaddr + sizeof(ACPI_MCFG) + (i * sizeof(ACPI_MCFG_ALLOCATION))),
+			sizeof(ACPI_MCFG_ALLOCATION));
+
+		printf("\n%s: MCFG segment %u, buses %02x-%02x, ECAM at 0x%08x%08x", __FUNCTION__,
+			alloc.segment, alloc.startbus, alloc.endbus,
+			(u32)(alloc.baseaddress >> 32), (u32)alloc.baseaddress);
+
+		if(alloc.segment != 0 || alloc.startbus > alloc.endbus ||
+			alloc.baseaddress + ((u64)(alloc.endbus + 1) << 20) > ADDR_4GB){
+			printf("\n%s: skipping (not segment 0 or not below 4GB).", __FUNCTION__);
+			continue;
+		}
+
+		for(bus=alloc.startbus; bus <= alloc.endbus; bus++)
+			g_pci_ecam_busbase[bus] = (u32)alloc.baseaddress + (bus << 20);
+	}
+
+	//make sure ECAM and type-1 accesses agree on the host bridge before
+	//trusting the firmware's word for it
+	if(g_pci_ecam_busbase[0]){
+		xmhf_baseplatform_arch_x86_pci_type1_read(0, 0, 0, PCI_CONF_HDR_IDX_VENDOR_ID, sizeof(u32), &type1_id);
+		ecam_id = _pci_ecam_read(g_pci_ecam_busbase[0] + PCI_CONF_HDR_IDX_VENDOR_ID, sizeof(u32));
+		if(type1_id != ecam_id){
+			printf("\n%s: ECAM reads %08x for 00:00.0, type-1 reads %08x; using PCI type-1 access only.",
+				__FUNCTION__, ecam_id, type1_id);
+			memset(g_pci_ecam_busbase, 0, sizeof(g_pci_ecam_busbase));
+		}
+	}
+}
+
+//size and decode the BARs of an inventory entry
+static void _pci_sizebars(PCI_DEVICE *dev){
+	u32 command, num_bars, i, index;
+	u32 bar, mask, bar_hi, mask_hi;
+	u64 addrmask;
+	PCI_BAR *pcibar;
+
+	switch(dev->header_type & PCI_HEADER_TYPE_MASK){
+		case PCI_HEADER_TYPE_NORMAL: num_bars = 6; break;
+		case PCI_HEADER_TYPE_BRIDGE: num_bars = 2; break;
+		default: num_bars = 0; break;
+	}
+
+	//turn off decoding while the BARs hold all-ones
+	xmhf_baseplatform_arch_x86_pci_read(dev->bus, dev->device, dev->function,
+		PCI_CONF_HDR_IDX_COMMAND, sizeof(u16), &command);
+	xmhf_baseplatform_arch_x86_pci_write(dev->bus, dev->device, dev->function,
+		PCI_CONF_HDR_IDX_COMMAND, sizeof(u16), command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+	for(i=0; i < num_bars; i++){
+		pcibar = &dev->bars[i];
+		index = PCI_CONF_HDR_IDX_BAR0 + (i * sizeof(u32));
+
+		xmhf_baseplatform_arch_x86_pci_read(dev->bus, dev->device, dev->function, index, sizeof(u32), &bar);
+		xmhf_baseplatform_arch_x86_pci_write(dev->bus, dev->device, dev->function, index, sizeof(u32), 0xFFFFFFFFUL);
+		xmhf_baseplatform_arch_x86_pci_read(dev->bus, dev->device, dev->function, index, sizeof(u32), &mask);
+		xmhf_baseplatform_arch_x86_pci_write(dev->bus, dev->device, dev->function, index, sizeof(u32), bar);
+
+		if(bar & PCI_BAR_SPACE_IO){
+			pcibar->flags = PCI_BAR_SPACE_IO;
+			pcibar->base = bar & PCI_BAR_IO_ADDR_MASK;
+			//I/O BARs may implement only the low 16 address bits
+			addrmask = mask & PCI_BAR_IO_ADDR_MASK & 0xFFFFUL;
+		}else{
+			pcibar->flags = bar & (PCI_BAR_MEM_TYPE_64 | PCI_BAR_MEM_PREFETCH);
+			pcibar->base = bar & PCI_BAR_MEM_ADDR_MASK;
+			addrmask = mask & PCI_BAR_MEM_ADDR_MASK;
+
+			if((bar & PCI_BAR_MEM_TYPE_64) && (i + 1) < num_bars){
+				i++;	//the upper half is not a BAR of its own
+				index += sizeof(u32);
+				xmhf_baseplatform_arch_x86_pci_read(dev->bus, dev->device, dev->function, index, sizeof(u32), &bar_hi);
+				xmhf_baseplatform_arch_x86_pci_write(dev->bus, dev->device, dev->function, index, sizeof(u32), 0xFFFFFFFFUL);
+				xmhf_baseplatform_arch_x86_pci_read(dev->bus, dev->device, dev->function, index, sizeof(u32), &mask_hi);
+				xmhf_baseplatform_arch_x86_pci_write(dev->bus, dev->device, dev->function, index, sizeof(u32), bar_hi);
+
+				pcibar->base |= (u64)bar_hi << 32;
+				addrmask |= (u64)mask_hi << 32;
+			}
+		}
+
+		//the size is the lowest address bit that sticks; an unimplemented
+		//BAR reads back as all zeroes
+		pcibar->size = addrmask & ~(addrmask - 1);
+		if(!pcibar->size){
+			pcibar->base = 0;
+			pcibar->flags = 0;
+		}
+	}
+
+	xmhf_baseplatform_arch_x86_pci_write(dev->bus, dev->device, dev->function,
+		PCI_CONF_HDR_IDX_COMMAND, sizeof(u16), command);
+}
+
+//add a function to the inventory; returns its header type, or
+//0xFFFFFFFF if there is no such function
+static u32 _pci_adddevice(u32 bus, u32 device, u32 function){
+	u32 id, classrev, header_type;
+	PCI_DEVICE *dev;
+
+	xmhf_baseplatform_arch_x86_pci_read(bus, device, function, PCI_CONF_HDR_IDX_VENDOR_ID, sizeof(u32), &id);
+	if((id & 0xFFFF) == 0xFFFF || (id & 0xFFFF) == 0)
+		return 0xFFFFFFFFUL;
+
+	xmhf_baseplatform_arch_x86_pci_read(bus, device, function, PCI_CONF_HDR_IDX_REVISION_ID, sizeof(u32), &classrev);
+	xmhf_baseplatform_arch_x86_pci_read(bus, device, function, PCI_CONF_HDR_IDX_HEADER_TYPE, sizeof(u8), &header_type);
+
+	if(g_pci_num_devices >= PCI_MAX_DEVICES){
+		printf("\n%s: inventory full, ignoring %02x:%02x.%1x", __FUNCTION__, bus, device, function);
+		return header_type;
+	}
+
+	if(!g_pci_busindex[bus]){
+		if(g_pci_num_inventorybuses >= PCI_MAX_INVENTORY_BUSES){
+			printf("\n%s: too many buses, ignoring %02x:%02x.%1x", __FUNCTION__, bus, device, function);
+			return header_type;
+		}
+		g_pci_busindex[bus] = ++g_pci_num_inventorybuses;
+	}
+
+	dev = &g_pci_devices[g_pci_num_devices];
+	memset(dev, 0, sizeof(PCI_DEVICE));
+	dev->bus = bus;
+	dev->device = device;
+	dev->function = function;
+	dev->header_type = header_type;
+	dev->vendor_id = id & 0xFFFF;
+	dev->device_id = id >> 16;
+	dev->revision_id = classrev & 0xFF;
+	dev->class_code = classrev >> 8;
+	_pci_sizebars(dev);
+
+	g_pci_devfnindex[g_pci_busindex[bus] - 1][PCI_DEVICE_FN(device, function)] = ++g_pci_num_devices;
+
+	printf("\n	%02x:%02x.%1x -> vendor_id=%04x, device_id=%04x, class=%06x",
+		bus, device, function, dev->vendor_id, dev->device_id, dev->class_code);
+
+	return header_type;
+}
+
+
+//==============================================================================
+//global interfaces
+//==============================================================================
+
+//physical address of the ECAM config space page of a given bus, device
+//and function, or 0 if it is not reachable through ECAM
+u32 xmhf_baseplatform_arch_x86_pci_ecam_getaddress(u32 bus, u32 device, u32 function){
+	HALT_ON_ERRORCOND( bus <= 255 );
+	HALT_ON_ERRORCOND( PCI_DEVICE_FN(device,function) <= 255 );
+
+	if(!g_pci_ecam_busbase[bus])
+		return 0;
+
+	return g_pci_ecam_busbase[bus] + PCIE_ECAM_OFFSET(0, device, function, 0);
+}
+
+//reads PCI config space for a given bus, device, function and index,
+//through ECAM where available and type-1 otherwise
+//len = 1(byte), 2(word) and 4(dword), index must be a multiple of len
+//value is a pointer to a 32-bit dword which contains the value read
+void xmhf_baseplatform_arch_x86_pci_read(u32 bus, u32 device, u32 function, u32 index, u32 len,
+			u32 *value){
+	//sanity checks
+	HALT_ON_ERRORCOND( bus <= 255 );
+	HALT_ON_ERRORCOND( PCI_DEVICE_FN(device,function) <= 255 );
+	HALT_ON_ERRORCOND( index <= 4095 );
+	HALT_ON_ERRORCOND( (len == 1 || len == 2 || len == 4) && !(index & (len - 1)) );
+
+	if(g_pci_ecam_busbase[bus]){
+		*value = _pci_ecam_read(g_pci_ecam_busbase[bus] + PCIE_ECAM_OFFSET(0, device, function, index), len);
+	}else{
+		xmhf_baseplatform_arch_x86_pci_type1_read(bus, device, function, index, len, value);
+	}
+}
+
+//writes PCI config space for a given bus, device, function and index,
+//through ECAM where available and type-1 otherwise
+//len = 1(byte), 2(word) and 4(dword), index must be a multiple of len
+//value contains the value to be written
+void xmhf_baseplatform_arch_x86_pci_write(u32 bus, u32 device, u32 function, u32 index, u32 len,
+	u32 value){
+	//sanity checks
+	HALT_ON_ERRORCOND( bus <= 255 );
+	HALT_ON_ERRORCOND( PCI_DEVICE_FN(device,function) <= 255 );
+	HALT_ON_ERRORCOND( index <= 4095 );
+	HALT_ON_ERRORCOND( (len == 1 || len == 2 || len == 4) && !(index & (len - 1)) );
+
+	if(g_pci_ecam_busbase[bus]){
+		_pci_ecam_write(g_pci_ecam_busbase[bus] + PCIE_ECAM_OFFSET(0, device, function, index), len, value);
+	}else{
+		xmhf_baseplatform_arch_x86_pci_type1_write(bus, device, function, index, len, value);
+	}
+}
+
+//discover PCI Express ECAM from the ACPI MCFG table and build the
+//boot-time PCI device inventory. must run on the BSP before the guest
+//is started, as the BAR sizing briefly disables decoding on each device
+void xmhf_baseplatform_arch_x86_pci_enumerate(void){
+	u32 b, d, f, header_type;
+
+	_pci_ecam_initialize();
+
+	g_pci_num_devices = 0;
+	g_pci_num_inventorybuses = 0;
+	memset(g_pci_busindex, 0, sizeof(g_pci_busindex));
+	memset(g_pci_devfnindex, 0, sizeof(g_pci_devfnindex));
+
+	printf("\n%s: PCI bus enumeration follows:", __FUNCTION__);
+
+	//bus numbers range from 0-255, device from 0-31 and function from 0-7
+	for(b=0; b < PCI_BUS_MAX; b++){
+		for(d=0; d < PCI_DEVICE_MAX; d++){
+			header_type = _pci_adddevice(b, d, 0);
+			if(header_type == 0xFFFFFFFFUL || !(header_type & PCI_HEADER_TYPE_MULTIFUNCTION))
+				continue;
+
+			for(f=1; f < PCI_FUNCTION_MAX; f++)
+				_pci_adddevice(b, d, f);
+		}
+	}
+
+	printf("\n%s: %u PCI functions on %u buses.", __FUNCTION__,
+		g_pci_num_devices, g_pci_num_inventorybuses);
+}
+
+//the inventory entry of a given bus, device and function, or NULL if
+//no such function was found at boot
+PCI_DEVICE *xmhf_baseplatform_arch_x86_pci_getdevice(u32 bus, u32 device, u32 function){
+	u32 row, index;
+
+	if(bus >= PCI_BUS_MAX || device >= PCI_DEVICE_MAX || function >= PCI_FUNCTION_MAX)
+		return NULL;
+
+	row = g_pci_busindex[bus];
+	if(!row)
+		return NULL;
+
+	index = g_pci_devfnindex[row - 1][PCI_DEVICE_FN(device, function)];
+	if(!index)
+		return NULL;
+
+	return &g_pci_devices[index - 1];
+}
+
+//the boot-time PCI device inventory, in bus/device/function order
+PCI_DEVICE *xmhf_baseplatform_arch_x86_pci_getdevices(u32 *num_devices){
+	*num_devices = g_pci_num_devices;
+	return g_pci_devices;
+}
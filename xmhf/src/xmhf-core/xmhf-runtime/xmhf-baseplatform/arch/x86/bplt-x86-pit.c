@@ -51,11 +51,13 @@
 // note: due to 8254 PIT usage, the routines in this module should not
 // be called when a guest OS has been booted up on the physical PIT without
 // saving/restoring the PIT registers
+// note: the PIT is shared by all cores; it is only used to calibrate the
+// TSC (see tsc.c), which all other delays are based on
 
 #include <xmhf.h> 
 
 //---microsecond delay----------------------------------------------------------
-void xmhf_baseplatform_arch_x86_udelay(u32 usecs){
+void xmhf_baseplatform_arch_x86_pit_udelay(u32 usecs){
   u8 val;
   u32 latchregval;  
 
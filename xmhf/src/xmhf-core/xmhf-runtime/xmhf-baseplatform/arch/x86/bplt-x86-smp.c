@@ -65,6 +65,36 @@ u32 xmhf_baseplatform_arch_x86_isbsp(void){
     return 0;
 }
 
+//return the VCPU of the calling CPU. each CPU runs on its own stack
+//in g_cpustacks, in the same order as the VCPUs in g_vcpubuffers, so
+//the stack pointer tells us who we are without touching the LAPIC.
+//before the CPUs are on their stacks we look up the LAPIC id in the
+//midtable instead
+VCPU *xmhf_baseplatform_arch_x86_getcurrentvcpu(void){
+  u32 esp, i;
+  u32 eax, edx;
+  u32 lapic_id;
+
+  __asm__ __volatile__ ("movl %%esp, %0" : "=r" (esp));
+  i = (esp - (u32)g_cpustacks) / RUNTIME_STACK_SIZE;
+  if(esp >= (u32)g_cpustacks && i < g_midtable_numentries)
+    return &g_vcpubuffers[i];
+
+  //read LAPIC id of this core
+  rdmsr(MSR_APIC_BASE, &eax, &edx);
+  HALT_ON_ERRORCOND( edx == 0 ); //APIC is below 4G
+  lapic_id = *(volatile u32 *)((eax & 0xFFFFF000UL) + LAPIC_ID) >> 24;
+
+  for(i=0; i < g_midtable_numentries; i++){
+    if(g_midtable[i].cpu_lapic_id == lapic_id)
+      return (VCPU *)g_midtable[i].vcpu_vaddr_ptr;
+  }
+
+  printf("\n%s: fatal, unable to retrieve vcpu for id=0x%02x", __FUNCTION__, lapic_id);
+  HALT();
+  return NULL; //currently unreachable
+}
+
 //wake up APs using the LAPIC by sending the INIT-SIPI-SIPI IPI sequence
 void xmhf_baseplatform_arch_x86_wakeupAPs(void){
   u32 eax, edx;
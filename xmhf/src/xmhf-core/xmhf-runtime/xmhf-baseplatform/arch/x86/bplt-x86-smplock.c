@@ -47,29 +47,24 @@
 // multi-processor support routines
 // author: amit vasudevan (amitvasudevan@acm.org)
 
+#include <xmhf.h>
+
 //---spinlock/unlock------------------------------------------------------------
-.section .text
+//out-of-line wrappers around the ticket lock in _spinlock.h; this object is
+//also linked into the bootloader and secure loader
+
+#ifndef __XMHF_VERIFICATION__
 
-  .global spin_lock
-  spin_lock:
-    pushl %esi
-    movl 0x8(%esp), %esi
-    spin:	bt	$0, (%esi)		//mutex is available?
-      	jnc	spin			      //wait till it is
+void spin_lock(volatile u32 *lock){
+	(void)ticket_spin_lock(lock);
+}
 
-      	lock				        //lock the bus (exclusive access)	
-	      btr	$0, (%esi)		    //and try to grab the mutex	
-	      jnc	spin			      //spin until successful --> spinlock :p
-    popl %esi
-    ret
-    
-  .global spin_unlock
-  spin_unlock:
-      pushl %esi
-      movl 0x8(%esp), %esi
-      bts	$0, (%esi)		       //release the spinlock
-      popl %esi
-      ret
+u32 spin_lock_spins(volatile u32 *lock){
+	return ticket_spin_lock(lock);
+}
 
+void spin_unlock(volatile u32 *lock){
+	ticket_spin_unlock(lock);
+}
 
-      		
+#endif //__XMHF_VERIFICATION__
@@ -0,0 +1,285 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+//	tsc.c - TSC calibration, and per-CPU microsecond delays and timeouts
+
+#include <xmhf.h> 
+
+/*
+	the TSC frequency is taken from CPUID leaf 0x15 where the CPU
+	enumerates both the TSC/crystal ratio and the crystal frequency,
+	or from the hypervisor timing leaf 0x40000010 when we are nested
+	(QEMU/KVM with vmware-cpuid-freq=on). otherwise it is measured
+	against the 8254 PIT, which is only safe before the guest has
+	booted (see pit.c). the LAPIC timer rate is found alongside it.
+
+	the TSC is "invariant" when it ticks at a constant rate in all
+	ACPI P-, C- and T-states (CPUID 0x80000007 EDX[8]). only then is
+	the measured frequency good for converting TSC deltas into time.
+
+	delays and timeouts spin on the TSC, or on the LAPIC timer where
+	the TSC is not invariant. both are per-CPU, so any number of cores
+	can delay at once. the runtime calibrates at boot; the loaders
+	calibrate on first use.
+*/
+
+#define TSC_CALIBRATE_USECS		10000
+#define TSC_CALIBRATE_RUNS		3
+
+//fewer TSC ticks than this (100MHz) across a TSC_CALIBRATE_USECS PIT
+//delay means there is no PIT to wait on: port 0x61 floats high
+#define TSC_CALIBRATE_MIN_TICKS		(100000ULL * TSC_CALIBRATE_USECS / 1000)
+
+//TSC rate assumed when nothing could be calibrated. deliberately high,
+//so that delays and timeouts err on the long side
+#define TSC_FALLBACK_KHZ		5000000
+
+static bool g_tsc_calibrated = false;
+static u32 g_tsc_khz = 0;
+static bool g_tsc_invariant = false;
+static u32 g_lapic_timer_khz = 0;
+
+//xAPIC MMIO base, or NULL if the LAPIC is off or in x2APIC mode
+static volatile u8 *lapic_base(void){
+	u32 eax, edx;
+
+	rdmsr(MSR_APIC_BASE, &eax, &edx);
+	if(!(eax & MSR_IA32_APICBASE_ENABLE) || (eax & MSR_IA32_APICBASE_X2APIC) || edx)
+		return NULL;
+	return (volatile u8 *)(eax & 0xFFFFF000UL);
+}
+
+static inline u32 lapic_read(volatile u8 *lapic, u32 reg){
+	return *(volatile u32 *)(lapic + reg);
+}
+
+static inline void lapic_write(volatile u8 *lapic, u32 reg, u32 val){
+	*(volatile u32 *)(lapic + reg) = val;
+}
+
+//start the LAPIC timer counting down from 0xffffffff, masked, one-shot,
+//undivided
+static void lapic_timer_start(volatile u8 *lapic){
+	lapic_write(lapic, LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_1);
+	lapic_write(lapic, LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+	lapic_write(lapic, LAPIC_TIMER_INIT, 0xFFFFFFFFUL);
+}
+
+//TSC and LAPIC timer rates in kHz from CPUID; left alone if not enumerated
+static void tsc_khz_from_cpuid(u32 *tsc_khz, u32 *lapic_khz){
+	u32 eax, ebx, ecx, edx;
+	u64 hz;
+
+	cpuid(0, &eax, &ebx, &ecx, &edx);
+	if(eax >= 0x15){
+		//eax = denominator, ebx = numerator of the TSC/crystal ratio,
+		//ecx = crystal frequency in Hz, which the LAPIC timer runs at
+		cpuid(0x15, &eax, &ebx, &ecx, &edx);
+		if(eax != 0 && ebx != 0 && ecx != 0){
+			hz = (u64)ecx * ebx;
+			do_div(hz, eax);
+			do_div(hz, 1000);
+			*tsc_khz = (u32)hz;
+			*lapic_khz = ecx / 1000;
+			return;
+		}
+	}
+
+	//hypervisor present: eax = TSC kHz, ebx = LAPIC bus kHz
+	cpuid(1, &eax, &ebx, &ecx, &edx);
+	if(ecx & (1UL << 31)){
+		cpuid(0x40000000, &eax, &ebx, &ecx, &edx);
+		if(eax >= 0x40000010){
+			cpuid(0x40000010, &eax, &ebx, &ecx, &edx);
+			if(eax != 0){
+				*tsc_khz = eax;
+				*lapic_khz = ebx;
+			}
+		}
+	}
+}
+
+//TSC and LAPIC timer rates in kHz measured across PIT delays. the
+//shortest of a few runs is used, since anything that lengthens a run
+//(an SMI, say) only ever adds ticks
+static void tsc_khz_from_pit(u32 *tsc_khz, u32 *lapic_khz){
+	volatile u8 *lapic = lapic_base();
+	u32 lvt=0, div=0, init=0;
+	u64 t0, t1, ticks = (u64)-1;
+	u32 c0=0, c1=0, counts = 0xFFFFFFFFUL;
+	u32 i;
+
+	if(lapic){
+		lvt = lapic_read(lapic, LAPIC_LVT_TIMER);
+		div = lapic_read(lapic, LAPIC_TIMER_DIV);
+		init = lapic_read(lapic, LAPIC_TIMER_INIT);
+	}
+
+	for(i=0; i < TSC_CALIBRATE_RUNS; i++){
+		if(lapic){
+			lapic_timer_start(lapic);
+			c0 = lapic_read(lapic, LAPIC_TIMER_CUR);
+		}
+		t0 = rdtsc64();
+		xmhf_baseplatform_arch_x86_pit_udelay(TSC_CALIBRATE_USECS);
+		t1 = rdtsc64();
+		if(lapic)
+			c1 = lapic_read(lapic, LAPIC_TIMER_CUR);
+		if(t1 - t0 < ticks)
+			ticks = t1 - t0;
+		if(c0 - c1 < counts)
+			counts = c0 - c1;
+	}
+
+	if(lapic){
+		lapic_write(lapic, LAPIC_LVT_TIMER, lvt);
+		lapic_write(lapic, LAPIC_TIMER_DIV, div);
+		lapic_write(lapic, LAPIC_TIMER_INIT, init);
+	}
+
+	if(ticks < TSC_CALIBRATE_MIN_TICKS)
+		return;
+
+	do_div(ticks, TSC_CALIBRATE_USECS / 1000);
+	*tsc_khz = (u32)ticks;
+	if(lapic && counts != 0)
+		*lapic_khz = counts / (TSC_CALIBRATE_USECS / 1000);
+}
+
+//calibrate the TSC and LAPIC timer; called once by the runtime BSP at
+//boot, and on first use in the loaders
+void xmhf_baseplatform_arch_x86_tsc_calibrate(void){
+	u32 eax, ebx, ecx, edx;
+	char *source = "CPUID";
+
+	cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+	if(eax >= 0x80000007){
+		cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+		g_tsc_invariant = (edx & (1UL << 8)) ? true : false;
+	}
+
+	tsc_khz_from_cpuid(&g_tsc_khz, &g_lapic_timer_khz);
+	if(g_tsc_khz == 0){
+		source = "PIT";
+		tsc_khz_from_pit(&g_tsc_khz, &g_lapic_timer_khz);
+	}
+	if(g_tsc_khz == 0)
+		source = "none, assuming 5GHz";
+
+	g_tsc_calibrated = true;
+
+	printf("\n%s: TSC %u kHz (%s), %s, LAPIC timer %u kHz", __FUNCTION__,
+		g_tsc_khz, source, (g_tsc_invariant ? "invariant" : "NOT invariant"),
+		g_lapic_timer_khz);
+}
+
+//TSC frequency in kHz, as calibrated at boot; 0 if unknown
+u32 xmhf_baseplatform_arch_x86_tsc_khz(void){
+	return g_tsc_khz;
+}
+
+//true if the TSC ticks at the calibrated rate in all power states
+bool xmhf_baseplatform_arch_x86_tsc_invariant(void){
+	return g_tsc_invariant;
+}
+
+//ticks of a clock running at khz in usecs
+static u64 usecs_to_ticks(u32 usecs, u32 khz){
+	u64 ticks = (u64)usecs * khz;
+
+	do_div(ticks, 1000);
+	return ticks;
+}
+
+//---microsecond delay----------------------------------------------------------
+//note: where the TSC is not invariant this uses the LAPIC timer, which
+//like the PIT must not be touched once the guest has booted
+void xmhf_baseplatform_arch_x86_udelay(u32 usecs){
+	u64 deadline;
+	volatile u8 *lapic;
+	u32 lvt, div, init, c0, counts;
+
+	if(!g_tsc_calibrated)
+		xmhf_baseplatform_arch_x86_tsc_calibrate();
+
+	if(!g_tsc_invariant && g_lapic_timer_khz && (lapic = lapic_base()) != NULL){
+		counts = (u32)usecs_to_ticks(usecs, g_lapic_timer_khz);
+		lvt = lapic_read(lapic, LAPIC_LVT_TIMER);
+		div = lapic_read(lapic, LAPIC_TIMER_DIV);
+		init = lapic_read(lapic, LAPIC_TIMER_INIT);
+		lapic_timer_start(lapic);
+		c0 = lapic_read(lapic, LAPIC_TIMER_CUR);
+		#ifndef __XMHF_VERIFICATION__
+		while(c0 - lapic_read(lapic, LAPIC_TIMER_CUR) < counts)
+			cpu_relax();
+		#endif //__XMHF_VERIFICATION__
+		lapic_write(lapic, LAPIC_LVT_TIMER, lvt);
+		lapic_write(lapic, LAPIC_TIMER_DIV, div);
+		lapic_write(lapic, LAPIC_TIMER_INIT, init);
+		return;
+	}
+
+	deadline = xmhf_baseplatform_arch_x86_deadline(usecs);
+	#ifndef __XMHF_VERIFICATION__
+	while(!xmhf_baseplatform_arch_x86_deadline_passed(deadline))
+		cpu_relax();
+	#endif //__XMHF_VERIFICATION__
+}
+
+//---timeouts-------------------------------------------------------------------
+//the TSC value usecs from now, calibrating on first use
+u64 xmhf_baseplatform_arch_x86_deadline(u32 usecs){
+	if(!g_tsc_calibrated)
+		xmhf_baseplatform_arch_x86_tsc_calibrate();
+
+	return rdtsc64() + usecs_to_ticks(usecs,
+		(g_tsc_khz ? g_tsc_khz : TSC_FALLBACK_KHZ));
+}
+
+//true once the TSC has reached deadline
+bool xmhf_baseplatform_arch_x86_deadline_passed(u64 deadline){
+	return (s64)(rdtsc64() - deadline) >= 0;
+}
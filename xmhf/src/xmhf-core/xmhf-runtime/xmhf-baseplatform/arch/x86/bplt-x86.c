@@ -113,6 +113,16 @@ void xmhf_baseplatform_arch_cpuinitialize(void){
 		write_cr4(t_cr4);
 	}
 
+	//set OSFXSR bit in CR4 so that hypapps can use SSE instructions
+	//(e.g., for hashing); they must save the guest's FPU/SSE state
+	//with FXSAVE/FXRSTOR around any such use
+	if(xmhf_baseplatform_arch_x86_cpuhasfxsrfeature()){
+		u32 t_cr4;
+		t_cr4 = read_cr4();
+		t_cr4 |= CR4_OSFXSR;
+		write_cr4(t_cr4);
+	}
+
 	if(cpu_vendor == CPU_VENDOR_INTEL)
 		xmhf_baseplatform_arch_x86vmx_cpuinitialize();
 }
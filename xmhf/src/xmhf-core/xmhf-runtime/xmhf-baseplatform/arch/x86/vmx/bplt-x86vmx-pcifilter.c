@@ -0,0 +1,515 @@
+/*
+ * @XMHF_LICENSE_HEADER_START@
+ *
+ * eXtensible, Modular Hypervisor Framework (XMHF)
+ * Copyright (c) 2009-2012 Carnegie Mellon University
+ * Copyright (c) 2010-2012 VDG Inc.
+ * All Rights Reserved.
+ *
+ * Developed by: XMHF Team
+ *               Carnegie Mellon University / CyLab
+ *               VDG Inc.
+ *               http://xmhf.org
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in
+ * the documentation and/or other materials provided with the
+ * distribution.
+ *
+ * Neither the names of Carnegie Mellon or VDG Inc, nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * @XMHF_LICENSE_HEADER_END@
+ */
+
+/*
+ * EMHF base platform component interface, x86 vmx backend
+ * PCI config space filtering
+ */
+
+#include <xmhf.h>
+
+/*
+	hypapps hide or emulate the config space of individual PCI functions
+	by registering a filter for them. we then intercept guest accesses
+	to those functions only, so that config accesses to any other
+	function cost no VM exit:
+
+	ECAM: each function has a 4KB page of its own in the ECAM window. we
+	mark the pages of filtered functions not-present in every core's EPT.
+	on an access, we fill a shadow page with what the filter wants the
+	guest to see at the accessed offset, map it in place of the ECAM page
+	and single-step the guest instruction (as the LAPIC emulation in
+	smpg-x86vmx.c does). on the #DB we put the ECAM page back and, for
+	writes, hand what the guest wrote to the filter.
+
+	type-1: the config data ports are shared by all functions, so they
+	are intercepted once any filter is registered. we look at the address
+	the guest put in PCI_CONFIG_ADDR_PORT and emulate the access only if
+	it is to a filtered function, letting everything else through.
+
+	ECAM windows above 4GB are not reachable by the runtime (see
+	bplt-x86-pcie.c) and are not filtered.
+
+	MMIO: hypapps can also filter guest writes to a range of device
+	registers. its pages are mapped read-only, so reads go to the device
+	with no VM exit. a write is stepped on the shadow page as for ECAM,
+	with the dwords around it filled from the device, and the dword
+	written is handed to the filter afterwards.
+*/
+
+//a filtered function
+typedef struct {
+	u32 bus;
+	u32 device;
+	u32 function;
+	u32 ecam_paddr;		//its ECAM page, 0 if it has none
+	PCI_FILTER_HANDLER handler;
+} PCI_FILTER;
+
+//a filtered MMIO range
+typedef struct {
+	u32 paddr;
+	u32 size;
+	PCI_MMIO_FILTER_HANDLER handler;
+} PCI_MMIO_FILTER;
+
+//an ECAM or MMIO access being single-stepped on a core
+typedef struct {
+	u32 page;			//guest physical page stepped on, 0 if idle
+	u32 filter;			//index into g_pcifilters, PCIFILTER_NONE for MMIO
+	u32 mmio;			//index into g_pcimmiofilters, PCIFILTER_NONE for ECAM
+	u32 errorcode;		//EPT violation exit qualification
+	u32 offset;			//offset of the access in the ECAM page
+	u32 window;			//bytes of the shadow page filled in at offset & ~3
+	u64 saved_entry;	//EPT entry of the page
+	u32 saved_dbintercept;	//#DB bit of the exception bitmap
+	u32 eflags_tfifmask;	//guest TF and IF
+	u8 fill[8];			//what the window was filled with
+} PCIFILTER_STEP;
+
+#define PCIFILTER_NONE			0xFFFFFFFFUL
+
+//guest writes to a filtered ECAM page are found by comparing the
+//window against this pattern after the write; trailing bytes written
+//with the pattern value itself look unchanged and are not delivered
+#define PCIFILTER_WRITE_PATTERN	0xA5
+
+//the shadow page is ordinary write-back memory
+#define PCIFILTER_SHADOW_MAP	((u64)EPT_PROT_READ | (u64)EPT_PROT_WRITE | (6ULL << 3))
+
+static PCI_FILTER g_pcifilters[PCI_FILTER_MAX];
+static u32 g_pcifilters_count=0;
+
+static PCI_MMIO_FILTER g_pcimmiofilters[PCI_MMIO_FILTER_MAX];
+static u32 g_pcimmiofilters_count=0;
+
+//bit devfn of g_pcifilter_bitmap[bus] is set if the function is filtered
+static u32 g_pcifilter_bitmap[PCI_BUS_MAX][(PCI_DEVICE_MAX * PCI_FUNCTION_MAX) / 32];
+
+//1 once filters have been put in place
+static u32 g_pcifilter_active=0;
+
+//per-core ECAM access state, indexed by vcpu->idx
+static PCIFILTER_STEP g_pcifilter_steps[MAX_VCPU_ENTRIES];
+
+
+//==============================================================================
+//static (local) functions
+//==============================================================================
+
+//the index of the filter for a bus, device and function, or
+//PCIFILTER_NONE if it is not filtered
+static u32 _pcifilter_find(u32 bus, u32 device, u32 function){
+	u32 devfn = PCI_DEVICE_FN(device, function);
+	u32 i;
+
+	if(!(g_pcifilter_bitmap[bus][devfn / 32] & (1UL << (devfn % 32))))
+		return PCIFILTER_NONE;
+
+	for(i=0; i < g_pcifilters_count; i++){
+		if(g_pcifilters[i].bus == bus && g_pcifilters[i].device == device &&
+			g_pcifilters[i].function == function)
+			return i;
+	}
+
+	return PCIFILTER_NONE;
+}
+
+//the config space dword at index as the filter presents it
+static u32 _pcifilter_view(VCPU *vcpu, PCI_FILTER *f, u32 index){
+	u32 value=0;
+
+	if(f->handler(vcpu, f->bus, f->device, f->function, index, 4,
+		PCI_ACCESS_READ, &value) == PCI_FILTER_PASSTHROUGH)
+		xmhf_baseplatform_arch_x86_pci_read(f->bus, f->device, f->function,
+			index, 4, &value);
+
+	return value;
+}
+
+//hand a guest write to the filter, and to the function if the filter
+//lets it through
+static void _pcifilter_write(VCPU *vcpu, PCI_FILTER *f, u32 index, u32 len, u32 value){
+	if(f->handler(vcpu, f->bus, f->device, f->function, index, len,
+		PCI_ACCESS_WRITE, &value) == PCI_FILTER_PASSTHROUGH)
+		xmhf_baseplatform_arch_x86_pci_write(f->bus, f->device, f->function,
+			index, len, value);
+}
+
+//install an EPT entry for the page of the access being stepped
+static void _pcifilter_changemapping(VCPU *vcpu, PCIFILTER_STEP *step, u64 entry){
+	u64 *pts = (u64 *)vcpu->vmx_vaddr_ept_p_tables;
+
+	pts[step->page / PAGE_SIZE_4K] = entry;
+	xmhf_memprot_arch_x86vmx_flushmappings(vcpu);
+}
+
+//deliver the bytes the guest wrote to the shadow window
+static void _pcifilter_deliverwrite(VCPU *vcpu, PCIFILTER_STEP *step, u8 *shadow){
+	PCI_FILTER *f = &g_pcifilters[step->filter];
+	u32 base = step->offset & ~0x3UL;
+	u32 start = step->offset;
+	u32 end, last, pos, len, value, i;
+
+	//the write starts at the faulting address; it ends at the last byte
+	//that changed, rounded up to an access size. if nothing changed the
+	//guest wrote back the fill, and we deliver only the byte we know it
+	//wrote
+	last = start;
+	for(i=start - base; i < step->window; i++){
+		if(shadow[base + i] != step->fill[i])
+			last = base + i;
+	}
+	if(last == start && shadow[start] == step->fill[start - base]){
+		len = 1;
+	}else{
+		len = last - start + 1;
+		len = (len <= 1) ? 1 : ((len <= 2) ? 2 : ((len <= 4) ? 4 : 8));
+	}
+	end = start + len;
+	if(end > base + step->window)
+		end = base + step->window;
+
+	//split into naturally aligned config accesses
+	for(pos=start; pos < end; pos += len){
+		if(!(pos & 3) && pos + 4 <= end)
+			len = 4;
+		else if(!(pos & 1) && pos + 2 <= end)
+			len = 2;
+		else
+			len = 1;
+
+		value = 0;
+		memcpy(&value, &shadow[pos], len);
+		_pcifilter_write(vcpu, f, pos, len, value);
+	}
+}
+
+//the index of the MMIO filter for a page, or PCIFILTER_NONE if it is
+//not filtered
+static u32 _pcifilter_findmmio(u32 page){
+	u32 i;
+
+	for(i=0; i < g_pcimmiofilters_count; i++){
+		if(page >= g_pcimmiofilters[i].paddr &&
+			page - g_pcimmiofilters[i].paddr < g_pcimmiofilters[i].size)
+			return i;
+	}
+
+	return PCIFILTER_NONE;
+}
+
+//hand a guest MMIO write to the filter. the dword at the fault is
+//always delivered, the one after it only if the guest changed it
+static void _pcifilter_delivermmiowrite(VCPU *vcpu, PCIFILTER_STEP *step, u8 *shadow){
+	PCI_MMIO_FILTER *f = &g_pcimmiofilters[step->mmio];
+	u32 base = step->offset & ~0x3UL;
+	u32 value, i;
+
+	for(i=0; i < step->window; i += 4){
+		if(i && !memcmp(&shadow[base + i], &step->fill[i], 4))
+			continue;
+
+		memcpy(&value, &shadow[base + i], 4);
+		if(f->handler(vcpu, step->page + base + i, &value) == PCI_FILTER_PASSTHROUGH)
+			xmhf_baseplatform_arch_flat_writeu32(step->page + base + i, value);
+	}
+}
+
+
+//==============================================================================
+//global functions
+//==============================================================================
+
+//filter guest accesses to the config space of a PCI function; called
+//from app main on the BSP. returns 1 on success, 0 if filtering is not
+//supported or there are too many filters
+u32 xmhf_baseplatform_arch_x86vmx_pcifilter_register(VCPU *vcpu, u32 bus, u32 device,
+	u32 function, PCI_FILTER_HANDLER handler){
+	PCI_FILTER *f;
+	u32 devfn;
+
+	if(vcpu->cpu_vendor != CPU_VENDOR_INTEL || g_pcifilter_active)
+		return 0;
+
+	if(bus >= PCI_BUS_MAX || device >= PCI_DEVICE_MAX || function >= PCI_FUNCTION_MAX ||
+		handler == NULL)
+		return 0;
+
+	if(_pcifilter_find(bus, device, function) != PCIFILTER_NONE)
+		return 0;
+
+	if(g_pcifilters_count >= PCI_FILTER_MAX){
+		printf("\n%s: too many PCI filters", __FUNCTION__);
+		return 0;
+	}
+
+	f = &g_pcifilters[g_pcifilters_count];
+	f->bus = bus;
+	f->device = device;
+	f->function = function;
+	f->ecam_paddr = xmhf_baseplatform_arch_x86_pci_ecam_getaddress(bus, device, function);
+	f->handler = handler;
+	g_pcifilters_count++;
+
+	devfn = PCI_DEVICE_FN(device, function);
+	g_pcifilter_bitmap[bus][devfn / 32] |= (1UL << (devfn % 32));
+
+	printf("\n%s: filtering %02x:%02x.%x (ECAM page 0x%08x)", __FUNCTION__,
+		bus, device, function, f->ecam_paddr);
+	return 1;
+}
+
+//filter guest writes to a page aligned range of device MMIO below 4GB,
+//such as a BAR; called from app main on the BSP. the device must not
+//mind being read. returns 1 on success, 0 if filtering is not supported
+//or there are too many filters
+u32 xmhf_baseplatform_arch_x86vmx_pcifilter_registermmio(VCPU *vcpu, u32 paddr, u32 size,
+	PCI_MMIO_FILTER_HANDLER handler){
+	PCI_MMIO_FILTER *f;
+	u32 i;
+
+	if(vcpu->cpu_vendor != CPU_VENDOR_INTEL || g_pcifilter_active)
+		return 0;
+
+	if((paddr & (PAGE_SIZE_4K - 1)) || (size & (PAGE_SIZE_4K - 1)) || size == 0 ||
+		paddr + size < paddr || handler == NULL)
+		return 0;
+
+	for(i=0; i < size; i += PAGE_SIZE_4K){
+		if(_pcifilter_findmmio(paddr + i) != PCIFILTER_NONE)
+			return 0;
+	}
+
+	if(g_pcimmiofilters_count >= PCI_MMIO_FILTER_MAX){
+		printf("\n%s: too many MMIO filters", __FUNCTION__);
+		return 0;
+	}
+
+	f = &g_pcimmiofilters[g_pcimmiofilters_count];
+	f->paddr = paddr;
+	f->size = size;
+	f->handler = handler;
+	g_pcimmiofilters_count++;
+
+	printf("\n%s: filtering writes to 0x%08x-0x%08x", __FUNCTION__,
+		paddr, paddr + size - 1);
+	return 1;
+}
+
+//start intercepting accesses to filtered functions on all cores;
+//called on the BSP once all cores have been through app main
+void xmhf_baseplatform_arch_x86vmx_pcifilter_activate(VCPU *vcpu){
+	VCPU *cpu;
+	u64 *pts;
+	u32 i, j, k;
+
+	for(i=0; i < MAX_VCPU_ENTRIES; i++)
+		g_pcifilter_steps[i].page = 0;
+
+	if(vcpu->cpu_vendor != CPU_VENDOR_INTEL ||
+		(g_pcifilters_count == 0 && g_pcimmiofilters_count == 0))
+		return;
+
+	//the APs have not run their guests yet, so only the BSP has EPT
+	//mappings to flush
+	for(i=0; i < g_midtable_numentries; i++){
+		cpu = (VCPU *)g_midtable[i].vcpu_vaddr_ptr;
+		pts = (u64 *)cpu->vmx_vaddr_ept_p_tables;
+		for(j=0; j < g_pcifilters_count; j++){
+			if(g_pcifilters[j].ecam_paddr)
+				pts[g_pcifilters[j].ecam_paddr / PAGE_SIZE_4K] &=
+					~((u64)EPT_PROT_READ | (u64)EPT_PROT_WRITE | (u64)EPT_PROT_EXEC);
+		}
+		for(j=0; j < g_pcimmiofilters_count; j++){
+			for(k=0; k < g_pcimmiofilters[j].size; k += PAGE_SIZE_4K)
+				pts[(g_pcimmiofilters[j].paddr + k) / PAGE_SIZE_4K] &= ~((u64)EPT_PROT_WRITE);
+		}
+	}
+	xmhf_memprot_arch_x86vmx_flushmappings(vcpu);
+
+	//the I/O bitmap is shared by all cores
+	if(g_pcifilters_count)
+		xmhf_partition_legacyIO_setprot(vcpu, PCI_CONFIG_DATA_PORT, PART_LEGACYIO_PORTSIZE_DWORD,
+			PART_LEGACYIO_NOACCESS);
+
+	g_pcifilter_active = 1;
+}
+
+//handle an EPT violation on a filtered function's ECAM page or a
+//filtered MMIO range; returns 1 if it was one, 0 otherwise
+u32 xmhf_baseplatform_arch_x86vmx_pcifilter_eptviolation(VCPU *vcpu, u32 gpa, u32 errorcode){
+	PCIFILTER_STEP *step = &g_pcifilter_steps[vcpu->idx];
+	u8 *shadow = &g_vmx_pcifilter_shadow_buffers[vcpu->idx * PAGE_SIZE_4K];
+	u32 page = gpa & ~(PAGE_SIZE_4K - 1);
+	u32 base, value, i, mmio;
+
+	if(!g_pcifilter_active)
+		return 0;
+
+	for(i=0; i < g_pcifilters_count; i++){
+		if(g_pcifilters[i].ecam_paddr && page == g_pcifilters[i].ecam_paddr)
+			break;
+	}
+	if(i == g_pcifilters_count){
+		i = PCIFILTER_NONE;
+		mmio = _pcifilter_findmmio(page);
+		if(mmio == PCIFILTER_NONE || !(errorcode & EPT_ERRORCODE_WRITE))
+			return 0;
+	}else{
+		mmio = PCIFILTER_NONE;
+	}
+
+	HALT_ON_ERRORCOND(step->page == 0);
+	step->page = page;
+	step->filter = i;
+	step->mmio = mmio;
+	step->errorcode = errorcode;
+	step->offset = gpa & (PAGE_SIZE_4K - 1);
+
+	//fill the dword of the access and the one after it, for accesses
+	//that straddle a dword boundary. MMIO writes see the device. reads
+	//of config space (including those of a read-modify-write) see the
+	//filter's view of it, plain writes a pattern we can find their
+	//bytes against
+	base = step->offset & ~0x3UL;
+	step->window = (base + 8 <= PAGE_SIZE_4K) ? 8 : 4;
+	for(i=0; i < step->window; i += 4){
+		if(mmio != PCIFILTER_NONE){
+			value = xmhf_baseplatform_arch_flat_readu32(page + base + i);
+			memcpy(&step->fill[i], &value, 4);
+		}else if(errorcode & EPT_ERRORCODE_READ){
+			value = _pcifilter_view(vcpu, &g_pcifilters[step->filter], base + i);
+			memcpy(&step->fill[i], &value, 4);
+		}else{
+			memset(&step->fill[i], PCIFILTER_WRITE_PATTERN, 4);
+		}
+		memcpy(&shadow[base + i], &step->fill[i], 4);
+	}
+
+	//map the shadow page and step the access
+	step->saved_entry = ((u64 *)vcpu->vmx_vaddr_ept_p_tables)[page / PAGE_SIZE_4K];
+	_pcifilter_changemapping(vcpu, step, (u64)hva2spa(shadow) | PCIFILTER_SHADOW_MAP);
+
+	step->saved_dbintercept = vcpu->vmcs.control_exception_bitmap & (1UL << 1);
+	vcpu->vmcs.control_exception_bitmap |= (1UL << 1);
+
+	step->eflags_tfifmask = (u32)vcpu->vmcs.guest_RFLAGS & ((u32)EFLAGS_IF | (u32)EFLAGS_TF);
+	vcpu->vmcs.guest_RFLAGS |= EFLAGS_TF;
+	vcpu->vmcs.guest_RFLAGS &= ~(EFLAGS_IF);
+
+	return 1;
+}
+
+//finish an access to a filtered function's ECAM page or MMIO range
+//after it has been single-stepped; returns 1 if the #DB was due to
+//one, 0 otherwise
+u32 xmhf_baseplatform_arch_x86vmx_pcifilter_dbexception(VCPU *vcpu, struct regs __attribute__((unused)) *r){
+	PCIFILTER_STEP *step = &g_pcifilter_steps[vcpu->idx];
+	u8 *shadow = &g_vmx_pcifilter_shadow_buffers[vcpu->idx * PAGE_SIZE_4K];
+
+	if(!g_pcifilter_active || step->page == 0)
+		return 0;
+
+	if(step->mmio != PCIFILTER_NONE)
+		_pcifilter_delivermmiowrite(vcpu, step, shadow);
+	else if(step->errorcode & EPT_ERRORCODE_WRITE)
+		_pcifilter_deliverwrite(vcpu, step, shadow);
+
+	_pcifilter_changemapping(vcpu, step, step->saved_entry);
+
+	vcpu->vmcs.control_exception_bitmap &= ~(1UL << 1);
+	vcpu->vmcs.control_exception_bitmap |= step->saved_dbintercept;
+
+	vcpu->vmcs.guest_RFLAGS &= ~(EFLAGS_IF);
+	vcpu->vmcs.guest_RFLAGS &= ~(EFLAGS_TF);
+	vcpu->vmcs.guest_RFLAGS |= step->eflags_tfifmask;
+
+	step->page = 0;
+	return 1;
+}
+
+//handle a PCI config data port access; returns APP_IOINTERCEPT_SKIP if
+//it was to a filtered function and has been emulated, else
+//APP_IOINTERCEPT_CHAIN
+u32 xmhf_baseplatform_arch_x86vmx_pcifilter_portaccess(VCPU *vcpu, struct regs *r,
+	u32 portnum, u32 access_type, u32 access_size){
+	PCI_FILTER *f;
+	u32 address, index, len, value, mask, i;
+
+	if(!g_pcifilter_active || portnum < PCI_CONFIG_DATA_PORT ||
+		portnum >= PCI_CONFIG_DATA_PORT + 4)
+		return APP_IOINTERCEPT_CHAIN;
+
+	//the address port is not intercepted, it holds what the guest last
+	//put there
+	address = inl(PCI_CONFIG_ADDR_PORT);
+	if(!(address & 0x80000000UL))
+		return APP_IOINTERCEPT_CHAIN;
+
+	i = _pcifilter_find((address >> 16) & 0xFF, (address >> 11) & 0x1F, (address >> 8) & 0x7);
+	if(i == PCIFILTER_NONE)
+		return APP_IOINTERCEPT_CHAIN;
+	f = &g_pcifilters[i];
+
+	index = (address & 0xFC) + (portnum - PCI_CONFIG_DATA_PORT);
+	len = (access_size == IO_SIZE_BYTE) ? 1 : ((access_size == IO_SIZE_WORD) ? 2 : 4);
+	mask = (len == 4) ? 0xFFFFFFFFUL : ((1UL << (len * 8)) - 1);
+
+	if(access_type == IO_TYPE_IN){
+		if(f->handler(vcpu, f->bus, f->device, f->function, index, len,
+			PCI_ACCESS_READ, &value) == PCI_FILTER_PASSTHROUGH)
+			return APP_IOINTERCEPT_CHAIN;
+		r->eax = (r->eax & ~mask) | (value & mask);
+	}else{
+		value = r->eax & mask;
+		if(f->handler(vcpu, f->bus, f->device, f->function, index, len,
+			PCI_ACCESS_WRITE, &value) == PCI_FILTER_PASSTHROUGH)
+			return APP_IOINTERCEPT_CHAIN;
+	}
+
+	return APP_IOINTERCEPT_SKIP;
+}
@@ -60,3 +60,46 @@ void xmhf_baseplatform_smpinitialize(void){
 void xmhf_baseplatform_reboot(VCPU *vcpu){
 	xmhf_baseplatform_arch_reboot(vcpu);
 }
+
+//registered spinlock statistics, most recently registered first
+static SPINLOCK_STATS *g_spinlock_stats_list = NULL;
+static volatile u32 g_lock_spinlock_stats_list = 1;
+
+void xmhf_baseplatform_spinlock_stats_register(SPINLOCK_STATS *stats){
+	spin_lock(&g_lock_spinlock_stats_list);
+	stats->next = g_spinlock_stats_list;
+	g_spinlock_stats_list = stats;
+	spin_unlock(&g_lock_spinlock_stats_list);
+}
+
+u32 xmhf_baseplatform_spinlock_stats_read(SPINLOCK_STATS *out, u32 max){
+	SPINLOCK_STATS *stats;
+	u32 n = 0, seq;
+
+	spin_lock(&g_lock_spinlock_stats_list);
+	for(stats = g_spinlock_stats_list; stats != NULL; stats = stats->next, n++){
+		if(n >= max)
+			continue;
+
+		//retry while the holder is in the middle of an update
+		do{
+			while((seq = stats->seq) & 1)
+				cpu_relax();
+			__asm__ __volatile__ ("" : : : "memory");
+			out[n].name = stats->name;
+			out[n].acquisitions = stats->acquisitions;
+			out[n].contended = stats->contended;
+			out[n].spins = stats->spins;
+			out[n].hold_cycles = stats->hold_cycles;
+			out[n].hold_max = stats->hold_max;
+			__asm__ __volatile__ ("" : : : "memory");
+		}while(stats->seq != seq);
+
+		out[n].seq = 0;
+		out[n].hold_start = 0;
+		out[n].next = NULL;
+	}
+	spin_unlock(&g_lock_spinlock_stats_list);
+
+	return n;
+}
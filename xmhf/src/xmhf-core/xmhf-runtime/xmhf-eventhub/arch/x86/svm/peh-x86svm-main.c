@@ -55,6 +55,7 @@ static void _svm_handle_ioio(VCPU *vcpu, struct _svm_vmcbfields *vmcb, struct re
   union svmioiointerceptinfo ioinfo;
   u32 app_ret_status = APP_IOINTERCEPT_CHAIN;
   u32 access_size, access_type;
+  PART_LEGACYIO_SHADOW *shadow;
 
   ioinfo.rawbits = vmcb->exitinfo1;
   
@@ -76,10 +77,21 @@ static void _svm_handle_ioio(VCPU *vcpu, struct _svm_vmcbfields *vmcb, struct re
 	access_size = IO_SIZE_DWORD;
 	
 	//call our app handler
-	xmhf_smpguest_arch_x86svm_quiesce(vcpu);
-	app_ret_status=xmhf_app_handleintercept_portaccess(vcpu, r, ioinfo.fields.port, access_type, 
-          access_size);
-    xmhf_smpguest_arch_x86svm_endquiesce(vcpu);
+	shadow = xmhf_partition_legacyIO_getshadow(ioinfo.fields.port, access_type, access_size);
+	if(shadow == NULL){
+		xmhf_smpguest_arch_x86svm_quiesce(vcpu);
+		app_ret_status=xmhf_app_handleintercept_portaccess(vcpu, r, ioinfo.fields.port, access_type, 
+	          access_size);
+	    xmhf_smpguest_arch_x86svm_endquiesce(vcpu);
+	}else if(access_type == IO_TYPE_IN || ioinfo.fields.port != shadow->trigger){
+		//shadow port writes are latched, and reads done, without a callback
+		app_ret_status=xmhf_partition_legacyIO_shadowaccess(shadow, ioinfo.fields.port,
+			access_type, (u8)vmcb->rax);
+	}else{
+		xmhf_smpguest_arch_x86svm_quiesce(vcpu);
+		app_ret_status=xmhf_partition_legacyIO_shadowtrigger(vcpu, r, shadow, (u8)vmcb->rax);
+	    xmhf_smpguest_arch_x86svm_endquiesce(vcpu);
+	}
 	
   
   if(app_ret_status == APP_IOINTERCEPT_CHAIN){
@@ -158,7 +170,7 @@ static void _svm_handle_npf(VCPU *vcpu, struct regs *r){
   if(gpa >= g_svm_lapic_base && gpa < (g_svm_lapic_base + PAGE_SIZE_4K)){
     //LAPIC access, xfer control to apropriate handler
     HALT_ON_ERRORCOND( vcpu->isbsp == 1); //only BSP gets a NPF during LAPIC SIPI detection
-    xmhf_smpguest_arch_x86_eventhandler_hwpgtblviolation(vcpu, gpa, errorcode);
+    xmhf_smpguest_arch_x86_eventhandler_hwpgtblviolation(vcpu, r, gpa, errorcode);
   } else {
 	//note: AMD does not provide guest virtual address on a #NPF so we pass zero always
 	xmhf_smpguest_arch_x86svm_quiesce(vcpu);
@@ -296,6 +296,11 @@ static void _vmx_handle_intercept_wrmsr(VCPU *vcpu, struct regs *r){
 		case IA32_SYSENTER_ESP_MSR:
 			vcpu->vmcs.guest_SYSENTER_ESP = (unsigned long long)r->eax;
 			break;
+		case MSR_X2APIC_ICR:
+			//INIT and SIPI during SMP guest boot are handled by smpguest
+			if(xmhf_smpguest_arch_x86vmx_eventhandler_x2apicicrwrite(vcpu, r))
+				break;
+			//fall through
 		default:{
 			asm volatile ("wrmsr\r\n"
           : //no outputs
@@ -338,6 +343,17 @@ static void _vmx_handle_intercept_rdmsr(VCPU *vcpu, struct regs *r){
 }
 
 
+//---virtual-NMI blocking after a faulting IRET--------------------------
+//an IRET that unblocks NMIs and then faults has unblocked virtual NMIs
+//by the time we see the exit; block them again since the IRET is run
+//again when the guest resumes
+static void _vmx_nmi_reblock_on_iret(VCPU *vcpu, u32 info){
+	if(vcpu->vmx_guest_vnmi && (info & INTR_INFO_NMI_UNBLOCKED_BY_IRET) &&
+		!(vcpu->vmcs.info_IDT_vectoring_information & VECTORING_INFO_VALID_MASK))
+		vcpu->vmcs.guest_interruptibility |= GUEST_INTR_STATE_NMI;
+}
+
+
 //---intercept handler (EPT voilation)----------------------------------
 static void _vmx_handle_intercept_eptviolation(VCPU *vcpu, struct regs *r){
 	u32 errorcode, gpa, gva;
@@ -345,9 +361,14 @@ static void _vmx_handle_intercept_eptviolation(VCPU *vcpu, struct regs *r){
 	gpa = (u32) vcpu->vmcs.guest_paddr_full;
 	gva = (u32) vcpu->vmcs.info_guest_linear_address;
 
-	//check if EPT violation is due to LAPIC interception
-	if(vcpu->isbsp && (gpa >= g_vmx_lapic_base) && (gpa < (g_vmx_lapic_base + PAGE_SIZE_4K)) ){
-		xmhf_smpguest_arch_x86_eventhandler_hwpgtblviolation(vcpu, gpa, errorcode);
+	_vmx_nmi_reblock_on_iret(vcpu, errorcode);
+
+	//check if EPT violation is due to a filtered PCI function's config
+	//space, or LAPIC interception
+	if(xmhf_baseplatform_arch_x86vmx_pcifilter_eptviolation(vcpu, gpa, errorcode)){
+		//handled, the access is being single-stepped
+	}else if(vcpu->isbsp && (gpa >= g_vmx_lapic_base) && (gpa < (g_vmx_lapic_base + PAGE_SIZE_4K)) ){
+		xmhf_smpguest_arch_x86_eventhandler_hwpgtblviolation(vcpu, r, gpa, errorcode);
 	}else{ //no, pass it to hypapp 
 		xmhf_smpguest_arch_x86vmx_quiesce(vcpu);
 		xmhf_app_handleintercept_hwpgtblviolation(vcpu, r, gpa, gva,
@@ -361,6 +382,7 @@ static void _vmx_handle_intercept_eptviolation(VCPU *vcpu, struct regs *r){
 static void _vmx_handle_intercept_ioportaccess(VCPU *vcpu, struct regs *r){
   u32 access_size, access_type, portnum, stringio;
 	u32 app_ret_status = APP_IOINTERCEPT_CHAIN;
+	PART_LEGACYIO_SHADOW *shadow;
 	
   access_size = (u32)vcpu->vmcs.info_exit_qualification & 0x00000007UL;
 	access_type = ((u32)vcpu->vmcs.info_exit_qualification & 0x00000008UL) >> 3;
@@ -369,12 +391,30 @@ static void _vmx_handle_intercept_ioportaccess(VCPU *vcpu, struct regs *r){
 	
   HALT_ON_ERRORCOND(!stringio);	//we dont handle string IO intercepts
 
+  //accesses to filtered PCI functions through the config data port
+  //are emulated by their filter
+  app_ret_status=xmhf_baseplatform_arch_x86vmx_pcifilter_portaccess(vcpu, r, portnum,
+          access_type, access_size);
+
   //call our app handler, TODO: it should be possible for an app to
   //NOT want a callback by setting up some parameters during appmain
-	xmhf_smpguest_arch_x86vmx_quiesce(vcpu);
-	app_ret_status=xmhf_app_handleintercept_portaccess(vcpu, r, portnum, access_type, 
-          access_size);
-    xmhf_smpguest_arch_x86vmx_endquiesce(vcpu);
+  if(app_ret_status == APP_IOINTERCEPT_CHAIN){
+	shadow = xmhf_partition_legacyIO_getshadow(portnum, access_type, access_size);
+	if(shadow == NULL){
+		xmhf_smpguest_arch_x86vmx_quiesce(vcpu);
+		app_ret_status=xmhf_app_handleintercept_portaccess(vcpu, r, portnum, access_type, 
+	          access_size);
+	    xmhf_smpguest_arch_x86vmx_endquiesce(vcpu);
+	}else if(access_type == IO_TYPE_IN || portnum != shadow->trigger){
+		//shadow port writes are latched, and reads done, without a callback
+		app_ret_status=xmhf_partition_legacyIO_shadowaccess(shadow, portnum,
+			access_type, (u8)r->eax);
+	}else{
+		xmhf_smpguest_arch_x86vmx_quiesce(vcpu);
+		app_ret_status=xmhf_partition_legacyIO_shadowtrigger(vcpu, r, shadow, (u8)r->eax);
+	    xmhf_smpguest_arch_x86vmx_endquiesce(vcpu);
+	}
+  }
 
   if(app_ret_status == APP_IOINTERCEPT_CHAIN){
    	if(access_type == IO_TYPE_OUT){
@@ -550,9 +590,11 @@ u32 xmhf_parteventhub_arch_x86vmx_intercept_handler(VCPU *vcpu, struct regs *r){
 		break;
 
  		case VMX_VMEXIT_EXCEPTION:{
+			_vmx_nmi_reblock_on_iret(vcpu, vcpu->vmcs.info_vmexit_interrupt_information);
 			switch( ((u32)vcpu->vmcs.info_vmexit_interrupt_information & INTR_INFO_VECTOR_MASK) ){
 				case 0x01:
-					xmhf_smpguest_arch_x86_eventhandler_dbexception(vcpu, r);
+					if(!xmhf_baseplatform_arch_x86vmx_pcifilter_dbexception(vcpu, r))
+						xmhf_smpguest_arch_x86_eventhandler_dbexception(vcpu, r);
 					break;				
 				
 				case 0x02:	//NMI
@@ -652,6 +694,11 @@ u32 xmhf_parteventhub_arch_x86vmx_intercept_handler(VCPU *vcpu, struct regs *r){
 		}
 		break;
 
+		case VMX_VMEXIT_NMI_WINDOW:{
+			//the guest can take an NMI; the queued one is injected below
+		}
+		break;
+
     
 		default:{
 			printf("\nCPU(0x%02x): Unhandled intercept: 0x%08x", vcpu->id, (u32)vcpu->vmcs.info_vmexit_reason);
@@ -671,11 +718,17 @@ u32 xmhf_parteventhub_arch_x86vmx_intercept_handler(VCPU *vcpu, struct regs *r){
 	} //end switch((u32)vcpu->vmcs.info_vmexit_reason)
 	
 
- 	//check and clear guest interruptibility state
-	if(vcpu->vmcs.guest_interruptibility != 0){
+ 	//check and clear guest interruptibility state. virtual-NMI blocking
+	//is kept, it tells us whether the guest is still handling an NMI
+	if(vcpu->vmx_guest_vnmi){
+		vcpu->vmcs.guest_interruptibility &= GUEST_INTR_STATE_NMI;
+	}else if(vcpu->vmcs.guest_interruptibility != 0){
 		vcpu->vmcs.guest_interruptibility = 0;
 	}
 
+	//inject NMIs queued for the guest
+	xmhf_smpguest_arch_x86vmx_injectnmi(vcpu);
+
 	//make sure we have no nested events
 	if(vcpu->vmcs.info_IDT_vectoring_information & 0x80000000){
 		printf("\nCPU(0x%02x): HALT; Nested events unhandled with hwp:0x%08x",
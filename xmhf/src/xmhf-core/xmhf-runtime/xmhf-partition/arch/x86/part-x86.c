@@ -96,3 +96,102 @@ void xmhf_partition_arch_legacyIO_setprot(VCPU *vcpu, u32 port, u32 size, u32 pr
 	}
 	
 }
+
+//shadow port groups set up by the hypapp
+static PART_LEGACYIO_SHADOW *g_legacyio_shadows[PART_LEGACYIO_SHADOW_MAXGROUPS];
+static u32 g_legacyio_shadows_count=0;
+
+//set up a shadow port group and intercept its ports
+u32 xmhf_partition_arch_legacyIO_setshadow(VCPU *vcpu, PART_LEGACYIO_SHADOW *shadow){
+	u32 i;
+
+	if(g_legacyio_shadows_count >= PART_LEGACYIO_SHADOW_MAXGROUPS ||
+		shadow->numports > PART_LEGACYIO_SHADOW_MAXPORTS || shadow->handler == NULL){
+		printf("\n%s: cannot set up shadow ports for trigger 0x%04x", __FUNCTION__,
+			shadow->trigger);
+		return 0;
+	}
+
+	//the latched values are 0 until the guest has written the ports
+	memset(shadow->values, 0, sizeof(shadow->values));
+	shadow->latched = shadow->triggered = 0;
+
+	for(i=0; i < shadow->numports; i++)
+		xmhf_partition_arch_legacyIO_setprot(vcpu, shadow->ports[i],
+			PART_LEGACYIO_PORTSIZE_BYTE, PART_LEGACYIO_NOACCESS);
+	xmhf_partition_arch_legacyIO_setprot(vcpu, shadow->trigger,
+		PART_LEGACYIO_PORTSIZE_BYTE, PART_LEGACYIO_NOACCESS);
+
+	g_legacyio_shadows[g_legacyio_shadows_count++] = shadow;
+	return 1;
+}
+
+//the shadow port group an intercepted byte access belongs to, if any
+PART_LEGACYIO_SHADOW *xmhf_partition_arch_legacyIO_getshadow(u32 portnum,
+	u32 access_type, u32 access_size){
+	PART_LEGACYIO_SHADOW *shadow;
+	u32 i, j;
+
+	(void)access_type;
+
+	//wider accesses go to the hypapp as usual
+	if(access_size != IO_SIZE_BYTE)
+		return NULL;
+
+	for(i=0; i < g_legacyio_shadows_count; i++){
+		shadow = g_legacyio_shadows[i];
+		if(portnum == shadow->trigger)
+			return shadow;
+		for(j=0; j < shadow->numports; j++){
+			if(portnum == shadow->ports[j])
+				return shadow;
+		}
+	}
+
+	return NULL;
+}
+
+//latch a guest write to a shadow port and pass it on to the device;
+//reads are left to the caller.
+//this runs without quiescing, so writes from different cores may
+//interleave; that only garbles what the guest itself asked for, and
+//the trigger handler sees and writes out a consistent copy
+u32 xmhf_partition_arch_legacyIO_shadowaccess(PART_LEGACYIO_SHADOW *shadow,
+	u32 portnum, u32 access_type, u8 value){
+	u32 i, d;
+
+	if(access_type == IO_TYPE_IN)
+		return APP_IOINTERCEPT_CHAIN;
+
+	for(i=0; i < shadow->numports; i++){
+		if(shadow->ports[i] == portnum){
+			for(d=0; d < PART_LEGACYIO_SHADOW_DEPTH - 1; d++)
+				shadow->values[i][d] = shadow->values[i][d+1];
+			shadow->values[i][PART_LEGACYIO_SHADOW_DEPTH - 1] = value;
+			break;
+		}
+	}
+
+	outb(value, portnum);
+	shadow->latched++;
+	return APP_IOINTERCEPT_SKIP;
+}
+
+//hand a guest write to a trigger port to its group's handler, and write
+//the latched values out to the device before the trigger
+u32 xmhf_partition_arch_legacyIO_shadowtrigger(VCPU *vcpu, struct regs *r,
+	PART_LEGACYIO_SHADOW *shadow, u8 value){
+	u32 status, i, d;
+
+	shadow->triggered++;
+	status = shadow->handler(vcpu, r, shadow, value);
+	if(status != APP_IOINTERCEPT_CHAIN)
+		return status;
+
+	for(d=0; d < PART_LEGACYIO_SHADOW_DEPTH; d++){
+		for(i=0; i < shadow->numports; i++)
+			outb(shadow->values[i][d], shadow->ports[i]);
+	}
+
+	return APP_IOINTERCEPT_CHAIN;
+}
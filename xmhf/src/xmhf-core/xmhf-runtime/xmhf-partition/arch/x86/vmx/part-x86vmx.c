@@ -308,6 +308,16 @@ void vmx_initunrestrictedguestVMCS(VCPU *vcpu){
 	vcpu->vmcs.control_IO_BitmapB_address_high = 0;
 	vcpu->vmcs.control_VMX_cpu_based |= (1 << 25); //enable use IO Bitmaps
 
+	//MSR bitmap support; all MSRs are intercepted as without bitmaps,
+	//except for the x2APIC registers which the guest accesses directly
+	//(see xmhf_smpguest_arch_x86vmx_initialize for the ICR)
+	memset((void *)vcpu->vmx_vaddr_msrbitmaps, 0xFF, PAGE_SIZE_4K);
+	memset((void *)(vcpu->vmx_vaddr_msrbitmaps + (MSR_X2APIC_ICR & ~0xFFUL)/8), 0, 0x100/8);		//reads
+	memset((void *)(vcpu->vmx_vaddr_msrbitmaps + 2048 + (MSR_X2APIC_ICR & ~0xFFUL)/8), 0, 0x100/8);	//writes
+	vcpu->vmcs.control_MSR_Bitmaps_address_full = (u32)hva2spa((void*)vcpu->vmx_vaddr_msrbitmaps);
+	vcpu->vmcs.control_MSR_Bitmaps_address_high = 0;
+	vcpu->vmcs.control_VMX_cpu_based |= (1 << 28); //enable use MSR Bitmaps
+
 	//Critical MSR load/store
 	{
 		u32 i;
@@ -430,7 +440,19 @@ void vmx_initunrestrictedguestVMCS(VCPU *vcpu){
 	vcpu->vmcs.guest_VMCS_link_pointer_high = (u32)0xFFFFFFFFUL;
 	
 	//setup NMI intercept for core-quiescing
-	vcpu->vmcs.control_VMX_pin_based |= (1 << 3);	//intercept NMIs
+	vcpu->vmcs.control_VMX_pin_based |= VMX_PINBASED_NMI_EXITING;	//intercept NMIs
+
+	//use virtual NMIs where the CPU allows them together with NMI-window
+	//exiting, so that NMIs we inject are blocked and unblocked by the
+	//guest as real ones would be, and further NMIs wait for the guest
+	//to be ready for them rather than being dropped
+	vcpu->vmx_guest_vnmi = 0;
+	vcpu->vmx_guest_nmi_pending = 0;
+	if( ((u32)(vcpu->vmx_msrs[INDEX_IA32_VMX_PINBASED_CTLS_MSR] >> 32) & VMX_PINBASED_VIRTUAL_NMIS) &&
+		((u32)(vcpu->vmx_msrs[INDEX_IA32_VMX_PROCBASED_CTLS_MSR] >> 32) & VMX_PROCBASED_NMI_WINDOW_EXITING) ){
+		vcpu->vmcs.control_VMX_pin_based |= VMX_PINBASED_VIRTUAL_NMIS;
+		vcpu->vmx_guest_vnmi = 1;
+	}
 	
 	//trap access to CR0 fixed 1-bits
 	vcpu->vmcs.control_CR0_mask = vcpu->vmx_msrs[INDEX_IA32_VMX_CR0_FIXED0_MSR];
@@ -575,3 +597,16 @@ void xmhf_partition_arch_x86vmx_legacyIO_setprot(VCPU *vcpu, u32 port, u32 size,
 		}
 	}
 }
+
+//---set MSR write interception------------------------------------------
+//only MSRs the bitmap covers (0-0x1FFF) can be let through to the guest
+void xmhf_partition_arch_x86vmx_msrwrite_setprot(VCPU *vcpu, u32 msr, u32 intercept){
+	u8 *bit_vector = (u8 *)vcpu->vmx_vaddr_msrbitmaps + 2048;	//write bitmap for low MSRs
+
+	HALT_ON_ERRORCOND(msr < 0x2000);
+
+	if(intercept)
+		bit_vector[msr / 8] |= (1 << (msr % 8));
+	else
+		bit_vector[msr / 8] &= ~(1 << (msr % 8));
+}
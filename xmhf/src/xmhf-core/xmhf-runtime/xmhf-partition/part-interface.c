@@ -70,3 +70,26 @@ void xmhf_partition_start(VCPU *vcpu){
 void xmhf_partition_legacyIO_setprot(VCPU *vcpu, u32 port, u32 size, u32 prottype){
 	xmhf_partition_arch_legacyIO_setprot(vcpu, port, size, prottype);
 }
+
+//set up a shadow port group
+u32 xmhf_partition_legacyIO_setshadow(VCPU *vcpu, PART_LEGACYIO_SHADOW *shadow){
+	return xmhf_partition_arch_legacyIO_setshadow(vcpu, shadow);
+}
+
+//the shadow port group an intercepted access belongs to
+PART_LEGACYIO_SHADOW *xmhf_partition_legacyIO_getshadow(u32 portnum,
+	u32 access_type, u32 access_size){
+	return xmhf_partition_arch_legacyIO_getshadow(portnum, access_type, access_size);
+}
+
+//handle a guest access to a port of a shadow port group
+u32 xmhf_partition_legacyIO_shadowaccess(PART_LEGACYIO_SHADOW *shadow,
+	u32 portnum, u32 access_type, u8 value){
+	return xmhf_partition_arch_legacyIO_shadowaccess(shadow, portnum, access_type, value);
+}
+
+//hand a guest write to a trigger port to its group's handler
+u32 xmhf_partition_legacyIO_shadowtrigger(VCPU *vcpu, struct regs *r,
+	PART_LEGACYIO_SHADOW *shadow, u8 value){
+	return xmhf_partition_arch_legacyIO_shadowtrigger(vcpu, r, shadow, value);
+}
@@ -70,7 +70,8 @@ void xmhf_smpguest_arch_initialize(VCPU *vcpu){
 	}else{ //we are an AP, so just wait for SIPI signal
 			printf("\nCPU(0x%02x): AP, waiting for SIPI signal...", vcpu->id);
 			#ifndef __XMHF_VERIFICATION__
-			while(!vcpu->sipireceived);
+			while(!*(volatile u32 *)&vcpu->sipireceived)
+				cpu_relax();
 			#endif
 			printf("\nCPU(0x%02x): SIPI signal received, vector=0x%02x", vcpu->id, vcpu->sipivector);
 	
@@ -106,12 +107,12 @@ void xmhf_smpguest_arch_x86_eventhandler_dbexception(VCPU *vcpu,
 }
 
 //handle LAPIC access #NPF (nested page fault) event
-void xmhf_smpguest_arch_x86_eventhandler_hwpgtblviolation(VCPU *vcpu, u32 gpa, u32 errorcode){
+void xmhf_smpguest_arch_x86_eventhandler_hwpgtblviolation(VCPU *vcpu, struct regs *r, u32 gpa, u32 errorcode){
 	HALT_ON_ERRORCOND(vcpu->cpu_vendor == CPU_VENDOR_AMD || vcpu->cpu_vendor == CPU_VENDOR_INTEL);
 	if(vcpu->cpu_vendor == CPU_VENDOR_AMD){ 
-		xmhf_smpguest_arch_x86svm_eventhandler_hwpgtblviolation(vcpu, gpa, errorcode);
+		xmhf_smpguest_arch_x86svm_eventhandler_hwpgtblviolation(vcpu, r, gpa, errorcode);
 	}else{	//CPU_VENDOR_INTEL
-		xmhf_smpguest_arch_x86vmx_eventhandler_hwpgtblviolation(vcpu, gpa, errorcode);
+		xmhf_smpguest_arch_x86vmx_eventhandler_hwpgtblviolation(vcpu, r, gpa, errorcode);
 	}	
 	
 }
@@ -79,6 +79,10 @@ u32 g_svm_quiesce __attribute__(( section(".data") )) = 0;;
 //SMP lock to access the above variable
 //smpguest x86svm
 u32 g_svm_lock_quiesce __attribute__(( section(".data") )) = 1; 
+
+//statistics for the above lock
+//smpguest x86svm
+SPINLOCK_STATS g_svm_lock_quiesce_stats __attribute__(( section(".data") )) = SPINLOCK_STATS_INITIALIZER("svm_quiesce");
     
 //resume signal, becomes 1 to signal resume after quiescing
 //smpguest x86svm
@@ -176,6 +176,8 @@ void xmhf_smpguest_arch_x86svm_initialize(VCPU *vcpu){
   
   //unmap LAPIC page
   svm_lapic_changemapping(vcpu, g_svm_lapic_base, g_svm_lapic_base, SVM_LAPIC_UNMAP);
+
+  xmhf_baseplatform_spinlock_stats_register(&g_svm_lock_quiesce_stats);
 }
 
 
@@ -187,8 +189,10 @@ void xmhf_smpguest_arch_x86svm_initialize(VCPU *vcpu){
 //----------------------------------------------------------------------
 //xmhf_smpguest_arch_x86svm_eventhandler_hwpgtblviolation
 //handle LAPIC accesses by the guest, used for SMP guest boot
-u32 xmhf_smpguest_arch_x86svm_eventhandler_hwpgtblviolation(VCPU *vcpu, u32 paddr, u32 errorcode){
+u32 xmhf_smpguest_arch_x86svm_eventhandler_hwpgtblviolation(VCPU *vcpu, struct regs *r, u32 paddr, u32 errorcode){
   struct _svm_vmcbfields *vmcb = (struct _svm_vmcbfields *)vcpu->vmcb_vaddr_ptr;
+
+  (void)r;
   
   //get LAPIC register being accessed
   g_svm_lapic_reg = (paddr - g_svm_lapic_base);
@@ -422,13 +426,32 @@ static void _svm_send_quiesce_signal(VCPU __attribute__((unused)) *vcpu, struct
 }
 
 
+//quiesce rounds that take longer than this are reported
+#define SVM_QUIESCE_WARN_USECS		1000000
+
+//wait for the other cores to bump *counter up to target, reporting it
+//(once) if they are slow to
+static void svm_quiesce_wait(volatile u32 *counter, u32 target, char *what){
+	u64 deadline = xmhf_baseplatform_arch_x86_deadline(SVM_QUIESCE_WARN_USECS);
+	bool warned = false;
+
+	while(*counter < target){
+		if(!warned && xmhf_baseplatform_arch_x86_deadline_passed(deadline)){
+			printf("\n%s: only %u of %u CPUs %s after %ums, still waiting",
+				__FUNCTION__, *counter, target, what, SVM_QUIESCE_WARN_USECS/1000);
+			warned = true;
+		}
+		cpu_relax();
+	}
+}
+
 //quiesce interface to switch all guest cores into hypervisor mode
 void xmhf_smpguest_arch_x86svm_quiesce(VCPU *vcpu){
 	struct _svm_vmcbfields *vmcb = (struct _svm_vmcbfields *)vcpu->vmcb_vaddr_ptr;
         
 	//printf("\nCPU(0x%02x): got quiesce signal...", vcpu->id);
     //grab hold of quiesce lock
-    spin_lock(&g_svm_lock_quiesce);
+    spin_lock_stat(&g_svm_lock_quiesce, &g_svm_lock_quiesce_stats);
     //printf("\nCPU(0x%02x): grabbed quiesce lock.", vcpu->id);
 
 	vcpu->quiesced = 1;
@@ -443,7 +466,7 @@ void xmhf_smpguest_arch_x86svm_quiesce(VCPU *vcpu){
         
     //wait for all the remaining CPUs to quiesce
     //printf("\nCPU(0x%02x): waiting for other CPUs to respond...", vcpu->id);
-    while(g_svm_quiesce_counter < (g_midtable_numentries-1) );
+    svm_quiesce_wait(&g_svm_quiesce_counter, g_midtable_numentries-1, "quiesced");
     //printf("\nCPU(0x%02x): all CPUs quiesced successfully.", vcpu->id);
 }
 
@@ -456,7 +479,7 @@ void xmhf_smpguest_arch_x86svm_endquiesce(VCPU __attribute__((unused)) *vcpu){
         //printf("\nCPU(0x%02x): waiting for other CPUs to resume...", vcpu->id);
         g_svm_quiesce_resume_signal=1;
         
-        while(g_svm_quiesce_resume_counter < (g_midtable_numentries-1) );
+        svm_quiesce_wait(&g_svm_quiesce_resume_counter, g_midtable_numentries-1, "resumed");
 
 		vcpu->quiesced = 0;
         g_svm_quiesce=0;  // we are out of quiesce at this point
@@ -471,7 +494,7 @@ void xmhf_smpguest_arch_x86svm_endquiesce(VCPU __attribute__((unused)) *vcpu){
                 
         //release quiesce lock
         //printf("\nCPU(0x%02x): releasing quiesce lock.", vcpu->id);
-        spin_unlock(&g_svm_lock_quiesce);
+        spin_unlock_stat(&g_svm_lock_quiesce, &g_svm_lock_quiesce_stats);
 }
 
 //quiescing handler for #NMI (non-maskable interrupt) exception event
@@ -507,7 +530,8 @@ void xmhf_smpguest_arch_x86svm_eventhandler_nmiexception(VCPU *vcpu, struct regs
     g_svm_quiesce_counter++;
     spin_unlock(&g_svm_lock_quiesce_counter);
     
-    while(!g_svm_quiesce_resume_signal);
+    while(!*(volatile u32 *)&g_svm_quiesce_resume_signal)
+      cpu_relax();
     //printf("\nCPU(0x%02x): EOQ received, resuming...", vcpu->id);
     
     spin_lock(&g_svm_lock_quiesce_resume_counter);
@@ -85,6 +85,10 @@ u32 g_vmx_quiesce __attribute__(( section(".data") )) = 0;;
 //SMP lock to access the above variable
 //smpguest x86vmx
 u32 g_vmx_lock_quiesce __attribute__(( section(".data") )) = 1; 
+
+//statistics for the above lock
+//smpguest x86vmx
+SPINLOCK_STATS g_vmx_lock_quiesce_stats __attribute__(( section(".data") )) = SPINLOCK_STATS_INITIALIZER("vmx_quiesce");
     
 //resume signal, becomes 1 to signal resume after quiescing
 //smpguest x86vmx
@@ -49,15 +49,6 @@
 // author: amit vasudevan (amitvasudevan@acm.org)
 #include <xmhf.h> 
 
-//the LAPIC register that is being accessed during emulation
-static u32 g_vmx_lapic_reg __attribute__(( section(".data") )) = 0;
-
-//the LAPIC operation that is being performed during emulation
-static u32 g_vmx_lapic_op __attribute__(( section(".data") )) = LAPIC_OP_RSVD;
-
-//guest TF and IF bit values during LAPIC emulation
-static u32 g_vmx_lapic_guest_eflags_tfifmask __attribute__(( section(".data") )) = 0;	 
-
 //----------------------------------------------------------------------
 //vmx_lapic_changemapping
 //change LAPIC mappings to handle SMP guest bootup
@@ -105,16 +96,14 @@ static u32 have_all_cores_recievedSIPI(void){
 //---SIPI processing logic------------------------------------------------------
 //return 1 if lapic interception has to be discontinued, typically after
 //all aps have received their SIPI, else 0
-static u32 processSIPI(VCPU *vcpu, u32 icr_low_value, u32 icr_high_value){
-  //we assume that destination is always physical and 
-  //specified via top 8 bits of icr_high_value
-  u32 dest_lapic_id;
+//we assume that destination is always physical, dest_lapic_id is
+//taken from the top 8 bits of ICR high (xAPIC) or bits 63:32 of the
+//ICR (x2APIC)
+static u32 processSIPI(VCPU *vcpu, u32 icr_low_value, u32 dest_lapic_id){
   VCPU *dest_vcpu = (VCPU *)0;
   
   HALT_ON_ERRORCOND( (icr_low_value & 0x000C0000) == 0x0 );
   
-  dest_lapic_id= icr_high_value >> 24;
-  
   printf("\nCPU(0x%02x): %s, dest_lapic_id is 0x%02x", 
 		vcpu->id, __FUNCTION__, dest_lapic_id);
   
@@ -170,6 +159,12 @@ void xmhf_smpguest_arch_x86vmx_initialize(VCPU *vcpu){
   
   //unmap LAPIC page
   vmx_lapic_changemapping(vcpu, g_vmx_lapic_base, g_vmx_lapic_base, VMX_LAPIC_UNMAP);
+
+  //and intercept ICR writes for guests which put the LAPIC in x2APIC
+  //mode, where it is accessed through MSRs instead
+  xmhf_partition_arch_x86vmx_msrwrite_setprot(vcpu, MSR_X2APIC_ICR, 1);
+
+  xmhf_baseplatform_spinlock_stats_register(&g_vmx_lock_quiesce_stats);
 }
 //----------------------------------------------------------------------
 
@@ -177,6 +172,272 @@ void xmhf_smpguest_arch_x86vmx_initialize(VCPU *vcpu){
 
 
 
+#ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
+	bool g_vmx_lapic_db_verification_coreprotected = false;
+	bool g_vmx_lapic_db_verification_pre = false;
+#endif
+
+//----------------------------------------------------------------------
+//LAPIC access emulation
+
+//stop intercepting LAPIC accesses, once all cores have their SIPI
+static void vmx_lapic_delink(VCPU *vcpu){
+	vmx_lapic_changemapping(vcpu, g_vmx_lapic_base, g_vmx_lapic_base, VMX_LAPIC_MAP);
+	xmhf_partition_arch_x86vmx_msrwrite_setprot(vcpu, MSR_X2APIC_ICR, 0);
+}
+
+//perform a guest write to a LAPIC register. INIT IPIs are voided and
+//SIPIs passed on to the core waiting for them, everything else goes
+//to the physical LAPIC. returns 1 if LAPIC interception has to be
+//discontinued
+static u32 vmx_lapic_write(VCPU *vcpu, u32 reg, u32 value_tobe_written){
+  u32 delink_lapic_interception=0;
+  u32 dst_registeraddress = (u32)g_vmx_lapic_base + reg;
+
+  #ifndef __XMHF_VERIFICATION__
+  //the guest reads back the ICR from the virtual LAPIC page
+  if(reg == LAPIC_ICR_LOW || reg == LAPIC_ICR_HIGH)
+    *((u32 *)((u32)&g_vmx_virtual_LAPIC_base + reg)) = value_tobe_written;
+  #endif
+
+    if(reg == LAPIC_ICR_LOW){
+      if ( (value_tobe_written & 0x00000F00) == 0x500){
+        //this is an INIT IPI, we just void it
+        printf("\n0x%04x:0x%08x -> (ICR=0x%08x write) INIT IPI detected and skipped, value=0x%08x", 
+          (u16)vcpu->vmcs.guest_CS_selector, (u32)vcpu->vmcs.guest_RIP, reg, value_tobe_written);
+        #ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
+			g_vmx_lapic_db_verification_coreprotected = true;
+		#endif
+
+      }else if( (value_tobe_written & 0x00000F00) == 0x600 ){
+        //this is a STARTUP IPI
+        u32 icr_value_high = *((u32 *)((u32)&g_vmx_virtual_LAPIC_base + (u32)LAPIC_ICR_HIGH));
+        printf("\n0x%04x:0x%08x -> (ICR=0x%08x write) STARTUP IPI detected, value=0x%08x", 
+          (u16)vcpu->vmcs.guest_CS_selector, (u32)vcpu->vmcs.guest_RIP, reg, value_tobe_written);        
+		
+		#ifdef __XMHF_VERIFICATION__
+			(void)icr_value_high;
+			#ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
+			g_vmx_lapic_db_verification_coreprotected = true;
+			#endif
+		#else
+			delink_lapic_interception=processSIPI(vcpu, value_tobe_written, icr_value_high >> 24);
+		#endif
+      }else{
+        #ifndef __XMHF_VERIFICATION__
+			//neither an INIT or SIPI, just propagate this IPI to physical LAPIC
+			*((u32 *)dst_registeraddress) = value_tobe_written;
+		#endif //TODO: hardware modeling
+      }
+    }else{
+       #ifndef __XMHF_VERIFICATION__
+			*((u32 *)dst_registeraddress) = value_tobe_written;
+	   #endif  //TODO: hardware modeling
+    }
+
+  return delink_lapic_interception;
+}
+
+#ifndef __XMHF_VERIFICATION__
+//translate a guest linear address, for the paging modes the guest can
+//be in. returns 0xFFFFFFFF if it is not mapped below 4GB
+static u32 vmx_lapic_guestpaddr(VCPU *vcpu, u64 vaddr){
+	u64 entry, paddr;
+	u32 shift;
+
+	if( !((u32)vcpu->vmcs.guest_CR0 & CR0_PG) )
+		return (u32)vaddr;
+
+	if( !(vcpu->vmcs.control_VM_entry_controls & VMX_ENTRY_IA32E_MODE_GUEST) )
+		return (u32)xmhf_smpguest_arch_x86vmx_walk_pagetables(vcpu, (u32)vaddr);
+
+	//4-level paging; stop at the first large page
+	entry = (u64)vcpu->vmcs.guest_CR3;
+	for(shift=39; ; shift -= 9){
+		u64 table = entry & 0x000FFFFFFFFFF000ULL;
+
+		if(table >> 32)
+			return 0xFFFFFFFF;
+		entry = ((u64 *)(u32)table)[(u32)(vaddr >> shift) & 0x1FF];
+		if( !(entry & _PAGE_PRESENT) )
+			return 0xFFFFFFFF;
+		if(shift == 12 || (shift < 39 && (entry & _PAGE_PSE)))
+			break;
+	}
+
+	paddr = (entry & 0x000FFFFFFFFFF000ULL & ~((1ULL << shift) - 1)) |
+		(vaddr & ((1ULL << shift) - 1));
+	if(paddr >> 32)
+		return 0xFFFFFFFF;
+	return (u32)paddr;
+}
+
+//fetch len bytes of the guest instruction at CS:RIP
+static bool vmx_lapic_fetchinsn(VCPU *vcpu, u8 *buf, u32 len){
+	u64 va = (u64)vcpu->vmcs.guest_CS_base + (u64)vcpu->vmcs.guest_RIP;
+	u32 pa = 0;
+	u32 i;
+
+	for(i=0; i < len; i++, va++, pa++){
+		if(i == 0 || (va & (PAGE_SIZE_4K - 1)) == 0){
+			pa = vmx_lapic_guestpaddr(vcpu, va);
+			if(pa == 0xFFFFFFFF)
+				return false;
+		}
+		buf[i] = *(u8 *)pa;
+	}
+	return true;
+}
+
+//decode a MOV between a register (or an immediate) and the LAPIC page,
+//which is how guests access LAPIC registers: 89 /r (store), 8B /r
+//(load) and C7 /0 (store immediate), with 32-bit operands. returns the
+//instruction length, or 0 for anything else
+static u32 vmx_lapic_decode(VCPU *vcpu, u32 *opcode, u32 *gpr, u32 *imm){
+	u8 insn[15];
+	u32 i=0, mod, rm;
+	bool longmode = (vcpu->vmcs.control_VM_entry_controls & VMX_ENTRY_IA32E_MODE_GUEST) &&
+		(vcpu->vmcs.guest_CS_access_rights & (1UL << 13));	//CS.L
+
+	//outside of 64-bit mode, only 32-bit code (CS.D)
+	if(!longmode && !(vcpu->vmcs.guest_CS_access_rights & (1UL << 14)))
+		return 0;
+
+	if(!vmx_lapic_fetchinsn(vcpu, insn, sizeof(insn)))
+		return 0;
+
+	//in 64-bit mode a REX prefix may extend the address registers, but
+	//must not change the operand size (W) or the register operand (R)
+	if(longmode && (insn[i] & 0xF0) == 0x40){
+		if(insn[i] & 0x0C)
+			return 0;
+		i++;
+	}
+
+	*opcode = insn[i++];
+	if(*opcode != 0x89 && *opcode != 0x8B && *opcode != 0xC7)
+		return 0;
+
+	mod = insn[i] >> 6;
+	*gpr = (insn[i] >> 3) & 0x7;
+	rm = insn[i] & 0x7;
+	i++;
+	if(mod == 3 || (*opcode == 0xC7 && *gpr != 0))
+		return 0;
+
+	//SIB byte and displacement
+	if(rm == 4){
+		if(mod == 0 && (insn[i] & 0x7) == 5)
+			i += 4;
+		i++;
+	}
+	if(mod == 1)
+		i += 1;
+	else if(mod == 2 || (mod == 0 && rm == 5))
+		i += 4;
+
+	if(*opcode == 0xC7){
+		*imm = *(u32 *)&insn[i];
+		i += 4;
+	}
+
+	return i;
+}
+
+//read and write the low 32 bits of a guest general purpose register,
+//by its ModRM encoding
+static u32 vmx_lapic_getgpr(VCPU *vcpu, struct regs *r, u32 gpr){
+	switch(gpr){
+		case 0: return r->eax;
+		case 1: return r->ecx;
+		case 2: return r->edx;
+		case 3: return r->ebx;
+		case 4: return (u32)vcpu->vmcs.guest_RSP;
+		case 5: return r->ebp;
+		case 6: return r->esi;
+		default: return r->edi;
+	}
+}
+
+static void vmx_lapic_setgpr(VCPU *vcpu, struct regs *r, u32 gpr, u32 value){
+	switch(gpr){
+		case 0: r->eax = value; break;
+		case 1: r->ecx = value; break;
+		case 2: r->edx = value; break;
+		case 3: r->ebx = value; break;
+		case 4: vcpu->vmcs.guest_RSP = value; break;
+		case 5: r->ebp = value; break;
+		case 6: r->esi = value; break;
+		default: r->edi = value; break;
+	}
+}
+
+//perform the guest's LAPIC access at CS:RIP and skip it, if it can be
+//decoded. this saves remapping the LAPIC page and single-stepping the
+//access. returns 1 if the access was performed
+static u32 vmx_lapic_emulate(VCPU *vcpu, struct regs *r, u32 reg, u32 iswrite){
+	u32 opcode, gpr, imm=0, len, value;
+
+	//a guest single-stepping itself expects its #DB after the access
+	if( (u32)vcpu->vmcs.guest_RFLAGS & EFLAGS_TF )
+		return 0;
+
+	//only whole, aligned registers
+	if(reg & 0xF)
+		return 0;
+
+	len = vmx_lapic_decode(vcpu, &opcode, &gpr, &imm);
+	if(!len || (iswrite ? (opcode == 0x8B) : (opcode != 0x8B)))
+		return 0;
+
+	if(iswrite){
+		value = (opcode == 0xC7) ? imm : vmx_lapic_getgpr(vcpu, r, gpr);
+		if(vmx_lapic_write(vcpu, reg, value)){
+			printf("\n%s: delinking LAPIC interception since all cores have SIPI", __FUNCTION__);
+			vmx_lapic_delink(vcpu);
+		}
+	}else{
+		if(reg == LAPIC_ICR_LOW || reg == LAPIC_ICR_HIGH)
+			value = *((u32 *)((u32)&g_vmx_virtual_LAPIC_base + reg));
+		else
+			value = *((volatile u32 *)((u32)g_vmx_lapic_base + reg));
+		vmx_lapic_setgpr(vcpu, r, gpr, value);
+	}
+
+	vcpu->vmcs.guest_RIP += len;
+	return 1;
+}
+#endif //__XMHF_VERIFICATION__
+
+//----------------------------------------------------------------------
+//xmhf_smpguest_arch_x86vmx_eventhandler_x2apicicrwrite
+//handle a guest write to the x2APIC ICR, intercepted on the BSP until all
+//cores have their SIPI. returns 1 if the write has been dealt with, or 0
+//if it is still to be made to the physical LAPIC
+u32 xmhf_smpguest_arch_x86vmx_eventhandler_x2apicicrwrite(VCPU *vcpu, struct regs *r){
+	if( (r->eax & 0x00000F00) == 0x500 ){
+		//this is an INIT IPI, we just void it
+		printf("\n0x%04x:0x%08x -> (x2APIC ICR write) INIT IPI detected and skipped, value=0x%08x%08x",
+			(u16)vcpu->vmcs.guest_CS_selector, (u32)vcpu->vmcs.guest_RIP, r->edx, r->eax);
+		return 1;
+	}
+
+	if( (r->eax & 0x00000F00) == 0x600 ){
+		//this is a STARTUP IPI
+		printf("\n0x%04x:0x%08x -> (x2APIC ICR write) STARTUP IPI detected, value=0x%08x%08x",
+			(u16)vcpu->vmcs.guest_CS_selector, (u32)vcpu->vmcs.guest_RIP, r->edx, r->eax);
+		if(processSIPI(vcpu, r->eax, r->edx)){
+			printf("\n%s: delinking LAPIC interception since all cores have SIPI", __FUNCTION__);
+			vmx_lapic_delink(vcpu);
+		}
+		return 1;
+	}
+
+	return 0;
+}
+//----------------------------------------------------------------------
+
+
 #ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
 	bool g_vmx_lapic_npf_verification_guesttrapping = false;
 	bool g_vmx_lapic_npf_verification_pre = false;
@@ -184,33 +445,42 @@ void xmhf_smpguest_arch_x86vmx_initialize(VCPU *vcpu){
 //----------------------------------------------------------------------
 //xmhf_smpguest_arch_x86vmx_eventhandler_hwpgtblviolation
 //handle LAPIC accesses by the guest, used for SMP guest boot
-u32 xmhf_smpguest_arch_x86vmx_eventhandler_hwpgtblviolation(VCPU *vcpu, u32 paddr, u32 errorcode){
+u32 xmhf_smpguest_arch_x86vmx_eventhandler_hwpgtblviolation(VCPU *vcpu, struct regs *r, u32 paddr, u32 errorcode){
+
+#ifndef __XMHF_VERIFICATION__
+  //perform the access right away if we can decode it, otherwise let the
+  //guest perform it on a mapped page and single-step it
+  if(vmx_lapic_emulate(vcpu, r, paddr - g_vmx_lapic_base, (errorcode & EPT_ERRORCODE_WRITE)))
+    return 0;
+#else
+  (void)r;
+#endif
 
   //get LAPIC register being accessed
-  g_vmx_lapic_reg = (paddr - g_vmx_lapic_base);
+  vcpu->vmx_lapic_reg = (paddr - g_vmx_lapic_base);
 
 #ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
   g_vmx_lapic_npf_verification_pre = (errorcode & EPT_ERRORCODE_WRITE) &&
-	((g_vmx_lapic_reg == LAPIC_ICR_LOW) || (g_vmx_lapic_reg == LAPIC_ICR_HIGH));
+	((vcpu->vmx_lapic_reg == LAPIC_ICR_LOW) || (vcpu->vmx_lapic_reg == LAPIC_ICR_HIGH));
 #endif
 
 
 	if(errorcode & EPT_ERRORCODE_WRITE){			//LAPIC write
 
-		if(g_vmx_lapic_reg == LAPIC_ICR_LOW || g_vmx_lapic_reg == LAPIC_ICR_HIGH ){
-			g_vmx_lapic_op = LAPIC_OP_WRITE;
+		if(vcpu->vmx_lapic_reg == LAPIC_ICR_LOW || vcpu->vmx_lapic_reg == LAPIC_ICR_HIGH ){
+			vcpu->vmx_lapic_op = LAPIC_OP_WRITE;
 			vmx_lapic_changemapping(vcpu, g_vmx_lapic_base, hva2spa(&g_vmx_virtual_LAPIC_base), VMX_LAPIC_MAP);
 		}else{
-			g_vmx_lapic_op = LAPIC_OP_RSVD;
+			vcpu->vmx_lapic_op = LAPIC_OP_RSVD;
 			vmx_lapic_changemapping(vcpu, g_vmx_lapic_base, g_vmx_lapic_base, VMX_LAPIC_MAP);
 		}    
 	
 	}else{											//LAPIC read
-		if(g_vmx_lapic_reg == LAPIC_ICR_LOW || g_vmx_lapic_reg == LAPIC_ICR_HIGH ){
-			g_vmx_lapic_op = LAPIC_OP_READ;
+		if(vcpu->vmx_lapic_reg == LAPIC_ICR_LOW || vcpu->vmx_lapic_reg == LAPIC_ICR_HIGH ){
+			vcpu->vmx_lapic_op = LAPIC_OP_READ;
 			vmx_lapic_changemapping(vcpu, g_vmx_lapic_base, hva2spa(&g_vmx_virtual_LAPIC_base), VMX_LAPIC_MAP);
 		}else{
-			g_vmx_lapic_op = LAPIC_OP_RSVD;
+			vcpu->vmx_lapic_op = LAPIC_OP_RSVD;
 			vmx_lapic_changemapping(vcpu, g_vmx_lapic_base, g_vmx_lapic_base, VMX_LAPIC_MAP);
 		}  
 	}
@@ -219,7 +489,7 @@ u32 xmhf_smpguest_arch_x86vmx_eventhandler_hwpgtblviolation(VCPU *vcpu, u32 padd
   vcpu->vmcs.control_exception_bitmap |= (1UL << 1); //enable INT 1 intercept (#DB fault)
   
   //save guest IF and TF masks
-  g_vmx_lapic_guest_eflags_tfifmask = (u32)vcpu->vmcs.guest_RFLAGS & ((u32)EFLAGS_IF | (u32)EFLAGS_TF);	
+  vcpu->vmx_lapic_guest_eflags_tfifmask = (u32)vcpu->vmcs.guest_RFLAGS & ((u32)EFLAGS_IF | (u32)EFLAGS_TF);	
 
   //set guest TF
   vcpu->vmcs.guest_RFLAGS |= EFLAGS_TF;
@@ -237,13 +507,13 @@ u32 xmhf_smpguest_arch_x86vmx_eventhandler_hwpgtblviolation(VCPU *vcpu, u32 padd
 #endif
 
 #ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
-  assert ( ((g_vmx_lapic_op == LAPIC_OP_RSVD) || 
-					   (g_vmx_lapic_op == LAPIC_OP_READ) ||
-					   (g_vmx_lapic_op == LAPIC_OP_WRITE))
+  assert ( ((vcpu->vmx_lapic_op == LAPIC_OP_RSVD) || 
+					   (vcpu->vmx_lapic_op == LAPIC_OP_READ) ||
+					   (vcpu->vmx_lapic_op == LAPIC_OP_WRITE))
 					 );	
 
-  assert ( ((g_vmx_lapic_reg >= 0) &&
-					   (g_vmx_lapic_reg < PAGE_SIZE_4K))
+  assert ( ((vcpu->vmx_lapic_reg >= 0) &&
+					   (vcpu->vmx_lapic_reg < PAGE_SIZE_4K))
 					 );	
 #endif
 
@@ -253,10 +523,6 @@ u32 xmhf_smpguest_arch_x86vmx_eventhandler_hwpgtblviolation(VCPU *vcpu, u32 padd
 
 
 
-#ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
-	bool g_vmx_lapic_db_verification_coreprotected = false;
-	bool g_vmx_lapic_db_verification_pre = false;
-#endif
 //------------------------------------------------------------------------------
 //xmhf_smpguest_arch_x86vmx_eventhandler_dbexception
 //handle instruction that performed the LAPIC operation
@@ -266,77 +532,40 @@ void xmhf_smpguest_arch_x86vmx_eventhandler_dbexception(VCPU *vcpu, struct regs
   (void)r;
 
 #ifdef	__XMHF_VERIFICATION_DRIVEASSERTS__
-	//this handler relies on two global symbols apart from the parameters, set them 
+	//this handler relies on two vcpu fields apart from the parameters, set them 
 	//to non-deterministic values with correct range
 	//note: LAPIC #npf handler ensures this at runtime
-	g_vmx_lapic_op = (nondet_u32() % 3) + 1;
-	g_vmx_lapic_reg = (nondet_u32() % PAGE_SIZE_4K);
+	vcpu->vmx_lapic_op = (nondet_u32() % 3) + 1;
+	vcpu->vmx_lapic_reg = (nondet_u32() % PAGE_SIZE_4K);
 #endif
 
 
-  if(g_vmx_lapic_op == LAPIC_OP_WRITE){			//LAPIC write
-    u32 src_registeraddress, dst_registeraddress;
+  if(vcpu->vmx_lapic_op == LAPIC_OP_WRITE){			//LAPIC write
     u32 value_tobe_written;
     
-    HALT_ON_ERRORCOND( (g_vmx_lapic_reg == LAPIC_ICR_LOW) || (g_vmx_lapic_reg == LAPIC_ICR_HIGH) );
+    HALT_ON_ERRORCOND( (vcpu->vmx_lapic_reg == LAPIC_ICR_LOW) || (vcpu->vmx_lapic_reg == LAPIC_ICR_HIGH) );
    
-    src_registeraddress = (u32)&g_vmx_virtual_LAPIC_base + g_vmx_lapic_reg;
-    dst_registeraddress = (u32)g_vmx_lapic_base + g_vmx_lapic_reg;
-    
 	#ifdef __XMHF_VERIFICATION__
 		//TODO: hardware modeling
 		value_tobe_written= nondet_u32();
 		#ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
-		g_vmx_lapic_db_verification_pre = (g_vmx_lapic_op == LAPIC_OP_WRITE) &&
-		(g_vmx_lapic_reg == LAPIC_ICR_LOW) &&
+		g_vmx_lapic_db_verification_pre = (vcpu->vmx_lapic_op == LAPIC_OP_WRITE) &&
+		(vcpu->vmx_lapic_reg == LAPIC_ICR_LOW) &&
 		(((value_tobe_written & 0x00000F00) == 0x500) || ( (value_tobe_written & 0x00000F00) == 0x600 ));
 		#endif
 		
 	#else
-		value_tobe_written= *((u32 *)src_registeraddress);
+		value_tobe_written= *((u32 *)((u32)&g_vmx_virtual_LAPIC_base + vcpu->vmx_lapic_reg));
 	#endif
 
-    
-    if(g_vmx_lapic_reg == LAPIC_ICR_LOW){
-      if ( (value_tobe_written & 0x00000F00) == 0x500){
-        //this is an INIT IPI, we just void it
-        printf("\n0x%04x:0x%08x -> (ICR=0x%08x write) INIT IPI detected and skipped, value=0x%08x", 
-          (u16)vcpu->vmcs.guest_CS_selector, (u32)vcpu->vmcs.guest_RIP, g_vmx_lapic_reg, value_tobe_written);
-        #ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
-			g_vmx_lapic_db_verification_coreprotected = true;
-		#endif
-
-      }else if( (value_tobe_written & 0x00000F00) == 0x600 ){
-        //this is a STARTUP IPI
-        u32 icr_value_high = *((u32 *)((u32)&g_vmx_virtual_LAPIC_base + (u32)LAPIC_ICR_HIGH));
-        printf("\n0x%04x:0x%08x -> (ICR=0x%08x write) STARTUP IPI detected, value=0x%08x", 
-          (u16)vcpu->vmcs.guest_CS_selector, (u32)vcpu->vmcs.guest_RIP, g_vmx_lapic_reg, value_tobe_written);        
-		
-		#ifdef __XMHF_VERIFICATION__
-			#ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
-			g_vmx_lapic_db_verification_coreprotected = true;
-			#endif
-		#else
-			delink_lapic_interception=processSIPI(vcpu, value_tobe_written, icr_value_high);
-		#endif
-      }else{
-        #ifndef __XMHF_VERIFICATION__
-			//neither an INIT or SIPI, just propagate this IPI to physical LAPIC
-			*((u32 *)dst_registeraddress) = value_tobe_written;
-		#endif //TODO: hardware modeling
-      }
-    }else{
-       #ifndef __XMHF_VERIFICATION__
-			*((u32 *)dst_registeraddress) = value_tobe_written;
-	   #endif  //TODO: hardware modeling
-    }
+    delink_lapic_interception = vmx_lapic_write(vcpu, vcpu->vmx_lapic_reg, value_tobe_written);
                 
-  }else if( g_vmx_lapic_op == LAPIC_OP_READ){		//LAPIC read
+  }else if( vcpu->vmx_lapic_op == LAPIC_OP_READ){		//LAPIC read
     u32 src_registeraddress;
     u32 value_read __attribute__((unused));
-    HALT_ON_ERRORCOND( (g_vmx_lapic_reg == LAPIC_ICR_LOW) || (g_vmx_lapic_reg == LAPIC_ICR_HIGH) );
+    HALT_ON_ERRORCOND( (vcpu->vmx_lapic_reg == LAPIC_ICR_LOW) || (vcpu->vmx_lapic_reg == LAPIC_ICR_HIGH) );
 
-    src_registeraddress = (u32)&g_vmx_virtual_LAPIC_base + g_vmx_lapic_reg;
+    src_registeraddress = (u32)&g_vmx_virtual_LAPIC_base + vcpu->vmx_lapic_reg;
    
     //TODO: hardware modeling
     #ifndef __XMHF_VERIFICATION__
@@ -352,7 +581,7 @@ void xmhf_smpguest_arch_x86vmx_eventhandler_dbexception(VCPU *vcpu, struct regs
   //remove LAPIC interception if all cores have booted up
   if(delink_lapic_interception){
     printf("\n%s: delinking LAPIC interception since all cores have SIPI", __FUNCTION__);
-	vmx_lapic_changemapping(vcpu, g_vmx_lapic_base, g_vmx_lapic_base, VMX_LAPIC_MAP);
+	vmx_lapic_delink(vcpu);
   }else{
 	vmx_lapic_changemapping(vcpu, g_vmx_lapic_base, g_vmx_lapic_base, VMX_LAPIC_UNMAP);
   }
@@ -360,7 +589,7 @@ void xmhf_smpguest_arch_x86vmx_eventhandler_dbexception(VCPU *vcpu, struct regs
   //restore guest IF and TF
   vcpu->vmcs.guest_RFLAGS &= ~(EFLAGS_IF);
   vcpu->vmcs.guest_RFLAGS &= ~(EFLAGS_TF);
-  vcpu->vmcs.guest_RFLAGS |= g_vmx_lapic_guest_eflags_tfifmask;
+  vcpu->vmcs.guest_RFLAGS |= vcpu->vmx_lapic_guest_eflags_tfifmask;
 
 #ifdef __XMHF_VERIFICATION_DRIVEASSERTS__
   assert(!g_vmx_lapic_db_verification_pre || g_vmx_lapic_db_verification_coreprotected);
@@ -380,6 +609,15 @@ static void _vmx_send_quiesce_signal(VCPU __attribute__((unused)) *vcpu){
   u32 icr_high_value= 0xFFUL << 24;
   u32 prev_icr_high_value;
   u32 delivered;
+  u32 eax, edx;
+
+  //the guest may have put the LAPIC in x2APIC mode, where the ICR is
+  //only reachable as an MSR and there is no delivery status to wait on
+  rdmsr(MSR_APIC_BASE, &eax, &edx);
+  if(eax & MSR_APIC_BASE_X2APIC){
+	wrmsr(MSR_X2APIC_ICR, 0x000C0400UL, 0);	//send NMI to all but self
+	return;
+  }
   
   prev_icr_high_value = *icr_high;
   
@@ -405,13 +643,32 @@ static void _vmx_send_quiesce_signal(VCPU __attribute__((unused)) *vcpu){
 }
 
 
+//quiesce rounds that take longer than this are reported
+#define VMX_QUIESCE_WARN_USECS		1000000
+
+//wait for the other cores to bump *counter up to target, reporting it
+//(once) if they are slow to
+static void vmx_quiesce_wait(volatile u32 *counter, u32 target, char *what){
+	u64 deadline = xmhf_baseplatform_arch_x86_deadline(VMX_QUIESCE_WARN_USECS);
+	bool warned = false;
+
+	while(*counter < target){
+		if(!warned && xmhf_baseplatform_arch_x86_deadline_passed(deadline)){
+			printf("\n%s: only %u of %u CPUs %s after %ums, still waiting",
+				__FUNCTION__, *counter, target, what, VMX_QUIESCE_WARN_USECS/1000);
+			warned = true;
+		}
+		cpu_relax();
+	}
+}
+
 //quiesce interface to switch all guest cores into hypervisor mode
 //note: we are in atomic processsing mode for this "vcpu"
 void xmhf_smpguest_arch_x86vmx_quiesce(VCPU *vcpu){
 
         //printf("\nCPU(0x%02x): got quiesce signal...", vcpu->id);
         //grab hold of quiesce lock
-        spin_lock(&g_vmx_lock_quiesce);
+        spin_lock_stat(&g_vmx_lock_quiesce, &g_vmx_lock_quiesce_stats);
         //printf("\nCPU(0x%02x): grabbed quiesce lock.", vcpu->id);
 
 		vcpu->quiesced = 1;
@@ -420,13 +677,24 @@ void xmhf_smpguest_arch_x86vmx_quiesce(VCPU *vcpu){
         g_vmx_quiesce_counter=0;
         spin_unlock(&g_vmx_lock_quiesce_counter);
         
+        //post the quiesce request to every other CPU, so that the NMI we
+        //send them can be told apart from NMIs meant for the guest
+        {
+			u32 i;
+			for(i=0; i < g_midtable_numentries; i++){
+				VCPU *other = (VCPU *)g_midtable[i].vcpu_vaddr_ptr;
+				if(other != vcpu)
+					*(volatile u32 *)&other->quiesce_request = 1;
+			}
+        }
+
         //send all the other CPUs the quiesce signal
         g_vmx_quiesce=1;  //we are now processing quiesce
         _vmx_send_quiesce_signal(vcpu);
         
         //wait for all the remaining CPUs to quiesce
         //printf("\nCPU(0x%02x): waiting for other CPUs to respond...", vcpu->id);
-        while(g_vmx_quiesce_counter < (g_midtable_numentries-1) );
+        vmx_quiesce_wait(&g_vmx_quiesce_counter, g_midtable_numentries-1, "quiesced");
         //printf("\nCPU(0x%02x): all CPUs quiesced successfully.", vcpu->id);
 
 }
@@ -441,7 +709,7 @@ void xmhf_smpguest_arch_x86vmx_endquiesce(VCPU *vcpu){
         //printf("\nCPU(0x%02x): waiting for other CPUs to resume...", vcpu->id);
         g_vmx_quiesce_resume_signal=1;
         
-        while(g_vmx_quiesce_resume_counter < (g_midtable_numentries-1) );
+        vmx_quiesce_wait(&g_vmx_quiesce_resume_counter, g_midtable_numentries-1, "resumed");
 
 		vcpu->quiesced=0;
         g_vmx_quiesce=0;  // we are out of quiesce at this point
@@ -455,12 +723,41 @@ void xmhf_smpguest_arch_x86vmx_endquiesce(VCPU *vcpu){
                 
         //release quiesce lock
         //printf("\nCPU(0x%02x): releasing quiesce lock.", vcpu->id);
-        spin_unlock(&g_vmx_lock_quiesce);
+        spin_unlock_stat(&g_vmx_lock_quiesce, &g_vmx_lock_quiesce_stats);
 
         
 }
 
+//most NMIs the guest can have outstanding: one being injected (or
+//handled, with virtual-NMI blocking) and one latched behind it
+#define VMX_GUEST_NMI_PENDING_MAX	2
+
+//add delta (1 or -1) to the NMIs queued for the guest, keeping them
+//within 0..VMX_GUEST_NMI_PENDING_MAX; returns 1 if the count changed.
+//the NMI handler can cut in on injectnmi on this CPU, so the update is
+//a single locked cmpxchg that can't lose the other's
+static u32 vmx_nmi_pending_add(VCPU *vcpu, s32 delta){
+	u32 old, new, prev;
+
+	do{
+		old = vcpu->vmx_guest_nmi_pending;
+		if((delta < 0 && old == 0) ||
+			(delta > 0 && old >= VMX_GUEST_NMI_PENDING_MAX))
+			return 0;
+		new = old + delta;
+		__asm__ __volatile__ ("lock; cmpxchgl %2, %1"
+			: "=a" (prev), "+m" (vcpu->vmx_guest_nmi_pending)
+			: "r" (new), "0" (old)
+			: "memory", "cc");
+	}while(prev != old);
+
+	return 1;
+}
+
 //quiescing handler for #NMI (non-maskable interrupt) exception event
+//NMIs are either a quiesce request from another core, which will have
+//posted vcpu->quiesce_request first, or meant for the guest, in which
+//case they are queued and injected by xmhf_smpguest_arch_x86vmx_injectnmi
 //note: we are in atomic processsing mode for this "vcpu"
 void xmhf_smpguest_arch_x86vmx_eventhandler_nmiexception(VCPU *vcpu, struct regs *r){
 	u32 nmiinhvm;	//1 if NMI originated from the HVM else 0 if within the hypervisor
@@ -469,6 +766,33 @@ void xmhf_smpguest_arch_x86vmx_eventhandler_nmiexception(VCPU *vcpu, struct regs
 
     (void)r;
 
+	if(*(volatile u32 *)&vcpu->quiesce_request){
+		//quiesce regardless of where the NMI originated from. a guest
+		//NMI arriving alongside the request is merged with it, as the
+		//hardware would merge two NMIs arriving while NMIs are blocked
+		*(volatile u32 *)&vcpu->quiesce_request = 0;
+
+		vcpu->quiesced=1;
+	
+		//increment quiesce counter
+		spin_lock(&g_vmx_lock_quiesce_counter);
+		g_vmx_quiesce_counter++;
+		spin_unlock(&g_vmx_lock_quiesce_counter);
+
+		//wait until quiesceing is finished
+		//printf("\nCPU(0x%02x): Quiesced", vcpu->id);
+		while(!*(volatile u32 *)&g_vmx_quiesce_resume_signal)
+			cpu_relax();
+		//printf("\nCPU(0x%02x): EOQ received, resuming...", vcpu->id);
+
+		spin_lock(&g_vmx_lock_quiesce_resume_counter);
+		g_vmx_quiesce_resume_counter++;
+		spin_unlock(&g_vmx_lock_quiesce_resume_counter);
+			
+		vcpu->quiesced=0;
+		return;
+	}
+
 	//determine if the NMI originated within the HVM or within the
 	//hypervisor. we use VMCS fields for this purpose. note that we
 	//use vmread directly instead of relying on vcpu-> to avoid 
@@ -477,46 +801,54 @@ void xmhf_smpguest_arch_x86vmx_eventhandler_nmiexception(VCPU *vcpu, struct regs
 	__vmx_vmread(0x4402, &_vmx_vmcs_info_vmexit_reason);
 	
 	nmiinhvm = ( (_vmx_vmcs_info_vmexit_reason == VMX_VMEXIT_EXCEPTION) && ((_vmx_vmcs_info_vmexit_interrupt_information & INTR_INFO_VECTOR_MASK) == 2) ) ? 1 : 0;
-	
-	if(g_vmx_quiesce){ //if g_vmx_quiesce =1 process quiesce regardless of where NMI originated from
-		//if this core has been quiesced, simply return
-			if(vcpu->quiesced)
-				return;
-				
-			vcpu->quiesced=1;
-	
-			//increment quiesce counter
-			spin_lock(&g_vmx_lock_quiesce_counter);
-			g_vmx_quiesce_counter++;
-			spin_unlock(&g_vmx_lock_quiesce_counter);
-
-			//wait until quiesceing is finished
-			//printf("\nCPU(0x%02x): Quiesced", vcpu->id);
-			while(!g_vmx_quiesce_resume_signal);
-			//printf("\nCPU(0x%02x): EOQ received, resuming...", vcpu->id);
-
-			spin_lock(&g_vmx_lock_quiesce_resume_counter);
-			g_vmx_quiesce_resume_counter++;
-			spin_unlock(&g_vmx_lock_quiesce_resume_counter);
-			
-			vcpu->quiesced=0;
-	}else{
-		//we are not in quiesce
-		//inject the NMI if it was triggered in guest mode
-		
-		if(nmiinhvm){
-			if(vcpu->vmcs.control_exception_bitmap & CPU_EXCEPTION_NMI){
-				//TODO: hypapp has chosen to intercept NMI so callback
-			}else{
-				//printf("\nCPU(0x%02x): Regular NMI, injecting back to guest...", vcpu->id);
-				vcpu->vmcs.control_VM_entry_exception_errorcode = 0;
-				vcpu->vmcs.control_VM_entry_interruption_information = NMI_VECTOR |
-					INTR_TYPE_NMI |
-					INTR_INFO_VALID_MASK;
-			}
+
+	if(nmiinhvm && (vcpu->vmcs.control_exception_bitmap & CPU_EXCEPTION_NMI)){
+		//TODO: hypapp has chosen to intercept NMI so callback
+		return;
+	}
+
+	//queue the NMI for the guest
+	vmx_nmi_pending_add(vcpu, 1);
+
+	//ask for an exit as soon as the guest can take it. if the NMI hit
+	//while we were handling an intercept, the VMCS fields in vcpu-> are
+	//written back before the guest resumes, so set it there as well as
+	//in the current VMCS. without virtual NMIs it is injected on the
+	//next intercept
+	if(vcpu->vmx_guest_vnmi){
+		vcpu->vmcs.control_VMX_cpu_based |= VMX_PROCBASED_NMI_WINDOW_EXITING;
+		__vmx_vmwrite(0x4002, vcpu->vmcs.control_VMX_cpu_based);
+	}
+}
+
+//inject a queued guest NMI if the guest can take it, and keep NMI-window
+//exiting on for as long as more are queued. called on the VMCS fields
+//in vcpu-> before they are written back on the way to the guest, by
+//which time guest_interruptibility holds no more than NMI blocking
+void xmhf_smpguest_arch_x86vmx_injectnmi(VCPU *vcpu){
+	if(!(vcpu->vmcs.control_VM_entry_interruption_information & INTR_INFO_VALID_MASK) &&
+		( !vcpu->vmx_guest_vnmi ||
+		  !(vcpu->vmcs.guest_interruptibility & GUEST_INTR_STATE_NMI) ) &&
+		vmx_nmi_pending_add(vcpu, -1)){
+		//printf("\nCPU(0x%02x): Regular NMI, injecting back to guest...", vcpu->id);
+		vcpu->vmcs.control_VM_entry_exception_errorcode = 0;
+		vcpu->vmcs.control_VM_entry_interruption_information = NMI_VECTOR |
+			INTR_TYPE_NMI |
+			INTR_INFO_VALID_MASK;
+	}
+
+	if(vcpu->vmx_guest_vnmi){
+		if(vcpu->vmx_guest_nmi_pending){
+			vcpu->vmcs.control_VMX_cpu_based |= VMX_PROCBASED_NMI_WINDOW_EXITING;
+		}else{
+			vcpu->vmcs.control_VMX_cpu_based &= ~VMX_PROCBASED_NMI_WINDOW_EXITING;
+			//an NMI that came in since the check above queued itself and
+			//set the bit, which the clear may just have undone
+			__asm__ __volatile__ ("" : : : "memory");
+			if(vcpu->vmx_guest_nmi_pending)
+				vcpu->vmcs.control_VMX_cpu_based |= VMX_PROCBASED_NMI_WINDOW_EXITING;
 		}
 	}
-	
 }
 
 //----------------------------------------------------------------------
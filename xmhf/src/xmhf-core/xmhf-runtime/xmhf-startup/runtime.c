@@ -65,10 +65,20 @@ void xmhf_runtime_entry(void){
 	//setup debugging	
 	xmhf_debug_init((char *)&rpb->RtmUartConfig);
 	printf("\nruntime initializing...");
+	xmhf_baseplatform_spinlock_stats_register(&g_emhfc_putchar_linelock_stats);
 
   	//initialize basic platform elements
 	xmhf_baseplatform_initialize();
 
+	#ifndef __XMHF_VERIFICATION__
+	//discover PCI Express ECAM and build the PCI device inventory
+	//(runtime only; the SL cannot afford the inventory's footprint)
+	xmhf_baseplatform_arch_x86_pci_enumerate();
+
+	//calibrate the TSC while the PIT is still ours
+	xmhf_baseplatform_arch_x86_tsc_calibrate();
+	#endif //__XMHF_VERIFICATION__
+
     //[debug] dump E820 and MP table
  	#ifndef __XMHF_VERIFICATION__
  	printf("\nNumber of E820 entries = %u", rpb->XtVmmE820NumEntries);
@@ -190,6 +200,10 @@ void xmhf_runtime_main(VCPU *vcpu, u32 isEarlyInit){
 		while(g_appmain_success_counter < g_midtable_numentries);	
 		printf("\nCPU(0x%02x): All cores have successfully been through appmain.", vcpu->id);
   }
+
+  //put PCI config filters registered by the app in place
+  if(vcpu->isbsp && vcpu->cpu_vendor == CPU_VENDOR_INTEL)
+	xmhf_baseplatform_arch_x86vmx_pcifilter_activate(vcpu);
 #endif
 
   //late initialization is still WiP and we can get only this far 
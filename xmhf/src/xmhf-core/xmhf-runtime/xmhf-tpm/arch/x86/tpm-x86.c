@@ -56,10 +56,13 @@
 //static (local) decls./defns.
 //======================================================================
 
-static void cpu_relax(void){
-    __asm__ __volatile__ ("pause");
-}
+/* the TPM's interface, as found by tpm_probe_interface() */
+#define TPM_INTF_UNKNOWN    0
+#define TPM_INTF_FIFO       1   /* TIS FIFO, single byte data accesses */
+#define TPM_INTF_FIFO_WIDE  2   /* TIS 1.3 FIFO, 4-byte data accesses */
+#define TPM_INTF_CRB        3   /* PTP command response buffer */
 
+static int g_tpm_intf = TPM_INTF_UNKNOWN;
 
 static void _read_tpm_reg(int locality, u32 reg, u8 *_raw, size_t size)
 {
@@ -75,6 +78,187 @@ static void _write_tpm_reg(int locality, u32 reg, u8 *_raw, size_t size)
         writeb((TPM_LOCALITY_BASE_N(locality) | reg) + i, _raw[i]);
 }
 
+static u32 read_tpm_reg32(uint32_t locality, u32 reg)
+{
+    return readl(TPM_LOCALITY_BASE_N(locality) | reg);
+}
+
+static void write_tpm_reg32(uint32_t locality, u32 reg, u32 val)
+{
+    writel(TPM_LOCALITY_BASE_N(locality) | reg, val);
+}
+
+/*
+ * finds out whether the TPM has a CRB or a FIFO interface, and whether
+ * the FIFO takes 4-byte accesses. the interface id and capability
+ * registers can be read at any locality, active or not.
+ */
+static void tpm_probe_interface(void)
+{
+    u32 intf_id, intf_cap;
+
+    intf_id = read_tpm_reg32(0, TPM_REG_INTERFACE_ID);
+    intf_cap = read_tpm_reg32(0, TPM_REG_INTF_CAPABILITY);
+    if ( TPM_INTERFACE_ID_TYPE(intf_id) == TPM_INTERFACE_TYPE_CRB ) {
+        g_tpm_intf = TPM_INTF_CRB;
+        printf("TPM: CRB interface\n");
+    } else if ( (TPM_INTF_CAP_VERSION(intf_cap) == TPM_INTF_VERSION_TIS13 ||
+                 TPM_INTF_CAP_VERSION(intf_cap) == TPM_INTF_VERSION_PTP) &&
+                TPM_INTF_CAP_TRANSFER_SIZE(intf_cap) != 0 ) {
+        g_tpm_intf = TPM_INTF_FIFO_WIDE;
+        printf("TPM: TIS 1.3 FIFO interface\n");
+    } else {
+        g_tpm_intf = TPM_INTF_FIFO;
+        printf("TPM: TIS FIFO interface\n");
+    }
+}
+
+static int tpm_interface(void)
+{
+    if ( g_tpm_intf == TPM_INTF_UNKNOWN )
+        tpm_probe_interface();
+    return g_tpm_intf;
+}
+
+/* TPM_STS_x, in one access where the interface allows it */
+static void read_tpm_sts(uint32_t locality, tpm_reg_sts_t *reg_sts)
+{
+    u32 sts;
+
+    if ( g_tpm_intf == TPM_INTF_FIFO_WIDE ) {
+        sts = read_tpm_reg32(locality, TPM_REG_STS);
+        memcpy(reg_sts->_raw, &sts, sizeof(reg_sts->_raw));
+    } else
+        read_tpm_reg(locality, TPM_REG_STS, reg_sts);
+}
+
+/*
+ * move n bytes between buf and the TPM at addr, which is the data FIFO
+ * if stride is 0, or a 4-byte aligned CRB buffer if it is 1. accesses
+ * are 4 bytes wide unless the interface only takes single bytes.
+ */
+static void tpm_write_data(u32 addr, u32 stride, const uint8_t *buf,
+                           uint32_t n)
+{
+    u32 val;
+
+    if ( g_tpm_intf != TPM_INTF_FIFO ) {
+        for ( ; n >= sizeof(val); n -= sizeof(val), buf += sizeof(val),
+                  addr += stride * sizeof(val) ) {
+            memcpy(&val, buf, sizeof(val));
+            writel(addr, val);
+        }
+    }
+    for ( ; n > 0; n--, buf++, addr += stride )
+        writeb(addr, *buf);
+}
+
+static void tpm_read_data(u32 addr, u32 stride, uint8_t *buf, uint32_t n)
+{
+    u32 val;
+
+    if ( g_tpm_intf != TPM_INTF_FIFO ) {
+        for ( ; n >= sizeof(val); n -= sizeof(val), buf += sizeof(val),
+                  addr += stride * sizeof(val) ) {
+            val = readl(addr);
+            memcpy(buf, &val, sizeof(val));
+        }
+    }
+    for ( ; n > 0; n--, buf++, addr += stride )
+        *buf = readb(addr);
+}
+
+typedef struct {
+    u64 deadline;
+    u32 delay;
+} tpm_poll_t;
+
+static void tpm_poll_start(tpm_poll_t *poll, u32 usecs)
+{
+    poll->deadline = xmhf_baseplatform_arch_x86_deadline(usecs);
+    poll->delay = 0;
+}
+
+/*
+ * wait before polling a register that wasn't ready yet again, for
+ * twice as long each time, up to TPM_POLL_MAX_DELAY us. a command can
+ * keep the TPM busy for hundreds of ms, and spinning on its status
+ * register all that time would tie up the LPC bus, which the guest
+ * shares. the TPM's interrupts are no use here, as the hypervisor runs
+ * with interrupts off. the wait spins on the TSC rather than calling
+ * udelay(), which falls back to the LAPIC timer where the TSC isn't
+ * invariant, and the guest owns that timer once it has booted. returns
+ * false once the timeout has passed.
+ */
+static bool tpm_poll(tpm_poll_t *poll)
+{
+    u64 until;
+
+    if ( xmhf_baseplatform_arch_x86_deadline_passed(poll->deadline) )
+        return false;
+
+    if ( poll->delay == 0 ) {
+        cpu_relax();
+        poll->delay = 1;
+    } else {
+        until = xmhf_baseplatform_arch_x86_deadline(poll->delay);
+        while ( !xmhf_baseplatform_arch_x86_deadline_passed(until) &&
+                !xmhf_baseplatform_arch_x86_deadline_passed(poll->deadline) )
+            cpu_relax();
+        if ( poll->delay < TPM_POLL_MAX_DELAY )
+            poll->delay <<= 1;
+    }
+    return true;
+}
+
+/* ask for locality N, give it up, and see whether it is the active one */
+static void request_locality(uint32_t locality)
+{
+    tpm_reg_access_t reg_acc;
+
+    if ( tpm_interface() == TPM_INTF_CRB ) {
+        write_tpm_reg32(locality, TPM_CRB_REG_LOC_CTRL,
+                        TPM_CRB_LOC_CTRL_REQUEST);
+        return;
+    }
+
+    reg_acc._raw[0] = 0;
+    reg_acc.request_use = 1;
+    write_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
+}
+
+static void relinquish_locality(uint32_t locality)
+{
+    tpm_reg_access_t reg_acc;
+
+    if ( tpm_interface() == TPM_INTF_CRB ) {
+        write_tpm_reg32(locality, TPM_CRB_REG_LOC_CTRL,
+                        TPM_CRB_LOC_CTRL_RELINQUISH);
+        return;
+    }
+
+    /* make inactive by writing a 1 */
+    reg_acc._raw[0] = 0;
+    reg_acc.active_locality = 1;
+    write_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
+}
+
+static bool locality_active(uint32_t locality)
+{
+    tpm_reg_access_t reg_acc;
+    u32 state;
+
+    if ( tpm_interface() == TPM_INTF_CRB ) {
+        state = read_tpm_reg32(locality, TPM_CRB_REG_LOC_STATE);
+        return (state & TPM_CRB_LOC_STATE_VALID) &&
+               (state & TPM_CRB_LOC_STATE_ASSIGNED) &&
+               TPM_CRB_LOC_STATE_ACTIVE(state) == locality;
+    }
+
+    read_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
+    return reg_acc.active_locality == 1;
+}
+
 
 static tpm_timeout_t g_timeout = {TIMEOUT_A,
                                   TIMEOUT_B,
@@ -87,6 +271,14 @@ static bool tpm_validate_locality(uint32_t locality)
     tpm_reg_access_t reg_acc;
 
     for ( i = TPM_VALIDATE_LOCALITY_TIME_OUT; i > 0; i-- ) {
+        if ( tpm_interface() == TPM_INTF_CRB ) {
+            if ( read_tpm_reg32(locality, TPM_CRB_REG_LOC_STATE) &
+                 TPM_CRB_LOC_STATE_VALID )
+                return true;
+            cpu_relax();
+            continue;
+        }
+
         /*
          * TCG spec defines reg_acc.tpm_reg_valid_sts bit to indicate whether
          * other bits of access reg are valid.( but this bit will also be 1
@@ -277,8 +469,7 @@ static bool is_tpm_ready(uint32_t locality)
 
 static bool release_locality(uint32_t locality)
 {
-    uint32_t i;
-    tpm_reg_access_t reg_acc;
+    tpm_poll_t poll;
 #ifdef TPM_TRACE
     printf("TPM: releasing locality %u\n", locality);
 #endif
@@ -286,24 +477,16 @@ static bool release_locality(uint32_t locality)
     if ( !tpm_validate_locality(locality) )
         return true;
 
-    read_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
-    if ( reg_acc.active_locality == 0 )
+    if ( !locality_active(locality) )
         return true;
 
-    /* make inactive by writing a 1 */
-    reg_acc._raw[0] = 0;
-    reg_acc.active_locality = 1;
-    write_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
+    relinquish_locality(locality);
 
-    i = 0;
+    tpm_poll_start(&poll, TPM_ACTIVE_LOCALITY_TIME_OUT);
     do {
-        read_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
-        if ( reg_acc.active_locality == 0 )
+        if ( !locality_active(locality) )
             return true;
-        else
-            cpu_relax();
-        i++;
-    } while ( i <= TPM_ACTIVE_LOCALITY_TIME_OUT );
+    } while ( tpm_poll(&poll) );
 
     printf("TPM: access reg release locality timeout\n");
     return false;
@@ -315,15 +498,11 @@ static bool release_locality(uint32_t locality)
 
 //deactivate all TPM localities
 void xmhf_tpm_arch_deactivate_all_localities(void) {
-    tpm_reg_access_t reg_acc;
     uint32_t locality;
 
     printf("\nTPM: %s()\n", __FUNCTION__);
-    for(locality=0; locality <= 3; locality++) {    
-        reg_acc._raw[0] = 0;
-        reg_acc.active_locality = 1;
-        write_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
-    }
+    for(locality=0; locality <= 3; locality++)
+        relinquish_locality(locality);
 }
 
 
@@ -347,6 +526,8 @@ int xmhf_tpm_arch_open_locality(int locality){
 
 //prepare TPM for use
 bool xmhf_tpm_arch_prepare_tpm(void){
+    tpm_probe_interface();
+
     /*
      * must ensure TPM_ACCESS_0.activeLocality bit is clear
      * (: locality is not active)
@@ -364,8 +545,7 @@ bool xmhf_tpm_arch_prepare_tpm(void){
 
 uint32_t tpm_wait_cmd_ready(uint32_t locality)
 {
-    uint32_t            i;
-    tpm_reg_access_t    reg_acc;
+    tpm_poll_t          poll;
     tpm_reg_sts_t       reg_sts;
 
 /*     //temporary debug prints */
@@ -374,41 +554,44 @@ uint32_t tpm_wait_cmd_ready(uint32_t locality)
 /*     dump_locality_access_regs(); */
 
     /* ensure the contents of the ACCESS register are valid */
-    read_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
-#ifdef TPM_TRACE
-    printf("\nTPM: Access reg content: 0x%02x\n", (uint32_t)reg_acc._raw[0]);
-#endif
-    if ( reg_acc.tpm_reg_valid_sts == 0 ) {
+    if ( !tpm_validate_locality(locality) ) {
         printf("TPM: Access reg not valid\n");
         return TPM_FAIL;
     }
 
     /* request access to the TPM from locality N */
-    reg_acc._raw[0] = 0;
-    reg_acc.request_use = 1;
-    write_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
-
-    i = 0;
-    do {
-        read_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
-        if ( reg_acc.active_locality == 1 )
-            break;
-        else
-            cpu_relax();
-        i++;
-    } while ( i <= TPM_ACTIVE_LOCALITY_TIME_OUT);
+    request_locality(locality);
 
-    if ( i > TPM_ACTIVE_LOCALITY_TIME_OUT ) {
-        printf("TPM: access reg request use timeout (i=%d)\n", i);
-        return TPM_FAIL;
+    tpm_poll_start(&poll, TPM_ACTIVE_LOCALITY_TIME_OUT);
+    while ( !locality_active(locality) ) {
+        if ( !tpm_poll(&poll) ) {
+            printf("TPM: access reg request use timeout\n");
+            return TPM_FAIL;
+        }
     }
 
     /* ensure the TPM is ready to accept a command */
 #ifdef TPM_TRACE
     printf("TPM: wait for cmd ready ");
 #endif
-    i = 0;
-    do {
+    tpm_poll_start(&poll, TPM_CMD_READY_TIME_OUT);
+    if ( g_tpm_intf == TPM_INTF_CRB ) {
+        /* the TPM clears cmdReady once it is ready */
+        write_tpm_reg32(locality, TPM_CRB_REG_CTRL_REQ,
+                        TPM_CRB_CTRL_REQ_CMD_READY);
+        while ( (read_tpm_reg32(locality, TPM_CRB_REG_CTRL_REQ) &
+                 TPM_CRB_CTRL_REQ_CMD_READY) ||
+                (read_tpm_reg32(locality, TPM_CRB_REG_CTRL_STS) &
+                 TPM_CRB_CTRL_STS_IDLE) ) {
+            if ( !tpm_poll(&poll) ) {
+                printf("TPM: tpm timeout for CRB cmdReady\n");
+                goto RelinquishControl;
+            }
+        }
+        return TPM_SUCCESS;
+    }
+
+    for ( ;; ) {
         /* write 1 to TPM_STS_x.commandReady to let TPM enter ready state */
         memset((void *)&reg_sts, 0, sizeof(reg_sts));
         reg_sts.command_ready = 1;
@@ -416,39 +599,191 @@ uint32_t tpm_wait_cmd_ready(uint32_t locality)
         cpu_relax();
 
         /* then see if it has */
-        read_tpm_reg(locality, TPM_REG_STS, &reg_sts);
+        read_tpm_sts(locality, &reg_sts);
 #ifdef TPM_TRACE
         printf(".");
 #endif
         if ( reg_sts.command_ready == 1 )
             break;
-        else
-            cpu_relax();
-        i++;
-    } while ( i <= TPM_CMD_READY_TIME_OUT );
+        if ( !tpm_poll(&poll) ) {
+            printf("TPM: status reg content: %02x %02x %02x\n",
+                   (uint32_t)reg_sts._raw[0],
+                   (uint32_t)reg_sts._raw[1],
+                   (uint32_t)reg_sts._raw[2]);
+            printf("TPM: tpm timeout for command_ready\n");
+            goto RelinquishControl;
+        }
+    }
 #ifdef TPM_TRACE
     printf("\n");
 #endif
-
-    if ( i > TPM_CMD_READY_TIME_OUT ) {
-        printf("TPM: status reg content: %02x %02x %02x\n",
-               (uint32_t)reg_sts._raw[0],
-               (uint32_t)reg_sts._raw[1],
-               (uint32_t)reg_sts._raw[2]);
-        printf("TPM: tpm timeout for command_ready\n");
-        goto RelinquishControl;
-    }
     return TPM_SUCCESS;
 
 RelinquishControl:
     /* deactivate current locality */
-    reg_acc._raw[0] = 0;
-    reg_acc.active_locality = 1;
-    write_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
+    relinquish_locality(locality);
 
     return TPM_FAIL;
 }
 
+/* wait for the FIFO to take or have some bytes; 0 on timeout */
+static uint32_t tpm_fifo_burst_count(uint32_t locality, u32 usecs)
+{
+    tpm_poll_t          poll;
+    tpm_reg_sts_t       reg_sts;
+
+    tpm_poll_start(&poll, usecs);
+    do {
+        read_tpm_sts(locality, &reg_sts);
+        if ( reg_sts.burst_count > 0 )
+            return reg_sts.burst_count;
+    } while ( tpm_poll(&poll) );
+
+    return 0;
+}
+
+/* a command through the TIS FIFO, moving burst_count bytes at a time */
+static uint32_t tpm_fifo_cmd(uint32_t locality, uint8_t *in,
+                             uint32_t in_size, uint8_t *out,
+                             uint32_t *out_size)
+{
+    u32                 fifo = TPM_LOCALITY_BASE_N(locality) | TPM_REG_DATA_FIFO;
+    uint32_t            rsp_size, offset, n;
+    bool                have_size;
+    tpm_poll_t          poll;
+    tpm_reg_sts_t       reg_sts;
+
+    /* write the command to the TPM FIFO */
+    for ( offset = 0; offset < in_size; offset += n ) {
+        n = tpm_fifo_burst_count(locality, TPM_CMD_WRITE_TIME_OUT);
+        if ( n == 0 ) {
+            printf("TPM: write cmd timeout\n");
+            return TPM_FAIL;
+        }
+        if ( n > in_size - offset )
+            n = in_size - offset;
+        tpm_write_data(fifo, 0, &in[offset], n);
+    }
+
+    /* command has been written to the TPM, it is time to execute it. */
+    memset(&reg_sts, 0,  sizeof(reg_sts));
+    reg_sts.tpm_go = 1;
+    write_tpm_reg(locality, TPM_REG_STS, &reg_sts);
+
+    /* check for data available */
+    tpm_poll_start(&poll, TPM_DATA_AVAIL_TIME_OUT);
+    for ( ;; ) {
+        read_tpm_sts(locality, &reg_sts);
+        if ( reg_sts.sts_valid == 1 && reg_sts.data_avail == 1 )
+            break;
+        if ( !tpm_poll(&poll) ) {
+            printf("TPM: wait for data available timeout\n");
+            return TPM_FAIL;
+        }
+    }
+
+    /* read up to the size field, and then the rest of the response */
+    rsp_size = RSP_RST_OFFSET;
+    have_size = false;
+    for ( offset = 0; offset < rsp_size && offset < *out_size; offset += n ) {
+        n = tpm_fifo_burst_count(locality, TPM_RSP_READ_TIME_OUT);
+        if ( n == 0 ) {
+            printf("TPM: read rsp timeout\n");
+            return TPM_FAIL;
+        }
+        if ( n > rsp_size - offset )
+            n = rsp_size - offset;
+        if ( n > *out_size - offset )
+            n = *out_size - offset;
+        tpm_read_data(fifo, 0, &out[offset], n);
+
+        /* get outgoing data size */
+        if ( !have_size && offset + n >= RSP_RST_OFFSET ) {
+            reverse_copy(&rsp_size, &out[RSP_SIZE_OFFSET], sizeof(rsp_size));
+            have_size = true;
+        }
+    }
+
+    *out_size = (*out_size > rsp_size) ? rsp_size : *out_size;
+
+    memset(&reg_sts, 0, sizeof(reg_sts));
+    reg_sts.command_ready = 1;
+    write_tpm_reg(locality, TPM_REG_STS, &reg_sts);
+
+    return TPM_SUCCESS;
+}
+
+/* whether a CRB buffer is within the TPM's registers, all that is mapped */
+static bool tpm_crb_buffer_ok(u32 addr, u32 size)
+{
+    return (addr & 3) == 0 && size >= RSP_HEAD_SIZE &&
+           addr >= TPM_LOCALITY_0 && addr < TPM_LOCALITY_4 + PAGE_SIZE_4K &&
+           size <= TPM_LOCALITY_4 + PAGE_SIZE_4K - addr;
+}
+
+/* a command through the CRB */
+static uint32_t tpm_crb_cmd(uint32_t locality, uint8_t *in,
+                            uint32_t in_size, uint8_t *out,
+                            uint32_t *out_size)
+{
+    u32                 cmd_addr, cmd_max, rsp_addr, rsp_max;
+    uint32_t            rsp_size;
+    tpm_poll_t          poll;
+
+    cmd_addr = read_tpm_reg32(locality, TPM_CRB_REG_CMD_LADDR);
+    cmd_max = read_tpm_reg32(locality, TPM_CRB_REG_CMD_SIZE);
+    rsp_addr = read_tpm_reg32(locality, TPM_CRB_REG_RSP_ADDR);
+    rsp_max = read_tpm_reg32(locality, TPM_CRB_REG_RSP_SIZE);
+    if ( !tpm_crb_buffer_ok(cmd_addr, cmd_max) ||
+         !tpm_crb_buffer_ok(rsp_addr, rsp_max) ||
+         read_tpm_reg32(locality, TPM_CRB_REG_CMD_HADDR) != 0 ||
+         read_tpm_reg32(locality, TPM_CRB_REG_RSP_ADDR + 4) != 0 ) {
+        printf("TPM: CRB buffers out of reach\n");
+        return TPM_FAIL;
+    }
+    if ( in_size > cmd_max ) {
+        printf("TPM: cmd too large for CRB buffer\n");
+        return TPM_BAD_PARAMETER;
+    }
+    if ( *out_size < RSP_HEAD_SIZE ) {
+        printf("TPM: out buffer too small for a response\n");
+        return TPM_BAD_PARAMETER;
+    }
+
+    tpm_write_data(cmd_addr, 1, in, in_size);
+    write_tpm_reg32(locality, TPM_CRB_REG_CTRL_START, 1);
+
+    /* the TPM clears start once the response is in */
+    tpm_poll_start(&poll, TPM_DATA_AVAIL_TIME_OUT);
+    while ( read_tpm_reg32(locality, TPM_CRB_REG_CTRL_START) & 1 ) {
+        if ( !tpm_poll(&poll) ) {
+            printf("TPM: wait for data available timeout\n");
+            return TPM_FAIL;
+        }
+    }
+    if ( read_tpm_reg32(locality, TPM_CRB_REG_CTRL_STS) &
+         TPM_CRB_CTRL_STS_ERROR ) {
+        printf("TPM: CRB fatal error\n");
+        return TPM_FAIL;
+    }
+
+    /* the first 8 bytes have the size, the rest is aligned after them */
+    tpm_read_data(rsp_addr, 1, out, 8);
+    reverse_copy(&rsp_size, &out[RSP_SIZE_OFFSET], sizeof(rsp_size));
+    if ( rsp_size < RSP_HEAD_SIZE )
+        rsp_size = RSP_HEAD_SIZE;
+    if ( rsp_size > rsp_max )
+        rsp_size = rsp_max;
+    if ( rsp_size > *out_size )
+        rsp_size = *out_size;
+    tpm_read_data(rsp_addr + 8, 1, &out[8], rsp_size - 8);
+    *out_size = rsp_size;
+
+    write_tpm_reg32(locality, TPM_CRB_REG_CTRL_REQ, TPM_CRB_CTRL_REQ_GO_IDLE);
+
+    return TPM_SUCCESS;
+}
+
 /*
  *   locality : TPM locality (0 - 3)
  *   in       : All bytes for a single TPM command, including TAG, SIZE,
@@ -473,14 +808,11 @@ RelinquishControl:
  *   return   : 0 = success; if not 0, it equal to the RETURN CODE in out buf.
  */
 
-uint32_t tpm_write_cmd_fifo(uint32_t locality, uint8_t *in,
-                                   uint32_t in_size, uint8_t *out,
-                                   uint32_t *out_size)
+static uint32_t _tpm_write_cmd_fifo(uint32_t locality, uint8_t *in,
+                                    uint32_t in_size, uint8_t *out,
+                                    uint32_t *out_size)
 {
-    uint32_t            i, rsp_size, offset, ret;
-    uint16_t            row_size;
-    tpm_reg_access_t    reg_acc;
-    tpm_reg_sts_t       reg_sts;
+    uint32_t            ret;
 
     if ( locality >= TPM_NR_LOCALITIES ) {
         printf("TPM: Invalid locality for tpm_write_cmd_fifo()\n");
@@ -511,114 +843,38 @@ uint32_t tpm_write_cmd_fifo(uint32_t locality, uint8_t *in,
     }
 #endif
 
-    /* write the command to the TPM FIFO */
-    offset = 0;
-    do {
-        i = 0;
-        do {
-            read_tpm_reg(locality, TPM_REG_STS, &reg_sts);
-            /* find out how many bytes the TPM can accept in a row */
-            row_size = reg_sts.burst_count;
-            if ( row_size > 0 )
-                break;
-            else
-                cpu_relax();
-            i++;
-        } while ( i <= TPM_CMD_WRITE_TIME_OUT );
-        if ( i > TPM_CMD_WRITE_TIME_OUT ) {
-            printf("TPM: write cmd timeout\n");
-            ret = TPM_FAIL;
-            goto RelinquishControl;
-        }
-
-        for ( ; row_size > 0 && offset < in_size; row_size--, offset++ )
-            write_tpm_reg(locality, TPM_REG_DATA_FIFO,
-                          (tpm_reg_data_fifo_t *)&in[offset]);
-    } while ( offset < in_size );
-
-    /* command has been written to the TPM, it is time to execute it. */
-    memset(&reg_sts, 0,  sizeof(reg_sts));
-    reg_sts.tpm_go = 1;
-    write_tpm_reg(locality, TPM_REG_STS, &reg_sts);
-
-    /* check for data available */
-    i = 0;
-    do {
-        read_tpm_reg(locality,TPM_REG_STS, &reg_sts);
-        if ( reg_sts.sts_valid == 1 && reg_sts.data_avail == 1 )
-            break;
-        else
-            cpu_relax();
-        i++;
-    } while ( i <= TPM_DATA_AVAIL_TIME_OUT );
-    if ( i > TPM_DATA_AVAIL_TIME_OUT ) {
-        printf("TPM: wait for data available timeout\n");
-        ret = TPM_FAIL;
-        goto RelinquishControl;
-    }
-
-    rsp_size = 0;
-    offset = 0;
-    do {
-        /* find out how many bytes the TPM returned in a row */
-        i = 0;
-        do {
-            read_tpm_reg(locality, TPM_REG_STS, &reg_sts);
-            row_size = reg_sts.burst_count;
-            if ( row_size > 0 )
-                break;
-            else
-                cpu_relax();
-            i++;
-        } while ( i <= TPM_RSP_READ_TIME_OUT );
-        if ( i > TPM_RSP_READ_TIME_OUT ) {
-            printf("TPM: read rsp timeout\n");
-            ret = TPM_FAIL;
-            goto RelinquishControl;
-        }
-
-        for ( ; row_size > 0 && offset < *out_size; row_size--, offset++ ) {
-            if ( offset < *out_size )
-                read_tpm_reg(locality, TPM_REG_DATA_FIFO,
-                             (tpm_reg_data_fifo_t *)&out[offset]);
-            else {
-                /* discard the responded bytes exceeding out buf size */
-                tpm_reg_data_fifo_t discard;
-                read_tpm_reg(locality, TPM_REG_DATA_FIFO,
-                             (tpm_reg_data_fifo_t *)&discard);
-            }
-
-            /* get outgoing data size */
-            if ( offset == RSP_RST_OFFSET - 1 ) {
-                reverse_copy(&rsp_size, &out[RSP_SIZE_OFFSET],
-                             sizeof(rsp_size));
-            }
-        }
-    } while ( offset < RSP_RST_OFFSET ||
-              (offset < rsp_size && offset < *out_size) );
+    if ( g_tpm_intf == TPM_INTF_CRB )
+        ret = tpm_crb_cmd(locality, in, in_size, out, out_size);
+    else
+        ret = tpm_fifo_cmd(locality, in, in_size, out, out_size);
 
-    *out_size = (*out_size > rsp_size) ? rsp_size : *out_size;
-
-    /* out buffer contains the complete outgoing data, get return code */
-    reverse_copy(&ret, &out[RSP_RST_OFFSET], sizeof(ret));
+    if ( ret == TPM_SUCCESS ) {
+        /* out buffer contains the complete outgoing data, get return code */
+        reverse_copy(&ret, &out[RSP_RST_OFFSET], sizeof(ret));
 
 #ifdef TPM_TRACE
-    {
-        printf("TPM: response size = %d\n", *out_size);
-        printf("TPM: response content: ");
-        print_hex("TPM: \t", out, *out_size);
-    }
+        {
+            printf("TPM: response size = %d\n", *out_size);
+            printf("TPM: response content: ");
+            print_hex("TPM: \t", out, *out_size);
+        }
 #endif
+    }
 
-    memset(&reg_sts, 0, sizeof(reg_sts));
-    reg_sts.command_ready = 1;
-    write_tpm_reg(locality, TPM_REG_STS, &reg_sts);
-
-RelinquishControl:
     /* deactivate current locality */
-    reg_acc._raw[0] = 0;
-    reg_acc.active_locality = 1;
-    write_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
+    relinquish_locality(locality);
+
+    return ret;
+}
+
+uint32_t tpm_write_cmd_fifo(uint32_t locality, uint8_t *in,
+                                   uint32_t in_size, uint8_t *out,
+                                   uint32_t *out_size)
+{
+    u64 start = rdtsc64();
+    uint32_t ret;
 
+    ret = _tpm_write_cmd_fifo(locality, in, in_size, out, out_size);
+    xmhf_tpm_stats_cmd(rdtsc64() - start);
     return ret;
 }
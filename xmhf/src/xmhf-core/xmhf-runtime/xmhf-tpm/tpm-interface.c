@@ -85,9 +85,49 @@ bool xmhf_tpm_is_tpm_ready(uint32_t locality){
 		return xmhf_tpm_arch_is_tpm_ready(locality);
 }
 
+//locality manager state, protected by g_tpm_locality_lock. the
+//locality last acquired stays open after its holders are done with
+//it, so that the next batch of commands at that locality doesn't pay
+//for opening it again: on Intel, the TXT chipset command, and on AMD,
+//the TIS access handshake, followed by the capability commands that
+//check that the TPM is ready. the TIS driver gives up the active
+//locality after every command anyway, so keeping ours open doesn't
+//keep the guest from the TPM.
+static volatile u32 g_tpm_locality_lock = 1;
+static int g_tpm_locality = -1;		//open locality, -1 if none
+static u32 g_tpm_locality_refs = 0;
+static u32 g_tpm_locality_ready = 0;	//bitmask of localities found ready
+static u64 g_tpm_locality_hold_start;
+
+//the statistics have a lock of their own, as commands are timed while
+//g_tpm_locality_lock is held to open a locality
+static volatile u32 g_tpm_stats_lock = 1;
+static XMHF_TPM_STATS g_tpm_stats;
+
+static void tpm_stats_begin(void){
+	spin_lock(&g_tpm_stats_lock);
+	g_tpm_stats.seq++;
+	__asm__ __volatile__ ("" : : : "memory");
+}
+
+static void tpm_stats_end(void){
+	__asm__ __volatile__ ("" : : : "memory");
+	g_tpm_stats.seq++;
+	spin_unlock(&g_tpm_stats_lock);
+}
+
+static void tpm_stats_add(u64 *total, u64 *max, u64 cycles){
+	*total += cycles;
+	if(cycles > *max)
+		*max = cycles;
+}
+
 //deactivate all TPM localities
 void xmhf_tpm_deactivate_all_localities(void){
+	spin_lock(&g_tpm_locality_lock);
 	xmhf_tpm_arch_deactivate_all_localities();
+	g_tpm_locality = -1;
+	spin_unlock(&g_tpm_locality_lock);
 }
 
 //prepare TPM for use
@@ -95,6 +135,115 @@ bool xmhf_tpm_prepare_tpm(void){
 	return xmhf_tpm_arch_prepare_tpm();
 }
 
+int xmhf_tpm_locality_acquire(int locality){
+	u64 start, cycles;
+	int rv = 1;
+
+	if(locality < 1 || locality > 2)
+		return 1;
+
+	spin_lock(&g_tpm_locality_lock);
+
+	if(g_tpm_locality != locality){
+		if(g_tpm_locality_refs > 0){
+			printf("\n%s: locality %d is held, can't open %d\n", __FUNCTION__,
+				g_tpm_locality, locality);
+			goto out;
+		}
+
+		start = rdtsc64();
+		if(g_tpm_locality >= 0){
+			xmhf_tpm_arch_deactivate_all_localities();
+			g_tpm_locality = -1;
+		}
+		if(xmhf_tpm_arch_open_locality(locality)){
+			printf("\n%s: FAILED to open TPM locality %d\n", __FUNCTION__, locality);
+			goto out;
+		}
+		//the TPM can't be disabled or deactivated without a reboot, so
+		//this need only be checked once
+		if(!(g_tpm_locality_ready & (1 << locality))){
+			if(!xmhf_tpm_is_tpm_ready(locality)){
+				printf("\n%s: ERROR TPM is not ready at locality %d\n", __FUNCTION__, locality);
+				xmhf_tpm_arch_deactivate_all_localities();
+				goto out;
+			}
+			g_tpm_locality_ready |= 1 << locality;
+		}
+		g_tpm_locality = locality;
+		cycles = rdtsc64() - start;
+
+		tpm_stats_begin();
+		g_tpm_stats.opens++;
+		tpm_stats_add(&g_tpm_stats.open_cycles, &g_tpm_stats.open_max, cycles);
+		tpm_stats_end();
+	}
+
+	if(g_tpm_locality_refs++ == 0)
+		g_tpm_locality_hold_start = rdtsc64();
+
+	tpm_stats_begin();
+	g_tpm_stats.acquisitions++;
+	tpm_stats_end();
+	rv = 0;
+
+ out:
+	spin_unlock(&g_tpm_locality_lock);
+	return rv;
+}
+
+void xmhf_tpm_locality_release(int locality){
+	spin_lock(&g_tpm_locality_lock);
+	HALT_ON_ERRORCOND(g_tpm_locality == locality && g_tpm_locality_refs > 0);
+
+	if(--g_tpm_locality_refs == 0){
+		tpm_stats_begin();
+		g_tpm_stats.holds++;
+		tpm_stats_add(&g_tpm_stats.hold_cycles, &g_tpm_stats.hold_max,
+			rdtsc64() - g_tpm_locality_hold_start);
+		tpm_stats_end();
+	}
+
+	spin_unlock(&g_tpm_locality_lock);
+}
+
+void xmhf_tpm_locality_relinquish(void){
+	spin_lock(&g_tpm_locality_lock);
+
+	if(g_tpm_locality >= 0 && g_tpm_locality_refs == 0){
+		xmhf_tpm_arch_deactivate_all_localities();
+		g_tpm_locality = -1;
+
+		tpm_stats_begin();
+		g_tpm_stats.relinquishes++;
+		tpm_stats_end();
+	}
+
+	spin_unlock(&g_tpm_locality_lock);
+}
+
+void xmhf_tpm_stats_cmd(u64 cycles){
+	tpm_stats_begin();
+	g_tpm_stats.cmds++;
+	tpm_stats_add(&g_tpm_stats.cmd_cycles, &g_tpm_stats.cmd_max, cycles);
+	tpm_stats_end();
+}
+
+void xmhf_tpm_stats_read(XMHF_TPM_STATS *out){
+	u32 seq;
+
+	//retry while a writer is in the middle of an update
+	do{
+		while((seq = g_tpm_stats.seq) & 1)
+			cpu_relax();
+		__asm__ __volatile__ ("" : : : "memory");
+		*out = g_tpm_stats;
+		__asm__ __volatile__ ("" : : : "memory");
+	}while(g_tpm_stats.seq != seq);
+
+	out->seq = 0;
+}
+
 
 
 
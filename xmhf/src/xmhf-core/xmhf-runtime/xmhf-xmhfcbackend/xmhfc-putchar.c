@@ -50,6 +50,7 @@ void *emhfc_putchar_arg;
 
 static u32 emhfc_putchar_linelock_spinlock = 1;
 void *emhfc_putchar_linelock_arg = &emhfc_putchar_linelock_spinlock;
+SPINLOCK_STATS g_emhfc_putchar_linelock_stats = SPINLOCK_STATS_INITIALIZER("printf_line");
 
 void emhfc_putchar(int ch, void *arg)
 {
@@ -59,10 +60,10 @@ void emhfc_putchar(int ch, void *arg)
 
 void emhfc_putchar_linelock(void *arg)
 {
-  spin_lock(arg);
+  spin_lock_stat(arg, &g_emhfc_putchar_linelock_stats);
 }
 
 void emhfc_putchar_lineunlock(void *arg)
 {
-  spin_unlock(arg);
+  spin_unlock_stat(arg, &g_emhfc_putchar_linelock_stats);
 }
@@ -32,6 +32,10 @@
 
 #include "tomcrypt.h"
 
+#ifdef LTC_XMHF_AESACCEL
+#include <aesaccel.h>
+#endif
+
 #ifdef LTC_RIJNDAEL
 
 #ifndef ENCRYPT_ONLY 
@@ -43,13 +47,31 @@
 #define ECB_TEST rijndael_test
 #define ECB_KS   rijndael_keysize
 
+#ifdef LTC_XMHF_AESACCEL
+static int rijndael_accel_ecb_encrypt(const unsigned char *pt, unsigned char *ct, unsigned long blocks, symmetric_key *skey);
+static int rijndael_accel_ecb_decrypt(const unsigned char *ct, unsigned char *pt, unsigned long blocks, symmetric_key *skey);
+static int rijndael_accel_cbc_encrypt(const unsigned char *pt, unsigned char *ct, unsigned long blocks, unsigned char *IV, symmetric_key *skey);
+static int rijndael_accel_cbc_decrypt(const unsigned char *ct, unsigned char *pt, unsigned long blocks, unsigned char *IV, symmetric_key *skey);
+
+#define ACCEL_ECB_ENC rijndael_accel_ecb_encrypt
+#define ACCEL_ECB_DEC rijndael_accel_ecb_decrypt
+#define ACCEL_CBC_ENC rijndael_accel_cbc_encrypt
+#define ACCEL_CBC_DEC rijndael_accel_cbc_decrypt
+#else
+#define ACCEL_ECB_ENC NULL
+#define ACCEL_ECB_DEC NULL
+#define ACCEL_CBC_ENC NULL
+#define ACCEL_CBC_DEC NULL
+#endif
+
 const struct ltc_cipher_descriptor rijndael_desc =
 {
     "rijndael",
     6,
     16, 32, 16, 10,
     SETUP, ECB_ENC, ECB_DEC, ECB_TEST, ECB_DONE, ECB_KS,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+    ACCEL_ECB_ENC, ACCEL_ECB_DEC, ACCEL_CBC_ENC, ACCEL_CBC_DEC,
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
 };
 
 const struct ltc_cipher_descriptor aes_desc =
@@ -58,7 +80,8 @@ const struct ltc_cipher_descriptor aes_desc =
     6,
     16, 32, 16, 10,
     SETUP, ECB_ENC, ECB_DEC, ECB_TEST, ECB_DONE, ECB_KS,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+    ACCEL_ECB_ENC, ACCEL_ECB_DEC, ACCEL_CBC_ENC, ACCEL_CBC_DEC,
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
 };
 
 #else
@@ -88,6 +111,85 @@ const struct ltc_cipher_descriptor aes_enc_desc =
 
 #endif
 
+#ifdef LTC_XMHF_AESACCEL
+
+/* AES-NI or constant-time AES from libxmhfcrypto's aesaccel, in place
+   of the table-driven code below. aesaccel_key_t has the same layout
+   as struct rijndael_key. */
+
+#define AESACCEL_KEY(skey) ((aesaccel_key_t *)&(skey)->rijndael)
+typedef char aesaccel_key_fits_rijndael_key[(sizeof(aesaccel_key_t) <= sizeof(struct rijndael_key)) ? 1 : -1];
+
+int SETUP(const unsigned char *key, int keylen, int num_rounds, symmetric_key *skey)
+{
+    LTC_ARGCHK(key  != NULL);
+    LTC_ARGCHK(skey != NULL);
+
+    if (keylen != 16 && keylen != 24 && keylen != 32) {
+       return CRYPT_INVALID_KEYSIZE;
+    }
+
+    if (num_rounds != 0 && num_rounds != (10 + ((keylen/8)-2)*2)) {
+       return CRYPT_INVALID_ROUNDS;
+    }
+
+    if (aesaccel_setkey(AESACCEL_KEY(skey), key, keylen * 8) != 0) {
+       return CRYPT_INVALID_KEYSIZE;
+    }
+    return CRYPT_OK;
+}
+
+int ECB_ENC(const unsigned char *pt, unsigned char *ct, symmetric_key *skey)
+{
+    LTC_ARGCHK(pt != NULL);
+    LTC_ARGCHK(ct != NULL);
+    LTC_ARGCHK(skey != NULL);
+
+    aesaccel_encrypt(AESACCEL_KEY(skey), pt, ct, 1);
+    return CRYPT_OK;
+}
+
+#ifndef ENCRYPT_ONLY
+
+int ECB_DEC(const unsigned char *ct, unsigned char *pt, symmetric_key *skey)
+{
+    LTC_ARGCHK(pt != NULL);
+    LTC_ARGCHK(ct != NULL);
+    LTC_ARGCHK(skey != NULL);
+
+    aesaccel_decrypt(AESACCEL_KEY(skey), ct, pt, 1);
+    return CRYPT_OK;
+}
+
+static int rijndael_accel_ecb_encrypt(const unsigned char *pt, unsigned char *ct, unsigned long blocks, symmetric_key *skey)
+{
+    aesaccel_encrypt(AESACCEL_KEY(skey), pt, ct, blocks);
+    return CRYPT_OK;
+}
+
+static int rijndael_accel_ecb_decrypt(const unsigned char *ct, unsigned char *pt, unsigned long blocks, symmetric_key *skey)
+{
+    aesaccel_decrypt(AESACCEL_KEY(skey), ct, pt, blocks);
+    return CRYPT_OK;
+}
+
+/* the mode code leaves IV at the last ciphertext block, as aesaccel does */
+static int rijndael_accel_cbc_encrypt(const unsigned char *pt, unsigned char *ct, unsigned long blocks, unsigned char *IV, symmetric_key *skey)
+{
+    aesaccel_cbc_encrypt(AESACCEL_KEY(skey), IV, pt, ct, blocks);
+    return CRYPT_OK;
+}
+
+static int rijndael_accel_cbc_decrypt(const unsigned char *ct, unsigned char *pt, unsigned long blocks, unsigned char *IV, symmetric_key *skey)
+{
+    aesaccel_cbc_decrypt(AESACCEL_KEY(skey), IV, ct, pt, blocks);
+    return CRYPT_OK;
+}
+
+#endif /* ENCRYPT_ONLY */
+
+#else /* !LTC_XMHF_AESACCEL */
+
 #include "aes_tab.c"
 
 static ulong32 setup_mix(ulong32 temp)
@@ -452,8 +554,10 @@ int ECB_ENC(const unsigned char *pt, unsigned char *ct, symmetric_key *skey)
    return err;
 }
 #endif
+#endif /* LTC_XMHF_AESACCEL */
 
 #ifndef ENCRYPT_ONLY 
+#ifndef LTC_XMHF_AESACCEL
 
 /**
   Decrypts a block of text with AES
@@ -632,6 +736,7 @@ int ECB_DEC(const unsigned char *ct, unsigned char *pt, symmetric_key *skey)
    return err;
 }
 #endif
+#endif /* LTC_XMHF_AESACCEL */
 
 /**
   Performs a self-test of the AES block cipher
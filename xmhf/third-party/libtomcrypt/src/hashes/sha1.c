@@ -9,6 +9,9 @@
  * Tom St Denis, tomstdenis@gmail.com, http://libtom.org
  */
 #include "tomcrypt.h"
+#ifdef LTC_XMHF_HASHACCEL
+#include <hashaccel.h>
+#endif
 
 /**
   @file sha1.c
@@ -41,6 +44,29 @@ const struct ltc_hash_descriptor sha1_desc =
 #define F2(x,y,z)  ((x & y) | (z & (x | y)))
 #define F3(x,y,z)  (x ^ y ^ z)
 
+#ifdef LTC_XMHF_HASHACCEL
+/* XMHF: compress with libbaremetal's hashaccel, which uses SHA-NI
+   when the cpu has it */
+static int sha1_compress_blocks(hash_state *md, const unsigned char *buf, unsigned long nblocks)
+{
+    uint32_t state[5];
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        state[i] = (uint32_t)md->sha1.state[i];
+    }
+    hashaccel_compress(HASHACCEL_SHA1, state, buf, nblocks);
+    for (i = 0; i < 5; i++) {
+        md->sha1.state[i] = state[i];
+    }
+    return CRYPT_OK;
+}
+
+static int sha1_compress(hash_state *md, unsigned char *buf)
+{
+    return sha1_compress_blocks(md, buf, 1);
+}
+#else
 #ifdef LTC_CLEAN_STACK
 static int _sha1_compress(hash_state *md, unsigned char *buf)
 #else
@@ -156,6 +182,7 @@ static int sha1_compress(hash_state *md, unsigned char *buf)
    return err;
 }
 #endif
+#endif /* LTC_XMHF_HASHACCEL */
 
 /**
    Initialize the hash state
@@ -182,7 +209,11 @@ int sha1_init(hash_state * md)
    @param inlen  The length of the data (octets)
    @return CRYPT_OK if successful
 */
+#ifdef LTC_XMHF_HASHACCEL
+HASH_PROCESS_BLOCKS(sha1_process, sha1_compress, sha1_compress_blocks, sha1, 64)
+#else
 HASH_PROCESS(sha1_process, sha1_compress, sha1, 64)
+#endif
 
 /**
    Terminate the hash to get the digest
@@ -9,6 +9,9 @@
  * Tom St Denis, tomstdenis@gmail.com, http://libtom.org
  */
 #include "tomcrypt.h"
+#ifdef LTC_XMHF_HASHACCEL
+#include <hashaccel.h>
+#endif
 
 /**
   @file sha256.c
@@ -64,6 +67,29 @@ static const ulong32 K[64] = {
 #define Gamma0(x)       (S(x, 7) ^ S(x, 18) ^ R(x, 3))
 #define Gamma1(x)       (S(x, 17) ^ S(x, 19) ^ R(x, 10))
 
+#ifdef LTC_XMHF_HASHACCEL
+/* XMHF: compress with libbaremetal's hashaccel, which uses SHA-NI
+   when the cpu has it */
+static int sha256_compress_blocks(hash_state *md, const unsigned char *buf, unsigned long nblocks)
+{
+    uint32_t state[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        state[i] = (uint32_t)md->sha256.state[i];
+    }
+    hashaccel_compress(HASHACCEL_SHA256, state, buf, nblocks);
+    for (i = 0; i < 8; i++) {
+        md->sha256.state[i] = state[i];
+    }
+    return CRYPT_OK;
+}
+
+static int sha256_compress(hash_state *md, unsigned char *buf)
+{
+    return sha256_compress_blocks(md, buf, 1);
+}
+#else
 /* compress 512-bits */
 #ifdef LTC_CLEAN_STACK
 static int _sha256_compress(hash_state * md, unsigned char *buf)
@@ -197,6 +223,7 @@ static int sha256_compress(hash_state * md, unsigned char *buf)
     return err;
 }
 #endif
+#endif /* LTC_XMHF_HASHACCEL */
 
 /**
    Initialize the hash state
@@ -227,7 +254,11 @@ int sha256_init(hash_state * md)
    @param inlen  The length of the data (octets)
    @return CRYPT_OK if successful
 */
+#ifdef LTC_XMHF_HASHACCEL
+HASH_PROCESS_BLOCKS(sha256_process, sha256_compress, sha256_compress_blocks, sha256, 64)
+#else
 HASH_PROCESS(sha256_process, sha256_compress, sha256, 64)
+#endif
 
 /**
    Terminate the hash to get the digest
@@ -376,6 +376,45 @@ int func_name (hash_state * md, const unsigned char *in, unsigned long inlen)
     return CRYPT_OK;                                                                        \
 }
 
+/* like HASH_PROCESS, but hands runs of whole blocks to
+   compress_blocks_name in a single call (XMHF) */
+#define HASH_PROCESS_BLOCKS(func_name, compress_name, compress_blocks_name, state_var, block_size) \
+int func_name (hash_state * md, const unsigned char *in, unsigned long inlen)               \
+{                                                                                           \
+    unsigned long n;                                                                        \
+    int           err;                                                                      \
+    LTC_ARGCHK(md != NULL);                                                                 \
+    LTC_ARGCHK(in != NULL);                                                                 \
+    if (md-> state_var .curlen > sizeof(md-> state_var .buf)) {                             \
+       return CRYPT_INVALID_ARG;                                                            \
+    }                                                                                       \
+    while (inlen > 0) {                                                                     \
+        if (md-> state_var .curlen == 0 && inlen >= block_size) {                           \
+           n = inlen / block_size;                                                          \
+           if ((err = compress_blocks_name (md, in, n)) != CRYPT_OK) {                      \
+              return err;                                                                   \
+           }                                                                                \
+           md-> state_var .length += (ulong64)n * block_size * 8;                           \
+           in             += n * block_size;                                                \
+           inlen          -= n * block_size;                                                \
+        } else {                                                                            \
+           n = MIN(inlen, (block_size - md-> state_var .curlen));                           \
+           memcpy(md-> state_var .buf + md-> state_var.curlen, in, (size_t)n);              \
+           md-> state_var .curlen += n;                                                     \
+           in             += n;                                                             \
+           inlen          -= n;                                                             \
+           if (md-> state_var .curlen == block_size) {                                      \
+              if ((err = compress_name (md, md-> state_var .buf)) != CRYPT_OK) {            \
+                 return err;                                                                \
+              }                                                                             \
+              md-> state_var .length += 8*block_size;                                       \
+              md-> state_var .curlen = 0;                                                   \
+           }                                                                                \
+       }                                                                                    \
+    }                                                                                       \
+    return CRYPT_OK;                                                                        \
+}
+
 /* $Source: /cvs/libtom/libtomcrypt/src/headers/tomcrypt_hash.h,v $ */
 /* $Revision: 1.22 $ */
 /* $Date: 2007/05/12 14:32:35 $ */